@@ -0,0 +1,234 @@
+#!/usr/bin/perl -w
+
+# Creates the ids for well-known http header names:
+#   include/lighttpd/http_header_ids.h (enum liHttpHeaderId)
+#   src/main/http_header_ids.c         (perfect hash: li_http_header_id())
+#
+# Run from the top source directory after changing the list below:
+#   perl contrib/create-http-header-ids.pl
+#
+# The hash is gperf-like:
+#   (len + asso[key[0]] + asso[key[len-2]] + asso[key[len-1]]) & mask
+# with characters lowercased by "| 0x20"; the asso values are searched until
+# every name gets its own slot.
+
+use strict;
+
+my @names = qw(
+	accept
+	accept-charset
+	accept-encoding
+	accept-language
+	accept-ranges
+	access-control-allow-origin
+	age
+	allow
+	authorization
+	cache-control
+	connection
+	content-disposition
+	content-encoding
+	content-language
+	content-length
+	content-location
+	content-range
+	content-type
+	cookie
+	date
+	dnt
+	etag
+	expect
+	expires
+	forwarded
+	host
+	http2-settings
+	if-match
+	if-modified-since
+	if-none-match
+	if-range
+	if-unmodified-since
+	keep-alive
+	last-modified
+	location
+	origin
+	pragma
+	priority
+	proxy-connection
+	range
+	referer
+	retry-after
+	sec-ch-ua
+	sec-ch-ua-mobile
+	sec-ch-ua-platform
+	sec-fetch-dest
+	sec-fetch-mode
+	sec-fetch-site
+	sec-fetch-user
+	server
+	set-cookie
+	strict-transport-security
+	te
+	trailer
+	transfer-encoding
+	upgrade
+	upgrade-insecure-requests
+	user-agent
+	vary
+	via
+	www-authenticate
+	x-forwarded-for
+	x-forwarded-host
+	x-forwarded-proto
+	x-real-ip
+	x-requested-with
+);
+
+my $table_size = 1;
+$table_size *= 2 while $table_size < 2 * scalar(@names);
+my $mask = $table_size - 1;
+
+my ($min_len, $max_len) = (1000, 0);
+foreach my $name (@names) {
+	$min_len = length($name) if length($name) < $min_len;
+	$max_len = length($name) if length($name) > $max_len;
+}
+
+sub ch {
+	my ($name, $pos) = @_;
+	return (ord(substr($name, $pos, 1)) | 0x20) & 0x7f;
+}
+
+sub hash {
+	my ($asso, $name) = @_;
+	my $len = length($name);
+	return ($len + $asso->[ch($name, 0)] + $asso->[ch($name, $len - 2)] + $asso->[ch($name, $len - 1)]) & $mask;
+}
+
+# random walk: change the asso value of a character of a colliding name until there are no collisions
+srand(1);
+my @asso = (0) x 128;
+my @table;
+for (my $round = 0; ; $round++) {
+	die "couldn't find a perfect hash" if $round > 1000000;
+	my @colliding;
+	@table = (0) x $table_size;
+	my $id = 0;
+	foreach my $name (@names) {
+		$id++;
+		my $h = hash(\@asso, $name);
+		if ($table[$h]) {
+			push @colliding, $name;
+		} else {
+			$table[$h] = $id;
+		}
+	}
+	last if !@colliding;
+
+	my $name = $colliding[int(rand(scalar(@colliding)))];
+	my @pos = (0, length($name) - 2, length($name) - 1);
+	$asso[ch($name, $pos[int(rand(3))])] = int(rand($table_size));
+}
+
+sub enum_name {
+	my ($name) = @_;
+	$name = uc($name);
+	$name =~ s/-/_/g;
+	return "LI_HTTP_HEADER_$name";
+}
+
+sub c_list {
+	my ($indent, @values) = @_;
+	my $out = "";
+	for (my $i = 0; $i < @values; $i += 16) {
+		my $last = ($i + 16 >= @values) ? $#values : $i + 15;
+		$out .= $indent . join(", ", @values[$i..$last]) . ($last == $#values ? "" : ",") . "\n";
+	}
+	return $out;
+}
+
+open(my $h, '>', 'include/lighttpd/http_header_ids.h') or die "couldn't write include/lighttpd/http_header_ids.h: $!";
+print $h <<EOF;
+#ifndef _LIGHTTPD_HTTP_HEADER_IDS_H_
+#define _LIGHTTPD_HTTP_HEADER_IDS_H_
+
+/* generated by contrib/create-http-header-ids.pl - don't edit */
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+typedef enum {
+	LI_HTTP_HEADER_UNKNOWN = 0,
+EOF
+foreach my $name (@names) {
+	print $h "\t" . enum_name($name) . ",\n";
+}
+print $h <<EOF;
+
+	LI_HTTP_HEADER_COUNT
+} liHttpHeaderId;
+
+#endif
+EOF
+close($h);
+
+open(my $c, '>', 'src/main/http_header_ids.c') or die "couldn't write src/main/http_header_ids.c: $!";
+print $c <<EOF;
+
+/* generated by contrib/create-http-header-ids.pl - don't edit */
+
+#include <lighttpd/base.h>
+
+#define HTTP_HEADER_MIN_LEN $min_len
+#define HTTP_HEADER_MAX_LEN $max_len
+#define HTTP_HEADER_HASH_MASK $mask
+
+static const guint8 http_header_asso[128] = {
+EOF
+print $c c_list("\t", @asso);
+print $c <<EOF;
+};
+
+static const guint8 http_header_hash_table[$table_size] = {
+EOF
+print $c c_list("\t", @table);
+print $c <<EOF;
+};
+
+static const struct {
+	const gchar *name;
+	guint len;
+} http_header_names[LI_HTTP_HEADER_COUNT] = {
+	{ "", 0 },
+EOF
+foreach my $name (@names) {
+	print $c "\t{ CONST_STR_LEN(\"$name\") },\n";
+}
+print $c <<EOF;
+};
+
+#define HTTP_HEADER_CHAR(c) (((guchar) (c) | 0x20) & 0x7f)
+
+liHttpHeaderId li_http_header_id(const gchar *key, size_t keylen) {
+	guint id;
+
+	if (keylen < HTTP_HEADER_MIN_LEN || keylen > HTTP_HEADER_MAX_LEN) return LI_HTTP_HEADER_UNKNOWN;
+
+	id = http_header_hash_table[(keylen
+		+ http_header_asso[HTTP_HEADER_CHAR(key[0])]
+		+ http_header_asso[HTTP_HEADER_CHAR(key[keylen - 2])]
+		+ http_header_asso[HTTP_HEADER_CHAR(key[keylen - 1])]) & HTTP_HEADER_HASH_MASK];
+
+	if (0 == id || http_header_names[id].len != keylen || 0 != g_ascii_strncasecmp(key, http_header_names[id].name, keylen)) {
+		return LI_HTTP_HEADER_UNKNOWN;
+	}
+	return (liHttpHeaderId) id;
+}
+
+const gchar* li_http_header_id_name(liHttpHeaderId id, guint *len) {
+	if ((guint) id >= LI_HTTP_HEADER_COUNT) id = LI_HTTP_HEADER_UNKNOWN;
+	if (NULL != len) *len = http_header_names[id].len;
+	return http_header_names[id].name;
+}
+EOF
+close($c);
@@ -7,7 +7,7 @@
 
 struct liActionRegexStackElement {
 	GString *string;
-	GMatchInfo *match_info;
+	liRegexMatch *match; /** references string */
 };
 
 struct liActionStack {
@@ -69,6 +69,12 @@ struct liAction {
 		GArray* list; /** array of (action*) */
 
 		liBalancerFunc balancer;
+
+		struct {
+			liConditionDispatch *dispatch;
+			GArray *targets; /** (liAction*) action target for the n-th condition of the chain, can be NULL */
+			liAction *target_else; /** if no condition matched */
+		} dispatch;
 	} data;
 };
 
@@ -96,4 +102,9 @@ LI_API liAction* li_action_new_balancer(liBackendSelectCB bselect, liBackendFall
 /* LI_FORCE_ASSERT(list->refcount == 1)! converts list to a list in place if necessary */
 LI_API void li_action_append_inplace(liAction *list, liAction *element);
 
+/* replaces long "if ... else if ..." chains comparing the same condition variable with ==, =^ or =$
+ * in the tree below a with dispatch actions (in place, first match still wins); call after loading the config
+ */
+LI_API void li_action_compile(liServer *srv, liAction *a);
+
 #endif
@@ -38,6 +38,7 @@ struct liPluginCoreConfig {
 
 	liInstance *inst;
 	GHashTable *listen_sockets;
+	GHashTable *reuseport_sockets; /* "<worker-ndx> <address>" => per-worker SO_REUSEPORT socket */
 
 	liEventSignal sig_hup;
 };
@@ -9,15 +9,33 @@ enum liBackendResult {
 	LI_BACKEND_TIMEOUT /* wait timed out, no free slots available */
 };
 
+enum liBackendHealth {
+	LI_BACKEND_HEALTHY,
+	LI_BACKEND_EJECTED,   /* too many consecutive failures; new requests fail until it recovers */
+	LI_BACKEND_SLOW_START /* recovered; the connection limit ramps up over config->slow_start seconds */
+};
+
+enum liBackendCheckResult {
+	LI_BACKEND_CHECK_OK,
+	LI_BACKEND_CHECK_FAILED,
+	LI_BACKEND_CHECK_NEED_MORE /* wait for more data (or eof) */
+};
+
 typedef enum liBackendResult liBackendResult;
+typedef enum liBackendHealth liBackendHealth;
+typedef enum liBackendCheckResult liBackendCheckResult;
 typedef struct liBackendCallbacks liBackendCallbacks;
 typedef struct liBackendWait liBackendWait;
 typedef struct liBackendConnection liBackendConnection;
 typedef struct liBackendPool liBackendPool;
 typedef struct liBackendConfig liBackendConfig;
+typedef struct liBackendPoolStats liBackendPoolStats;
+typedef struct liBackendHealthOptions liBackendHealthOptions;
 
 typedef void (*liBackendConnectionThreadCB)(liBackendPool *bpool, liWorker *wrk, liBackendConnection *bcon);
 typedef void (*liBackendCB)(liBackendPool *bpool);
+/* response: everything received so far; eof: backend closed the connection */
+typedef liBackendCheckResult (*liBackendCheckCB)(liBackendPool *bpool, const GString *response, gboolean eof);
 
 
 struct liBackendConnection {
@@ -38,6 +56,11 @@ struct liBackendCallbacks {
 
 	/* free pool config */
 	liBackendCB free_cb;
+
+	/* active health checks: validate the response to config->check_request.
+	 * NULL: any response is fine. runs in the first worker, the pool lock is not held.
+	 */
+	liBackendCheckCB check_cb;
 };
 
 
@@ -85,6 +108,44 @@ struct liBackendConfig {
 	 * if you disable this you should have to handle this yourself
 	 */
 	gboolean watch_for_close;
+
+	/* health checks; see li_backend_report() for passive checks */
+
+	/* eject the backend after max_fails consecutive failures (failed connects, failed active checks and
+	 * reported request failures). while ejected new requests fail as if the pool was disabled.
+	 * without active checks an ejected backend comes back after disable_time (10 seconds if that is 0).
+	 * 0: never eject
+	 */
+	guint max_fails;
+
+	/* active checks: the first worker connects to the backend every check_interval seconds, sends
+	 * check_request (if not NULL) and passes the response to callbacks->check_cb; a check has to finish
+	 * within check_interval seconds. an ejected backend only comes back after a successful check.
+	 * 0: no active checks
+	 */
+	guint check_interval;
+	GString *check_request;
+
+	/* after an ejected backend recovered, the connection limit ramps up from 1 to max_connections
+	 * (128 if there is no limit) over slow_start seconds. 0: no ramp
+	 */
+	guint slow_start;
+};
+
+/* health check options of the backend actions; see li_backend_parse_health_option() */
+struct liBackendHealthOptions {
+	guint max_fails, check_interval, slow_start; /* see liBackendConfig */
+	GString *check_path; /* "check-path": path for http checks; not copied, NULL if not set */
+};
+
+struct liBackendPoolStats {
+	GString *address;   /* backend socket address */
+	guint active, idle; /* current connections: used by a vrequest / waiting for one */
+	guint64 requests;   /* connections handed out to vrequests */
+	guint64 reused;     /* ... which already served an earlier request (keep-alive) */
+	liBackendHealth health;
+	guint fails;        /* consecutive failures */
+	guint64 ejections;  /* how often the backend was ejected */
 };
 
 LI_API liBackendPool* li_backend_pool_new(const liBackendConfig *config);
@@ -96,9 +157,36 @@ LI_API void li_backend_wait_stop(liVRequest *vr, liBackendPool *bpool, liBackend
 /* set bcon->fd = -1 if you closed the connection after an error */
 LI_API void li_backend_put(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon, gboolean closecon); /* if closecon == TRUE or bcon->watcher.fd == -1 the connection gets removed */
 
+/* use an active connection for one more request (multiplexing backends); doesn't change the
+ * connection state. returns FALSE if the backend is ejected or disabled - li_backend_get() would fail too.
+ * max_requests has to be checked by the caller (li_backend_put() only closes the connection afterwards).
+ */
+LI_API gboolean li_backend_share(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon);
+
+/* passive health checks: report whether a request that used a connection from the pool succeeded.
+ * failed: the connection broke or timed out, or the backend answered with a server error.
+ * threadsafe; see liBackendConfig.max_fails
+ */
+LI_API void li_backend_report(liWorker *wrk, liBackendPool *bpool, gboolean failed);
+
 /* if an idle connections gets closed; bcon must be INACTIVE (i.e. not detached and not active).
  * call in worker that bcon is attached to.
  */
 LI_API void li_backend_connection_closed(liBackendPool *bpool, liBackendConnection *bcon);
 
+/* snapshot of all pools that were used so far: array of liBackendPoolStats. threadsafe,
+ * but the numbers are not synchronized with each other.
+ * free with li_backend_pools_stats_free()
+ */
+LI_API GArray* li_backend_pools_stats(liServer *srv);
+LI_API void li_backend_pools_stats_free(GArray *stats);
+
+LI_API const gchar* li_backend_health_string(liBackendHealth health);
+
+/* parses the health check options "max-fails", "check-interval", "slow-start" and "check-path" of the
+ * action name (used in the error messages). sets *handled to FALSE if key is none of them;
+ * returns FALSE (after logging an error) if the value is invalid.
+ */
+LI_API gboolean li_backend_parse_health_option(liServer *srv, const gchar *name, GString *key, liValue *value, liBackendHealthOptions *opts, gboolean *handled);
+
 #endif
@@ -22,6 +22,7 @@
 #include <lighttpd/filter.h>
 #include <lighttpd/filter_chunked.h>
 #include <lighttpd/radix.h>
+#include <lighttpd/regex.h>
 #include <lighttpd/fetch.h>
 
 #include <lighttpd/value.h>
@@ -46,6 +47,8 @@
 #include <lighttpd/mimetype.h>
 
 #include <lighttpd/connection.h>
+#include <lighttpd/http2_hpack.h>
+#include <lighttpd/http2.h>
 
 #include <lighttpd/collect.h>
 #include <lighttpd/network.h>
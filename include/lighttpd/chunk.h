@@ -19,13 +19,27 @@ struct liChunkFile {
 	gboolean is_temp; /* file is temporary and will be deleted on cleanup */
 };
 
+/* kernel buffer for forwarding data between sockets with splice();
+ * only one PIPE_CHUNK at a time has data in a pipe, so the data of a
+ * chunk always starts at the head of its pipe
+ */
+struct liChunkPipe {
+	gint refcount;
+
+	int fd[2]; /* read end, write end */
+	goffset length; /* bytes in the pipe */
+	goffset size; /* capacity of the pipe; 0 if the pipe can't be used anymore */
+};
+
 struct liChunk {
-	enum { UNUSED_CHUNK, STRING_CHUNK, MEM_CHUNK, FILE_CHUNK, BUFFER_CHUNK } type;
+	enum { UNUSED_CHUNK, STRING_CHUNK, MEM_CHUNK, FILE_CHUNK, BUFFER_CHUNK, PIPE_CHUNK } type;
 
 	goffset offset;
 	/* if type == FILE_CHUNK and mem != NULL,
 	 * mem contains the data [file.mmap.offset .. file.mmap.offset + file.mmap.length)
 	 * from the file, and file.mmap.start is NULL as mmap failed and read(...) was used.
+	 * if type == PIPE_CHUNK and mem != NULL, the data was read from the pipe:
+	 * mem contains the data [pipe.mem_offset .. pipe.length) of the chunk.
 	 */
 	GByteArray *mem;
 
@@ -46,10 +60,16 @@ struct liChunk {
 			liBuffer *buffer;
 			gsize offset, length;
 		} buffer;
+		struct {
+			liChunkPipe *pipe;
+			goffset length;
+			goffset read; /* data before this chunk offset isn't in the pipe anymore */
+			goffset mem_offset;
+		} pipe;
 	} data;
 
-	/* a chunk can only be in one queue, so we just reserve the memory for the link in it */
-	GList cq_link;
+	/* a chunk can only be in one queue, so the queue is a list through the chunks */
+	liChunk *next;
 };
 
 typedef void (*liCQLimitNotifyCB)(gpointer context, gboolean locked);
@@ -72,12 +92,15 @@ struct liChunkQueue {
 	goffset bytes_in, bytes_out, length, mem_usage;
 	liCQLimit *limit; /* limit is the sum of all { c->mem->len | c->type == STRING_CHUNK } */
 /* private */
-	GQueue queue;
+	struct {
+		liChunk *head, *tail;
+		guint length; /* number of chunks */
+	} queue;
 };
 
 struct liChunkIter {
 /* private */
-	GList *element;
+	liChunk *element;
 };
 
 #define LI_CHUNK_ERROR li_chunk_error_quark()
@@ -96,6 +119,15 @@ LI_API void li_chunkfile_release(liChunkFile *cf);
  */
 LI_API liHandlerResult li_chunkfile_open(liChunkFile *cf, GError **err);
 
+/******************
+ *   chunkpipe    *
+ ******************/
+
+/* returns NULL if splice() isn't supported */
+LI_API liChunkPipe* li_chunkpipe_new(void);
+LI_API void li_chunkpipe_acquire(liChunkPipe *cp);
+LI_API void li_chunkpipe_release(liChunkPipe *cp);
+
 /******************
  * chunk iterator *
  ******************/
@@ -105,7 +137,7 @@ INLINE gboolean li_chunkiter_next(liChunkIter *iter);
 INLINE goffset li_chunkiter_length(liChunkIter iter);
 
 /* get the data from a chunk; easy in case of a STRING_CHUNK,
- * but needs to do io in case of FILE_CHUNK; the data is _not_ marked as "done"
+ * but needs to do io in case of FILE_CHUNK and PIPE_CHUNK; the data is _not_ marked as "done"
  * may return HANDLER_GO_ON, HANDLER_ERROR
  */
 LI_API liHandlerResult li_chunkiter_read(liChunkIter iter, off_t start, off_t length, char **data_start, off_t *data_len, GError **err);
@@ -180,7 +212,17 @@ LI_API void li_chunkqueue_append_tempfile(liChunkQueue *cq, GString *filename, o
 LI_API void li_chunkqueue_append_tempfile_fd(liChunkQueue *cq, GString *filename, off_t start, off_t length, int fd);
 
 
-/* steal up to length bytes from in and put them into out, return number of bytes stolen */
+/* number of bytes that can be spliced into the write end of cp and appended to cq with
+ * li_chunkqueue_append_pipe; 0 if cp still has data of another chunk
+ */
+LI_API goffset li_chunkqueue_pipe_space(liChunkQueue *cq, liChunkPipe *cp);
+/* length bytes were spliced into cp: extends the last chunk of cq or appends a new PIPE_CHUNK */
+LI_API void li_chunkqueue_append_pipe(liChunkQueue *cq, liChunkPipe *cp, goffset length);
+
+/* steal up to length bytes from in and put them into out, return number of bytes stolen
+ * returns -1 if splitting a PIPE_CHUNK failed to read from the pipe; the data is lost then,
+ * the caller has to fail the request (the bytes moved before the error are still in out)
+ */
 LI_API goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset length);
 
 /* steal all chunks from in and put them into out, return number of bytes stolen */
@@ -192,6 +234,9 @@ LI_API goffset li_chunkqueue_steal_chunk(liChunkQueue *out, liChunkQueue *in);
 /* skip up to length bytes in a chunkqueue, return number of bytes skipped */
 LI_API goffset li_chunkqueue_skip(liChunkQueue *cq, goffset length);
 
+/* first chunk of cq is a PIPE_CHUNK and length bytes were spliced out of its pipe; skip them */
+LI_API goffset li_chunkqueue_skip_spliced(liChunkQueue *cq, goffset length);
+
 /* skip all chunks in a queue (similar to reset, but keeps stats) */
 LI_API goffset li_chunkqueue_skip_all(liChunkQueue *cq);
 
@@ -222,13 +267,12 @@ LI_API void li_chunkqueue_update_last_buffer_size(liChunkQueue *cq, goffset add_
  ********************/
 
 INLINE liChunk* li_chunkiter_chunk(liChunkIter iter) {
-	if (!iter.element) return NULL;
-	return (liChunk*) iter.element->data;
+	return iter.element;
 }
 
 INLINE gboolean li_chunkiter_next(liChunkIter *iter) {
 	if (!iter || !iter->element) return FALSE;
-	return NULL != (iter->element = g_list_next(iter->element));
+	return NULL != (iter->element = iter->element->next);
 }
 
 INLINE goffset li_chunkiter_length(liChunkIter iter) {
@@ -248,18 +292,20 @@ INLINE goffset li_chunk_length(liChunk *c) {
 		return c->data.file.length - c->offset;
 	case BUFFER_CHUNK:
 		return c->data.buffer.length - c->offset;
+	case PIPE_CHUNK:
+		return c->data.pipe.length - c->offset;
 	}
 	return 0;
 }
 
 INLINE liChunkIter li_chunkqueue_iter(liChunkQueue *cq) {
 	liChunkIter i;
-	i.element = g_queue_peek_head_link(&cq->queue);
+	i.element = cq->queue.head;
 	return i;
 }
 
 INLINE liChunk* li_chunkqueue_first_chunk(liChunkQueue *cq) {
-	return (liChunk*) g_queue_peek_head(&cq->queue);
+	return cq->queue.head;
 }
 
 #endif
@@ -90,7 +90,7 @@ struct liConditionRValue {
 
 	gboolean b;
 	GString *string;
-	GRegex *regex;
+	liRegex *regex;
 	gint64 i;
 	struct {
 		guint32 addr;
@@ -130,6 +130,23 @@ LI_API liCondLValue li_cond_lvalue_from_string(const gchar *str, guint len);
 
 LI_API liHandlerResult li_condition_check(liVRequest *vr, liCondition *cond, gboolean *result);
 
+/* lookup table for a chain of string conditions on the same lvalue with ==, =^ or =$ (hash table for ==,
+ * tries for prefixes and suffixes); a lookup returns the index of the first condition in the chain
+ * that matches (G_MAXUINT if none matches), i.e. the same result as checking them one after another.
+ */
+LI_API liConditionDispatch* li_condition_dispatch_new(liConditionLValue *lvalue);
+LI_API void li_condition_dispatch_free(liServer *srv, liConditionDispatch *d);
+/* whether cond can be appended to a dispatch table (string rvalue, supported operator) */
+LI_API gboolean li_condition_dispatch_supported(liCondition *cond);
+/* appends cond as next condition in the chain (takes a reference); returns FALSE if cond isn't supported
+ * or has a different lvalue */
+LI_API gboolean li_condition_dispatch_add(liConditionDispatch *d, liCondition *cond);
+LI_API guint li_condition_dispatch_length(liConditionDispatch *d);
+LI_API liConditionLValue* li_condition_dispatch_lvalue(liConditionDispatch *d);
+
+LI_API guint li_condition_dispatch_lookup(liConditionDispatch *d, const gchar *value);
+LI_API liHandlerResult li_condition_dispatch_check(liVRequest *vr, liConditionDispatch *d, guint *index);
+
 /* condition values */
 
 typedef enum {
@@ -152,8 +169,28 @@ typedef struct {
 	} data;
 } liConditionValue;
 
+/* strings in res point to tmpstr, the request or the condition cache of vr; use them before changing any of these */
 LI_API liHandlerResult li_condition_get_value(GString *tmpstr, liVRequest *vr, liConditionLValue *lvalue, liConditionValue *res, liConditionValueType prefer);
 /* tmpstr can be the same as for li_condition_get_value */
 LI_API gchar const* li_condition_value_to_string(GString *tmpstr, liConditionValue *value);
 
+/* per vrequest cache for lvalues which are expensive to get: joined request/response headers
+ * (valid while the liHttpHeaders version doesn't change) and the stat() result for the physical.*
+ * lvalues (valid while physical.path doesn't change). other lvalues are read directly from the request.
+ */
+#define LI_CONDITION_CACHE_MAX_HEADERS 16
+
+struct liConditionCache {
+	GArray *headers;      /* (internal) entries, the first headers_used are valid; strings are reused */
+	guint headers_used;
+
+	GString *stat_path;   /* physical.path the stat result belongs to */
+	gboolean stat_valid, stat_found, stat_isdir, stat_isfile;
+	goffset stat_size;
+};
+
+LI_API void li_condition_cache_init(liConditionCache *cache);
+LI_API void li_condition_cache_reset(liConditionCache *cache);
+LI_API void li_condition_cache_clear(liConditionCache *cache);
+
 #endif
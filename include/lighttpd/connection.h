@@ -28,9 +28,12 @@ typedef enum {
 	LI_CON_STATE_WRITE,
 
 	/** connection was upgraded */
-	LI_CON_STATE_UPGRADED
+	LI_CON_STATE_UPGRADED,
+
+	/** HTTP/2: frames are handled by con->http2, each stream has its own vrequest */
+	LI_CON_STATE_HTTP2
 } liConnectionState;
-#define LI_CON_STATE_LAST LI_CON_STATE_UPGRADED
+#define LI_CON_STATE_LAST LI_CON_STATE_HTTP2
 /* update mod_status too */
 
 typedef struct liConnectionSocketCallbacks liConnectionSocketCallbacks;
@@ -57,6 +60,7 @@ struct liConnection {
 	liConnectionSocket con_sock;
 
 	liConInfo info;
+	liSockAddr remote_addr_buf; /** storage for info.remote_addr if it fits */
 
 	liConnectionState state;
 	gboolean response_headers_sent, expect_100_cont, out_has_all_data;
@@ -67,6 +71,8 @@ struct liConnection {
 	liVRequest *mainvr;
 	liHttpRequestCtx req_parser_ctx;
 
+	liHttp2Connection *http2; /* only in LI_CON_STATE_HTTP2 */
+
 	li_tstamp ts_started; /* when connection was started, not a (v)request */
 
 	/* Keep alive timeout data */
@@ -97,7 +103,8 @@ LI_API void li_connection_update_io_wait(liConnection *con);
 /** aborts an active connection, calls all plugin cleanup handlers */
 LI_API void li_connection_error(liConnection *con); /* used in worker.c */
 
-LI_API void li_connection_start(liConnection *con, liSocketAddress remote_addr, int s, liServerSocket *srv_sock);
+/* remote_addr is copied; NULL: get it from the socket */
+LI_API void li_connection_start(liConnection *con, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock);
 
 /* public function */
 LI_API gchar *li_connection_state_str(liConnectionState state);
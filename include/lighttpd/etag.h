@@ -12,5 +12,7 @@ LI_API gboolean li_http_response_handle_cachable(liVRequest *vr);
 /* mut maybe the same as etag */
 LI_API void li_etag_mutate(GString *mut, GString *etag);
 LI_API void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable);
+/* same as li_etag_set_header, but for a representation with content encoding (like mod_deflate: etag is mutated with the encoding name) */
+LI_API void li_etag_set_header_encoded(liVRequest *vr, struct stat *st, const gchar *encoding, gboolean *cachable);
 
 #endif
@@ -0,0 +1,16 @@
+#ifndef _LIGHTTPD_FILTER_CACHE_FILE_H_
+#define _LIGHTTPD_FILTER_CACHE_FILE_H_
+
+#include <lighttpd/base.h>
+
+/* size of the cache file, -1 if it wasn't written (error or aborted stream); vr may be NULL */
+typedef void (*liFilterCacheFileCB)(liVRequest *vr, goffset size, gpointer data);
+
+/* output filter which forwards the stream and writes a copy into a tempfile next to filename (missing
+ * directories are created); the tempfile is renamed to filename at end-of-stream. on errors the tempfile
+ * is removed and the data is still forwarded.
+ * done_cb (may be NULL) is called exactly once, also if no filter could be added (returns NULL then).
+ */
+LI_API liFilter* li_filter_cache_file(liVRequest *vr, const gchar *filename, liFilterCacheFileCB done_cb, gpointer data);
+
+#endif
@@ -0,0 +1,163 @@
+#ifndef _LIGHTTPD_HTTP2_H_
+#define _LIGHTTPD_HTTP2_H_
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+/* HTTP/2 (RFC 7540) on top of a liConnection: the connection only moves frames between
+ * raw_in/raw_out, each stream gets its own liVRequest with its own liConInfo.
+ */
+
+#define LI_HTTP2_PREFACE "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+#define LI_HTTP2_FRAME_HEADER_LEN 9
+#define LI_HTTP2_DEFAULT_WINDOW_SIZE 65535
+#define LI_HTTP2_MAX_FRAME_SIZE 16384   /* SETTINGS_MAX_FRAME_SIZE: we always use (and accept) the default */
+#define LI_HTTP2_MAX_CONCURRENT_STREAMS 100
+
+typedef enum {
+	LI_HTTP2_FRAME_DATA = 0x0,
+	LI_HTTP2_FRAME_HEADERS = 0x1,
+	LI_HTTP2_FRAME_PRIORITY = 0x2,
+	LI_HTTP2_FRAME_RST_STREAM = 0x3,
+	LI_HTTP2_FRAME_SETTINGS = 0x4,
+	LI_HTTP2_FRAME_PUSH_PROMISE = 0x5,
+	LI_HTTP2_FRAME_PING = 0x6,
+	LI_HTTP2_FRAME_GOAWAY = 0x7,
+	LI_HTTP2_FRAME_WINDOW_UPDATE = 0x8,
+	LI_HTTP2_FRAME_CONTINUATION = 0x9
+} liHttp2FrameType;
+
+#define LI_HTTP2_FLAG_END_STREAM  0x1
+#define LI_HTTP2_FLAG_ACK         0x1
+#define LI_HTTP2_FLAG_END_HEADERS 0x4
+#define LI_HTTP2_FLAG_PADDED      0x8
+#define LI_HTTP2_FLAG_PRIORITY    0x20
+
+typedef enum {
+	LI_HTTP2_NO_ERROR = 0x0,
+	LI_HTTP2_PROTOCOL_ERROR = 0x1,
+	LI_HTTP2_INTERNAL_ERROR = 0x2,
+	LI_HTTP2_FLOW_CONTROL_ERROR = 0x3,
+	LI_HTTP2_SETTINGS_TIMEOUT = 0x4,
+	LI_HTTP2_STREAM_CLOSED = 0x5,
+	LI_HTTP2_FRAME_SIZE_ERROR = 0x6,
+	LI_HTTP2_REFUSED_STREAM = 0x7,
+	LI_HTTP2_CANCEL = 0x8,
+	LI_HTTP2_COMPRESSION_ERROR = 0x9,
+	LI_HTTP2_CONNECT_ERROR = 0xa,
+	LI_HTTP2_ENHANCE_YOUR_CALM = 0xb,
+	LI_HTTP2_INADEQUATE_SECURITY = 0xc,
+	LI_HTTP2_HTTP_1_1_REQUIRED = 0xd
+} liHttp2ErrorCode;
+
+typedef enum {
+	LI_HTTP2_SETTINGS_HEADER_TABLE_SIZE = 0x1,
+	LI_HTTP2_SETTINGS_ENABLE_PUSH = 0x2,
+	LI_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS = 0x3,
+	LI_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE = 0x4,
+	LI_HTTP2_SETTINGS_MAX_FRAME_SIZE = 0x5,
+	LI_HTTP2_SETTINGS_MAX_HEADER_LIST_SIZE = 0x6
+} liHttp2SettingsId;
+
+typedef enum {
+	LI_HTTP2_STREAM_STATE_OPEN,
+	LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE, /* received END_STREAM */
+	LI_HTTP2_STREAM_STATE_HALF_CLOSED_LOCAL,  /* sent END_STREAM, still receiving the request body */
+	LI_HTTP2_STREAM_STATE_CLOSED
+} liHttp2StreamState;
+
+struct liHttp2Stream {
+	liHttp2Connection *h2;
+	guint32 id;
+	liHttp2StreamState state;
+
+	liConInfo info;  /* addresses are shared with the connection */
+	liVRequest *vr;
+
+	liStream in;     /* request body from DATA frames (info.req) */
+	liStream out;    /* response body (info.resp); the source gets connected when the headers are ready */
+	guint destroyed; /* number of liStreams (in, out) which received LI_STREAM_DESTROY */
+
+	gint32 send_window, recv_window;
+	guint32 recv_pending; /* received DATA we didn't return with WINDOW_UPDATE yet (consumer is too slow) */
+
+	gboolean headers_ready, headers_sent, end_stream_sent;
+	gboolean expect_100_cont;
+
+	/* priority: weight 1..256, only used to schedule DATA frames between streams */
+	guint16 weight;
+	guint32 depends_on;
+
+	GList send_link; /* in h2->send_queue while there are frames to send */
+};
+
+struct liHttp2Connection {
+	liConnection *con;
+
+	liHPackDecoder decoder;
+	liHPackEncoder encoder;
+
+	/* peer settings */
+	gint32 peer_initial_window_size;
+	guint32 peer_max_concurrent_streams;
+
+	gint32 send_window, recv_window; /* connection flow control */
+
+	GHashTable *streams; /* stream id => liHttp2Stream* */
+	guint32 last_stream_id;   /* highest stream id the client opened */
+	guint active_streams;
+	guint requests;           /* number of handled requests, limited by max-keep-alive-requests */
+
+	GQueue send_queue;        /* (liHttp2Stream*) streams with pending response headers or data */
+	GQueue closed;            /* (liHttp2Stream*) closed streams, freed in the next write pass */
+
+	/* HEADERS + CONTINUATION frames are collected until END_HEADERS */
+	guint32 continuation_stream;
+	guint8 continuation_flags;
+	GString *header_block;
+	guint16 header_weight;     /* priority from the HEADERS frame, applied when the stream is created */
+	guint32 header_depends_on;
+
+	gboolean preface_received, settings_received;
+	gboolean goaway_sent, goaway_received;
+	gboolean broken;                 /* connection error: GOAWAY sent, ignore further input */
+	gboolean window_updates_pending; /* a request body consumer freed space in its queue */
+
+	guint max_idle; /* max-keep-alive-idle of the last finished request */
+
+	GString *header_out; /* HPACK output */
+	GString *payload;    /* payload of the current (non DATA) frame */
+	GString *tmp;        /* control frames */
+	liChunkQueue *frame_data; /* payload of the DATA frame being queued */
+};
+
+/* checks whether raw_in starts with the client connection preface; LI_HANDLER_GO_ON: preface found,
+ * LI_HANDLER_WAIT_FOR_EVENT: need more data, LI_HANDLER_ERROR: no HTTP/2 (prior knowledge) connection
+ */
+LI_API liHandlerResult li_http2_check_preface(liChunkQueue *raw_in);
+
+/* switches the connection to HTTP/2: "h2" from ALPN or a cleartext connection starting with the preface */
+LI_API liHttp2Connection* li_http2_connection_new(liConnection *con);
+LI_API void li_http2_connection_free(liHttp2Connection *h2);
+
+/* parses frames from raw_in; returns FALSE if the connection has to be closed immediately */
+LI_API gboolean li_http2_connection_read(liHttp2Connection *h2, liChunkQueue *raw_in);
+/* writes pending control frames, response headers and (flow controlled) DATA frames to con->out */
+LI_API void li_http2_connection_write(liHttp2Connection *h2);
+
+/* sends GOAWAY; the connection gets closed after the active streams are done */
+LI_API void li_http2_connection_shutdown(liHttp2Connection *h2);
+
+/* whether the connection should be in the io timeout queue */
+LI_API gboolean li_http2_connection_want_timeout(liHttp2Connection *h2);
+
+/* h2c upgrade from a HTTP/1.1 request (without request body); returns FALSE if the request doesn't ask for it.
+ * sends "101 Switching Protocols" and continues the request from con->mainvr as stream 1
+ */
+LI_API gboolean li_http2_upgrade(liConnection *con);
+
+/* returns NULL if the vrequest doesn't belong to a HTTP/2 stream */
+LI_API liConnection* li_http2_connection_from_vrequest(liVRequest *vr);
+
+#endif
@@ -0,0 +1,68 @@
+#ifndef _LIGHTTPD_HTTP2_HPACK_H_
+#define _LIGHTTPD_HTTP2_HPACK_H_
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+/* HPACK header compression for HTTP/2 (RFC 7541) */
+
+#define LI_HPACK_DEFAULT_TABLE_SIZE 4096
+#define LI_HPACK_ENTRY_OVERHEAD 32
+#define LI_HPACK_STATIC_TABLE_LEN 61
+
+struct liHPackEntry {
+	gsize name_len, value_len;
+	gchar data[]; /* name followed by value, not terminated */
+};
+
+/* dynamic table: ring buffer, the newest entry has the lowest index */
+struct liHPackTable {
+	liHPackEntry **entries;
+	guint capacity, first, count; /* capacity is a power of 2; first: slot of the newest entry */
+	gsize size, max_size; /* size as defined in RFC 7541 4.1 (name + value + 32 per entry) */
+};
+
+struct liHPackDecoder {
+	liHPackTable table;
+	gsize max_size_limit; /* our SETTINGS_HEADER_TABLE_SIZE: the encoder may not use a larger table */
+	GString *name, *value; /* buffers for huffman decoded strings */
+};
+
+struct liHPackEncoder {
+	liHPackTable table;
+	gboolean size_update; /* announce table size changes at the start of the next header block */
+	gsize size_update_min;
+};
+
+/* called for each decoded header field; name and value are only valid during the call */
+typedef void (*liHPackHeaderCB)(gpointer context, const gchar *name, gsize name_len, const gchar *value, gsize value_len);
+
+LI_API void li_hpack_decoder_init(liHPackDecoder *dec, gsize max_size);
+LI_API void li_hpack_decoder_clear(liHPackDecoder *dec);
+
+/* decodes a complete header block; returns FALSE on errors, which are always connection errors
+ * (COMPRESSION_ERROR) as the dynamic table state is lost
+ */
+LI_API gboolean li_hpack_decode(liHPackDecoder *dec, const guint8 *data, gsize len, liHPackHeaderCB cb, gpointer context);
+
+LI_API void li_hpack_encoder_init(liHPackEncoder *enc);
+LI_API void li_hpack_encoder_clear(liHPackEncoder *enc);
+
+/* the peer announced a new SETTINGS_HEADER_TABLE_SIZE; we never use more than LI_HPACK_DEFAULT_TABLE_SIZE */
+LI_API void li_hpack_encoder_set_max_size(liHPackEncoder *enc, gsize max_size);
+
+/* call before the first field of each header block */
+LI_API void li_hpack_encode_start(liHPackEncoder *enc, GString *dest);
+
+/* appends a header field to dest; name has to be lowercase. responses headers like content-length, etag or
+ * set-cookie are not added to the dynamic table (they rarely repeat or shouldn't be guessable)
+ */
+LI_API void li_hpack_encode(liHPackEncoder *enc, GString *dest, const gchar *name, gsize name_len, const gchar *value, gsize value_len);
+
+/* huffman code from RFC 7541 appendix B; decode returns FALSE for invalid padding or EOS in the data */
+LI_API gboolean li_hpack_huffman_decode(GString *dest, const guint8 *data, gsize len);
+LI_API void li_hpack_huffman_encode(GString *dest, const guint8 *data, gsize len);
+LI_API gsize li_hpack_huffman_length(const guint8 *data, gsize len);
+
+#endif
@@ -0,0 +1,82 @@
+#ifndef _LIGHTTPD_HTTP_HEADER_IDS_H_
+#define _LIGHTTPD_HTTP_HEADER_IDS_H_
+
+/* generated by contrib/create-http-header-ids.pl - don't edit */
+
+#ifndef _LIGHTTPD_BASE_H_
+#error Please include <lighttpd/base.h> instead of this file
+#endif
+
+typedef enum {
+	LI_HTTP_HEADER_UNKNOWN = 0,
+	LI_HTTP_HEADER_ACCEPT,
+	LI_HTTP_HEADER_ACCEPT_CHARSET,
+	LI_HTTP_HEADER_ACCEPT_ENCODING,
+	LI_HTTP_HEADER_ACCEPT_LANGUAGE,
+	LI_HTTP_HEADER_ACCEPT_RANGES,
+	LI_HTTP_HEADER_ACCESS_CONTROL_ALLOW_ORIGIN,
+	LI_HTTP_HEADER_AGE,
+	LI_HTTP_HEADER_ALLOW,
+	LI_HTTP_HEADER_AUTHORIZATION,
+	LI_HTTP_HEADER_CACHE_CONTROL,
+	LI_HTTP_HEADER_CONNECTION,
+	LI_HTTP_HEADER_CONTENT_DISPOSITION,
+	LI_HTTP_HEADER_CONTENT_ENCODING,
+	LI_HTTP_HEADER_CONTENT_LANGUAGE,
+	LI_HTTP_HEADER_CONTENT_LENGTH,
+	LI_HTTP_HEADER_CONTENT_LOCATION,
+	LI_HTTP_HEADER_CONTENT_RANGE,
+	LI_HTTP_HEADER_CONTENT_TYPE,
+	LI_HTTP_HEADER_COOKIE,
+	LI_HTTP_HEADER_DATE,
+	LI_HTTP_HEADER_DNT,
+	LI_HTTP_HEADER_ETAG,
+	LI_HTTP_HEADER_EXPECT,
+	LI_HTTP_HEADER_EXPIRES,
+	LI_HTTP_HEADER_FORWARDED,
+	LI_HTTP_HEADER_HOST,
+	LI_HTTP_HEADER_HTTP2_SETTINGS,
+	LI_HTTP_HEADER_IF_MATCH,
+	LI_HTTP_HEADER_IF_MODIFIED_SINCE,
+	LI_HTTP_HEADER_IF_NONE_MATCH,
+	LI_HTTP_HEADER_IF_RANGE,
+	LI_HTTP_HEADER_IF_UNMODIFIED_SINCE,
+	LI_HTTP_HEADER_KEEP_ALIVE,
+	LI_HTTP_HEADER_LAST_MODIFIED,
+	LI_HTTP_HEADER_LOCATION,
+	LI_HTTP_HEADER_ORIGIN,
+	LI_HTTP_HEADER_PRAGMA,
+	LI_HTTP_HEADER_PRIORITY,
+	LI_HTTP_HEADER_PROXY_CONNECTION,
+	LI_HTTP_HEADER_RANGE,
+	LI_HTTP_HEADER_REFERER,
+	LI_HTTP_HEADER_RETRY_AFTER,
+	LI_HTTP_HEADER_SEC_CH_UA,
+	LI_HTTP_HEADER_SEC_CH_UA_MOBILE,
+	LI_HTTP_HEADER_SEC_CH_UA_PLATFORM,
+	LI_HTTP_HEADER_SEC_FETCH_DEST,
+	LI_HTTP_HEADER_SEC_FETCH_MODE,
+	LI_HTTP_HEADER_SEC_FETCH_SITE,
+	LI_HTTP_HEADER_SEC_FETCH_USER,
+	LI_HTTP_HEADER_SERVER,
+	LI_HTTP_HEADER_SET_COOKIE,
+	LI_HTTP_HEADER_STRICT_TRANSPORT_SECURITY,
+	LI_HTTP_HEADER_TE,
+	LI_HTTP_HEADER_TRAILER,
+	LI_HTTP_HEADER_TRANSFER_ENCODING,
+	LI_HTTP_HEADER_UPGRADE,
+	LI_HTTP_HEADER_UPGRADE_INSECURE_REQUESTS,
+	LI_HTTP_HEADER_USER_AGENT,
+	LI_HTTP_HEADER_VARY,
+	LI_HTTP_HEADER_VIA,
+	LI_HTTP_HEADER_WWW_AUTHENTICATE,
+	LI_HTTP_HEADER_X_FORWARDED_FOR,
+	LI_HTTP_HEADER_X_FORWARDED_HOST,
+	LI_HTTP_HEADER_X_FORWARDED_PROTO,
+	LI_HTTP_HEADER_X_REAL_IP,
+	LI_HTTP_HEADER_X_REQUESTED_WITH,
+
+	LI_HTTP_HEADER_COUNT
+} liHttpHeaderId;
+
+#endif
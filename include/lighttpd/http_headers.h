@@ -14,13 +14,26 @@
 #define LI_HEADER_KEY_LEN(h) \
 	((h)->data->str), ((h)->keylen)
 
+#include <lighttpd/http_header_ids.h>
+
 struct liHttpHeader {
 	guint keylen;     /** length of "headername" in data */
 	GString *data;    /** "headername: value" */
+	liHttpHeaderId id; /** LI_HTTP_HEADER_UNKNOWN if the name isn't well-known; don't change the name in data */
+	GList link;       /** (internal) entry in liHttpHeaders.entries, link.data is the header */
 };
 
+/* entries must only be changed with the li_http_header_* functions (the list links are embedded in the headers);
+ * removed headers are kept for reuse until the headers are freed.
+ */
 struct liHttpHeaders {
 	GQueue entries;
+	guint version;    /** incremented by all li_http_header_* changes; increment it yourself if you modify header data directly */
+
+	GList *id_first[LI_HTTP_HEADER_COUNT]; /** (internal) first entry for each well-known header */
+	guint id_count[LI_HTTP_HEADER_COUNT]; /** (internal) number of entries for each well-known header */
+
+	GQueue unused;    /** (internal) removed headers */
 };
 
 typedef struct liHttpHeaderTokenizer liHttpHeaderTokenizer;
@@ -55,6 +68,20 @@ LI_API GList* li_http_header_find_first(liHttpHeaders *headers, const gchar *key
 LI_API GList* li_http_header_find_next(GList *l, const gchar *key, size_t keylen);
 LI_API GList* li_http_header_find_last(liHttpHeaders *headers, const gchar *key, size_t keylen);
 
+/** well-known header names have an id (LI_HTTP_HEADER_UNKNOWN for other names); the string functions
+ * use it too, so they don't need to compare the name of each header. the id functions don't hash the name.
+ */
+LI_API liHttpHeaderId li_http_header_id(const gchar *key, size_t keylen);
+/** lowercase name of a well-known header ("" for LI_HTTP_HEADER_UNKNOWN); len may be NULL */
+LI_API const gchar* li_http_header_id_name(liHttpHeaderId id, guint *len);
+
+LI_API liHttpHeader* li_http_header_lookup_id(liHttpHeaders *headers, liHttpHeaderId id);
+LI_API GList* li_http_header_find_next_id(GList *l, liHttpHeaderId id);
+LI_API GList* li_http_header_find_last_id(liHttpHeaders *headers, liHttpHeaderId id);
+
+INLINE GList* li_http_header_find_first_id(liHttpHeaders *headers, liHttpHeaderId id);
+INLINE guint li_http_header_count_id(liHttpHeaders *headers, liHttpHeaderId id);
+
 /** Use lowercase keys! values are compared case-insensitive */
 LI_API gboolean li_http_header_is(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen);
 
@@ -65,9 +92,25 @@ INLINE gboolean li_http_header_key_is(liHttpHeader *h, const gchar *key, size_t
 	return (h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen));
 }
 
+/* inline implementations */
+
+INLINE GList* li_http_header_find_first_id(liHttpHeaders *headers, liHttpHeaderId id) {
+	return (id > LI_HTTP_HEADER_UNKNOWN && id < LI_HTTP_HEADER_COUNT) ? headers->id_first[id] : NULL;
+}
+
+INLINE guint li_http_header_count_id(liHttpHeaders *headers, liHttpHeaderId id) {
+	return (id > LI_HTTP_HEADER_UNKNOWN && id < LI_HTTP_HEADER_COUNT) ? headers->id_count[id] : 0;
+}
+
 /* very simple tokenizer. splits at ' ' and ',', unquotes \\ escapes and "..." tokens */
 LI_API void li_http_header_tokenizer_start(liHttpHeaderTokenizer *tokenizer, liHttpHeaders *headers, const gchar *key, size_t keylen);
 LI_API gboolean li_http_header_tokenizer_next(liHttpHeaderTokenizer *tokenizer, GString *token);
 
+/** parses lists like Accept-Encoding ("gzip;q=0.5, br, *;q=0") from all headers with the id.
+ * names is NULL terminated; q[i] gets the q-value (in 1/1000) of names[i] or -1 if it isn't listed,
+ * *q_star the value of "*" (-1 if not listed). names are compared case-insensitive.
+ */
+LI_API void li_http_header_parse_qvalues(liHttpHeaders *headers, liHttpHeaderId id, const gchar * const *names, gint *q, gint *q_star);
+
 
 #endif
@@ -42,10 +42,24 @@ typedef enum {
 	LI_MEMCACHED_UNKNOWN = 0xff
 } liMemcachedError;
 
+typedef enum {
+	LI_MEMCACHED_PROTOCOL_TEXT, /* get / set */
+	LI_MEMCACHED_PROTOCOL_META  /* mg / ms (memcached >= 1.6): shorter responses, a GET doesn't wait for END */
+} liMemcachedProtocol;
+
 LI_API liMemcachedCon* li_memcached_con_new(liEventLoop *loop, liSocketAddress addr);
 LI_API void li_memcached_con_acquire(liMemcachedCon* con);
 LI_API void li_memcached_con_release(liMemcachedCon* con); /* thread-safe */
 
+/* protocol for the following requests (default: LI_MEMCACHED_PROTOCOL_TEXT) */
+LI_API void li_memcached_con_set_protocol(liMemcachedCon *con, liMemcachedProtocol protocol);
+/* fail all waiting requests (and disable the connection for a second) if the server doesn't answer or
+ * the connect doesn't finish within timeout seconds; 0 (default) waits forever
+ */
+LI_API void li_memcached_con_set_timeout(liMemcachedCon *con, li_tstamp timeout);
+/* number of requests waiting for their response; requests are pipelined on the connection */
+LI_API guint li_memcached_con_pending(liMemcachedCon *con);
+
 /* these functions are not thread-safe, i.e. must be called in the same context as "loop" from li_memcached_con_new */
 LI_API liMemcachedRequest* li_memcached_get(liMemcachedCon *con, GString *key, liMemcachedCB callback, gpointer cb_data, GError **err);
 LI_API liMemcachedRequest* li_memcached_set(liMemcachedCon *con, GString *key, guint32 flags, li_tstamp ttl, liBuffer *data, liMemcachedCB callback, gpointer cb_data, GError **err);
@@ -9,6 +9,9 @@
 # define USE_SENDFILE
 #endif
 
+/* file ranges up to this size following memory chunks are read and sent in the same writev() */
+#define LI_NETWORK_WRITEV_FILE_MAX (16*1024)
+
 #define LI_NETWORK_ERROR li_network_error_quark()
 LI_API GQuark li_network_error_quark(void);
 
@@ -18,24 +21,43 @@ LI_API ssize_t li_net_write(int fd, void *buf, ssize_t nbyte);
 /** repeats read after EINTR */
 LI_API ssize_t li_net_read(int fd, void *buf, ssize_t nbyte);
 
-LI_API liNetworkStatus li_network_write(int fd, liChunkQueue *cq, goffset write_max, GError **err);
+/* adds the number of write syscalls it needed to *syscalls (if not NULL) */
+LI_API liNetworkStatus li_network_write(int fd, liChunkQueue *cq, goffset write_max, liNetworkBackend backend, guint64 *syscalls, GError **err);
 LI_API liNetworkStatus li_network_read(int fd, liChunkQueue *cq, goffset read_max, liBuffer **buffer, GError **err);
+/* like li_network_read, but moves the data into cp with splice() if possible (as PIPE_CHUNK) */
+LI_API liNetworkStatus li_network_read_splice(int fd, liChunkQueue *cq, goffset read_max, liChunkPipe *cp, liBuffer **buffer, GError **err);
+
+/* parses "auto", "sendfile", "writev", "write" and "io_uring"; returns FALSE for unknown or unavailable backends */
+LI_API gboolean li_network_backend_from_string(const gchar *str, liNetworkBackend *backend);
+
+#ifdef HAVE_LIBURING
+/* submits the memory chunks at the head of stream->stream_out.out as one writev through the io_uring of the worker.
+ * the data stays in the queue until the write completes; stream->throttled_out is set while it is in flight.
+ * returns FALSE if nothing was submitted (no memory chunk at the head, ring not available): use li_network_write then.
+ * only for iostreams which stay in one worker (they must not get detached while a write is in flight)
+ */
+LI_API gboolean li_network_uring_write(liIOStream *stream, goffset write_max);
+/* cancels and waits for the writes in flight */
+LI_API void li_network_uring_free(liWorker *wrk);
+#endif
 
 /* use writev for mem chunks, buffered read/write for files */
-LI_API liNetworkStatus li_network_write_writev(int fd, liChunkQueue *cq, goffset *write_max, GError **err);
+LI_API liNetworkStatus li_network_write_writev(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err);
 
 #ifdef USE_SENDFILE
 /* use sendfile for files, writev for mem chunks */
-LI_API liNetworkStatus li_network_write_sendfile(int fd, liChunkQueue *cq, goffset *write_max, GError **err);
+LI_API liNetworkStatus li_network_write_sendfile(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err);
 #endif
 
-/* write backends */
-LI_API liNetworkStatus li_network_backend_write(int fd, liChunkQueue *cq, goffset *write_max, GError **err);
-LI_API liNetworkStatus li_network_backend_writev(int fd, liChunkQueue *cq, goffset *write_max, GError **err);
+/* write backends; count their syscalls in *syscalls */
+LI_API liNetworkStatus li_network_backend_write(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err);
+LI_API liNetworkStatus li_network_backend_writev(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err);
+/* first chunk must be a PIPE_CHUNK; falls back to li_network_backend_write */
+LI_API liNetworkStatus li_network_backend_splice(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err);
 
 #define LI_NETWORK_FALLBACK(f, write_max) do { \
 	liNetworkStatus res; \
-	switch(res = f(fd, cq, write_max, err)) { \
+	switch(res = f(fd, cq, write_max, syscalls, err)) { \
 		case LI_NETWORK_STATUS_SUCCESS: \
 			break; \
 		default: \
@@ -27,6 +27,8 @@ enum liCoreOptionPtrs {
 	LI_CORE_OPTION_SERVER_TAG,
 
 	LI_CORE_OPTION_MIME_TYPES,
+
+	LI_CORE_OPTION_STATIC_PRECOMPRESSED,
 };
 
 /* the core plugin always has base index 0, as it is the first plugin loaded */
@@ -0,0 +1,65 @@
+#ifndef _LIGHTTPD_REGEX_H_
+#define _LIGHTTPD_REGEX_H_
+
+#include <lighttpd/settings.h>
+
+/* regular expressions for conditions (=~, !~) and modules (rewrite, redirect, vhost.map_regex, ...)
+ *
+ * uses PCRE2 with JIT if available (HAVE_PCRE2), GRegex otherwise; patterns are matched
+ * on raw bytes (no utf-8 validation), like GRegex with G_REGEX_RAW.
+ */
+
+typedef struct liRegex liRegex;
+typedef struct liRegexMatch liRegexMatch;
+typedef struct liRegexSet liRegexSet;
+
+LI_API liRegex* li_regex_new(const gchar *pattern, GError **error);
+LI_API void li_regex_free(liRegex *regex);
+
+LI_API const gchar* li_regex_get_pattern(liRegex *regex);
+/* number of capture groups (not counting group 0 for the complete match) */
+LI_API guint li_regex_get_capture_count(liRegex *regex);
+
+/* matching fails (and sets error) if a limit was hit, like the match limit or the jit stack size;
+ * the result is the same as "no match" then, but callers should fail the request instead.
+ */
+
+/* only returns whether subject matches; doesn't allocate */
+LI_API gboolean li_regex_test(liRegex *regex, const gchar *subject, gsize len, GError **error);
+
+/* returns NULL if subject doesn't match; the match only references subject, so it has to stay
+ * valid until the match is freed. match objects are kept in a per-thread cache.
+ */
+LI_API liRegexMatch* li_regex_match(liRegex *regex, const gchar *subject, gsize len, GError **error);
+LI_API void li_regex_match_free(liRegexMatch *match);
+
+/* number of groups including group 0 */
+LI_API guint li_regex_match_get_count(liRegexMatch *match);
+LI_API const gchar* li_regex_match_get_subject(liRegexMatch *match);
+/* returns FALSE if group n doesn't exist or didn't participate in the match */
+LI_API gboolean li_regex_match_fetch_pos(liRegexMatch *match, guint n, gsize *start, gsize *end);
+
+/* a list of regular expressions matched in one pass: the result is the index of the first regex
+ * in the list that matches (G_MAXUINT if none does), the same as trying them one after another.
+ *
+ * with PCRE2 the list gets combined into one anchored alternation "(?|(?s:.*?)\K(?:re0)(*MARK:0)|...)";
+ * the branch reset group gives each alternative its own capture numbers, so the match has the captures
+ * of the winning regex. regexes using backtracking verbs, recursion or subroutine calls are not
+ * combined; these lists are matched one regex after another.
+ */
+LI_API liRegexSet* li_regex_set_new(void);
+/* takes ownership of regex; a NULL regex matches everything (without captures) */
+LI_API void li_regex_set_add(liRegexSet *set, liRegex *regex);
+/* call after all regexes were added; returns FALSE if the list couldn't be combined (still usable) */
+LI_API gboolean li_regex_set_compile(liRegexSet *set);
+LI_API void li_regex_set_free(liRegexSet *set);
+
+LI_API guint li_regex_set_get_length(liRegexSet *set);
+LI_API liRegex* li_regex_set_get(liRegexSet *set, guint ndx);
+
+/* if match is not NULL it gets the match of the winning regex (NULL if none or a NULL regex matched).
+ * returns G_MAXUINT if matching failed (error is set).
+ */
+LI_API guint li_regex_set_match(liRegexSet *set, const gchar *subject, gsize len, liRegexMatch **match, GError **error);
+
+#endif
@@ -42,6 +42,8 @@ LI_API void li_request_clear(liRequest *req);
 LI_API void li_request_copy(liRequest *dest, const liRequest *src);
 
 LI_API gboolean li_request_validate_header(liConnection *con);
+/* HTTP/2 stream request; sets vr->response.http_status if it returns FALSE */
+LI_API gboolean li_request_validate_header_http2(liVRequest *vr, gboolean end_stream);
 
 LI_API void li_physical_init(liPhysical *phys);
 LI_API void li_physical_reset(liPhysical *phys);
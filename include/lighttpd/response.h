@@ -16,5 +16,9 @@ LI_API void li_response_reset(liResponse *resp);
 LI_API void li_response_clear(liResponse *resp);
 
 LI_API void li_response_send_headers(liVRequest *vr, liChunkQueue *raw_out, liChunkQueue *response_body, gboolean upgraded);
+/* HPACK encodes the response headers of a HTTP/2 stream into dest (after li_hpack_encode_start);
+ * returns FALSE if no DATA frames follow (END_STREAM on the HEADERS frame)
+ */
+LI_API gboolean li_response_send_headers_http2(liVRequest *vr, GString *dest, liHPackEncoder *enc, liChunkQueue *response_body);
 
 #endif
@@ -10,6 +10,8 @@
 #endif
 
 typedef gboolean (*liConnectionNewCB)(liConnection *con, int fd);
+
+typedef struct liServerSocketTLSStats liServerSocketTLSStats;
 typedef void (*liServerSocketReleaseCB)(liServerSocket *srv_sock);
 
 typedef void (*liServerStateWaitCancelled)(liServer *srv, liServerStateWait *w);
@@ -30,6 +32,7 @@ typedef enum {
 struct liServerSocket {
 	gint refcount;
 	liServer *srv;
+	liWorker *wrk;            /** owning worker of a SO_REUSEPORT socket (workers.reuseport); NULL: main worker accepts and dispatches */
 	liEventIO watcher;
 
 	liSocketAddress local_addr;
@@ -38,6 +41,13 @@ struct liServerSocket {
 	gpointer data;
 	liConnectionNewCB new_cb;
 	liServerSocketReleaseCB release_cb;
+
+	guint64 tls_handshakes, tls_resumed; /** finished TLS handshakes and how many of them resumed a session; see li_server_socket_tls_stats_add() */
+};
+
+struct liServerSocketTLSStats {
+	GString *address;
+	guint64 handshakes, resumed;
 };
 
 struct liServerStateWait {
@@ -66,6 +76,9 @@ struct liServer {
 #ifdef LIGHTY_OS_LINUX
 	liValue *workers_cpu_affinity;
 #endif
+	gboolean reuseport;          /** workers.reuseport: each worker accepts on its own SO_REUSEPORT sockets */
+	gboolean reuseport_cpu;      /** steer connections to the worker with the index of the receiving cpu */
+	GPtrArray *listen_addrs;     /** array of (GString*): addresses from listen, bound when the workers start (once per worker with workers.reuseport) */
 	GArray *ts_formats;      /** array of (GString*), add with li_server_ts_format_add() */
 
 	guint loop_flags;
@@ -105,6 +118,9 @@ struct liServer {
 	GHashTable *fetch_backends;
 	GMutex *fetch_backends_mutex;
 
+	GPtrArray *backend_pools;     /** (liBackendPool*) pools that were used, for statistics; see li_backend_pools_stats() */
+	GMutex *backend_pools_mutex;
+
 	gboolean exiting;         /** atomic access */
 
 	liLogServerData logs;
@@ -119,8 +135,15 @@ struct liServer {
 	guint keep_alive_queue_timeout;
 
 	gdouble io_timeout;
+	gboolean http2;                 /** http2 setup: accept HTTP/2 (ALPN "h2", prior knowledge and h2c upgrade) */
+	liNetworkBackend network_backend; /** network.backend: how chunkqueues get written to sockets */
 
 	gdouble stat_cache_ttl;
+	gboolean stat_cache_inotify;           /** stat_cache.inotify setup */
+	liStatCacheInotify *stat_cache_watch;  /** shared inotify watcher, created before workers start */
+	guint stat_cache_max_open_files;       /** per worker budget for the open file cache */
+	guint64 stat_cache_content_size;       /** per worker budget (bytes) for the content cache, 0: disabled */
+	goffset stat_cache_content_max_file_size; /** only files up to this size are kept in the content cache */
 	gint tasklet_pool_threads;
 };
 
@@ -131,6 +154,11 @@ LI_API void li_server_loop_init(liServer *srv);
 
 LI_API liServerSocket* li_server_listen(liServer *srv, int fd);
 
+/* remember a listen address; bound when the workers start, once per worker with SO_REUSEPORT if workers.reuseport is enabled */
+LI_API void li_server_listen_addr(liServer *srv, GString *str);
+/* hand a SO_REUSEPORT socket to the worker owning it (main worker context) */
+LI_API liServerSocket* li_server_listen_worker(liWorker *wrk, int fd);
+
 /* exit asap with cleanup */
 LI_API void li_server_exit(liServer *srv);
 
@@ -143,6 +171,14 @@ LI_API guint li_server_ts_format_add(liServer *srv, GString* format);
 LI_API void li_server_socket_release(liServerSocket* sock);
 LI_API void li_server_socket_acquire(liServerSocket* sock);
 
+/* threadsafe; called by the ssl modules after a handshake */
+LI_API void li_server_socket_tls_stats_add(liServerSocket *sock, gboolean resumed);
+/* snapshot of the listening sockets which did TLS handshakes: array of liServerSocketTLSStats. threadsafe,
+ * free with li_server_sockets_tls_stats_free()
+ */
+LI_API GArray* li_server_sockets_tls_stats(liServer *srv);
+LI_API void li_server_sockets_tls_stats_free(GArray *stats);
+
 LI_API void li_server_goto_state(liServer *srv, liServerState state);
 LI_API void li_server_reached_state(liServer *srv, liServerState state);
 
@@ -120,6 +120,11 @@
 # include <sys/uio.h>
 #endif
 
+#if defined(LIGHTY_OS_LINUX) && defined(HAVE_SPLICE)
+# define USE_SPLICE
+# include <fcntl.h>
+#endif
+
 #if defined(HAVE_SYS_UIO_H) && defined(HAVE_WRITEV)
 # define USE_WRITEV
 # include <sys/uio.h>
@@ -9,10 +9,14 @@
  *
  * Entries are removed after 10 seconds (adjustable through stat_cache.ttl setup)
  *
+ * With stat_cache.inotify (linux) one shared thread watches the directories of all cached paths (and their parents)
+ * and pushes invalidations to the job queue of each worker, so the TTL can be increased to minutes.
+ * Entries whose directories can't be watched (relative or unclean paths, watch limit) expire after 10 seconds
+ * (or the TTL if smaller); on an inotify queue overflow all caches are flushed.
+ *
  * TODO:
  *     - create ETAGs
  *     - get content type from xattr
- *     - add support for inotify (linux). TTL for entries can be increased to 60s
  *
  * Technical details:
  * If a stat is requested, the following procedure takes place:
@@ -66,7 +70,11 @@ struct liStatCacheEntry {
 	GPtrArray *vrequests;             /* vrequests waiting for this info */
 	guint refcount;                   /* vrequests, delete_queue and tasklet hold references; dirlist/entrie cache entries are always in delete_queue too */
 	liWaitQueueElem queue_elem;       /* queue element for the delete_queue */
+	liWaitQueue *queue;               /* the queue queue_elem is in: delete_queue or unwatched_queue */
 	gboolean cached;
+
+	liStatCacheInotify *inotify;      /* copy of sc->inotify for the stat thread */
+	gboolean watched;                 /* set by the stat thread: changes will be notified by inotify */
 };
 
 struct liStatCache {
@@ -75,14 +83,47 @@ struct liStatCache {
 	liWaitQueue delete_queue;
 	gdouble ttl;
 
+	/* inotify invalidation, NULL if disabled */
+	liStatCacheInotify *inotify;
+	liWaitQueue unwatched_queue;      /* entries not covered by inotify watches, short TTL */
+	GAsyncQueue *invalidate_queue;    /* liStatCacheInvalidation*, filled by the inotify thread */
+	liJob invalidate_job;
+	liJobRef *invalidate_jobref;
+
+	/* open regular files (liStatCacheFile*), keyed by dev, ino, mtime and size of the stat cache entries;
+	 * dropped together with the stat cache entry, LRU evicted beyond files_max */
+	GHashTable *files;
+	GQueue files_lru;
+	guint files_max;
+
+	/* content of small regular files; same table as files, but a liBuffer instead of an open file
+	 * LRU evicted beyond content_max bytes */
+	GQueue content_lru;
+	guint64 content_size;
+	guint64 content_max;
+	goffset content_max_file_size;
+
 	guint64 hits;
 	guint64 misses;
 	guint64 errors;
+	guint64 invalidations;
+	guint64 file_hits;
+	guint64 file_misses;
+	guint64 content_hits;
+	guint64 content_misses;
 };
 
 LI_API liStatCache* li_stat_cache_new(liWorker *wrk, gdouble ttl);
 LI_API void li_stat_cache_free(liStatCache *sc);
 
+/* stops the delete queues (worker shutdown) */
+LI_API void li_stat_cache_stop(liStatCache *sc);
+
+/* shared inotify watcher for all worker caches; returns NULL if inotify isn't available */
+LI_API liStatCacheInotify* li_stat_cache_inotify_new(liServer *srv);
+/* call after all stat caches are freed */
+LI_API void li_stat_cache_inotify_free(liStatCacheInotify *sci);
+
 /*
  gets a stat_cache_entry for a specified path
  if fd is set, a new fd is acquired via open() and stat info via fstat(), otherwise only a stat() is performed
@@ -90,6 +131,14 @@ LI_API void li_stat_cache_free(liStatCache *sc);
 */
 LI_API liHandlerResult li_stat_cache_get(liVRequest *vr, GString *path, struct stat *st, int *err, int *fd);
 
+/*
+ like li_stat_cache_get with fd, but returns a (new reference to a) liChunkFile from the open file cache;
+ if content is not NULL small files might be returned from the content cache as (new reference to a) liBuffer
+ with the complete file instead (*cf is NULL then).
+ *cf and *content are only set with HANDLER_GO_ON
+*/
+LI_API liHandlerResult li_stat_cache_get_file(liVRequest *vr, GString *path, struct stat *st, int *err, liChunkFile **cf, liBuffer **content);
+
 /* doesn't return HANDLER_WAIT_FOR_EVENT, blocks instead of async lookup */
 LI_API liHandlerResult li_stat_cache_get_sync(liVRequest *vr, GString *path, struct stat *st, int *err, int *fd);
 
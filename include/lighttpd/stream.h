@@ -72,6 +72,9 @@ struct liIOStream {
 	guint in_closed:1, out_closed:1;
 	guint can_read:1, can_write:1; /* set to FALSE if you got EAGAIN */
 	guint throttled_in:1, throttled_out:1;
+	guint uring_writes:1; /* use li_network_uring_write with network.backend "io_uring" */
+
+	gpointer uring_write; /* write in flight, see li_network_uring_write */
 
 	/* throttle needs to be handled by the liIOStreamCB cb */
 	liThrottleState *throttle_in;
@@ -102,6 +105,8 @@ LI_API void li_iostream_attach(liIOStream *iostream, liWorker *wrk);
 LI_API void li_stream_simple_socket_close(liIOStream *stream, gboolean aborted);
 LI_API void li_stream_simple_socket_io_cb(liIOStream *stream, liIOStreamEvent event);
 LI_API void li_stream_simple_socket_io_cb_with_context(liIOStream *stream, liIOStreamEvent event, gpointer *data);
+/* reads up to splice_max bytes with splice() into splice_pipe (if not NULL); the data must not need to get parsed */
+LI_API void li_stream_simple_socket_io_cb_with_splice(liIOStream *stream, liIOStreamEvent event, gpointer *data, liChunkPipe *splice_pipe, goffset splice_max);
 /* tries to flush TCP sockets by disabling nagle */
 LI_API void li_stream_simple_socket_flush(liIOStream *stream);
 
@@ -3,6 +3,26 @@
 
 #include <lighttpd/base.h>
 
+/* http_status: status of the (final) response
+ * keepalive: connection is idle and may be used for another request
+ */
+typedef void (*liStreamHttpResponseDoneCB)(gpointer data, gint http_status, gboolean keepalive);
+
 LI_API liStream* li_stream_http_response_handle(liStream *http_in, liVRequest *vr, gboolean accept_cgi, gboolean accept_nph);
 
+/* for HTTP/1.x backends: finds the end of the response body from the message framing
+ * (Content-Length, chunked encoding, responses without body) instead of waiting for eof.
+ * done_cb is called when the body was read completely; http_in isn't read anymore after
+ * that and gets disconnected after done_cb returns.
+ * done_cb isn't called if the response ends with the connection (or on errors).
+ */
+LI_API liStream* li_stream_http_response_handle_framed(liStream *http_in, liVRequest *vr, gboolean accept_cgi, gboolean accept_nph, liStreamHttpResponseDoneCB done_cb, gpointer done_data);
+
+/* stream must be from li_stream_http_response_handle_framed: returns how many bytes of the
+ * response body could be read from http_in into a pipe (li_stream_simple_socket_io_cb_with_splice)
+ * right now, or 0 if the body has to be read into memory (headers not parsed yet, chunked
+ * encoding, response filters, TLS, ...)
+ */
+LI_API goffset li_stream_http_response_splice_max(liStream *stream);
+
 #endif
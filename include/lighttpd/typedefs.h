@@ -39,7 +39,8 @@ typedef enum {
 	LI_ACTION_TFUNCTION,
 	LI_ACTION_TCONDITION,
 	LI_ACTION_TLIST,
-	LI_ACTION_TBALANCER
+	LI_ACTION_TBALANCER,
+	LI_ACTION_TDISPATCH
 } liActionType;
 
 typedef enum {
@@ -55,6 +56,8 @@ typedef struct liLuaState liLuaState;
 
 typedef struct liChunkFile liChunkFile;
 
+typedef struct liChunkPipe liChunkPipe;
+
 typedef struct liChunk liChunk;
 
 typedef struct liCQLimit liCQLimit;
@@ -77,6 +80,10 @@ typedef struct liConditionLValue liConditionLValue;
 
 typedef struct liCondition liCondition;
 
+typedef struct liConditionDispatch liConditionDispatch;
+
+typedef struct liConditionCache liConditionCache;
+
 /* connection.h */
 
 typedef struct liConnection liConnection;
@@ -91,6 +98,18 @@ typedef struct liHttpHeader liHttpHeader;
 
 typedef struct liHttpHeaders liHttpHeaders;
 
+/* http2.h */
+
+typedef struct liHttp2Connection liHttp2Connection;
+typedef struct liHttp2Stream liHttp2Stream;
+
+/* http2_hpack.h */
+
+typedef struct liHPackEntry liHPackEntry;
+typedef struct liHPackTable liHPackTable;
+typedef struct liHPackDecoder liHPackDecoder;
+typedef struct liHPackEncoder liHPackEncoder;
+
 /* li_http_request_parser.h */
 
 typedef struct liHttpRequestCtx liHttpRequestCtx;
@@ -136,6 +155,16 @@ typedef enum {
 	LI_NETWORK_STATUS_WAIT_FOR_EVENT       /**< read/write returned -1 with errno=EAGAIN/EWOULDBLOCK */
 } liNetworkStatus;
 
+typedef enum {
+	LI_NETWORK_BACKEND_AUTO,               /**< sendfile if available, writev otherwise */
+	LI_NETWORK_BACKEND_SENDFILE,
+	LI_NETWORK_BACKEND_WRITEV,
+	LI_NETWORK_BACKEND_WRITE,              /**< plain write() of one chunk at a time */
+	LI_NETWORK_BACKEND_IO_URING            /**< client connections submit memory chunks through the io_uring of the worker */
+} liNetworkBackend;
+
+typedef struct liNetworkUring liNetworkUring;
+
 /* options.h */
 
 typedef union liOptionValue liOptionValue;
@@ -198,7 +227,8 @@ typedef enum {
 typedef enum {
 	LI_HTTP_VERSION_UNSET = -1,
 	LI_HTTP_VERSION_1_0,
-	LI_HTTP_VERSION_1_1
+	LI_HTTP_VERSION_1_1,
+	LI_HTTP_VERSION_2
 } liHttpVersion;
 
 typedef struct liRequest liRequest;
@@ -264,5 +294,6 @@ typedef struct liWorker liWorker;
 typedef struct liStatCacheEntryData liStatCacheEntryData;
 typedef struct liStatCacheEntry liStatCacheEntry;
 typedef struct liStatCache liStatCache;
+typedef struct liStatCacheInotify liStatCacheInotify;
 
 #endif
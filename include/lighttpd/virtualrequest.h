@@ -51,6 +51,7 @@ struct liConInfo {
 	liSocketAddress remote_addr, local_addr;
 	GString *remote_addr_str, *local_addr_str;
 	gboolean is_ssl;
+	gboolean is_ktls; /* ssl records are encrypted by the kernel, plain data goes to the socket */
 	gboolean keep_alive;
 	gboolean aborted; /* network aborted connection before response was sent completely */
 
@@ -84,6 +85,7 @@ struct liVRequest {
 	liVRequestState state;
 
 	li_tstamp ts_started;
+	li_tstamp ts_response_headers; /* when a backend delivered the response headers (li_vrequest_indirect_headers_ready), 0 before */
 
 	GPtrArray *plugin_ctx;
 
@@ -111,6 +113,8 @@ struct liVRequest {
 	liJob job;
 
 	GPtrArray *stat_cache_entries;
+
+	liConditionCache cond_cache;
 };
 
 #define LI_VREQUEST_WAIT_FOR_REQUEST_BODY(vr) \
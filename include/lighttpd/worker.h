@@ -10,6 +10,19 @@
 
 struct lua_State;
 
+#define LI_WORKER_NEW_CON_RING_SIZE 1024 /* slots in the accept hand-off ring, must be a power of 2 */
+#define LI_WORKER_NEW_CON_BATCH_BUCKETS 8 /* bucket i counts hand-off batches of [2^i, 2^(i+1)) connections, last one is open */
+#define LI_STATS_COMPRESS_LEVELS 23 /* bucket i counts responses compressed with level i (zstd goes up to 22) */
+
+/* compression levels of different libraries aren't comparable, so each has its own histogram */
+typedef enum {
+	LI_STATS_COMPRESS_ZLIB,   /* gzip, deflate */
+	LI_STATS_COMPRESS_BZIP2,
+	LI_STATS_COMPRESS_BROTLI,
+	LI_STATS_COMPRESS_ZSTD,
+	LI_STATS_COMPRESS_ENCODINGS
+} liStatsCompressEncoding;
+
 typedef struct liStatistics liStatistics;
 struct liStatistics {
 	guint64 bytes_out;        /** bytes transfered, outgoing */
@@ -42,6 +55,34 @@ struct liStatistics {
 	guint64 last_requests;
 	double requests_per_sec;
 	li_tstamp last_update;
+
+	/* accept hand-off (li_worker_new_con) */
+	guint64 new_con_batches[LI_WORKER_NEW_CON_BATCH_BUCKETS]; /** histogram of connections taken from the ring per wakeup */
+	guint new_con_batch_max;   /** deepest ring seen by a wakeup */
+	guint64 new_con_ring_full; /** connections started locally because the ring of the target worker was full */
+
+	/* updated in timer */
+	gdouble loop_load;         /** smoothed fraction (0..1) of the time the event loop was handling events instead of waiting */
+
+	/* response compression (mod_deflate) */
+	guint64 compress_levels[LI_STATS_COMPRESS_ENCODINGS][LI_STATS_COMPRESS_LEVELS]; /** histograms of the compression levels used */
+	guint64 compress_skipped;  /** responses not compressed because the worker was overloaded */
+
+	guint64 write_syscalls;    /** syscalls (writev, sendfile, setsockopt(TCP_CORK), ...) used to write to sockets */
+
+	/* condition value cache (li_condition_get_value), only lvalues which can be cached are counted */
+	guint64 cond_cache_hits;
+	guint64 cond_cache_misses;
+};
+
+/* slot in the accept hand-off ring; remote address is stored inline */
+typedef struct liWorkerNewCon liWorkerNewCon;
+struct liWorkerNewCon {
+	guint sequence;            /** slot state, atomic access: == pos: free, == pos+1: filled */
+	int s;
+	liServerSocket *srv_sock;
+	socklen_t remote_addr_len; /** 0: unknown, get it from the socket */
+	liSockAddr remote_addr;
 };
 
 typedef struct liWorkerTS liWorkerTS;
@@ -60,6 +101,9 @@ struct liWorker {
 
 	liEventLoop loop;
 	liEventPrepare loop_prepare;
+	liEventCheck loop_check;
+	li_tstamp loop_wakeup_ts; /** when the loop returned from polling, 0 while waiting */
+	li_tstamp loop_busy;      /** time spent handling events since the last stats update */
 	liEventAsync worker_stop_watcher, worker_stopping_watcher, worker_suspend_watcher, worker_exit_watcher;
 
 	liLogWorkerData logs;
@@ -87,9 +131,19 @@ struct liWorker {
 	GArray *timestamps_local;
 
 	/* incoming queues */
-	/*  - new connections (after accept) */
+	/*  - new connections (after accept): bounded lock-free ring, many producers (accepting workers), one consumer */
 	liEventAsync new_con_watcher;
-	GAsyncQueue *new_con_queue;
+	liWorkerNewCon *new_con_ring; /** LI_WORKER_NEW_CON_RING_SIZE slots */
+	guint new_con_head;           /** next position to claim, atomic access by producers */
+	guint new_con_tail;           /** next position to take, use only from local worker context */
+	gint new_con_wakeup;          /** 1 while a wakeup is pending; producers only send one async notification per burst */
+
+	/*  - own listen sockets (workers.reuseport) and listen state changes */
+	liEventAsync listen_watcher;
+	GAsyncQueue *new_socket_queue; /** (liServerSocket*) handed over by the main worker */
+	GPtrArray *sockets;            /** array of (liServerSocket*), use only from local worker context */
+	gboolean listen_active;        /** whether the server wants to accept connections; use atomic access */
+	gboolean connection_limit_hit; /** own sockets disabled because of max_connections, use only from local worker context */
 
 	liServerStateWait wait_for_stop_connections;
 
@@ -105,6 +159,8 @@ struct liWorker {
 	liStatCache *stat_cache;
 
 	liBuffer *network_read_buf; /** available buffer - steal it if you need it, can be NULL. refcount must be 1, no other references. */
+
+	liNetworkUring *network_uring; /** created with the first io_uring write, see network_uring.c */
 };
 
 LI_API liWorker* li_worker_new(liServer *srv, struct ev_loop *loop);
@@ -121,7 +177,15 @@ LI_API void li_worker_stopping(liWorker *context, liWorker *wrk);
 LI_API void li_worker_suspend(liWorker *context, liWorker *wrk);
 LI_API void li_worker_exit(liWorker *context, liWorker *wrk);
 
-LI_API void li_worker_new_con(liWorker *ctx, liWorker *wrk, liSocketAddress remote_addr, int s, liServerSocket *srv_sock);
+/* remote_addr is copied, can be NULL (remote_addr_len = 0) to query it from the socket.
+ * if the ring of wrk is full, the connection is started in ctx instead
+ */
+LI_API void li_worker_new_con(liWorker *ctx, liWorker *wrk, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock);
+
+/* takes ownership of the srv_sock reference; the socket gets attached to the loop of wrk */
+LI_API void li_worker_add_socket(liWorker *wrk, liServerSocket *srv_sock);
+/* start/stop the own listen sockets of wrk according to listen_active and connection_limit_hit */
+LI_API void li_worker_listen_update(liWorker *context, liWorker *wrk);
 
 LI_API void li_worker_check_keepalive(liWorker *wrk);
 
@@ -21,6 +21,8 @@ struct listen_socket {
 
 	liSocketAddress addr;
 	int fd;
+
+	GString *reuseport_key; /* "<worker-ndx> <address>" for per-worker SO_REUSEPORT sockets, NULL otherwise */
 };
 
 struct listen_ref_resource {
@@ -502,7 +504,11 @@ static void listen_ref_release(liServer *srv, liInstance *i, liPlugin *p, liInst
 	if (g_atomic_int_dec_and_test(&sock->refcount)) {
 		liPluginCoreConfig *config = (liPluginCoreConfig*) p->data;
 
-		g_hash_table_remove(config->listen_sockets, &sock->addr);
+		if (NULL != sock->reuseport_key) {
+			g_hash_table_remove(config->reuseport_sockets, sock->reuseport_key);
+		} else {
+			g_hash_table_remove(config->listen_sockets, &sock->addr);
+		}
 	}
 
 	g_slice_free(listen_ref_resource, ref);
@@ -513,6 +519,7 @@ static void _listen_socket_free(gpointer ptr) {
 
 	li_sockaddr_clear(&sock->addr);
 	close(sock->fd);
+	if (NULL != sock->reuseport_key) g_string_free(sock->reuseport_key, TRUE);
 
 	g_slice_free(listen_socket, sock);
 }
@@ -605,7 +612,22 @@ static gboolean listen_check_acl(liServer *srv, liPluginCoreConfig *config, liSo
 	return FALSE;
 }
 
-static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
+static gboolean set_reuseport(liServer *srv, int s) {
+#ifdef SO_REUSEPORT
+	int v = 1;
+	if (-1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+		ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+		return FALSE;
+	}
+	return TRUE;
+#else
+	ERROR(srv, "%s", "Couldn't setsockopt(SO_REUSEPORT): not supported on this platform");
+	UNUSED(s);
+	return FALSE;
+#endif
+}
+
+static int do_listen(liServer *srv, liSocketAddress *addr, GString *str, gboolean reuseport) {
 	int s, v;
 	GString *ipv6_str;
 
@@ -621,6 +643,10 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 			ERROR(srv, "Couldn't setsockopt(SO_REUSEADDR): %s", g_strerror(errno));
 			return -1;
 		}
+		if (reuseport && !set_reuseport(srv, s)) {
+			close(s);
+			return -1;
+		}
 		if (-1 == bind(s, &addr->addr->plain, addr->len)) {
 			close(s);
 			ERROR(srv, "Couldn't bind socket to '%s': %s", str->str, g_strerror(errno));
@@ -654,6 +680,11 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 			g_string_free(ipv6_str, TRUE);
 			return -1;
 		}
+		if (reuseport && !set_reuseport(srv, s)) {
+			close(s);
+			g_string_free(ipv6_str, TRUE);
+			return -1;
+		}
 		if (-1 == setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v))) {
 			close(s);
 			ERROR(srv, "Couldn't setsockopt(IPV6_V6ONLY): %s", g_strerror(errno));
@@ -682,6 +713,10 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 #endif
 #ifdef HAVE_SYS_UN_H
 	case AF_UNIX:
+		if (reuseport) {
+			ERROR(srv, "Couldn't listen on '%s': SO_REUSEPORT not supported for unix sockets", str->str);
+			return -1;
+		}
 		if (-1 == unlink(addr->addr->un.sun_path)) {
 			switch (errno) {
 			case ENOENT:
@@ -715,7 +750,17 @@ static int do_listen(liServer *srv, liSocketAddress *addr, GString *str) {
 	return -1;
 }
 
-static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+static void core_listen_send_error(liServer *srv, liInstance *i, gint32 id, GString *error) {
+	GError *err = NULL;
+
+	if (!li_angel_send_result(i->acon, id, error, NULL, NULL, &err)) {
+		ERROR(srv, "Couldn't send result: %s", err->message);
+		g_error_free(err);
+	}
+}
+
+/* reuseport_key: "<worker-ndx> <address>" for a per-worker SO_REUSEPORT socket, NULL for a shared socket */
+static void core_listen_common(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data, GString *reuseport_key) {
 	GError *err = NULL;
 	gint fd;
 	GArray *fds;
@@ -723,18 +768,11 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 	liSocketAddress addr;
 	listen_socket *sock;
 
-	/* DEBUG(srv, "core_listen(%i) '%s'", id, data->str); */
-
-	if (-1 == id) return; /* ignore simple calls */
-
 	addr = li_sockaddr_from_string(data, 80);
 	if (!addr.addr) {
 		GString *error = g_string_sized_new(0);
 		g_string_printf(error, "Invalid socket address: '%s'", data->str);
-		if (!li_angel_send_result(i->acon, id, error, NULL, NULL, &err)) {
-			ERROR(srv, "Couldn't send result: %s", err->message);
-			g_error_free(err);
-		}
+		core_listen_send_error(srv, i, id, error);
 		return;
 	}
 
@@ -742,30 +780,35 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 		GString *error = g_string_sized_new(0);
 		li_sockaddr_clear(&addr);
 		g_string_printf(error, "Socket address not allowed: '%s'", data->str);
-		if (!li_angel_send_result(i->acon, id, error, NULL, NULL, &err)) {
-			ERROR(srv, "Couldn't send result: %s", err->message);
-			g_error_free(err);
-		}
+		core_listen_send_error(srv, i, id, error);
 		return;
 	}
 
-	if (NULL == (sock = g_hash_table_lookup(config->listen_sockets, &addr))) {
-		fd = do_listen(srv, &addr, data);
+	if (NULL != reuseport_key) {
+		sock = g_hash_table_lookup(config->reuseport_sockets, reuseport_key);
+	} else {
+		sock = g_hash_table_lookup(config->listen_sockets, &addr);
+	}
+
+	if (NULL == sock) {
+		fd = do_listen(srv, &addr, data, NULL != reuseport_key);
 
 		if (-1 == fd) {
 			GString *error = g_string_sized_new(0);
 			li_sockaddr_clear(&addr);
 			g_string_printf(error, "Couldn't listen to '%s'", data->str);
-			if (!li_angel_send_result(i->acon, id, error, NULL, NULL, &err)) {
-				ERROR(srv, "Couldn't send result: %s", err->message);
-				g_error_free(err);
-			}
+			core_listen_send_error(srv, i, id, error);
 			return;
 		}
 
 		li_fd_init(fd);
 		sock = listen_new_socket(&addr, fd);
-		g_hash_table_insert(config->listen_sockets, &sock->addr, sock);
+		if (NULL != reuseport_key) {
+			sock->reuseport_key = g_string_new_len(GSTR_LEN(reuseport_key));
+			g_hash_table_insert(config->reuseport_sockets, sock->reuseport_key, sock);
+		} else {
+			g_hash_table_insert(config->listen_sockets, &sock->addr, sock);
+		}
 	} else {
 		li_sockaddr_clear(&addr);
 	}
@@ -778,10 +821,7 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 		/* socket ref will be released when instance is released */
 		GString *error = g_string_sized_new(0);
 		g_string_printf(error, "Couldn't duplicate fd");
-		if (!li_angel_send_result(i->acon, id, error, NULL, NULL, &err)) {
-			ERROR(srv, "Couldn't send result: %s", err->message);
-			g_error_free(err);
-		}
+		core_listen_send_error(srv, i, id, error);
 		return;
 	}
 
@@ -795,6 +835,37 @@ static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GS
 	}
 }
 
+static void core_listen(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+	/* DEBUG(srv, "core_listen(%i) '%s'", id, data->str); */
+
+	if (-1 == id) return; /* ignore simple calls */
+
+	core_listen_common(srv, p, i, id, data, NULL);
+}
+
+/* data: "<worker-ndx> <address>"; every worker gets its own socket bound with SO_REUSEPORT.
+ * sockets are kept by (worker-ndx, address) so a graceful restart takes over the same accept queues
+ */
+static void core_listen_reuseport(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
+	gchar *sep;
+	GString *addr_str;
+
+	/* DEBUG(srv, "core_listen_reuseport(%i) '%s'", id, data->str); */
+
+	if (-1 == id) return; /* ignore simple calls */
+
+	if (NULL == (sep = strchr(data->str, ' ')) || sep == data->str) {
+		GString *error = g_string_sized_new(0);
+		g_string_printf(error, "Invalid reuseport listen request: '%s'", data->str);
+		core_listen_send_error(srv, i, id, error);
+		return;
+	}
+
+	addr_str = g_string_new(sep + 1);
+	core_listen_common(srv, p, i, id, addr_str, data);
+	g_string_free(addr_str, TRUE);
+}
+
 static void core_reached_state(liServer *srv, liPlugin *p, liInstance *i, gint32 id, GString *data) {
 	UNUSED(srv);
 	UNUSED(p);
@@ -894,6 +965,7 @@ static void core_free(liServer *srv, liPlugin *p) {
 	}
 	g_ptr_array_free(config->listen_masks, TRUE);
 	g_hash_table_destroy(config->listen_sockets);
+	g_hash_table_destroy(config->reuseport_sockets);
 	config->listen_masks = NULL;
 
 	g_slice_free(liPluginCoreConfig, config);
@@ -972,9 +1044,11 @@ static gboolean core_init(liServer *srv, liPlugin *p) {
 
 	core_parse_init(srv, p);
 	config->listen_sockets = g_hash_table_new_full(li_hash_sockaddr, li_equal_sockaddr, NULL, _listen_socket_free);
+	config->reuseport_sockets = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, NULL, _listen_socket_free);
 	config->listen_masks = g_ptr_array_new();
 
 	li_angel_plugin_add_angel_cb(p, "listen", core_listen);
+	li_angel_plugin_add_angel_cb(p, "listen-reuseport", core_listen_reuseport);
 	li_angel_plugin_add_angel_cb(p, "reached-state", core_reached_state);
 	li_angel_plugin_add_angel_cb(p, "log-open-file", core_log_open_file);
 
@@ -3,6 +3,8 @@
 
 #include <lighttpd/utils.h>
 
+#include <sys/uio.h>
+
 /* IMPORTANT
  * In order to keep _release thread-safe the io watcher keeps a
  * reference too while active; when the last reference is dropped
@@ -26,6 +28,7 @@ GQuark li_memcached_error_quark(void) {
 }
 
 #define BUFFER_CHUNK_SIZE 4*1024
+#define SEND_MAX_IOVEC 32
 
 typedef struct int_request int_request;
 typedef enum {
@@ -40,6 +43,10 @@ struct liMemcachedCon {
 	liEventIO con_watcher;
 	int fd;
 	li_tstamp last_con_start;
+	liMemcachedProtocol protocol;
+
+	li_tstamp timeout; /* 0: wait forever */
+	liEventTimer timeout_watcher;
 
 	GQueue req_queue;
 	int_request *cur_req;
@@ -63,6 +70,7 @@ struct liMemcachedCon {
 struct int_request {
 	liMemcachedRequest req;
 	req_type type;
+	gboolean meta; /* LI_MEMCACHED_PROTOCOL_META */
 
 	GString *key;
 	guint32 flags;
@@ -82,6 +90,14 @@ static void send_queue_push_buffer(GQueue *queue, liBuffer *buf, gsize start, gs
 	if (!buf || !len) return;
 	g_assert(start+len <= buf->used);
 
+	/* commands of requests issued in the same loop iteration are written one after another
+	 * into the same buffer; extend the last item so they are sent as one block */
+	i = g_queue_peek_tail(queue);
+	if (NULL != i && i->buf == buf && i->pos + i->len == start) {
+		i->len += len;
+		return;
+	}
+
 	li_buffer_acquire(buf);
 	i = g_slice_new0(send_item);
 	i->buf = buf;
@@ -148,16 +164,34 @@ static void memcached_stop_io(liMemcachedCon *con) {
 	}
 }
 
+/* (re)start the timer while requests are waiting; "progress" restarts a running timer */
+static void memcached_update_timeout(liMemcachedCon *con, gboolean progress) {
+	if (0 == con->timeout || 0 == con->req_queue.length) {
+		li_event_stop(&con->timeout_watcher);
+	} else if (progress || !li_event_active(&con->timeout_watcher)) {
+		li_event_timer_once(&con->timeout_watcher, con->timeout);
+	}
+}
+
 static void send_request(liMemcachedCon *con, int_request *req) {
 	switch (req->type) {
 	case REQ_GET:
-		g_string_printf(con->tmpstr, "get %s\r\n", req->key->str);
+		if (req->meta) {
+			/* mg <key> v f\r\n: return value and client flags */
+			g_string_printf(con->tmpstr, "mg %s v f\r\n", req->key->str);
+		} else {
+			g_string_printf(con->tmpstr, "get %s\r\n", req->key->str);
+		}
 		send_queue_push_gstring(&con->out, con->tmpstr, &con->buf);
 		break;
 	case REQ_SET:
-		/* set <key> <flags> <exptime> <bytes>\r\n */
-
-		g_string_printf(con->tmpstr, "set %s %"G_GUINT32_FORMAT" %"G_GUINT64_FORMAT" %"G_GSIZE_FORMAT"\r\n", req->key->str, req->flags, (guint64) req->ttl, req->data ? req->data->used : 0);
+		if (req->meta) {
+			/* ms <key> <bytes> F<flags> T<exptime>\r\n */
+			g_string_printf(con->tmpstr, "ms %s %"G_GSIZE_FORMAT" F%"G_GUINT32_FORMAT" T%"G_GUINT64_FORMAT"\r\n", req->key->str, req->data ? req->data->used : 0, req->flags, (guint64) req->ttl);
+		} else {
+			/* set <key> <flags> <exptime> <bytes>\r\n */
+			g_string_printf(con->tmpstr, "set %s %"G_GUINT32_FORMAT" %"G_GUINT64_FORMAT" %"G_GSIZE_FORMAT"\r\n", req->key->str, req->flags, (guint64) req->ttl, req->data ? req->data->used : 0);
+		}
 		send_queue_push_gstring(&con->out, con->tmpstr, &con->buf);
 		if (NULL != req->data) {
 			send_queue_push_buffer(&con->out, req->data, 0, req->data->used);
@@ -180,6 +214,7 @@ static gboolean push_request(liMemcachedCon *con, int_request *req, GError **err
 
 	memcached_start_io(con);
 	li_event_io_set_events(&con->con_watcher, LI_EV_READ | LI_EV_WRITE);
+	memcached_update_timeout(con, FALSE);
 
 	return TRUE;
 }
@@ -346,9 +381,15 @@ static void memcached_connect(liMemcachedCon *con) {
 			li_sockaddr_to_string(con->addr, con->tmpstr, TRUE)->str,
 			g_strerror(err));
 
+		if (con->buf) con->buf->used = 0;
+		send_queue_reset(&con->out);
+
 		close(s);
 		memcached_stop_io(con);
 		li_event_io_set_fd(&con->con_watcher, -1);
+
+		/* requests queued while connecting */
+		cancel_all_requests(con);
 	} else {
 		/* connect succeeded */
 		con->fd = s;
@@ -385,6 +426,7 @@ static void close_con(liMemcachedCon *con) {
 	li_event_io_set_fd(&con->con_watcher, -1);
 	con->cur_req = NULL;
 	cancel_all_requests(con);
+	memcached_update_timeout(con, FALSE);
 	memcached_connect(con);
 }
 
@@ -615,7 +657,8 @@ static void handle_read(liMemcachedCon *con) {
 
 			con->get_have_header = TRUE;
 
-			if (3 == con->line->used && 0 == memcmp("END", con->line->addr, 3)) {
+			if (cur->meta ? (2 == con->line->used && 0 == memcmp("EN", con->line->addr, 2))
+					: (3 == con->line->used && 0 == memcmp("END", con->line->addr, 3))) {
 				/* key not found */
 				if (cur->req.callback) {
 					cur->req.callback(&cur->req, LI_MEMCACHED_NOT_FOUND, NULL, NULL);
@@ -627,6 +670,44 @@ static void handle_read(liMemcachedCon *con) {
 
 			/* con->line is 0 terminated */
 
+			if (cur->meta) {
+				if (0 != strncmp("VA ", con->line->addr, 3)) {
+					g_clear_error(&con->err);
+					g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Protocol error: Unexpected response for GET: '%s'", con->line->addr);
+					close_con(con);
+					return;
+				}
+
+				/* VA <bytes> <flags>*\r\n; we asked for f (client flags) only */
+
+				/* <bytes> */
+				pos = con->line->addr + 3;
+				con->get_data_size = g_ascii_strtoll(pos, &next, 10);
+				if (pos == next) goto req_get_header_error;
+
+				while (' ' == *next) {
+					pos = next + 1;
+					if ('f' == *pos) {
+						con->curitem.flags = strtoul(pos + 1, &next, 10);
+						if (pos + 1 == next) goto req_get_header_error;
+					} else {
+						/* ignore flags we didn't ask for */
+						next = pos + strcspn(pos, " ");
+					}
+				}
+
+				if ('\0' != *next) {
+					goto req_get_header_error;
+				}
+
+				/* the response doesn't repeat the key */
+				con->curitem.key = g_string_new_len(GSTR_LEN(cur->key));
+
+				con->line->used = 0;
+
+				goto req_get_header_done;
+			}
+
 			if (0 != strncmp("VALUE ", con->line->addr, 6)) {
 				g_clear_error(&con->err);
 				g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Protocol error: Unexpected response for GET: '%s'", con->line->addr);
@@ -680,24 +761,27 @@ req_get_header_done: ;
 			/* wait for data */
 			if (!try_read_data(con, con->get_data_size)) return;
 		}
-		/* wait for END\r\n */
-		if (!try_read_line(con)) return;
 
-		if (3 == con->line->used && 0 == memcmp("END", con->line->addr, 3)) {
-			/* Move data to item */
-			con->curitem.data = con->data;
-			con->data = NULL;
-			if (cur->req.callback) {
-				cur->req.callback(&cur->req, LI_MEMCACHED_OK, &con->curitem, NULL);
+		if (!cur->meta) {
+			/* wait for END\r\n */
+			if (!try_read_line(con)) return;
+
+			if (3 != con->line->used || 0 != memcmp("END", con->line->addr, 3)) {
+				g_clear_error(&con->err);
+				g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Protocol error: GET response not terminated with END (got '%s')", con->line->addr);
+				close_con(con);
+				return;
 			}
-			reset_item(&con->curitem);
-		} else {
-			g_clear_error(&con->err);
-			g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Protocol error: GET response not terminated with END (got '%s')", con->line->addr);
-			close_con(con);
-			return;
 		}
 
+		/* Move data to item */
+		con->curitem.data = con->data;
+		con->data = NULL;
+		if (cur->req.callback) {
+			cur->req.callback(&cur->req, LI_MEMCACHED_OK, &con->curitem, NULL);
+		}
+		reset_item(&con->curitem);
+
 		con->cur_req = NULL;
 		free_request(con, cur);
 		return;
@@ -705,7 +789,29 @@ req_get_header_done: ;
 	case REQ_SET:
 		if (!try_read_line(con)) return;
 
-		if (6 == con->line->used && 0 == memcmp("STORED", con->line->addr, 6)) {
+		if (cur->meta && 2 == con->line->used) {
+			/* HD: stored, NS: not stored, EX: cas mismatch, NF: not found (cas) */
+			liMemcachedResult result;
+
+			if (0 == memcmp("HD", con->line->addr, 2)) {
+				result = LI_MEMCACHED_OK;
+			} else if (0 == memcmp("NS", con->line->addr, 2)) {
+				result = LI_MEMCACHED_NOT_STORED;
+			} else if (0 == memcmp("EX", con->line->addr, 2)) {
+				result = LI_MEMCACHED_EXISTS;
+			} else if (0 == memcmp("NF", con->line->addr, 2)) {
+				result = LI_MEMCACHED_NOT_FOUND;
+			} else {
+				g_clear_error(&con->err);
+				g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Protocol error: unepxected SET response: '%s'", con->line->addr);
+				close_con(con);
+				return;
+			}
+
+			if (cur->req.callback) {
+				cur->req.callback(&cur->req, result, NULL, NULL);
+			}
+		} else if (!cur->meta && 6 == con->line->used && 0 == memcmp("STORED", con->line->addr, 6)) {
 			if (cur->req.callback) {
 				cur->req.callback(&cur->req, LI_MEMCACHED_OK, NULL, NULL);
 			}
@@ -732,6 +838,7 @@ static void memcached_io_cb(liEventBase *watcher, int events) {
 
 	if (-1 == con->fd) {
 		memcached_connect(con);
+		memcached_update_timeout(con, TRUE);
 		return;
 	}
 
@@ -739,16 +846,22 @@ static void memcached_io_cb(liEventBase *watcher, int events) {
 
 	if (events & LI_EV_WRITE) {
 		int i;
-		ssize_t written, len;
-		gchar *data;
+		ssize_t written;
+		struct iovec iov[SEND_MAX_IOVEC];
+		GList *l;
 		send_item *si;
 
-		si = g_queue_peek_head(&con->out);
+		for (i = 0; i < 10 && con->out.length > 0; i++) { /* don't try more than 10 times */
+			/* all pending requests (the pipeline) in one syscall */
+			int iovcnt = 0;
+			for (l = con->out.head; NULL != l && iovcnt < SEND_MAX_IOVEC; l = l->next) {
+				si = l->data;
+				iov[iovcnt].iov_base = si->buf->addr + si->pos;
+				iov[iovcnt].iov_len = si->len;
+				iovcnt++;
+			}
 
-		for (i = 0; si && (i < 10); i++) { /* don't send more than 10 chunks */
-			data = si->buf->addr + si->pos;
-			len = si->len;
-			written = write(li_event_io_fd(&con->con_watcher), data, len);
+			written = writev(li_event_io_fd(&con->con_watcher), iov, iovcnt);
 			if (written < 0) {
 				switch (errno) {
 				case EINTR:
@@ -767,12 +880,16 @@ static void memcached_io_cb(liEventBase *watcher, int events) {
 					goto out;
 				}
 			} else {
-				si->pos += written;
-				si->len -= written;
-				if (0 == si->len) {
+				while (written > 0) {
+					si = g_queue_peek_head(&con->out);
+					if ((gsize) written < si->len) {
+						si->pos += written;
+						si->len -= written;
+						goto write_eagain; /* socket buffer full */
+					}
+					written -= si->len;
 					send_queue_item_free(si);
 					g_queue_pop_head(&con->out);
-					si = g_queue_peek_head(&con->out);
 				}
 			}
 		}
@@ -789,6 +906,24 @@ write_eagain:
 
 out:
 	memcached_update_io(con);
+	memcached_update_timeout(con, TRUE);
+	li_memcached_con_release(con);
+}
+
+static void memcached_timeout_cb(liEventBase *watcher, int events) {
+	liMemcachedCon *con = LI_CONTAINER_OF(li_event_timer_from(watcher), liMemcachedCon, timeout_watcher);
+	UNUSED(events);
+
+	li_memcached_con_acquire(con);
+
+	g_clear_error(&con->err);
+	g_set_error(&con->err, LI_MEMCACHED_ERROR, LI_MEMCACHED_CONNECTION, "Timeout: no response from '%s'",
+		li_sockaddr_to_string(con->addr, con->tmpstr, TRUE)->str);
+
+	/* don't reconnect right away (see memcached_connect): new requests fail until then */
+	con->last_con_start = li_event_now(li_event_get_loop(&con->con_watcher));
+	close_con(con);
+
 	li_memcached_con_release(con);
 }
 
@@ -803,12 +938,27 @@ liMemcachedCon* li_memcached_con_new(liEventLoop *loop, liSocketAddress addr) {
 	con->fd = -1;
 	li_event_io_init(loop, "memcached", &con->con_watcher, memcached_io_cb, -1, 0);
 	li_event_set_keep_loop_alive(&con->con_watcher, FALSE);
+	li_event_timer_init(loop, "memcached timeout", &con->timeout_watcher, memcached_timeout_cb);
+	li_event_set_keep_loop_alive(&con->timeout_watcher, FALSE);
 
 	memcached_connect(con);
 
 	return con;
 }
 
+void li_memcached_con_set_protocol(liMemcachedCon *con, liMemcachedProtocol protocol) {
+	con->protocol = protocol;
+}
+
+void li_memcached_con_set_timeout(liMemcachedCon *con, li_tstamp timeout) {
+	con->timeout = timeout;
+	memcached_update_timeout(con, FALSE);
+}
+
+guint li_memcached_con_pending(liMemcachedCon *con) {
+	return con->req_queue.length;
+}
+
 static void li_memcached_con_free(liMemcachedCon* con) {
 	if (!con) return;
 
@@ -820,6 +970,7 @@ static void li_memcached_con_free(liMemcachedCon* con) {
 
 	send_queue_reset(&con->out);
 	cancel_all_requests(con);
+	li_event_clear(&con->timeout_watcher);
 
 	li_buffer_release(con->buf);
 	li_buffer_release(con->line);
@@ -857,8 +1008,9 @@ liMemcachedRequest* li_memcached_get(liMemcachedCon *con, GString *key, liMemcac
 		return NULL;
 	}
 
-	if (-1 == con->fd) memcached_connect(con);
-	if (-1 == con->fd) {
+	/* requests wait in the queue while connecting */
+	if (-1 == li_event_io_fd(&con->con_watcher)) memcached_connect(con);
+	if (-1 == li_event_io_fd(&con->con_watcher)) {
 		if (NULL == con->err) {
 			g_set_error(err, LI_MEMCACHED_ERROR, LI_MEMCACHED_DISABLED, "Not connected");
 		} else if (err) {
@@ -872,6 +1024,7 @@ liMemcachedRequest* li_memcached_get(liMemcachedCon *con, GString *key, liMemcac
 	req->req.cb_data = cb_data;
 
 	req->type = REQ_GET;
+	req->meta = (LI_MEMCACHED_PROTOCOL_META == con->protocol);
 	req->key = g_string_new_len(GSTR_LEN(key));
 
 	if (!push_request(con, req, err)) {
@@ -890,8 +1043,9 @@ liMemcachedRequest* li_memcached_set(liMemcachedCon *con, GString *key, guint32
 		return NULL;
 	}
 
-	if (-1 == con->fd) memcached_connect(con);
-	if (-1 == con->fd) {
+	/* requests wait in the queue while connecting */
+	if (-1 == li_event_io_fd(&con->con_watcher)) memcached_connect(con);
+	if (-1 == li_event_io_fd(&con->con_watcher)) {
 		if (NULL == con->err) {
 			g_set_error(err, LI_MEMCACHED_ERROR, LI_MEMCACHED_DISABLED, "Not connected");
 		} else if (err) {
@@ -905,6 +1059,7 @@ liMemcachedRequest* li_memcached_set(liMemcachedCon *con, GString *key, guint32
 	req->req.cb_data = cb_data;
 
 	req->type = REQ_SET;
+	req->meta = (LI_MEMCACHED_PROTOCOL_META == con->protocol);
 	req->key = g_string_new_len(GSTR_LEN(key));
 	req->flags = flags;
 	req->ttl = ttl;
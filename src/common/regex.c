@@ -0,0 +1,549 @@
+
+#include <lighttpd/regex.h>
+#include <lighttpd/utils.h>
+
+#ifdef HAVE_PCRE2
+# define PCRE2_CODE_UNIT_WIDTH 8
+# include <pcre2.h>
+#endif
+
+struct liRegex {
+	gchar *pattern;
+	guint capture_count;
+#ifdef HAVE_PCRE2
+	pcre2_code *code;
+#else
+	GRegex *regex;
+#endif
+};
+
+struct liRegexMatch {
+	const gchar *subject;
+	guint count; /* groups of the matching regex, including group 0 */
+#ifdef HAVE_PCRE2
+	pcre2_match_data *match_data;
+	guint size; /* ovector pairs in match_data */
+	liRegexMatch *next; /* in the per-thread cache */
+#else
+	GMatchInfo *match_info;
+#endif
+};
+
+struct liRegexSet {
+	GPtrArray *regexes; /* (liRegex*), can contain NULL */
+	guint always; /* index of first NULL regex (G_MAXUINT if none); later entries never match */
+#ifdef HAVE_PCRE2
+	pcre2_code *combined; /* NULL: match one regex after another */
+	guint combined_groups;
+#endif
+};
+
+#ifdef HAVE_PCRE2
+
+static GQuark li_regex_error_quark(void) {
+	return g_quark_from_static_string("li-regex-error-quark");
+}
+
+/* matches are needed for every =~ condition and every rewrite/redirect; keep the
+ * match data (and the jit stack) per thread (i.e. per worker) instead of allocating it each time
+ */
+#define REGEX_MATCH_CACHE_SIZE 16
+/* enough for $0-$9 */
+#define REGEX_MATCH_MIN_SIZE 10
+
+#define REGEX_JIT_STACK_START (32*1024)
+#define REGEX_JIT_STACK_MAX (512*1024)
+
+typedef struct regex_match_cache regex_match_cache;
+struct regex_match_cache {
+	liRegexMatch *free; /* linked through match->next */
+	guint count;
+
+	pcre2_match_data *test_data; /* only group 0, for li_regex_test and sets without captures */
+	pcre2_match_context *context;
+	pcre2_jit_stack *jit_stack;
+};
+
+static void regex_match_cache_free(gpointer data) {
+	regex_match_cache *cache = data;
+	liRegexMatch *m;
+
+	while (NULL != (m = cache->free)) {
+		cache->free = m->next;
+		pcre2_match_data_free(m->match_data);
+		g_slice_free(liRegexMatch, m);
+	}
+	pcre2_match_data_free(cache->test_data);
+	pcre2_match_context_free(cache->context);
+	if (NULL != cache->jit_stack) pcre2_jit_stack_free(cache->jit_stack);
+	g_slice_free(regex_match_cache, cache);
+}
+
+static GStaticPrivate regex_match_cache_key = G_STATIC_PRIVATE_INIT;
+
+static regex_match_cache* regex_match_cache_get(void) {
+	regex_match_cache *cache = g_static_private_get(&regex_match_cache_key);
+
+	if (G_UNLIKELY(NULL == cache)) {
+		cache = g_slice_new0(regex_match_cache);
+		cache->test_data = pcre2_match_data_create(1, NULL);
+		cache->context = pcre2_match_context_create(NULL);
+		/* NULL if jit isn't supported */
+		cache->jit_stack = pcre2_jit_stack_create(REGEX_JIT_STACK_START, REGEX_JIT_STACK_MAX, NULL);
+		if (NULL != cache->jit_stack) pcre2_jit_stack_assign(cache->context, NULL, cache->jit_stack);
+		g_static_private_set(&regex_match_cache_key, cache, regex_match_cache_free);
+	}
+	return cache;
+}
+
+static liRegexMatch* regex_match_get(regex_match_cache *cache, guint groups) {
+	liRegexMatch *m = cache->free;
+
+	if (NULL != m) {
+		cache->free = m->next;
+		cache->count--;
+		m->next = NULL;
+	} else {
+		m = g_slice_new0(liRegexMatch);
+	}
+
+	groups = MAX(groups, REGEX_MATCH_MIN_SIZE);
+	if (m->size < groups) {
+		if (NULL != m->match_data) pcre2_match_data_free(m->match_data);
+		m->match_data = pcre2_match_data_create(groups, NULL);
+		m->size = groups;
+	}
+
+	return m;
+}
+
+static void regex_match_put(regex_match_cache *cache, liRegexMatch *m) {
+	if (cache->count < REGEX_MATCH_CACHE_SIZE) {
+		m->subject = NULL;
+		m->next = cache->free;
+		cache->free = m;
+		cache->count++;
+	} else {
+		pcre2_match_data_free(m->match_data);
+		g_slice_free(liRegexMatch, m);
+	}
+}
+
+/* rc is a negative pcre2_match result other than "no match" (like hitting the jit stack limit) */
+static void regex_match_error(GError **error, int rc) {
+	PCRE2_UCHAR msg[256];
+
+	pcre2_get_error_message(rc, msg, sizeof(msg));
+	g_set_error(error, li_regex_error_quark(), rc, "pcre2_match failed: %s", (const gchar*) msg);
+}
+
+static liRegexMatch* regex_match_exec(pcre2_code *code, guint groups, const gchar *subject, gsize len, GError **error) {
+	regex_match_cache *cache = regex_match_cache_get();
+	liRegexMatch *m = regex_match_get(cache, groups);
+	int rc;
+
+	if ((rc = pcre2_match(code, (PCRE2_SPTR) subject, len, 0, 0, m->match_data, cache->context)) < 0) {
+		regex_match_put(cache, m);
+		if (PCRE2_ERROR_NOMATCH != rc) regex_match_error(error, rc);
+		return NULL;
+	}
+
+	m->subject = subject;
+	m->count = groups;
+	return m;
+}
+
+liRegex* li_regex_new(const gchar *pattern, GError **error) {
+	liRegex *regex;
+	pcre2_code *code;
+	int errcode;
+	PCRE2_SIZE erroffset;
+	uint32_t capture_count = 0;
+
+	code = pcre2_compile((PCRE2_SPTR) pattern, PCRE2_ZERO_TERMINATED, 0, &errcode, &erroffset, NULL);
+	if (NULL == code) {
+		PCRE2_UCHAR msg[256];
+
+		pcre2_get_error_message(errcode, msg, sizeof(msg));
+		g_set_error(error, li_regex_error_quark(), errcode, "%s at offset %u", (const gchar*) msg, (guint) erroffset);
+		return NULL;
+	}
+
+	/* if jit isn't available pcre2_match uses the interpreter */
+	pcre2_jit_compile(code, PCRE2_JIT_COMPLETE);
+	pcre2_pattern_info(code, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+
+	regex = g_slice_new0(liRegex);
+	regex->pattern = g_strdup(pattern);
+	regex->capture_count = capture_count;
+	regex->code = code;
+
+	return regex;
+}
+
+void li_regex_free(liRegex *regex) {
+	if (NULL == regex) return;
+
+	pcre2_code_free(regex->code);
+	g_free(regex->pattern);
+	g_slice_free(liRegex, regex);
+}
+
+gboolean li_regex_test(liRegex *regex, const gchar *subject, gsize len, GError **error) {
+	regex_match_cache *cache = regex_match_cache_get();
+	int rc;
+
+	/* returns 0 if the ovector was too small: still a match */
+	if ((rc = pcre2_match(regex->code, (PCRE2_SPTR) subject, len, 0, 0, cache->test_data, cache->context)) >= 0) return TRUE;
+
+	if (PCRE2_ERROR_NOMATCH != rc) regex_match_error(error, rc);
+	return FALSE;
+}
+
+liRegexMatch* li_regex_match(liRegex *regex, const gchar *subject, gsize len, GError **error) {
+	return regex_match_exec(regex->code, regex->capture_count + 1, subject, len, error);
+}
+
+void li_regex_match_free(liRegexMatch *match) {
+	if (NULL == match) return;
+
+	regex_match_put(regex_match_cache_get(), match);
+}
+
+gboolean li_regex_match_fetch_pos(liRegexMatch *match, guint n, gsize *start, gsize *end) {
+	PCRE2_SIZE *ovector;
+
+	if (n >= match->count) return FALSE;
+
+	ovector = pcre2_get_ovector_pointer(match->match_data);
+	/* start > end is possible with \K in a lookahead */
+	if (PCRE2_UNSET == ovector[2*n] || ovector[2*n] > ovector[2*n+1]) return FALSE;
+
+	*start = ovector[2*n];
+	*end = ovector[2*n+1];
+	return TRUE;
+}
+
+#else
+
+liRegex* li_regex_new(const gchar *pattern, GError **error) {
+	liRegex *regex;
+	GRegex *gregex;
+
+	gregex = g_regex_new(pattern, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, error);
+	if (NULL == gregex) return NULL;
+
+	regex = g_slice_new0(liRegex);
+	regex->pattern = g_strdup(pattern);
+	regex->capture_count = g_regex_get_capture_count(gregex);
+	regex->regex = gregex;
+
+	return regex;
+}
+
+void li_regex_free(liRegex *regex) {
+	if (NULL == regex) return;
+
+	g_regex_unref(regex->regex);
+	g_free(regex->pattern);
+	g_slice_free(liRegex, regex);
+}
+
+gboolean li_regex_test(liRegex *regex, const gchar *subject, gsize len, GError **error) {
+	return g_regex_match_full(regex->regex, subject, len, 0, 0, NULL, error);
+}
+
+liRegexMatch* li_regex_match(liRegex *regex, const gchar *subject, gsize len, GError **error) {
+	GMatchInfo *match_info = NULL;
+	liRegexMatch *m;
+
+	if (!g_regex_match_full(regex->regex, subject, len, 0, 0, &match_info, error)) {
+		if (NULL != match_info) g_match_info_free(match_info);
+		return NULL;
+	}
+
+	m = g_slice_new0(liRegexMatch);
+	m->subject = subject;
+	m->count = regex->capture_count + 1;
+	m->match_info = match_info;
+	return m;
+}
+
+void li_regex_match_free(liRegexMatch *match) {
+	if (NULL == match) return;
+
+	g_match_info_free(match->match_info);
+	g_slice_free(liRegexMatch, match);
+}
+
+gboolean li_regex_match_fetch_pos(liRegexMatch *match, guint n, gsize *start, gsize *end) {
+	gint start_pos, end_pos;
+
+	if (n >= match->count) return FALSE;
+
+	if (!g_match_info_fetch_pos(match->match_info, (gint) n, &start_pos, &end_pos) || start_pos < 0 || start_pos > end_pos) return FALSE;
+
+	*start = start_pos;
+	*end = end_pos;
+	return TRUE;
+}
+
+#endif
+
+const gchar* li_regex_get_pattern(liRegex *regex) {
+	return regex->pattern;
+}
+
+guint li_regex_get_capture_count(liRegex *regex) {
+	return regex->capture_count;
+}
+
+guint li_regex_match_get_count(liRegexMatch *match) {
+	return match->count;
+}
+
+const gchar* li_regex_match_get_subject(liRegexMatch *match) {
+	return match->subject;
+}
+
+liRegexSet* li_regex_set_new(void) {
+	liRegexSet *set = g_slice_new0(liRegexSet);
+
+	set->regexes = g_ptr_array_new();
+	set->always = G_MAXUINT;
+
+	return set;
+}
+
+void li_regex_set_add(liRegexSet *set, liRegex *regex) {
+	if (NULL == regex && G_MAXUINT == set->always) set->always = set->regexes->len;
+	g_ptr_array_add(set->regexes, regex);
+}
+
+#ifdef HAVE_PCRE2
+
+/* whether the regex keeps its meaning as an alternative of the combined pattern; this is
+ * conservative: it only has to reject everything that could change the result.
+ */
+static gboolean regex_combinable(const gchar *pattern) {
+	const gchar *c;
+
+	for (c = pattern; '\0' != *c; c++) {
+		switch (*c) {
+		case '\\':
+			c++;
+			/* \Q would quote the closing parentheses; \g<..> and \g'..' are subroutine calls */
+			if ('\0' == *c || 'Q' == *c) return FALSE;
+			if ('g' == *c && ('<' == c[1] || '\'' == c[1])) return FALSE;
+			break;
+		case '#':
+			/* comment in extended mode (?x) */
+			return FALSE;
+		case '(':
+			/* backtracking verbs like (*COMMIT) or (*SKIP) affect the other alternatives too,
+			 * (*UTF) etc. are only allowed at the start of a pattern */
+			if ('*' == c[1]) return FALSE;
+			if ('?' == c[1]) {
+				/* recursion and subroutine calls: (?R), (?1), (?+1), (?-1), (?&name), (?P>name) */
+				if ('R' == c[2] || '&' == c[2] || '+' == c[2] || g_ascii_isdigit(c[2])) return FALSE;
+				if ('-' == c[2] && g_ascii_isdigit(c[3])) return FALSE;
+				if ('P' == c[2] && '>' == c[3]) return FALSE;
+			}
+			break;
+		}
+	}
+
+	return TRUE;
+}
+
+/* whether all alternatives of the (combinable) regex start with '^', i.e. it starts with '^' and
+ * has no '|' outside of groups and character classes; when in doubt returns FALSE.
+ */
+static gboolean regex_anchored(const gchar *pattern) {
+	const gchar *c;
+	guint depth = 0;
+
+	if ('^' != pattern[0]) return FALSE;
+
+	for (c = pattern + 1; '\0' != *c; c++) {
+		switch (*c) {
+		case '\\':
+			c++;
+			if ('\0' == *c) return FALSE;
+			break;
+		case '[':
+			/* skip the character class; a ']' right at the start is a literal */
+			c++;
+			if ('^' == *c) c++;
+			if (']' == *c) c++;
+			for (; ']' != *c; c++) {
+				if ('\0' == *c) return FALSE;
+				if ('\\' == *c) {
+					c++;
+					if ('\0' == *c) return FALSE;
+				} else if ('[' == *c && ':' == c[1]) {
+					/* [:alpha:] */
+					const gchar *end = strstr(c + 2, ":]");
+					if (NULL == end) return FALSE;
+					c = end + 1;
+				}
+			}
+			break;
+		case '(':
+			depth++;
+			break;
+		case ')':
+			if (0 == depth) return FALSE;
+			depth--;
+			break;
+		case '|':
+			if (0 == depth) return FALSE;
+			break;
+		}
+	}
+
+	return TRUE;
+}
+
+gboolean li_regex_set_compile(liRegexSet *set) {
+	GString *combined;
+	guint i, len = MIN(set->always, set->regexes->len);
+	int errcode;
+	PCRE2_SIZE erroffset;
+	uint32_t capture_count = 0;
+
+	if (NULL != set->combined) {
+		pcre2_code_free(set->combined);
+		set->combined = NULL;
+	}
+
+	/* nothing to gain */
+	if (len < 2) return FALSE;
+
+	for (i = 0; i < len; i++) {
+		if (!regex_combinable(li_regex_get_pattern(g_ptr_array_index(set->regexes, i)))) return FALSE;
+	}
+
+	/* the complete pattern is anchored, so alternative n is tried at all positions before
+	 * alternative n+1, i.e. the first regex in the list that matches anywhere wins.
+	 * "(?s:.*?)\K" skips to the start of the match (not needed if all alternatives of the regex
+	 * are anchored: "^/old|\.bak$" still needs it),
+	 * "(?:...)" keeps inline options like (?i) inside the alternative.
+	 */
+	combined = g_string_sized_new(255);
+	g_string_append_len(combined, CONST_STR_LEN("(?|"));
+	for (i = 0; i < len; i++) {
+		const gchar *pattern = li_regex_get_pattern(g_ptr_array_index(set->regexes, i));
+
+		if (i > 0) g_string_append_c(combined, '|');
+		if (!regex_anchored(pattern)) g_string_append_len(combined, CONST_STR_LEN("(?s:.*?)\\K"));
+		g_string_append_printf(combined, "(?:%s)(*MARK:%u)", pattern, i);
+	}
+	g_string_append_c(combined, ')');
+
+	set->combined = pcre2_compile((PCRE2_SPTR) combined->str, combined->len, PCRE2_ANCHORED, &errcode, &erroffset, NULL);
+	g_string_free(combined, TRUE);
+
+	if (NULL == set->combined) return FALSE;
+
+	pcre2_jit_compile(set->combined, PCRE2_JIT_COMPLETE);
+	pcre2_pattern_info(set->combined, PCRE2_INFO_CAPTURECOUNT, &capture_count);
+	set->combined_groups = capture_count + 1;
+
+	return TRUE;
+}
+
+static guint regex_set_mark(pcre2_match_data *match_data) {
+	PCRE2_SPTR mark = pcre2_get_mark(match_data);
+
+	LI_FORCE_ASSERT(NULL != mark);
+	return strtoul((const char*) mark, NULL, 10);
+}
+
+#else
+
+gboolean li_regex_set_compile(liRegexSet *set) {
+	UNUSED(set);
+	return FALSE;
+}
+
+#endif
+
+void li_regex_set_free(liRegexSet *set) {
+	guint i;
+
+	if (NULL == set) return;
+
+	for (i = 0; i < set->regexes->len; i++) {
+		li_regex_free(g_ptr_array_index(set->regexes, i));
+	}
+	g_ptr_array_free(set->regexes, TRUE);
+#ifdef HAVE_PCRE2
+	if (NULL != set->combined) pcre2_code_free(set->combined);
+#endif
+	g_slice_free(liRegexSet, set);
+}
+
+guint li_regex_set_get_length(liRegexSet *set) {
+	return set->regexes->len;
+}
+
+liRegex* li_regex_set_get(liRegexSet *set, guint ndx) {
+	return g_ptr_array_index(set->regexes, ndx);
+}
+
+guint li_regex_set_match(liRegexSet *set, const gchar *subject, gsize len, liRegexMatch **match, GError **error) {
+	GError *err = NULL;
+	guint i;
+
+	if (NULL != match) *match = NULL;
+
+#ifdef HAVE_PCRE2
+	if (NULL != set->combined) {
+		if (NULL != match) {
+			liRegexMatch *m = regex_match_exec(set->combined, set->combined_groups, subject, len, &err);
+
+			if (NULL == m) {
+				if (NULL == err) return set->always;
+				g_propagate_error(error, err);
+				return G_MAXUINT;
+			}
+
+			i = regex_set_mark(m->match_data);
+			/* only the groups of the winning regex */
+			m->count = li_regex_get_capture_count(g_ptr_array_index(set->regexes, i)) + 1;
+			*match = m;
+			return i;
+		} else {
+			regex_match_cache *cache = regex_match_cache_get();
+			int rc;
+
+			if ((rc = pcre2_match(set->combined, (PCRE2_SPTR) subject, len, 0, 0, cache->test_data, cache->context)) < 0) {
+				if (PCRE2_ERROR_NOMATCH == rc) return set->always;
+				regex_match_error(error, rc);
+				return G_MAXUINT;
+			}
+
+			return regex_set_mark(cache->test_data);
+		}
+	}
+#endif
+
+	for (i = 0; i < set->regexes->len; i++) {
+		liRegex *regex = g_ptr_array_index(set->regexes, i);
+
+		if (NULL == regex) return i;
+
+		if (NULL != match) {
+			if (NULL != (*match = li_regex_match(regex, subject, len, &err))) return i;
+		} else {
+			if (li_regex_test(regex, subject, len, &err)) return i;
+		}
+		if (NULL != err) {
+			g_propagate_error(error, err);
+			return G_MAXUINT;
+		}
+	}
+
+	return G_MAXUINT;
+}
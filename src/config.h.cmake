@@ -11,6 +11,7 @@
 #cmakedefine HAVE_SYS_DEVPOLL_H
 #cmakedefine HAVE_SYS_EPOLL_H
 #cmakedefine HAVE_SYS_EVENT_H
+#cmakedefine HAVE_SYS_INOTIFY_H
 #cmakedefine HAVE_SYS_MMAN_H
 #cmakedefine HAVE_SYS_POLL_H
 #cmakedefine HAVE_SYS_PORT_H
@@ -27,6 +28,7 @@
 #cmakedefine HAVE_TIME_H
 #cmakedefine HAVE_UNISTD_H
 #cmakedefine HAVE_PTHREAD_H
+#cmakedefine HAVE_LINUX_TLS_H
 #cmakedefine HAVE_INET_ATON
 #cmakedefine HAVE_IPV6
 #cmakedefine HAVE_SOCKADDR_STORAGE
@@ -97,10 +99,22 @@
 /* ZLIB */
 #cmakedefine  HAVE_ZLIB
 
+/* Brotli */
+#cmakedefine  HAVE_BROTLI
+
+/* Zstandard */
+#cmakedefine  HAVE_ZSTD
+
 /* GLIB */
 #cmakedefine  HAVE_GLIB_H
 #cmakedefine  HAVE_GLIB
 
+/* PCRE2 */
+#cmakedefine  HAVE_PCRE2
+
+/* liburing */
+#cmakedefine  HAVE_LIBURING
+
 /* lua */
 #cmakedefine  HAVE_LUA_H
 #cmakedefine  HAVE_LIBLUA
@@ -150,6 +164,7 @@
 #cmakedefine  HAVE_SYSLOG
 #cmakedefine  HAVE_WRITEV
 #cmakedefine  HAVE_ACCEPT4
+#cmakedefine  HAVE_SPLICE
 
 /* libcrypt */
 #cmakedefine  HAVE_LIBCRYPT
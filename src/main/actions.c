@@ -1,6 +1,9 @@
 
 #include <lighttpd/base.h>
 
+/* shorter chains are as fast to check one by one */
+#define LI_ACTION_DISPATCH_MIN_CHAIN 8
+
 typedef struct action_stack_element action_stack_element;
 
 struct action_stack_element {
@@ -46,6 +49,14 @@ void li_action_release(liServer *srv, liAction *a) {
 				a->data.balancer.free(srv, a->data.balancer.param);
 			}
 			break;
+		case LI_ACTION_TDISPATCH:
+			li_condition_dispatch_free(srv, a->data.dispatch.dispatch);
+			for (i = a->data.dispatch.targets->len; i-- > 0; ) {
+				li_action_release(srv, g_array_index(a->data.dispatch.targets, liAction*, i));
+			}
+			g_array_free(a->data.dispatch.targets, TRUE);
+			li_action_release(srv, a->data.dispatch.target_else);
+			break;
 		}
 		g_slice_free(liAction, a);
 	}
@@ -161,6 +172,104 @@ void li_action_append_inplace(liAction *list, liAction *element) {
 	}
 }
 
+/* next condition in an "else if" chain; the config parser wraps it in a list */
+static liAction* action_chain_next(liAction *a) {
+	liAction *next = a->data.condition.target_else;
+
+	if (NULL != next && LI_ACTION_TLIST == next->type && 1 == next->data.list->len) {
+		next = g_array_index(next->data.list, liAction*, 0);
+	}
+
+	return (NULL != next && LI_ACTION_TCONDITION == next->type) ? next : NULL;
+}
+
+/* converts a condition action to a dispatch action if it starts a long enough chain */
+static gboolean action_compile_dispatch(liServer *srv, liAction *a) {
+	liConditionDispatch *d;
+	liConditionLValue *lvalue;
+	liAction *cur, *last = NULL, *target_else;
+	GArray *targets;
+	guint len;
+
+	if (!li_condition_dispatch_supported(a->data.condition.cond)) return FALSE;
+
+	d = li_condition_dispatch_new(a->data.condition.cond->lvalue);
+	for (cur = a; NULL != cur && li_condition_dispatch_add(d, cur->data.condition.cond); cur = action_chain_next(cur)) {
+		last = cur;
+	}
+
+	len = li_condition_dispatch_length(d);
+	if (len < LI_ACTION_DISPATCH_MIN_CHAIN) {
+		li_condition_dispatch_free(srv, d);
+		return FALSE;
+	}
+
+	targets = g_array_sized_new(FALSE, FALSE, sizeof(liAction*), len);
+	for (cur = a; ; cur = action_chain_next(cur)) {
+		liAction *target = cur->data.condition.target;
+		if (NULL != target) li_action_acquire(target);
+		g_array_append_val(targets, target);
+		if (cur == last) break;
+	}
+	target_else = last->data.condition.target_else;
+	if (NULL != target_else) li_action_acquire(target_else);
+
+	lvalue = li_condition_dispatch_lvalue(d);
+	if (NULL != lvalue->key) {
+		DEBUG(srv, "compiled chain of %u conditions on %s[\"%s\"] to a dispatch table", len, li_cond_lvalue_to_string(lvalue->type), lvalue->key->str);
+	} else {
+		DEBUG(srv, "compiled chain of %u conditions on %s to a dispatch table", len, li_cond_lvalue_to_string(lvalue->type));
+	}
+
+	/* a may be referenced from several places: replace it in place */
+	li_condition_release(srv, a->data.condition.cond);
+	li_action_release(srv, a->data.condition.target);
+	li_action_release(srv, a->data.condition.target_else);
+
+	a->type = LI_ACTION_TDISPATCH;
+	a->data.dispatch.dispatch = d;
+	a->data.dispatch.targets = targets;
+	a->data.dispatch.target_else = target_else;
+
+	return TRUE;
+}
+
+/* visited: actions can be shared (and/or conditions), only compile them once */
+static void action_compile(liServer *srv, liAction *a, GHashTable *visited) {
+	guint i;
+
+	if (NULL == a || NULL != g_hash_table_lookup(visited, a)) return;
+	g_hash_table_insert(visited, a, a);
+
+	if (LI_ACTION_TCONDITION == a->type) action_compile_dispatch(srv, a);
+
+	switch (a->type) {
+	case LI_ACTION_TCONDITION:
+		action_compile(srv, a->data.condition.target, visited);
+		action_compile(srv, a->data.condition.target_else, visited);
+		break;
+	case LI_ACTION_TLIST:
+		for (i = 0; i < a->data.list->len; i++) {
+			action_compile(srv, g_array_index(a->data.list, liAction*, i), visited);
+		}
+		break;
+	case LI_ACTION_TDISPATCH:
+		for (i = 0; i < a->data.dispatch.targets->len; i++) {
+			action_compile(srv, g_array_index(a->data.dispatch.targets, liAction*, i), visited);
+		}
+		action_compile(srv, a->data.dispatch.target_else, visited);
+		break;
+	default:
+		break;
+	}
+}
+
+void li_action_compile(liServer *srv, liAction *a) {
+	GHashTable *visited = g_hash_table_new(g_direct_hash, g_direct_equal);
+	action_compile(srv, a, visited);
+	g_hash_table_destroy(visited);
+}
+
 static void action_stack_element_release(liServer *srv, liVRequest *vr, action_stack_element *ase) {
 	liAction *a;
 
@@ -185,7 +294,7 @@ static void action_stack_element_release(liServer *srv, liVRequest *vr, action_s
 				liActionRegexStackElement *arse = &g_array_index(rs, liActionRegexStackElement, rs->len - 1);
 				if (arse->string)
 					g_string_free(arse->string, TRUE);
-				g_match_info_free(arse->match_info);
+				li_regex_match_free(arse->match);
 				g_array_set_size(rs, rs->len - 1);
 			}
 		}
@@ -195,6 +304,8 @@ static void action_stack_element_release(liServer *srv, liVRequest *vr, action_s
 	case LI_ACTION_TBALANCER:
 		a->data.balancer.finished(vr, a->data.balancer.param, ase->data.context);
 		break;
+	case LI_ACTION_TDISPATCH:
+		break;
 	}
 
 	li_action_release(srv, ase->act);
@@ -410,6 +521,30 @@ liHandlerResult li_action_execute(liVRequest *vr) {
 				li_action_enter(vr, g_array_index(a->data.list, liAction*, p));
 			}
 			break;
+		case LI_ACTION_TDISPATCH:
+			{
+				guint ndx;
+				res = li_condition_dispatch_check(vr, a->data.dispatch.dispatch, &ndx);
+				switch (res) {
+				case LI_HANDLER_GO_ON:
+					ase->finished = TRUE;
+					if (ndx < a->data.dispatch.targets->len) {
+						liAction *target = g_array_index(a->data.dispatch.targets, liAction*, ndx);
+						if (target) li_action_enter(vr, target);
+					}
+					else if (a->data.dispatch.target_else) {
+						li_action_enter(vr, a->data.dispatch.target_else);
+					}
+					break;
+				case LI_HANDLER_ERROR:
+					li_action_stack_reset(vr, as);
+					return res;
+				case LI_HANDLER_COMEBACK:
+				case LI_HANDLER_WAIT_FOR_EVENT:
+					return res;
+				}
+			}
+			break;
 		case LI_ACTION_TBALANCER:
 			/* skip balancer if request is already handled */
 			if (li_vrequest_is_handled(vr)) {
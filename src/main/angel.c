@@ -82,8 +82,7 @@ static void li_angel_listen_cb(gpointer pctx, gboolean timeout, GString *error,
 	}
 }
 
-/* listen to a socket */
-void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer data) {
+static void angel_listen(liServer *srv, const gchar *call, GString *request, GString *str, gboolean reuseport, liAngelListenCB cb, gpointer data) {
 	if (srv->acon) {
 		liAngelCall *acall = li_angel_call_new(&srv->main_worker->loop, li_angel_listen_cb, 20.0);
 		angel_listen_cb_ctx *ctx = g_slice_new0(angel_listen_cb_ctx);
@@ -93,12 +92,13 @@ void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer d
 		ctx->cb = cb;
 		ctx->data = data;
 		acall->context = ctx;
-		if (!li_angel_send_call(srv->acon, CONST_STR_LEN("core"), CONST_STR_LEN("listen"), acall, g_string_new_len(GSTR_LEN(str)), &err)) {
+		if (!li_angel_send_call(srv->acon, CONST_STR_LEN("core"), call, strlen(call), acall, request, &err)) {
 			ERROR(srv, "couldn't send call: %s", err->message);
 			g_error_free(err);
 		}
 	} else {
-		int fd = li_angel_fake_listen(srv, str);
+		int fd = li_angel_fake_listen(srv, str, reuseport);
+		g_string_free(request, TRUE);
 		if (-1 == fd) {
 			ERROR(srv, "listen('%s') failed", str->str);
 			/* TODO: exit? */
@@ -112,6 +112,17 @@ void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer d
 	}
 }
 
+/* listen to a socket */
+void li_angel_listen(liServer *srv, GString *str, liAngelListenCB cb, gpointer data) {
+	angel_listen(srv, "listen", g_string_new_len(GSTR_LEN(str)), str, FALSE, cb, data);
+}
+
+void li_angel_listen_reuseport(liServer *srv, GString *str, guint ndx, liAngelListenCB cb, gpointer data) {
+	GString *request = g_string_sized_new(str->len + 8);
+	g_string_printf(request, "%u %s", ndx, str->str);
+	angel_listen(srv, "listen-reuseport", request, str, TRUE, cb, data);
+}
+
 /* send log messages while startup to angel */
 void li_angel_log(liServer *srv, GString *str) {
 	li_angel_fake_log(srv, str);
@@ -6,7 +6,7 @@
 #include <fcntl.h>
 
 /* listen to a socket */
-int li_angel_fake_listen(liServer *srv, GString *str) {
+int li_angel_fake_listen(liServer *srv, GString *str, gboolean reuseport) {
 	liSocketAddress addr = li_sockaddr_from_string(str, 80);
 	liSockAddr *saddr = addr.addr;
 	GString *tmpstr;
@@ -22,6 +22,10 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 	switch (saddr->plain.sa_family) {
 #ifdef HAVE_SYS_UN_H
 	case AF_UNIX:
+		if (reuseport) {
+			ERROR(srv, "Couldn't listen on '%s': SO_REUSEPORT not supported for unix sockets", tmpstr->str);
+			goto error;
+		}
 		if (-1 == unlink(saddr->un.sun_path)) {
 			switch (errno) {
 			case ENOENT:
@@ -62,6 +66,19 @@ int li_angel_fake_listen(liServer *srv, GString *str) {
 			close(s);
 			goto error;
 		}
+		if (reuseport) {
+#ifdef SO_REUSEPORT
+			if (-1 == setsockopt(s, SOL_SOCKET, SO_REUSEPORT, &v, sizeof(v))) {
+				ERROR(srv, "Couldn't setsockopt(SO_REUSEPORT): %s", g_strerror(errno));
+				close(s);
+				goto error;
+			}
+#else
+			ERROR(srv, "%s", "Couldn't setsockopt(SO_REUSEPORT): not supported on this platform");
+			close(s);
+			goto error;
+#endif
+		}
 #ifdef HAVE_IPV6
 		if (AF_INET6 == saddr->plain.sa_family && -1 == setsockopt(s, IPPROTO_IPV6, IPV6_V6ONLY, &v, sizeof(v))) {
 			ERROR(srv, "Couldn't setsockopt(IPV6_V6ONLY): %s", g_strerror(errno));
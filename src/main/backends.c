@@ -5,6 +5,10 @@ typedef struct liBackendConnection_p liBackendConnection_p;
 typedef struct liBackendWorkerPool liBackendWorkerPool;
 typedef struct liBackendPool_p liBackendPool_p;
 
+#define BACKEND_EJECT_TIME 10 /* seconds an ejected backend without active checks is skipped if disable_time is 0 */
+#define BACKEND_SLOW_START_RETRY 0.2 /* seconds until requests held back by the slow start ramp retry */
+#define BACKEND_CHECK_MAX_RESPONSE 4096 /* active checks read at most this many bytes of the response */
+
 struct liBackendWait {
 	li_tstamp ts_started;
 
@@ -77,12 +81,28 @@ struct liBackendPool_p {
 
 	guint active, reserved, idle, pending, total; /* [pool] connection counts. */
 
+	guint64 requests, reused; /* [pool] connections handed out to vrequests; how many of them served a request before */
+
 	/* waiting vrequests: global queue if connection limit > 0 is used */
 	GQueue wait_queue; /* <liBackendWait> */
 	/* ^^ should use timer in worker-pool? */
 
 	li_tstamp ts_disabled_till;
 
+	/* health checks [pool] */
+	liBackendHealth health;
+	guint fails; /* consecutive failures */
+	guint64 ejections;
+	li_tstamp ts_health; /* when the backend was ejected / recovered */
+
+	/* active health checks; only used in the first worker */
+	liWaitQueue check_queue;
+	liWaitQueueElem check_elem;
+	liEventIO check_watcher; /* fd != -1 while a check is running */
+	gboolean check_connected;
+	gsize check_sent;
+	GString *check_response; /* != NULL if active checks were started */
+
 	gboolean initialized, shutdown;
 };
 
@@ -255,21 +275,16 @@ static void S_backend_pool_worker_insert_connected(liBackendWorkerPool *wpool, i
 	S_backend_pool_worker_insert_con(pool, NULL, con);
 }
 
-static void S_backend_pool_failed(liBackendWorkerPool *wpool) {
-	liBackendPool_p *pool = wpool->pool;
+static void S_backend_pool_fail_waiting(liBackendPool_p *pool, liServer *srv) {
 	GList *elem;
 
-	if (pool->public.config->disable_time > 0) {
-		pool->ts_disabled_till = li_cur_ts(wpool->wrk) + pool->public.config->disable_time;
-	}
-
 	while (NULL != (elem = g_queue_pop_head_link(&pool->wait_queue))) {
 		liBackendWait *bwait = LI_CONTAINER_OF(elem, liBackendWait, wait_queue_link);
 		bwait->failed = TRUE;
 		li_job_async(bwait->vr_ref);
 	}
 
-	for (guint i = 0, len = wpool->wrk->srv->worker_count; i < len; ++i) {
+	for (guint i = 0, len = srv->worker_count; i < len; ++i) {
 		liBackendWorkerPool *_wpool = &pool->worker_pools[i];
 		while (NULL != (elem = g_queue_pop_head_link(&_wpool->wait_queue))) {
 			liBackendWait *bwait = LI_CONTAINER_OF(elem, liBackendWait, wait_queue_link);
@@ -279,6 +294,85 @@ static void S_backend_pool_failed(liBackendWorkerPool *wpool) {
 	}
 }
 
+static void S_backend_health_failed(liBackendPool_p *pool, liWorker *wrk) {
+	const liBackendConfig *config = pool->public.config;
+
+	if (pool->fails < G_MAXUINT) ++pool->fails;
+
+	if (0 == config->max_fails || pool->fails < config->max_fails || LI_BACKEND_EJECTED == pool->health) return;
+
+	pool->health = LI_BACKEND_EJECTED;
+	pool->ts_health = li_cur_ts(wrk);
+	++pool->ejections;
+
+	ERROR(wrk->srv, "Backend '%s' ejected after %u consecutive failures",
+		li_sockaddr_to_string(config->sock_addr, wrk->tmp_str, TRUE)->str, pool->fails);
+
+	S_backend_pool_fail_waiting(pool, wrk->srv);
+}
+
+static void S_backend_health_recovered(liBackendPool_p *pool, liWorker *wrk) {
+	const liBackendConfig *config = pool->public.config;
+
+	pool->fails = 0;
+
+	if (LI_BACKEND_EJECTED != pool->health) return;
+
+	pool->health = (config->slow_start > 0) ? LI_BACKEND_SLOW_START : LI_BACKEND_HEALTHY;
+	pool->ts_health = li_cur_ts(wrk);
+	pool->ts_disabled_till = 0;
+
+	INFO(wrk->srv, "Backend '%s' recovered",
+		li_sockaddr_to_string(config->sock_addr, wrk->tmp_str, TRUE)->str);
+}
+
+/* whether new requests have to fail */
+static gboolean S_backend_pool_unavailable(liBackendPool_p *pool, liWorker *wrk) {
+	li_tstamp now = li_cur_ts(wrk);
+
+	if (LI_BACKEND_EJECTED == pool->health) {
+		const liBackendConfig *config = pool->public.config;
+		guint eject_time = (config->disable_time > 0) ? config->disable_time : BACKEND_EJECT_TIME;
+
+		/* only a successful active check brings it back */
+		if (config->check_interval > 0) return TRUE;
+		if (now < pool->ts_health + eject_time) return TRUE;
+
+		S_backend_health_recovered(pool, wrk);
+	}
+
+	return pool->ts_disabled_till > now;
+}
+
+/* limit for the total number of connections; G_MAXUINT: no limit (apart from max_connections) */
+static guint S_backend_pool_slow_start_limit(liBackendPool_p *pool, liWorker *wrk) {
+	const liBackendConfig *config = pool->public.config;
+	li_tstamp elapsed;
+	guint target;
+
+	if (LI_BACKEND_SLOW_START != pool->health) return G_MAXUINT;
+
+	elapsed = li_cur_ts(wrk) - pool->ts_health;
+	if (elapsed >= config->slow_start) {
+		pool->health = LI_BACKEND_HEALTHY;
+		return G_MAXUINT;
+	}
+
+	target = (config->max_connections > 0) ? (guint) config->max_connections : 128;
+	return MAX(1, (guint) (target * elapsed / config->slow_start));
+}
+
+static void S_backend_pool_failed(liBackendWorkerPool *wpool) {
+	liBackendPool_p *pool = wpool->pool;
+
+	if (pool->public.config->disable_time > 0) {
+		pool->ts_disabled_till = li_cur_ts(wpool->wrk) + pool->public.config->disable_time;
+	}
+
+	S_backend_health_failed(pool, wpool->wrk);
+	S_backend_pool_fail_waiting(pool, wpool->wrk->srv);
+}
+
 /* See http://www.cyberconf.org/~cynbe/ref/nonblocking-connects.html
  * for a discussion on async connects
  */
@@ -436,6 +530,7 @@ static gboolean S_backend_connection_connect(liBackendWorkerPool *wpool) {
 static void S_backend_pool_distribute(liBackendPool_p *pool, liWorker *wrk) {
 	if (pool->public.config->max_connections <= 0) {
 		int max_connections = (pool->public.config->max_connections < 0) ? -pool->public.config->max_connections : 128;
+		guint limit = S_backend_pool_slow_start_limit(pool, wrk);
 		liBackendWorkerPool *wpool = &pool->worker_pools[wrk->ndx];
 		/* only local wpool */
 
@@ -454,6 +549,14 @@ static void S_backend_pool_distribute(liBackendPool_p *pool, liWorker *wrk) {
 
 		if (MIN((unsigned int) max_connections, wpool->wait_queue.length) > wpool->pending) {
 			guint need = MIN((unsigned int) max_connections, wpool->wait_queue.length) - wpool->pending;
+
+			need = (pool->total < limit) ? MIN(need, limit - pool->total) : 0;
+			if (0 == need) {
+				/* slow start: other workers won't wake us up, retry when the limit grew */
+				li_event_timer_once(&wpool->wait_queue_timer, BACKEND_SLOW_START_RETRY);
+				return;
+			}
+
 			for (; need > 0; --need) {
 				if (!S_backend_connection_connect(wpool)) {
 					S_backend_pool_failed(wpool);
@@ -546,7 +649,8 @@ static void S_backend_pool_distribute(liBackendPool_p *pool, liWorker *wrk) {
 		}
 
 		if (pool->wait_queue.length > pool->pending) {
-			guint need = MIN((unsigned int) pool->public.config->max_connections - pool->total, pool->wait_queue.length - pool->pending);
+			guint limit = MIN((unsigned int) pool->public.config->max_connections, S_backend_pool_slow_start_limit(pool, wrk));
+			guint need = (pool->total < limit) ? MIN(limit - pool->total, pool->wait_queue.length - pool->pending) : 0;
 			if (need > 0) {
 				liBackendWorkerPool *wpool = &pool->worker_pools[wrk->ndx];
 
@@ -751,6 +855,13 @@ static void backend_pool_wait_queue_timeout(liEventBase *watcher, int events) {
 
 	g_mutex_lock(pool->lock);
 
+	if (pool->public.config->max_connections <= 0) {
+		/* per worker wait queues don't time out; the timer only retries requests held back by slow start */
+		S_backend_pool_distribute(pool, wpool->wrk);
+		g_mutex_unlock(pool->lock);
+		return;
+	}
+
 	while (pool->wait_queue.length > 0) {
 		liBackendWait *bwait = LI_CONTAINER_OF(g_queue_peek_head_link(&pool->wait_queue), liBackendWait, wait_queue_link);
 
@@ -768,6 +879,159 @@ static void backend_pool_wait_queue_timeout(liEventBase *watcher, int events) {
 	g_mutex_unlock(pool->lock);
 }
 
+static void backend_pool_check_done(liBackendPool_p *pool, gboolean success, const gchar *reason) {
+	liWorker *wrk = pool->worker_pools[0].wrk;
+	int fd = li_event_io_fd(&pool->check_watcher);
+
+	if (-1 != fd) {
+		li_event_stop(&pool->check_watcher);
+		li_event_io_set_fd(&pool->check_watcher, -1);
+		close(fd);
+	}
+	pool->check_connected = FALSE;
+	pool->check_sent = 0;
+	g_string_truncate(pool->check_response, 0);
+
+	if (!success) {
+		ERROR(wrk->srv, "Health check for '%s' failed: %s",
+			li_sockaddr_to_string(pool->public.config->sock_addr, wrk->tmp_str, TRUE)->str, reason);
+	}
+
+	g_mutex_lock(pool->lock);
+	if (success) {
+		/* a healthy backend keeps its failure count: the check might not cover what failed */
+		if (LI_BACKEND_EJECTED == pool->health) S_backend_health_recovered(pool, wrk);
+	} else {
+		S_backend_health_failed(pool, wrk);
+	}
+	g_mutex_unlock(pool->lock);
+}
+
+static void backend_pool_check_start(liBackendPool_p *pool) {
+	const liBackendConfig *config = pool->public.config;
+	liWorker *wrk = pool->worker_pools[0].wrk;
+	int fd;
+
+	do {
+		fd = socket(config->sock_addr.addr->plain.sa_family, SOCK_STREAM, 0);
+	} while (-1 == fd && errno == EINTR);
+	if (-1 == fd) {
+		/* not the backends fault */
+		if (errno == EMFILE) {
+			li_server_out_of_fds(wrk->srv);
+		}
+		ERROR(wrk->srv, "Couldn't open socket: %s", g_strerror(errno));
+		return;
+	}
+	li_fd_no_block(fd);
+
+	if (-1 == connect(fd, &config->sock_addr.addr->plain, config->sock_addr.len)) {
+		switch (errno) {
+		case EINPROGRESS:
+		case EALREADY:
+		case EINTR:
+			break;
+		default:
+			{
+				int err = errno;
+				close(fd);
+				backend_pool_check_done(pool, FALSE, g_strerror(err));
+			}
+			return;
+		}
+	}
+
+	/* writable: connect finished */
+	li_event_io_set_fd(&pool->check_watcher, fd);
+	li_event_io_set_events(&pool->check_watcher, LI_EV_WRITE);
+	li_event_start(&pool->check_watcher);
+}
+
+static void backend_pool_check_cb(liEventBase *watcher, int events) {
+	liEventIO *iowatcher = li_event_io_from(watcher);
+	liBackendPool_p *pool = LI_CONTAINER_OF(iowatcher, liBackendPool_p, check_watcher);
+	const liBackendConfig *config = pool->public.config;
+	int fd = li_event_io_fd(iowatcher);
+	UNUSED(events);
+
+	if (!pool->check_connected) {
+		int err;
+		socklen_t len = sizeof(err);
+
+		if (-1 == getsockopt(fd, SOL_SOCKET, SO_ERROR, (void*)&err, &len)) {
+			err = errno;
+		}
+		if (0 != err) {
+			backend_pool_check_done(pool, FALSE, g_strerror(err));
+			return;
+		}
+		pool->check_connected = TRUE;
+
+		if (NULL == config->check_request) {
+			backend_pool_check_done(pool, TRUE, NULL);
+			return;
+		}
+	}
+
+	if (pool->check_sent < config->check_request->len) {
+		ssize_t r = write(fd, config->check_request->str + pool->check_sent, config->check_request->len - pool->check_sent);
+
+		if (-1 == r) {
+			if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) return;
+			backend_pool_check_done(pool, FALSE, g_strerror(errno));
+			return;
+		}
+
+		pool->check_sent += r;
+		if (pool->check_sent == config->check_request->len) {
+			li_event_io_set_events(iowatcher, LI_EV_READ);
+		}
+		return;
+	}
+
+	{
+		gchar buf[1024];
+		liBackendCheckResult result;
+		ssize_t r = read(fd, buf, MIN(sizeof(buf), BACKEND_CHECK_MAX_RESPONSE - pool->check_response->len));
+
+		if (-1 == r) {
+			if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) return;
+			backend_pool_check_done(pool, FALSE, g_strerror(errno));
+			return;
+		}
+
+		g_string_append_len(pool->check_response, buf, r);
+
+		if (NULL != config->callbacks->check_cb) {
+			result = config->callbacks->check_cb(&pool->public, pool->check_response, 0 == r);
+		} else {
+			result = (pool->check_response->len > 0) ? LI_BACKEND_CHECK_OK : LI_BACKEND_CHECK_FAILED;
+		}
+
+		if (LI_BACKEND_CHECK_NEED_MORE == result) {
+			if (0 != r && pool->check_response->len < BACKEND_CHECK_MAX_RESPONSE) return;
+			result = LI_BACKEND_CHECK_FAILED;
+		}
+
+		backend_pool_check_done(pool, LI_BACKEND_CHECK_OK == result, (0 == r) ? "connection closed" : "unexpected response");
+	}
+}
+
+static void backend_pool_check_timeout(liWaitQueue *wq, gpointer data) {
+	liBackendPool_p *pool = data;
+
+	if (NULL != li_waitqueue_pop(wq)) {
+		if (-1 != li_event_io_fd(&pool->check_watcher)) {
+			backend_pool_check_done(pool, FALSE, "timeout");
+		}
+
+		backend_pool_check_start(pool);
+		li_waitqueue_push(wq, &pool->check_elem);
+	}
+
+	li_waitqueue_update(wq);
+}
+
 static gpointer backend_pool_worker_init(liWorker *wrk, gpointer fdata) {
 	liBackendPool_p *pool = fdata;
 	liBackendWorkerPool *wpool = &pool->worker_pools[wrk->ndx];
@@ -783,6 +1047,17 @@ static gpointer backend_pool_worker_init(liWorker *wrk, gpointer fdata) {
 	li_event_timer_init(&wrk->loop, "backend wait timeout", &wpool->wait_queue_timer, backend_pool_wait_queue_timeout);
 	li_event_set_keep_loop_alive(&wpool->wait_queue_timer, FALSE);
 
+	if (0 == wrk->ndx && pool->public.config->check_interval > 0) {
+		li_waitqueue_init(&pool->check_queue, &wrk->loop, "backend health check queue", backend_pool_check_timeout, pool->public.config->check_interval, pool);
+		li_event_set_keep_loop_alive(&pool->check_queue.timer, FALSE);
+		li_event_io_init(&wrk->loop, "backend health check", &pool->check_watcher, backend_pool_check_cb, -1, 0);
+		li_event_set_keep_loop_alive(&pool->check_watcher, FALSE);
+		pool->check_response = g_string_sized_new(0);
+
+		/* might run with the pool lock held; the first check starts after check_interval */
+		li_waitqueue_push(&pool->check_queue, &pool->check_elem);
+	}
+
 	wpool->initialized = TRUE;
 	return NULL;
 }
@@ -813,6 +1088,10 @@ static void S_backend_pool_init(liWorker *wrk, liBackendPool_p *pool) {
 		}
 
 		li_collect_start(wrk, backend_pool_worker_init, pool, backend_pool_worker_init_done, NULL);
+
+		g_mutex_lock(wrk->srv->backend_pools_mutex);
+		g_ptr_array_add(wrk->srv->backend_pools, &pool->public);
+		g_mutex_unlock(wrk->srv->backend_pools_mutex);
 	}
 
 	backend_pool_worker_init(wrk, pool);
@@ -828,6 +1107,18 @@ static gpointer backend_pool_worker_shutdown(liWorker *wrk, gpointer fdata) {
 	li_event_clear(&wpool->wakeup);
 	li_event_clear(&wpool->wait_queue_timer);
 
+	if (0 == wrk->ndx && NULL != pool->check_response) {
+		int fd = li_event_io_fd(&pool->check_watcher);
+
+		li_waitqueue_remove(&pool->check_queue, &pool->check_elem);
+		li_waitqueue_stop(&pool->check_queue);
+		li_event_clear(&pool->check_watcher);
+		if (-1 != fd) close(fd);
+
+		g_string_free(pool->check_response, TRUE);
+		pool->check_response = NULL;
+	}
+
 	g_mutex_lock(pool->lock);
 
 	while (NULL != (elem = li_waitqueue_pop_force(&wpool->idle_queue))) {
@@ -867,6 +1158,13 @@ static void backend_pool_worker_shutdown_done(gpointer cbdata, gpointer fdata, G
 	UNUSED(result);
 	UNUSED(complete);
 
+	if (pool->worker_pools != NULL) {
+		liServer *srv = pool->worker_pools[0].wrk->srv;
+		g_mutex_lock(srv->backend_pools_mutex);
+		g_ptr_array_remove_fast(srv->backend_pools, &pool->public);
+		g_mutex_unlock(srv->backend_pools_mutex);
+	}
+
 	pool->public.config->callbacks->free_cb(&pool->public);
 
 	if (pool->worker_pools != NULL) {
@@ -929,7 +1227,7 @@ liBackendResult li_backend_get(liVRequest *vr, liBackendPool *bpool, liBackendCo
 	if (*pbwait) {
 		bwait = *pbwait;
 		LI_FORCE_ASSERT(vr == bwait->vr);
-	} else if (pool->ts_disabled_till > li_cur_ts(vr->wrk)) {
+	} else if (S_backend_pool_unavailable(pool, vr->wrk)) {
 		goto out;
 	} else {
 		if (wpool->idle > 0) {
@@ -945,6 +1243,8 @@ liBackendResult li_backend_get(liVRequest *vr, liBackendPool *bpool, liBackendCo
 				li_event_set_callback(&con->public.watcher, NULL);
 			}
 			li_waitqueue_remove(&wpool->idle_queue, &con->timeout_elem);
+			++pool->requests;
+			if (con->requests > 0) ++pool->reused;
 			goto out;
 		}
 
@@ -997,6 +1297,8 @@ liBackendResult li_backend_get(liVRequest *vr, liBackendPool *bpool, liBackendCo
 			li_event_set_callback(&con->public.watcher, NULL);
 		}
 		li_waitqueue_remove(&wpool->idle_queue, &con->timeout_elem);
+		++pool->requests;
+		if (con->requests > 0) ++pool->reused;
 		goto out;
 	}
 
@@ -1054,6 +1356,26 @@ void li_backend_wait_stop(liVRequest *vr, liBackendPool *bpool, liBackendWait **
 	g_mutex_unlock(pool->lock);
 }
 
+gboolean li_backend_share(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon) {
+	liBackendPool_p *pool = LI_CONTAINER_OF(bpool, liBackendPool_p, public);
+	liBackendConnection_p *con = LI_CONTAINER_OF(bcon, liBackendConnection_p, public);
+	gboolean result = FALSE;
+
+	g_mutex_lock(pool->lock);
+	LI_FORCE_ASSERT(con->active);
+
+	if (!S_backend_pool_unavailable(pool, wrk)) {
+		/* li_backend_put() counts the first request */
+		++con->requests;
+		++pool->requests;
+		++pool->reused;
+		result = TRUE;
+	}
+	g_mutex_unlock(pool->lock);
+
+	return result;
+}
+
 void li_backend_put(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bcon, gboolean closecon) {
 	liBackendPool_p *pool = LI_CONTAINER_OF(bpool, liBackendPool_p, public);
 	liBackendConnection_p *con = LI_CONTAINER_OF(bcon, liBackendConnection_p, public);
@@ -1087,9 +1409,109 @@ void li_backend_put(liWorker *wrk, liBackendPool *bpool, liBackendConnection *bc
 	}
 }
 
+void li_backend_report(liWorker *wrk, liBackendPool *bpool, gboolean failed) {
+	liBackendPool_p *pool = LI_CONTAINER_OF(bpool, liBackendPool_p, public);
+
+	g_mutex_lock(pool->lock);
+	if (failed) {
+		S_backend_health_failed(pool, wrk);
+	} else if (LI_BACKEND_EJECTED != pool->health) {
+		/* late answers from before the ejection don't bring the backend back */
+		pool->fails = 0;
+	}
+	g_mutex_unlock(pool->lock);
+}
+
 void li_backend_connection_closed(liBackendPool *bpool, liBackendConnection *bcon) {
 	liBackendPool_p *pool = LI_CONTAINER_OF(bpool, liBackendPool_p, public);
 	liBackendConnection_p *con = LI_CONTAINER_OF(bcon, liBackendConnection_p, public);
 
 	backend_connection_close(pool, con, FALSE);
 }
+
+GArray* li_backend_pools_stats(liServer *srv) {
+	GArray *stats = g_array_new(FALSE, TRUE, sizeof(liBackendPoolStats));
+	guint i;
+
+	g_mutex_lock(srv->backend_pools_mutex);
+	g_array_set_size(stats, srv->backend_pools->len);
+	for (i = 0; i < srv->backend_pools->len; ++i) {
+		liBackendPool_p *pool = LI_CONTAINER_OF(g_ptr_array_index(srv->backend_pools, i), liBackendPool_p, public);
+		liBackendPoolStats *ps = &g_array_index(stats, liBackendPoolStats, i);
+
+		/* don't lock the pool (lock order); the counters are only statistics */
+		ps->address = li_sockaddr_to_string(pool->public.config->sock_addr, NULL, TRUE);
+		ps->active = pool->active;
+		ps->idle = pool->idle;
+		ps->requests = pool->requests;
+		ps->reused = pool->reused;
+		ps->health = pool->health;
+		ps->fails = pool->fails;
+		ps->ejections = pool->ejections;
+	}
+	g_mutex_unlock(srv->backend_pools_mutex);
+
+	return stats;
+}
+
+const gchar* li_backend_health_string(liBackendHealth health) {
+	switch (health) {
+	case LI_BACKEND_HEALTHY:
+		return "healthy";
+	case LI_BACKEND_EJECTED:
+		return "ejected";
+	case LI_BACKEND_SLOW_START:
+		return "slow start";
+	}
+
+	return "unknown";
+}
+
+static const GString
+	bon_max_fails = { CONST_STR_LEN("max-fails"), 0 },
+	bon_check_interval = { CONST_STR_LEN("check-interval"), 0 },
+	bon_check_path = { CONST_STR_LEN("check-path"), 0 },
+	bon_slow_start = { CONST_STR_LEN("slow-start"), 0 }
+;
+
+gboolean li_backend_parse_health_option(liServer *srv, const gchar *name, GString *key, liValue *value, liBackendHealthOptions *opts, gboolean *handled) {
+	guint *target;
+
+	*handled = TRUE;
+
+	if (g_string_equal(key, &bon_check_path)) {
+		if (LI_VALUE_STRING != li_value_type(value) || '/' != value->data.string->str[0]) {
+			ERROR(srv, "%s option '%s' expects a path starting with '/' as parameter", name, key->str);
+			return FALSE;
+		}
+		opts->check_path = value->data.string;
+		return TRUE;
+	}
+
+	if (g_string_equal(key, &bon_max_fails)) {
+		target = &opts->max_fails;
+	} else if (g_string_equal(key, &bon_check_interval)) {
+		target = &opts->check_interval;
+	} else if (g_string_equal(key, &bon_slow_start)) {
+		target = &opts->slow_start;
+	} else {
+		*handled = FALSE;
+		return TRUE;
+	}
+
+	if (LI_VALUE_NUMBER != li_value_type(value) || value->data.number < 0 || value->data.number > G_MAXINT) {
+		ERROR(srv, "%s option '%s' expects non-negative number as parameter", name, key->str);
+		return FALSE;
+	}
+	*target = value->data.number;
+	return TRUE;
+}
+
+void li_backend_pools_stats_free(GArray *stats) {
+	guint i;
+
+	for (i = 0; i < stats->len; ++i) {
+		g_string_free(g_array_index(stats, liBackendPoolStats, i).address, TRUE);
+	}
+	g_array_free(stats, TRUE);
+}
@@ -74,6 +74,114 @@ liHandlerResult li_chunkfile_open(liChunkFile *cf, GError **err) {
 	return LI_HANDLER_GO_ON;
 }
 
+/******************
+ *   chunkpipe    *
+ ******************/
+
+/* try to get a bigger pipe buffer than the default (64k on linux) */
+#define CHUNKPIPE_SIZE (256*1024)
+
+liChunkPipe* li_chunkpipe_new(void) {
+#ifdef USE_SPLICE
+	liChunkPipe *cp;
+	int fds[2];
+
+	if (-1 == pipe(fds)) return NULL;
+	li_fd_init(fds[0]);
+	li_fd_init(fds[1]);
+
+	cp = g_slice_new0(liChunkPipe);
+	cp->refcount = 1;
+	cp->fd[0] = fds[0];
+	cp->fd[1] = fds[1];
+	cp->length = 0;
+	cp->size = 64*1024;
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+	{
+		int size;
+		fcntl(fds[1], F_SETPIPE_SZ, CHUNKPIPE_SIZE); /* may fail, keep the default then */
+		if (0 < (size = fcntl(fds[1], F_GETPIPE_SZ))) cp->size = size;
+	}
+#endif
+	return cp;
+#else
+	return NULL;
+#endif
+}
+
+void li_chunkpipe_acquire(liChunkPipe *cp) {
+	LI_FORCE_ASSERT(g_atomic_int_get(&cp->refcount) > 0);
+	g_atomic_int_inc(&cp->refcount);
+}
+
+void li_chunkpipe_release(liChunkPipe *cp) {
+	if (!cp) return;
+	LI_FORCE_ASSERT(g_atomic_int_get(&cp->refcount) > 0);
+	if (g_atomic_int_dec_and_test(&cp->refcount)) {
+		close(cp->fd[0]);
+		close(cp->fd[1]);
+		g_slice_free(liChunkPipe, cp);
+	}
+}
+
+/* read len bytes of a PIPE_CHUNK from the head of the pipe (starting at c->data.pipe.read) */
+static gboolean chunk_pipe_read(liChunk *c, guint8 *dest, goffset len, GError **err) {
+	liChunkPipe *cp = c->data.pipe.pipe;
+	ssize_t r;
+
+	while (len > 0) {
+		if (-1 == (r = read(cp->fd[0], dest, len))) {
+			if (EINTR == errno) continue;
+			g_set_error(err, LI_CHUNK_ERROR, 0, "chunk_pipe_read: read from pipe failed: %s", g_strerror(errno));
+		} else if (0 == r) {
+			g_set_error(err, LI_CHUNK_ERROR, 0, "chunk_pipe_read: pipe is empty");
+		}
+		if (r <= 0) {
+			/* lost track of the pipe content, don't use it for new data */
+			cp->size = 0;
+			return FALSE;
+		}
+		dest += r;
+		len -= r;
+		c->data.pipe.read += r;
+		cp->length -= r;
+	}
+	return TRUE;
+}
+
+/* throw away skipped data which is still in the pipe */
+static void chunk_pipe_drain(liChunk *c) {
+	guint8 buf[4096];
+
+	while (NULL == c->mem && c->data.pipe.read < c->offset) {
+		goffset len = MIN((goffset) sizeof(buf), c->offset - c->data.pipe.read);
+		if (!chunk_pipe_read(c, buf, len, NULL)) {
+			c->data.pipe.read = c->offset;
+			return;
+		}
+	}
+}
+
+/* move the remaining data of a PIPE_CHUNK from the pipe into c->mem */
+static gboolean chunk_pipe_to_mem(liChunk *c, GError **err) {
+	goffset len;
+
+	if (NULL != c->mem) return TRUE;
+
+	chunk_pipe_drain(c);
+	len = c->data.pipe.length - c->data.pipe.read;
+	c->data.pipe.mem_offset = c->data.pipe.read;
+
+	c->mem = g_byte_array_sized_new(len);
+	g_byte_array_set_size(c->mem, len);
+	if (!chunk_pipe_read(c, c->mem->data, len, err)) {
+		g_byte_array_free(c->mem, TRUE);
+		c->mem = NULL;
+		return FALSE;
+	}
+	return TRUE;
+}
+
 /******************
  * chunk iterator *
  ******************/
@@ -152,6 +260,12 @@ read_chunk:
 		*data_start = (char*) c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset + start;
 		*data_len = length;
 		break;
+	case PIPE_CHUNK:
+		/* someone needs the data in userspace after all */
+		if (!chunk_pipe_to_mem(c, err)) return LI_HANDLER_ERROR;
+		*data_start = (char*) c->mem->data + c->offset - c->data.pipe.mem_offset + start;
+		*data_len = length;
+		break;
 	}
 	return LI_HANDLER_GO_ON;
 }
@@ -264,6 +378,11 @@ read_chunk:
 		*data_start = (char*) c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset + start;
 		*data_len = length;
 		break;
+	case PIPE_CHUNK:
+		if (!chunk_pipe_to_mem(c, err)) return LI_HANDLER_ERROR;
+		*data_start = (char*) c->mem->data + c->offset - c->data.pipe.mem_offset + start;
+		*data_len = length;
+		break;
 	}
 	return LI_HANDLER_GO_ON;
 }
@@ -272,17 +391,87 @@ read_chunk:
  *     chunk      *
  ******************/
 
+/* chunks are created and destroyed for almost every read and write; keep some
+ * free chunks per thread (i.e. per worker) instead of going to the allocator each time
+ */
+#define CHUNK_CACHE_SIZE 256
+
+typedef struct chunk_cache chunk_cache;
+struct chunk_cache {
+	liChunk *free; /* linked through chunk->next */
+	guint count;
+};
+
+static void chunk_cache_free(gpointer data) {
+	chunk_cache *cache = data;
+	liChunk *c;
+
+	while (NULL != (c = cache->free)) {
+		cache->free = c->next;
+		g_slice_free(liChunk, c);
+	}
+	g_slice_free(chunk_cache, cache);
+}
+
+static GStaticPrivate chunk_cache_key = G_STATIC_PRIVATE_INIT;
+
+static chunk_cache* chunk_cache_get(void) {
+	chunk_cache *cache = g_static_private_get(&chunk_cache_key);
+
+	if (G_UNLIKELY(NULL == cache)) {
+		cache = g_slice_new0(chunk_cache);
+		g_static_private_set(&chunk_cache_key, cache, chunk_cache_free);
+	}
+	return cache;
+}
+
 static liChunk* chunk_new(void) {
-	liChunk *c = g_slice_new0(liChunk);
+	chunk_cache *cache = chunk_cache_get();
+	liChunk *c = cache->free;
+
+	if (NULL != c) {
+		cache->free = c->next;
+		cache->count--;
+		memset(c, 0, sizeof(*c));
+	} else {
+		c = g_slice_new0(liChunk);
+	}
 	c->data.file.mmap.data = MAP_FAILED;
-	c->cq_link.data = c;
 	return c;
 }
 
+/* chunk queue: singly linked list of chunks; chunks only get removed at the head */
+
+static void cq_push_tail(liChunkQueue *cq, liChunk *c) {
+	c->next = NULL;
+	if (NULL != cq->queue.tail) {
+		cq->queue.tail->next = c;
+	} else {
+		cq->queue.head = c;
+	}
+	cq->queue.tail = c;
+	cq->queue.length++;
+}
+
+static liChunk* cq_pop_head(liChunkQueue *cq) {
+	liChunk *c = cq->queue.head;
+
+	if (NULL == c) return NULL;
+	cq->queue.head = c->next;
+	if (NULL == cq->queue.head) cq->queue.tail = NULL;
+	cq->queue.length--;
+	c->next = NULL;
+	return c;
+}
+
+/* if cq != NULL c must be the first chunk in cq */
 static void chunk_free(liChunkQueue *cq, liChunk *c) {
+	chunk_cache *cache;
+
 	if (!c) return;
 	if (cq) {
-		g_queue_unlink(&cq->queue, &c->cq_link);
+		LI_FORCE_ASSERT(c == cq->queue.head);
+		cq_pop_head(cq);
 	}
 	switch (c->type) {
 	case UNUSED_CHUNK:
@@ -307,13 +496,30 @@ static void chunk_free(liChunkQueue *cq, liChunk *c) {
 	case BUFFER_CHUNK:
 		li_buffer_release(c->data.buffer.buffer);
 		break;
+	case PIPE_CHUNK:
+		if (g_atomic_int_get(&c->data.pipe.pipe->refcount) > 1) {
+			/* pipe gets used for more data */
+			c->offset = c->data.pipe.length;
+			chunk_pipe_drain(c);
+		}
+		li_chunkpipe_release(c->data.pipe.pipe);
+		c->data.pipe.pipe = NULL;
+		break;
 	}
 	c->type = UNUSED_CHUNK;
 	if (c->mem) {
 		g_byte_array_free(c->mem, TRUE);
 		c->mem = NULL;
 	}
-	g_slice_free(liChunk, c);
+
+	cache = chunk_cache_get();
+	if (cache->count < CHUNK_CACHE_SIZE) {
+		c->next = cache->free;
+		cache->free = c;
+		cache->count++;
+	} else {
+		g_slice_free(liChunk, c);
+	}
 }
 
 /******************
@@ -415,32 +621,32 @@ void li_cqlimit_set_limit(liCQLimit *cql, goffset limit) {
 
 liChunkQueue* li_chunkqueue_new(void) {
 	liChunkQueue *cq = g_slice_new0(liChunkQueue);
-	g_queue_init(&cq->queue);
 	return cq;
 }
 
-static void __chunk_free(gpointer _c, gpointer userdata) {
-	liChunk *c = (liChunk *)_c;
-	liChunkQueue *cq = (liChunkQueue*) userdata;
-	if (c->type == STRING_CHUNK) cqlimit_update(cq, - (goffset)c->data.str->len);
-	else if (c->type == MEM_CHUNK) cqlimit_update(cq, - (goffset)c->mem->len);
-	else if (c->type == BUFFER_CHUNK) cqlimit_update(cq, - (goffset)c->data.buffer.length);
-	chunk_free(cq, c);
+static void cq_free_chunks(liChunkQueue *cq) {
+	liChunk *c;
+
+	while (NULL != (c = cq->queue.head)) {
+		if (c->type == STRING_CHUNK) cqlimit_update(cq, - (goffset)c->data.str->len);
+		else if (c->type == MEM_CHUNK) cqlimit_update(cq, - (goffset)c->mem->len);
+		else if (c->type == BUFFER_CHUNK) cqlimit_update(cq, - (goffset)c->data.buffer.length);
+		chunk_free(cq, c);
+	}
 }
 
 void li_chunkqueue_reset(liChunkQueue *cq) {
 	if (!cq) return;
 	cq->is_closed = FALSE;
 	cq->bytes_in = cq->bytes_out = cq->length = 0;
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
+	cq_free_chunks(cq);
 	LI_FORCE_ASSERT(cq->mem_usage == 0);
 	cq->mem_usage = 0;
-	g_queue_init(&cq->queue); /* should be empty now */
 }
 
 void li_chunkqueue_free(liChunkQueue *cq) {
 	if (!cq) return;
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
+	cq_free_chunks(cq);
 	li_cqlimit_release(cq->limit);
 	cq->limit = NULL;
 	LI_FORCE_ASSERT(cq->mem_usage == 0);
@@ -489,7 +695,7 @@ void li_chunkqueue_append_string(liChunkQueue *cq, GString *str) {
 	c = chunk_new();
 	c->type = STRING_CHUNK;
 	c->data.str = str;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += str->len;
 	cq->bytes_in += str->len;
 	cqlimit_update(cq, str->len);
@@ -508,7 +714,7 @@ void li_chunkqueue_append_bytearr(liChunkQueue *cq, GByteArray *mem) {
 	c = chunk_new();
 	c->type = MEM_CHUNK;
 	c->mem = mem;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += mem->len;
 	cq->bytes_in += mem->len;
 	cqlimit_update(cq, mem->len);
@@ -528,7 +734,7 @@ void li_chunkqueue_append_buffer(liChunkQueue *cq, liBuffer *buffer) {
 	c->data.buffer.buffer = buffer;
 	c->data.buffer.offset = 0;
 	c->data.buffer.length = buffer->used;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += buffer->used;
 	cq->bytes_in += buffer->used;
 	cqlimit_update(cq, buffer->used);
@@ -546,7 +752,7 @@ void li_chunkqueue_append_buffer2(liChunkQueue *cq, liBuffer *buffer, gsize offs
 	c->data.buffer.buffer = buffer;
 	c->data.buffer.offset = offset;
 	c->data.buffer.length = length;
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += length;
 	cq->bytes_in += length;
 	cqlimit_update(cq, length);
@@ -560,7 +766,7 @@ void li_chunkqueue_append_mem(liChunkQueue *cq, const void *mem, gssize len) {
 	c->type = MEM_CHUNK;
 	c->mem = g_byte_array_sized_new(len);
 	g_byte_array_append(c->mem, mem, len);
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += c->mem->len;
 	cq->bytes_in += c->mem->len;
 	cqlimit_update(cq, c->mem->len);
@@ -577,7 +783,7 @@ void li_chunkqueue_append_chunkfile(liChunkQueue *cq, liChunkFile *cf, off_t sta
 		c->data.file.start = start;
 		c->data.file.length = length;
 
-		g_queue_push_tail_link(&cq->queue, &c->cq_link);
+		cq_push_tail(cq, c);
 		cq->length += length;
 		cq->bytes_in += length;
 	}
@@ -590,7 +796,7 @@ static void __chunkqueue_append_file(liChunkQueue *cq, GString *filename, off_t
 	c->data.file.start = start;
 	c->data.file.length = length;
 
-	g_queue_push_tail_link(&cq->queue, &c->cq_link);
+	cq_push_tail(cq, c);
 	cq->length += length;
 	cq->bytes_in += length;
 }
@@ -626,12 +832,42 @@ void li_chunkqueue_append_tempfile_fd(liChunkQueue *cq, GString *filename, off_t
 	}
 }
 
+goffset li_chunkqueue_pipe_space(liChunkQueue *cq, liChunkPipe *cp) {
+	liChunk *c = cq->queue.tail;
+
+	if (cp->length > 0 && !(NULL != c && PIPE_CHUNK == c->type && cp == c->data.pipe.pipe && NULL == c->mem)) {
+		/* the data in the pipe belongs to a chunk somewhere else */
+		return 0;
+	}
+	return MAX(0, cp->size - cp->length);
+}
+
+void li_chunkqueue_append_pipe(liChunkQueue *cq, liChunkPipe *cp, goffset length) {
+	liChunk *c = cq->queue.tail;
+
+	if (0 == length) return;
+
+	if (NULL == c || PIPE_CHUNK != c->type || cp != c->data.pipe.pipe || NULL != c->mem) {
+		LI_FORCE_ASSERT(0 == cp->length);
+		c = chunk_new();
+		c->type = PIPE_CHUNK;
+		li_chunkpipe_acquire(cp);
+		c->data.pipe.pipe = cp;
+		cq_push_tail(cq, c);
+	}
+
+	c->data.pipe.length += length;
+	cp->length += length;
+	cq->length += length;
+	cq->bytes_in += length;
+}
+
 /* steal up to length bytes from in and put them into out, return number of bytes stolen */
 goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset length) {
 	liChunk *c, *cnew;
-	GList* l;
 	goffset bytes = 0, meminbytes = 0, memoutbytes = 0;
 	goffset we_have;
+	gboolean failed = FALSE;
 
 	while ( (NULL != (c = li_chunkqueue_first_chunk(in))) && length > 0 ) {
 		we_have = li_chunk_length(c);
@@ -643,8 +879,7 @@ goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset len
 			continue;
 		}
 		if (we_have <= length) { /* move complete chunk */
-			l = g_queue_pop_head_link(&in->queue);
-			g_queue_push_tail_link(&out->queue, l);
+			cq_push_tail(out, cq_pop_head(in));
 			bytes += we_have;
 			if (c->type == STRING_CHUNK) {
 				meminbytes -= c->data.str->len;
@@ -692,11 +927,29 @@ goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset len
 				cnew->data.buffer.length = length;
 				memoutbytes += length;
 				break;
+			case PIPE_CHUNK: /* only one chunk can refer to the pipe; copy the first part */
+				cnew->type = MEM_CHUNK;
+				cnew->mem = g_byte_array_sized_new(length);
+				if (NULL != c->mem) {
+					g_byte_array_append(cnew->mem, c->mem->data + c->offset - c->data.pipe.mem_offset, length);
+				} else {
+					chunk_pipe_drain(c);
+					g_byte_array_set_size(cnew->mem, length);
+					if (!chunk_pipe_read(c, cnew->mem->data, length, NULL)) {
+						/* the pipe content is lost; leave the chunk in "in" */
+						chunk_free(NULL, cnew);
+						failed = TRUE;
+						break;
+					}
+				}
+				memoutbytes += length;
+				break;
 			}
+			if (failed) break;
 			c->offset += length;
 			bytes += length;
 			length = 0;
-			g_queue_push_tail_link(&out->queue, &cnew->cq_link);
+			cq_push_tail(out, cnew);
 		}
 	}
 
@@ -707,7 +960,7 @@ goffset li_chunkqueue_steal_len(liChunkQueue *out, liChunkQueue *in, goffset len
 	cqlimit_update(out, memoutbytes);
 	cqlimit_update(in, meminbytes);
 
-	return bytes;
+	return failed ? -1 : bytes;
 }
 
 /* steal all chunks from in and put them into out, return number of bytes stolen */
@@ -725,7 +978,15 @@ goffset li_chunkqueue_steal_all(liChunkQueue *out, liChunkQueue *in) {
 		in->mem_usage = 0;
 	}
 
-	li_g_queue_merge(&out->queue, &in->queue);
+	if (NULL != out->queue.tail) {
+		out->queue.tail->next = in->queue.head;
+	} else {
+		out->queue.head = in->queue.head;
+	}
+	out->queue.tail = in->queue.tail;
+	out->queue.length += in->queue.length;
+	in->queue.head = in->queue.tail = NULL;
+	in->queue.length = 0;
 
 	/* count bytes in chunkqueues */
 	len = in->length;
@@ -739,13 +1000,11 @@ goffset li_chunkqueue_steal_all(liChunkQueue *out, liChunkQueue *in) {
 
 /* steal the first chunk from in and append it to out, return number of bytes stolen */
 goffset li_chunkqueue_steal_chunk(liChunkQueue *out, liChunkQueue *in) {
-	liChunk *c;
+	liChunk *c = cq_pop_head(in);
 	goffset length;
-	GList *l = g_queue_pop_head_link(&in->queue);
-	if (!l) return 0;
-	g_queue_push_tail_link(&out->queue, l);
+	if (!c) return 0;
+	cq_push_tail(out, c);
 
-	c = (liChunk*) l->data;
 	length = li_chunk_length(c);
 	in->bytes_out += length;
 	in->length -= length;
@@ -783,6 +1042,7 @@ goffset li_chunkqueue_skip(liChunkQueue *cq, goffset length) {
 			length -= we_have;
 		} else { /* skip first part of a chunk */
 			c->offset += length;
+			if (PIPE_CHUNK == c->type) chunk_pipe_drain(c);
 			bytes += length;
 			length = 0;
 		}
@@ -793,11 +1053,22 @@ goffset li_chunkqueue_skip(liChunkQueue *cq, goffset length) {
 	return bytes;
 }
 
+goffset li_chunkqueue_skip_spliced(liChunkQueue *cq, goffset length) {
+	liChunk *c = li_chunkqueue_first_chunk(cq);
+
+	LI_FORCE_ASSERT(NULL != c && PIPE_CHUNK == c->type && NULL == c->mem);
+	LI_FORCE_ASSERT(c->offset == c->data.pipe.read && length <= li_chunk_length(c));
+
+	c->data.pipe.read += length;
+	c->data.pipe.pipe->length -= length;
+
+	return li_chunkqueue_skip(cq, length);
+}
+
 goffset li_chunkqueue_skip_all(liChunkQueue *cq) {
 	goffset bytes = cq->length;
 
-	g_queue_foreach(&cq->queue, __chunk_free, cq);
-	g_queue_init(&cq->queue);
+	cq_free_chunks(cq);
 
 	cq->bytes_out += bytes;
 	cq->length = 0;
@@ -892,7 +1163,7 @@ gboolean li_chunkqueue_extract_to_bytearr(liChunkQueue *cq, goffset len, GByteAr
 /* returns the liBuffer from the last chunk in cq, if the chunk has type BUFFER_CHUNK,
  * and the buffer has at least min_space bytes free and refcount == 1 (NULL otherwise) */
 liBuffer* li_chunkqueue_get_last_buffer(liChunkQueue *cq, guint min_space) {
-	liChunk *c = g_queue_peek_tail(&cq->queue);
+	liChunk *c = cq->queue.tail;
 	liBuffer *buf;
 
 	if (!c || c->type != BUFFER_CHUNK) return NULL;
@@ -910,7 +1181,7 @@ liBuffer* li_chunkqueue_get_last_buffer(liChunkQueue *cq, guint min_space) {
  * updates the buffer and the cq data
  */
 LI_API void li_chunkqueue_update_last_buffer_size(liChunkQueue *cq, goffset add_length) {
-	liChunk *c = g_queue_peek_tail(&cq->queue);
+	liChunk *c = cq->queue.tail;
 	liBuffer *buf;
 
 	LI_FORCE_ASSERT(c && c->type == BUFFER_CHUNK);
@@ -31,12 +31,134 @@ static const liConditionValueType cond_value_hints[] = {
 };
 #endif
 
+typedef struct condition_cache_header condition_cache_header;
+struct condition_cache_header {
+	liConditionLValue *lvalue; /* reference; NULL for unused entries */
+	liHttpHeaders *headers;
+	guint version;
+	GString *value;
+};
+
+void li_condition_cache_init(liConditionCache *cache) {
+	cache->headers = g_array_sized_new(FALSE, TRUE, sizeof(condition_cache_header), 2);
+	cache->headers_used = 0;
+	cache->stat_path = g_string_sized_new(0);
+	cache->stat_valid = FALSE;
+}
+
+/* keeps the allocated strings for the next request */
+void li_condition_cache_reset(liConditionCache *cache) {
+	guint i;
+
+	for (i = 0; i < cache->headers_used; i++) {
+		condition_cache_header *ch = &g_array_index(cache->headers, condition_cache_header, i);
+		li_condition_lvalue_release(ch->lvalue);
+		ch->lvalue = NULL;
+		ch->headers = NULL;
+	}
+	cache->headers_used = 0;
+	cache->stat_valid = FALSE;
+}
+
+void li_condition_cache_clear(liConditionCache *cache) {
+	guint i;
+
+	li_condition_cache_reset(cache);
+	for (i = 0; i < cache->headers->len; i++) {
+		g_string_free(g_array_index(cache->headers, condition_cache_header, i).value, TRUE);
+	}
+	g_array_free(cache->headers, TRUE);
+	cache->headers = NULL;
+	g_string_free(cache->stat_path, TRUE);
+	cache->stat_path = NULL;
+}
+
+static gboolean condition_cache_lvalue_equal(liConditionLValue *a, liConditionLValue *b) {
+	return a == b || (a->type == b->type && g_string_equal(a->key, b->key));
+}
+
+/* returns the joined header values; uses tmpstr if the cache is full */
+static const gchar* condition_cache_get_header(GString *tmpstr, liVRequest *vr, liConditionLValue *lvalue, liHttpHeaders *headers) {
+	liConditionCache *cache = &vr->cond_cache;
+	condition_cache_header *ch;
+	guint i;
+
+	for (i = 0; i < cache->headers_used; i++) {
+		ch = &g_array_index(cache->headers, condition_cache_header, i);
+		if (!condition_cache_lvalue_equal(ch->lvalue, lvalue)) continue;
+
+		if (ch->headers == headers && ch->version == headers->version) {
+			vr->wrk->stats.cond_cache_hits++;
+		} else {
+			vr->wrk->stats.cond_cache_misses++;
+			li_http_header_get_all(ch->value, headers, GSTR_LEN(lvalue->key));
+			ch->headers = headers;
+			ch->version = headers->version;
+		}
+		return ch->value->str;
+	}
+
+	vr->wrk->stats.cond_cache_misses++;
+
+	if (cache->headers_used >= LI_CONDITION_CACHE_MAX_HEADERS) {
+		li_http_header_get_all(tmpstr, headers, GSTR_LEN(lvalue->key));
+		return tmpstr->str;
+	}
+
+	if (cache->headers_used == cache->headers->len) {
+		g_array_set_size(cache->headers, cache->headers_used + 1);
+		g_array_index(cache->headers, condition_cache_header, cache->headers_used).value = g_string_sized_new(0);
+	}
+	ch = &g_array_index(cache->headers, condition_cache_header, cache->headers_used++);
+
+	li_condition_lvalue_acquire(lvalue);
+	ch->lvalue = lvalue;
+	ch->headers = headers;
+	ch->version = headers->version;
+	li_http_header_get_all(ch->value, headers, GSTR_LEN(lvalue->key));
+	return ch->value->str;
+}
+
+/* stat() result for physical.path, shared by the physical.* lvalues */
+static liHandlerResult condition_cache_stat(liVRequest *vr) {
+	liConditionCache *cache = &vr->cond_cache;
+	GString *path = vr->physical.path;
+	liHandlerResult r;
+	struct stat st;
+	int err;
+
+	if (cache->stat_valid && cache->stat_path->len == path->len && 0 == memcmp(cache->stat_path->str, path->str, path->len)) {
+		vr->wrk->stats.cond_cache_hits++;
+		return LI_HANDLER_GO_ON;
+	}
+
+	r = li_stat_cache_get(vr, path, &st, &err, NULL);
+	if (r == LI_HANDLER_WAIT_FOR_EVENT) return r;
+
+	vr->wrk->stats.cond_cache_misses++;
+
+	cache->stat_valid = TRUE;
+	g_string_truncate(cache->stat_path, 0);
+	g_string_append_len(cache->stat_path, GSTR_LEN(path));
+
+	if (r == LI_HANDLER_GO_ON) {
+		cache->stat_found = TRUE;
+		cache->stat_isdir = S_ISDIR(st.st_mode);
+		cache->stat_isfile = S_ISREG(st.st_mode);
+		cache->stat_size = (goffset) st.st_size;
+	} else {
+		/* not found */
+		cache->stat_found = cache->stat_isdir = cache->stat_isfile = FALSE;
+		cache->stat_size = -1;
+	}
+
+	return LI_HANDLER_GO_ON;
+}
+
 /* uses tmpstr for temporary (and returned) strings */
 liHandlerResult li_condition_get_value(GString *tmpstr, liVRequest *vr, liConditionLValue *lvalue, liConditionValue *res, liConditionValueType prefer) {
 	liConInfo *coninfo = vr->coninfo;
 	liHandlerResult r;
-	struct stat st;
-	int err;
 
 	res->match_type = LI_COND_VALUE_HINT_ANY;
 	res->data.str = "";
@@ -137,17 +259,15 @@ liHandlerResult li_condition_get_value(GString *tmpstr, liVRequest *vr, liCondit
 			break;
 		}
 
-		r = li_stat_cache_get(vr, vr->physical.path, &st, &err, NULL);
-		if (r == LI_HANDLER_WAIT_FOR_EVENT) return r;
+		r = condition_cache_stat(vr);
+		if (r != LI_HANDLER_GO_ON) return r;
 
-		/* not found, return FALSE */
-		if (r != LI_HANDLER_GO_ON) break;
 		if (lvalue->type == LI_COMP_PHYSICAL_ISFILE) {
-			res->data.bool = S_ISREG(st.st_mode);
+			res->data.bool = vr->cond_cache.stat_isfile;
 		} else if (lvalue->type == LI_COMP_PHYSICAL_ISDIR) {
-			res->data.bool = S_ISDIR(st.st_mode);
+			res->data.bool = vr->cond_cache.stat_isdir;
 		} else {
-			res->data.bool = TRUE;
+			res->data.bool = vr->cond_cache.stat_found;
 		}
 		break;
 	case LI_COMP_PHYSICAL_SIZE:
@@ -157,12 +277,10 @@ liHandlerResult li_condition_get_value(GString *tmpstr, liVRequest *vr, liCondit
 			break;
 		}
 
-		r = li_stat_cache_get(vr, vr->physical.path, &st, &err, NULL);
-		if (r == LI_HANDLER_WAIT_FOR_EVENT) return r;
+		r = condition_cache_stat(vr);
+		if (r != LI_HANDLER_GO_ON) return r;
 
-		if (r == LI_HANDLER_GO_ON) { /* not found -> size "-1" */
-			res->data.number = (gint64) st.st_size;
-		}
+		res->data.number = vr->cond_cache.stat_size; /* not found -> size "-1" */
 		break;
 	case LI_COMP_PHYSICAL_DOCROOT:
 		res->match_type = LI_COND_VALUE_HINT_STRING;
@@ -179,14 +297,12 @@ liHandlerResult li_condition_get_value(GString *tmpstr, liVRequest *vr, liCondit
 		break;
 	case LI_COMP_REQUEST_HEADER:
 		res->match_type = LI_COND_VALUE_HINT_STRING;
-		li_http_header_get_all(tmpstr, vr->request.headers, GSTR_LEN(lvalue->key));
-		res->data.str = tmpstr->str;
+		res->data.str = condition_cache_get_header(tmpstr, vr, lvalue, vr->request.headers);
 		break;
 	case LI_COMP_RESPONSE_HEADER:
 		LI_VREQUEST_WAIT_FOR_RESPONSE_HEADERS(vr);
 		res->match_type = LI_COND_VALUE_HINT_STRING;
-		li_http_header_get_all(tmpstr, vr->response.headers, GSTR_LEN(lvalue->key));
-		res->data.str = tmpstr->str;
+		res->data.str = condition_cache_get_header(tmpstr, vr, lvalue, vr->response.headers);
 		break;
 	case LI_COMP_ENVIRONMENT:
 		res->match_type = LI_COND_VALUE_HINT_STRING;
@@ -307,12 +423,12 @@ static liCondition* cond_new_string(liCompOperator op, liConditionLValue *lvalue
 /* only MATCH and NOMATCH */
 static liCondition* cond_new_match(liServer *srv, liCompOperator op, liConditionLValue *lvalue, GString *str) {
 	liCondition *c;
-	GRegex *regex;
+	liRegex *regex;
 	GError *err = NULL;
 
-	regex = g_regex_new(str->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, &err);
+	regex = li_regex_new(str->str, &err);
 
-	if (!regex || err) {
+	if (NULL == regex) {
 		ERROR(srv, "failed to compile regex \"%s\": %s", str->str, err->message);
 		g_error_free(err);
 		return NULL;
@@ -418,7 +534,7 @@ static void condition_free(liCondition *c) {
 		g_string_free(c->rvalue.string, TRUE);
 		break;
 	case LI_COND_VALUE_REGEXP:
-		g_regex_unref(c->rvalue.regex);
+		li_regex_free(c->rvalue.regex);
 		break;
 	case LI_COND_VALUE_SOCKET_IPV4:
 	case LI_COND_VALUE_SOCKET_IPV6:
@@ -618,6 +734,7 @@ static liHandlerResult li_condition_check_eval_string(liVRequest *vr, liConditio
 	liActionRegexStackElement arse;
 	liConditionValue match_val;
 	liHandlerResult r;
+	GError *err = NULL;
 	const char *val = "";
 	*res = FALSE;
 
@@ -646,22 +763,22 @@ static liHandlerResult li_condition_check_eval_string(liVRequest *vr, liConditio
 		*res = !g_str_has_suffix(val, cond->rvalue.string->str);
 		break;
 	case LI_CONFIG_COND_MATCH:
-		arse.match_info = NULL;
-		arse.string = g_string_new(val); /* we have to copy the value, as match-info references it */
-		*res = g_regex_match(cond->rvalue.regex, arse.string->str, 0, &arse.match_info);
+		arse.string = g_string_new(val); /* we have to copy the value, as the match references it */
+		arse.match = li_regex_match(cond->rvalue.regex, GSTR_LEN(arse.string), &err);
+		if (NULL != err) goto regex_error;
+		*res = (NULL != arse.match);
 		if (*res) {
 			g_array_append_val(vr->action_stack.regex_stack, arse);
 		} else {
-			g_match_info_free(arse.match_info);
 			g_string_free(arse.string, TRUE);
 		}
 		break;
 	case LI_CONFIG_COND_NOMATCH:
-		arse.match_info = NULL;
-		arse.string = g_string_new(val); /* we have to copy the value, as match-info references it */
-		*res = !g_regex_match(cond->rvalue.regex, arse.string->str, 0, &arse.match_info);
+		arse.string = g_string_new(val); /* we have to copy the value, as the match references it */
+		arse.match = li_regex_match(cond->rvalue.regex, GSTR_LEN(arse.string), &err);
+		if (NULL != err) goto regex_error;
+		*res = (NULL == arse.match);
 		if (*res) {
-			g_match_info_free(arse.match_info);
 			g_string_free(arse.string, TRUE);
 		} else {
 			g_array_append_val(vr->action_stack.regex_stack, arse);
@@ -678,6 +795,12 @@ static liHandlerResult li_condition_check_eval_string(liVRequest *vr, liConditio
 	}
 
 	return LI_HANDLER_GO_ON;
+
+regex_error:
+	VR_ERROR(vr, "matching '%s' against regex \"%s\" failed: %s", arse.string->str, li_regex_get_pattern(cond->rvalue.regex), err->message);
+	g_error_free(err);
+	g_string_free(arse.string, TRUE);
+	return LI_HANDLER_ERROR;
 }
 
 
@@ -825,3 +948,218 @@ liHandlerResult li_condition_check(liVRequest *vr, liCondition *cond, gboolean *
 	VR_ERROR(vr, "Unsupported conditional type: %i", cond->rvalue.type);
 	return LI_HANDLER_ERROR;
 }
+
+
+/* dispatch tables */
+
+typedef struct condition_trie_node condition_trie_node;
+struct condition_trie_node {
+	guint index;     /* first condition with the string ending here; G_MAXUINT if none */
+	guint min_index; /* minimum index in this subtree: stop the lookup if it can't get better */
+	guint children_len;
+	guchar *labels;  /* sorted */
+	condition_trie_node **children;
+};
+
+struct liConditionDispatch {
+	liConditionLValue *lvalue;
+	GPtrArray *conditions; /* (liCondition*) in chain order */
+
+	GHashTable *equal; /* rvalue string => GUINT_TO_POINTER(index + 1); first condition wins */
+	condition_trie_node *prefix, *suffix; /* suffixes are stored reversed */
+};
+
+static condition_trie_node* condition_trie_node_new(void) {
+	condition_trie_node *node = g_slice_new0(condition_trie_node);
+	node->index = node->min_index = G_MAXUINT;
+	return node;
+}
+
+static void condition_trie_free(condition_trie_node *node) {
+	guint i;
+	if (NULL == node) return;
+	for (i = 0; i < node->children_len; i++) condition_trie_free(node->children[i]);
+	g_free(node->labels);
+	g_free(node->children);
+	g_slice_free(condition_trie_node, node);
+}
+
+/* binary search for label; returns position to insert if not found */
+static guint condition_trie_find(condition_trie_node *node, guchar label, gboolean *found) {
+	guint lo = 0, hi = node->children_len;
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (node->labels[mid] == label) {
+			*found = TRUE;
+			return mid;
+		} else if (node->labels[mid] < label) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	*found = FALSE;
+	return lo;
+}
+
+/* step: 1 for prefixes, -1 for suffixes (str points to the last character then) */
+static void condition_trie_insert(condition_trie_node *node, const guchar *str, gsize len, gssize step, guint index) {
+	for (;;) {
+		gboolean found;
+		guint pos;
+
+		node->min_index = MIN(node->min_index, index);
+		if (0 == len) break;
+
+		pos = condition_trie_find(node, *str, &found);
+		if (!found) {
+			node->labels = g_realloc(node->labels, (node->children_len + 1) * sizeof(*node->labels));
+			node->children = g_realloc(node->children, (node->children_len + 1) * sizeof(*node->children));
+			memmove(node->labels + pos + 1, node->labels + pos, (node->children_len - pos) * sizeof(*node->labels));
+			memmove(node->children + pos + 1, node->children + pos, (node->children_len - pos) * sizeof(*node->children));
+			node->labels[pos] = *str;
+			node->children[pos] = condition_trie_node_new();
+			node->children_len++;
+		}
+		node = node->children[pos];
+		str += step;
+		len--;
+	}
+	if (index < node->index) node->index = index;
+}
+
+static guint condition_trie_lookup(condition_trie_node *node, const guchar *str, gsize len, gssize step, guint best) {
+	while (NULL != node && node->min_index < best) {
+		gboolean found;
+		guint pos;
+
+		if (node->index < best) best = node->index;
+		if (0 == len) break;
+
+		pos = condition_trie_find(node, *str, &found);
+		node = found ? node->children[pos] : NULL;
+		str += step;
+		len--;
+	}
+	return best;
+}
+
+liConditionDispatch* li_condition_dispatch_new(liConditionLValue *lvalue) {
+	liConditionDispatch *d = g_slice_new0(liConditionDispatch);
+
+	li_condition_lvalue_acquire(lvalue);
+	d->lvalue = lvalue;
+	d->conditions = g_ptr_array_new();
+
+	return d;
+}
+
+void li_condition_dispatch_free(liServer *srv, liConditionDispatch *d) {
+	guint i;
+
+	if (NULL == d) return;
+
+	for (i = 0; i < d->conditions->len; i++) {
+		li_condition_release(srv, g_ptr_array_index(d->conditions, i));
+	}
+	g_ptr_array_free(d->conditions, TRUE);
+	if (NULL != d->equal) g_hash_table_destroy(d->equal);
+	condition_trie_free(d->prefix);
+	condition_trie_free(d->suffix);
+	li_condition_lvalue_release(d->lvalue);
+
+	g_slice_free(liConditionDispatch, d);
+}
+
+gboolean li_condition_dispatch_supported(liCondition *cond) {
+	if (LI_COND_VALUE_STRING != cond->rvalue.type) return FALSE;
+
+	switch (cond->op) {
+	case LI_CONFIG_COND_EQ:
+		return TRUE;
+	case LI_CONFIG_COND_PREFIX:
+	case LI_CONFIG_COND_SUFFIX:
+		/* an empty prefix/suffix always matches - the chain ends there anyway */
+		return '\0' != cond->rvalue.string->str[0];
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean condition_lvalue_equal(liConditionLValue *a, liConditionLValue *b) {
+	if (a == b) return TRUE;
+	if (a->type != b->type) return FALSE;
+	if (NULL == a->key || NULL == b->key) return a->key == b->key;
+	return g_string_equal(a->key, b->key);
+}
+
+gboolean li_condition_dispatch_add(liConditionDispatch *d, liCondition *cond) {
+	guint index = d->conditions->len;
+	/* the conditions compare C strings: ignore everything after a \0 like they do */
+	const gchar *str = cond->rvalue.string->str;
+	gsize len = strlen(str);
+
+	if (!li_condition_dispatch_supported(cond) || !condition_lvalue_equal(d->lvalue, cond->lvalue)) return FALSE;
+
+	switch (cond->op) {
+	case LI_CONFIG_COND_EQ:
+		if (NULL == d->equal) d->equal = g_hash_table_new(g_str_hash, g_str_equal);
+		if (NULL == g_hash_table_lookup(d->equal, str)) {
+			g_hash_table_insert(d->equal, (gpointer) str, GUINT_TO_POINTER(index + 1));
+		}
+		break;
+	case LI_CONFIG_COND_PREFIX:
+		if (NULL == d->prefix) d->prefix = condition_trie_node_new();
+		condition_trie_insert(d->prefix, (const guchar*) str, len, 1, index);
+		break;
+	case LI_CONFIG_COND_SUFFIX:
+		if (NULL == d->suffix) d->suffix = condition_trie_node_new();
+		condition_trie_insert(d->suffix, (const guchar*) str + len - 1, len, -1, index);
+		break;
+	default:
+		return FALSE;
+	}
+
+	li_condition_acquire(cond);
+	g_ptr_array_add(d->conditions, cond);
+	return TRUE;
+}
+
+guint li_condition_dispatch_length(liConditionDispatch *d) {
+	return d->conditions->len;
+}
+
+liConditionLValue* li_condition_dispatch_lvalue(liConditionDispatch *d) {
+	return d->lvalue;
+}
+
+guint li_condition_dispatch_lookup(liConditionDispatch *d, const gchar *value) {
+	guint best = G_MAXUINT;
+	gsize len = strlen(value);
+
+	if (NULL != d->equal) {
+		guint found = GPOINTER_TO_UINT(g_hash_table_lookup(d->equal, value));
+		if (0 != found) best = found - 1;
+	}
+	if (NULL != d->prefix) {
+		best = condition_trie_lookup(d->prefix, (const guchar*) value, len, 1, best);
+	}
+	if (NULL != d->suffix && len > 0) {
+		best = condition_trie_lookup(d->suffix, (const guchar*) value + len - 1, len, -1, best);
+	}
+
+	return best;
+}
+
+liHandlerResult li_condition_dispatch_check(liVRequest *vr, liConditionDispatch *d, guint *index) {
+	liConditionValue match_val;
+	liHandlerResult r;
+	*index = G_MAXUINT;
+
+	r = li_condition_get_value(vr->wrk->tmp_str, vr, d->lvalue, &match_val, LI_COND_VALUE_HINT_STRING);
+	if (r != LI_HANDLER_GO_ON) return r;
+
+	*index = li_condition_dispatch_lookup(d, li_condition_value_to_string(vr->wrk->tmp_str, &match_val));
+
+	return LI_HANDLER_GO_ON;
+}
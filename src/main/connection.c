@@ -29,6 +29,8 @@ void li_connection_simple_tcp(liConnection **pcon, liIOStream *stream, gpointer
 			if (transfer_out > 0) {
 				li_connection_update_io_timeout(con);
 				li_vrequest_update_stats_out(con->mainvr, transfer_out);
+				/* the http2 writer keeps the response data in the streams until there is room */
+				if (LI_CON_STATE_HTTP2 == con->state) li_stream_again_later(&con->out);
 			}
 		}
 	}
@@ -140,6 +142,7 @@ static const liConnectionSocketCallbacks simple_tcp_cbs = {
 static gboolean simple_tcp_new(liConnection *con, int fd) {
 	simple_tcp_connection *data = g_slice_new0(simple_tcp_connection);
 	data->sock_stream = li_iostream_new(con->wrk, fd, simple_tcp_io_cb, data);
+	data->sock_stream->uring_writes = TRUE; /* client connections don't move between workers */
 	data->simple_tcp_context = NULL;
 	data->con = con;
 	con->con_sock.data = data;
@@ -232,6 +235,16 @@ static void _connection_http_in_cb(liStream *stream, liStreamEvent event) {
 		return;
 	}
 
+	if (LI_CON_STATE_HTTP2 == con->state) {
+		if (!li_http2_connection_read(con->http2, raw_in)) {
+			if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+				VR_DEBUG(vr, "%s", "invalid http2 connection preface");
+			}
+			li_connection_error(con);
+		}
+		return;
+	}
+
 	if (con->state == LI_CON_STATE_KEEP_ALIVE) {
 		/* stop keep alive timeout watchers */
 		if (con->keep_alive_data.link) {
@@ -256,6 +269,24 @@ static void _connection_http_in_cb(liStream *stream, liStreamEvent event) {
 		/* put back in io timeout queue */
 		li_connection_update_io_wait(con);
 	} else if (con->state == LI_CON_STATE_REQUEST_START) {
+		if (con->srv->http2) {
+			/* "h2" from ALPN or prior knowledge: the client starts with the connection preface */
+			switch (li_http2_check_preface(raw_in)) {
+			case LI_HANDLER_GO_ON:
+				if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+					VR_DEBUG(vr, "%s", "start http2 connection");
+				}
+				con->http2 = li_http2_connection_new(con);
+				con->state = LI_CON_STATE_HTTP2;
+				li_connection_update_io_wait(con);
+				if (!li_http2_connection_read(con->http2, raw_in)) li_connection_error(con);
+				return;
+			case LI_HANDLER_WAIT_FOR_EVENT:
+				return;
+			default:
+				break; /* HTTP/1.x */
+			}
+		}
 		con->state = LI_CON_STATE_READ_REQUEST_HEADER;
 		li_connection_update_io_wait(con);
 	}
@@ -325,6 +356,14 @@ static void _connection_http_in_cb(liStream *stream, liStreamEvent event) {
 			return;
 		}
 
+		if (con->srv->http2 && li_http2_upgrade(con)) {
+			/* the request continues as stream 1; handle the remaining input as http2 frames */
+			li_connection_update_io_wait(con);
+			li_stream_again_later(&con->out);
+			li_stream_again_later(&con->in);
+			return;
+		}
+
 		/* When does a client ask for 100 Continue? probably not while trying to ddos us
 		 * as post content probably goes to a dynamic backend anyway, we don't
 		 * care about the rare cases we could determine that we don't want a request at all
@@ -408,6 +447,12 @@ static void _connection_http_out_cb(liStream *stream, liStreamEvent event) {
 		return;
 	}
 
+	if (LI_CON_STATE_HTTP2 == con->state) {
+		li_http2_connection_write(con->http2);
+		li_stream_notify(stream);
+		return;
+	}
+
 	out = (NULL != stream->source) ? stream->source->out : NULL;
 
 	/* keep raw_out->is_closed = FALSE for keep-alive requests; instead set con->out_has_all_data = TRUE */
@@ -495,6 +540,9 @@ void li_connection_update_io_wait(liConnection *con) {
 	case LI_CON_STATE_UPGRADED:
 		want_timeout = stopping;
 		break;
+	case LI_CON_STATE_HTTP2:
+		want_timeout = stopping || li_http2_connection_want_timeout(con->http2);
+		break;
 	}
 
 	if (want_timeout == con->io_timeout_elem.queued) return;
@@ -506,15 +554,31 @@ void li_connection_update_io_wait(liConnection *con) {
 }
 
 
-void li_connection_start(liConnection *con, liSocketAddress remote_addr, int s, liServerSocket *srv_sock) {
+/* remote address is either con->remote_addr_buf or allocated by li_sockaddr_remote_from_socket */
+static void connection_clear_remote_addr(liConnection *con) {
+	if (con->info.remote_addr.addr == &con->remote_addr_buf) {
+		con->info.remote_addr.addr = NULL;
+		con->info.remote_addr.len = 0;
+	} else {
+		li_sockaddr_clear(&con->info.remote_addr);
+	}
+}
+
+void li_connection_start(liConnection *con, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock) {
 	LI_FORCE_ASSERT(NULL == con->con_sock.data);
 
 	con->srv_sock = srv_sock;
 	con->state = LI_CON_STATE_REQUEST_START;
 	con->mainvr->ts_started = con->ts_started = li_cur_ts(con->wrk);
 
-	con->info.remote_addr = remote_addr;
-	li_sockaddr_to_string(remote_addr, con->info.remote_addr_str, FALSE);
+	if (NULL != remote_addr && remote_addr_len > 0 && remote_addr_len <= sizeof(con->remote_addr_buf)) {
+		memcpy(&con->remote_addr_buf, remote_addr, remote_addr_len);
+		con->info.remote_addr.addr = &con->remote_addr_buf;
+		con->info.remote_addr.len = remote_addr_len;
+	} else {
+		con->info.remote_addr = li_sockaddr_remote_from_socket(s);
+	}
+	li_sockaddr_to_string(con->info.remote_addr, con->info.remote_addr_str, FALSE);
 
 	con->info.local_addr = li_sockaddr_dup(srv_sock->local_addr);
 	li_sockaddr_to_string(con->info.local_addr, con->info.local_addr_str, FALSE);
@@ -612,6 +676,12 @@ static void connection_keepalive_cb(liEventBase *watcher, int events) {
 	liConnection *con = LI_CONTAINER_OF(li_event_timer_from(watcher), liConnection, keep_alive_data.watcher);
 	UNUSED(events);
 
+	if (NULL != con->http2) {
+		/* idle http2 connection: GOAWAY first, close after it was sent */
+		li_http2_connection_shutdown(con->http2);
+		return;
+	}
+
 	li_connection_reset(con);
 }
 
@@ -692,6 +762,7 @@ liConnection* li_connection_new(liWorker *wrk) {
 	con->info.remote_addr_str = g_string_sized_new(INET6_ADDRSTRLEN);
 	con->info.local_addr_str = g_string_sized_new(INET6_ADDRSTRLEN);
 	con->info.is_ssl = FALSE;
+	con->info.is_ktls = FALSE;
 	con->info.keep_alive = TRUE;
 
 	con->info.req = NULL;
@@ -723,6 +794,11 @@ void li_connection_reset(liConnection *con) {
 		li_stream_reset(&con->in);
 		li_stream_reset(&con->out);
 
+		if (NULL != con->http2) {
+			li_http2_connection_free(con->http2);
+			con->http2 = NULL;
+		}
+
 		li_vrequest_reset(con->mainvr, TRUE);
 		li_stream_release(&con->in);
 		li_stream_release(&con->out);
@@ -752,6 +828,7 @@ static void li_connection_reset2(liConnection *con) {
 	li_server_socket_release(con->srv_sock);
 	con->srv_sock = NULL;
 	con->info.is_ssl = FALSE;
+	con->info.is_ktls = FALSE;
 	con->info.aborted = FALSE;
 	con->info.out_queue_length = 0;
 
@@ -763,7 +840,7 @@ static void li_connection_reset2(liConnection *con) {
 	li_http_request_parser_reset(&con->req_parser_ctx);
 
 	g_string_truncate(con->info.remote_addr_str, 0);
-	li_sockaddr_clear(&con->info.remote_addr);
+	connection_clear_remote_addr(con);
 	g_string_truncate(con->info.local_addr_str, 0);
 	li_sockaddr_clear(&con->info.local_addr);
 
@@ -874,7 +951,7 @@ void li_connection_free(liConnection *con) {
 	con->srv_sock = NULL;
 
 	g_string_free(con->info.remote_addr_str, TRUE);
-	li_sockaddr_clear(&con->info.remote_addr);
+	connection_clear_remote_addr(con);
 	g_string_free(con->info.local_addr_str, TRUE);
 	li_sockaddr_clear(&con->info.local_addr);
 
@@ -916,6 +993,8 @@ gchar *li_connection_state_str(liConnectionState state) {
 		return "write";
 	case LI_CON_STATE_UPGRADED:
 		return "upgraded";
+	case LI_CON_STATE_HTTP2:
+		return "http2";
 	}
 
 	return "undefined";
@@ -924,7 +1003,7 @@ gchar *li_connection_state_str(liConnectionState state) {
 liConnection* li_connection_from_vrequest(liVRequest *vr) {
 	liConnection *con;
 
-	if (vr->coninfo->callbacks != &con_callbacks) return NULL;
+	if (vr->coninfo->callbacks != &con_callbacks) return li_http2_connection_from_vrequest(vr);
 
 	con = LI_CONTAINER_OF(vr->coninfo, liConnection, info);
 
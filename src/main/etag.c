@@ -129,6 +129,10 @@ void li_etag_mutate(GString *mut, GString *etag) {
 }
 
 void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
+	li_etag_set_header_encoded(vr, st, NULL, cachable);
+}
+
+void li_etag_set_header_encoded(liVRequest *vr, struct stat *st, const gchar *encoding, gboolean *cachable) {
 	guint flags = CORE_OPTION(LI_CORE_OPTION_ETAG_FLAGS).number;
 	GString *tmp_str = vr->wrk->tmp_str;
 	struct tm tm;
@@ -154,6 +158,12 @@ void li_etag_set_header(liVRequest *vr, struct stat *st, gboolean *cachable) {
 		}
 	
 		li_etag_mutate(tmp_str, tmp_str);
+
+		if (NULL != encoding) {
+			g_string_append_len(tmp_str, CONST_STR_LEN("-"));
+			g_string_append(tmp_str, encoding);
+			li_etag_mutate(tmp_str, tmp_str);
+		}
 	
 		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("ETag"), GSTR_LEN(tmp_str));
 
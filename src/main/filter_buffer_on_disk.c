@@ -134,6 +134,7 @@ static void bod_handle_data(bod_state *state) {
 		case STRING_CHUNK:
 		case MEM_CHUNK:
 		case BUFFER_CHUNK:
+		case PIPE_CHUNK:
 			if (!bod_open(state)) return;
 
 			length = li_chunk_length(c);
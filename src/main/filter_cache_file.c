@@ -0,0 +1,180 @@
+
+#include <lighttpd/base.h>
+#include <lighttpd/filter_cache_file.h>
+
+#include <sys/stat.h>
+
+typedef struct cache_file_writer cache_file_writer;
+struct cache_file_writer {
+	GString *filename, *tmpfilename;
+	int fd;
+	goffset size;
+
+	liFilterCacheFileCB done_cb;
+	gpointer data;
+};
+
+static gboolean cache_file_mkdir_for_file(liVRequest *vr, char *filename) {
+	char *p = filename;
+
+	if (!filename || !filename[0])
+		return FALSE;
+
+	while ((p = strchr(p + 1, '/')) != NULL) {
+		*p = '\0';
+		if ((mkdir(filename, 0700) != 0) && (errno != EEXIST)) {
+			VR_ERROR(vr, "creating cache-directory '%s' failed: %s", filename, g_strerror(errno));
+			*p = '/';
+			return FALSE;
+		}
+
+		*p++ = '/';
+		if (!*p) {
+			VR_ERROR(vr, "unexpected trailing slash for filename '%s'", filename);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static void cache_file_writer_free(liVRequest *vr, cache_file_writer *writer) {
+	if (NULL == writer) return;
+
+	if (-1 != writer->fd) {
+		/* not finished */
+		close(writer->fd);
+		unlink(writer->tmpfilename->str);
+		writer->size = -1;
+	}
+
+	if (NULL != writer->done_cb) writer->done_cb(vr, writer->size, writer->data);
+
+	g_string_free(writer->filename, TRUE);
+	g_string_free(writer->tmpfilename, TRUE);
+	g_slice_free(cache_file_writer, writer);
+}
+
+static void cache_file_writer_finish(liVRequest *vr, cache_file_writer *writer) {
+	close(writer->fd);
+	writer->fd = -1;
+	if (-1 == rename(writer->tmpfilename->str, writer->filename->str)) {
+		if (NULL != vr) VR_ERROR(vr, "Couldn't move temporary cache file '%s': '%s'", writer->tmpfilename->str, g_strerror(errno));
+		unlink(writer->tmpfilename->str);
+		writer->size = -1;
+	}
+	cache_file_writer_free(vr, writer);
+}
+
+static void cache_file_filter_free(liVRequest *vr, liFilter *f) {
+	cache_file_writer *writer = (cache_file_writer*) f->param;
+	f->param = NULL;
+
+	cache_file_writer_free(vr, writer);
+}
+
+static liHandlerResult cache_file_filter(liVRequest *vr, liFilter *f) {
+	cache_file_writer *writer = (cache_file_writer*) f->param;
+	ssize_t res;
+	gchar *buf;
+	off_t buflen;
+	liChunkIter citer;
+	GError *err = NULL;
+
+	if (NULL == f->in) {
+		cache_file_filter_free(vr, f);
+		/* didn't handle f->in->is_closed? abort forwarding */
+		if (!f->out->is_closed) li_stream_reset(&f->stream);
+		return LI_HANDLER_GO_ON;
+	}
+
+	if (NULL == writer) goto forward;
+
+	if (f->in->length > 0) {
+		citer = li_chunkqueue_iter(f->in);
+		if (LI_HANDLER_GO_ON != li_chunkiter_read(citer, 0, 64*1024, &buf, &buflen, &err)) {
+			if (NULL != err) {
+				if (NULL != vr) VR_ERROR(vr, "Couldn't read data from chunkqueue: %s", err->message);
+				g_error_free(err);
+			} else {
+				if (NULL != vr) VR_ERROR(vr, "%s", "Couldn't read data from chunkqueue");
+			}
+			cache_file_filter_free(vr, f);
+			goto forward;
+		}
+
+		res = write(writer->fd, buf, buflen);
+		if (res < 0) {
+			switch (errno) {
+			case EINTR:
+			case EAGAIN:
+				return LI_HANDLER_COMEBACK;
+			default:
+				if (NULL != vr) VR_ERROR(vr, "Couldn't write to temporary cache file '%s': %s",
+					writer->tmpfilename->str, g_strerror(errno));
+				cache_file_filter_free(vr, f);
+				goto forward;
+			}
+		} else {
+			writer->size += res;
+			if (!f->out->is_closed) {
+				li_chunkqueue_steal_len(f->out, f->in, res);
+			} else {
+				li_chunkqueue_skip(f->in, res);
+			}
+		}
+	}
+
+	if (0 == f->in->length && f->in->is_closed) {
+		f->out->is_closed = TRUE;
+		f->param = NULL;
+		cache_file_writer_finish(vr, writer);
+		return LI_HANDLER_GO_ON;
+	}
+
+	return LI_HANDLER_GO_ON;
+
+forward:
+	if (f->out->is_closed) {
+		li_chunkqueue_skip_all(f->in);
+		li_stream_disconnect(&f->stream);
+	} else {
+		li_chunkqueue_steal_all(f->out, f->in);
+		if (f->in->is_closed) f->out->is_closed = f->in->is_closed;
+	}
+	return LI_HANDLER_GO_ON;
+}
+
+liFilter* li_filter_cache_file(liVRequest *vr, const gchar *filename, liFilterCacheFileCB done_cb, gpointer data) {
+	cache_file_writer *writer = g_slice_new0(cache_file_writer);
+	liFilter *f;
+
+	writer->filename = g_string_new(filename);
+	writer->tmpfilename = g_string_sized_new(writer->filename->len + 7);
+	g_string_append_len(writer->tmpfilename, GSTR_LEN(writer->filename));
+	g_string_append_len(writer->tmpfilename, CONST_STR_LEN("-XXXXXX"));
+	writer->fd = -1;
+	writer->done_cb = done_cb;
+	writer->data = data;
+
+	if (!cache_file_mkdir_for_file(vr, writer->tmpfilename->str)) {
+		goto error;
+	}
+
+	errno = 0; /* posix doesn't define any errors */
+	if (-1 == (writer->fd = mkstemp(writer->tmpfilename->str))) {
+		VR_ERROR(vr, "Couldn't create cache tempfile '%s': %s", writer->tmpfilename->str, g_strerror(errno));
+		goto error;
+	}
+
+	if (NULL == (f = li_vrequest_add_filter_out(vr, cache_file_filter, cache_file_filter_free, NULL, writer))) {
+		goto error;
+	}
+
+	return f;
+
+error:
+	writer->size = -1;
+	cache_file_writer_free(vr, writer);
+	return NULL;
+}
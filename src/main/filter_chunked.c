@@ -130,7 +130,9 @@ gboolean li_filter_chunked_decode(liVRequest *vr, liChunkQueue *out, liChunkQueu
 			break;
 		case 3:
 			if (state->cur_chunklen != 0) {
-				state->cur_chunklen -= li_chunkqueue_steal_len(out, in, state->cur_chunklen);
+				goffset stolen = li_chunkqueue_steal_len(out, in, state->cur_chunklen);
+				if (-1 == stolen) goto error;
+				state->cur_chunklen -= stolen;
 			}
 			if (state->cur_chunklen == 0) {
 				li_chunk_parser_prepare(&ctx);
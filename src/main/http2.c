@@ -0,0 +1,1399 @@
+
+#include <lighttpd/base.h>
+#include <lighttpd/lighttpd-glue.h>
+#include <lighttpd/plugin_core.h>
+
+/* response data buffered per stream before the backend gets throttled */
+#define LI_HTTP2_STREAM_CHUNKQUEUE_LIMIT (128*1024)
+/* stop generating DATA frames while that much is waiting for the socket; the streams keep their data
+ * until the socket is ready, so they can still be scheduled by priority */
+#define LI_HTTP2_WRITE_QUEUE_LENGTH (64*1024)
+/* receive window for the connection; the per stream windows (default size) limit the buffered request bodies */
+#define LI_HTTP2_CONNECTION_WINDOW (1024*1024)
+#define LI_HTTP2_MAX_HEADER_BLOCK (64*1024)
+#define LI_HTTP2_MAX_WINDOW G_MAXINT32
+
+static void h2_stream_close(liHttp2Stream *stream);
+static void h2_stream_reset(liHttp2Stream *stream, liHttp2ErrorCode code);
+
+/**********************************************************************************/
+/* frames */
+
+static guint32 h2_get_u32(const guint8 *p) {
+	return ((guint32) p[0] << 24) | ((guint32) p[1] << 16) | ((guint32) p[2] << 8) | (guint32) p[3];
+}
+
+static void h2_append_u32(GString *dest, guint32 v) {
+	guint8 b[4];
+	b[0] = (v >> 24) & 0xff; b[1] = (v >> 16) & 0xff; b[2] = (v >> 8) & 0xff; b[3] = v & 0xff;
+	g_string_append_len(dest, (const gchar*) b, 4);
+}
+
+static void h2_frame_header(GString *dest, guint32 len, liHttp2FrameType type, guint8 flags, guint32 stream_id) {
+	guint8 b[5];
+	b[0] = (len >> 16) & 0xff; b[1] = (len >> 8) & 0xff; b[2] = len & 0xff;
+	b[3] = type;
+	b[4] = flags;
+	g_string_append_len(dest, (const gchar*) b, 5);
+	h2_append_u32(dest, stream_id & 0x7fffffff);
+}
+
+/* queue h2->tmp for the socket */
+static void h2_send_tmp(liHttp2Connection *h2) {
+	li_chunkqueue_append_mem(h2->con->out.out, GSTR_LEN(h2->tmp));
+	g_string_truncate(h2->tmp, 0);
+	li_stream_again_later(&h2->con->out);
+}
+
+static void h2_send_settings(liHttp2Connection *h2) {
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 2*6, LI_HTTP2_FRAME_SETTINGS, 0, 0);
+	g_string_append_c(h2->tmp, 0); g_string_append_c(h2->tmp, LI_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS);
+	h2_append_u32(h2->tmp, LI_HTTP2_MAX_CONCURRENT_STREAMS);
+	g_string_append_c(h2->tmp, 0); g_string_append_c(h2->tmp, LI_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE);
+	h2_append_u32(h2->tmp, LI_HTTP2_DEFAULT_WINDOW_SIZE);
+	/* the connection window can only be raised with WINDOW_UPDATE */
+	h2_frame_header(h2->tmp, 4, LI_HTTP2_FRAME_WINDOW_UPDATE, 0, 0);
+	h2_append_u32(h2->tmp, LI_HTTP2_CONNECTION_WINDOW - LI_HTTP2_DEFAULT_WINDOW_SIZE);
+	h2->recv_window = LI_HTTP2_CONNECTION_WINDOW;
+	h2_send_tmp(h2);
+}
+
+static void h2_send_window_update(liHttp2Connection *h2, guint32 stream_id, guint32 increment) {
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 4, LI_HTTP2_FRAME_WINDOW_UPDATE, 0, stream_id);
+	h2_append_u32(h2->tmp, increment);
+	h2_send_tmp(h2);
+}
+
+static void h2_send_rst_stream(liHttp2Connection *h2, guint32 stream_id, liHttp2ErrorCode code) {
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 4, LI_HTTP2_FRAME_RST_STREAM, 0, stream_id);
+	h2_append_u32(h2->tmp, code);
+	h2_send_tmp(h2);
+}
+
+static void h2_send_goaway(liHttp2Connection *h2, liHttp2ErrorCode code) {
+	if (h2->goaway_sent) return;
+	h2->goaway_sent = TRUE;
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 8, LI_HTTP2_FRAME_GOAWAY, 0, 0);
+	h2_append_u32(h2->tmp, h2->last_stream_id);
+	h2_append_u32(h2->tmp, code);
+	h2_send_tmp(h2);
+}
+
+/* splits a header block into HEADERS and CONTINUATION frames */
+static void h2_send_header_block(liHttp2Connection *h2, guint32 stream_id, const GString *block, gboolean end_stream) {
+	gsize pos = 0;
+	gboolean first = TRUE;
+
+	g_string_truncate(h2->tmp, 0);
+	do {
+		gsize len = MIN(block->len - pos, LI_HTTP2_MAX_FRAME_SIZE);
+		guint8 flags = 0;
+		if (pos + len == block->len) flags |= LI_HTTP2_FLAG_END_HEADERS;
+		if (first && end_stream) flags |= LI_HTTP2_FLAG_END_STREAM;
+		h2_frame_header(h2->tmp, len, first ? LI_HTTP2_FRAME_HEADERS : LI_HTTP2_FRAME_CONTINUATION, flags, stream_id);
+		g_string_append_len(h2->tmp, block->str + pos, len);
+		pos += len;
+		first = FALSE;
+	} while (pos < block->len);
+	h2_send_tmp(h2);
+}
+
+/* fatal for the connection: GOAWAY, abort all streams and close after the GOAWAY was sent */
+static void h2_connection_error(liHttp2Connection *h2, liHttp2ErrorCode code, const gchar *reason) {
+	liConnection *con = h2->con;
+	liVRequest *vr = con->mainvr;
+	GHashTableIter it;
+	gpointer value;
+
+	if (h2->broken) return;
+
+	if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(vr, "http2 connection error %i: %s", (int) code, reason);
+	}
+
+	h2->goaway_sent = FALSE; /* send the error code even after a graceful GOAWAY */
+	h2_send_goaway(h2, code);
+	h2->broken = TRUE;
+
+	g_hash_table_iter_init(&it, h2->streams);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		liHttp2Stream *stream = value;
+		g_hash_table_iter_steal(&it);
+		stream->info.aborted = TRUE;
+		stream->id = 0; /* already removed from the table */
+		h2_stream_close(stream);
+	}
+
+	con->info.keep_alive = FALSE;
+	con->out_has_all_data = TRUE;
+}
+
+/**********************************************************************************/
+/* streams */
+
+/* the stream has something to send: headers, DATA or END_STREAM */
+static void h2_stream_schedule(liHttp2Stream *stream) {
+	liHttp2Connection *h2 = stream->h2;
+	if (NULL == h2 || LI_HTTP2_STREAM_STATE_CLOSED == stream->state) return;
+	if (NULL == stream->send_link.data) {
+		stream->send_link.data = stream;
+		g_queue_push_tail_link(&h2->send_queue, &stream->send_link);
+	}
+	li_stream_again_later(&h2->con->out);
+}
+
+static void h2_stream_unschedule(liHttp2Stream *stream) {
+	if (NULL != stream->send_link.data) {
+		g_queue_unlink(&stream->h2->send_queue, &stream->send_link);
+		stream->send_link.data = NULL;
+	}
+}
+
+static void h2_stream_free(liHttp2Stream *stream) {
+	if (NULL != stream->in.out && NULL != stream->in.out->limit) {
+		/* the limit might be shared with the request body consumers */
+		stream->in.out->limit->notify = NULL;
+		stream->in.out->limit->context = NULL;
+	}
+
+	li_stream_reset(&stream->in);
+	li_stream_reset(&stream->out);
+
+	li_vrequest_free(stream->vr);
+	stream->vr = NULL;
+
+	/* last DESTROY frees the stream */
+	li_stream_release(&stream->in);
+	li_stream_release(&stream->out);
+}
+
+static void h2_stream_destroy_one(liHttp2Stream *stream) {
+	if (2 == ++stream->destroyed) {
+		g_slice_free(liHttp2Stream, stream);
+	}
+}
+
+/* request body: filled from DATA frames */
+static void h2_stream_in_cb(liStream *s, liStreamEvent event) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(s, liHttp2Stream, in);
+
+	switch (event) {
+	case LI_STREAM_DESTROY:
+		h2_stream_destroy_one(stream);
+		break;
+	default:
+		break;
+	}
+}
+
+/* response body: the vrequest connects its output when the response headers are ready */
+static void h2_stream_out_cb(liStream *s, liStreamEvent event) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(s, liHttp2Stream, out);
+
+	switch (event) {
+	case LI_STREAM_CONNECTED_SOURCE:
+		stream->headers_ready = TRUE;
+		/* fall through */
+	case LI_STREAM_NEW_DATA:
+		if (NULL == s->source) return;
+		if (stream->end_stream_sent) {
+			li_chunkqueue_skip_all(s->source->out);
+		} else {
+			li_chunkqueue_steal_all(s->out, s->source->out);
+		}
+		if (s->source->out->is_closed) {
+			s->out->is_closed = TRUE;
+			li_stream_disconnect(s);
+		}
+		h2_stream_schedule(stream);
+		break;
+	case LI_STREAM_DISCONNECTED_SOURCE:
+		if (!s->out->is_closed && LI_HTTP2_STREAM_STATE_CLOSED != stream->state) {
+			h2_stream_reset(stream, LI_HTTP2_INTERNAL_ERROR);
+		}
+		break;
+	case LI_STREAM_DESTROY:
+		h2_stream_destroy_one(stream);
+		break;
+	default:
+		break;
+	}
+}
+
+/* the request body consumer freed space; return the received data to the client's window */
+static void h2_stream_in_limit_cb(gpointer context, gboolean locked) {
+	liHttp2Stream *stream = context;
+	if (locked || NULL == stream || 0 == stream->recv_pending) return;
+	stream->h2->window_updates_pending = TRUE;
+	li_stream_again_later(&stream->h2->con->out);
+}
+
+static void h2_stream_update_recv_window(liHttp2Stream *stream) {
+	liCQLimit *limit = stream->in.out->limit;
+
+	if (0 == stream->recv_pending || stream->in.out->is_closed) return;
+	if (NULL != limit && limit->locked) return; /* wait for h2_stream_in_limit_cb */
+
+	h2_send_window_update(stream->h2, stream->id, stream->recv_pending);
+	stream->recv_window += stream->recv_pending;
+	stream->recv_pending = 0;
+}
+
+static void h2_handle_response_error(liVRequest *vr) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(vr->coninfo, liHttp2Stream, info);
+	h2_stream_reset(stream, LI_HTTP2_INTERNAL_ERROR);
+}
+
+static liThrottleState* h2_throttle_out(liVRequest *vr) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(vr->coninfo, liHttp2Stream, info);
+	liConnection *con;
+
+	if (NULL == stream->h2) return NULL;
+	con = stream->h2->con;
+	if (NULL == con->con_sock.callbacks) return NULL;
+	/* throttling applies to the whole connection */
+	return con->con_sock.callbacks->throttle_out(con);
+}
+
+static liThrottleState* h2_throttle_in(liVRequest *vr) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(vr->coninfo, liHttp2Stream, info);
+	liConnection *con;
+
+	if (NULL == stream->h2) return NULL;
+	con = stream->h2->con;
+	if (NULL == con->con_sock.callbacks) return NULL;
+	return con->con_sock.callbacks->throttle_in(con);
+}
+
+static void h2_connection_upgrade(liVRequest *vr, liStream *backend_drain, liStream *backend_source) {
+	liHttp2Stream *stream = LI_CONTAINER_OF(vr->coninfo, liHttp2Stream, info);
+
+	/* no websockets (RFC 8441) over HTTP/2; the client can retry with HTTP/1.1 */
+	li_stream_reset(backend_drain);
+	li_stream_reset(backend_source);
+	h2_stream_reset(stream, LI_HTTP2_HTTP_1_1_REQUIRED);
+}
+
+static const liConCallbacks h2_stream_callbacks = {
+	h2_handle_response_error,
+	h2_throttle_out,
+	h2_throttle_in,
+	h2_connection_upgrade
+};
+
+static liHttp2Stream* h2_stream_new(liHttp2Connection *h2, guint32 id) {
+	liConnection *con = h2->con;
+	liHttp2Stream *stream = g_slice_new0(liHttp2Stream);
+
+	stream->h2 = h2;
+	stream->id = id;
+	stream->state = LI_HTTP2_STREAM_STATE_OPEN;
+	stream->send_window = h2->peer_initial_window_size;
+	stream->recv_window = LI_HTTP2_DEFAULT_WINDOW_SIZE;
+	stream->weight = 16;
+
+	/* the addresses belong to the connection and live longer than the stream */
+	stream->info.callbacks = &h2_stream_callbacks;
+	stream->info.remote_addr = con->info.remote_addr;
+	stream->info.local_addr = con->info.local_addr;
+	stream->info.remote_addr_str = con->info.remote_addr_str;
+	stream->info.local_addr_str = con->info.local_addr_str;
+	stream->info.is_ssl = con->info.is_ssl;
+	stream->info.is_ktls = con->info.is_ktls;
+	stream->info.keep_alive = TRUE;
+
+	li_stream_init(&stream->in, &con->wrk->loop, h2_stream_in_cb);
+	li_stream_init(&stream->out, &con->wrk->loop, h2_stream_out_cb);
+	stream->info.req = &stream->in;
+	stream->info.resp = &stream->out;
+
+	/* a full window can always be buffered; the window is only returned after the consumer took the data */
+	li_chunkqueue_use_limit(stream->in.out, LI_HTTP2_DEFAULT_WINDOW_SIZE + 1);
+	stream->in.out->limit->notify = h2_stream_in_limit_cb;
+	stream->in.out->limit->context = stream;
+	li_chunkqueue_use_limit(stream->out.out, LI_HTTP2_STREAM_CHUNKQUEUE_LIMIT);
+
+	stream->vr = li_vrequest_new(con->wrk, &stream->info);
+	li_vrequest_start(stream->vr);
+	stream->vr->request.http_version = LI_HTTP_VERSION_2;
+
+	g_hash_table_insert(h2->streams, GUINT_TO_POINTER(id), stream);
+	h2->active_streams++;
+
+	li_event_stop(&con->keep_alive_data.watcher);
+
+	return stream;
+}
+
+/* closed streams are freed in the next write pass, we might be in a callback of the vrequest */
+static void h2_stream_close(liHttp2Stream *stream) {
+	liHttp2Connection *h2 = stream->h2;
+
+	if (LI_HTTP2_STREAM_STATE_CLOSED == stream->state) return;
+	stream->state = LI_HTTP2_STREAM_STATE_CLOSED;
+
+	h2_stream_unschedule(stream);
+	if (0 != stream->id) g_hash_table_remove(h2->streams, GUINT_TO_POINTER(stream->id));
+	h2->active_streams--;
+
+	g_queue_push_tail(&h2->closed, stream);
+	li_stream_again_later(&h2->con->out);
+}
+
+static void h2_stream_reset(liHttp2Stream *stream, liHttp2ErrorCode code) {
+	liHttp2Connection *h2 = stream->h2;
+
+	if (LI_HTTP2_STREAM_STATE_CLOSED == stream->state) return;
+
+	if (NULL != stream->vr && _CORE_OPTION(stream->vr, LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(stream->vr, "http2 stream %u reset: error %i", stream->id, (int) code);
+	}
+
+	h2_send_rst_stream(h2, stream->id, code);
+	stream->info.aborted = (LI_HTTP2_NO_ERROR != code);
+	h2_stream_close(stream);
+}
+
+/* we sent END_STREAM */
+static void h2_stream_local_done(liHttp2Stream *stream) {
+	liHttp2Connection *h2 = stream->h2;
+	liVRequest *vr = stream->vr;
+
+	stream->end_stream_sent = TRUE;
+	h2_stream_unschedule(stream);
+
+	/* same keep-alive options as HTTP/1.x connections */
+	if (0 == CORE_OPTION(LI_CORE_OPTION_MAX_KEEP_ALIVE_IDLE).number) {
+		li_http2_connection_shutdown(h2);
+	} else {
+		h2->max_idle = CORE_OPTION(LI_CORE_OPTION_MAX_KEEP_ALIVE_IDLE).number;
+	}
+
+	if (LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE == stream->state) {
+		h2_stream_close(stream);
+	} else {
+		/* we don't need the rest of the request body */
+		h2_stream_reset(stream, LI_HTTP2_NO_ERROR);
+	}
+}
+
+/**********************************************************************************/
+/* request headers */
+
+typedef struct {
+	liHttp2Stream *stream;
+	gboolean regular_seen, malformed, trailers;
+	gboolean have_method, have_scheme, have_authority, have_path;
+	gsize size;
+} h2_header_ctx;
+
+static void h2_header_cb(gpointer context, const gchar *name, gsize name_len, const gchar *value, gsize value_len) {
+	h2_header_ctx *ctx = context;
+	liRequest *req;
+	gsize i;
+
+	/* the block still has to be decoded to keep the HPACK state in sync */
+	if (ctx->malformed || NULL == ctx->stream) return;
+	req = &ctx->stream->vr->request;
+
+	ctx->size += name_len + value_len + LI_HPACK_ENTRY_OVERHEAD;
+	if (ctx->size > LI_HTTP2_MAX_HEADER_BLOCK || 0 == name_len) goto malformed;
+
+	for (i = 0; i < name_len; i++) {
+		if (name[i] >= 'A' && name[i] <= 'Z') goto malformed;
+	}
+
+	if (ctx->trailers) {
+		if (':' == name[0]) goto malformed;
+		return; /* trailers are dropped */
+	}
+
+	if (':' == name[0]) {
+		if (ctx->regular_seen) goto malformed;
+
+		if (7 == name_len && 0 == memcmp(name, ":method", 7)) {
+			if (ctx->have_method || 0 == value_len) goto malformed;
+			ctx->have_method = TRUE;
+			li_string_assign_len(req->http_method_str, value, value_len);
+			req->http_method = li_http_method_from_string(value, value_len);
+		} else if (7 == name_len && 0 == memcmp(name, ":scheme", 7)) {
+			/* uri.scheme is set from the connection in li_request_validate_header_http2 */
+			if (ctx->have_scheme) goto malformed;
+			ctx->have_scheme = TRUE;
+		} else if (10 == name_len && 0 == memcmp(name, ":authority", 10)) {
+			if (ctx->have_authority) goto malformed;
+			ctx->have_authority = TRUE;
+			li_string_assign_len(req->uri.authority, value, value_len);
+		} else if (5 == name_len && 0 == memcmp(name, ":path", 5)) {
+			if (ctx->have_path || 0 == value_len) goto malformed;
+			ctx->have_path = TRUE;
+			li_string_assign_len(req->uri.raw, value, value_len);
+		} else {
+			goto malformed;
+		}
+		return;
+	}
+
+	ctx->regular_seen = TRUE;
+
+	/* connection specific headers are not allowed (RFC 7540 8.1.2.2) */
+	if ((10 == name_len && 0 == memcmp(name, "connection", 10))
+	    || (10 == name_len && 0 == memcmp(name, "keep-alive", 10))
+	    || (16 == name_len && 0 == memcmp(name, "proxy-connection", 16))
+	    || (17 == name_len && 0 == memcmp(name, "transfer-encoding", 17))
+	    || (7 == name_len && 0 == memcmp(name, "upgrade", 7))) {
+		goto malformed;
+	}
+	if (2 == name_len && 0 == memcmp(name, "te", 2) && !(8 == value_len && 0 == memcmp(value, "trailers", 8))) {
+		goto malformed;
+	}
+
+	if (6 == name_len && 0 == memcmp(name, "cookie", 6)) {
+		/* cookies may be split into several fields for better compression; join them again */
+		liHttpHeader *hh = li_http_header_lookup(req->headers, CONST_STR_LEN("cookie"));
+		if (NULL != hh) {
+			g_string_append_len(hh->data, CONST_STR_LEN("; "));
+			g_string_append_len(hh->data, value, value_len);
+			req->headers->version++;
+			return;
+		}
+	}
+
+	li_http_header_insert(req->headers, name, name_len, value, value_len);
+	return;
+
+malformed:
+	ctx->malformed = TRUE;
+}
+
+static void h2_send_100_continue(liHttp2Connection *h2, liHttp2Stream *stream) {
+	GString *block = h2->header_out;
+
+	g_string_truncate(block, 0);
+	li_hpack_encode_start(&h2->encoder, block);
+	li_hpack_encode(&h2->encoder, block, CONST_STR_LEN(":status"), CONST_STR_LEN("100"));
+	h2_send_header_block(h2, stream->id, block, FALSE);
+}
+
+/* request headers are complete: validate and start the vrequest */
+static void h2_stream_start(liHttp2Connection *h2, liHttp2Stream *stream, gboolean end_stream) {
+	liConnection *con = h2->con;
+	liVRequest *vr = stream->vr;
+	liRequest *req = &vr->request;
+
+	con->wrk->stats.requests++;
+	h2->requests++;
+	if (h2->requests == (guint) CORE_OPTION(LI_CORE_OPTION_MAX_KEEP_ALIVE_REQUESTS).number) {
+		li_http2_connection_shutdown(h2);
+	}
+
+	if (end_stream) {
+		stream->state = LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE;
+		stream->in.out->is_closed = TRUE;
+	}
+
+	if (!li_request_validate_header_http2(vr, end_stream)) {
+		if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+			VR_DEBUG(vr, "http2 stream %u: invalid request header", stream->id);
+		}
+		if (0 == vr->response.http_status) vr->response.http_status = 400;
+		/* send the error page without handling the request */
+		stream->out.out->is_closed = TRUE;
+		stream->headers_ready = TRUE;
+		h2_stream_schedule(stream);
+		return;
+	}
+
+	if (!end_stream && li_http_header_is(req->headers, CONST_STR_LEN("expect"), CONST_STR_LEN("100-continue"))) {
+		h2_send_100_continue(h2, stream);
+	}
+
+	if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(vr, "http2 stream %u: handle request", stream->id);
+	}
+
+	li_action_enter(vr, con->srv->mainaction);
+	li_vrequest_handle_request_headers(vr);
+}
+
+static void h2_handle_header_block(liHttp2Connection *h2, guint32 stream_id, guint8 flags, const guint8 *data, gsize len) {
+	h2_header_ctx ctx;
+	liHttp2Stream *stream;
+	gboolean end_stream = (0 != (flags & LI_HTTP2_FLAG_END_STREAM));
+
+	memset(&ctx, 0, sizeof(ctx));
+
+	stream = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream_id));
+	if (NULL != stream) {
+		/* trailers */
+		if (LI_HTTP2_STREAM_STATE_OPEN != stream->state && LI_HTTP2_STREAM_STATE_HALF_CLOSED_LOCAL != stream->state) {
+			stream = NULL;
+		} else {
+			ctx.stream = stream;
+			ctx.trailers = TRUE;
+		}
+		if (!li_hpack_decode(&h2->decoder, data, len, h2_header_cb, &ctx)) {
+			h2_connection_error(h2, LI_HTTP2_COMPRESSION_ERROR, "header decoding failed");
+			return;
+		}
+		if (NULL == stream) {
+			h2_send_rst_stream(h2, stream_id, LI_HTTP2_STREAM_CLOSED);
+		} else if (!end_stream || ctx.malformed) {
+			h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+		} else {
+			liChunkQueue *in = stream->in.out;
+			if (-1 == stream->vr->request.content_length) stream->vr->request.content_length = in->bytes_in;
+			if (stream->vr->request.content_length != in->bytes_in) {
+				h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+				return;
+			}
+			in->is_closed = TRUE;
+			li_stream_notify_later(&stream->in);
+			if (stream->end_stream_sent) {
+				h2_stream_close(stream);
+			} else {
+				stream->state = LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE;
+			}
+		}
+		return;
+	}
+
+	if (stream_id <= h2->last_stream_id) {
+		/* closed stream; decode to keep the HPACK state */
+		if (!li_hpack_decode(&h2->decoder, data, len, h2_header_cb, &ctx)) {
+			h2_connection_error(h2, LI_HTTP2_COMPRESSION_ERROR, "header decoding failed");
+			return;
+		}
+		h2_connection_error(h2, LI_HTTP2_STREAM_CLOSED, "HEADERS on closed stream");
+		return;
+	}
+	if (0 == (stream_id & 1)) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "even stream id from client");
+		return;
+	}
+	h2->last_stream_id = stream_id;
+
+	if (h2->goaway_sent || h2->active_streams >= LI_HTTP2_MAX_CONCURRENT_STREAMS) {
+		if (!li_hpack_decode(&h2->decoder, data, len, h2_header_cb, &ctx)) {
+			h2_connection_error(h2, LI_HTTP2_COMPRESSION_ERROR, "header decoding failed");
+			return;
+		}
+		h2_send_rst_stream(h2, stream_id, LI_HTTP2_REFUSED_STREAM);
+		return;
+	}
+
+	stream = h2_stream_new(h2, stream_id);
+	stream->weight = h2->header_weight;
+	stream->depends_on = h2->header_depends_on;
+	ctx.stream = stream;
+	if (!li_hpack_decode(&h2->decoder, data, len, h2_header_cb, &ctx)) {
+		h2_connection_error(h2, LI_HTTP2_COMPRESSION_ERROR, "header decoding failed");
+		return;
+	}
+
+	if (ctx.malformed || !ctx.have_method || !ctx.have_scheme || !ctx.have_path) {
+		/* malformed request (RFC 7540 8.1.2.6); CONNECT isn't supported */
+		h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+		return;
+	}
+
+	h2_stream_start(h2, stream, end_stream);
+}
+
+/**********************************************************************************/
+/* frame handlers */
+
+static void h2_apply_settings(liHttp2Connection *h2, const guint8 *data, gsize len) {
+	gsize i;
+
+	for (i = 0; i + 6 <= len; i += 6) {
+		guint16 id = ((guint16) data[i] << 8) | data[i+1];
+		guint32 value = h2_get_u32(data + i + 2);
+
+		switch (id) {
+		case LI_HTTP2_SETTINGS_HEADER_TABLE_SIZE:
+			li_hpack_encoder_set_max_size(&h2->encoder, value);
+			break;
+		case LI_HTTP2_SETTINGS_ENABLE_PUSH:
+			if (value > 1) {
+				h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "invalid SETTINGS_ENABLE_PUSH");
+				return;
+			}
+			break;
+		case LI_HTTP2_SETTINGS_MAX_CONCURRENT_STREAMS:
+			h2->peer_max_concurrent_streams = value; /* only limits server push */
+			break;
+		case LI_HTTP2_SETTINGS_INITIAL_WINDOW_SIZE:
+			if (value > LI_HTTP2_MAX_WINDOW) {
+				h2_connection_error(h2, LI_HTTP2_FLOW_CONTROL_ERROR, "invalid SETTINGS_INITIAL_WINDOW_SIZE");
+				return;
+			} else {
+				gint64 delta = (gint64) value - h2->peer_initial_window_size;
+				GHashTableIter it;
+				gpointer v;
+
+				g_hash_table_iter_init(&it, h2->streams);
+				while (g_hash_table_iter_next(&it, NULL, &v)) {
+					liHttp2Stream *stream = v;
+					if ((gint64) stream->send_window + delta > LI_HTTP2_MAX_WINDOW) {
+						h2_connection_error(h2, LI_HTTP2_FLOW_CONTROL_ERROR, "stream window too large");
+						return;
+					}
+					stream->send_window += delta;
+				}
+				h2->peer_initial_window_size = value;
+				li_stream_again_later(&h2->con->out);
+			}
+			break;
+		case LI_HTTP2_SETTINGS_MAX_FRAME_SIZE:
+			/* we keep sending frames of the minimum size */
+			if (value < LI_HTTP2_MAX_FRAME_SIZE || value > 0xffffff) {
+				h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "invalid SETTINGS_MAX_FRAME_SIZE");
+				return;
+			}
+			break;
+		default:
+			/* unknown settings must be ignored */
+			break;
+		}
+	}
+}
+
+static void h2_handle_settings(liHttp2Connection *h2, guint32 stream_id, guint8 flags, const guint8 *data, gsize len) {
+	if (0 != stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "SETTINGS on stream");
+		return;
+	}
+	if (flags & LI_HTTP2_FLAG_ACK) {
+		if (0 != len) h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "SETTINGS ACK with payload");
+		return;
+	}
+	if (0 != len % 6) {
+		h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "invalid SETTINGS length");
+		return;
+	}
+
+	h2_apply_settings(h2, data, len);
+	if (h2->broken) return;
+	h2->settings_received = TRUE;
+
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 0, LI_HTTP2_FRAME_SETTINGS, LI_HTTP2_FLAG_ACK, 0);
+	h2_send_tmp(h2);
+}
+
+static void h2_handle_window_update(liHttp2Connection *h2, guint32 stream_id, const guint8 *data, gsize len) {
+	guint32 increment;
+	liHttp2Stream *stream;
+
+	if (4 != len) {
+		h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "invalid WINDOW_UPDATE length");
+		return;
+	}
+	increment = h2_get_u32(data) & 0x7fffffff;
+
+	if (0 == stream_id) {
+		if (0 == increment) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "WINDOW_UPDATE with 0 increment");
+			return;
+		}
+		if ((gint64) h2->send_window + increment > LI_HTTP2_MAX_WINDOW) {
+			h2_connection_error(h2, LI_HTTP2_FLOW_CONTROL_ERROR, "connection window too large");
+			return;
+		}
+		h2->send_window += increment;
+		li_stream_again_later(&h2->con->out);
+		return;
+	}
+
+	if (stream_id > h2->last_stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "WINDOW_UPDATE on idle stream");
+		return;
+	}
+	stream = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream_id));
+	if (NULL == stream) return; /* closed */
+
+	if (0 == increment) {
+		h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+		return;
+	}
+	if ((gint64) stream->send_window + increment > LI_HTTP2_MAX_WINDOW) {
+		h2_stream_reset(stream, LI_HTTP2_FLOW_CONTROL_ERROR);
+		return;
+	}
+	stream->send_window += increment;
+	if (stream->headers_sent && !stream->end_stream_sent) h2_stream_schedule(stream);
+}
+
+static void h2_handle_rst_stream(liHttp2Connection *h2, guint32 stream_id, const guint8 *data, gsize len) {
+	liHttp2Stream *stream;
+	UNUSED(data);
+
+	if (0 == stream_id || stream_id > h2->last_stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "RST_STREAM on idle stream");
+		return;
+	}
+	if (4 != len) {
+		h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "invalid RST_STREAM length");
+		return;
+	}
+
+	stream = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream_id));
+	if (NULL == stream) return;
+
+	stream->info.aborted = TRUE;
+	h2_stream_close(stream);
+}
+
+static void h2_handle_priority(liHttp2Connection *h2, guint32 stream_id, const guint8 *data, gsize len) {
+	liHttp2Stream *stream;
+	guint32 depends_on;
+
+	if (0 == stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "PRIORITY on stream 0");
+		return;
+	}
+	if (5 != len) {
+		h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "invalid PRIORITY length");
+		return;
+	}
+
+	depends_on = h2_get_u32(data) & 0x7fffffff;
+	stream = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream_id));
+	if (depends_on == stream_id) {
+		if (NULL != stream) {
+			h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+		} else {
+			h2_send_rst_stream(h2, stream_id, LI_HTTP2_PROTOCOL_ERROR);
+		}
+		return;
+	}
+	if (NULL == stream) return; /* we don't keep priorities for idle or closed streams */
+
+	stream->depends_on = depends_on;
+	stream->weight = (guint16) data[4] + 1;
+}
+
+static void h2_handle_ping(liHttp2Connection *h2, guint32 stream_id, guint8 flags, const guint8 *data, gsize len) {
+	if (0 != stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "PING on stream");
+		return;
+	}
+	if (8 != len) {
+		h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "invalid PING length");
+		return;
+	}
+	if (flags & LI_HTTP2_FLAG_ACK) return;
+
+	g_string_truncate(h2->tmp, 0);
+	h2_frame_header(h2->tmp, 8, LI_HTTP2_FRAME_PING, LI_HTTP2_FLAG_ACK, 0);
+	g_string_append_len(h2->tmp, (const gchar*) data, 8);
+	h2_send_tmp(h2);
+}
+
+static void h2_handle_headers(liHttp2Connection *h2, guint32 stream_id, guint8 flags, const guint8 *data, gsize len) {
+	gsize pad = 0;
+
+	if (0 == stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "HEADERS on stream 0");
+		return;
+	}
+
+	if (flags & LI_HTTP2_FLAG_PADDED) {
+		if (len < 1) goto invalid_length;
+		pad = data[0];
+		data++; len--;
+	}
+
+	h2->header_weight = 16;
+	h2->header_depends_on = 0;
+	if (flags & LI_HTTP2_FLAG_PRIORITY) {
+		if (len < 5) goto invalid_length;
+		h2->header_depends_on = h2_get_u32(data) & 0x7fffffff;
+		h2->header_weight = (guint16) data[4] + 1;
+		data += 5; len -= 5;
+		if (h2->header_depends_on == stream_id) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "stream depends on itself");
+			return;
+		}
+	}
+
+	if (pad > len) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "too much padding");
+		return;
+	}
+	len -= pad;
+
+	if (flags & LI_HTTP2_FLAG_END_HEADERS) {
+		h2_handle_header_block(h2, stream_id, flags, data, len);
+	} else {
+		h2->continuation_stream = stream_id;
+		h2->continuation_flags = flags;
+		g_string_truncate(h2->header_block, 0);
+		g_string_append_len(h2->header_block, (const gchar*) data, len);
+	}
+	return;
+
+invalid_length:
+	h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "HEADERS frame too short");
+}
+
+static void h2_handle_continuation(liHttp2Connection *h2, guint32 stream_id, guint8 flags, const guint8 *data, gsize len) {
+	if (0 == h2->continuation_stream || stream_id != h2->continuation_stream) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "unexpected CONTINUATION");
+		return;
+	}
+	if (h2->header_block->len + len > LI_HTTP2_MAX_HEADER_BLOCK) {
+		h2_connection_error(h2, LI_HTTP2_ENHANCE_YOUR_CALM, "header block too large");
+		return;
+	}
+	g_string_append_len(h2->header_block, (const gchar*) data, len);
+
+	if (flags & LI_HTTP2_FLAG_END_HEADERS) {
+		h2->continuation_stream = 0;
+		h2_handle_header_block(h2, stream_id, h2->continuation_flags, (const guint8*) h2->header_block->str, h2->header_block->len);
+		g_string_truncate(h2->header_block, 0);
+	}
+}
+
+/* payload is still in raw_in: move it into the request body without copying */
+static void h2_handle_data(liHttp2Connection *h2, liChunkQueue *raw_in, guint32 stream_id, guint8 flags, guint32 len) {
+	liHttp2Stream *stream;
+	guint32 pad = 0, data_len = len;
+	liChunkQueue *in;
+
+	if (0 == stream_id) {
+		h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "DATA on stream 0");
+		return;
+	}
+
+	if (flags & LI_HTTP2_FLAG_PADDED) {
+		guint8 p;
+		if (len < 1 || !li_chunkqueue_extract_to_memory(raw_in, 1, &p, NULL)) {
+			h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "DATA frame too short");
+			return;
+		}
+		pad = p;
+		if (pad >= len) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "too much padding");
+			return;
+		}
+		data_len = len - 1 - pad;
+	}
+
+	/* the whole frame counts against the windows */
+	h2->recv_window -= len;
+	if (h2->recv_window < 0) {
+		h2_connection_error(h2, LI_HTTP2_FLOW_CONTROL_ERROR, "connection window exceeded");
+		return;
+	}
+	if (h2->recv_window < LI_HTTP2_CONNECTION_WINDOW / 2) {
+		h2_send_window_update(h2, 0, LI_HTTP2_CONNECTION_WINDOW - h2->recv_window);
+		h2->recv_window = LI_HTTP2_CONNECTION_WINDOW;
+	}
+
+	stream = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream_id));
+	if (NULL == stream || LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE == stream->state) {
+		li_chunkqueue_skip(raw_in, len);
+		if (stream_id > h2->last_stream_id) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "DATA on idle stream");
+		} else if (NULL != stream) {
+			h2_stream_reset(stream, LI_HTTP2_STREAM_CLOSED);
+		} else {
+			h2_send_rst_stream(h2, stream_id, LI_HTTP2_STREAM_CLOSED);
+		}
+		return;
+	}
+
+	stream->recv_window -= len;
+	if (stream->recv_window < 0) {
+		li_chunkqueue_skip(raw_in, len);
+		h2_stream_reset(stream, LI_HTTP2_FLOW_CONTROL_ERROR);
+		return;
+	}
+
+	in = stream->in.out;
+	if (pad > 0 || (flags & LI_HTTP2_FLAG_PADDED)) li_chunkqueue_skip(raw_in, 1);
+	li_chunkqueue_steal_len(in, raw_in, data_len);
+	li_chunkqueue_skip(raw_in, pad);
+	stream->info.stats.bytes_in += len;
+	stream->recv_pending += len;
+
+	if (stream->vr->request.content_length >= 0 && in->bytes_in > stream->vr->request.content_length) {
+		h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+		return;
+	}
+
+	if (flags & LI_HTTP2_FLAG_END_STREAM) {
+		if (-1 == stream->vr->request.content_length) stream->vr->request.content_length = in->bytes_in;
+		if (stream->vr->request.content_length != in->bytes_in) {
+			h2_stream_reset(stream, LI_HTTP2_PROTOCOL_ERROR);
+			return;
+		}
+		in->is_closed = TRUE;
+		stream->recv_pending = 0;
+		if (stream->end_stream_sent) {
+			h2_stream_close(stream);
+		} else {
+			stream->state = LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE;
+		}
+	} else {
+		h2_stream_update_recv_window(stream);
+	}
+
+	li_stream_notify_later(&stream->in);
+}
+
+liHandlerResult li_http2_check_preface(liChunkQueue *raw_in) {
+	gchar buf[sizeof(LI_HTTP2_PREFACE) - 1];
+	goffset len = MIN(raw_in->length, (goffset) sizeof(buf));
+
+	if (0 == len) return LI_HANDLER_WAIT_FOR_EVENT;
+	if (!li_chunkqueue_extract_to_memory(raw_in, len, buf, NULL)) return LI_HANDLER_ERROR;
+	if (0 != memcmp(buf, LI_HTTP2_PREFACE, len)) return LI_HANDLER_ERROR;
+
+	return (len == (goffset) sizeof(buf)) ? LI_HANDLER_GO_ON : LI_HANDLER_WAIT_FOR_EVENT;
+}
+
+gboolean li_http2_connection_read(liHttp2Connection *h2, liChunkQueue *raw_in) {
+	guint8 header[LI_HTTP2_FRAME_HEADER_LEN];
+
+	if (!h2->preface_received) {
+		switch (li_http2_check_preface(raw_in)) {
+		case LI_HANDLER_GO_ON:
+			li_chunkqueue_skip(raw_in, sizeof(LI_HTTP2_PREFACE) - 1);
+			h2->preface_received = TRUE;
+			break;
+		case LI_HANDLER_WAIT_FOR_EVENT:
+			return TRUE;
+		default:
+			return FALSE;
+		}
+	}
+
+	while (!h2->broken && raw_in->length >= LI_HTTP2_FRAME_HEADER_LEN) {
+		guint32 len, stream_id;
+		guint8 type, flags;
+
+		if (!li_chunkqueue_extract_to_memory(raw_in, LI_HTTP2_FRAME_HEADER_LEN, header, NULL)) return FALSE;
+		len = ((guint32) header[0] << 16) | ((guint32) header[1] << 8) | header[2];
+		type = header[3];
+		flags = header[4];
+		stream_id = h2_get_u32(header + 5) & 0x7fffffff;
+
+		if (len > LI_HTTP2_MAX_FRAME_SIZE) {
+			h2_connection_error(h2, LI_HTTP2_FRAME_SIZE_ERROR, "frame too large");
+			break;
+		}
+		if (raw_in->length < (goffset) (LI_HTTP2_FRAME_HEADER_LEN + len)) break; /* wait for the complete frame */
+
+		if (!h2->settings_received && LI_HTTP2_FRAME_SETTINGS != type) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "expected SETTINGS");
+			break;
+		}
+		if (0 != h2->continuation_stream && LI_HTTP2_FRAME_CONTINUATION != type) {
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "expected CONTINUATION");
+			break;
+		}
+
+		li_chunkqueue_skip(raw_in, LI_HTTP2_FRAME_HEADER_LEN);
+
+		if (LI_HTTP2_FRAME_DATA == type) {
+			h2_handle_data(h2, raw_in, stream_id, flags, len);
+			continue;
+		}
+
+		if (!li_chunkqueue_extract_to(raw_in, len, h2->payload, NULL)) return FALSE;
+		li_chunkqueue_skip(raw_in, len);
+
+		switch (type) {
+		case LI_HTTP2_FRAME_HEADERS:
+			h2_handle_headers(h2, stream_id, flags, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_PRIORITY:
+			h2_handle_priority(h2, stream_id, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_RST_STREAM:
+			h2_handle_rst_stream(h2, stream_id, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_SETTINGS:
+			h2_handle_settings(h2, stream_id, flags, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_PUSH_PROMISE:
+			h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "PUSH_PROMISE from client");
+			break;
+		case LI_HTTP2_FRAME_PING:
+			h2_handle_ping(h2, stream_id, flags, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_GOAWAY:
+			if (0 != stream_id) {
+				h2_connection_error(h2, LI_HTTP2_PROTOCOL_ERROR, "GOAWAY on stream");
+				break;
+			}
+			/* finish the active streams, then close */
+			h2->goaway_received = TRUE;
+			li_http2_connection_shutdown(h2);
+			break;
+		case LI_HTTP2_FRAME_WINDOW_UPDATE:
+			h2_handle_window_update(h2, stream_id, (const guint8*) h2->payload->str, len);
+			break;
+		case LI_HTTP2_FRAME_CONTINUATION:
+			h2_handle_continuation(h2, stream_id, flags, (const guint8*) h2->payload->str, len);
+			break;
+		default:
+			/* unknown frame types must be ignored */
+			break;
+		}
+	}
+
+	if (h2->broken) li_chunkqueue_skip_all(raw_in);
+
+	li_connection_update_io_wait(h2->con);
+
+	return TRUE;
+}
+
+/**********************************************************************************/
+/* writing */
+
+static void h2_stream_send_headers(liHttp2Connection *h2, liHttp2Stream *stream) {
+	GString *block = h2->header_out;
+	gboolean have_body;
+
+	if (_CORE_OPTION(stream->vr, LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(stream->vr, "http2 stream %u: write response headers", stream->id);
+	}
+
+	g_string_truncate(block, 0);
+	li_hpack_encode_start(&h2->encoder, block);
+	have_body = li_response_send_headers_http2(stream->vr, block, &h2->encoder, stream->out.out);
+	h2_send_header_block(h2, stream->id, block, !have_body);
+	stream->headers_sent = TRUE;
+
+	if (!have_body) h2_stream_local_done(stream);
+}
+
+/* sends up to max bytes of DATA frames; returns the number of payload bytes */
+static goffset h2_stream_send_data(liHttp2Connection *h2, liHttp2Stream *stream, goffset max) {
+	liChunkQueue *body = stream->out.out, *out = h2->con->out.out;
+	goffset len = body->length, sent = 0;
+
+	len = MIN(len, max);
+	len = MIN(len, stream->send_window);
+	len = MIN(len, h2->send_window);
+
+	while (len > 0) {
+		goffset frame = MIN(len, LI_HTTP2_MAX_FRAME_SIZE);
+		guint8 flags = (body->is_closed && body->length == frame) ? LI_HTTP2_FLAG_END_STREAM : 0;
+
+		/* take the payload first: reading a splice pipe can fail, and a frame must not be cut short */
+		if (-1 == li_chunkqueue_steal_len(h2->frame_data, body, frame)) {
+			li_chunkqueue_reset(h2->frame_data);
+			h2_stream_reset(stream, LI_HTTP2_INTERNAL_ERROR);
+			return sent;
+		}
+
+		g_string_truncate(h2->tmp, 0);
+		h2_frame_header(h2->tmp, frame, LI_HTTP2_FRAME_DATA, flags, stream->id);
+		li_chunkqueue_append_mem(out, GSTR_LEN(h2->tmp));
+		li_chunkqueue_steal_all(out, h2->frame_data);
+
+		stream->send_window -= frame;
+		h2->send_window -= frame;
+		stream->info.stats.bytes_out += frame;
+		len -= frame;
+		sent += frame;
+
+		if (flags & LI_HTTP2_FLAG_END_STREAM) {
+			h2_stream_local_done(stream);
+			return sent;
+		}
+	}
+
+	if (body->is_closed && 0 == body->length) {
+		/* empty body or the END_STREAM didn't fit into the last frame */
+		g_string_truncate(h2->tmp, 0);
+		h2_frame_header(h2->tmp, 0, LI_HTTP2_FRAME_DATA, LI_HTTP2_FLAG_END_STREAM, stream->id);
+		li_chunkqueue_append_mem(out, GSTR_LEN(h2->tmp));
+		h2_stream_local_done(stream);
+	}
+
+	return sent;
+}
+
+/* a stream waits for its parent if the parent can send data right now */
+static gboolean h2_stream_blocked_by_parent(liHttp2Connection *h2, liHttp2Stream *stream) {
+	liHttp2Stream *parent;
+
+	if (0 == stream->depends_on) return FALSE;
+	parent = g_hash_table_lookup(h2->streams, GUINT_TO_POINTER(stream->depends_on));
+	if (NULL == parent || !parent->headers_sent || parent->end_stream_sent) return FALSE;
+	return parent->out.out->length > 0 && parent->send_window > 0;
+}
+
+static void h2_send_window_updates(liHttp2Connection *h2) {
+	GHashTableIter it;
+	gpointer value;
+
+	h2->window_updates_pending = FALSE;
+	g_hash_table_iter_init(&it, h2->streams);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		h2_stream_update_recv_window(value);
+	}
+}
+
+static void h2_check_idle(liHttp2Connection *h2) {
+	liConnection *con = h2->con;
+
+	if (0 != h2->active_streams) return;
+
+	if (h2->goaway_sent) {
+		/* close after the remaining frames are sent (li_connection_request_done) */
+		con->info.keep_alive = FALSE;
+		con->out_has_all_data = TRUE;
+	} else if (!li_event_active(&con->keep_alive_data.watcher)) {
+		li_event_timer_once(&con->keep_alive_data.watcher, h2->max_idle);
+	}
+}
+
+void li_http2_connection_write(liHttp2Connection *h2) {
+	liConnection *con = h2->con;
+	liChunkQueue *out = con->out.out;
+	GList *l, *next;
+	gboolean progress;
+
+	while (h2->closed.length > 0) {
+		h2_stream_free(g_queue_pop_head(&h2->closed));
+	}
+
+	if (h2->broken) return;
+
+	if (h2->window_updates_pending) h2_send_window_updates(h2);
+
+	/* response headers aren't flow controlled */
+	for (l = h2->send_queue.head; NULL != l; l = next) {
+		liHttp2Stream *stream = l->data;
+		next = l->next;
+		if (stream->headers_ready && !stream->headers_sent) h2_stream_send_headers(h2, stream);
+	}
+
+	/* weighted round robin over the streams with data */
+	do {
+		progress = FALSE;
+		for (l = h2->send_queue.head; NULL != l; l = next) {
+			liHttp2Stream *stream = l->data;
+			goffset pending = out->length + (NULL != con->con_sock.raw_out ? con->con_sock.raw_out->out->length : 0);
+			next = l->next;
+
+			if (pending >= LI_HTTP2_WRITE_QUEUE_LENGTH) break;
+			if (!stream->headers_sent) continue;
+
+			if (0 == stream->out.out->length && !stream->out.out->is_closed) {
+				h2_stream_unschedule(stream); /* scheduled again on new data */
+				continue;
+			}
+			if (stream->out.out->length > 0 && (stream->send_window <= 0 || h2->send_window <= 0)) continue;
+			if (h2_stream_blocked_by_parent(h2, stream)) continue;
+
+			if (h2_stream_send_data(h2, stream, stream->weight * (LI_HTTP2_MAX_FRAME_SIZE / 16)) > 0) progress = TRUE;
+		}
+
+		/* next round starts with another stream */
+		if (h2->send_queue.length > 1) {
+			l = g_queue_pop_head_link(&h2->send_queue);
+			g_queue_push_tail_link(&h2->send_queue, l);
+		}
+	} while (progress && h2->send_window > 0);
+
+	h2_check_idle(h2);
+	con->info.out_queue_length = out->length;
+	li_connection_update_io_wait(con);
+}
+
+/**********************************************************************************/
+
+liHttp2Connection* li_http2_connection_new(liConnection *con) {
+	liVRequest *vr = con->mainvr;
+	liHttp2Connection *h2 = g_slice_new0(liHttp2Connection);
+
+	h2->con = con;
+	li_hpack_decoder_init(&h2->decoder, LI_HPACK_DEFAULT_TABLE_SIZE);
+	li_hpack_encoder_init(&h2->encoder);
+
+	h2->peer_initial_window_size = LI_HTTP2_DEFAULT_WINDOW_SIZE;
+	h2->peer_max_concurrent_streams = G_MAXUINT32;
+	h2->send_window = LI_HTTP2_DEFAULT_WINDOW_SIZE;
+	h2->recv_window = LI_HTTP2_DEFAULT_WINDOW_SIZE;
+
+	h2->streams = g_hash_table_new(g_direct_hash, g_direct_equal);
+	g_queue_init(&h2->send_queue);
+	g_queue_init(&h2->closed);
+
+	h2->header_block = g_string_sized_new(0);
+	h2->header_out = g_string_sized_new(1024);
+	h2->payload = g_string_sized_new(LI_HTTP2_MAX_FRAME_SIZE);
+	h2->tmp = g_string_sized_new(64);
+	h2->frame_data = li_chunkqueue_new();
+
+	h2->max_idle = CORE_OPTION(LI_CORE_OPTION_MAX_KEEP_ALIVE_IDLE).number;
+
+	/* server connection preface */
+	h2_send_settings(h2);
+
+	return h2;
+}
+
+void li_http2_connection_free(liHttp2Connection *h2) {
+	GHashTableIter it;
+	gpointer value;
+
+	if (NULL == h2) return;
+
+	g_hash_table_iter_init(&it, h2->streams);
+	while (g_hash_table_iter_next(&it, NULL, &value)) {
+		liHttp2Stream *stream = value;
+		g_hash_table_iter_steal(&it);
+		stream->id = 0;
+		stream->info.aborted = TRUE;
+		h2_stream_close(stream);
+	}
+	while (h2->closed.length > 0) {
+		liHttp2Stream *stream = g_queue_pop_head(&h2->closed);
+		h2_stream_free(stream);
+	}
+	g_hash_table_destroy(h2->streams);
+
+	li_hpack_decoder_clear(&h2->decoder);
+	li_hpack_encoder_clear(&h2->encoder);
+
+	g_string_free(h2->header_block, TRUE);
+	g_string_free(h2->header_out, TRUE);
+	g_string_free(h2->payload, TRUE);
+	g_string_free(h2->tmp, TRUE);
+	li_chunkqueue_free(h2->frame_data);
+
+	g_slice_free(liHttp2Connection, h2);
+}
+
+void li_http2_connection_shutdown(liHttp2Connection *h2) {
+	if (h2->goaway_sent) return;
+	h2_send_goaway(h2, LI_HTTP2_NO_ERROR);
+	li_stream_again_later(&h2->con->out);
+}
+
+gboolean li_http2_connection_want_timeout(liHttp2Connection *h2) {
+	liConnection *con = h2->con;
+
+	/* waiting for the rest of a frame or for the socket to take our frames */
+	if (!h2->preface_received || 0 != h2->continuation_stream) return TRUE;
+	if (0 != con->out.out->length) return TRUE;
+	if (NULL != con->con_sock.raw_out && 0 != con->con_sock.raw_out->out->length) return TRUE;
+	return FALSE;
+}
+
+liConnection* li_http2_connection_from_vrequest(liVRequest *vr) {
+	liHttp2Stream *stream;
+
+	if (vr->coninfo->callbacks != &h2_stream_callbacks) return NULL;
+
+	stream = LI_CONTAINER_OF(vr->coninfo, liHttp2Stream, info);
+	return (NULL != stream->h2) ? stream->h2->con : NULL;
+}
+
+/**********************************************************************************/
+/* h2c upgrade (RFC 7540 3.2) */
+
+static gboolean h2_decode_settings_header(const gchar *value, gsize len, GString *dest) {
+	gchar *b64;
+	guchar *raw;
+	gsize i, raw_len;
+
+	/* base64url without padding */
+	b64 = g_malloc(len + 4);
+	for (i = 0; i < len; i++) {
+		gchar c = value[i];
+		if ('-' == c) c = '+';
+		else if ('_' == c) c = '/';
+		else if ('=' == c || '+' == c || '/' == c) { g_free(b64); return FALSE; }
+		b64[i] = c;
+	}
+	while (0 != i % 4) b64[i++] = '=';
+	b64[i] = '\0';
+
+	raw = g_base64_decode(b64, &raw_len);
+	g_free(b64);
+
+	if (0 != raw_len % 6) {
+		g_free(raw);
+		return FALSE;
+	}
+	g_string_truncate(dest, 0);
+	g_string_append_len(dest, (const gchar*) raw, raw_len);
+	g_free(raw);
+	return TRUE;
+}
+
+gboolean li_http2_upgrade(liConnection *con) {
+	liVRequest *vr = con->mainvr;
+	liRequest *req = &vr->request;
+	liHttpHeader *hh;
+	liHttpHeaderTokenizer tok;
+	GString *token = vr->wrk->tmp_str, *settings;
+	gboolean found = FALSE;
+	liHttp2Connection *h2;
+	liHttp2Stream *stream;
+
+	/* only the simple case: cleartext, HTTP/1.1 without request body */
+	if (con->info.is_ssl || LI_HTTP_VERSION_1_1 != req->http_version) return FALSE;
+	if (0 != req->content_length || con->expect_100_cont) return FALSE;
+
+	li_http_header_tokenizer_start(&tok, req->headers, CONST_STR_LEN("upgrade"));
+	while (li_http_header_tokenizer_next(&tok, token)) {
+		if (li_strncase_equal(token, CONST_STR_LEN("h2c"))) found = TRUE;
+	}
+	if (!found) return FALSE;
+
+	hh = li_http_header_lookup(req->headers, CONST_STR_LEN("http2-settings"));
+	if (NULL == hh) return FALSE;
+	settings = g_string_sized_new(0);
+	if (!h2_decode_settings_header(LI_HEADER_VALUE_LEN(hh), settings)) {
+		g_string_free(settings, TRUE);
+		return FALSE;
+	}
+
+	if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(vr, "%s", "upgrade to h2c");
+	}
+
+	li_chunkqueue_append_mem(con->out.out, CONST_STR_LEN("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n"));
+
+	h2 = li_http2_connection_new(con);
+	h2_apply_settings(h2, (const guint8*) settings->str, settings->len);
+	g_string_free(settings, TRUE);
+	con->http2 = h2;
+	con->state = LI_CON_STATE_HTTP2;
+
+	/* the request continues as stream 1, which is already half closed */
+	h2->last_stream_id = 1;
+	stream = h2_stream_new(h2, 1);
+	li_request_copy(&stream->vr->request, req);
+	stream->vr->request.http_version = LI_HTTP_VERSION_2;
+	li_http_header_remove(stream->vr->request.headers, CONST_STR_LEN("connection"));
+	li_http_header_remove(stream->vr->request.headers, CONST_STR_LEN("upgrade"));
+	li_http_header_remove(stream->vr->request.headers, CONST_STR_LEN("http2-settings"));
+	li_http_header_remove(stream->vr->request.headers, CONST_STR_LEN("keep-alive"));
+	stream->state = LI_HTTP2_STREAM_STATE_HALF_CLOSED_REMOTE;
+	stream->in.out->is_closed = TRUE;
+	h2->requests++;
+
+	li_vrequest_reset(vr, FALSE);
+
+	li_action_enter(stream->vr, con->srv->mainaction);
+	li_vrequest_handle_request_headers(stream->vr);
+
+	return TRUE;
+}
@@ -0,0 +1,579 @@
+
+#include <lighttpd/base.h>
+
+/* HPACK (RFC 7541): static table (appendix A), huffman code (appendix B), dynamic tables, decoder and encoder */
+
+typedef struct hpack_static_entry hpack_static_entry;
+struct hpack_static_entry {
+	const gchar *name, *value;
+	gsize name_len, value_len;
+};
+
+#define HPACK_STATIC(name, value) { name, value, sizeof(name) - 1, sizeof(value) - 1 }
+
+static const hpack_static_entry hpack_static_table[LI_HPACK_STATIC_TABLE_LEN] = {
+	HPACK_STATIC(":authority", ""),
+	HPACK_STATIC(":method", "GET"),
+	HPACK_STATIC(":method", "POST"),
+	HPACK_STATIC(":path", "/"),
+	HPACK_STATIC(":path", "/index.html"),
+	HPACK_STATIC(":scheme", "http"),
+	HPACK_STATIC(":scheme", "https"),
+	HPACK_STATIC(":status", "200"),
+	HPACK_STATIC(":status", "204"),
+	HPACK_STATIC(":status", "206"),
+	HPACK_STATIC(":status", "304"),
+	HPACK_STATIC(":status", "400"),
+	HPACK_STATIC(":status", "404"),
+	HPACK_STATIC(":status", "500"),
+	HPACK_STATIC("accept-charset", ""),
+	HPACK_STATIC("accept-encoding", "gzip, deflate"),
+	HPACK_STATIC("accept-language", ""),
+	HPACK_STATIC("accept-ranges", ""),
+	HPACK_STATIC("accept", ""),
+	HPACK_STATIC("access-control-allow-origin", ""),
+	HPACK_STATIC("age", ""),
+	HPACK_STATIC("allow", ""),
+	HPACK_STATIC("authorization", ""),
+	HPACK_STATIC("cache-control", ""),
+	HPACK_STATIC("content-disposition", ""),
+	HPACK_STATIC("content-encoding", ""),
+	HPACK_STATIC("content-language", ""),
+	HPACK_STATIC("content-length", ""),
+	HPACK_STATIC("content-location", ""),
+	HPACK_STATIC("content-range", ""),
+	HPACK_STATIC("content-type", ""),
+	HPACK_STATIC("cookie", ""),
+	HPACK_STATIC("date", ""),
+	HPACK_STATIC("etag", ""),
+	HPACK_STATIC("expect", ""),
+	HPACK_STATIC("expires", ""),
+	HPACK_STATIC("from", ""),
+	HPACK_STATIC("host", ""),
+	HPACK_STATIC("if-match", ""),
+	HPACK_STATIC("if-modified-since", ""),
+	HPACK_STATIC("if-none-match", ""),
+	HPACK_STATIC("if-range", ""),
+	HPACK_STATIC("if-unmodified-since", ""),
+	HPACK_STATIC("last-modified", ""),
+	HPACK_STATIC("link", ""),
+	HPACK_STATIC("location", ""),
+	HPACK_STATIC("max-forwards", ""),
+	HPACK_STATIC("proxy-authenticate", ""),
+	HPACK_STATIC("proxy-authorization", ""),
+	HPACK_STATIC("range", ""),
+	HPACK_STATIC("referer", ""),
+	HPACK_STATIC("refresh", ""),
+	HPACK_STATIC("retry-after", ""),
+	HPACK_STATIC("server", ""),
+	HPACK_STATIC("set-cookie", ""),
+	HPACK_STATIC("strict-transport-security", ""),
+	HPACK_STATIC("transfer-encoding", ""),
+	HPACK_STATIC("user-agent", ""),
+	HPACK_STATIC("vary", ""),
+	HPACK_STATIC("via", ""),
+	HPACK_STATIC("www-authenticate", ""),
+};
+
+#undef HPACK_STATIC
+
+/* the code is canonical: codes of the same length are consecutive numbers, ordered by symbol.
+ * generated from the code lengths in RFC 7541 appendix B.
+ */
+static const guint32 hpack_huffman_codes[257] = {
+	0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+	0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+	0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+	0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+	0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+	0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+	0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+	0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+	0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+	0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+	0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+	0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+	0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+	0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+	0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+	0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+	0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+	0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+	0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+	0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+	0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+	0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+	0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+	0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+	0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+	0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+	0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+	0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+	0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+	0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+	0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+	0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+	0x3fffffff,
+};
+
+static const guint8 hpack_huffman_lengths[257] = {
+	13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+	28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+	6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+	5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+	13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+	7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+	15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+	6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+	20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+	24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+	22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+	21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+	26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+	19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+	20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+	26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+	30,
+};
+
+/* symbols ordered by (code length, symbol) */
+static const guint16 hpack_huffman_symbols[257] = {
+	48, 49, 50, 97, 99, 101, 105, 111, 115, 116, 32, 37, 45, 46, 47, 51,
+	52, 53, 54, 55, 56, 57, 61, 65, 95, 98, 100, 102, 103, 104, 108, 109,
+	110, 112, 114, 117, 58, 66, 67, 68, 69, 70, 71, 72, 73, 74, 75, 76,
+	77, 78, 79, 80, 81, 82, 83, 84, 85, 86, 87, 89, 106, 107, 113, 118,
+	119, 120, 121, 122, 38, 42, 44, 59, 88, 90, 33, 34, 40, 41, 63, 39,
+	43, 124, 35, 62, 0, 36, 64, 91, 93, 126, 94, 125, 60, 96, 123, 92,
+	195, 208, 128, 130, 131, 162, 184, 194, 224, 226, 153, 161, 167, 172, 176, 177,
+	179, 209, 216, 217, 227, 229, 230, 129, 132, 133, 134, 136, 146, 154, 156, 160,
+	163, 164, 169, 170, 173, 178, 181, 185, 186, 187, 189, 190, 196, 198, 228, 232,
+	233, 1, 135, 137, 138, 139, 140, 141, 143, 147, 149, 150, 151, 152, 155, 157,
+	158, 165, 166, 168, 174, 175, 180, 182, 183, 188, 191, 197, 231, 239, 9, 142,
+	144, 145, 148, 159, 171, 206, 215, 225, 236, 237, 199, 207, 234, 235, 192, 193,
+	200, 201, 202, 205, 210, 213, 218, 219, 238, 240, 242, 243, 255, 203, 204, 211,
+	212, 214, 221, 222, 223, 241, 244, 245, 246, 247, 248, 250, 251, 252, 253, 254,
+	2, 3, 4, 5, 6, 7, 8, 11, 12, 14, 15, 16, 17, 18, 19, 20,
+	21, 23, 24, 25, 26, 27, 28, 29, 30, 31, 127, 220, 249, 10, 13, 22,
+	256,
+};
+
+/* per code length (index 0 is length 5): first code, number of codes and offset in hpack_huffman_symbols */
+static const guint32 hpack_huffman_first_code[26] = {
+	0x0, 0x14, 0x5c, 0xf8, 0x0, 0x3f8, 0x7fa, 0xffa,
+	0x1ff8, 0x3ffc, 0x7ffc, 0x0, 0x0, 0x0, 0x7fff0, 0xfffe6,
+	0x1fffdc, 0x3fffd2, 0x7fffd8, 0xffffea, 0x1ffffec, 0x3ffffe0, 0x7ffffde, 0xfffffe2,
+	0x0, 0x3ffffffc,
+};
+static const guint16 hpack_huffman_count[26] = {
+	10, 26, 32, 6, 0, 5, 3, 2, 6, 2, 3, 0, 0,
+	0, 3, 8, 13, 26, 29, 12, 4, 15, 19, 29, 0, 4,
+};
+static const guint16 hpack_huffman_offset[26] = {
+	0, 10, 36, 68, 74, 74, 79, 82, 84, 90, 92, 95, 95,
+	95, 95, 98, 106, 119, 145, 174, 186, 190, 205, 224, 253, 253,
+};
+
+/******************
+ *    huffman     *
+ ******************/
+
+gboolean li_hpack_huffman_decode(GString *dest, const guint8 *data, gsize len) {
+	guint32 code = 0;
+	guint bits = 0;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		guint8 b = data[i];
+		gint bit;
+
+		for (bit = 7; bit >= 0; bit--) {
+			code = (code << 1) | ((b >> bit) & 1);
+			bits++;
+
+			if (bits >= 5) {
+				guint k = bits - 5;
+				guint32 n = code - hpack_huffman_first_code[k];
+
+				if (code >= hpack_huffman_first_code[k] && n < hpack_huffman_count[k]) {
+					guint sym = hpack_huffman_symbols[hpack_huffman_offset[k] + n];
+					if (256 == sym) return FALSE; /* EOS must not be encoded */
+					g_string_append_c(dest, (gchar) sym);
+					code = 0;
+					bits = 0;
+				} else if (bits >= 30) {
+					return FALSE;
+				}
+			}
+		}
+	}
+
+	/* padding: at most 7 bits, the most significant bits of EOS (all set) */
+	if (bits > 7 || code != (1u << bits) - 1) return FALSE;
+
+	return TRUE;
+}
+
+gsize li_hpack_huffman_length(const guint8 *data, gsize len) {
+	gsize bits = 0, i;
+
+	for (i = 0; i < len; i++) {
+		bits += hpack_huffman_lengths[data[i]];
+	}
+
+	return (bits + 7) / 8;
+}
+
+void li_hpack_huffman_encode(GString *dest, const guint8 *data, gsize len) {
+	guint64 acc = 0; /* only the lowest "bits" bits are pending */
+	guint bits = 0;
+	gsize i;
+
+	for (i = 0; i < len; i++) {
+		acc = (acc << hpack_huffman_lengths[data[i]]) | hpack_huffman_codes[data[i]];
+		bits += hpack_huffman_lengths[data[i]];
+
+		while (bits >= 8) {
+			bits -= 8;
+			g_string_append_c(dest, (gchar) (acc >> bits));
+		}
+	}
+
+	if (bits > 0) {
+		/* pad with the most significant bits of EOS */
+		g_string_append_c(dest, (gchar) ((acc << (8 - bits)) | (0xff >> bits)));
+	}
+}
+
+/******************
+ * dynamic table  *
+ ******************/
+
+static void hpack_table_init(liHPackTable *table, gsize max_size) {
+	table->capacity = 16;
+	table->entries = g_new0(liHPackEntry*, table->capacity);
+	table->first = table->count = 0;
+	table->size = 0;
+	table->max_size = max_size;
+}
+
+static void hpack_entry_free(liHPackEntry *e) {
+	g_slice_free1(sizeof(liHPackEntry) + e->name_len + e->value_len, e);
+}
+
+/* removes the oldest entry */
+static void hpack_table_evict(liHPackTable *table) {
+	guint slot = (table->first + table->count - 1) & (table->capacity - 1);
+	liHPackEntry *e = table->entries[slot];
+
+	table->entries[slot] = NULL;
+	table->count--;
+	table->size -= e->name_len + e->value_len + LI_HPACK_ENTRY_OVERHEAD;
+	hpack_entry_free(e);
+}
+
+static void hpack_table_clear(liHPackTable *table) {
+	while (table->count > 0) hpack_table_evict(table);
+	g_free(table->entries);
+	table->entries = NULL;
+	table->capacity = 0;
+}
+
+/* ndx 0 is the newest entry */
+static liHPackEntry* hpack_table_get(liHPackTable *table, guint ndx) {
+	if (ndx >= table->count) return NULL;
+	return table->entries[(table->first + ndx) & (table->capacity - 1)];
+}
+
+static void hpack_table_set_max_size(liHPackTable *table, gsize max_size) {
+	table->max_size = max_size;
+	while (table->size > table->max_size) hpack_table_evict(table);
+}
+
+static void hpack_table_add(liHPackTable *table, const gchar *name, gsize name_len, const gchar *value, gsize value_len) {
+	gsize size = name_len + value_len + LI_HPACK_ENTRY_OVERHEAD;
+	liHPackEntry *e;
+
+	/* copy first: name may point into an entry which gets evicted */
+	e = g_slice_alloc(sizeof(liHPackEntry) + name_len + value_len);
+	e->name_len = name_len;
+	e->value_len = value_len;
+	memcpy(e->data, name, name_len);
+	memcpy(e->data + name_len, value, value_len);
+
+	while (table->count > 0 && table->size + size > table->max_size) hpack_table_evict(table);
+
+	if (size > table->max_size) {
+		/* entries larger than the table only empty it */
+		hpack_entry_free(e);
+		return;
+	}
+
+	if (table->count == table->capacity) {
+		guint i, capacity = table->capacity * 2;
+		liHPackEntry **entries = g_new0(liHPackEntry*, capacity);
+
+		for (i = 0; i < table->count; i++) {
+			entries[i + 1] = hpack_table_get(table, i);
+		}
+		g_free(table->entries);
+		table->entries = entries;
+		table->capacity = capacity;
+		table->first = 1;
+	}
+
+	table->first = (table->first + table->capacity - 1) & (table->capacity - 1);
+	table->entries[table->first] = e;
+	table->count++;
+	table->size += size;
+}
+
+/* 1-based index into static table followed by the dynamic table */
+static gboolean hpack_table_lookup(liHPackTable *table, guint32 ndx, const gchar **name, gsize *name_len, const gchar **value, gsize *value_len) {
+	if (0 == ndx) return FALSE;
+
+	if (ndx <= LI_HPACK_STATIC_TABLE_LEN) {
+		const hpack_static_entry *se = &hpack_static_table[ndx - 1];
+		*name = se->name;
+		*name_len = se->name_len;
+		*value = se->value;
+		*value_len = se->value_len;
+	} else {
+		liHPackEntry *e = hpack_table_get(table, ndx - LI_HPACK_STATIC_TABLE_LEN - 1);
+		if (NULL == e) return FALSE;
+		*name = e->data;
+		*name_len = e->name_len;
+		*value = e->data + e->name_len;
+		*value_len = e->value_len;
+	}
+
+	return TRUE;
+}
+
+/******************
+ *    decoder     *
+ ******************/
+
+void li_hpack_decoder_init(liHPackDecoder *dec, gsize max_size) {
+	hpack_table_init(&dec->table, max_size);
+	dec->max_size_limit = max_size;
+	dec->name = g_string_sized_new(31);
+	dec->value = g_string_sized_new(127);
+}
+
+void li_hpack_decoder_clear(liHPackDecoder *dec) {
+	hpack_table_clear(&dec->table);
+	g_string_free(dec->name, TRUE);
+	g_string_free(dec->value, TRUE);
+	dec->name = dec->value = NULL;
+}
+
+/* integer with a prefix_bits prefix (RFC 7541 5.1); values above 2^28 are rejected */
+static gboolean hpack_decode_int(const guint8 **pdata, const guint8 *end, guint prefix_bits, guint32 *result) {
+	const guint8 *p = *pdata;
+	guint32 max_prefix = (1u << prefix_bits) - 1;
+	guint32 value;
+	guint shift = 0;
+
+	if (p >= end) return FALSE;
+	value = *p++ & max_prefix;
+
+	if (value == max_prefix) {
+		guint8 b;
+		do {
+			if (p >= end || shift > 21) return FALSE;
+			b = *p++;
+			value += (guint32) (b & 0x7f) << shift;
+			shift += 7;
+		} while (b & 0x80);
+	}
+
+	*pdata = p;
+	*result = value;
+	return TRUE;
+}
+
+/* string literal (RFC 7541 5.2); *str points either into the data or into buf (huffman) */
+static gboolean hpack_decode_string(const guint8 **pdata, const guint8 *end, GString *buf, const gchar **str, gsize *str_len) {
+	const guint8 *p = *pdata;
+	gboolean huffman;
+	guint32 len;
+
+	if (p >= end) return FALSE;
+	huffman = (0 != (*p & 0x80));
+	if (!hpack_decode_int(&p, end, 7, &len)) return FALSE;
+	if (len > (gsize) (end - p)) return FALSE;
+
+	if (huffman) {
+		g_string_truncate(buf, 0);
+		if (!li_hpack_huffman_decode(buf, p, len)) return FALSE;
+		*str = buf->str;
+		*str_len = buf->len;
+	} else {
+		*str = (const gchar*) p;
+		*str_len = len;
+	}
+
+	*pdata = p + len;
+	return TRUE;
+}
+
+gboolean li_hpack_decode(liHPackDecoder *dec, const guint8 *data, gsize len, liHPackHeaderCB cb, gpointer context) {
+	const guint8 *p = data, *end = data + len;
+	gboolean fields_seen = FALSE;
+
+	while (p < end) {
+		const gchar *name, *value;
+		gsize name_len, value_len;
+		guint32 ndx;
+		guint8 b = *p;
+
+		if (0x80 == (b & 0x80)) {
+			/* indexed header field */
+			if (!hpack_decode_int(&p, end, 7, &ndx)) return FALSE;
+			if (!hpack_table_lookup(&dec->table, ndx, &name, &name_len, &value, &value_len)) return FALSE;
+			cb(context, name, name_len, value, value_len);
+			fields_seen = TRUE;
+		} else if (0x20 == (b & 0xe0)) {
+			/* dynamic table size update; only allowed at the start of a header block */
+			if (fields_seen) return FALSE;
+			if (!hpack_decode_int(&p, end, 5, &ndx)) return FALSE;
+			if (ndx > dec->max_size_limit) return FALSE;
+			hpack_table_set_max_size(&dec->table, ndx);
+		} else {
+			/* literal header field with incremental indexing (01), without indexing (0000) or never indexed (0001) */
+			gboolean add = (0x40 == (b & 0xc0));
+
+			if (!hpack_decode_int(&p, end, add ? 6 : 4, &ndx)) return FALSE;
+			if (0 == ndx) {
+				if (!hpack_decode_string(&p, end, dec->name, &name, &name_len)) return FALSE;
+			} else {
+				if (!hpack_table_lookup(&dec->table, ndx, &name, &name_len, &value, &value_len)) return FALSE;
+			}
+			if (!hpack_decode_string(&p, end, dec->value, &value, &value_len)) return FALSE;
+
+			cb(context, name, name_len, value, value_len);
+			if (add) hpack_table_add(&dec->table, name, name_len, value, value_len);
+			fields_seen = TRUE;
+		}
+	}
+
+	return TRUE;
+}
+
+/******************
+ *    encoder     *
+ ******************/
+
+void li_hpack_encoder_init(liHPackEncoder *enc) {
+	hpack_table_init(&enc->table, LI_HPACK_DEFAULT_TABLE_SIZE);
+	enc->size_update = FALSE;
+	enc->size_update_min = LI_HPACK_DEFAULT_TABLE_SIZE;
+}
+
+void li_hpack_encoder_clear(liHPackEncoder *enc) {
+	hpack_table_clear(&enc->table);
+}
+
+void li_hpack_encoder_set_max_size(liHPackEncoder *enc, gsize max_size) {
+	max_size = MIN(max_size, LI_HPACK_DEFAULT_TABLE_SIZE);
+	if (max_size == enc->table.max_size) return;
+
+	/* the decoder has to see the smallest size since the last header block to evict the same entries */
+	enc->size_update_min = enc->size_update ? MIN(enc->size_update_min, max_size) : max_size;
+	enc->size_update = TRUE;
+	hpack_table_set_max_size(&enc->table, max_size);
+}
+
+static void hpack_encode_int(GString *dest, guint8 flags, guint prefix_bits, gsize value) {
+	gsize max_prefix = (1u << prefix_bits) - 1;
+
+	if (value < max_prefix) {
+		g_string_append_c(dest, (gchar) (flags | value));
+		return;
+	}
+
+	g_string_append_c(dest, (gchar) (flags | max_prefix));
+	value -= max_prefix;
+	while (value >= 0x80) {
+		g_string_append_c(dest, (gchar) ((value & 0x7f) | 0x80));
+		value >>= 7;
+	}
+	g_string_append_c(dest, (gchar) value);
+}
+
+static void hpack_encode_string(GString *dest, const gchar *str, gsize len) {
+	gsize huffman_len = li_hpack_huffman_length((const guint8*) str, len);
+
+	if (huffman_len < len) {
+		hpack_encode_int(dest, 0x80, 7, huffman_len);
+		li_hpack_huffman_encode(dest, (const guint8*) str, len);
+	} else {
+		hpack_encode_int(dest, 0x00, 7, len);
+		g_string_append_len(dest, str, len);
+	}
+}
+
+void li_hpack_encode_start(liHPackEncoder *enc, GString *dest) {
+	if (!enc->size_update) return;
+
+	if (enc->size_update_min < enc->table.max_size) {
+		hpack_encode_int(dest, 0x20, 5, enc->size_update_min);
+	}
+	hpack_encode_int(dest, 0x20, 5, enc->table.max_size);
+	enc->size_update = FALSE;
+}
+
+#define NAME_IS(x) (name_len == sizeof(x) - 1 && 0 == memcmp(name, x, sizeof(x) - 1))
+
+/* values which are unique per response; adding them would only evict useful entries */
+static gboolean hpack_encode_no_index(const gchar *name, gsize name_len) {
+	return NAME_IS("content-length") || NAME_IS("content-range") || NAME_IS("etag")
+		|| NAME_IS("last-modified") || NAME_IS("location");
+}
+
+/* intermediaries must not compress these either (RFC 7541 7.1.3) */
+static gboolean hpack_encode_never_index(const gchar *name, gsize name_len) {
+	return NAME_IS("set-cookie") || NAME_IS("authorization") || NAME_IS("proxy-authorization");
+}
+
+#undef NAME_IS
+
+void li_hpack_encode(liHPackEncoder *enc, GString *dest, const gchar *name, gsize name_len, const gchar *value, gsize value_len) {
+	guint name_ndx = 0, i;
+	gboolean add = FALSE;
+
+	for (i = 0; i < LI_HPACK_STATIC_TABLE_LEN; i++) {
+		const hpack_static_entry *se = &hpack_static_table[i];
+		if (se->name_len != name_len || 0 != memcmp(se->name, name, name_len)) continue;
+		if (se->value_len == value_len && 0 == memcmp(se->value, value, value_len)) {
+			hpack_encode_int(dest, 0x80, 7, i + 1);
+			return;
+		}
+		if (0 == name_ndx) name_ndx = i + 1;
+	}
+
+	for (i = 0; i < enc->table.count; i++) {
+		liHPackEntry *e = hpack_table_get(&enc->table, i);
+		if (e->name_len != name_len || 0 != memcmp(e->data, name, name_len)) continue;
+		if (e->value_len == value_len && 0 == memcmp(e->data + name_len, value, value_len)) {
+			hpack_encode_int(dest, 0x80, 7, LI_HPACK_STATIC_TABLE_LEN + 1 + i);
+			return;
+		}
+		if (0 == name_ndx) name_ndx = LI_HPACK_STATIC_TABLE_LEN + 1 + i;
+	}
+
+	if (hpack_encode_never_index(name, name_len)) {
+		hpack_encode_int(dest, 0x10, 4, name_ndx);
+	} else if (hpack_encode_no_index(name, name_len)
+	           || name_len + value_len + LI_HPACK_ENTRY_OVERHEAD > enc->table.max_size / 2) {
+		hpack_encode_int(dest, 0x00, 4, name_ndx);
+	} else {
+		hpack_encode_int(dest, 0x40, 6, name_ndx);
+		add = TRUE;
+	}
+
+	if (0 == name_ndx) hpack_encode_string(dest, name, name_len);
+	hpack_encode_string(dest, value, value_len);
+
+	if (add) hpack_table_add(&enc->table, name, name_len, value, value_len);
+}
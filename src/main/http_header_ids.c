@@ -0,0 +1,135 @@
+
+/* generated by contrib/create-http-header-ids.pl - don't edit */
+
+#include <lighttpd/base.h>
+
+#define HTTP_HEADER_MIN_LEN 2
+#define HTTP_HEADER_MAX_LEN 27
+#define HTTP_HEADER_HASH_MASK 255
+
+static const guint8 http_header_asso[128] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 67, 0, 44, 31, 121, 57, 174, 178, 83, 0, 4, 217, 8, 207, 41,
+	198, 0, 67, 55, 220, 61, 234, 39, 73, 241, 0, 0, 0, 0, 0, 0
+};
+
+static const guint8 http_header_hash_table[256] = {
+	5, 49, 0, 0, 0, 0, 41, 0, 0, 29, 42, 32, 0, 51, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 37, 0, 0, 0, 0, 0, 52, 0, 0,
+	0, 0, 59, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 11, 0,
+	24, 0, 0, 53, 16, 0, 0, 12, 0, 28, 0, 10, 0, 0, 30, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 9, 0, 0, 0, 0, 0, 0, 0,
+	0, 36, 0, 0, 0, 0, 0, 0, 46, 0, 0, 0, 0, 0, 0, 64,
+	17, 0, 0, 14, 0, 0, 0, 0, 0, 57, 55, 65, 63, 7, 22, 40,
+	0, 33, 0, 0, 0, 0, 0, 18, 20, 4, 0, 0, 0, 0, 34, 0,
+	6, 0, 31, 60, 0, 0, 0, 23, 0, 0, 0, 0, 61, 0, 0, 0,
+	0, 0, 0, 0, 45, 0, 0, 0, 8, 44, 48, 38, 0, 0, 0, 54,
+	0, 0, 0, 0, 0, 27, 2, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 13, 0, 0, 0, 0, 0, 0,
+	43, 0, 0, 0, 62, 0, 0, 0, 15, 26, 0, 0, 0, 21, 39, 3,
+	0, 0, 0, 0, 0, 0, 0, 0, 0, 35, 25, 0, 56, 47, 0, 0,
+	0, 0, 0, 0, 0, 0, 0, 66, 0, 0, 0, 1, 0, 0, 0, 0,
+	0, 0, 58, 0, 0, 0, 0, 0, 0, 50, 0, 0, 0, 0, 19, 0
+};
+
+static const struct {
+	const gchar *name;
+	guint len;
+} http_header_names[LI_HTTP_HEADER_COUNT] = {
+	{ "", 0 },
+	{ CONST_STR_LEN("accept") },
+	{ CONST_STR_LEN("accept-charset") },
+	{ CONST_STR_LEN("accept-encoding") },
+	{ CONST_STR_LEN("accept-language") },
+	{ CONST_STR_LEN("accept-ranges") },
+	{ CONST_STR_LEN("access-control-allow-origin") },
+	{ CONST_STR_LEN("age") },
+	{ CONST_STR_LEN("allow") },
+	{ CONST_STR_LEN("authorization") },
+	{ CONST_STR_LEN("cache-control") },
+	{ CONST_STR_LEN("connection") },
+	{ CONST_STR_LEN("content-disposition") },
+	{ CONST_STR_LEN("content-encoding") },
+	{ CONST_STR_LEN("content-language") },
+	{ CONST_STR_LEN("content-length") },
+	{ CONST_STR_LEN("content-location") },
+	{ CONST_STR_LEN("content-range") },
+	{ CONST_STR_LEN("content-type") },
+	{ CONST_STR_LEN("cookie") },
+	{ CONST_STR_LEN("date") },
+	{ CONST_STR_LEN("dnt") },
+	{ CONST_STR_LEN("etag") },
+	{ CONST_STR_LEN("expect") },
+	{ CONST_STR_LEN("expires") },
+	{ CONST_STR_LEN("forwarded") },
+	{ CONST_STR_LEN("host") },
+	{ CONST_STR_LEN("http2-settings") },
+	{ CONST_STR_LEN("if-match") },
+	{ CONST_STR_LEN("if-modified-since") },
+	{ CONST_STR_LEN("if-none-match") },
+	{ CONST_STR_LEN("if-range") },
+	{ CONST_STR_LEN("if-unmodified-since") },
+	{ CONST_STR_LEN("keep-alive") },
+	{ CONST_STR_LEN("last-modified") },
+	{ CONST_STR_LEN("location") },
+	{ CONST_STR_LEN("origin") },
+	{ CONST_STR_LEN("pragma") },
+	{ CONST_STR_LEN("priority") },
+	{ CONST_STR_LEN("proxy-connection") },
+	{ CONST_STR_LEN("range") },
+	{ CONST_STR_LEN("referer") },
+	{ CONST_STR_LEN("retry-after") },
+	{ CONST_STR_LEN("sec-ch-ua") },
+	{ CONST_STR_LEN("sec-ch-ua-mobile") },
+	{ CONST_STR_LEN("sec-ch-ua-platform") },
+	{ CONST_STR_LEN("sec-fetch-dest") },
+	{ CONST_STR_LEN("sec-fetch-mode") },
+	{ CONST_STR_LEN("sec-fetch-site") },
+	{ CONST_STR_LEN("sec-fetch-user") },
+	{ CONST_STR_LEN("server") },
+	{ CONST_STR_LEN("set-cookie") },
+	{ CONST_STR_LEN("strict-transport-security") },
+	{ CONST_STR_LEN("te") },
+	{ CONST_STR_LEN("trailer") },
+	{ CONST_STR_LEN("transfer-encoding") },
+	{ CONST_STR_LEN("upgrade") },
+	{ CONST_STR_LEN("upgrade-insecure-requests") },
+	{ CONST_STR_LEN("user-agent") },
+	{ CONST_STR_LEN("vary") },
+	{ CONST_STR_LEN("via") },
+	{ CONST_STR_LEN("www-authenticate") },
+	{ CONST_STR_LEN("x-forwarded-for") },
+	{ CONST_STR_LEN("x-forwarded-host") },
+	{ CONST_STR_LEN("x-forwarded-proto") },
+	{ CONST_STR_LEN("x-real-ip") },
+	{ CONST_STR_LEN("x-requested-with") },
+};
+
+#define HTTP_HEADER_CHAR(c) (((guchar) (c) | 0x20) & 0x7f)
+
+liHttpHeaderId li_http_header_id(const gchar *key, size_t keylen) {
+	guint id;
+
+	if (keylen < HTTP_HEADER_MIN_LEN || keylen > HTTP_HEADER_MAX_LEN) return LI_HTTP_HEADER_UNKNOWN;
+
+	id = http_header_hash_table[(keylen
+		+ http_header_asso[HTTP_HEADER_CHAR(key[0])]
+		+ http_header_asso[HTTP_HEADER_CHAR(key[keylen - 2])]
+		+ http_header_asso[HTTP_HEADER_CHAR(key[keylen - 1])]) & HTTP_HEADER_HASH_MASK];
+
+	if (0 == id || http_header_names[id].len != keylen || 0 != g_ascii_strncasecmp(key, http_header_names[id].name, keylen)) {
+		return LI_HTTP_HEADER_UNKNOWN;
+	}
+	return (liHttpHeaderId) id;
+}
+
+const gchar* li_http_header_id_name(liHttpHeaderId id, guint *len) {
+	if ((guint) id >= LI_HTTP_HEADER_COUNT) id = LI_HTTP_HEADER_UNKNOWN;
+	if (NULL != len) *len = http_header_names[id].len;
+	return http_header_names[id].name;
+}
@@ -1,12 +1,25 @@
 
 #include <lighttpd/base.h>
 
-static void _http_header_free(gpointer p) {
-	liHttpHeader *h = (liHttpHeader*) p;
+/* removed headers are kept for reuse by the same liHttpHeaders (request/response headers of a vrequest),
+ * so keep-alive requests don't allocate anything for their headers; large values are not kept.
+ */
+#define HTTP_HEADERS_MAX_UNUSED 64
+#define HTTP_HEADER_MAX_REUSE_SIZE 1024
+
+static void _http_header_free(liHttpHeader *h) {
 	g_string_free(h->data, TRUE);
 	g_slice_free(liHttpHeader, h);
 }
 
+static void _http_header_release(liHttpHeaders *headers, liHttpHeader *h) {
+	if (headers->unused.length >= HTTP_HEADERS_MAX_UNUSED || h->data->allocated_len > HTTP_HEADER_MAX_REUSE_SIZE) {
+		_http_header_free(h);
+	} else {
+		g_queue_push_tail_link(&headers->unused, &h->link);
+	}
+}
+
 /* remove folding */
 static void _http_header_sanitize(liHttpHeader *h) {
 	guint i, j, len = h->data->len;
@@ -46,12 +59,21 @@ cleanup:
 	g_string_truncate(h->data, j);
 }
 
-static liHttpHeader* _http_header_new(const gchar *key, size_t keylen, const gchar *val, size_t valuelen) {
-	liHttpHeader *h = g_slice_new0(liHttpHeader);
+static liHttpHeader* _http_header_new(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen) {
+	GList *l = g_queue_pop_head_link(&headers->unused);
+	liHttpHeader *h;
 	gchar *s;
-	h->data = g_string_sized_new(keylen + valuelen + 2);
+
+	if (NULL != l) {
+		h = (liHttpHeader*) l->data;
+	} else {
+		h = g_slice_new0(liHttpHeader);
+		h->link.data = h;
+		h->data = g_string_sized_new(keylen + valuelen + 2);
+	}
 	g_string_set_size(h->data, keylen + valuelen + 2);
 	h->keylen = keylen;
+	h->id = li_http_header_id(key, keylen);
 	s = h->data->str;
 	memcpy(s, key, keylen);
 	s += keylen;
@@ -62,63 +84,121 @@ static liHttpHeader* _http_header_new(const gchar *key, size_t keylen, const gch
 	return h;
 }
 
-static void _header_queue_free(gpointer data, gpointer userdata) {
-	UNUSED(userdata);
-	_http_header_free((liHttpHeader*) data);
+static void _http_header_index_add(liHttpHeaders *headers, liHttpHeader *h) {
+	if (LI_HTTP_HEADER_UNKNOWN == h->id) return;
+	/* new headers are always appended: only the first one of an id gets indexed */
+	if (0 == headers->id_count[h->id]++) headers->id_first[h->id] = &h->link;
+}
+
+static void _http_header_index_remove(liHttpHeaders *headers, liHttpHeader *h) {
+	if (LI_HTTP_HEADER_UNKNOWN == h->id) return;
+	if (headers->id_first[h->id] == &h->link) headers->id_first[h->id] = li_http_header_find_next_id(&h->link, h->id);
+	headers->id_count[h->id]--;
 }
 
 liHttpHeaders* li_http_headers_new(void) {
 	liHttpHeaders* headers = g_slice_new0(liHttpHeaders);
 	g_queue_init(&headers->entries);
+	g_queue_init(&headers->unused);
 	return headers;
 }
 
 void li_http_headers_reset(liHttpHeaders* headers) {
-	g_queue_foreach(&headers->entries, _header_queue_free, NULL);
-	g_queue_clear(&headers->entries);
+	GList *l;
+
+	while (NULL != (l = g_queue_pop_head_link(&headers->entries))) {
+		_http_header_release(headers, (liHttpHeader*) l->data);
+	}
+	memset(headers->id_first, 0, sizeof(headers->id_first));
+	memset(headers->id_count, 0, sizeof(headers->id_count));
+	headers->version++;
 }
 
 void li_http_headers_free(liHttpHeaders* headers) {
+	GList *l;
+
 	if (!headers) return;
-	g_queue_foreach(&headers->entries, _header_queue_free, NULL);
-	g_queue_clear(&headers->entries);
+	while (NULL != (l = g_queue_pop_head_link(&headers->entries))) {
+		_http_header_free((liHttpHeader*) l->data);
+	}
+	while (NULL != (l = g_queue_pop_head_link(&headers->unused))) {
+		_http_header_free((liHttpHeader*) l->data);
+	}
 	g_slice_free(liHttpHeaders, headers);
 }
 
 /** just insert normal header, allow duplicates */
 void li_http_header_insert(liHttpHeaders *headers, const gchar *key, size_t keylen, const gchar *val, size_t valuelen) {
-	liHttpHeader *h = _http_header_new(key, keylen, val, valuelen);
-	g_queue_push_tail(&headers->entries, h);
+	liHttpHeader *h = _http_header_new(headers, key, keylen, val, valuelen);
+	g_queue_push_tail_link(&headers->entries, &h->link);
+	_http_header_index_add(headers, h);
+	headers->version++;
+}
+
+GList* li_http_header_find_next_id(GList *l, liHttpHeaderId id) {
+	for (l = g_list_next(l); l; l = g_list_next(l)) {
+		if (((liHttpHeader*) l->data)->id == id) return l;
+	}
+	return NULL;
+}
+
+GList* li_http_header_find_last_id(liHttpHeaders *headers, liHttpHeaderId id) {
+	GList *l;
+
+	switch (li_http_header_count_id(headers, id)) {
+	case 0: return NULL;
+	case 1: return headers->id_first[id];
+	}
+
+	for (l = g_queue_peek_tail_link(&headers->entries); l; l = g_list_previous(l)) {
+		if (((liHttpHeader*) l->data)->id == id) return l;
+	}
+	return NULL;
 }
 
+liHttpHeader* li_http_header_lookup_id(liHttpHeaders *headers, liHttpHeaderId id) {
+	GList *l = li_http_header_find_last_id(headers, id);
+	return NULL == l ? NULL : (liHttpHeader*) l->data;
+}
+
+/* headers with a well-known name are found by id; names without an id only have to be compared with the unknown headers */
 GList* li_http_header_find_first(liHttpHeaders *headers, const gchar *key, size_t keylen) {
+	liHttpHeaderId id = li_http_header_id(key, keylen);
 	liHttpHeader *h;
 	GList *l;
 
+	if (LI_HTTP_HEADER_UNKNOWN != id) return li_http_header_find_first_id(headers, id);
+
 	for (l = g_queue_peek_head_link(&headers->entries); l; l = g_list_next(l)) {
 		h = (liHttpHeader*) l->data;
-		if (h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
+		if (LI_HTTP_HEADER_UNKNOWN == h->id && h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
 	}
 	return NULL;
 }
 
 GList* li_http_header_find_next(GList *l, const gchar *key, size_t keylen) {
+	liHttpHeaderId id = li_http_header_id(key, keylen);
 	liHttpHeader *h;
 
+	if (LI_HTTP_HEADER_UNKNOWN != id) return li_http_header_find_next_id(l, id);
+
 	for (l = g_list_next(l); l; l = g_list_next(l)) {
 		h = (liHttpHeader*) l->data;
-		if (h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
+		if (LI_HTTP_HEADER_UNKNOWN == h->id && h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
 	}
 	return NULL;
 }
 
 GList* li_http_header_find_last(liHttpHeaders *headers, const gchar *key, size_t keylen) {
+	liHttpHeaderId id = li_http_header_id(key, keylen);
 	liHttpHeader *h;
 	GList *l;
 
+	if (LI_HTTP_HEADER_UNKNOWN != id) return li_http_header_find_last_id(headers, id);
+
 	for (l = g_queue_peek_tail_link(&headers->entries); l; l = g_list_previous(l)) {
 		h = (liHttpHeader*) l->data;
-		if (h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
+		if (LI_HTTP_HEADER_UNKNOWN == h->id && h->keylen == keylen && 0 == g_ascii_strncasecmp(key, h->data->str, keylen)) return l;
 	}
 	return NULL;
 }
@@ -140,6 +220,7 @@ void li_http_header_append(liHttpHeaders *headers, const gchar *key, size_t keyl
 		s = h->data->str + oldlen;
 		memcpy(s, ", ", 2);
 		memcpy(s+2, val, valuelen);
+		headers->version++;
 	}
 }
 
@@ -156,12 +237,17 @@ void li_http_header_overwrite(liHttpHeaders *headers, const gchar *key, size_t k
 		g_string_set_size(h->data, keylen + 2 + valuelen);
 		/* only overwrite value */
 		memcpy(h->data->str + keylen + 2, val, valuelen);
+		headers->version++;
 	}
 }
 
 void li_http_header_remove_link(liHttpHeaders *headers, GList *l) {
-	_http_header_free(l->data);
-	g_queue_delete_link(&headers->entries, l);
+	liHttpHeader *h = (liHttpHeader*) l->data;
+
+	_http_header_index_remove(headers, h);
+	g_queue_unlink(&headers->entries, l);
+	_http_header_release(headers, h);
+	headers->version++;
 }
 
 gboolean li_http_header_remove(liHttpHeaders *headers, const gchar *key, size_t keylen) {
@@ -291,3 +377,76 @@ quoted:
 	}
 	return FALSE; /* no terminating quote found */
 }
+
+/* q-value in 1/1000; invalid values are ignored (1000) */
+static gint http_header_parse_qvalue(const gchar **ps, const gchar *end) {
+	const gchar *s = *ps;
+	gint q = 1000, scale = 100;
+
+	if (s < end && '0' == *s) {
+		q = 0;
+		s++;
+		if (s < end && '.' == *s) {
+			for (s++; s < end && g_ascii_isdigit(*s); s++) {
+				q += (*s - '0') * scale;
+				scale /= 10;
+			}
+		}
+	} else if (s < end && '1' == *s) {
+		s++;
+		if (s < end && '.' == *s) for (s++; s < end && g_ascii_isdigit(*s); s++) ;
+	}
+
+	*ps = s;
+	return q;
+}
+
+void li_http_header_parse_qvalues(liHttpHeaders *headers, liHttpHeaderId id, const gchar * const *names, gint *q, gint *q_star) {
+	GList *l;
+	guint i;
+
+	for (i = 0; NULL != names[i]; i++) q[i] = -1;
+	*q_star = -1;
+
+	for (l = li_http_header_find_first_id(headers, id); NULL != l; l = li_http_header_find_next_id(l, id)) {
+		liHttpHeader *h = (liHttpHeader*) l->data;
+		const gchar *s = LI_HEADER_VALUE(h), *end = h->data->str + h->data->len;
+
+		while (s < end) {
+			const gchar *name;
+			gsize namelen;
+			gint qv = 1000;
+
+			while (s < end && (' ' == *s || '\t' == *s || ',' == *s)) s++;
+			if (s >= end) break;
+
+			name = s;
+			while (s < end && ',' != *s && ';' != *s && ' ' != *s && '\t' != *s) s++;
+			namelen = s - name;
+
+			/* parameters */
+			while (s < end && ',' != *s) {
+				if (';' == *s) {
+					for (s++; s < end && (' ' == *s || '\t' == *s); s++) ;
+					if (s + 1 < end && ('q' == *s || 'Q' == *s) && '=' == s[1]) {
+						s += 2;
+						qv = http_header_parse_qvalue(&s, end);
+					}
+					continue;
+				}
+				s++;
+			}
+
+			if (1 == namelen && '*' == *name) {
+				*q_star = qv;
+				continue;
+			}
+			for (i = 0; NULL != names[i]; i++) {
+				if (strlen(names[i]) == namelen && 0 == g_ascii_strncasecmp(name, names[i], namelen)) {
+					q[i] = qv;
+					break;
+				}
+			}
+		}
+	}
+}
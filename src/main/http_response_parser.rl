@@ -23,14 +23,10 @@
 	action status {
 		getStringTo(fpc, ctx->h_value);
 		ctx->response->http_status = atoi(ctx->h_value->str);
-		switch (ctx->response->http_status) {
-		case 100: /* Continue */
-		case 102: /* Processing */
+		/* skip interim responses (100 Continue, 102 Processing, 103 Early Hints, ...);
+		 * don't ignore 101 Switching Protocols */
+		if (ctx->response->http_status >= 100 && ctx->response->http_status < 200 && 101 != ctx->response->http_status) {
 			ctx->drop_header = TRUE;
-			break;
-			/* don't ignore 101 Switching Protocols */
-		default:
-			break;
 		}
 	}
 
@@ -95,13 +91,13 @@
 	Quoted_String   = DQUOTE ( QDText | Quoted_Pair )* DQUOTE;
 
 	HTTP_Version = (
-		  "HTTP/1.0"  %{ ctx->response->http_version = LI_HTTP_VERSION_1_0; }
-		| "HTTP/1.1"  %{ ctx->response->http_version = LI_HTTP_VERSION_1_1; }
-		| "HTTP" "/" DIGIT+ "." DIGIT+ ) >{ ctx->response->http_version = LI_HTTP_VERSION_UNSET; };
+		  "HTTP/1.0"  %{ ctx->http_version = LI_HTTP_VERSION_1_0; }
+		| "HTTP/1.1"  %{ ctx->http_version = LI_HTTP_VERSION_1_1; }
+		| "HTTP" "/" DIGIT+ "." DIGIT+ ) >{ ctx->http_version = LI_HTTP_VERSION_UNSET; };
 	#HTTP_URL = "http:" "//" Host ( ":" Port )? ( abs_path ( "?" query )? )?;
 
 	Status = (digit digit digit) >mark %status;
-	Response_Line = "HTTP/" digit+ "." digit+ SP Status SP (any - CTL - CR - LF)* CRLF;
+	Response_Line = HTTP_Version SP Status SP (any - CTL - CR - LF)* CRLF;
 
 	# Field_Content = ( TEXT+ | ( Token | Separators | Quoted_String )+ );
 	Field_Content = ( (OCTET - CTL - DQUOTE) | SP | HT | Quoted_String )+;
@@ -127,6 +123,7 @@ void li_http_response_parser_init(liHttpResponseCtx* ctx, liResponse *req, liChu
 	ctx->accept_cgi = accept_cgi;
 	ctx->accept_nph = accept_nph;
 	ctx->drop_header = FALSE;
+	ctx->http_version = LI_HTTP_VERSION_UNSET;
 	ctx->h_key = g_string_sized_new(0);
 	ctx->h_value = g_string_sized_new(0);
 
@@ -139,6 +136,7 @@ void li_http_response_parser_reset(liHttpResponseCtx* ctx) {
 	g_string_truncate(ctx->h_key, 0);
 	g_string_truncate(ctx->h_value, 0);
 	ctx->drop_header = FALSE;
+	ctx->http_version = LI_HTTP_VERSION_UNSET;
 
 	%% write init;
 }
@@ -40,42 +40,119 @@ ssize_t li_net_read(int fd, void *buf, ssize_t nbyte) {
 	return r;
 }
 
-liNetworkStatus li_network_write(int fd, liChunkQueue *cq, goffset write_max, GError **err) {
+gboolean li_network_backend_from_string(const gchar *str, liNetworkBackend *backend) {
+	if (0 == strcmp(str, "auto")) {
+		*backend = LI_NETWORK_BACKEND_AUTO;
+#ifdef USE_SENDFILE
+	} else if (0 == strcmp(str, "sendfile")) {
+		*backend = LI_NETWORK_BACKEND_SENDFILE;
+#endif
+	} else if (0 == strcmp(str, "writev")) {
+		*backend = LI_NETWORK_BACKEND_WRITEV;
+	} else if (0 == strcmp(str, "write")) {
+		*backend = LI_NETWORK_BACKEND_WRITE;
+#ifdef HAVE_LIBURING
+	} else if (0 == strcmp(str, "io_uring")) {
+		*backend = LI_NETWORK_BACKEND_IO_URING;
+#endif
+	} else {
+		return FALSE;
+	}
+	return TRUE;
+}
+
+#ifdef TCP_CORK
+/* whether the writev backend sends everything it may send now with a single writev(): the data starts
+ * with memory chunks and only contains memory chunks and small file ranges (see li_network_backend_writev);
+ * corking only adds two syscalls then
+ */
+static gboolean network_write_single_call(liChunkQueue *cq, goffset write_max, liNetworkBackend backend) {
+	/* don't look too far; long queues need several calls anyway */
+	static const guint max_chunks = 64;
+	liChunkIter ci;
+	liChunk *c;
+	guint n = 0;
+
+	if (LI_NETWORK_BACKEND_WRITE == backend) return FALSE;
+
+	ci = li_chunkqueue_iter(cq);
+	c = li_chunkiter_chunk(ci);
+	if (STRING_CHUNK != c->type && MEM_CHUNK != c->type && BUFFER_CHUNK != c->type) return FALSE;
+
+	do {
+		c = li_chunkiter_chunk(ci);
+		if (++n > max_chunks) return FALSE;
+		switch (c->type) {
+		case STRING_CHUNK:
+		case MEM_CHUNK:
+		case BUFFER_CHUNK:
+			break;
+		case FILE_CHUNK:
+			if (li_chunk_length(c) > LI_NETWORK_WRITEV_FILE_MAX) return FALSE;
+			break;
+		default:
+			return FALSE;
+		}
+		write_max -= li_chunk_length(c);
+	} while (write_max > 0 && li_chunkiter_next(&ci));
+
+	return TRUE;
+}
+#endif
+
+liNetworkStatus li_network_write(int fd, liChunkQueue *cq, goffset write_max, liNetworkBackend backend, guint64 *syscalls, GError **err) {
 	liNetworkStatus res;
+	guint calls = 0;
 #ifdef TCP_CORK
 	int corked = 0;
 #endif
 
 #ifdef TCP_CORK
 	/* Linux: put a cork into the socket as we want to combine the write() calls
-	 * but only if we really have multiple chunks
+	 * but only if we really have multiple chunks which need more than one call
 	 */
-	if (cq->queue.length > 1) {
+	if (cq->queue.length > 1 && !network_write_single_call(cq, write_max, backend)) {
 		corked = 1;
 		setsockopt(fd, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+		calls++;
 	}
 #endif
 
-	/* TODO: add setup-option to select the backend */
+	switch (backend) {
+	case LI_NETWORK_BACKEND_WRITE:
+		res = li_network_backend_write(fd, cq, &write_max, &calls, err);
+		break;
+	case LI_NETWORK_BACKEND_WRITEV:
+		res = li_network_write_writev(fd, cq, &write_max, &calls, err);
+		break;
+	case LI_NETWORK_BACKEND_SENDFILE:
+	case LI_NETWORK_BACKEND_IO_URING: /* for data li_network_uring_write doesn't take */
+	case LI_NETWORK_BACKEND_AUTO:
+	default:
 #ifdef USE_SENDFILE
-	res = li_network_write_sendfile(fd, cq, &write_max, err);
+		res = li_network_write_sendfile(fd, cq, &write_max, &calls, err);
 #else
-	res = li_network_write_writev(fd, cq, &write_max, err);
+		res = li_network_write_writev(fd, cq, &write_max, &calls, err);
 #endif
+		break;
+	}
 
 #ifdef TCP_CORK
 	if (corked) {
 		corked = 0;
 		setsockopt(fd, IPPROTO_TCP, TCP_CORK, &corked, sizeof(corked));
+		calls++;
 	}
 #endif
 
+	if (NULL != syscalls) *syscalls += calls;
+
 	return res;
 }
 
 liNetworkStatus li_network_read(int fd, liChunkQueue *cq, goffset read_max, liBuffer **buffer, GError **err) {
 	const ssize_t blocksize = 16*1024; /* 16k */
-	ssize_t r;
+	ssize_t r, want;
 	off_t len = 0;
 
 	if (cq->limit && cq->limit->limit > 0) {
@@ -128,7 +205,8 @@ liNetworkStatus li_network_read(int fd, liChunkQueue *cq, goffset read_max, liBu
 			}
 		}
 
-		if (-1 == (r = li_net_read(fd, buf->addr + buf->used, buf->alloc_size - buf->used))) {
+		want = buf->alloc_size - buf->used;
+		if (-1 == (r = li_net_read(fd, buf->addr + buf->used, want))) {
 			if (buffer == NULL && !cq_buf_append) li_buffer_release(buf);
 			switch (errno) {
 			case EAGAIN:
@@ -166,7 +244,53 @@ liNetworkStatus li_network_read(int fd, liChunkQueue *cq, goffset read_max, liBu
 			}
 		}
 		len += r;
-	} while (r == blocksize && len < read_max);
+		/* a short read means the socket is empty; don't wait for the next loop iteration
+		 * only because the data didn't fit into the remaining space of a buffer */
+	} while (r == want && len < read_max);
+
+	return LI_NETWORK_STATUS_SUCCESS;
+}
+
+liNetworkStatus li_network_read_splice(int fd, liChunkQueue *cq, goffset read_max, liChunkPipe *cp, liBuffer **buffer, GError **err) {
+#ifdef USE_SPLICE
+	goffset len = (NULL != cp) ? li_chunkqueue_pipe_space(cq, cp) : 0;
+	ssize_t r;
+
+	if (len > read_max) len = read_max;
+	if (len <= 0) goto read_buffered;
+
+	while (-1 == (r = splice(fd, NULL, cp->fd[1], NULL, len, SPLICE_F_MOVE | SPLICE_F_NONBLOCK))) {
+		switch (errno) {
+		case EINTR:
+			break; /* try again */
+		case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+		case EWOULDBLOCK:
+#endif
+			/* socket is empty; or the pipe is full (it can run out of slots
+			 * before cp->size is reached) - let read() find out */
+			if (0 == cp->length) return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+			goto read_buffered;
+		case ECONNRESET:
+		case ETIMEDOUT:
+			return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+		case EINVAL:
+		case ENOSYS:
+			/* not supported for this fd */
+			goto read_buffered;
+		default:
+			g_set_error(err, LI_NETWORK_ERROR, 0, "li_network_read_splice: oops, splice from fd=%d failed: %s", fd, g_strerror(errno) );
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+	}
+	if (0 == r) return LI_NETWORK_STATUS_CONNECTION_CLOSE;
 
+	li_chunkqueue_append_pipe(cq, cp, r);
 	return LI_NETWORK_STATUS_SUCCESS;
+
+read_buffered:
+#else
+	UNUSED(cp);
+#endif
+	return li_network_read(fd, cq, read_max, buffer, err);
 }
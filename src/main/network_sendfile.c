@@ -151,7 +151,7 @@ static network_sendfile_result lighty_sendfile(int fd, int filefd, goffset offse
 
 
 /* first chunk must be a FILE_CHUNK ! */
-static liNetworkStatus network_backend_sendfile(int fd, liChunkQueue *cq, goffset *write_max, GError **err) {
+static liNetworkStatus network_backend_sendfile(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
 	off_t file_offset, toSend;
 	ssize_t r;
 	gboolean did_write_something = FALSE;
@@ -179,6 +179,7 @@ static liNetworkStatus network_backend_sendfile(int fd, liChunkQueue *cq, goffse
 		if (toSend > *write_max) toSend = *write_max;
 
 		r = 0;
+		(*syscalls)++;
 		switch (lighty_sendfile(fd, c->data.file.file->fd, file_offset, toSend, &r, err)) {
 		case NSR_SUCCESS:
 			li_chunkqueue_skip(cq, r);
@@ -218,7 +219,7 @@ static liNetworkStatus network_backend_sendfile(int fd, liChunkQueue *cq, goffse
 	return LI_NETWORK_STATUS_SUCCESS;
 }
 
-liNetworkStatus li_network_write_sendfile(int fd, liChunkQueue *cq, goffset *write_max, GError **err) {
+liNetworkStatus li_network_write_sendfile(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
 	if (cq->length == 0) return LI_NETWORK_STATUS_FATAL_ERROR;
 
 	do {
@@ -231,6 +232,9 @@ liNetworkStatus li_network_write_sendfile(int fd, liChunkQueue *cq, goffset *wri
 		case FILE_CHUNK:
 			LI_NETWORK_FALLBACK(network_backend_sendfile, write_max);
 			break;
+		case PIPE_CHUNK:
+			LI_NETWORK_FALLBACK(li_network_backend_splice, write_max);
+			break;
 		default:
 			return LI_NETWORK_STATUS_FATAL_ERROR;
 		}
@@ -0,0 +1,68 @@
+#include <lighttpd/base.h>
+
+/* first chunk must be a PIPE_CHUNK ! */
+liNetworkStatus li_network_backend_splice(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
+#ifdef USE_SPLICE
+	off_t toSend;
+	ssize_t r;
+	gboolean did_write_something = FALSE;
+	liChunk *c;
+
+	if (0 == cq->length) return LI_NETWORK_STATUS_FATAL_ERROR;
+
+	do {
+		if (PIPE_CHUNK != (c = li_chunkqueue_first_chunk(cq))->type) {
+			return did_write_something ? LI_NETWORK_STATUS_SUCCESS : LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+
+		if (NULL != c->mem) {
+			/* data was already read from the pipe */
+			LI_NETWORK_FALLBACK(li_network_backend_write, write_max);
+			return LI_NETWORK_STATUS_SUCCESS;
+		}
+
+		toSend = li_chunk_length(c);
+		if (toSend > *write_max) toSend = *write_max;
+
+		(*syscalls)++;
+		while (-1 == (r = splice(c->data.pipe.pipe->fd[0], NULL, fd, NULL, toSend, SPLICE_F_MOVE | SPLICE_F_NONBLOCK))) {
+			switch (errno) {
+			case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+			case EWOULDBLOCK:
+#endif
+				return did_write_something ? LI_NETWORK_STATUS_SUCCESS : LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+			case ECONNRESET:
+			case EPIPE:
+			case ETIMEDOUT:
+				return LI_NETWORK_STATUS_CONNECTION_CLOSE;
+			case EINTR:
+				break; /* try again */
+			case EINVAL:
+			case ENOSYS:
+				LI_NETWORK_FALLBACK(li_network_backend_write, write_max);
+				return LI_NETWORK_STATUS_SUCCESS;
+			default:
+				g_set_error(err, LI_NETWORK_ERROR, 0, "li_network_backend_splice: oops, write to fd=%d failed: %s", fd, g_strerror(errno));
+				return LI_NETWORK_STATUS_FATAL_ERROR;
+			}
+		}
+		if (0 == r) {
+			g_set_error(err, LI_NETWORK_ERROR, 0, "li_network_backend_splice: pipe is empty");
+			return LI_NETWORK_STATUS_FATAL_ERROR;
+		}
+
+		li_chunkqueue_skip_spliced(cq, r);
+		*write_max -= r;
+		did_write_something = TRUE;
+
+		if (0 == cq->length) return LI_NETWORK_STATUS_SUCCESS;
+		if (r != toSend) return LI_NETWORK_STATUS_WAIT_FOR_EVENT;
+	} while (*write_max > 0);
+
+	return LI_NETWORK_STATUS_SUCCESS;
+#else
+	/* li_chunkpipe_new() doesn't create pipes without splice(), but reading works anyway */
+	return li_network_backend_write(fd, cq, write_max, syscalls, err);
+#endif
+}
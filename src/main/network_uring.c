@@ -0,0 +1,276 @@
+
+#include <lighttpd/base.h>
+#include <lighttpd/throttle.h>
+
+#ifdef HAVE_LIBURING
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+#include <sys/uio.h>
+
+#define NETWORK_URING_ENTRIES 256
+#define NETWORK_URING_MAX_IOV 64
+
+struct liNetworkUring {
+	liWorker *wrk;
+	gboolean ok; /* FALSE if the ring couldn't be set up; li_network_write is used then */
+
+	struct io_uring ring;
+	liEventIO eventfd_watcher; /* the kernel signals completions on the eventfd */
+
+	GQueue writes; /* network_uring_write in flight */
+};
+
+typedef struct network_uring_write network_uring_write;
+struct network_uring_write {
+	liNetworkUring *uring;
+	liIOStream *stream;
+
+	/* the data in flight: references to the buffers and copies of strings from the stream queue,
+	 * which may get reset while the kernel still reads the data */
+	liChunkQueue *cq;
+	struct iovec iov[NETWORK_URING_MAX_IOV];
+	guint iovcnt;
+
+	GList link;
+};
+
+static void network_uring_write_done(network_uring_write *w, int res) {
+	liNetworkUring *uring = w->uring;
+	liIOStream *stream = w->stream;
+
+	g_queue_unlink(&uring->writes, &w->link);
+	stream->uring_write = NULL;
+
+	if (-1 != li_event_io_fd(&stream->io_watcher) && !stream->out_closed && NULL != stream->stream_out.out) {
+		if (res >= 0) {
+			li_chunkqueue_skip(stream->stream_out.out, res);
+			if (NULL != stream->throttle_out) li_throttle_update(stream->throttle_out, res);
+
+			stream->throttled_out = FALSE;
+			stream->can_write = TRUE;
+			li_stream_again_later(&stream->stream_out);
+		} else {
+			switch (-res) {
+			case EAGAIN:
+			case EINTR:
+				stream->throttled_out = FALSE;
+				stream->can_write = TRUE;
+				li_stream_again_later(&stream->stream_out);
+				break;
+			case ECONNRESET:
+			case EPIPE:
+			case ETIMEDOUT:
+			case ECANCELED:
+				li_stream_simple_socket_close(stream, TRUE);
+				break;
+			default:
+				ERROR(uring->wrk->srv, "io_uring write to fd=%d failed: %s", li_event_io_fd(&stream->io_watcher), g_strerror(-res));
+				li_stream_simple_socket_close(stream, TRUE);
+				break;
+			}
+		}
+	}
+	/* else: the socket is gone, drop the data */
+
+	li_chunkqueue_free(w->cq);
+	g_slice_free(network_uring_write, w);
+	li_iostream_release(stream);
+}
+
+static void network_uring_reap(liNetworkUring *uring) {
+	struct io_uring_cqe *cqe;
+
+	while (0 == io_uring_peek_cqe(&uring->ring, &cqe)) {
+		network_uring_write *w = io_uring_cqe_get_data(cqe);
+		int res = cqe->res;
+
+		io_uring_cqe_seen(&uring->ring, cqe);
+
+		/* cancel requests have no data */
+		if (NULL != w) network_uring_write_done(w, res);
+	}
+}
+
+static void network_uring_eventfd_cb(liEventBase *watcher, int events) {
+	liNetworkUring *uring = LI_CONTAINER_OF(li_event_io_from(watcher), liNetworkUring, eventfd_watcher);
+	eventfd_t value;
+	UNUSED(events);
+
+	/* reset the counter; the completion queue is the actual state */
+	while (-1 == eventfd_read(li_event_io_fd(&uring->eventfd_watcher), &value) && EINTR == errno) ;
+
+	network_uring_reap(uring);
+}
+
+static liNetworkUring* network_uring_new(liWorker *wrk) {
+	liNetworkUring *uring = g_slice_new0(liNetworkUring);
+	int efd, r;
+
+	uring->wrk = wrk;
+	g_queue_init(&uring->writes);
+	li_event_io_init(&wrk->loop, "io_uring", &uring->eventfd_watcher, network_uring_eventfd_cb, -1, LI_EV_READ);
+	li_event_set_keep_loop_alive(&uring->eventfd_watcher, FALSE);
+
+	if (0 > (r = io_uring_queue_init(NETWORK_URING_ENTRIES, &uring->ring, 0))) {
+		ERROR(wrk->srv, "io_uring_queue_init failed: %s; using the default network backend", g_strerror(-r));
+		return uring;
+	}
+
+	if (-1 == (efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))) {
+		ERROR(wrk->srv, "eventfd failed: %s; using the default network backend", g_strerror(errno));
+		io_uring_queue_exit(&uring->ring);
+		return uring;
+	}
+
+	if (0 > (r = io_uring_register_eventfd(&uring->ring, efd))) {
+		ERROR(wrk->srv, "io_uring_register_eventfd failed: %s; using the default network backend", g_strerror(-r));
+		close(efd);
+		io_uring_queue_exit(&uring->ring);
+		return uring;
+	}
+
+	li_event_io_set_fd(&uring->eventfd_watcher, efd);
+	li_event_start(&uring->eventfd_watcher);
+	uring->ok = TRUE;
+
+	return uring;
+}
+
+gboolean li_network_uring_write(liIOStream *stream, goffset write_max) {
+	liWorker *wrk = li_worker_from_iostream(stream);
+	liChunkQueue *cq = stream->stream_out.out;
+	int fd = li_event_io_fd(&stream->io_watcher);
+	network_uring_write *w;
+	struct io_uring_sqe *sqe;
+	liChunkIter ci;
+	liChunk *c;
+	goffset we_have = 0;
+	int r;
+
+	if (NULL != stream->uring_write) {
+		/* wait for the write in flight */
+		stream->throttled_out = TRUE;
+		return TRUE;
+	}
+
+	if (-1 == fd || 0 == cq->length) return FALSE;
+
+	c = li_chunkiter_chunk(li_chunkqueue_iter(cq));
+	if (STRING_CHUNK != c->type && MEM_CHUNK != c->type && BUFFER_CHUNK != c->type) return FALSE;
+
+	if (NULL == wrk->network_uring) wrk->network_uring = network_uring_new(wrk);
+	if (!wrk->network_uring->ok) return FALSE;
+
+	/* keep the completions of all writes in flight within the completion queue (twice the size of the submission queue) */
+	if (wrk->network_uring->writes.length >= NETWORK_URING_ENTRIES) return FALSE;
+
+	if (NULL == (sqe = io_uring_get_sqe(&wrk->network_uring->ring))) return FALSE;
+
+	w = g_slice_new0(network_uring_write);
+	w->uring = wrk->network_uring;
+	w->stream = stream;
+	w->cq = li_chunkqueue_new();
+	w->link.data = w;
+
+	ci = li_chunkqueue_iter(cq);
+	do {
+		off_t len;
+
+		c = li_chunkiter_chunk(ci);
+		if (STRING_CHUNK != c->type && MEM_CHUNK != c->type && BUFFER_CHUNK != c->type) break;
+
+		len = li_chunk_length(c);
+		if (len > write_max - we_have) len = write_max - we_have;
+
+		switch (c->type) {
+		case STRING_CHUNK:
+			li_chunkqueue_append_mem(w->cq, c->data.str->str + c->offset, len);
+			break;
+		case MEM_CHUNK:
+			li_chunkqueue_append_mem(w->cq, c->mem->data + c->offset, len);
+			break;
+		default: /* BUFFER_CHUNK */
+			li_buffer_acquire(c->data.buffer.buffer);
+			li_chunkqueue_append_buffer2(w->cq, c->data.buffer.buffer, c->data.buffer.offset + c->offset, len);
+			break;
+		}
+		we_have += len;
+	} while (we_have < write_max && w->cq->queue.length < NETWORK_URING_MAX_IOV && li_chunkiter_next(&ci));
+
+	ci = li_chunkqueue_iter(w->cq);
+	do {
+		c = li_chunkiter_chunk(ci);
+		if (MEM_CHUNK == c->type) {
+			w->iov[w->iovcnt].iov_base = c->mem->data + c->offset;
+		} else {
+			w->iov[w->iovcnt].iov_base = c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset;
+		}
+		w->iov[w->iovcnt].iov_len = li_chunk_length(c);
+		w->iovcnt++;
+	} while (li_chunkiter_next(&ci));
+
+	io_uring_prep_writev(sqe, fd, w->iov, w->iovcnt, 0);
+	io_uring_sqe_set_data(sqe, w);
+
+	wrk->stats.write_syscalls++;
+	if (0 > (r = io_uring_submit(&w->uring->ring))) {
+		/* the sqe stays in the ring and is submitted later; keep w alive for its completion */
+		ERROR(wrk->srv, "io_uring_submit failed: %s", g_strerror(-r));
+	}
+
+	li_iostream_acquire(stream);
+	stream->uring_write = w;
+	g_queue_push_tail_link(&w->uring->writes, &w->link);
+
+	/* don't watch for LI_EV_WRITE until the write completes */
+	stream->throttled_out = TRUE;
+
+	return TRUE;
+}
+
+void li_network_uring_free(liWorker *wrk) {
+	liNetworkUring *uring = wrk->network_uring;
+	int efd;
+
+	if (NULL == uring) return;
+	wrk->network_uring = NULL;
+
+	if (uring->ok) {
+		GList *l;
+
+		/* the kernel may still read the buffers of writes in flight: cancel them and wait */
+		for (l = uring->writes.head; NULL != l; l = l->next) {
+			struct io_uring_sqe *sqe = io_uring_get_sqe(&uring->ring);
+			if (NULL == sqe) {
+				io_uring_submit(&uring->ring);
+				sqe = io_uring_get_sqe(&uring->ring);
+			}
+			io_uring_prep_cancel(sqe, l->data, 0);
+			io_uring_sqe_set_data(sqe, NULL);
+		}
+		io_uring_submit(&uring->ring);
+
+		while (uring->writes.length > 0) {
+			struct io_uring_cqe *cqe;
+			network_uring_write *w;
+			int res;
+
+			if (0 > io_uring_wait_cqe(&uring->ring, &cqe)) break;
+			w = io_uring_cqe_get_data(cqe);
+			res = cqe->res;
+			io_uring_cqe_seen(&uring->ring, cqe);
+			if (NULL != w) network_uring_write_done(w, res);
+		}
+
+		io_uring_queue_exit(&uring->ring);
+	}
+
+	efd = li_event_io_fd(&uring->eventfd_watcher);
+	li_event_clear(&uring->eventfd_watcher);
+	if (-1 != efd) close(efd);
+
+	g_slice_free(liNetworkUring, uring);
+}
+
+#endif
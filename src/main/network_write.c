@@ -1,7 +1,7 @@
 
 #include <lighttpd/base.h>
 
-liNetworkStatus li_network_backend_write(int fd, liChunkQueue *cq, goffset *write_max, GError **err) {
+liNetworkStatus li_network_backend_write(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
 	const ssize_t blocksize = 16*1024; /* 16k */
 	char *block_data;
 	off_t block_len;
@@ -22,6 +22,7 @@ liNetworkStatus li_network_backend_write(int fd, liChunkQueue *cq, goffset *writ
 			return LI_NETWORK_STATUS_FATAL_ERROR;
 		}
 
+		(*syscalls)++;
 		if (-1 == (r = li_net_write(fd, block_data, block_len))) {
 			switch (errno) {
 			case EAGAIN:
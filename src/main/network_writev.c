@@ -24,11 +24,27 @@
 # endif
 #endif
 
-/* first chunk must be a STRING_CHUNK ! */
-liNetworkStatus li_network_backend_writev(int fd, liChunkQueue *cq, goffset *write_max, GError **err) {
+/* chunks which can be part of a writev() batch after the first one */
+static gboolean network_writev_chunk(liChunk *c) {
+	switch (c->type) {
+	case STRING_CHUNK:
+	case MEM_CHUNK:
+	case BUFFER_CHUNK:
+		return TRUE;
+	case FILE_CHUNK:
+		return li_chunk_length(c) <= LI_NETWORK_WRITEV_FILE_MAX;
+	default:
+		return FALSE;
+	}
+}
+
+/* first chunk must be a STRING_CHUNK, MEM_CHUNK or BUFFER_CHUNK !
+ * small file ranges following memory chunks are read (from the page cache) and sent in the same writev()
+ */
+liNetworkStatus li_network_backend_writev(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
 	off_t we_have;
 	ssize_t r;
-	gboolean did_write_something = FALSE;
+	gboolean did_write_something = FALSE, short_read;
 	liChunkIter ci;
 	liChunk *c;
 	liNetworkStatus res = LI_NETWORK_STATUS_FATAL_ERROR;
@@ -46,27 +62,44 @@ liNetworkStatus li_network_backend_writev(int fd, liChunkQueue *cq, goffset *wri
 		}
 
 		we_have = 0;
+		short_read = FALSE;
 		do {
 			guint i = chunks->len;
 			off_t len = li_chunk_length(c);
+			char *data;
 			struct iovec *v;
-			g_array_set_size(chunks, i + 1);
-			v = &g_array_index(chunks, struct iovec, i);
+			if (len > *write_max - we_have) len = *write_max - we_have;
 			if (c->type == STRING_CHUNK) {
-				v->iov_base = c->data.str->str + c->offset;
+				data = c->data.str->str + c->offset;
 			} else if (c->type == MEM_CHUNK) {
-				v->iov_base = c->mem->data + c->offset;
-			} else { /* if (c->type == BUFFER_CHUNK) */
-				v->iov_base = c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset;
+				data = (char*) c->mem->data + c->offset;
+			} else if (c->type == BUFFER_CHUNK) {
+				data = c->data.buffer.buffer->addr + c->data.buffer.offset + c->offset;
+			} else { /* if (c->type == FILE_CHUNK) */
+				off_t data_len;
+				GError *read_err = NULL;
+
+				(*syscalls)++;
+				if (LI_HANDLER_GO_ON != li_chunkiter_read(ci, 0, len, &data, &data_len, &read_err)) {
+					/* send what we have; li_network_backend_write reports the error when it gets to the chunk */
+					if (NULL != read_err) g_error_free(read_err);
+					break;
+				}
+				/* a short read ends the batch */
+				short_read = (data_len != len);
+				len = data_len;
 			}
-			if (len > *write_max - we_have) len = *write_max - we_have;
+			g_array_set_size(chunks, i + 1);
+			v = &g_array_index(chunks, struct iovec, i);
+			v->iov_base = data;
 			v->iov_len = len;
 			we_have += len;
-		} while (we_have < *write_max &&
+		} while (!short_read && we_have < *write_max &&
 		         li_chunkiter_next(&ci) &&
-		         (STRING_CHUNK == (c = li_chunkiter_chunk(ci))->type || MEM_CHUNK == c->type || BUFFER_CHUNK == c->type) &&
+		         network_writev_chunk(c = li_chunkiter_chunk(ci)) &&
 		         chunks->len < UIO_MAXIOV);
 
+		(*syscalls)++;
 		while (-1 == (r = writev(fd, &g_array_index(chunks, struct iovec, 0), chunks->len))) {
 			switch (errno) {
 			case EAGAIN:
@@ -115,7 +148,7 @@ cleanup:
 	return res;
 }
 
-liNetworkStatus li_network_write_writev(int fd, liChunkQueue *cq, goffset *write_max, GError **err) {
+liNetworkStatus li_network_write_writev(int fd, liChunkQueue *cq, goffset *write_max, guint *syscalls, GError **err) {
 	if (cq->length == 0) return LI_NETWORK_STATUS_FATAL_ERROR;
 	do {
 		switch (li_chunkqueue_first_chunk(cq)->type) {
@@ -127,6 +160,9 @@ liNetworkStatus li_network_write_writev(int fd, liChunkQueue *cq, goffset *write
 		case FILE_CHUNK:
 			LI_NETWORK_FALLBACK(li_network_backend_write, write_max);
 			break;
+		case PIPE_CHUNK:
+			LI_NETWORK_FALLBACK(li_network_backend_splice, write_max);
+			break;
 		default:
 			return LI_NETWORK_STATUS_FATAL_ERROR;
 		}
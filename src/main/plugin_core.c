@@ -154,7 +154,7 @@ static void core_docroot_nth_cb(GString *pattern_result, guint to, guint from, g
 
 static liHandlerResult core_handle_docroot(liVRequest *vr, gpointer param, gpointer *context) {
 	guint i;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 	GArray *arr = param;
 	docroot_split dsplit = { vr->request.uri.host, NULL, 0 };
 
@@ -162,7 +162,7 @@ static liHandlerResult core_handle_docroot(liVRequest *vr, gpointer param, gpoin
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	/* resume from last stat check */
@@ -180,7 +180,7 @@ static liHandlerResult core_handle_docroot(liVRequest *vr, gpointer param, gpoin
 
 
 		g_string_truncate(vr->physical.doc_root, 0);
-		li_pattern_eval(vr, vr->physical.doc_root, g_array_index(arr, liPattern*, i), core_docroot_nth_cb, &dsplit, li_pattern_regex_cb, match_info);
+		li_pattern_eval(vr, vr->physical.doc_root, g_array_index(arr, liPattern*, i), core_docroot_nth_cb, &dsplit, li_pattern_regex_cb, match);
 
 		/* if there's only one entry and we're not debug logging, don't stat */
 		if (i == arr->len - 1 && !CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) break;
@@ -284,12 +284,12 @@ static liHandlerResult core_handle_alias(liVRequest *vr, gpointer _param, gpoint
 	GArray *param = _param;
 	guint i;
 	docroot_split dsplit = { vr->request.uri.host, NULL, 0 };
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 	UNUSED(context);
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	for (i = 0; i < param->len; i++) {
@@ -307,7 +307,7 @@ static liHandlerResult core_handle_alias(liVRequest *vr, gpointer _param, gpoint
 			if (isdir && vr->request.uri.path->str[preflen] != '\0' && vr->request.uri.path->str[preflen] != '/') continue;
 
 			g_string_truncate(vr->physical.doc_root, 0);
-			li_pattern_eval(vr, vr->physical.doc_root, ac.path, core_docroot_nth_cb, &dsplit, li_pattern_regex_cb, match_info);
+			li_pattern_eval(vr, vr->physical.doc_root, ac.path, core_docroot_nth_cb, &dsplit, li_pattern_regex_cb, match);
 
 			/* prefix matched */
 			if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
@@ -541,12 +541,63 @@ static liAction* core_index(liServer *srv, liWorker *wrk, liPlugin* p, liValue *
 }
 
 
+/* precompressed variants for static files (static.precompressed) */
+typedef struct {
+	const gchar *encoding, *suffix;
+} core_static_encoding;
+
+static const core_static_encoding core_static_encodings[] = {
+	{ "gzip", ".gz" },
+	{ "br", ".br" },
+	{ "zstd", ".zst" },
+	{ "bzip2", ".bz2" },
+	{ NULL, NULL }
+};
+
+#define CORE_STATIC_ENCODINGS (G_N_ELEMENTS(core_static_encodings) - 1)
+
+/* core_static_encodings names, followed by the aliases */
+static const gchar * const core_static_accept_names[] = {
+	"gzip", "br", "zstd", "bzip2",
+	"x-gzip", "x-bzip2",
+	NULL
+};
+
+/* q-value (in 1/1000) the client gives each core_static_encodings entry; 0: not acceptable.
+ * "*" only covers codings the client didn't list.
+ */
+static void core_static_accepted_encodings(liVRequest *vr, gint q[CORE_STATIC_ENCODINGS]) {
+	gint listed[G_N_ELEMENTS(core_static_accept_names) - 1], q_star;
+	guint i;
+
+	li_http_header_parse_qvalues(vr->request.headers, LI_HTTP_HEADER_ACCEPT_ENCODING, core_static_accept_names, listed, &q_star);
+
+	if (listed[0] < 0) listed[0] = listed[4]; /* x-gzip */
+	if (listed[3] < 0) listed[3] = listed[5]; /* x-bzip2 */
+
+	for (i = 0; i < CORE_STATIC_ENCODINGS; i++) {
+		q[i] = (listed[i] >= 0) ? listed[i] : MAX(q_star, 0);
+	}
+}
+
+/* small files come from the content cache as buffer */
+static void core_static_append(liChunkQueue *cq, liChunkFile *cf, liBuffer *content, off_t start, off_t length) {
+	if (NULL != content) {
+		li_buffer_acquire(content);
+		li_chunkqueue_append_buffer2(cq, content, start, length);
+	} else {
+		li_chunkqueue_append_chunkfile(cq, cf, start, length);
+	}
+}
+
 static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpointer *context) {
-	int fd = -1;
+	liChunkFile *cf = NULL;
+	liBuffer *content = NULL;
 	struct stat st;
 	int err;
 	liHandlerResult res;
 	GPtrArray *exclude_arr = CORE_OPTIONPTR(LI_CORE_OPTION_STATIC_FILE_EXCLUDE_EXTENSIONS).list;
+	GArray *precompressed = CORE_OPTIONPTR(LI_CORE_OPTION_STATIC_PRECOMPRESSED).ptr;
 	static const gchar boundary[] = "fkj49sn38dcn3";
 	gboolean no_fail = GPOINTER_TO_INT(param);
 
@@ -597,7 +648,7 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		}
 	}
 
-	res = li_stat_cache_get(vr, vr->physical.path, &st, &err, &fd);
+	res = li_stat_cache_get_file(vr, vr->physical.path, &st, &err, &cf, &content);
 	if (res == LI_HANDLER_WAIT_FOR_EVENT)
 		return res;
 
@@ -608,9 +659,6 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 	if (res == LI_HANDLER_ERROR) {
 		/* open or fstat failed */
 
-		if (fd != -1)
-			close(fd);
-
 		if (no_fail) return LI_HANDLER_GO_ON;
 
 		if (!li_vrequest_handle_direct(vr)) {
@@ -634,16 +682,16 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 			return LI_HANDLER_GO_ON;
 		}
 	} else if (S_ISDIR(st.st_mode)) {
-		if (fd != -1)
-			close(fd);
+		li_chunkfile_release(cf);
+		li_buffer_release(content);
 		return LI_HANDLER_GO_ON;
 	} else if (!S_ISREG(st.st_mode)) {
 		if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
 			VR_DEBUG(vr, "not a regular file: '%s'", vr->physical.path->str);
 		}
 
-		if (fd != -1)
-			close(fd);
+		li_chunkfile_release(cf);
+		li_buffer_release(content);
 
 		if (no_fail) return LI_HANDLER_GO_ON;
 
@@ -657,30 +705,98 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		gboolean cachable;
 		gboolean ranged_response = FALSE;
 		liHttpHeader *hh_range;
-		liChunkFile *cf;
 		static const GString default_mime_str = { CONST_STR_LEN("application/octet-stream"), 0 };
+		const gchar *encoding = NULL;
+
+		if (NULL != precompressed && precompressed->len > 0) {
+			gint q[CORE_STATIC_ENCODINGS];
+
+			core_static_accepted_encodings(vr, q);
+
+			for (;;) {
+				const core_static_encoding *enc;
+				GString *variant;
+				liChunkFile *vcf = NULL;
+				liBuffer *vcontent = NULL;
+				struct stat vst;
+				int verr;
+				guint i, ndx = 0;
+				gint best_q = 0;
+
+				/* highest q-value first; the configured order decides between equal values */
+				for (i = 0; i < precompressed->len; i++) {
+					guint k = g_array_index(precompressed, guint, i);
+					if (q[k] > best_q) {
+						best_q = q[k];
+						ndx = k;
+					}
+				}
+				if (0 == best_q) break;
+				q[ndx] = 0; /* don't try it again */
+				enc = &core_static_encodings[ndx];
+
+				variant = g_string_sized_new(vr->physical.path->len + 4);
+				g_string_append_len(variant, GSTR_LEN(vr->physical.path));
+				g_string_append(variant, enc->suffix);
+				res = li_stat_cache_get_file(vr, variant, &vst, &verr, &vcf, &vcontent);
+				g_string_free(variant, TRUE);
+
+				if (LI_HANDLER_WAIT_FOR_EVENT == res) {
+					/* restart the whole handler once the stat of the variant finished */
+					li_chunkfile_release(cf);
+					li_buffer_release(content);
+					return res;
+				}
+
+				/* ignore variants older than the original file */
+				if (LI_HANDLER_GO_ON == res && S_ISREG(vst.st_mode) && vst.st_mtime >= st.st_mtime) {
+					li_chunkfile_release(cf);
+					li_buffer_release(content);
+					cf = vcf;
+					content = vcontent;
+					st = vst;
+					encoding = enc->encoding;
+
+					if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+						VR_DEBUG(vr, "serving precompressed variant '%s%s'", vr->physical.path->str, enc->suffix);
+					}
+					break;
+				}
+
+				li_chunkfile_release(vcf);
+				li_buffer_release(vcontent);
+			}
+		}
 
 		if (!li_vrequest_handle_direct(vr)) {
-			close(fd);
+			li_chunkfile_release(cf);
+			li_buffer_release(content);
 			return LI_HANDLER_ERROR;
 		}
 
-		li_etag_set_header(vr, &st, &cachable);
+		if (NULL != precompressed && precompressed->len > 0) {
+			li_http_header_append(vr->response.headers, CONST_STR_LEN("Vary"), CONST_STR_LEN("Accept-Encoding"));
+		}
+		if (NULL != encoding) {
+			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Encoding"), encoding, strlen(encoding));
+		}
+
+		/* validators describe the file actually sent (the variant); the etag is mutated with the encoding */
+		li_etag_set_header_encoded(vr, &st, encoding, &cachable);
 		if (cachable) {
 			vr->response.http_status = 304;
-			close(fd);
+			li_chunkfile_release(cf);
+			li_buffer_release(content);
 			return LI_HANDLER_GO_ON;
 		}
 
-		cf = li_chunkfile_new(NULL, fd, FALSE);
-
 		mime_str = li_mimetype_get(vr, vr->physical.path);
 		if (!mime_str) mime_str = &default_mime_str;
 
 		if (CORE_OPTION(LI_CORE_OPTION_STATIC_RANGE_REQUESTS).boolean) {
 			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Accept-Ranges"), CONST_STR_LEN("bytes"));
 
-			hh_range = li_http_header_lookup(vr->request.headers, CONST_STR_LEN("range"));
+			hh_range = li_http_header_lookup_id(vr->request.headers, LI_HTTP_HEADER_RANGE);
 			if (hh_range) {
 				/* TODO: Check If-Range: header */
 				const GString range_str = li_const_gstring(LI_HEADER_VALUE_LEN(hh_range));
@@ -699,10 +815,10 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 							GString *subheader = g_string_sized_new(1023);
 							g_string_append_printf(subheader, "\r\n--%s\r\nContent-Type: %s\r\nContent-Range: %s\r\n\r\n", boundary, mime_str->str, vr->wrk->tmp_str->str);
 							li_chunkqueue_append_string(vr->direct_out, subheader);
-							li_chunkqueue_append_chunkfile(vr->direct_out, cf, rs.range_start, rs.range_length);
+							core_static_append(vr->direct_out, cf, content, rs.range_start, rs.range_length);
 						} else {
 							li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Range"), GSTR_LEN(vr->wrk->tmp_str));
-							li_chunkqueue_append_chunkfile(vr->direct_out, cf, rs.range_start, rs.range_length);
+							core_static_append(vr->direct_out, cf, content, rs.range_start, rs.range_length);
 						}
 						break;
 					case LI_PARSE_HTTP_RANGE_DONE:
@@ -742,10 +858,11 @@ static liHandlerResult core_handle_static(liVRequest *vr, gpointer param, gpoint
 		if (!ranged_response) {
 			vr->response.http_status = 200;
 			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Type"), GSTR_LEN(mime_str));
-			li_chunkqueue_append_chunkfile(vr->direct_out, cf, 0, st.st_size);
+			core_static_append(vr->direct_out, cf, content, 0, st.st_size);
 		}
 
 		li_chunkfile_release(cf);
+		li_buffer_release(content);
 	}
 
 	return LI_HANDLER_GO_ON;
@@ -877,18 +994,18 @@ static void core_log_write_free(liServer *srv, gpointer param) {
 
 static liHandlerResult core_handle_log_write(liVRequest *vr, gpointer param, gpointer *context) {
 	liPattern *pattern = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	UNUSED(context);
 
 	/* eval pattern, ignore $n */
 	g_string_truncate(vr->wrk->tmp_str, 0);
-	li_pattern_eval(vr, vr->wrk->tmp_str, pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, vr->wrk->tmp_str, pattern, NULL, NULL, li_pattern_regex_cb, match);
 
 	VR_INFO(vr, "%s", vr->wrk->tmp_str->str);
 
@@ -935,7 +1052,7 @@ static void core_respond_free(liServer *srv, gpointer param) {
 
 static liHandlerResult core_handle_respond(liVRequest *vr, gpointer param, gpointer *context) {
 	respond_param *rp = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	UNUSED(context);
 
@@ -944,7 +1061,7 @@ static liHandlerResult core_handle_respond(liVRequest *vr, gpointer param, gpoin
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	vr->response.http_status = rp->status_code;
@@ -954,7 +1071,7 @@ static liHandlerResult core_handle_respond(liVRequest *vr, gpointer param, gpoin
 
 	if (rp->pattern) {
 		g_string_truncate(vr->wrk->tmp_str, 0);
-		li_pattern_eval(vr, vr->wrk->tmp_str, rp->pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+		li_pattern_eval(vr, vr->wrk->tmp_str, rp->pattern, NULL, NULL, li_pattern_regex_cb, match);
 		li_chunkqueue_append_mem(vr->direct_out, GSTR_LEN(vr->wrk->tmp_str));
 	}
 
@@ -1023,17 +1140,17 @@ static void core_env_set_add_free(liServer *srv, gpointer param) {
 
 static liHandlerResult core_handle_env_set(liVRequest *vr, gpointer param, gpointer *context) {
 	env_set_add_ctx *ctx = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	UNUSED(context);
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(vr->wrk->tmp_str, 0);
-	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match);
 	li_environment_set(&vr->env, GSTR_LEN(ctx->key), GSTR_LEN(vr->wrk->tmp_str));
 
 	return LI_HANDLER_GO_ON;
@@ -1068,17 +1185,17 @@ static liAction* core_env_set(liServer *srv, liWorker *wrk, liPlugin* p, liValue
 
 static liHandlerResult core_handle_env_add(liVRequest *vr, gpointer param, gpointer *context) {
 	env_set_add_ctx *ctx = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	UNUSED(context);
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(vr->wrk->tmp_str, 0);
-	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match);
 	li_environment_insert(&vr->env, GSTR_LEN(ctx->key), GSTR_LEN(vr->wrk->tmp_str));
 
 	return LI_HANDLER_GO_ON;
@@ -1168,11 +1285,11 @@ static gboolean core_listen(liServer *srv, liPlugin* p, liValue *val, gpointer u
 	if (NULL == val) goto fail;
 
 	if (LI_VALUE_STRING == li_value_type(val)) {
-		li_angel_listen(srv, val->data.string, NULL, NULL);
+		li_server_listen_addr(srv, val->data.string);
 	} else if (LI_VALUE_LIST == li_value_type(val)) {
 		LI_VALUE_FOREACH(ip, val);
 			if (LI_VALUE_STRING != li_value_type(ip)) goto fail;
-			li_angel_listen(srv, ip->data.string, NULL, NULL);
+			li_server_listen_addr(srv, ip->data.string);
 		LI_VALUE_END_FOREACH()
 	} else {
 		goto fail;
@@ -1204,6 +1321,24 @@ static gboolean core_workers(liServer *srv, liPlugin* p, liValue *val, gpointer
 	return TRUE;
 }
 
+static gboolean core_workers_reuseport(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_BOOLEAN == li_value_type(val)) {
+		srv->reuseport = val->data.boolean;
+		srv->reuseport_cpu = FALSE;
+	} else if (LI_VALUE_STRING == li_value_type(val) && li_strncase_equal(val->data.string, CONST_STR_LEN("cpu"))) {
+		srv->reuseport = TRUE;
+		srv->reuseport_cpu = TRUE;
+	} else {
+		ERROR(srv, "%s", "workers.reuseport expects a boolean or \"cpu\" as parameter");
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static gboolean core_workers_cpu_affinity(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
 #if defined(LIGHTY_OS_LINUX)
 	UNUSED(p); UNUSED(userdata);
@@ -1298,6 +1433,39 @@ static gboolean core_io_timeout(liServer *srv, liPlugin* p, liValue *val, gpoint
 	return TRUE;
 }
 
+static gboolean core_http2(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_BOOLEAN != li_value_type(val)) {
+		ERROR(srv, "%s", "http2 expects a boolean as parameter");
+		return FALSE;
+	}
+
+	srv->http2 = val->data.boolean;
+
+	return TRUE;
+}
+
+static gboolean core_network_backend(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_STRING != li_value_type(val)) {
+		ERROR(srv, "%s", "network.backend expects a string as parameter");
+		return FALSE;
+	}
+
+	if (!li_network_backend_from_string(val->data.string->str, &srv->network_backend)) {
+		ERROR(srv, "network.backend: unknown or unsupported backend '%s'", val->data.string->str);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
 static gboolean core_stat_cache_ttl(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
 	UNUSED(p); UNUSED(userdata);
 
@@ -1313,6 +1481,73 @@ static gboolean core_stat_cache_ttl(liServer *srv, liPlugin* p, liValue *val, gp
 	return TRUE;
 }
 
+static gboolean core_stat_cache_max_open_files(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_NUMBER != li_value_type(val) || val->data.number < 0 || val->data.number > G_MAXUINT) {
+		ERROR(srv, "%s", "stat_cache.max_open_files expects a positive number as parameter");
+		return FALSE;
+	}
+
+	srv->stat_cache_max_open_files = val->data.number;
+
+	return TRUE;
+}
+
+static gboolean core_stat_cache_content_size(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_NUMBER != li_value_type(val) || val->data.number < 0) {
+		ERROR(srv, "%s", "stat_cache.content_size expects a positive number as parameter");
+		return FALSE;
+	}
+
+	srv->stat_cache_content_size = val->data.number;
+
+	return TRUE;
+}
+
+static gboolean core_stat_cache_content_max_file_size(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_NUMBER != li_value_type(val) || val->data.number < 0) {
+		ERROR(srv, "%s", "stat_cache.content_max_file_size expects a positive number as parameter");
+		return FALSE;
+	}
+
+	srv->stat_cache_content_max_file_size = val->data.number;
+
+	return TRUE;
+}
+
+static gboolean core_stat_cache_inotify(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
+	UNUSED(p); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (LI_VALUE_BOOLEAN != li_value_type(val)) {
+		ERROR(srv, "%s", "stat_cache.inotify expects a boolean as parameter");
+		return FALSE;
+	}
+
+#ifndef HAVE_SYS_INOTIFY_H
+	if (val->data.boolean) {
+		ERROR(srv, "%s", "stat_cache.inotify: inotify not supported on this platform");
+		return FALSE;
+	}
+#endif
+
+	srv->stat_cache_inotify = val->data.boolean;
+
+	return TRUE;
+}
+
 static gboolean core_tasklet_pool_threads(liServer *srv, liPlugin* p, liValue *val, gpointer userdata) {
 	UNUSED(p); UNUSED(userdata);
 
@@ -1493,6 +1728,50 @@ static gboolean core_option_static_exclude_exts_parse(liServer *srv, liWorker *w
 }
 
 
+static gboolean core_option_static_precompressed_parse(liServer *srv, liWorker *wrk, liPlugin *p, size_t ndx, liValue *val, gpointer *oval) {
+	GArray *encodings;
+	UNUSED(wrk); UNUSED(p); UNUSED(ndx);
+
+	/* default value: disabled */
+	if (NULL == val) return TRUE;
+	LI_FORCE_ASSERT(LI_VALUE_LIST == val->type);
+
+	encodings = g_array_new(FALSE, FALSE, sizeof(guint));
+
+	LI_VALUE_FOREACH(v, val)
+		guint i;
+
+		if (LI_VALUE_STRING != li_value_type(v)) {
+			ERROR(srv, "static.precompressed option expects a list of strings, entry #%u is of type %s", _v_i, li_value_type_string(v));
+			g_array_free(encodings, TRUE);
+			return FALSE;
+		}
+
+		for (i = 0; NULL != core_static_encodings[i].encoding; i++) {
+			if (0 == g_ascii_strcasecmp(v->data.string->str, core_static_encodings[i].encoding)) break;
+		}
+		if (NULL == core_static_encodings[i].encoding) {
+			ERROR(srv, "static.precompressed: unknown encoding '%s'", v->data.string->str);
+			g_array_free(encodings, TRUE);
+			return FALSE;
+		}
+
+		g_array_append_val(encodings, i);
+	LI_VALUE_END_FOREACH()
+
+	*oval = encodings;
+
+	return TRUE;
+}
+
+static void core_option_static_precompressed_free(liServer *srv, liPlugin *p, size_t ndx, gpointer oval) {
+	UNUSED(srv);
+	UNUSED(p);
+	UNUSED(ndx);
+
+	if (NULL != oval) g_array_free(oval, TRUE);
+}
+
 static gboolean core_option_mime_types_parse(liServer *srv, liWorker *wrk, liPlugin *p, size_t ndx, liValue *val, gpointer *oval) {
 	liMimetypeNode *node;
 
@@ -1595,17 +1874,17 @@ static void core_header_free(liServer *srv, gpointer param) {
 
 static liHandlerResult core_handle_header(liVRequest *vr, gpointer param, gpointer *context) {
 	header_ctx *ctx = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	UNUSED(context);
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(vr->wrk->tmp_str, 0);
-	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->value, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, vr->wrk->tmp_str, ctx->value, NULL, NULL, li_pattern_regex_cb, match);
 
 	ctx->cb(ctx->use_req_header ? vr->request.headers : vr->response.headers, GSTR_LEN(ctx->key), GSTR_LEN(vr->wrk->tmp_str));
 
@@ -1796,17 +2075,17 @@ static void core_map_free(liServer *srv, gpointer param) {
 static liHandlerResult core_handle_map(liVRequest *vr, gpointer param, gpointer *context) {
 	liValue *v;
 	core_map_data *md = param;
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 	UNUSED(context);
 
 	g_string_truncate(vr->wrk->tmp_str, 0);
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
-	li_pattern_eval(vr, vr->wrk->tmp_str, md->pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, vr->wrk->tmp_str, md->pattern, NULL, NULL, li_pattern_regex_cb, match);
 	v = g_hash_table_lookup(md->hash, vr->wrk->tmp_str);
 	if (NULL != v) {
 		li_action_enter(vr, v->data.val_action.action);
@@ -2090,6 +2369,8 @@ static const liPluginOptionPtr optionptrs[] = {
 
 	{ "mime_types", LI_VALUE_LIST, NULL, core_option_mime_types_parse, core_option_mime_types_free },
 
+	{ "static.precompressed", LI_VALUE_LIST, NULL, core_option_static_precompressed_parse, core_option_static_precompressed_free },
+
 	{ NULL, 0, NULL, NULL, NULL }
 };
 
@@ -2138,9 +2419,16 @@ static const liPluginSetup setups[] = {
 	{ "listen", core_listen, NULL },
 	{ "workers", core_workers, NULL },
 	{ "workers.cpu_affinity", core_workers_cpu_affinity, NULL },
+	{ "workers.reuseport", core_workers_reuseport, NULL },
 	{ "module_load", core_module_load, NULL },
 	{ "io.timeout", core_io_timeout, NULL },
+	{ "http2", core_http2, NULL },
+	{ "network.backend", core_network_backend, NULL },
 	{ "stat_cache.ttl", core_stat_cache_ttl, NULL },
+	{ "stat_cache.inotify", core_stat_cache_inotify, NULL },
+	{ "stat_cache.max_open_files", core_stat_cache_max_open_files, NULL },
+	{ "stat_cache.content_size", core_stat_cache_content_size, NULL },
+	{ "stat_cache.content_max_file_size", core_stat_cache_content_max_file_size, NULL },
 	{ "tasklet_pool.threads", core_tasklet_pool_threads, NULL },
 	{ "log", core_setup_log, NULL },
 	{ "log.timestamp", core_setup_log_timestamp, NULL },
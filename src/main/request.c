@@ -115,6 +115,44 @@ static gboolean request_parse_url(liVRequest *vr) {
 	return TRUE;
 }
 
+/* returns 0 or the http status for the error */
+static int request_parse_content_length(liVRequest *vr) {
+	liHttpHeader *hh;
+	const gchar *val;
+	gint64 r;
+	char *err;
+
+	hh = li_http_header_lookup_id(vr->request.headers, LI_HTTP_HEADER_CONTENT_LENGTH);
+	if (NULL == hh) return 0;
+
+	val = LI_HEADER_VALUE(hh);
+	r = g_ascii_strtoll(val, &err, 10);
+	if (*err != '\0') {
+		VR_DEBUG(vr, "content-length is not a number: %s (Status: 400)", err);
+		return 400; /* bad request */
+	}
+
+	/**
+		* negative content-length is not supported
+		* and is a bad request
+		*/
+	if (r < 0) {
+		return 400; /* bad request */
+	}
+
+	/**
+		* check if we had a over- or underrun in the string conversion
+		*/
+	if (r == G_MININT64 || r == G_MAXINT64) {
+		if (errno == ERANGE) {
+			return 413; /* Request Entity Too Large */
+		}
+	}
+
+	vr->request.content_length = r;
+	return 0;
+}
+
 gboolean li_request_validate_header(liConnection *con) {
 	liRequest *req = &con->mainvr->request;
 	liHttpHeader *hh;
@@ -136,6 +174,7 @@ gboolean li_request_validate_header(liConnection *con) {
 		if (li_http_header_is(req->headers, CONST_STR_LEN("connection"), CONST_STR_LEN("close")))
 			con->info.keep_alive = FALSE;
 		break;
+	case LI_HTTP_VERSION_2: /* only through li_request_validate_header_http2 */
 	case LI_HTTP_VERSION_UNSET:
 		bad_request(con, 505); /* Version not Supported */
 		return FALSE;
@@ -147,9 +186,9 @@ gboolean li_request_validate_header(liConnection *con) {
 	}
 
 	/* get hostname */
-	l = li_http_header_find_first(req->headers, CONST_STR_LEN("host"));
+	l = li_http_header_find_first_id(req->headers, LI_HTTP_HEADER_HOST);
 	if (NULL != l) {
-		if (NULL != li_http_header_find_next(l, CONST_STR_LEN("host"))) {
+		if (li_http_header_count_id(req->headers, LI_HTTP_HEADER_HOST) > 1) {
 			/* more than one "host" header */
 			bad_request(con, 400); /* bad request */
 			return FALSE;
@@ -187,45 +226,18 @@ gboolean li_request_validate_header(liConnection *con) {
 	}
 
 	/* content-length */
-	hh = li_http_header_lookup(req->headers, CONST_STR_LEN("content-length"));
-	if (hh) {
-		const gchar *val = LI_HEADER_VALUE(hh);
-		gint64 r;
-		char *err;
-
-		r = g_ascii_strtoll(val, &err, 10);
-		if (*err != '\0') {
-			_VR_DEBUG(con->srv, con->mainvr, "content-length is not a number: %s (Status: 400)", err);
-			bad_request(con, 400); /* bad request */
-			return FALSE;
-		}
-
-		/**
-			* negative content-length is not supported
-			* and is a bad request
-			*/
-		if (r < 0) {
-			bad_request(con, 400); /* bad request */
+	{
+		int status = request_parse_content_length(con->mainvr);
+		if (0 != status) {
+			bad_request(con, status);
 			return FALSE;
 		}
-
-		/**
-			* check if we had a over- or underrun in the string conversion
-			*/
-		if (r == G_MININT64 || r == G_MAXINT64) {
-			if (errno == ERANGE) {
-				bad_request(con, 413); /* Request Entity Too Large */
-				return FALSE;
-			}
-		}
-
-		con->mainvr->request.content_length = r;
 	}
 
 	/* Transfer-Encoding: chunked */
-	l = li_http_header_find_first(req->headers, CONST_STR_LEN("transfer-encoding"));
+	l = li_http_header_find_first_id(req->headers, LI_HTTP_HEADER_TRANSFER_ENCODING);
 	if (l) {
-		for ( ; l ; l = li_http_header_find_next(l, CONST_STR_LEN("transfer-encoding")) ) {
+		for ( ; l ; l = li_http_header_find_next_id(l, LI_HTTP_HEADER_TRANSFER_ENCODING) ) {
 			hh = (liHttpHeader*) l->data;
 			if (0 == g_ascii_strcasecmp( LI_HEADER_VALUE(hh), "identity" )) {
 				/* ignore */
@@ -247,11 +259,11 @@ gboolean li_request_validate_header(liConnection *con) {
 	}
 
 	/* Expect: 100-continue */
-	l = li_http_header_find_first(req->headers, CONST_STR_LEN("expect"));
+	l = li_http_header_find_first_id(req->headers, LI_HTTP_HEADER_EXPECT);
 	if (l) {
 		gboolean expect_100_cont = FALSE;
 
-		for ( ; l ; l = li_http_header_find_next(l, CONST_STR_LEN("expect")) ) {
+		for ( ; l ; l = li_http_header_find_next_id(l, LI_HTTP_HEADER_EXPECT) ) {
 			hh = (liHttpHeader*) l->data;
 			if (0 == g_ascii_strcasecmp( LI_HEADER_VALUE(hh), "100-continue" )) {
 				expect_100_cont = TRUE;
@@ -308,6 +320,87 @@ gboolean li_request_validate_header(liConnection *con) {
 	return TRUE;
 }
 
+/* the pseudo headers were already mapped (see http2.c); no connection state to update */
+gboolean li_request_validate_header_http2(liVRequest *vr, gboolean end_stream) {
+	liRequest *req = &vr->request;
+	GList *l;
+	int status;
+
+	if (vr->coninfo->is_ssl) {
+		g_string_append_len(req->uri.scheme, CONST_STR_LEN("https"));
+	} else {
+		g_string_append_len(req->uri.scheme, CONST_STR_LEN("http"));
+	}
+
+	if (req->uri.raw->len == 0) goto bad_request;
+
+	/* :authority replaces host; HTTP/1 backends still need a host header */
+	l = li_http_header_find_first_id(req->headers, LI_HTTP_HEADER_HOST);
+	if (li_http_header_count_id(req->headers, LI_HTTP_HEADER_HOST) > 1) goto bad_request;
+	if (0 == req->uri.authority->len) {
+		liHttpHeader *hh;
+		if (NULL == l) goto bad_request;
+		hh = (liHttpHeader*) l->data;
+		g_string_append_len(req->uri.authority, LI_HEADER_VALUE_LEN(hh));
+	} else if (NULL == l) {
+		li_http_header_insert(req->headers, CONST_STR_LEN("host"), GSTR_LEN(req->uri.authority));
+	} else {
+		li_http_header_overwrite(req->headers, CONST_STR_LEN("host"), GSTR_LEN(req->uri.authority));
+	}
+
+	if (!request_parse_url(vr)) goto bad_request;
+
+	if (req->uri.host->len == 0 && req->uri.authority->len != 0) {
+		if (!li_parse_hostname(&req->uri)) goto bad_request;
+	}
+
+	/* remove trailing dots from hostname */
+	{
+		guint i = req->uri.host->len;
+		while (i > 0 && req->uri.host->str[i-1] == '.') i--;
+		g_string_truncate(req->uri.host, i);
+	}
+
+	if (0 != (status = request_parse_content_length(vr))) {
+		vr->response.http_status = status;
+		return FALSE;
+	}
+	if (end_stream) {
+		if (req->content_length > 0) goto bad_request;
+		req->content_length = 0;
+	}
+
+	/* Expect: 100-continue */
+	for (l = li_http_header_find_first_id(req->headers, LI_HTTP_HEADER_EXPECT); NULL != l; l = li_http_header_find_next_id(l, LI_HTTP_HEADER_EXPECT)) {
+		liHttpHeader *hh = (liHttpHeader*) l->data;
+		if (0 != g_ascii_strcasecmp(LI_HEADER_VALUE(hh), "100-continue")) {
+			vr->response.http_status = 417; /* Expectation Failed */
+			return FALSE;
+		}
+	}
+
+	switch (req->http_method) {
+	case LI_HTTP_METHOD_GET:
+	case LI_HTTP_METHOD_HEAD:
+		/* content-length is forbidden for those */
+		if (req->content_length > 0) {
+			VR_ERROR(vr, "%s", "GET/HEAD with content-length -> 400");
+			goto bad_request;
+		}
+		req->content_length = 0;
+		break;
+	default:
+		/* without content-length the body ends with END_STREAM */
+		break;
+	}
+
+	return TRUE;
+
+bad_request:
+	vr->response.http_status = 400;
+	return FALSE;
+}
+
 void li_physical_init(liPhysical *phys) {
 	phys->path = g_string_sized_new(127);
 	phys->doc_root = g_string_sized_new(63);
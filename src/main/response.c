@@ -111,17 +111,17 @@ void li_response_send_headers(liVRequest *vr, liChunkQueue *raw_out, liChunkQueu
 	{
 		liHttpHeader *header;
 		GList *iter;
-		gboolean have_date = FALSE, have_server = FALSE;
+		gboolean have_date, have_server;
 
 		for (iter = g_queue_peek_head_link(&vr->response.headers->entries); iter; iter = g_list_next(iter)) {
 			header = (liHttpHeader*) iter->data;
 			/* ignore connection headers from backends. set con->info.keep_alive = FALSE to disable keep-alive */
-			if (li_http_header_key_is(header, CONST_STR_LEN("connection"))) continue;
+			if (LI_HTTP_HEADER_CONNECTION == header->id) continue;
 			g_string_append_len(head, GSTR_LEN(header->data));
 			g_string_append_len(head, CONST_STR_LEN("\r\n"));
-			if (!have_date && li_http_header_key_is(header, CONST_STR_LEN("date"))) have_date = TRUE;
-			if (!have_server && li_http_header_key_is(header, CONST_STR_LEN("server"))) have_server = TRUE;
 		}
+		have_date = li_http_header_count_id(vr->response.headers, LI_HTTP_HEADER_DATE) > 0;
+		have_server = li_http_header_count_id(vr->response.headers, LI_HTTP_HEADER_SERVER) > 0;
 
 		if (!have_date) {
 			GString *d = li_worker_current_timestamp(vr->wrk, LI_GMTIME, LI_TS_FORMAT_HEADER);
@@ -151,6 +151,101 @@ void li_response_send_headers(liVRequest *vr, liChunkQueue *raw_out, liChunkQueu
 	}
 }
 
+/* lowercases the name into vr->wrk->tmp_str and encodes the field */
+static void response_encode_header(liVRequest *vr, GString *dest, liHPackEncoder *enc, const gchar *key, gsize keylen, const gchar *value, gsize valuelen) {
+	GString *name = vr->wrk->tmp_str;
+	gsize i;
+
+	g_string_truncate(name, 0);
+	g_string_append_len(name, key, keylen);
+	for (i = 0; i < name->len; i++) name->str[i] = g_ascii_tolower(name->str[i]);
+	li_hpack_encode(enc, dest, GSTR_LEN(name), value, valuelen);
+}
+
+gboolean li_response_send_headers_http2(liVRequest *vr, GString *dest, liHPackEncoder *enc, liChunkQueue *response_body) {
+	gboolean have_real_body, response_complete, have_body = TRUE;
+	gchar status_str[3];
+
+	if (vr->response.http_status < 200 || vr->response.http_status > 999) {
+		/* no interim responses from backends */
+		VR_ERROR(vr, "wrong status: %i, internal error", vr->response.http_status);
+		vr->response.http_status = 500;
+		li_chunkqueue_skip_all(response_body);
+		response_body->is_closed = TRUE;
+	}
+
+	have_real_body = (response_body->length > 0) || !response_body->is_closed;
+	response_complete = response_body->is_closed;
+
+	if (!have_real_body && vr->response.http_status >= 400 && vr->response.http_status < 600) {
+		li_response_send_error_page(vr, response_body);
+		have_real_body = response_complete = TRUE;
+	}
+
+	if (vr->response.http_status == 204 ||
+	     vr->response.http_status == 205 ||
+	     vr->response.http_status == 304) {
+		/* They never have a content-body/length */
+		li_chunkqueue_skip_all(response_body);
+		have_body = FALSE;
+	} else if (response_complete) {
+		if (vr->request.http_method != LI_HTTP_METHOD_HEAD || response_body->length > 0) {
+			/* do not send content-length: 0 if backend already skipped content generation for HEAD */
+			g_string_printf(vr->wrk->tmp_str, "%"LI_GOFFSET_FORMAT, response_body->length);
+			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Length"), GSTR_LEN(vr->wrk->tmp_str));
+		}
+	}
+	/* unknown length: DATA frames until END_STREAM, no chunked encoding */
+
+	if (vr->request.http_method == LI_HTTP_METHOD_HEAD) {
+		/* content-length is set, but no body */
+		li_chunkqueue_skip_all(response_body);
+		have_body = FALSE;
+	}
+
+	li_http_status_to_str(vr->response.http_status, status_str);
+	li_hpack_encode(enc, dest, CONST_STR_LEN(":status"), status_str, 3);
+
+	{
+		liHttpHeader *header;
+		GList *iter;
+		gboolean have_date, have_server;
+
+		for (iter = g_queue_peek_head_link(&vr->response.headers->entries); iter; iter = g_list_next(iter)) {
+			header = (liHttpHeader*) iter->data;
+			/* connection specific headers are not allowed in HTTP/2 */
+			switch (header->id) {
+			case LI_HTTP_HEADER_CONNECTION:
+			case LI_HTTP_HEADER_KEEP_ALIVE:
+			case LI_HTTP_HEADER_PROXY_CONNECTION:
+			case LI_HTTP_HEADER_TRANSFER_ENCODING:
+			case LI_HTTP_HEADER_UPGRADE:
+				continue;
+			default:
+				break;
+			}
+			response_encode_header(vr, dest, enc, LI_HEADER_KEY_LEN(header), LI_HEADER_VALUE_LEN(header));
+		}
+		have_date = li_http_header_count_id(vr->response.headers, LI_HTTP_HEADER_DATE) > 0;
+		have_server = li_http_header_count_id(vr->response.headers, LI_HTTP_HEADER_SERVER) > 0;
+
+		if (!have_date) {
+			GString *d = li_worker_current_timestamp(vr->wrk, LI_GMTIME, LI_TS_FORMAT_HEADER);
+			li_hpack_encode(enc, dest, CONST_STR_LEN("date"), GSTR_LEN(d));
+		}
+
+		if (!have_server) {
+			GString *tag = CORE_OPTIONPTR(LI_CORE_OPTION_SERVER_TAG).string;
+
+			if (tag->len) {
+				li_hpack_encode(enc, dest, CONST_STR_LEN("server"), GSTR_LEN(tag));
+			}
+		}
+	}
+
+	return have_body && have_real_body;
+}
+
 #define SET_LEN_AND_RETURN_STR(x) \
 	do { \
 		*len = sizeof(x) - 1; \
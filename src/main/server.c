@@ -6,6 +6,10 @@
 # include <sys/resource.h>
 #endif
 
+#if defined(LIGHTY_OS_LINUX)
+# include <linux/filter.h>
+#endif
+
 typedef struct {
 	liServerPrepareCallbackCB callback;
 	gpointer data;
@@ -16,13 +20,14 @@ static void li_server_stop(liServer *srv);
 static void state_ready_cb(liEventBase *watcher, int events);
 static void li_server_1sec_timer(liEventBase *watcher, int events);
 
-static liServerSocket* server_socket_new(liServer *srv, int fd) {
+/* loop can be NULL; the socket gets attached later by the owning worker */
+static liServerSocket* server_socket_new(liEventLoop *loop, int fd) {
 	liServerSocket *sock = g_slice_new0(liServerSocket);
 
 	sock->local_addr = li_sockaddr_local_from_socket(fd);
 	sock->refcount = 1;
 	li_fd_no_block(fd);
-	li_event_io_init(&srv->main_worker->loop, "server socket", &sock->watcher, li_server_listen_cb, fd, LI_EV_READ);
+	li_event_io_init(loop, "server socket", &sock->watcher, li_server_listen_cb, fd, LI_EV_READ);
 	return sock;
 }
 
@@ -85,6 +90,7 @@ liServer* li_server_new(const gchar *module_dir, gboolean module_resident) {
 	srv->worker_count = 0;
 
 	srv->sockets = g_ptr_array_new();
+	srv->listen_addrs = g_ptr_array_new();
 
 	srv->modules = li_modules_new(srv, module_dir, module_resident);
 
@@ -100,6 +106,9 @@ liServer* li_server_new(const gchar *module_dir, gboolean module_resident) {
 	srv->fetch_backends = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, server_fetch_db_free);
 	srv->fetch_backends_mutex = g_mutex_new();
 
+	srv->backend_pools = g_ptr_array_new();
+	srv->backend_pools_mutex = g_mutex_new();
+
 	srv->exiting = FALSE;
 
 	srv->ts_formats = g_array_new(FALSE, TRUE, sizeof(GString*));
@@ -142,8 +151,13 @@ liServer* li_server_new(const gchar *module_dir, gboolean module_resident) {
 #endif
 
 	srv->io_timeout = 300; /* default I/O timeout */
+	srv->http2 = FALSE;
+	srv->network_backend = LI_NETWORK_BACKEND_AUTO;
 	srv->keep_alive_queue_timeout = 5;
 	srv->stat_cache_ttl = 10.0; /* default stat cache ttl */
+	srv->stat_cache_max_open_files = 256; /* default per-worker open file cache size */
+	srv->stat_cache_content_size = 0; /* content cache disabled by default */
+	srv->stat_cache_content_max_file_size = 64*1024;
 	srv->tasklet_pool_threads = 4; /* default per-worker tasklet_pool threads */
 
 	return srv;
@@ -204,6 +218,10 @@ void li_server_free(liServer* srv) {
 		g_array_free(srv->workers, TRUE);
 	}
 
+	/* after the stat caches of the workers are gone */
+	li_stat_cache_inotify_free(srv->stat_cache_watch);
+	srv->stat_cache_watch = NULL;
+
 	{
 		guint i; for (i = 0; i < srv->sockets->len; i++) {
 			liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
@@ -214,6 +232,13 @@ void li_server_free(liServer* srv) {
 		g_ptr_array_free(srv->sockets, TRUE);
 	}
 
+	{
+		guint i; for (i = 0; i < srv->listen_addrs->len; i++) {
+			g_string_free(g_ptr_array_index(srv->listen_addrs, i), TRUE);
+		}
+		g_ptr_array_free(srv->listen_addrs, TRUE);
+	}
+
 	g_hash_table_remove_all(srv->fetch_backends);
 
 	/* release modules */
@@ -245,6 +270,9 @@ void li_server_free(liServer* srv) {
 	g_hash_table_destroy(srv->fetch_backends);
 	g_mutex_free(srv->fetch_backends_mutex);
 
+	g_ptr_array_free(srv->backend_pools, TRUE);
+	g_mutex_free(srv->backend_pools_mutex);
+
 	g_mutex_free(srv->action_mutex);
 
 #ifdef LIGHTY_OS_LINUX
@@ -346,6 +374,13 @@ static gboolean li_server_worker_init(liServer *srv) {
 	return TRUE;
 }
 
+static void server_reuseport_listen_cb(liServer *srv, int fd, gpointer data) {
+	liWorker *wrk = data;
+	UNUSED(srv);
+
+	li_server_listen_worker(wrk, fd);
+}
+
 static void li_server_worker_run(liServer *srv) {
 	guint i, len;
 
@@ -357,6 +392,24 @@ static void li_server_worker_run(liServer *srv) {
 	srv->prepare_callbacks = NULL;
 	li_plugins_prepare_worker(srv->main_worker);
 
+	/* workers.reuseport is only known now that the setup is complete:
+	 * every worker binds its own socket for each address, or the main worker binds one
+	 */
+	for (i = 0, len = srv->listen_addrs->len; i < len; ++i) {
+		GString *addr = g_ptr_array_index(srv->listen_addrs, i);
+		guint j;
+
+		if (!srv->reuseport) {
+			li_angel_listen(srv, addr, NULL, NULL);
+			continue;
+		}
+
+		for (j = 0; j < srv->worker_count; j++) {
+			liWorker *wrk = g_array_index(srv->workers, liWorker*, j);
+			li_angel_listen_reuseport(srv, addr, j, server_reuseport_listen_cb, wrk);
+		}
+	}
+
 	for (i = 1; i < srv->worker_count; i++) {
 		GError *error = NULL;
 		liWorker *wrk  = g_array_index(srv->workers, liWorker*, i);
@@ -377,14 +430,21 @@ static void server_connection_limit_hit(liServer *srv) {
 	srv->connection_limit_hit = TRUE;
 }
 
+/* worker context: only disables the own sockets of the worker; re-enabled in the worker stats timer */
+static void worker_connection_limit_hit(liWorker *wrk) {
+	wrk->connection_limit_hit = TRUE;
+	li_worker_listen_update(wrk, wrk);
+}
+
 static void li_server_listen_cb(liEventBase *watcher, int events) {
 	liServerSocket *sock = LI_CONTAINER_OF(li_event_io_from(watcher), liServerSocket, watcher);
 	liServer *srv = sock->srv;
 	int s;
-	liSocketAddress remote_addr;
 	liSockAddr sa;
 	socklen_t l;
 	int fd = li_event_io_fd(li_event_io_from(watcher));
+	/* the loop the socket is attached to */
+	liWorker *ctx = (NULL != sock->wrk) ? sock->wrk : srv->main_worker;
 	UNUSED(events);
 
 	for ( ;; ) {
@@ -394,7 +454,11 @@ static void li_server_listen_cb(liEventBase *watcher, int events) {
 		srv_cur_load = g_atomic_int_get(&srv->connection_load);
 		srv_max_load = g_atomic_int_get(&srv->max_connections);
 		if (srv_cur_load >= srv_max_load) {
-			server_connection_limit_hit(srv);
+			if (NULL != sock->wrk) {
+				worker_connection_limit_hit(sock->wrk);
+			} else {
+				server_connection_limit_hit(srv);
+			}
 			return;
 		}
 
@@ -413,30 +477,26 @@ static void li_server_listen_cb(liEventBase *watcher, int events) {
 		li_fd_no_block(s); /* we don't fork, don't care about FD_CLOEXEC */
 #endif
 
-		wrk = srv->main_worker;
+		wrk = ctx;
 		min_load = g_atomic_int_get(&wrk->connection_load);
 
-		if (l <= sizeof(sa)) {
-			remote_addr.addr = g_slice_alloc(l);
-			remote_addr.len = l;
-			memcpy(remote_addr.addr, &sa, l);
-		} else {
-			remote_addr = li_sockaddr_remote_from_socket(s);
-		}
-
-		for (i = 1; i < srv->worker_count; i++) {
-			liWorker *wt = g_array_index(srv->workers, liWorker*, i);
-			guint load = g_atomic_int_get(&wt->connection_load);
-			if (load < min_load) {
-				wrk = wt;
-				min_load = load;
+		/* SO_REUSEPORT sockets: the kernel already balanced, keep the connection local */
+		if (NULL == sock->wrk) {
+			for (i = 1; i < srv->worker_count; i++) {
+				liWorker *wt = g_array_index(srv->workers, liWorker*, i);
+				guint load = g_atomic_int_get(&wt->connection_load);
+				if (load < min_load) {
+					wrk = wt;
+					min_load = load;
+				}
 			}
 		}
 
 		g_atomic_int_inc((gint*) &wrk->connection_load);
 		g_atomic_int_inc((gint*) &srv->connection_load);
 		li_server_socket_acquire(sock);
-		li_worker_new_con(srv->main_worker, wrk, remote_addr, s, sock);
+		/* truncated address: li_connection_start queries the socket */
+		li_worker_new_con(ctx, wrk, (l <= sizeof(sa)) ? &sa : NULL, (l <= sizeof(sa)) ? l : 0, s, sock);
 	}
 
 #ifdef _WIN32
@@ -466,7 +526,7 @@ static void li_server_listen_cb(liEventBase *watcher, int events) {
 
 /* main worker only */
 liServerSocket* li_server_listen(liServer *srv, int fd) {
-	liServerSocket *sock = server_socket_new(srv, fd);
+	liServerSocket *sock = server_socket_new(&srv->main_worker->loop, fd);
 
 	sock->srv = srv;
 	g_ptr_array_add(srv->sockets, sock);
@@ -476,6 +536,104 @@ liServerSocket* li_server_listen(liServer *srv, int fd) {
 	return sock;
 }
 
+static GStaticMutex tls_stats_mutex = G_STATIC_MUTEX_INIT;
+
+void li_server_socket_tls_stats_add(liServerSocket *sock, gboolean resumed) {
+	g_static_mutex_lock(&tls_stats_mutex);
+	sock->tls_handshakes++;
+	if (resumed) sock->tls_resumed++;
+	g_static_mutex_unlock(&tls_stats_mutex);
+}
+
+/* srv->sockets only changes while the server isn't running */
+GArray* li_server_sockets_tls_stats(liServer *srv) {
+	GArray *stats = g_array_new(FALSE, TRUE, sizeof(liServerSocketTLSStats));
+	guint i;
+
+	g_static_mutex_lock(&tls_stats_mutex);
+	for (i = 0; i < srv->sockets->len; i++) {
+		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
+		liServerSocketTLSStats ts;
+
+		if (0 == sock->tls_handshakes) continue;
+
+		ts.address = li_sockaddr_to_string(sock->local_addr, NULL, TRUE);
+		ts.handshakes = sock->tls_handshakes;
+		ts.resumed = sock->tls_resumed;
+		g_array_append_val(stats, ts);
+	}
+	g_static_mutex_unlock(&tls_stats_mutex);
+
+	return stats;
+}
+
+void li_server_sockets_tls_stats_free(GArray *stats) {
+	guint i;
+
+	for (i = 0; i < stats->len; ++i) {
+		g_string_free(g_array_index(stats, liServerSocketTLSStats, i).address, TRUE);
+	}
+	g_array_free(stats, TRUE);
+}
+
+void li_server_listen_addr(liServer *srv, GString *str) {
+	g_ptr_array_add(srv->listen_addrs, g_string_new_len(GSTR_LEN(str)));
+}
+
+#if defined(LIGHTY_OS_LINUX) && defined(SO_ATTACH_REUSEPORT_CBPF)
+/* select socket "cpu % worker_count" in the reuseport group; the group is ordered by worker index */
+static void server_reuseport_attach_cpu_steering(liServer *srv, int fd) {
+	struct sock_filter code[] = {
+		{ BPF_LD  | BPF_W | BPF_ABS, 0, 0, SKF_AD_OFF + SKF_AD_CPU },
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, 0 },
+		{ BPF_RET | BPF_A, 0, 0, 0 },
+	};
+	struct sock_fprog prog;
+
+	code[1].k = srv->worker_count;
+	prog.len = G_N_ELEMENTS(code);
+	prog.filter = code;
+
+	if (-1 == setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog))) {
+		WARNING(srv, "couldn't attach reuseport cpu steering program: %s", g_strerror(errno));
+	}
+}
+#endif
+
+/* main worker only */
+liServerSocket* li_server_listen_worker(liWorker *wrk, int fd) {
+	liServer *srv = wrk->srv;
+	liServerSocket *sock = server_socket_new(NULL, fd);
+
+	sock->srv = srv;
+	sock->wrk = wrk;
+
+	if (srv->reuseport_cpu) {
+#if defined(LIGHTY_OS_LINUX) && defined(SO_ATTACH_REUSEPORT_CBPF)
+		server_reuseport_attach_cpu_steering(srv, fd);
+#else
+		WARNING(srv, "%s", "reuseport cpu steering not supported on this platform");
+#endif
+	}
+
+	li_worker_add_socket(wrk, sock);
+
+	return sock;
+}
+
+static void server_workers_listen(liServer *srv, gboolean active) {
+	guint i;
+
+	if (!srv->reuseport || 0 == srv->listen_addrs->len) return;
+
+	for (i = 0; i < srv->worker_count; i++) {
+		liWorker *wrk;
+		wrk = g_array_index(srv->workers, liWorker*, i);
+		g_atomic_int_set(&wrk->listen_active, active);
+		li_worker_listen_update(srv->main_worker, wrk);
+	}
+}
+
 static void li_server_start_listen(liServer *srv) {
 	guint i;
 
@@ -483,6 +641,8 @@ static void li_server_start_listen(liServer *srv) {
 		liServerSocket *sock = g_ptr_array_index(srv->sockets, i);
 		li_event_start(&sock->watcher);
 	}
+
+	server_workers_listen(srv, TRUE);
 }
 
 static void li_server_stop_listen(liServer *srv) {
@@ -494,6 +654,8 @@ static void li_server_stop_listen(liServer *srv) {
 	}
 	srv->connection_limit_hit = FALSE; /* reset flag */
 
+	server_workers_listen(srv, FALSE);
+
 	/* suspend all workers (close keep-alive connections) */
 	for (i = 0; i < srv->worker_count; i++) {
 		liWorker *wrk;
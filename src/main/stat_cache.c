@@ -2,13 +2,63 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 
+#ifdef HAVE_SYS_INOTIFY_H
+# include <sys/inotify.h>
+# include <poll.h>
+#endif
+
 #include <lighttpd/plugin_core.h>
 
+/* max ttl for entries which are not covered by inotify watches */
+#define STAT_CACHE_UNWATCHED_TTL 10.0
+
+typedef struct liStatCacheInvalidation liStatCacheInvalidation;
+struct liStatCacheInvalidation {
+	GString *path; /* NULL: flush everything */
+	gboolean prefix; /* also invalidate everything below path */
+};
+
+struct liStatCacheInotify {
+	liServer *srv;
+	int fd;
+	int stop_fds[2];
+	GThread *thread;
+
+	GMutex *lock; /* protects all fields below */
+	GHashTable *dir_wds; /* GString* directory => GINT_TO_POINTER(wd); owns the directory strings */
+	GHashTable *wd_dirs; /* GINT_TO_POINTER(wd) => GPtrArray* of directories (same inode through different paths) */
+	GPtrArray *caches; /* liStatCache* */
+	gboolean watch_limit_logged;
+};
+
+/* open file cache entry */
+typedef struct liStatCacheFile liStatCacheFile;
+struct liStatCacheFile {
+	dev_t dev;
+	ino_t ino;
+	time_t mtime;
+	off_t size;
+	gboolean is_content; /* part of the key: the open file and the content of a file are cached independently */
+
+	/* either an open file or the content of a small file */
+	liChunkFile *cf; /* cache reference */
+	liBuffer *content; /* cache reference */
+	GList lru_link; /* in files_lru or content_lru */
+};
+
 static void stat_cache_delete_cb(liWaitQueue *wq, gpointer daa);
+static void stat_cache_invalidate_cb(liJob *job);
 
 static void stat_cache_entry_release(liStatCacheEntry *sce);
 static void stat_cache_entry_acquire(liStatCacheEntry *sce);
 
+static void stat_cache_inotify_register(liStatCacheInotify *sci, liStatCache *sc);
+static void stat_cache_inotify_unregister(liStatCacheInotify *sci, liStatCache *sc);
+static gboolean stat_cache_inotify_watch(liStatCacheInotify *sci, GString *path, gboolean is_dir);
+
+static guint stat_cache_file_hash(gconstpointer key);
+static gboolean stat_cache_file_equal(gconstpointer a, gconstpointer b);
+
 liStatCache* li_stat_cache_new(liWorker *wrk, gdouble ttl) {
 	liStatCache *sc;
 
@@ -24,13 +74,140 @@ liStatCache* li_stat_cache_new(liWorker *wrk, gdouble ttl) {
 	sc->ttl = ttl;
 	sc->entries = g_hash_table_new_full((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal, NULL, NULL);
 	sc->dirlists = g_hash_table_new_full((GHashFunc)g_string_hash, (GEqualFunc)g_string_equal, NULL, NULL);
+	sc->files = g_hash_table_new(stat_cache_file_hash, stat_cache_file_equal);
+	g_queue_init(&sc->files_lru);
+	sc->files_max = wrk->srv->stat_cache_max_open_files;
+	g_queue_init(&sc->content_lru);
+	sc->content_max = wrk->srv->stat_cache_content_size;
+	sc->content_max_file_size = wrk->srv->stat_cache_content_max_file_size;
 
 	li_waitqueue_init(&sc->delete_queue, &wrk->loop, "stat cache delete queue", stat_cache_delete_cb, ttl, sc);
+	li_waitqueue_init(&sc->unwatched_queue, &wrk->loop, "stat cache unwatched delete queue", stat_cache_delete_cb, MIN(ttl, STAT_CACHE_UNWATCHED_TTL), sc);
+
+	sc->inotify = wrk->srv->stat_cache_watch;
+	if (NULL != sc->inotify) {
+		sc->invalidate_queue = g_async_queue_new();
+		li_job_init(&sc->invalidate_job, stat_cache_invalidate_cb);
+		sc->invalidate_jobref = li_job_ref(&wrk->loop.jobqueue, &sc->invalidate_job);
+		stat_cache_inotify_register(sc->inotify, sc);
+	}
 
 	return sc;
 }
 
+static guint stat_cache_file_hash(gconstpointer key) {
+	const liStatCacheFile *scf = key;
+	guint64 h = (guint64) scf->ino;
+
+	h = h * 31 + (guint64) scf->dev;
+	h = h * 31 + (guint64) scf->mtime;
+	h = h * 31 + (guint64) scf->size;
+	h = h * 31 + (guint64) scf->is_content;
+
+	return (guint) (h ^ (h >> 32));
+}
+
+static gboolean stat_cache_file_equal(gconstpointer a, gconstpointer b) {
+	const liStatCacheFile *x = a, *y = b;
+
+	return x->ino == y->ino && x->dev == y->dev && x->mtime == y->mtime && x->size == y->size && x->is_content == y->is_content;
+}
+
+static void stat_cache_file_key(liStatCacheFile *key, const struct stat *st, gboolean is_content) {
+	key->dev = st->st_dev;
+	key->ino = st->st_ino;
+	key->mtime = st->st_mtime;
+	key->size = st->st_size;
+	key->is_content = is_content;
+}
+
+static void stat_cache_file_remove(liStatCache *sc, liStatCacheFile *scf) {
+	g_hash_table_remove(sc->files, scf);
+	if (NULL != scf->content) {
+		g_queue_unlink(&sc->content_lru, &scf->lru_link);
+		sc->content_size -= scf->content->used;
+		li_buffer_release(scf->content);
+	} else {
+		g_queue_unlink(&sc->files_lru, &scf->lru_link);
+		li_chunkfile_release(scf->cf);
+	}
+	g_slice_free(liStatCacheFile, scf);
+}
+
+static void stat_cache_file_drop(liStatCache *sc, const struct stat *st, gboolean is_content) {
+	liStatCacheFile key, *scf;
+
+	stat_cache_file_key(&key, st, is_content);
+	if (NULL != (scf = g_hash_table_lookup(sc->files, &key))) {
+		stat_cache_file_remove(sc, scf);
+	}
+}
+
+static void stat_cache_file_insert(liStatCache *sc, const struct stat *st, liChunkFile *cf, liBuffer *content) {
+	liStatCacheFile *scf = g_slice_new0(liStatCacheFile);
+
+	stat_cache_file_drop(sc, st, NULL != content);
+
+	stat_cache_file_key(scf, st, NULL != content);
+	scf->lru_link.data = scf;
+	g_hash_table_insert(sc->files, scf, scf);
+
+	if (NULL != content) {
+		li_buffer_acquire(content);
+		scf->content = content;
+		sc->content_size += content->used;
+		g_queue_push_head_link(&sc->content_lru, &scf->lru_link);
+
+		while (sc->content_size > sc->content_max) {
+			stat_cache_file_remove(sc, g_queue_peek_tail(&sc->content_lru));
+		}
+	} else {
+		li_chunkfile_acquire(cf);
+		scf->cf = cf;
+		g_queue_push_head_link(&sc->files_lru, &scf->lru_link);
+
+		while (sc->files_lru.length > sc->files_max) {
+			stat_cache_file_remove(sc, g_queue_peek_tail(&sc->files_lru));
+		}
+	}
+}
+
+static gboolean stat_cache_content_wanted(liStatCache *sc, const struct stat *st) {
+	return sc->content_max > 0 && st->st_size > 0
+		&& st->st_size <= sc->content_max_file_size && (guint64) st->st_size <= sc->content_max;
+}
+
+/* read the complete file; NULL on error or if the file changed size */
+static liBuffer* stat_cache_read_content(int fd, goffset size) {
+	liBuffer *buf = li_buffer_new_slice(size);
+
+	while (buf->used < (gsize) size) {
+		ssize_t r = pread(fd, buf->addr + buf->used, size - buf->used, buf->used);
+
+		if (-1 == r) {
+			if (EINTR == errno) continue;
+			break;
+		}
+		if (0 == r) break;
+		buf->used += r;
+	}
+
+	if (buf->used != (gsize) size) {
+		li_buffer_release(buf);
+		return NULL;
+	}
+
+	return buf;
+}
+
 static void stat_cache_remove_from_cache(liStatCache *sc, liStatCacheEntry *sce) {
+	/* open file goes together with the stat info it was validated against */
+	if (sce->cached && sce->type == STAT_CACHE_ENTRY_SINGLE && g_atomic_int_get(&sce->state) == STAT_CACHE_ENTRY_FINISHED
+			&& !sce->data.failed && S_ISREG(sce->data.st.st_mode)) {
+		stat_cache_file_drop(sc, &sce->data.st, FALSE);
+		stat_cache_file_drop(sc, &sce->data.st, TRUE);
+	}
+
 	if (sce->cached) {
 		if (sce->type == STAT_CACHE_ENTRY_SINGLE) {
 			g_hash_table_remove(sc->entries, sce->data.path);
@@ -43,25 +220,66 @@ static void stat_cache_remove_from_cache(liStatCache *sc, liStatCacheEntry *sce)
 	stat_cache_entry_release(sce);
 }
 
-void li_stat_cache_free(liStatCache *sc) {
+static void stat_cache_flush(liStatCache *sc) {
 	liWaitQueueElem *wqe;
 
+	while (NULL != (wqe = li_waitqueue_pop_force(&sc->delete_queue))) {
+		liStatCacheEntry *sce = wqe->data;
+		stat_cache_remove_from_cache(sc, sce);
+	}
+
+	while (NULL != (wqe = li_waitqueue_pop_force(&sc->unwatched_queue))) {
+		liStatCacheEntry *sce = wqe->data;
+		stat_cache_remove_from_cache(sc, sce);
+	}
+}
+
+static void stat_cache_invalidation_free(liStatCacheInvalidation *inv) {
+	if (NULL != inv->path) g_string_free(inv->path, TRUE);
+	g_slice_free(liStatCacheInvalidation, inv);
+}
+
+void li_stat_cache_free(liStatCache *sc) {
 	/* check if stat cache was enabled */
 	if (!sc)
 		return;
 
-	li_waitqueue_stop(&sc->delete_queue);
+	if (NULL != sc->inotify) {
+		liStatCacheInvalidation *inv;
 
-	while (NULL != (wqe = li_waitqueue_pop_force(&sc->delete_queue))) {
-		liStatCacheEntry *sce = wqe->data;
-		stat_cache_remove_from_cache(sc, sce);
+		stat_cache_inotify_unregister(sc->inotify, sc);
+
+		while (NULL != (inv = g_async_queue_try_pop(sc->invalidate_queue))) {
+			stat_cache_invalidation_free(inv);
+		}
+		g_async_queue_unref(sc->invalidate_queue);
+
+		li_job_ref_release(sc->invalidate_jobref);
+		li_job_clear(&sc->invalidate_job);
 	}
 
+	li_stat_cache_stop(sc);
+
+	stat_cache_flush(sc);
+
+	while (sc->files_lru.length > 0) {
+		stat_cache_file_remove(sc, g_queue_peek_tail(&sc->files_lru));
+	}
+	while (sc->content_lru.length > 0) {
+		stat_cache_file_remove(sc, g_queue_peek_tail(&sc->content_lru));
+	}
+	g_hash_table_destroy(sc->files);
+
 	g_hash_table_destroy(sc->entries);
 	g_hash_table_destroy(sc->dirlists);
 	g_slice_free(liStatCache, sc);
 }
 
+void li_stat_cache_stop(liStatCache *sc) {
+	li_waitqueue_stop(&sc->delete_queue);
+	li_waitqueue_stop(&sc->unwatched_queue);
+}
+
 static void stat_cache_delete_cb(liWaitQueue *wq, gpointer data) {
 	liStatCache *sc = data;
 	liWaitQueueElem *wqe;
@@ -76,6 +294,87 @@ static void stat_cache_delete_cb(liWaitQueue *wq, gpointer data) {
 	li_waitqueue_update(wq);
 }
 
+/* drop a cached entry before its TTL is over */
+static void stat_cache_drop(liStatCache *sc, liStatCacheEntry *sce) {
+	li_waitqueue_remove(sce->queue, &sce->queue_elem);
+	stat_cache_remove_from_cache(sc, sce);
+	sc->invalidations++;
+}
+
+static void stat_cache_drop_path(liStatCache *sc, GHashTable *table, const gchar *path, gsize len) {
+	GString key = li_const_gstring(path, len);
+	liStatCacheEntry *sce = g_hash_table_lookup(table, &key);
+
+	if (NULL != sce) stat_cache_drop(sc, sce);
+}
+
+/* paths might be cached with a trailing slash */
+static void stat_cache_drop_path_variants(liStatCache *sc, GHashTable *table, GString *path) {
+	stat_cache_drop_path(sc, table, GSTR_LEN(path));
+	g_string_append_c(path, G_DIR_SEPARATOR);
+	stat_cache_drop_path(sc, table, GSTR_LEN(path));
+	g_string_truncate(path, path->len - 1);
+}
+
+static void stat_cache_drop_prefix(liStatCache *sc, GHashTable *table, GString *path) {
+	GHashTableIter it;
+	gpointer k, v;
+	GPtrArray *matches = NULL;
+	guint i;
+
+	g_hash_table_iter_init(&it, table);
+	while (g_hash_table_iter_next(&it, &k, &v)) {
+		GString *key = k;
+
+		if (key->len > path->len && key->str[path->len] == G_DIR_SEPARATOR && 0 == memcmp(key->str, path->str, path->len)) {
+			if (NULL == matches) matches = g_ptr_array_new();
+			g_ptr_array_add(matches, v);
+		}
+	}
+
+	if (NULL == matches) return;
+
+	for (i = 0; i < matches->len; i++) {
+		stat_cache_drop(sc, g_ptr_array_index(matches, i));
+	}
+	g_ptr_array_free(matches, TRUE);
+}
+
+static void stat_cache_invalidate(liStatCache *sc, GString *path, gboolean prefix) {
+	gchar *sep;
+
+	stat_cache_drop_path_variants(sc, sc->entries, path);
+	stat_cache_drop_path_variants(sc, sc->dirlists, path);
+
+	if (prefix) {
+		stat_cache_drop_prefix(sc, sc->entries, path);
+		stat_cache_drop_prefix(sc, sc->dirlists, path);
+	}
+
+	/* listing of the parent directory */
+	sep = strrchr(path->str, G_DIR_SEPARATOR);
+	if (NULL != sep) {
+		GString *parent = g_string_new_len(path->str, (sep == path->str) ? 1 : (gssize) (sep - path->str));
+		stat_cache_drop_path_variants(sc, sc->dirlists, parent);
+		g_string_free(parent, TRUE);
+	}
+}
+
+static void stat_cache_invalidate_cb(liJob *job) {
+	liStatCache *sc = LI_CONTAINER_OF(job, liStatCache, invalidate_job);
+	liStatCacheInvalidation *inv;
+
+	while (NULL != (inv = g_async_queue_try_pop(sc->invalidate_queue))) {
+		if (NULL == inv->path) {
+			sc->invalidations += g_hash_table_size(sc->entries) + g_hash_table_size(sc->dirlists);
+			stat_cache_flush(sc);
+		} else {
+			stat_cache_invalidate(sc, inv->path, inv->prefix);
+		}
+		stat_cache_invalidation_free(inv);
+	}
+}
+
 static void stat_cache_finished(gpointer data) {
 	liStatCacheEntry *sce = data;
 	guint i;
@@ -85,6 +384,13 @@ static void stat_cache_finished(gpointer data) {
 		if (NULL != sce->sc) sce->sc->errors++;
 	}
 
+	/* changes of this entry won't be notified: use the short ttl */
+	if (NULL != sce->sc && NULL != sce->inotify && !sce->watched && sce->queue == &sce->sc->delete_queue) {
+		li_waitqueue_remove(sce->queue, &sce->queue_elem);
+		sce->queue = &sce->sc->unwatched_queue;
+		li_waitqueue_push(sce->queue, &sce->queue_elem);
+	}
+
 	/* queue pending vrequests */
 	for (i = 0; i < sce->vrequests->len; i++) {
 		vr = g_ptr_array_index(sce->vrequests, i);
@@ -98,6 +404,11 @@ static void stat_cache_finished(gpointer data) {
 static void stat_cache_run(gpointer data) {
 	liStatCacheEntry *sce = data;
 
+	/* watch before stat(): changes after the watch was added get notified */
+	if (NULL != sce->inotify) {
+		sce->watched = stat_cache_inotify_watch(sce->inotify, sce->data.path, sce->type == STAT_CACHE_ENTRY_DIR);
+	}
+
 	if (stat(sce->data.path->str, &sce->data.st) == -1) {
 		sce->data.failed = TRUE;
 		sce->data.err = errno;
@@ -177,8 +488,10 @@ static liStatCacheEntry *stat_cache_entry_new(liStatCache *sc, GString *path) {
 	sce->vrequests = g_ptr_array_sized_new(8);
 	sce->state = STAT_CACHE_ENTRY_WAITING;
 	sce->queue_elem.data = sce;
+	sce->queue = &sc->delete_queue;
 	sce->refcount = 1;
 	sce->cached = TRUE;
+	sce->inotify = sc->inotify;
 
 	return sce;
 }
@@ -344,7 +657,471 @@ liHandlerResult li_stat_cache_get(liVRequest *vr, GString *path, struct stat *st
 	return stat_cache_get(vr, path, st, err, fd, TRUE);
 }
 
+liHandlerResult li_stat_cache_get_file(liVRequest *vr, GString *path, struct stat *st, int *err, liChunkFile **cf, liBuffer **content) {
+	liStatCache *sc = NULL;
+	liStatCacheEntry *sce = NULL;
+	liHandlerResult res;
+	int fd = -1;
+
+	*cf = NULL;
+	if (NULL != content) *content = NULL;
+
+	if (NULL != vr && NULL != (sc = vr->wrk->stat_cache) && (sc->files_max > 0 || sc->content_max > 0) && CORE_OPTION(LI_CORE_OPTION_ASYNC_STAT).boolean) {
+		sce = g_hash_table_lookup(sc->entries, path);
+		if (NULL != sce && (g_atomic_int_get(&sce->state) != STAT_CACHE_ENTRY_FINISHED || sce->data.failed || !S_ISREG(sce->data.st.st_mode))) {
+			sce = NULL;
+		}
+
+		if (NULL != sce) {
+			liStatCacheFile key, *scf = NULL;
+
+			if (NULL != content) {
+				stat_cache_file_key(&key, &sce->data.st, TRUE);
+				scf = g_hash_table_lookup(sc->files, &key);
+			}
+
+			if (NULL != scf) {
+				g_queue_unlink(&sc->content_lru, &scf->lru_link);
+				g_queue_push_head_link(&sc->content_lru, &scf->lru_link);
+
+				li_buffer_acquire(scf->content);
+				*content = scf->content;
+				*st = sce->data.st;
+				sc->hits++;
+				sc->content_hits++;
+				return LI_HANDLER_GO_ON;
+			}
+
+			/* don't let an open file hide a content miss: small files get their content cached next to it */
+			stat_cache_file_key(&key, &sce->data.st, FALSE);
+			scf = (NULL != content && stat_cache_content_wanted(sc, &sce->data.st)) ? NULL : g_hash_table_lookup(sc->files, &key);
+
+			if (NULL != scf) {
+				g_queue_unlink(&sc->files_lru, &scf->lru_link);
+				g_queue_push_head_link(&sc->files_lru, &scf->lru_link);
+
+				li_chunkfile_acquire(scf->cf);
+				*cf = scf->cf;
+				*st = sce->data.st;
+				sc->hits++;
+				sc->file_hits++;
+				return LI_HANDLER_GO_ON;
+			}
+		}
+	}
+
+	res = stat_cache_get(vr, path, st, err, &fd, TRUE);
+	if (LI_HANDLER_GO_ON != res) return res;
+
+	/* only cache if the opened file matches the cached stat info it will be validated against */
+	if (NULL != sce) {
+		liStatCacheFile a, b;
+
+		stat_cache_file_key(&a, &sce->data.st, FALSE);
+		stat_cache_file_key(&b, st, FALSE);
+		if (!stat_cache_file_equal(&a, &b)) sce = NULL;
+	}
+
+	if (NULL != sce && NULL != content && stat_cache_content_wanted(sc, st)) {
+		liBuffer *buf;
+
+		sc->content_misses++;
+		if (NULL != (buf = stat_cache_read_content(fd, st->st_size))) {
+			close(fd);
+			stat_cache_file_insert(sc, st, NULL, buf);
+			*content = buf;
+			return LI_HANDLER_GO_ON;
+		}
+	}
+
+	*cf = li_chunkfile_new(NULL, fd, FALSE);
+
+	if (NULL != sce && sc->files_max > 0) {
+		sc->file_misses++;
+		stat_cache_file_insert(sc, st, *cf, NULL);
+	}
+
+	return LI_HANDLER_GO_ON;
+}
+
 /* doesn't return HANDLER_WAIT_FOR_EVENT, blocks instead of async lookup */
 liHandlerResult li_stat_cache_get_sync(liVRequest *vr, GString *path, struct stat *st, int *err, int *fd) {
 	return stat_cache_get(vr, path, st, err, fd, FALSE);
 }
+
+/* inotify watcher */
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+#ifdef IN_EXCL_UNLINK
+# define STAT_CACHE_INOTIFY_EXCL_UNLINK IN_EXCL_UNLINK
+#else
+# define STAT_CACHE_INOTIFY_EXCL_UNLINK 0
+#endif
+#define STAT_CACHE_INOTIFY_MASK (IN_ATTRIB | IN_MODIFY | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO \
+	| IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR | STAT_CACHE_INOTIFY_EXCL_UNLINK)
+
+static void stat_cache_inotify_register(liStatCacheInotify *sci, liStatCache *sc) {
+	g_mutex_lock(sci->lock);
+	g_ptr_array_add(sci->caches, sc);
+	g_mutex_unlock(sci->lock);
+}
+
+static void stat_cache_inotify_unregister(liStatCacheInotify *sci, liStatCache *sc) {
+	g_mutex_lock(sci->lock);
+	g_ptr_array_remove_fast(sci->caches, sc);
+	g_mutex_unlock(sci->lock);
+}
+
+/* only absolute paths without "//", "/./" and "/../" map to the paths reported by inotify */
+static gboolean stat_cache_inotify_path_clean(GString *path) {
+	gsize i;
+
+	if (0 == path->len || G_DIR_SEPARATOR != path->str[0]) return FALSE;
+
+	for (i = 0; i < path->len; i++) {
+		if (G_DIR_SEPARATOR != path->str[i]) continue;
+		if (i + 1 < path->len && G_DIR_SEPARATOR == path->str[i+1]) return FALSE;
+		if (i + 1 < path->len && '.' == path->str[i+1]) {
+			gsize j = i + 2;
+			if (j < path->len && '.' == path->str[j]) j++;
+			if (j == path->len || G_DIR_SEPARATOR == path->str[j]) return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+/* needs lock */
+static void stat_cache_inotify_forget(liStatCacheInotify *sci, int wd) {
+	GPtrArray *dirs = g_hash_table_lookup(sci->wd_dirs, GINT_TO_POINTER(wd));
+	guint i;
+
+	if (NULL == dirs) return;
+
+	g_hash_table_steal(sci->wd_dirs, GINT_TO_POINTER(wd));
+
+	for (i = 0; i < dirs->len; i++) {
+		GString *dir = g_ptr_array_index(dirs, i);
+		gpointer other_wd;
+
+		/* the path might already be watched again with a new inode */
+		if (g_hash_table_lookup_extended(sci->dir_wds, dir, NULL, &other_wd) && GPOINTER_TO_INT(other_wd) == wd) {
+			g_hash_table_remove(sci->dir_wds, dir); /* frees dir */
+		} else {
+			g_string_free(dir, TRUE);
+		}
+	}
+
+	g_ptr_array_free(dirs, TRUE);
+}
+
+/* needs lock. drops the watches of dir and all directories below it (by path); used when an entry
+ * in a watched directory is replaced: a path going through a symlink that now points somewhere else
+ * would keep the watch of the old target. the next stat watches the new target.
+ */
+static void stat_cache_inotify_forget_path(liStatCacheInotify *sci, GString *dir, int keep_wd) {
+	GHashTableIter it;
+	gpointer key, value;
+	GPtrArray *remove = g_ptr_array_new();
+	guint i;
+
+	g_hash_table_iter_init(&it, sci->dir_wds);
+	while (g_hash_table_iter_next(&it, &key, &value)) {
+		GString *path = key;
+
+		if (path->len < dir->len || 0 != memcmp(path->str, dir->str, dir->len)) continue;
+		if (path->len > dir->len && G_DIR_SEPARATOR != path->str[dir->len]) continue;
+		if (keep_wd == GPOINTER_TO_INT(value)) continue; /* symlink loop; don't touch the watch we're handling */
+		g_ptr_array_add(remove, path);
+	}
+
+	for (i = 0; i < remove->len; i++) {
+		GString *path = g_ptr_array_index(remove, i);
+		int wd = GPOINTER_TO_INT(g_hash_table_lookup(sci->dir_wds, path));
+		GPtrArray *dirs = g_hash_table_lookup(sci->wd_dirs, GINT_TO_POINTER(wd));
+
+		g_hash_table_steal(sci->dir_wds, path);
+		if (NULL != dirs) {
+			g_ptr_array_remove_fast(dirs, path);
+			if (0 == dirs->len) {
+				g_hash_table_remove(sci->wd_dirs, GINT_TO_POINTER(wd));
+				inotify_rm_watch(sci->fd, wd);
+			}
+		}
+		g_string_free(path, TRUE);
+	}
+
+	g_ptr_array_free(remove, TRUE);
+}
+
+static void stat_cache_inotify_dirs_free(gpointer data) {
+	/* strings are owned by dir_wds */
+	g_ptr_array_free(data, TRUE);
+}
+
+/* watch the directory of path (or path itself for dirlists) and all its parents, so
+ * renames of parent directories get noticed too. missing directories are covered by
+ * IN_CREATE of a parent.
+ * called from stat threads. returns FALSE if changes might not be noticed.
+ */
+static gboolean stat_cache_inotify_watch(liStatCacheInotify *sci, GString *path, gboolean is_dir) {
+	GString *dir;
+	gboolean result = TRUE;
+
+	if (!stat_cache_inotify_path_clean(path)) return FALSE;
+
+	dir = g_string_new_len(GSTR_LEN(path));
+	while (dir->len > 1 && G_DIR_SEPARATOR == dir->str[dir->len-1]) g_string_truncate(dir, dir->len - 1);
+	if (!is_dir) {
+		gchar *sep = strrchr(dir->str, G_DIR_SEPARATOR);
+		g_string_truncate(dir, (sep == dir->str) ? 1 : (gsize) (sep - dir->str));
+	}
+
+	g_mutex_lock(sci->lock);
+
+	for ( ;; ) {
+		gchar *sep;
+
+		if (NULL == g_hash_table_lookup(sci->dir_wds, dir)) {
+			int wd = inotify_add_watch(sci->fd, dir->str, STAT_CACHE_INOTIFY_MASK);
+
+			if (-1 == wd) {
+				if (ENOENT != errno && ENOTDIR != errno) {
+					result = FALSE;
+
+					if (ENOSPC == errno && !sci->watch_limit_logged) {
+						sci->watch_limit_logged = TRUE;
+						WARNING(sci->srv, "%s", "stat_cache.inotify: watch limit reached (fs.inotify.max_user_watches), falling back to short ttl for new entries");
+					}
+				}
+			} else {
+				GString *key = g_string_new_len(GSTR_LEN(dir));
+				GPtrArray *dirs = g_hash_table_lookup(sci->wd_dirs, GINT_TO_POINTER(wd));
+
+				/* same directory might be reachable through different paths (symlinks) */
+				if (NULL == dirs) {
+					dirs = g_ptr_array_new();
+					g_hash_table_insert(sci->wd_dirs, GINT_TO_POINTER(wd), dirs);
+				}
+				g_ptr_array_add(dirs, key);
+				g_hash_table_insert(sci->dir_wds, key, GINT_TO_POINTER(wd));
+			}
+		}
+
+		if (1 == dir->len) break;
+
+		sep = strrchr(dir->str, G_DIR_SEPARATOR);
+		g_string_truncate(dir, (sep == dir->str) ? 1 : (gsize) (sep - dir->str));
+	}
+
+	g_mutex_unlock(sci->lock);
+
+	g_string_free(dir, TRUE);
+
+	return result;
+}
+
+/* needs lock. path == NULL: flush. path is consumed */
+static void stat_cache_inotify_broadcast(liStatCacheInotify *sci, GString *path, gboolean prefix) {
+	guint i;
+
+	for (i = 0; i < sci->caches->len; i++) {
+		liStatCache *sc = g_ptr_array_index(sci->caches, i);
+		liStatCacheInvalidation *inv = g_slice_new(liStatCacheInvalidation);
+
+		inv->path = (NULL == path) ? NULL : g_string_new_len(GSTR_LEN(path));
+		inv->prefix = prefix;
+		g_async_queue_push(sc->invalidate_queue, inv);
+		li_job_async(sc->invalidate_jobref);
+	}
+
+	if (NULL != path) g_string_free(path, TRUE);
+}
+
+static void stat_cache_inotify_event(liStatCacheInotify *sci, const struct inotify_event *ev) {
+	GPtrArray *dirs;
+	guint i;
+
+	g_mutex_lock(sci->lock);
+
+	if (ev->mask & IN_Q_OVERFLOW) {
+		/* events got lost; nothing in any cache can be trusted */
+		stat_cache_inotify_broadcast(sci, NULL, FALSE);
+		g_mutex_unlock(sci->lock);
+		return;
+	}
+
+	dirs = g_hash_table_lookup(sci->wd_dirs, GINT_TO_POINTER(ev->wd));
+	if (NULL == dirs) {
+		/* late event for a removed watch */
+		g_mutex_unlock(sci->lock);
+		return;
+	}
+
+	for (i = 0; i < dirs->len; i++) {
+		GString *dir = g_ptr_array_index(dirs, i);
+		GString *path = g_string_new_len(GSTR_LEN(dir));
+		gboolean prefix;
+
+		if (ev->len > 0 && '\0' != ev->name[0]) {
+			/* entry in the watched directory */
+			if (path->len > 1) g_string_append_c(path, G_DIR_SEPARATOR);
+			g_string_append(path, ev->name);
+
+			/* created, removed or renamed directories (or symlinks to watched directories): everything below changes too */
+			prefix = (0 != (ev->mask & (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO)))
+				&& ((ev->mask & IN_ISDIR) || NULL != g_hash_table_lookup(sci->dir_wds, path));
+		} else {
+			/* the watched directory itself */
+			prefix = TRUE;
+		}
+
+		if (prefix && ev->len > 0 && '\0' != ev->name[0]) stat_cache_inotify_forget_path(sci, path, ev->wd);
+
+		stat_cache_inotify_broadcast(sci, path, prefix);
+	}
+
+	if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_UNMOUNT | IN_IGNORED)) {
+		/* a moved directory would keep reporting events with the old path; watch again on next stat */
+		if (ev->mask & IN_MOVE_SELF) inotify_rm_watch(sci->fd, ev->wd);
+		stat_cache_inotify_forget(sci, ev->wd);
+	}
+
+	g_mutex_unlock(sci->lock);
+}
+
+static gpointer stat_cache_inotify_thread(gpointer data) {
+	liStatCacheInotify *sci = data;
+	union {
+		struct inotify_event ev;
+		gchar buf[16*1024];
+	} events;
+
+	for ( ;; ) {
+		struct pollfd pfd[2];
+		ssize_t len;
+		gchar *p;
+
+		pfd[0].fd = sci->fd;
+		pfd[0].events = POLLIN;
+		pfd[0].revents = 0;
+		pfd[1].fd = sci->stop_fds[0];
+		pfd[1].events = POLLIN;
+		pfd[1].revents = 0;
+
+		if (-1 == poll(pfd, 2, -1)) {
+			if (EINTR == errno) continue;
+			ERROR(sci->srv, "stat_cache.inotify: poll failed: %s", g_strerror(errno));
+			break;
+		}
+
+		if (0 != pfd[1].revents) break;
+
+		len = read(sci->fd, events.buf, sizeof(events.buf));
+		if (-1 == len) {
+			if (EINTR == errno || EAGAIN == errno) continue;
+			ERROR(sci->srv, "stat_cache.inotify: read failed: %s", g_strerror(errno));
+			break;
+		}
+
+		for (p = events.buf; p < events.buf + len; ) {
+			const struct inotify_event *ev = (const struct inotify_event*) p;
+			stat_cache_inotify_event(sci, ev);
+			p += sizeof(struct inotify_event) + ev->len;
+		}
+	}
+
+	return NULL;
+}
+
+liStatCacheInotify* li_stat_cache_inotify_new(liServer *srv) {
+	liStatCacheInotify *sci;
+	GError *err = NULL;
+	int fd;
+
+	if (-1 == (fd = inotify_init())) {
+		ERROR(srv, "stat_cache.inotify: inotify_init failed: %s", g_strerror(errno));
+		return NULL;
+	}
+	li_fd_no_block(fd);
+	li_fd_close_on_exec(fd);
+
+	sci = g_slice_new0(liStatCacheInotify);
+	sci->srv = srv;
+	sci->fd = fd;
+
+	if (-1 == pipe(sci->stop_fds)) {
+		ERROR(srv, "stat_cache.inotify: pipe failed: %s", g_strerror(errno));
+		close(fd);
+		g_slice_free(liStatCacheInotify, sci);
+		return NULL;
+	}
+	li_fd_close_on_exec(sci->stop_fds[0]);
+	li_fd_close_on_exec(sci->stop_fds[1]);
+
+	sci->lock = g_mutex_new();
+	sci->dir_wds = g_hash_table_new_full((GHashFunc) g_string_hash, (GEqualFunc) g_string_equal, li_g_string_free, NULL);
+	sci->wd_dirs = g_hash_table_new_full(g_direct_hash, g_direct_equal, NULL, stat_cache_inotify_dirs_free);
+	sci->caches = g_ptr_array_new();
+
+	if (NULL == (sci->thread = g_thread_create(stat_cache_inotify_thread, sci, TRUE, &err))) {
+		ERROR(srv, "stat_cache.inotify: could not create thread: %s", err->message);
+		g_error_free(err);
+		li_stat_cache_inotify_free(sci);
+		return NULL;
+	}
+
+	return sci;
+}
+
+void li_stat_cache_inotify_free(liStatCacheInotify *sci) {
+	if (NULL == sci) return;
+
+	if (NULL != sci->thread) {
+		ssize_t r;
+		do {
+			r = write(sci->stop_fds[1], "", 1);
+		} while (-1 == r && EINTR == errno);
+		g_thread_join(sci->thread);
+	}
+
+	LI_FORCE_ASSERT(0 == sci->caches->len);
+
+	close(sci->fd);
+	close(sci->stop_fds[0]);
+	close(sci->stop_fds[1]);
+
+	g_hash_table_destroy(sci->wd_dirs);
+	g_hash_table_destroy(sci->dir_wds);
+	g_ptr_array_free(sci->caches, TRUE);
+	g_mutex_free(sci->lock);
+
+	g_slice_free(liStatCacheInotify, sci);
+}
+
+#else
+
+static void stat_cache_inotify_register(liStatCacheInotify *sci, liStatCache *sc) {
+	UNUSED(sci); UNUSED(sc);
+}
+
+static void stat_cache_inotify_unregister(liStatCacheInotify *sci, liStatCache *sc) {
+	UNUSED(sci); UNUSED(sc);
+}
+
+static gboolean stat_cache_inotify_watch(liStatCacheInotify *sci, GString *path, gboolean is_dir) {
+	UNUSED(sci); UNUSED(path); UNUSED(is_dir);
+	return FALSE;
+}
+
+liStatCacheInotify* li_stat_cache_inotify_new(liServer *srv) {
+	ERROR(srv, "%s", "stat_cache.inotify: not supported on this platform");
+	return NULL;
+}
+
+void li_stat_cache_inotify_free(liStatCacheInotify *sci) {
+	UNUSED(sci);
+}
+
+#endif
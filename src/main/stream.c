@@ -491,6 +491,8 @@ liIOStream* li_iostream_new(liWorker *wrk, int fd, liIOStreamCB cb, gpointer dat
 
 	iostream->in_closed = iostream->out_closed = iostream->can_read = FALSE;
 	iostream->can_write = TRUE;
+	iostream->uring_writes = FALSE;
+	iostream->uring_write = NULL;
 
 	iostream->cb = cb;
 	iostream->data = data;
@@ -532,6 +534,8 @@ int li_iostream_reset(liIOStream *iostream) {
 }
 
 void li_iostream_detach(liIOStream *iostream) {
+	LI_FORCE_ASSERT(NULL == iostream->uring_write);
+
 	li_event_detach(&iostream->io_watcher);
 
 	if (NULL != iostream->stream_in_limit) {
@@ -9,8 +9,86 @@ struct liStreamHttpResponse {
 	liVRequest *vr;
 	gboolean response_headers_finished, transfer_encoding_chunked;
 	liFilterChunkedDecodeState chunked_decode_state;
+
+	/* message framing, only with li_stream_http_response_handle_framed */
+	liStreamHttpResponseDoneCB done_cb;
+	gpointer done_data;
+	goffset content_length; /* remaining body length, -1: chunked or until eof */
+	gboolean keepalive;
 };
 
+static void check_response_framing(liStreamHttpResponse* shr) {
+	liVRequest *vr = shr->vr;
+	liResponse *resp = &vr->response;
+	liHttpHeaderTokenizer header_tokenizer;
+	GString *token = vr->wrk->tmp_str;
+	gboolean connection_close = FALSE, connection_keepalive = FALSE;
+	liHttpHeader *hh;
+
+	li_http_header_tokenizer_start(&header_tokenizer, resp->headers, CONST_STR_LEN("Connection"));
+	while (li_http_header_tokenizer_next(&header_tokenizer, token)) {
+		if (0 == g_ascii_strcasecmp(token->str, "close")) {
+			connection_close = TRUE;
+		} else if (0 == g_ascii_strcasecmp(token->str, "keep-alive")) {
+			connection_keepalive = TRUE;
+		}
+	}
+	/* hop-by-hop header of the backend connection */
+	li_http_header_remove(resp->headers, CONST_STR_LEN("keep-alive"));
+
+	switch (shr->parse_response_ctx.http_version) {
+	case LI_HTTP_VERSION_1_1:
+		shr->keepalive = !connection_close;
+		break;
+	case LI_HTTP_VERSION_1_0:
+		shr->keepalive = connection_keepalive && !connection_close;
+		break;
+	default:
+		shr->keepalive = FALSE;
+		break;
+	}
+
+	shr->content_length = -1;
+	if (LI_HTTP_METHOD_HEAD == vr->request.http_method || 204 == resp->http_status || 304 == resp->http_status) {
+		/* no body, even if the headers say otherwise */
+		shr->content_length = 0;
+		shr->transfer_encoding_chunked = FALSE;
+	} else if (shr->transfer_encoding_chunked) {
+		/* chunked decoder finds the end */
+	} else if (NULL != (hh = li_http_header_lookup(resp->headers, CONST_STR_LEN("content-length")))) {
+		gchar *err;
+		gint64 r = g_ascii_strtoll(LI_HEADER_VALUE(hh), &err, 10);
+
+		if (*err != '\0' || r < 0 || r == G_MAXINT64) {
+			VR_ERROR(vr, "Invalid Content-Length in response: %s", LI_HEADER_VALUE(hh));
+			shr->keepalive = FALSE;
+		} else {
+			shr->content_length = r;
+		}
+	} else {
+		/* response ends with the connection */
+		shr->keepalive = FALSE;
+	}
+}
+
+/* response body is complete; source isn't read anymore */
+static void stream_http_response_done(liStreamHttpResponse* shr) {
+	liStreamHttpResponseDoneCB done_cb = shr->done_cb;
+	liChunkQueue *in = shr->stream.source->out;
+	/* trailing garbage or eof: can't use the connection for another request */
+	gboolean keepalive = shr->keepalive && 0 == in->length && !in->is_closed;
+	gint http_status = (NULL != shr->vr) ? shr->vr->response.http_status : 0;
+
+	shr->done_cb = NULL;
+	shr->stream.out->is_closed = TRUE;
+
+	li_stream_acquire(&shr->stream);
+	done_cb(shr->done_data, http_status, keepalive);
+	if (NULL != shr->stream.source) li_stream_disconnect(&shr->stream);
+	li_stream_notify(&shr->stream);
+	li_stream_release(&shr->stream);
+}
+
 static void check_response_header(liStreamHttpResponse* shr) {
 	liResponse *resp = &shr->vr->response;
 	GList *l;
@@ -90,6 +168,15 @@ static void check_response_header(liStreamHttpResponse* shr) {
 		return;
 	}
 
+	/* the parser skips interim responses, and 101 needs Upgrade */
+	if (resp->http_status < 200) {
+		VR_ERROR(shr->vr, "Unexpected response status %i", resp->http_status);
+		li_vrequest_error(shr->vr);
+		return;
+	}
+
+	if (NULL != shr->done_cb) check_response_framing(shr);
+
 	shr->response_headers_finished = TRUE;
 	li_vrequest_indirect_headers_ready(shr->vr);
 
@@ -128,10 +215,38 @@ static void stream_http_response_data(liStreamHttpResponse* shr) {
 			} else {
 				li_stream_reset(&shr->stream);
 			}
+		} else if (NULL != shr->done_cb && shr->stream.out->is_closed) {
+			stream_http_response_done(shr);
+			return;
 		}
 		if (shr->stream.source->out->is_closed) {
 			li_stream_disconnect(&shr->stream);
 		}
+	} else if (NULL != shr->done_cb && shr->content_length >= 0) {
+		goffset stolen = li_chunkqueue_steal_len(shr->stream.out, shr->stream.source->out, shr->content_length);
+		if (-1 == stolen) {
+			if (NULL != shr->vr) {
+				VR_ERROR(shr->vr, "%s", "Reading response body failed");
+				li_vrequest_error(shr->vr);
+			} else {
+				li_stream_reset(&shr->stream);
+			}
+			return;
+		}
+		shr->content_length -= stolen;
+		if (0 == shr->content_length) {
+			stream_http_response_done(shr);
+			return;
+		}
+		if (shr->stream.source->out->is_closed) {
+			if (NULL != shr->vr) {
+				VR_ERROR(shr->vr, "%s", "Response body shorter than Content-Length");
+				li_vrequest_error(shr->vr);
+			} else {
+				li_stream_reset(&shr->stream);
+			}
+			return;
+		}
 	} else {
 		li_chunkqueue_steal_all(shr->stream.out, shr->stream.source->out);
 		if (shr->stream.source->out->is_closed) {
@@ -180,3 +295,35 @@ LI_API liStream* li_stream_http_response_handle(liStream *http_in, liVRequest *v
 	li_stream_connect(http_in, &shr->stream);
 	return &shr->stream;
 }
+
+LI_API liStream* li_stream_http_response_handle_framed(liStream *http_in, liVRequest *vr, gboolean accept_cgi, gboolean accept_nph, liStreamHttpResponseDoneCB done_cb, gpointer done_data) {
+	liStream *stream = li_stream_http_response_handle(http_in, vr, accept_cgi, accept_nph);
+	liStreamHttpResponse *shr = LI_CONTAINER_OF(stream, liStreamHttpResponse, stream);
+
+	shr->done_cb = done_cb;
+	shr->done_data = done_data;
+	shr->content_length = -1;
+
+	return stream;
+}
+
+LI_API goffset li_stream_http_response_splice_max(liStream *stream) {
+	liStreamHttpResponse *shr = LI_CONTAINER_OF(stream, liStreamHttpResponse, stream);
+	liVRequest *vr = shr->vr;
+
+	if (NULL == shr->done_cb || NULL == stream->source || NULL == vr) return 0;
+	if (!shr->response_headers_finished || shr->transfer_encoding_chunked) return 0;
+
+	/* output filters are settled after the response headers were handled */
+	if (LI_VRS_WRITE_CONTENT != vr->state) return 0;
+	/* the data would have to be read into memory anyway (filters, ssl encrypted in userspace) */
+	if (NULL != vr->filters_out_first || (vr->coninfo->is_ssl && !vr->coninfo->is_ktls)) return 0;
+	/* http2 splits the body into DATA frames */
+	if (LI_HTTP_VERSION_2 == vr->request.http_version) return 0;
+
+	/* response ends with the connection */
+	if (shr->content_length < 0) return G_MAXOFFSET;
+
+	/* don't read beyond the response */
+	return MAX(0, shr->content_length - stream->source->out->length);
+}
@@ -43,7 +43,7 @@ static void stream_simple_socket_read_throttle_notify(liThrottleState *state, gp
 	stream->can_read = TRUE;
 	li_stream_again(&stream->stream_out);
 }
-static void stream_simple_socket_read(liIOStream *stream, gpointer *data) {
+static void stream_simple_socket_read(liIOStream *stream, gpointer *data, liChunkPipe *splice_pipe, goffset splice_max) {
 	liNetworkStatus res;
 	GError *err = NULL;
 	liWorker *wrk = li_worker_from_iostream(stream);
@@ -68,7 +68,11 @@ static void stream_simple_socket_read(liIOStream *stream, gpointer *data) {
 	{
 		goffset current_in_bytes = raw_in->bytes_in;
 		liBuffer *raw_in_buffer = *data;
-		res = li_network_read(fd, raw_in, max_read, &raw_in_buffer, &err);
+		if (NULL != splice_pipe && splice_max > 0) {
+			res = li_network_read_splice(fd, raw_in, MIN(max_read, splice_max), splice_pipe, &raw_in_buffer, &err);
+		} else {
+			res = li_network_read(fd, raw_in, max_read, &raw_in_buffer, &err);
+		}
 		*data = raw_in_buffer;
 		if (NULL != stream->throttle_in) {
 			li_throttle_update(stream->throttle_in, raw_in->bytes_in - current_in_bytes);
@@ -118,6 +122,14 @@ static void stream_simple_socket_write(liIOStream *stream) {
 
 	if (NULL != from) li_chunkqueue_steal_all(raw_out, from);
 
+#ifdef HAVE_LIBURING
+	if (NULL != stream->uring_write) {
+		/* wait for the io_uring write in flight */
+		stream->throttled_out = TRUE;
+		return;
+	}
+#endif
+
 	if (raw_out->length > 0) {
 		static const goffset WRITE_MAX = 256*1024; /* 256kB */
 		goffset write_max, current_out_bytes = raw_out->bytes_out;
@@ -132,7 +144,15 @@ static void stream_simple_socket_write(liIOStream *stream) {
 			}
 		}
 
-		res = li_network_write(fd, raw_out, write_max, &err);
+#ifdef HAVE_LIBURING
+		if (stream->uring_writes && LI_NETWORK_BACKEND_IO_URING == wrk->srv->network_backend
+		    && li_network_uring_write(stream, write_max)) {
+			/* the write is in flight; the data stays in raw_out until it completes */
+			return;
+		}
+#endif
+
+		res = li_network_write(fd, raw_out, write_max, wrk->srv->network_backend, &wrk->stats.write_syscalls, &err);
 
 		if (NULL != stream->throttle_out) {
 			li_throttle_update(stream->throttle_out, raw_out->bytes_out - current_out_bytes);
@@ -170,9 +190,13 @@ void li_stream_simple_socket_io_cb(liIOStream *stream, liIOStreamEvent event) {
 }
 
 void li_stream_simple_socket_io_cb_with_context(liIOStream *stream, liIOStreamEvent event, gpointer *data) {
+	li_stream_simple_socket_io_cb_with_splice(stream, event, data, NULL, 0);
+}
+
+void li_stream_simple_socket_io_cb_with_splice(liIOStream *stream, liIOStreamEvent event, gpointer *data, liChunkPipe *splice_pipe, goffset splice_max) {
 	switch (event) {
 	case LI_IOSTREAM_READ:
-		stream_simple_socket_read(stream, data);
+		stream_simple_socket_read(stream, data, splice_pipe, splice_max);
 		break;
 	case LI_IOSTREAM_WRITE:
 		stream_simple_socket_write(stream);
@@ -313,6 +313,7 @@ static liSubrequest* subrequest_new(liVRequest *vr) {
 	sr->coninfo.remote_addr_str = g_string_new_len(GSTR_LEN(vr->coninfo->remote_addr_str));
 	sr->coninfo.local_addr_str = g_string_new_len(GSTR_LEN(vr->coninfo->local_addr_str));
 	sr->coninfo.is_ssl = vr->coninfo->is_ssl;
+	sr->coninfo.is_ktls = vr->coninfo->is_ktls;
 	sr->coninfo.keep_alive = FALSE; /* doesn't mean anything here anyway */
 
 	sr->coninfo.req = li_stream_null_new(&vr->wrk->loop);
@@ -47,6 +47,8 @@ liVRequest* li_vrequest_new(liWorker *wrk, liConInfo *coninfo) {
 
 	vr->stat_cache_entries = g_ptr_array_sized_new(2);
 
+	li_condition_cache_init(&vr->cond_cache);
+
 	return vr;
 }
 
@@ -96,6 +98,8 @@ void li_vrequest_free(liVRequest* vr) {
 	}
 	g_ptr_array_free(vr->stat_cache_entries, TRUE);
 
+	li_condition_cache_clear(&vr->cond_cache);
+
 	g_slice_free(liVRequest, vr);
 }
 
@@ -138,6 +142,8 @@ void li_vrequest_reset(liVRequest *vr, gboolean keepalive) {
 		li_stat_cache_entry_release(vr, sce);
 	}
 
+	li_condition_cache_reset(&vr->cond_cache);
+
 	memcpy(vr->options, srv->option_def_values->data, srv->option_def_values->len * sizeof(liOptionValue));
 	{
 		guint i;
@@ -190,6 +196,7 @@ void li_vrequest_start(liVRequest *vr) {
 	}
 
 	vr->ts_started = li_cur_ts(vr->wrk);
+	vr->ts_response_headers = 0;
 }
 
 /* received all request headers */
@@ -386,6 +393,7 @@ void li_vrequest_indirect_headers_ready(liVRequest* vr) {
 	LI_FORCE_ASSERT(LI_VRS_HANDLE_RESPONSE_HEADERS > vr->state);
 
 	vr->state = LI_VRS_HANDLE_RESPONSE_HEADERS;
+	vr->ts_response_headers = li_cur_ts(vr->wrk);
 
 	li_vrequest_joblist_append(vr);
 }
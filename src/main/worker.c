@@ -95,6 +95,11 @@ static void worker_close_idle_connections(liWorker *wrk) {
 		case LI_CON_STATE_KEEP_ALIVE:
 			li_connection_reset(con);
 			break;
+		case LI_CON_STATE_HTTP2:
+			/* no new streams; close after the active ones are done */
+			li_http2_connection_shutdown(con->http2);
+			li_connection_update_io_wait(con);
+			break;
 		default:
 			/* update if wrk->wait_for_stop_connections.active changed */
 			li_connection_update_io_wait(con);
@@ -149,6 +154,12 @@ static void li_worker_prepare_cb(liEventBase *watcher, int events) {
 	liServer *srv = wrk->srv;
 	UNUSED(events);
 
+	/* about to wait for events again: account the time since the wakeup as busy */
+	if (0 != wrk->loop_wakeup_ts) {
+		wrk->loop_busy += li_event_time() - wrk->loop_wakeup_ts;
+		wrk->loop_wakeup_ts = 0;
+	}
+
 	/* are there pending log entries? */
 	if (g_queue_get_length(&wrk->logs.log_queue)) {
 		/* take log entries from local queue, insert into global queue and notify log thread */
@@ -161,6 +172,14 @@ static void li_worker_prepare_cb(liEventBase *watcher, int events) {
 	}
 }
 
+static void li_worker_check_cb(liEventBase *watcher, int events) {
+	liWorker *wrk = LI_CONTAINER_OF(li_event_check_from(watcher), liWorker, loop_check);
+	UNUSED(events);
+
+	/* the loop time was just updated after polling */
+	wrk->loop_wakeup_ts = li_cur_ts(wrk);
+}
+
 /* stop worker watcher */
 static void li_worker_stop_cb(liEventBase *watcher, int events) {
 	liWorker *wrk = LI_CONTAINER_OF(li_event_async_from(watcher), liWorker, worker_stop_watcher);
@@ -193,37 +212,136 @@ static void li_worker_exit_cb(liEventBase *watcher, int events) {
 	li_worker_exit(wrk, wrk);
 }
 
-typedef struct li_worker_new_con_data li_worker_new_con_data;
-struct li_worker_new_con_data {
-	liSocketAddress remote_addr;
-	int s;
-	liServerSocket *srv_sock;
-};
-
 /* new con watcher */
-void li_worker_new_con(liWorker *ctx, liWorker *wrk, liSocketAddress remote_addr, int s, liServerSocket *srv_sock) {
-	if (ctx == wrk) {
-		liConnection *con = worker_con_get(wrk);
 
-		li_connection_start(con, remote_addr, s, srv_sock);
+/* bounded MPSC ring (after D. Vyukov's bounded queue): slot "pos & mask" is free for
+ * pos if sequence == pos and filled if sequence == pos + 1; after taking the consumer
+ * releases it for pos + LI_WORKER_NEW_CON_RING_SIZE.
+ */
+static gboolean worker_new_con_push(liWorker *wrk, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock) {
+	liWorkerNewCon *slot;
+	guint pos;
+
+	for ( ;; ) {
+		gint diff;
+
+		pos = (guint) g_atomic_int_get((gint*) &wrk->new_con_head);
+		slot = &wrk->new_con_ring[pos & (LI_WORKER_NEW_CON_RING_SIZE - 1)];
+		diff = (gint) ((guint) g_atomic_int_get((gint*) &slot->sequence) - pos);
+
+		if (0 == diff) {
+			if (g_atomic_int_compare_and_exchange((gint*) &wrk->new_con_head, (gint) pos, (gint) (pos + 1))) break;
+		} else if (diff < 0) {
+			return FALSE; /* full */
+		}
+		/* else another producer claimed pos; retry */
+	}
+
+	slot->s = s;
+	slot->srv_sock = srv_sock;
+	if (NULL != remote_addr && remote_addr_len <= sizeof(slot->remote_addr)) {
+		memcpy(&slot->remote_addr, remote_addr, remote_addr_len);
+		slot->remote_addr_len = remote_addr_len;
 	} else {
-		li_worker_new_con_data *d = g_slice_new(li_worker_new_con_data);
-		d->remote_addr = remote_addr;
-		d->s = s;
-		d->srv_sock = srv_sock;
-		g_async_queue_push(wrk->new_con_queue, d);
+		slot->remote_addr_len = 0;
+	}
+	g_atomic_int_set((gint*) &slot->sequence, (gint) (pos + 1));
+
+	/* coalesce notifications: the consumer clears the flag before draining */
+	if (g_atomic_int_compare_and_exchange(&wrk->new_con_wakeup, 0, 1)) {
 		li_event_async_send(&wrk->new_con_watcher);
 	}
+
+	return TRUE;
+}
+
+void li_worker_new_con(liWorker *ctx, liWorker *wrk, const liSockAddr *remote_addr, socklen_t remote_addr_len, int s, liServerSocket *srv_sock) {
+	liConnection *con;
+
+	if (ctx != wrk) {
+		if (worker_new_con_push(wrk, remote_addr, remote_addr_len, s, srv_sock)) return;
+
+		/* ring full: keep the connection */
+		g_atomic_int_add((gint*) &wrk->connection_load, -1);
+		g_atomic_int_inc((gint*) &ctx->connection_load);
+		ctx->stats.new_con_ring_full++;
+		wrk = ctx;
+	}
+
+	con = worker_con_get(wrk);
+	li_connection_start(con, remote_addr, remote_addr_len, s, srv_sock);
 }
 
 static void li_worker_new_con_cb(liEventBase *watcher, int events) {
 	liWorker *wrk = LI_CONTAINER_OF(li_event_async_from(watcher), liWorker, new_con_watcher);
-	li_worker_new_con_data *d;
+	guint batch = 0;
+	UNUSED(events);
+
+	g_atomic_int_set(&wrk->new_con_wakeup, 0);
+
+	for ( ;; ) {
+		guint pos = wrk->new_con_tail;
+		liWorkerNewCon *slot = &wrk->new_con_ring[pos & (LI_WORKER_NEW_CON_RING_SIZE - 1)];
+		liConnection *con;
+
+		if ((guint) g_atomic_int_get((gint*) &slot->sequence) != pos + 1) break; /* empty or not published yet */
+
+		con = worker_con_get(wrk);
+		li_connection_start(con, slot->remote_addr_len > 0 ? &slot->remote_addr : NULL, slot->remote_addr_len, slot->s, slot->srv_sock);
+
+		g_atomic_int_set((gint*) &slot->sequence, (gint) (pos + LI_WORKER_NEW_CON_RING_SIZE));
+		wrk->new_con_tail = pos + 1;
+		batch++;
+	}
+
+	if (batch > 0) {
+		guint bucket = g_bit_storage(batch) - 1;
+		if (bucket >= LI_WORKER_NEW_CON_BATCH_BUCKETS) bucket = LI_WORKER_NEW_CON_BATCH_BUCKETS - 1;
+		wrk->stats.new_con_batches[bucket]++;
+		if (batch > wrk->stats.new_con_batch_max) wrk->stats.new_con_batch_max = batch;
+	}
+}
+
+/* own listen sockets (workers.reuseport) */
+void li_worker_add_socket(liWorker *wrk, liServerSocket *srv_sock) {
+	g_async_queue_push(wrk->new_socket_queue, srv_sock);
+	li_event_async_send(&wrk->listen_watcher);
+}
+
+static void worker_listen_apply(liWorker *wrk) {
+	liServerSocket *sock;
+	gboolean active;
+	guint i;
+
+	while (NULL != (sock = g_async_queue_try_pop(wrk->new_socket_queue))) {
+		li_event_attach(&wrk->loop, &sock->watcher);
+		g_ptr_array_add(wrk->sockets, sock);
+	}
+
+	active = g_atomic_int_get(&wrk->listen_active) && !wrk->connection_limit_hit;
+
+	for (i = 0; i < wrk->sockets->len; i++) {
+		sock = g_ptr_array_index(wrk->sockets, i);
+		if (active) {
+			li_event_start(&sock->watcher);
+		} else {
+			li_event_stop(&sock->watcher);
+		}
+	}
+}
+
+static void li_worker_listen_cb(liEventBase *watcher, int events) {
+	liWorker *wrk = LI_CONTAINER_OF(li_event_async_from(watcher), liWorker, listen_watcher);
 	UNUSED(events);
 
-	while (NULL != (d = g_async_queue_try_pop(wrk->new_con_queue))) {
-		li_worker_new_con(wrk, wrk, d->remote_addr, d->s, d->srv_sock);
-		g_slice_free(li_worker_new_con_data, d);
+	worker_listen_apply(wrk);
+}
+
+void li_worker_listen_update(liWorker *context, liWorker *wrk) {
+	if (context == wrk) {
+		worker_listen_apply(wrk);
+	} else {
+		li_event_async_send(&wrk->listen_watcher);
 	}
 }
 
@@ -240,7 +358,15 @@ static void worker_stats_watcher_cb(liEventBase *watcher, int events) {
 			if (wrk->stats.requests_per_sec > 0)
 			DEBUG(wrk->srv, "worker %u: %.2f requests per second", wrk->ndx, wrk->stats.requests_per_sec);
 #endif
+
+		{
+			/* the busy time of the running iteration is counted in the next interval */
+			gdouble load = wrk->loop_busy / (now - wrk->stats.last_update);
+			if (load > 1) load = 1;
+			wrk->stats.loop_load = (wrk->stats.loop_load + load) / 2;
+		}
 	}
+	wrk->loop_busy = 0;
 
 	/* 5s averages and peak values */
 	if ((now - wrk->stats.last_avg) > 5) {
@@ -271,6 +397,15 @@ static void worker_stats_watcher_cb(liEventBase *watcher, int events) {
 	wrk->stats.last_requests = wrk->stats.requests;
 	wrk->stats.last_update = now;
 
+	if (wrk->connection_limit_hit) {
+		guint srv_cur_load = g_atomic_int_get(&wrk->srv->connection_load);
+		guint srv_max_load = g_atomic_int_get(&wrk->srv->max_connections);
+		if (srv_cur_load <= (srv_max_load - srv_max_load/8)) { /* cur_load <= 7/8 * max_load */
+			wrk->connection_limit_hit = FALSE;
+			worker_listen_apply(wrk);
+		}
+	}
+
 	/* and run again next second */
 	li_event_timer_once(&wrk->stats_watcher, 1);
 }
@@ -308,13 +443,25 @@ liWorker* li_worker_new(liServer *srv, struct ev_loop *loop) {
 	}
 
 	li_event_prepare_init(&wrk->loop, "worker flush logs", &wrk->loop_prepare, li_worker_prepare_cb);
+	li_event_check_init(&wrk->loop, "worker loop load", &wrk->loop_check, li_worker_check_cb);
 	li_event_async_init(&wrk->loop, "worker stop", &wrk->worker_stop_watcher, li_worker_stop_cb);
 	li_event_async_init(&wrk->loop, "worker stopping", &wrk->worker_stopping_watcher, li_worker_stopping_cb);
 	li_event_async_init(&wrk->loop, "worker exit", &wrk->worker_exit_watcher, li_worker_exit_cb);
 	li_event_async_init(&wrk->loop, "worker suspend", &wrk->worker_suspend_watcher, li_worker_suspend_cb);
 
 	li_event_async_init(&wrk->loop, "worker new connection", &wrk->new_con_watcher, li_worker_new_con_cb);
-	wrk->new_con_queue = g_async_queue_new();
+	wrk->new_con_ring = g_new(liWorkerNewCon, LI_WORKER_NEW_CON_RING_SIZE);
+	{
+		guint i;
+		for (i = 0; i < LI_WORKER_NEW_CON_RING_SIZE; i++)
+			wrk->new_con_ring[i].sequence = i;
+	}
+	wrk->new_con_head = wrk->new_con_tail = 0;
+	wrk->new_con_wakeup = 0;
+
+	li_event_async_init(&wrk->loop, "worker listen", &wrk->listen_watcher, li_worker_listen_cb);
+	wrk->new_socket_queue = g_async_queue_new();
+	wrk->sockets = g_ptr_array_new();
 
 	li_event_timer_init(&wrk->loop, "worker stats update", &wrk->stats_watcher, worker_stats_watcher_cb);
 	li_event_set_keep_loop_alive(&wrk->stats_watcher, FALSE);
@@ -360,6 +507,10 @@ struct ev_loop* li_worker_free(liWorker *wrk) {
 		g_array_free(wrk->connections, TRUE);
 	}
 
+#ifdef HAVE_LIBURING
+	li_network_uring_free(wrk);
+#endif
+
 	{ /* free timestamps */
 		guint i;
 		for (i = 0; i < wrk->timestamps_gmt->len; i++) {
@@ -379,8 +530,28 @@ struct ev_loop* li_worker_free(liWorker *wrk) {
 	li_event_clear(&wrk->worker_exit_watcher);
 
 	li_event_clear(&wrk->new_con_watcher);
-	g_async_queue_unref(wrk->new_con_queue);
-	wrk->new_con_queue = NULL;
+	g_free(wrk->new_con_ring);
+	wrk->new_con_ring = NULL;
+
+	{ /* close own listen sockets */
+		liServerSocket *sock;
+		guint i;
+
+		while (NULL != (sock = g_async_queue_try_pop(wrk->new_socket_queue))) {
+			g_ptr_array_add(wrk->sockets, sock);
+		}
+		for (i = 0; i < wrk->sockets->len; i++) {
+			sock = g_ptr_array_index(wrk->sockets, i);
+			close(li_event_io_fd(&sock->watcher));
+			li_event_clear(&sock->watcher);
+			li_server_socket_release(sock);
+		}
+		g_ptr_array_free(wrk->sockets, TRUE);
+		wrk->sockets = NULL;
+	}
+	li_event_clear(&wrk->listen_watcher);
+	g_async_queue_unref(wrk->new_socket_queue);
+	wrk->new_socket_queue = NULL;
 
 	li_event_clear(&wrk->stats_watcher);
 
@@ -390,6 +561,7 @@ struct ev_loop* li_worker_free(liWorker *wrk) {
 	wrk->collect_queue = NULL;
 
 	li_event_clear(&wrk->loop_prepare);
+	li_event_clear(&wrk->loop_check);
 
 	g_string_free(wrk->tmp_str, TRUE);
 
@@ -426,6 +598,10 @@ void li_worker_run(liWorker *wrk) {
 		}
 	}
 
+	/* main worker runs first; the inotify watcher is shared by the stat caches of all workers */
+	if (wrk == wrk->srv->main_worker && wrk->srv->stat_cache_ttl && wrk->srv->stat_cache_inotify && !wrk->srv->stat_cache_watch)
+		wrk->srv->stat_cache_watch = li_stat_cache_inotify_new(wrk->srv);
+
 	/* setup stat cache if necessary */
 	if (wrk->srv->stat_cache_ttl && !wrk->stat_cache)
 		wrk->stat_cache = li_stat_cache_new(wrk, wrk->srv->stat_cache_ttl);
@@ -445,8 +621,12 @@ void li_worker_stop(liWorker *context, liWorker *wrk) {
 
 		li_event_stop(&wrk->new_con_watcher);
 
+		g_atomic_int_set(&wrk->listen_active, FALSE);
+		worker_listen_apply(wrk);
+		li_event_stop(&wrk->listen_watcher);
+
 		if (wrk->stat_cache)
-			li_waitqueue_stop(&wrk->stat_cache->delete_queue);
+			li_stat_cache_stop(wrk->stat_cache);
 		/* handle remaining new connections. there shouldn't be any, we'll kill them soon anyway */
 		li_worker_new_con_cb(&wrk->new_con_watcher.base, 0);
 
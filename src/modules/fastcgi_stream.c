@@ -24,6 +24,11 @@ enum FCGI_Type {
 };
 #define FCGI_MAXTYPE (FCGI_UNKNOWN_TYPE)
 
+/* multiplexed connections: limit for the records waiting to be sent to the backend, and
+ * for the records read from the backend but not decoded yet (per direction)
+ */
+#define FASTCGI_MUX_QUEUE_LIMIT (256*1024)
+
 enum FCGI_Flags {
 	FCGI_KEEP_CONN  = 1
 };
@@ -58,9 +63,24 @@ struct liFastCGIBackendContext {
 
 	liStream fcgi_out, fcgi_in;
 
-	/* for now: no multiplexing, at most one connection */
-	liFastCGIBackendConnection_p *currentcon;
-	gboolean stdin_closed, stdout_closed, stderr_closed, request_done;
+	/* one request at a time (no multiplexing configured): the vrequest streams are connected
+	 * to fcgi_out and fcgi_in directly, so the vrequest limits apply to the backend connection.
+	 * otherwise every request has its own streams, and the connection has its own limits.
+	 */
+	gboolean direct;
+	liCQLimit *in_limit, *out_limit; /* NULL if direct */
+	liFastCGIBackendConnection_p *stdout_blocked; /* decoding waits until the response queue of this request has room */
+
+	/* requests on this connection: index requestID-1 => (liFastCGIBackendConnection_p*) or NULL */
+	GPtrArray *requests;
+	guint active_requests;
+	guint started_requests; /* all requests on this connection so far, for max_requests */
+
+	gboolean keepalive;  /* send FCGI_KEEP_CONN and reuse the connection */
+	gboolean mpxs_conns; /* backend accepts more than one request at a time (FCGI_MPXS_CONNS) */
+	guint max_reqs;      /* concurrent requests on this connection */
+	GQueue *mux_queue;   /* queue mux_link is in (NULL if none): connection can take more requests */
+	GList mux_link;
 
 	/* current record */
 	guint8 version;
@@ -73,14 +93,25 @@ struct liFastCGIBackendContext {
 
 struct liFastCGIBackendConnection_p {
 	liFastCGIBackendConnection public;
-	liFastCGIBackendContext *ctx;
+	gint refcount; /* stdin_stream, stdout_stream */
+	liFastCGIBackendContext *ctx; /* NULL after the request id was released */
+	guint16 requestid;
+
+	liVRequest *vr; /* NULL after li_fastcgi_backend_put() */
 
-	liVRequest *vr;
+	liStream stdin_stream;  /* request body -> FCGI_STDIN records */
+	liStream stdout_stream; /* FCGI_STDOUT records -> response */
+
+	gboolean stdin_closed, stdout_closed, stderr_closed, request_done;
+	gboolean aborted; /* sent FCGI_ABORT_REQUEST, waiting for FCGI_END_REQUEST */
 };
 
 struct liFastCGIBackendPool_p {
 	liFastCGIBackendPool public;
 	const liFastCGIBackendCallbacks *callbacks;
+	guint multiplex;
+
+	gpointer mux_queues; /* (GQueue[worker_count]) per worker connections which can take more requests; created on first use */
 
 	liBackendConfig config;
 };
@@ -124,6 +155,10 @@ static const gchar* fcgi_type_string(enum FCGI_Type type) {
 
 static void fastcgi_stream_out(liStream *stream, liStreamEvent event);
 static void fastcgi_stream_in(liStream *stream, liStreamEvent event);
+static void fastcgi_out_limit_cb(gpointer context, gboolean locked);
+static void stream_send_get_values(liChunkQueue *out);
+static void fastcgi_request_fail(liFastCGIBackendConnection_p *con);
+static liBackendCheckResult backend_check(liBackendPool *bpool, const GString *response, gboolean eof);
 
 static void backend_detach_thread(liBackendPool *bpool, liWorker *wrk, liBackendConnection *bcon) {
 	liFastCGIBackendContext *ctx = bcon->data;
@@ -132,8 +167,8 @@ static void backend_detach_thread(liBackendPool *bpool, liWorker *wrk, liBackend
 	LI_FORCE_ASSERT(wrk == ctx->wrk);
 	ctx->wrk = NULL;
 
-	li_stream_disconnect(&ctx->fcgi_out);
-	li_stream_disconnect_dest(&ctx->fcgi_in);
+	LI_FORCE_ASSERT(0 == ctx->active_requests);
+	LI_FORCE_ASSERT(NULL == ctx->mux_queue);
 
 	LI_FORCE_ASSERT(2 == ctx->fcgi_in.refcount);
 	LI_FORCE_ASSERT(2 == ctx->fcgi_out.refcount);
@@ -165,12 +200,39 @@ static void backend_new(liBackendPool *bpool, liWorker *wrk, liBackendConnection
 	ctx->iostream = li_iostream_new(wrk, li_event_io_fd(&bcon->watcher), li_stream_simple_socket_io_cb, NULL);
 	li_event_set_keep_loop_alive(&ctx->iostream->io_watcher, FALSE);
 
+	ctx->requests = g_ptr_array_new();
+	ctx->keepalive = (pool->multiplex > 0);
+	ctx->direct = (pool->multiplex <= 1);
+	ctx->max_reqs = 1; /* until the backend says it can multiplex */
+	ctx->mux_link.data = ctx;
+
 	li_stream_init(&ctx->fcgi_out, &wrk->loop, fastcgi_stream_out);
 	li_stream_init(&ctx->fcgi_in, &wrk->loop, fastcgi_stream_in);
 
 	li_stream_connect(&ctx->iostream->stream_in, &ctx->fcgi_in);
 	li_stream_connect(&ctx->fcgi_out, &ctx->iostream->stream_out);
 
+	if (!ctx->direct) {
+		/* stop reading from the backend while the records are not decoded (a response queue is full) */
+		ctx->in_limit = li_cqlimit_new();
+		li_cqlimit_set_limit(ctx->in_limit, FASTCGI_MUX_QUEUE_LIMIT);
+		li_stream_set_cqlimit(NULL, &ctx->fcgi_in, ctx->in_limit);
+
+		/* stop sending request bodies while the backend doesn't read them */
+		ctx->out_limit = li_cqlimit_new();
+		ctx->out_limit->notify = fastcgi_out_limit_cb;
+		ctx->out_limit->context = ctx;
+		li_cqlimit_set_limit(ctx->out_limit, FASTCGI_MUX_QUEUE_LIMIT);
+		li_chunkqueue_set_limit(ctx->fcgi_out.out, ctx->out_limit);
+		li_chunkqueue_set_limit(ctx->iostream->stream_out.out, ctx->out_limit);
+	}
+
+	if (pool->multiplex > 1) {
+		/* the answer arrives before or with the response to the first request */
+		stream_send_get_values(ctx->fcgi_out.out);
+		li_stream_notify_later(&ctx->fcgi_out);
+	}
+
 	ctx->subcon = bcon;
 	bcon->data = ctx;
 }
@@ -178,6 +240,7 @@ static void backend_new(liBackendPool *bpool, liWorker *wrk, liBackendConnection
 static void backend_ctx_unref(liFastCGIBackendContext *ctx) {
 	LI_FORCE_ASSERT(g_atomic_int_get(&ctx->refcount) > 0);
 	if (g_atomic_int_dec_and_test(&ctx->refcount)) {
+		g_ptr_array_free(ctx->requests, TRUE);
 		g_slice_free(liFastCGIBackendContext, ctx);
 	}
 }
@@ -191,10 +254,21 @@ static void backend_close(liBackendPool *bpool, liWorker *wrk, liBackendConnecti
 
 	ctx->pool = NULL;
 
-	LI_FORCE_ASSERT(NULL == ctx->currentcon);
+	LI_FORCE_ASSERT(0 == ctx->active_requests);
+	LI_FORCE_ASSERT(NULL == ctx->mux_queue);
 
 	fcgi_debug("backend_close\n");
 
+	/* the queues keep their references to the limits until they are reset */
+	if (NULL != ctx->out_limit) {
+		ctx->out_limit->notify = NULL;
+		ctx->out_limit->context = NULL;
+		li_cqlimit_release(ctx->out_limit);
+		ctx->out_limit = NULL;
+	}
+	li_cqlimit_release(ctx->in_limit);
+	ctx->in_limit = NULL;
+
 	if (NULL != ctx->iostream) {
 		int fd;
 		li_stream_simple_socket_close(ctx->iostream, FALSE);
@@ -217,6 +291,9 @@ static void backend_free(liBackendPool *bpool) {
 	liFastCGIBackendPool_p *pool = LI_CONTAINER_OF(bpool->config, liFastCGIBackendPool_p, config);
 
 	li_sockaddr_clear(&pool->config.sock_addr);
+	if (NULL != pool->config.check_request) g_string_free(pool->config.check_request, TRUE);
+
+	g_free(pool->mux_queues);
 
 	g_slice_free(liFastCGIBackendPool_p, pool);
 }
@@ -226,42 +303,74 @@ static liBackendCallbacks backend_cbs = {
 	backend_attach_thread,
 	backend_new,
 	backend_close,
-	backend_free
+	backend_free,
+	backend_check
 };
 
+/* each worker only uses its own queue, no locking needed */
+static GQueue* fastcgi_mux_queue(liFastCGIBackendPool_p *pool, liWorker *wrk) {
+	GQueue *queues = g_atomic_pointer_get(&pool->mux_queues);
+
+	if (NULL == queues) {
+		queues = g_new0(GQueue, wrk->srv->worker_count);
+		if (!g_atomic_pointer_compare_and_exchange(&pool->mux_queues, NULL, queues)) {
+			g_free(queues);
+			queues = g_atomic_pointer_get(&pool->mux_queues);
+		}
+	}
+
+	return &queues[wrk->ndx];
+}
+
+/* a connection is in the queue of its worker as long as it can take more requests */
+static void fastcgi_mux_update(liFastCGIBackendContext *ctx) {
+	gboolean available = NULL != ctx->pool && ctx->is_active && ctx->mpxs_conns && NULL != ctx->iostream
+		&& ctx->active_requests < ctx->max_reqs
+		&& (ctx->pool->config.max_requests <= 0 || ctx->started_requests < (guint) ctx->pool->config.max_requests);
+
+	if (available && NULL == ctx->mux_queue) {
+		ctx->mux_queue = fastcgi_mux_queue(ctx->pool, ctx->wrk);
+		g_queue_push_tail_link(ctx->mux_queue, &ctx->mux_link);
+	} else if (!available && NULL != ctx->mux_queue) {
+		g_queue_unlink(ctx->mux_queue, &ctx->mux_link);
+		ctx->mux_queue = NULL;
+	}
+}
+
 static void fastcgi_check_put(liFastCGIBackendContext *ctx) {
-	/* wait for li_fastcgi_backend_put() */
-	if (NULL != ctx->currentcon) return;
+	/* wait for all requests on the connection */
+	if (0 != ctx->active_requests) return;
 	/* already inactive */
 	if (!ctx->is_active) return;
-	/* wait for vrequest streams to disconnect */
-	if (NULL != ctx->fcgi_in.dest || NULL != ctx->fcgi_out.source) return;
 
-	li_stream_disconnect(&ctx->fcgi_out);
-	li_stream_disconnect_dest(&ctx->fcgi_in);
+	if (ctx->direct) {
+		/* wait for vrequest streams to disconnect */
+		if (NULL != ctx->fcgi_in.dest || NULL != ctx->fcgi_out.source) return;
 
-	ctx->is_active = FALSE;
+		li_stream_set_cqlimit(NULL, &ctx->fcgi_in, NULL);
+		li_stream_set_cqlimit(&ctx->fcgi_out, NULL, NULL);
+	}
 
-	li_stream_set_cqlimit(NULL, &ctx->fcgi_in, NULL);
-	li_stream_set_cqlimit(&ctx->fcgi_out, NULL, NULL);
+	ctx->is_active = FALSE;
+	fastcgi_mux_update(ctx);
 
 	if (NULL != ctx->iostream) {
 		li_event_io_set_fd(&ctx->subcon->watcher, li_event_io_fd(&ctx->iostream->io_watcher));
 		li_event_set_keep_loop_alive(&ctx->iostream->io_watcher, FALSE);
-		LI_FORCE_ASSERT(NULL == ctx->iostream->stream_in.out->limit);
-		LI_FORCE_ASSERT(NULL == ctx->iostream->stream_out.out->limit);
+		LI_FORCE_ASSERT(ctx->in_limit == ctx->iostream->stream_in.out->limit);
+		LI_FORCE_ASSERT(ctx->out_limit == ctx->iostream->stream_out.out->limit);
 	} else {
 		li_event_io_set_fd(&ctx->subcon->watcher, -1);
 	}
 
-	LI_FORCE_ASSERT(NULL == ctx->fcgi_in.out->limit);
-	LI_FORCE_ASSERT(NULL == ctx->fcgi_out.out->limit);
+	LI_FORCE_ASSERT(ctx->in_limit == ctx->fcgi_in.out->limit);
+	LI_FORCE_ASSERT(ctx->out_limit == ctx->fcgi_out.out->limit);
 
 	fcgi_debug("li_backend_put\n");
-	li_backend_put(ctx->wrk, ctx->pool->public.subpool, ctx->subcon, TRUE); /* disable keep-alive for now */
+	li_backend_put(ctx->wrk, ctx->pool->public.subpool, ctx->subcon, !ctx->keepalive || NULL == ctx->iostream);
 }
 
-/* destroys ctx */
+/* closes the connection; all requests on it fail */
 static void fastcgi_reset(liFastCGIBackendContext *ctx) {
 	if (NULL == ctx->pool) return;
 	fcgi_debug("fastcgi_reset\n");
@@ -270,24 +379,26 @@ static void fastcgi_reset(liFastCGIBackendContext *ctx) {
 		li_backend_connection_closed(ctx->pool->public.subpool, ctx->subcon);
 	} else {
 		int fd;
-		const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
-		liFastCGIBackendConnection_p *currentcon = ctx->currentcon;
+		guint i;
 		liIOStream *iostream = ctx->iostream;
 
 		if (NULL == iostream) return;
 
-		ctx->request_done = TRUE;
+		/* the last failed request puts (and closes) the connection */
+		g_atomic_int_inc(&ctx->refcount);
+
 		ctx->iostream = NULL;
+		fastcgi_mux_update(ctx);
 		li_stream_simple_socket_close(iostream, TRUE);
 		fd = li_iostream_reset(iostream);
 		LI_FORCE_ASSERT(-1 == fd);
 
-		li_stream_disconnect(&ctx->fcgi_out);
-		li_stream_disconnect_dest(&ctx->fcgi_in);
-
-		if (NULL != currentcon) {
-			callbacks->reset_cb(currentcon->vr, &ctx->pool->public, &currentcon->public);
+		for (i = 0; i < ctx->requests->len; ++i) {
+			liFastCGIBackendConnection_p *con = g_ptr_array_index(ctx->requests, i);
+			if (NULL != con) fastcgi_request_fail(con);
 		}
+
+		backend_ctx_unref(ctx);
 	}
 }
 
@@ -383,20 +494,62 @@ static void stream_send_chunks(liChunkQueue *out, guint8 type, guint16 requestid
 	}
 }
 
-static void stream_send_begin(liChunkQueue *out, guint16 requestid) {
+static void stream_send_begin(liChunkQueue *out, guint16 requestid, gboolean keepconn) {
 	GByteArray *buf = g_byte_array_sized_new(16);
 	guint16 w;
 
-	LI_FORCE_ASSERT(1 == requestid);
-
 	stream_build_fcgi_record(buf, FCGI_BEGIN_REQUEST, requestid, 8);
 	w = htons(FCGI_RESPONDER);
 	g_byte_array_append(buf, (const guint8*) &w, sizeof(w));
-	l_byte_array_append_c(buf, 0 /* FCGI_KEEP_CONN */); /* disabled keep-alive for now */
+	l_byte_array_append_c(buf, keepconn ? FCGI_KEEP_CONN : 0);
 	append_padding(buf, 5);
 	li_chunkqueue_append_bytearr(out, buf);
 }
 
+/* management record (request id 0), the values in the answer tell whether the backend can multiplex */
+static void stream_send_get_values(liChunkQueue *out) {
+	GByteArray *buf = g_byte_array_sized_new(0);
+
+	append_key_value_pair(buf, CONST_STR_LEN("FCGI_MAX_REQS"), CONST_STR_LEN(""));
+	append_key_value_pair(buf, CONST_STR_LEN("FCGI_MPXS_CONNS"), CONST_STR_LEN(""));
+
+	stream_send_bytearr(out, FCGI_GET_VALUES, 0, buf);
+}
+
+/* active health check: a management record doesn't run the application, but needs a working FastCGI server */
+static GString* fastcgi_check_request(void) {
+	GByteArray *values = g_byte_array_sized_new(0);
+	GByteArray *record = g_byte_array_sized_new(FCGI_HEADER_LEN);
+	GString *request;
+	guint8 padlen;
+
+	append_key_value_pair(values, CONST_STR_LEN("FCGI_MPXS_CONNS"), CONST_STR_LEN(""));
+	padlen = stream_build_fcgi_record(record, FCGI_GET_VALUES, 0, values->len);
+	append_padding(values, padlen);
+
+	request = g_string_sized_new(record->len + values->len);
+	g_string_append_len(request, (const gchar*) record->data, record->len);
+	g_string_append_len(request, (const gchar*) values->data, values->len);
+
+	g_byte_array_free(record, TRUE);
+	g_byte_array_free(values, TRUE);
+
+	return request;
+}
+
+/* any FastCGI record answering the management record will do */
+static liBackendCheckResult backend_check(liBackendPool *bpool, const GString *response, gboolean eof) {
+	const guint8 *header = (const guint8*) response->str;
+	UNUSED(bpool);
+
+	if (response->len < FCGI_HEADER_LEN) return eof ? LI_BACKEND_CHECK_FAILED : LI_BACKEND_CHECK_NEED_MORE;
+
+	if (FCGI_VERSION_1 != header[0]) return LI_BACKEND_CHECK_FAILED;
+	if (FCGI_GET_VALUES_RESULT != header[1] && FCGI_UNKNOWN_TYPE != header[1]) return LI_BACKEND_CHECK_FAILED;
+
+	return LI_BACKEND_CHECK_OK;
+}
+
 /* end fastcgi stream send helpers */
 /**********************************************************************************/
 
@@ -476,6 +629,9 @@ static void fastcgi_env_create(liVRequest *vr, liEnvironmentDup *envdup, GByteAr
 	fastcgi_env_add(buf, envdup, CONST_STR_LEN("REQUEST_METHOD"), GSTR_LEN(vr->request.http_method_str));
 	fastcgi_env_add(buf, envdup, CONST_STR_LEN("REDIRECT_STATUS"), CONST_STR_LEN("200")); /* if php is compiled with --force-redirect */
 	switch (vr->request.http_version) {
+	case LI_HTTP_VERSION_2:
+		fastcgi_env_add(buf, envdup, CONST_STR_LEN("SERVER_PROTOCOL"), CONST_STR_LEN("HTTP/2.0"));
+		break;
 	case LI_HTTP_VERSION_1_1:
 		fastcgi_env_add(buf, envdup, CONST_STR_LEN("SERVER_PROTOCOL"), CONST_STR_LEN("HTTP/1.1"));
 		break;
@@ -547,35 +703,259 @@ static void fastcgi_send_env(liVRequest *vr, liChunkQueue *out, int requestid) {
 /**********************************************************************************/
 
 
+/**********************************************************************************/
+/* fastcgi requests */
+
+static void fastcgi_con_unref(liFastCGIBackendConnection_p *con) {
+	LI_FORCE_ASSERT(g_atomic_int_get(&con->refcount) > 0);
+	if (g_atomic_int_dec_and_test(&con->refcount)) {
+		g_slice_free(liFastCGIBackendConnection_p, con);
+	}
+}
+
+/* the stream the response (FCGI_STDOUT) of the request goes to */
+static liStream* fastcgi_request_stdout(liFastCGIBackendConnection_p *con) {
+	return con->ctx->direct ? &con->ctx->fcgi_in : &con->stdout_stream;
+}
+
+/* the only request of a direct connection, NULL if there is none (or it was released) */
+static liFastCGIBackendConnection_p* fastcgi_direct_request(liFastCGIBackendContext *ctx) {
+	if (!ctx->direct || 0 == ctx->requests->len) return NULL;
+	return g_ptr_array_index(ctx->requests, 0);
+}
+
+static void fastcgi_stdout_limit_cb(gpointer context, gboolean locked);
+
+/* multiplexed connections: stop decoding until the response queue of con has room again.
+ * returns FALSE if the limit can't notify us (decoding continues then)
+ */
+static gboolean fastcgi_stdout_block(liFastCGIBackendConnection_p *con) {
+	liCQLimit *limit = con->stdout_stream.out->limit;
+
+	if (NULL == limit || NULL != limit->notify) return FALSE;
+
+	limit->notify = fastcgi_stdout_limit_cb;
+	limit->context = con;
+	con->ctx->stdout_blocked = con;
+	return TRUE;
+}
+
+static void fastcgi_stdout_unblock(liFastCGIBackendConnection_p *con) {
+	liFastCGIBackendContext *ctx = con->ctx;
+	liCQLimit *limit = con->stdout_stream.out->limit;
+
+	if (NULL == ctx || con != ctx->stdout_blocked) return;
+
+	if (NULL != limit && con == limit->context) {
+		limit->notify = NULL;
+		limit->context = NULL;
+	}
+	ctx->stdout_blocked = NULL;
+	li_stream_again_later(&ctx->fcgi_in);
+}
+
+static void fastcgi_stdout_limit_cb(gpointer context, gboolean locked) {
+	liFastCGIBackendConnection_p *con = context;
+	if (!locked) fastcgi_stdout_unblock(con);
+}
+
+/* multiplexed connections: the backend read some records, continue sending request bodies */
+static void fastcgi_out_limit_cb(gpointer context, gboolean locked) {
+	liFastCGIBackendContext *ctx = context;
+	guint i;
+
+	if (locked || NULL == ctx->iostream) return;
+
+	for (i = 0; i < ctx->requests->len; ++i) {
+		liFastCGIBackendConnection_p *con = g_ptr_array_index(ctx->requests, i);
+		if (NULL != con && !con->stdin_closed) li_stream_again_later(&con->stdin_stream);
+	}
+}
+
+/* frees the request id; needs FCGI_END_REQUEST (or a failed connection) and li_fastcgi_backend_put() */
+static void fastcgi_request_release(liFastCGIBackendConnection_p *con) {
+	liFastCGIBackendContext *ctx = con->ctx;
+
+	LI_FORCE_ASSERT(NULL != ctx && con->request_done && NULL == con->vr);
+	LI_FORCE_ASSERT(con == g_ptr_array_index(ctx->requests, con->requestid - 1));
+
+	fastcgi_stdout_unblock(con);
+
+	g_ptr_array_index(ctx->requests, con->requestid - 1) = NULL;
+	ctx->active_requests--;
+	con->ctx = NULL;
+
+	/* may free con: the vrequest can still hold references to the streams */
+	li_stream_release(&con->stdin_stream);
+	li_stream_release(&con->stdout_stream);
+
+	fastcgi_mux_update(ctx);
+	fastcgi_check_put(ctx);
+}
+
+static void fastcgi_request_end(liFastCGIBackendConnection_p *con, guint32 appStatus) {
+	liFastCGIBackendContext *ctx = con->ctx;
+
+	con->stdin_closed = con->stdout_closed = con->stderr_closed = con->request_done = TRUE;
+	fastcgi_request_stdout(con)->out->is_closed = TRUE;
+	li_stream_notify_later(fastcgi_request_stdout(con));
+
+	li_backend_report(ctx->wrk, ctx->pool->public.subpool, FALSE);
+
+	if (NULL != con->vr) {
+		const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
+
+		fcgi_debug("fastcgi end request: %i\n", appStatus);
+		callbacks->end_request_cb(con->vr, &ctx->pool->public, &con->public, appStatus);
+	} else {
+		fastcgi_request_release(con);
+	}
+}
+
+static void fastcgi_request_fail(liFastCGIBackendConnection_p *con) {
+	liFastCGIBackendContext *ctx = con->ctx;
+
+	con->stdin_closed = con->stdout_closed = con->stderr_closed = con->request_done = TRUE;
+	fastcgi_stdout_unblock(con);
+	li_stream_reset(&con->stdin_stream);
+	li_stream_reset(&con->stdout_stream);
+	if (ctx->direct) {
+		li_stream_disconnect(&ctx->fcgi_out);
+		li_stream_disconnect_dest(&ctx->fcgi_in);
+	}
+
+	/* requests we aborted ourselves don't count against the backend */
+	if (!con->aborted) li_backend_report(ctx->wrk, ctx->pool->public.subpool, TRUE);
+
+	if (NULL != con->vr) {
+		const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
+		callbacks->reset_cb(con->vr, &ctx->pool->public, &con->public);
+	} else {
+		fastcgi_request_release(con);
+	}
+}
+
+/* vrequest went away before the request was finished */
+static void fastcgi_request_abort(liFastCGIBackendConnection_p *con) {
+	liFastCGIBackendContext *ctx = con->ctx;
+
+	if (NULL == ctx || con->request_done || con->aborted) return;
+
+	if (!ctx->mpxs_conns || NULL == ctx->iostream) {
+		/* no other requests on the connection */
+		con->aborted = TRUE;
+		fastcgi_reset(ctx);
+		return;
+	}
+
+	/* keep the request id until the backend confirms with FCGI_END_REQUEST */
+	con->aborted = TRUE;
+	con->stdin_closed = con->stdout_closed = con->stderr_closed = TRUE;
+	stream_send_fcgi_record(ctx->fcgi_out.out, FCGI_ABORT_REQUEST, con->requestid, 0);
+	li_stream_notify_later(&ctx->fcgi_out);
+
+	fastcgi_stdout_unblock(con);
+	li_stream_reset(&con->stdin_stream);
+	li_stream_reset(&con->stdout_stream);
+
+	if (NULL != con->vr) {
+		const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
+		callbacks->reset_cb(con->vr, &ctx->pool->public, &con->public);
+	}
+}
+
+/* request body (stream->source) -> FCGI_STDIN records; stream is fcgi_out (direct) or con->stdin_stream */
+static void fastcgi_send_stdin(liFastCGIBackendConnection_p *con, liStream *stream) {
+	liFastCGIBackendContext *ctx = con->ctx;
+
+	if (NULL == stream->source) return;
+	if (NULL == ctx || NULL == ctx->fcgi_out.dest || con->stdin_closed) {
+		li_chunkqueue_skip_all(stream->source->out);
+		return;
+	}
+	/* multiplexed: wait for fastcgi_out_limit_cb; the request body stays in the (limited) vrequest queue */
+	if (NULL != ctx->out_limit && ctx->out_limit->locked) return;
+
+	stream_send_chunks(ctx->fcgi_out.out, FCGI_STDIN, con->requestid, stream->source->out);
+	if (stream->source->out->is_closed && !con->stdin_closed) {
+		fcgi_debug("fcgi_out: closing stdin\n");
+		con->stdin_closed = TRUE;
+		stream_send_fcgi_record(ctx->fcgi_out.out, FCGI_STDIN, con->requestid, 0);
+		li_stream_disconnect(stream);
+	}
+	li_stream_notify(&ctx->fcgi_out);
+}
+
 /* request body -> fastcgi */
+static void fastcgi_stream_stdin(liStream *stream, liStreamEvent event) {
+	liFastCGIBackendConnection_p *con = LI_CONTAINER_OF(stream, liFastCGIBackendConnection_p, stdin_stream);
+	fcgi_debug("fastcgi_stream_stdin event: %s\n", li_stream_event_string(event));
+	switch (event) {
+	case LI_STREAM_NEW_DATA:
+		fastcgi_send_stdin(con, stream);
+		break;
+	case LI_STREAM_CONNECTED_SOURCE:
+		/* support Connection: Upgrade by reopening stdin. not standard compliant,
+		 * but the backend asked for it :) */
+		if (!con->request_done) con->stdin_closed = FALSE;
+		break;
+	case LI_STREAM_DISCONNECTED_SOURCE:
+		if (!con->stdin_closed) {
+			fcgi_debug("fcgi_out: lost request before request body was sent to FastCGI\n");
+			fastcgi_request_abort(con);
+		}
+		break;
+	case LI_STREAM_DESTROY:
+		fastcgi_con_unref(con);
+		break;
+	default:
+		break;
+	}
+}
+
+/* fastcgi -> response body */
+static void fastcgi_stream_stdout(liStream *stream, liStreamEvent event) {
+	liFastCGIBackendConnection_p *con = LI_CONTAINER_OF(stream, liFastCGIBackendConnection_p, stdout_stream);
+	fcgi_debug("fastcgi_stream_stdout event: %s\n", li_stream_event_string(event));
+	switch (event) {
+	case LI_STREAM_DISCONNECTED_DEST:
+		if (!con->stdout_closed) {
+			fcgi_debug("request aborted (by client?) before request was finished\n");
+			fastcgi_request_abort(con);
+		}
+		break;
+	case LI_STREAM_DESTROY:
+		fastcgi_con_unref(con);
+		break;
+	default:
+		break;
+	}
+}
+
+/* end fastcgi requests */
+/**********************************************************************************/
+
+/* fastcgi records -> backend; direct connections get the request body from the vrequest */
 static void fastcgi_stream_out(liStream *stream, liStreamEvent event) {
 	liFastCGIBackendContext *ctx = LI_CONTAINER_OF(stream, liFastCGIBackendContext, fcgi_out);
+	liFastCGIBackendConnection_p *con;
 	fcgi_debug("fastcgi_stream_out event: %s\n", li_stream_event_string(event));
 	switch (event) {
 	case LI_STREAM_NEW_DATA:
-		if (NULL == stream->source) return;
-		if (NULL == stream->dest || ctx->stdin_closed) {
+		if (NULL != (con = fastcgi_direct_request(ctx))) {
+			fastcgi_send_stdin(con, stream);
+		} else if (NULL != stream->source) {
 			li_chunkqueue_skip_all(stream->source->out);
-			return;
 		}
-		stream_send_chunks(stream->out, FCGI_STDIN, 1, stream->source->out);
-		if (stream->source->out->is_closed && !ctx->stdin_closed) {
-			fcgi_debug("fcgi_out: closing stdin\n");
-			ctx->stdin_closed = TRUE;
-			stream_send_fcgi_record(stream->out, FCGI_STDIN, 1, 0);
-			li_stream_disconnect(stream);
-		}
-		li_stream_notify(stream);
 		break;
 	case LI_STREAM_CONNECTED_SOURCE:
-		/* support Connection: Upgrade by reopening stdin. not standard compliant,
-		 * but the backend asked for it :) */
-		ctx->stdin_closed = FALSE;
+		/* see fastcgi_stream_stdin */
+		if (NULL != (con = fastcgi_direct_request(ctx)) && !con->request_done) con->stdin_closed = FALSE;
 		break;
 	case LI_STREAM_DISCONNECTED_SOURCE:
-		if (!ctx->stdin_closed) {
+		if (NULL != (con = fastcgi_direct_request(ctx)) && !con->stdin_closed) {
 			fcgi_debug("fcgi_out: lost request before request body was sent to FastCGI\n");
-			fastcgi_reset(ctx);
+			fastcgi_request_abort(con);
 		} else {
 			fastcgi_check_put(ctx);
 		}
@@ -593,16 +973,105 @@ static void fastcgi_stream_out(liStream *stream, liStreamEvent event) {
 	}
 }
 
+static liFastCGIBackendConnection_p* fastcgi_get_request(liFastCGIBackendContext *ctx, guint16 requestID) {
+	if (0 == requestID || requestID > ctx->requests->len) return NULL;
+	return g_ptr_array_index(ctx->requests, requestID - 1);
+}
+
+/* name-value pair lengths: 1 byte, or 4 bytes if the high bit is set */
+static gboolean fastcgi_read_len(const guint8 **pos, const guint8 *end, guint32 *len) {
+	const guint8 *p = *pos;
+
+	if (p >= end) return FALSE;
+	if (0 == (p[0] & 0x80)) {
+		*len = p[0];
+		*pos = p + 1;
+	} else {
+		if (end - p < 4) return FALSE;
+		*len = ((guint32) (p[0] & 0x7f) << 24) | ((guint32) p[1] << 16) | ((guint32) p[2] << 8) | p[3];
+		*pos = p + 4;
+	}
+	return TRUE;
+}
+
+static guint fastcgi_value_to_uint(const guint8 *val, guint32 len) {
+	guint32 i;
+	guint result = 0;
+
+	for (i = 0; i < len && g_ascii_isdigit(val[i]); i++) {
+		result = MIN(10*result + (val[i] - '0'), G_MAXUINT16);
+	}
+	return result;
+}
+
+static gboolean fastcgi_key_equal(const guint8 *key, guint32 keylen, const gchar *name, guint32 namelen) {
+	return keylen == namelen && 0 == memcmp(key, name, namelen);
+}
+
+/* FCGI_GET_VALUES_RESULT */
+static void fastcgi_parse_values(liFastCGIBackendContext *ctx, GString *values) {
+	const guint8 *pos = (const guint8*) values->str, *end = pos + values->len;
+	guint32 keylen, valuelen;
+	gboolean mpxs_conns = FALSE;
+	guint max_reqs = 0;
+
+	while (fastcgi_read_len(&pos, end, &keylen) && fastcgi_read_len(&pos, end, &valuelen)) {
+		const guint8 *key = pos, *val;
+
+		if (keylen > (guint32) (end - pos) || valuelen > (guint32) (end - pos) - keylen) break;
+		val = pos + keylen;
+		pos = val + valuelen;
+
+		fcgi_debug("fastcgi value %.*s = %.*s\n", (int) keylen, (const gchar*) key, (int) valuelen, (const gchar*) val);
+
+		if (fastcgi_key_equal(key, keylen, CONST_STR_LEN("FCGI_MPXS_CONNS"))) {
+			mpxs_conns = (0 != fastcgi_value_to_uint(val, valuelen));
+		} else if (fastcgi_key_equal(key, keylen, CONST_STR_LEN("FCGI_MAX_REQS"))) {
+			max_reqs = fastcgi_value_to_uint(val, valuelen);
+		}
+	}
+
+	if (NULL == ctx->pool || !mpxs_conns) return;
+
+	ctx->max_reqs = ctx->pool->multiplex;
+	if (max_reqs > 0 && max_reqs < ctx->max_reqs) ctx->max_reqs = max_reqs;
+	ctx->mpxs_conns = (ctx->max_reqs > 1);
+	fastcgi_mux_update(ctx);
+}
+
+/* backend closed the connection */
+static void fastcgi_eof(liFastCGIBackendContext *ctx, liChunkQueue *in) {
+	ctx->keepalive = FALSE;
+
+	if (0 == in->length && 0 == ctx->remainingContent && 0 == ctx->remainingPadding) {
+		guint i;
+
+		/* requests with complete stdout are finished even without FCGI_END_REQUEST */
+		for (i = 0; NULL != ctx->iostream && i < ctx->requests->len; ++i) {
+			liFastCGIBackendConnection_p *con = g_ptr_array_index(ctx->requests, i);
+			if (NULL != con && con->stdout_closed && !con->aborted) fastcgi_request_end(con, 0);
+		}
+	} else {
+		fcgi_debug("unexpected eof, still have partial fastcgi record\n");
+	}
+
+	fastcgi_reset(ctx);
+}
+
 static void fastcgi_decode(liFastCGIBackendContext *ctx) {
 	liChunkQueue *in;
 	liWorker *wrk;
 	LI_FORCE_ASSERT(NULL != ctx->iostream);
 
+	/* wait for fastcgi_stdout_unblock */
+	if (NULL != ctx->stdout_blocked) return;
+
 	in = ctx->iostream->stream_in.out;
 	wrk = li_worker_from_iostream(ctx->iostream);
 
 	while (NULL != ctx->iostream && 0 < in->length) {
 		gboolean newdata = FALSE;
+		liFastCGIBackendConnection_p *con;
 
 		if (0 == ctx->remainingContent && 0 == ctx->remainingPadding) {
 			unsigned char header[FCGI_HEADER_LEN];
@@ -629,9 +1098,11 @@ static void fastcgi_decode(liFastCGIBackendContext *ctx) {
 				return;
 			}
 			newdata = TRUE;
-			fcgi_debug("fastcgi packet type %s (%i), payload %i\n", fcgi_type_string(ctx->type), ctx->type, (int) ctx->contentLength);
+			fcgi_debug("fastcgi packet type %s (%i), request %i, payload %i\n", fcgi_type_string(ctx->type), ctx->type, (int) ctx->requestID, (int) ctx->contentLength);
 		}
 
+		con = fastcgi_get_request(ctx, ctx->requestID);
+
 		if (newdata || (ctx->remainingContent > 0 && in->length > 0)) {
 			switch (ctx->type) {
 			case FCGI_END_REQUEST:
@@ -653,55 +1124,63 @@ static void fastcgi_decode(liFastCGIBackendContext *ctx) {
 					ctx->remainingContent -= 8;
 
 					protocolStatus = endreq[4];
-					if (FCGI_REQUEST_COMPLETE != protocolStatus) {
+					if (NULL == con) {
+						fcgi_debug("FCGI_END_REQUEST for unknown request %i\n", (int) ctx->requestID);
+					} else if (FCGI_REQUEST_COMPLETE != protocolStatus) {
 						fcgi_debug("fcgi_out: FCGI_END_REQUEST with protocolStatus %i != FCGI_REQUEST_COMPLETE\n", (int) protocolStatus);
-						fastcgi_reset(ctx);
-						return;
-					}
-
-					ctx->stdin_closed = TRUE;
-					ctx->stdout_closed = TRUE;
-					ctx->stderr_closed = TRUE;
-					ctx->request_done = TRUE;
-					ctx->fcgi_in.out->is_closed = TRUE;
-					li_stream_notify_later(&ctx->fcgi_in);
-
-					if (ctx->currentcon) {
+						if (FCGI_CANT_MPX_CONN == protocolStatus) {
+							ctx->mpxs_conns = FALSE;
+							ctx->max_reqs = 1;
+							fastcgi_mux_update(ctx);
+						}
+						fastcgi_request_fail(con);
+					} else {
 						guint32 appStatus = (endreq[0] << 24) | (endreq[1] << 16) | (endreq[2] << 8) | endreq[3];
-						const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
-
-						fcgi_debug("fastcgi end request: %i\n", appStatus);
-						callbacks->end_request_cb(ctx->currentcon->vr, &ctx->pool->public, &ctx->currentcon->public, appStatus);
+						fastcgi_request_end(con, appStatus);
 					}
 				}
 				break;
 			case FCGI_STDOUT:
-				if (0 == ctx->contentLength) {
+				if (NULL == con || con->aborted) {
+					int len = li_chunkqueue_skip(in, ctx->remainingContent);
+					ctx->remainingContent -= len;
+				} else if (0 == ctx->contentLength) {
 					fcgi_debug("fastcgi stdout eof\n");
-					ctx->stdout_closed = TRUE;
-				} else if (ctx->stdout_closed) {
+					con->stdout_closed = TRUE;
+				} else if (con->stdout_closed) {
 					fcgi_debug("fastcgi stdout data after eof\n");
 					fastcgi_reset(ctx);
 					return;
 				} else {
+					liStream *stdout_stream = fastcgi_request_stdout(con);
 					int len = MIN(in->length, ctx->remainingContent);
+
+					/* multiplexed: the vrequest limit doesn't reach the backend connection; the
+					 * records of the other requests wait in the (limited) backend queue meanwhile.
+					 */
+					if (!ctx->direct && 0 == li_chunkqueue_limit_available(stdout_stream->out) && fastcgi_stdout_block(con)) return;
 #ifdef FCGI_DEBUG
 					GString *stdoutdata = g_string_new(0);
 					li_chunkqueue_extract_to(in, len, stdoutdata, NULL);
 					fcgi_debug("fastcgi stdout data: '%s'\n", stdoutdata->str);
 					g_string_free(stdoutdata, TRUE);
 #endif
-					li_chunkqueue_steal_len(ctx->fcgi_in.out, in, len);
+					li_chunkqueue_steal_len(stdout_stream->out, in, len);
 					ctx->remainingContent -= len;
+					li_stream_notify_later(stdout_stream);
 				}
-				li_stream_notify_later(&ctx->fcgi_in);
 				break;
 			case FCGI_STDERR:
+				if (NULL == con || con->aborted) {
+					int len = li_chunkqueue_skip(in, ctx->remainingContent);
+					ctx->remainingContent -= len;
+					break;
+				}
 				if (0 == ctx->contentLength) {
-					ctx->stderr_closed = TRUE;
+					con->stderr_closed = TRUE;
 					break;
 				}
-				if (ctx->stderr_closed) {
+				if (con->stderr_closed) {
 					fcgi_debug("fastcgi stderr data after stderr end-of-stream\n");
 					fastcgi_reset(ctx);
 					return;
@@ -714,14 +1193,28 @@ static void fastcgi_decode(liFastCGIBackendContext *ctx) {
 
 					fcgi_debug("fastcgi stderr data: '%s'\n", errormsg->str);
 
-					if (NULL != ctx->currentcon) {
+					if (NULL != con->vr) {
 						const liFastCGIBackendCallbacks *callbacks = ctx->pool->callbacks;
-						callbacks->fastcgi_stderr_cb(ctx->currentcon->vr, &ctx->pool->public, &ctx->currentcon->public, errormsg);
+						callbacks->fastcgi_stderr_cb(con->vr, &ctx->pool->public, &con->public, errormsg);
 					}
 
 					g_string_free(errormsg, TRUE);
 				}
 				break;
+			case FCGI_GET_VALUES_RESULT:
+				if (in->length < ctx->remainingContent) break; /* wait for the complete record */
+
+				{
+					GString *values = g_string_sized_new(ctx->remainingContent);
+					li_chunkqueue_extract_to(in, ctx->remainingContent, values, NULL);
+					li_chunkqueue_skip(in, ctx->remainingContent);
+					ctx->remainingContent = 0;
+
+					fastcgi_parse_values(ctx, values);
+
+					g_string_free(values, TRUE);
+				}
+				break;
 			default:
 				if (newdata) {
 					WARNING(wrk->srv, "(%s) Unhandled fastcgi record type %i",
@@ -744,36 +1237,29 @@ static void fastcgi_decode(liFastCGIBackendContext *ctx) {
 		}
 	}
 
-	if (NULL != ctx->iostream && (in->is_closed && !ctx->request_done)) {
-		if (0 != in->length || !ctx->stdout_closed) {
-			fcgi_debug("unexpected eof, still have partial fastcgi record header\n");
-			fastcgi_reset(ctx);
-		} else {
-			ctx->stdin_closed = ctx->stdout_closed = ctx->stderr_closed = ctx->request_done = TRUE;
-			ctx->fcgi_in.out->is_closed = TRUE;
-			li_stream_simple_socket_close(ctx->iostream, FALSE);
-		}
+	if (NULL != ctx->iostream && in->is_closed) {
+		fastcgi_eof(ctx, in);
 	}
 }
 
-/* fastcgi -> response body */
+/* backend -> fastcgi records */
 static void fastcgi_stream_in(liStream *stream, liStreamEvent event) {
 	liFastCGIBackendContext *ctx = LI_CONTAINER_OF(stream, liFastCGIBackendContext, fcgi_in);
+	liFastCGIBackendConnection_p *con;
 	fcgi_debug("fastcgi_stream_in event: %s\n", li_stream_event_string(event));
 	switch (event) {
 	case LI_STREAM_NEW_DATA:
 		fastcgi_decode(ctx);
 		break;
 	case LI_STREAM_DISCONNECTED_SOURCE:
-		if (!ctx->request_done) {
-			fcgi_debug("fastcgi backend closed connection before request was finished\n");
-			fastcgi_reset(ctx);
-		}
+		fcgi_debug("fastcgi backend closed connection\n");
+		fastcgi_reset(ctx);
 		break;
 	case LI_STREAM_DISCONNECTED_DEST:
-		if (!ctx->stdout_closed) {
+		/* only direct connections have a dest */
+		if (NULL != (con = fastcgi_direct_request(ctx)) && !con->stdout_closed) {
 			fcgi_debug("request aborted (by client?) before request was finished\n");
-			fastcgi_reset(ctx);
+			fastcgi_request_abort(con);
 		} else {
 			fastcgi_check_put(ctx);
 		}
@@ -798,8 +1284,13 @@ liFastCGIBackendPool* li_fastcgi_backend_pool_new(const liFastCGIBackendConfig *
 	pool->config.disable_time = config->disable_time;
 	pool->config.max_requests = config->max_requests;
 	pool->config.watch_for_close = FALSE;
+	pool->config.max_fails = config->max_fails;
+	pool->config.check_interval = config->check_interval;
+	pool->config.check_request = (config->check_interval > 0) ? fastcgi_check_request() : NULL;
+	pool->config.slow_start = config->slow_start;
 
 	pool->callbacks = config->callbacks;
+	pool->multiplex = MIN(config->multiplex, G_MAXUINT16);
 
 	pool->public.subpool = li_backend_pool_new(&pool->config);
 
@@ -810,6 +1301,56 @@ void li_fastcgi_backend_pool_free(liFastCGIBackendPool *bpool) {
 	li_backend_pool_free(bpool->subpool);
 }
 
+static void fastcgi_request_start(liVRequest *vr, liFastCGIBackendContext *ctx, liFastCGIBackendConnection **pbcon) {
+	liFastCGIBackendConnection_p *con = g_slice_new0(liFastCGIBackendConnection_p);
+	liStream *http_out;
+	guint i;
+
+	LI_FORCE_ASSERT(vr->wrk == ctx->wrk);
+	LI_FORCE_ASSERT(NULL != ctx->iostream);
+	LI_FORCE_ASSERT(-1 != li_event_io_fd(&ctx->iostream->io_watcher));
+	LI_FORCE_ASSERT(ctx->active_requests < ctx->max_reqs);
+
+	/* lowest free request id */
+	for (i = 0; i < ctx->requests->len && NULL != g_ptr_array_index(ctx->requests, i); i++) ;
+	if (i == ctx->requests->len) g_ptr_array_add(ctx->requests, NULL);
+	g_ptr_array_index(ctx->requests, i) = con;
+	ctx->active_requests++;
+	ctx->started_requests++;
+
+	con->refcount = 2; /* stdin_stream, stdout_stream */
+	con->ctx = ctx;
+	con->requestid = i + 1;
+	con->vr = vr;
+	li_stream_init(&con->stdin_stream, &vr->wrk->loop, fastcgi_stream_stdin);
+	li_stream_init(&con->stdout_stream, &vr->wrk->loop, fastcgi_stream_stdout);
+	*pbcon = &con->public;
+
+	fastcgi_mux_update(ctx);
+
+	fcgi_debug("fastcgi request %i\n", (int) con->requestid);
+
+	stream_send_begin(ctx->fcgi_out.out, con->requestid, ctx->keepalive);
+	fastcgi_send_env(vr, ctx->fcgi_out.out, con->requestid);
+	li_stream_notify_later(&ctx->fcgi_out);
+
+	li_vrequest_handle_indirect(vr, NULL);
+
+	if (ctx->direct) {
+		LI_FORCE_ASSERT(NULL == ctx->fcgi_in.dest);
+		LI_FORCE_ASSERT(NULL == ctx->fcgi_out.source);
+		li_chunkqueue_reset(ctx->fcgi_in.out);
+
+		http_out = li_stream_http_response_handle(&ctx->fcgi_in, vr, TRUE, TRUE);
+		li_vrequest_indirect_connect(vr, &ctx->fcgi_out, http_out);
+	} else {
+		http_out = li_stream_http_response_handle(&con->stdout_stream, vr, TRUE, TRUE);
+		li_vrequest_indirect_connect(vr, &con->stdin_stream, http_out);
+	}
+
+	li_stream_release(http_out);
+}
+
 liBackendResult li_fastcgi_backend_get(liVRequest *vr, liFastCGIBackendPool *bpool, liFastCGIBackendConnection **pbcon, liFastCGIBackendWait **pbwait) {
 	liFastCGIBackendPool_p *pool = LI_CONTAINER_OF(bpool, liFastCGIBackendPool_p, public);
 	liBackendConnection *subcon = NULL;
@@ -818,21 +1359,37 @@ liBackendResult li_fastcgi_backend_get(liVRequest *vr, liFastCGIBackendPool *bpo
 
 	fcgi_debug("li_fastcgi_backend_get\n");
 
+	/* share a connection of this worker which can take more requests */
+	if (NULL != g_atomic_pointer_get(&pool->mux_queues)) {
+		GQueue *mux_queue = fastcgi_mux_queue(pool, vr->wrk);
+
+		/* counts like a connection from li_backend_get(); fails if the backend is ejected or disabled,
+		 * then li_backend_get() below fails too
+		 */
+		if (NULL != mux_queue->head && li_backend_share(vr->wrk, pool->public.subpool, ((liFastCGIBackendContext*) mux_queue->head->data)->subcon)) {
+			liFastCGIBackendContext *ctx = mux_queue->head->data;
+
+			if (NULL != subwait) {
+				li_backend_wait_stop(vr, pool->public.subpool, &subwait);
+				*pbwait = NULL;
+			}
+
+			fcgi_debug("li_fastcgi_backend_get: multiplexing\n");
+			fastcgi_request_start(vr, ctx, pbcon);
+			return LI_BACKEND_SUCCESS;
+		}
+	}
+
 	res = li_backend_get(vr, pool->public.subpool, &subcon, &subwait);
 	*pbwait = (liFastCGIBackendWait*) subwait;
 
 	if (subcon != NULL) {
-		liFastCGIBackendConnection_p *con = g_slice_new0(liFastCGIBackendConnection_p);
 		liFastCGIBackendContext *ctx = subcon->data;
-		liStream *http_out;
 
 		LI_FORCE_ASSERT(NULL != ctx);
 		LI_FORCE_ASSERT(LI_BACKEND_SUCCESS == res);
-		con->ctx = ctx;
-		con->vr = vr;
-		ctx->currentcon = con;
+		LI_FORCE_ASSERT(!ctx->is_active && 0 == ctx->active_requests);
 		ctx->is_active = TRUE;
-		*pbcon = &con->public;
 
 		fcgi_debug("li_fastcgi_backend_get: got backend\n");
 
@@ -843,28 +1400,10 @@ liBackendResult li_fastcgi_backend_get(liVRequest *vr, liFastCGIBackendPool *bpo
 		LI_FORCE_ASSERT(li_event_active(&ctx->iostream->io_watcher));
 		li_event_set_keep_loop_alive(&ctx->iostream->io_watcher, TRUE);
 
-		LI_FORCE_ASSERT(NULL == ctx->fcgi_in.dest);
-		LI_FORCE_ASSERT(NULL == ctx->fcgi_out.source);
-
-		LI_FORCE_ASSERT(NULL != ctx->iostream);
-		LI_FORCE_ASSERT(-1 != li_event_io_fd(&ctx->iostream->io_watcher));
-
 		LI_FORCE_ASSERT(ctx->iostream->stream_in.dest == &ctx->fcgi_in);
 		LI_FORCE_ASSERT(ctx->iostream->stream_out.source == &ctx->fcgi_out);
 
-		ctx->stdin_closed = ctx->stdout_closed = ctx->stderr_closed = ctx->request_done = FALSE;
-		li_chunkqueue_reset(ctx->fcgi_in.out);
-
-		stream_send_begin(ctx->fcgi_out.out, 1);
-		fastcgi_send_env(vr, ctx->fcgi_out.out, 1);
-		li_stream_notify_later(&ctx->fcgi_out);
-
-		http_out = li_stream_http_response_handle(&ctx->fcgi_in, vr, TRUE, TRUE);
-
-		li_vrequest_handle_indirect(vr, NULL);
-		li_vrequest_indirect_connect(vr, &ctx->fcgi_out, http_out);
-
-		li_stream_release(http_out);
+		fastcgi_request_start(vr, ctx, pbcon);
 	} else {
 		*pbcon = NULL;
 		LI_FORCE_ASSERT(LI_BACKEND_SUCCESS != res);
@@ -885,14 +1424,10 @@ void li_fastcgi_backend_wait_stop(liVRequest *vr, liFastCGIBackendPool *bpool, l
 
 void li_fastcgi_backend_put(liFastCGIBackendConnection *bcon) {
 	liFastCGIBackendConnection_p *con = LI_CONTAINER_OF(bcon, liFastCGIBackendConnection_p, public);
-	liFastCGIBackendContext *ctx = con->ctx;
 
-	LI_FORCE_ASSERT(NULL != ctx && con == ctx->currentcon);
-	ctx->currentcon = NULL;
-	con->ctx = NULL;
+	LI_FORCE_ASSERT(NULL != con->vr);
 	con->vr = NULL;
 
-	g_slice_free(liFastCGIBackendConnection_p, con);
-
-	fastcgi_check_put(ctx);
+	/* aborted requests keep their id until FCGI_END_REQUEST */
+	if (NULL != con->ctx && con->request_done) fastcgi_request_release(con);
 }
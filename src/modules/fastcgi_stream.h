@@ -40,6 +40,14 @@ struct liFastCGIBackendConfig {
 	guint wait_timeout;
 	guint disable_time;
 	int max_requests;
+	guint max_fails;
+	guint check_interval; /* the active check sends FCGI_GET_VALUES, it doesn't run the application */
+	guint slow_start;
+
+	/* 0: one request per connection. otherwise connections are kept open (FCGI_KEEP_CONN),
+	 * and if the backend supports FCGI_MPXS_CONNS up to multiplex requests share a connection
+	 */
+	guint multiplex;
 };
 
 /* config gets copied, can be freed after this call */
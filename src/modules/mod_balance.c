@@ -7,6 +7,7 @@
 
 
 #include <lighttpd/base.h>
+#include <lighttpd/pattern.h>
 #include <lighttpd/plugin_core.h>
 
 LI_API gboolean mod_balance_init(liModules *mods, liModule *mod);
@@ -26,7 +27,9 @@ typedef enum {
 
 typedef enum {
 	BM_SQF,
-	BM_ROUNDROBIN
+	BM_ROUNDROBIN,
+	BM_HASH,
+	BM_EWMA
 } balancer_method;
 
 typedef struct backend backend;
@@ -35,9 +38,10 @@ typedef struct bcontext bcontext;
 
 struct backend {
 	liAction *act;
-	guint load;
-	backend_state state;
+	gint load;     /* atomic access */
+	gint state;    /* backend_state; only changed with the balancer lock, atomic access */
 	li_tstamp wake;
+	gint latency;  /* balance.ewma: moving average of the response time in microseconds, atomic access */
 };
 
 struct balancer {
@@ -45,9 +49,11 @@ struct balancer {
 
 	GMutex *lock; /* balancer functions with "_" prefix need to be called with the lock being locked */
 	GArray *backends;
-	balancer_state state;
+	gint state; /* balancer_state; only changed with the lock, atomic access */
+	gint backends_waiting; /* number of backends which are not alive; only changed with the lock, atomic access */
 	balancer_method method;
 	gint next_ndx;
+	liPattern *hash_key; /* balance.hash */
 
 	li_tstamp wake;
 
@@ -64,6 +70,7 @@ struct balancer {
 
 struct bcontext { /* context for a balancer in a vrequest */
 	gint selected; /* selected backend */
+	li_tstamp selected_ts;
 
 	GList backlog_link;
 	liJobRef *ref;
@@ -105,6 +112,7 @@ static void balancer_free(liServer *srv, balancer *b) {
 		li_action_release(srv, be->act);
 	}
 	g_array_free(b->backends, TRUE);
+	if (NULL != b->hash_key) li_pattern_free(b->hash_key);
 	g_slice_free(balancer, b);
 }
 
@@ -114,7 +122,7 @@ static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val)
 	if (LI_VALUE_ACTION == li_value_type(val)) {
 		backend be;
 		be.act = val->data.val_action.action;
-		be.load = 0; be.state = BE_ALIVE; be.wake = 0;
+		be.load = 0; be.state = BE_ALIVE; be.wake = 0; be.latency = 0;
 		LI_FORCE_ASSERT(srv == val->data.val_action.srv);
 		li_action_acquire(be.act);
 		g_array_append_val(b->backends, be);
@@ -133,7 +141,7 @@ static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val)
 			{
 				backend be;
 				be.act = oa->data.val_action.action;
-				be.load = 0; be.state = BE_ALIVE; be.wake = 0;
+				be.load = 0; be.state = BE_ALIVE; be.wake = 0; be.latency = 0;
 				li_action_acquire(be.act);
 				g_array_append_val(b->backends, be);
 			}
@@ -145,6 +153,16 @@ static gboolean balancer_fill_backends(balancer *b, liServer *srv, liValue *val)
 	}
 }
 
+static void _balancer_backend_set_state(balancer *b, backend *be, backend_state state) {
+	backend_state old = g_atomic_int_get(&be->state);
+
+	if (old == state) return;
+	if (BE_ALIVE == old) g_atomic_int_inc(&b->backends_waiting);
+	else if (BE_ALIVE == state) g_atomic_int_add(&b->backends_waiting, -1);
+
+	g_atomic_int_set(&be->state, state);
+}
+
 static void _balancer_context_backlog_unlink(balancer *b, bcontext *bc) {
 	if (NULL != bc->backlog_link.data) {
 		g_queue_unlink(&b->backlog, &bc->backlog_link);
@@ -207,7 +225,7 @@ static gboolean _balancer_backlog_schedule(liWorker *wrk, balancer *b) {
 
 		if (NULL == it) {
 			/* backlog done */
-			b->state = BAL_ALIVE;
+			g_atomic_int_set(&b->state, BAL_ALIVE);
 			b->backlog_reactivate_now = 0;
 			b->wake = 0;
 
@@ -255,24 +273,52 @@ static void balancer_async_cb(liEventBase *watcher, int events) {
 	g_mutex_unlock(b->lock);
 }
 
+static void balancer_update_latency(backend *be, li_tstamp duration) {
+	gint sample = (gint) CLAMP(duration * 1e6, 0, (li_tstamp) (G_MAXINT / 2)), old, cur;
+
+	do {
+		old = g_atomic_int_get(&be->latency);
+		/* weight 1/8 for the new sample */
+		cur = (0 == old) ? MAX(sample, 1) : old + (sample - old) / 8;
+	} while (!g_atomic_int_compare_and_exchange(&be->latency, old, cur));
+}
+
 static void balancer_context_free(liVRequest *vr, balancer *b, gpointer *context, gboolean success) {
 	bcontext *bc = *context;
 
 	if (!bc) return;
 	*context = NULL;
 
+	if (bc->selected >= 0) {
+		/* a selected context is never in the backlog */
+		backend *be = &g_array_index(b->backends, backend, bc->selected);
+
+		if (success && BM_EWMA == b->method) {
+			/* time until the backend sent the response headers, not the time to transfer the body to the client */
+			li_tstamp done = (vr->ts_response_headers >= bc->selected_ts) ? vr->ts_response_headers : li_cur_ts(vr->wrk);
+			balancer_update_latency(be, done - bc->selected_ts);
+		}
+
+		/* nothing to reactivate: finish without the lock */
+		if (BAL_ALIVE == g_atomic_int_get(&b->state) && (!success || BE_ALIVE == g_atomic_int_get(&be->state))) {
+			g_atomic_int_add(&be->load, -1);
+			g_slice_free(bcontext, bc);
+			return;
+		}
+	}
+
 	g_mutex_lock(b->lock);
 
 	_balancer_context_backlog_unlink(b, bc);
 
 	if (bc->selected >= 0) {
 		backend *be = &g_array_index(b->backends, backend, bc->selected);
-		be->load--;
+		g_atomic_int_add(&be->load, -1);
 		bc->selected = -1;
 
 		if (success) {
 			/* reactivate it (if not alive), as it obviously isn't completely down */
-			be->state = BE_ALIVE;
+			_balancer_backend_set_state(b, be, BE_ALIVE);
 			b->backlog_reactivate_now++;
 			_balancer_backlog_schedule(vr->wrk, b);
 		}
@@ -296,18 +342,145 @@ static void _balancer_context_select_backend(balancer *b, gpointer *context, gin
 
 	if (bc->selected >= 0) {
 		backend *be = &g_array_index(b->backends, backend, bc->selected);
-		be->load--;
+		g_atomic_int_add(&be->load, -1);
 	}
 
 	bc->selected = ndx;
 
 	if (bc->selected >= 0) {
 		backend *be = &g_array_index(b->backends, backend, bc->selected);
-		be->load++;
+		g_atomic_int_inc(&be->load);
 		b->next_ndx = ndx + 1;
 	}
 }
 
+/* splitmix64 finalizer */
+static guint64 balancer_mix64(guint64 x) {
+	x ^= x >> 30;
+	x *= G_GUINT64_CONSTANT(0xbf58476d1ce4e5b9);
+	x ^= x >> 27;
+	x *= G_GUINT64_CONSTANT(0x94d049bb133111eb);
+	x ^= x >> 31;
+	return x;
+}
+
+/* "A Fast, Minimal Memory, Consistent Hash Algorithm" (Lamping, Veach): maps key to [0, buckets) */
+static gint balancer_jump_hash(guint64 key, gint buckets) {
+	gint64 b = -1, j = 0;
+
+	while (j < buckets) {
+		b = j;
+		key = key * G_GUINT64_CONSTANT(2862933555777941757) + 1;
+		j = (gint64) ((b + 1) * ((gdouble) (G_GINT64_CONSTANT(1) << 31) / (gdouble) ((key >> 33) + 1)));
+	}
+
+	return (gint) b;
+}
+
+/* 64-bit FNV-1a of the evaluated balance.hash key */
+static guint64 balancer_hash_key(liVRequest *vr, balancer *b) {
+	GString *key = vr->wrk->tmp_str;
+	liRegexMatch *match = NULL;
+	guint64 h = G_GUINT64_CONSTANT(14695981039346656037);
+	gsize i;
+
+	if (vr->action_stack.regex_stack->len) {
+		GArray *rs = vr->action_stack.regex_stack;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
+	}
+
+	g_string_truncate(key, 0);
+	li_pattern_eval(vr, key, b->hash_key, NULL, NULL, li_pattern_regex_cb, match);
+
+	for (i = 0; i < key->len; i++) {
+		h ^= (guchar) key->str[i];
+		h *= G_GUINT64_CONSTANT(1099511628211);
+	}
+
+	return h;
+}
+
+static gboolean backend_is_alive(balancer *b, gint ndx) {
+	backend *be = &g_array_index(b->backends, backend, ndx);
+	return BE_ALIVE == g_atomic_int_get(&be->state);
+}
+
+/* the picks don't need the lock: they only read the backend states and loads.
+ * they don't wake up backends; balancer_act_select does that (with the lock) first */
+
+/* keys of a backend which is not alive are spread over the others by rehashing;
+ * the keys of the alive backends don't move */
+static gint balancer_pick_hash(balancer *b, guint64 key) {
+	gint n = b->backends->len, attempt, ndx;
+
+	for (attempt = 0; attempt < n; attempt++) {
+		ndx = balancer_jump_hash(key, n);
+		if (backend_is_alive(b, ndx)) return ndx;
+		key = balancer_mix64(key + attempt + 1);
+	}
+
+	/* unlucky: take the next alive backend */
+	for (attempt = 0; attempt < n; attempt++) {
+		if (backend_is_alive(b, (ndx + attempt) % n)) return (ndx + attempt) % n;
+	}
+
+	return -1;
+}
+
+static guint64 backend_ewma_score(balancer *b, gint ndx) {
+	backend *be = &g_array_index(b->backends, backend, ndx);
+	/* backends without measurements yet get a chance first */
+	return (guint64) (g_atomic_int_get(&be->latency) + 1) * (guint64) (MAX(g_atomic_int_get(&be->load), 0) + 1);
+}
+
+/* per thread, so the picks don't need a lock */
+static GStaticPrivate balancer_rand_key = G_STATIC_PRIVATE_INIT;
+
+static GRand* balancer_rand(void) {
+	GRand *rand = g_static_private_get(&balancer_rand_key);
+
+	if (G_UNLIKELY(NULL == rand)) {
+		rand = g_rand_new();
+		g_static_private_set(&balancer_rand_key, rand, (GDestroyNotify) g_rand_free);
+	}
+	return rand;
+}
+
+/* power of two choices: compare two random backends */
+static gint balancer_pick_ewma(balancer *b) {
+	gint n = b->backends->len, i1, i2, i, best = -1;
+	GRand *rand = balancer_rand();
+
+	i1 = g_rand_int_range(rand, 0, n);
+	i2 = (n > 1) ? (i1 + g_rand_int_range(rand, 1, n)) % n : i1;
+
+	if (backend_is_alive(b, i1) && backend_is_alive(b, i2)) {
+		return (backend_ewma_score(b, i1) <= backend_ewma_score(b, i2)) ? i1 : i2;
+	} else if (backend_is_alive(b, i1)) {
+		return i1;
+	} else if (backend_is_alive(b, i2)) {
+		return i2;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (!backend_is_alive(b, i)) continue;
+		if (-1 == best || backend_ewma_score(b, i) < backend_ewma_score(b, best)) best = i;
+	}
+
+	return best;
+}
+
+static gint balancer_pick(balancer *b, guint64 key) {
+	switch (b->method) {
+	case BM_HASH:
+		return balancer_pick_hash(b, key);
+	case BM_EWMA:
+		return balancer_pick_ewma(b);
+	default:
+		return -1;
+	}
+}
+
 static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_provided, gpointer param, gpointer *context) {
 	balancer *b = param;
 	bcontext *bc = *context;
@@ -317,9 +490,36 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 	li_tstamp now = li_cur_ts(vr->wrk);
 	gboolean all_dead = TRUE;
 	gboolean debug = _OPTION(vr, b->p, 0).boolean;
+	guint64 key = 0;
 
 	be_ndx = -1;
 
+	if (BM_HASH == b->method) key = balancer_hash_key(vr, b);
+
+	if ((BM_HASH == b->method || BM_EWMA == b->method) && NULL == bc && BAL_ALIVE == g_atomic_int_get(&b->state)
+			&& 0 == g_atomic_int_get(&b->backends_waiting)) {
+		/* new request and nothing to wake up: select without the lock. backends which are
+		 * down or overloaded are only woken up in the locked path below, so take that one
+		 * as long as there are any. */
+		be_ndx = balancer_pick(b, key);
+
+		if (-1 != be_ndx) {
+			*context = bc = g_slice_new0(bcontext);
+			bc->selected = be_ndx;
+			bc->selected_ts = now;
+			be = &g_array_index(b->backends, backend, be_ndx);
+			g_atomic_int_inc(&be->load);
+
+			if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean){
+				VR_DEBUG(vr, "balancer select: %i", be_ndx);
+			}
+
+			li_action_enter(vr, be->act);
+
+			return LI_HANDLER_GO_ON;
+		}
+	}
+
 	g_mutex_lock(b->lock);
 
 	if (b->state != BAL_ALIVE && backlog_provided) {
@@ -361,13 +561,13 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 		for (i = 0; i < b->backends->len; i++) {
 			be = &g_array_index(b->backends, backend, i);
 
-			if (now >= be->wake) be->state = BE_ALIVE;
+			if (now >= be->wake) _balancer_backend_set_state(b, be, BE_ALIVE);
 			if (be->state != BE_DOWN) all_dead = FALSE;
 			if (be->state != BE_ALIVE) continue;
 
-			if (load == -1 || load > (gint) be->load) {
+			if (load == -1 || load > g_atomic_int_get(&be->load)) {
 				be_ndx = i;
-				load = be->load;
+				load = g_atomic_int_get(&be->load);
 			}
 		}
 
@@ -377,7 +577,7 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 			i = (b->next_ndx + j) % b->backends->len;
 			be = &g_array_index(b->backends, backend, i);
 
-			if (now >= be->wake) be->state = BE_ALIVE;
+			if (now >= be->wake) _balancer_backend_set_state(b, be, BE_ALIVE);
 			if (be->state != BE_DOWN) all_dead = FALSE;
 			if (be->state != BE_ALIVE) continue;
 
@@ -385,6 +585,18 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 			break; /* use first alive backend */
 		}
 
+		break;
+	case BM_HASH:
+	case BM_EWMA:
+		for (i = 0; i < b->backends->len; i++) {
+			be = &g_array_index(b->backends, backend, i);
+
+			if (now >= be->wake) _balancer_backend_set_state(b, be, BE_ALIVE);
+			if (be->state != BE_DOWN) all_dead = FALSE;
+		}
+
+		be_ndx = balancer_pick(b, key);
+
 		break;
 	}
 
@@ -392,7 +604,7 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 		/* Couldn't find active backend */
 
 		if (b->state == BAL_ALIVE) {
-			b->state = all_dead ? BAL_DOWN : BAL_OVERLOADED;
+			g_atomic_int_set(&b->state, all_dead ? BAL_DOWN : BAL_OVERLOADED);
 			b->wake = li_cur_ts(vr->wrk) + 10;
 
 			for (i = 0; i < b->backends->len; i++) {
@@ -426,6 +638,7 @@ static liHandlerResult balancer_act_select(liVRequest *vr, gboolean backlog_prov
 	}
 
 	_balancer_context_select_backend(b, context, be_ndx);
+	((bcontext*) *context)->selected_ts = now;
 	be = &g_array_index(b->backends, backend, be_ndx);
 
 	g_mutex_unlock(b->lock);
@@ -456,16 +669,16 @@ static liHandlerResult balancer_act_fallback(liVRequest *vr, gboolean backlog_pr
 
 	_balancer_context_select_backend(b, context, -1);
 
-	if (error == LI_BACKEND_OVERLOAD || be->load > 0) {
+	if (error == LI_BACKEND_OVERLOAD || g_atomic_int_get(&be->load) > 0) {
 		/* long timeout for overload - we will enable the backend anyway if another request finishs */
 		if (be->state == BE_ALIVE) be->wake = li_cur_ts(vr->wrk) + 5.0;
 
-		if (be->state != BE_DOWN) be->state = BE_OVERLOADED;
+		if (be->state != BE_DOWN) _balancer_backend_set_state(b, be, BE_OVERLOADED);
 	} else {
 		/* short timeout for dead backends - lets retry soon */
 		be->wake = li_cur_ts(vr->wrk) + 1.0;
 
-		be->state = BE_DOWN;
+		_balancer_backend_set_state(b, be, BE_DOWN);
 	}
 
 
@@ -506,14 +719,29 @@ static void balancer_act_free(liServer *srv, gpointer param) {
 
 static liAction* balancer_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	balancer *b;
+	balancer_method method = GPOINTER_TO_INT(userdata); /* userdata contains the method */
+	liPattern *hash_key = NULL;
 
 	if (NULL == val) {
 		ERROR(srv, "%s", "need parameter");
 		return NULL;
 	}
 
-	/* userdata contains the method */
-	b = balancer_new(wrk, p, GPOINTER_TO_INT(userdata));
+	if (BM_HASH == method) {
+		val = li_value_get_single_argument(val);
+		if (!li_value_list_has_len(val, 2) || LI_VALUE_STRING != li_value_type(li_value_list_at(val, 0))) {
+			ERROR(srv, "%s", "balance.hash expects a key pattern and the actions to balance between");
+			return NULL;
+		}
+		if (NULL == (hash_key = li_pattern_new(srv, li_value_list_at(val, 0)->data.string->str))) {
+			ERROR(srv, "%s", "balance.hash: parsing key pattern failed");
+			return NULL;
+		}
+		val = li_value_list_at(val, 1);
+	}
+
+	b = balancer_new(wrk, p, method);
+	b->hash_key = hash_key;
 	if (!balancer_fill_backends(b, srv, val)) {
 		balancer_free(srv, b);
 		return NULL;
@@ -531,6 +759,8 @@ static const liPluginOption options[] = {
 static const liPluginAction actions[] = {
 	{ "balance.rr", balancer_create, GINT_TO_POINTER(BM_ROUNDROBIN) },
 	{ "balance.sqf", balancer_create, GINT_TO_POINTER(BM_SQF) },
+	{ "balance.hash", balancer_create, GINT_TO_POINTER(BM_HASH) },
+	{ "balance.ewma", balancer_create, GINT_TO_POINTER(BM_EWMA) },
 	{ NULL, NULL, NULL }
 };
 
@@ -10,6 +10,7 @@
 
 #include <lighttpd/base.h>
 #include <lighttpd/plugin_core.h>
+#include <lighttpd/filter_cache_file.h>
 
 #include <sys/stat.h>
 #include <fcntl.h>
@@ -24,8 +25,7 @@ struct cache_etag_context {
 
 typedef struct cache_etag_file cache_etag_file;
 struct cache_etag_file {
-	GString *filename, *tmpfilename;
-	int fd;
+	GString *filename;
 /* cache hit */
 	int hit_fd;
 	goffset hit_length;
@@ -34,58 +34,12 @@ struct cache_etag_file {
 static cache_etag_file* cache_etag_file_create(GString *filename) {
 	cache_etag_file *cfile = g_slice_new0(cache_etag_file);
 	cfile->filename = filename;
-	cfile->fd = -1;
 	cfile->hit_fd = -1;
 	return cfile;
 }
 
-static gboolean mkdir_for_file(liVRequest *vr, char *filename) {
-	char *p = filename;
-
-	if (!filename || !filename[0])
-		return FALSE;
-
-	while ((p = strchr(p + 1, '/')) != NULL) {
-		*p = '\0';
-		if ((mkdir(filename, 0700) != 0) && (errno != EEXIST)) {
-			VR_ERROR(vr, "creating cache-directory '%s' failed: %s", filename, g_strerror(errno));
-			*p = '/';
-			return FALSE;
-		}
-
-		*p++ = '/';
-		if (!*p) {
-			VR_ERROR(vr, "unexpected trailing slash for filename '%s'", filename);
-			return FALSE;
-		}
-	}
-
-	return TRUE;
-}
-
-static gboolean cache_etag_file_start(liVRequest *vr, cache_etag_file *cfile) {
-	cfile->tmpfilename = g_string_sized_new(cfile->filename->len + 7);
-	g_string_append_len(cfile->tmpfilename, GSTR_LEN(cfile->filename));
-	g_string_append_len(cfile->tmpfilename, CONST_STR_LEN("-XXXXXX"));
-
-	if (!mkdir_for_file(vr, cfile->tmpfilename->str)) {
-		return FALSE;
-	}
-
-	errno = 0; /* posix doesn't define any errors */
-	if (-1 == (cfile->fd = mkstemp(cfile->tmpfilename->str))) {
-		VR_ERROR(vr, "Couldn't create cache tempfile '%s': %s", cfile->tmpfilename->str, g_strerror(errno));
-		return FALSE;
-	}
-	return TRUE;
-}
-
 static void cache_etag_file_free(cache_etag_file *cfile) {
 	if (!cfile) return;
-	if (cfile->fd != -1) {
-		close(cfile->fd);
-		unlink(cfile->tmpfilename->str);
-	}
 	if (cfile->hit_fd != -1) {
 		close(cfile->hit_fd);
 		cfile->hit_fd = -1;
@@ -94,33 +48,11 @@ static void cache_etag_file_free(cache_etag_file *cfile) {
 		g_string_free(cfile->filename, TRUE);
 		cfile->filename = NULL;
 	}
-	if (cfile->tmpfilename) {
-		g_string_free(cfile->tmpfilename, TRUE);
-		cfile->tmpfilename = NULL;
-	}
 	g_slice_free(cache_etag_file, cfile);
 }
 
-static void cache_etag_file_finish(liVRequest *vr, cache_etag_file *cfile) {
-	close(cfile->fd);
-	cfile->fd = -1;
-	if (-1 == rename(cfile->tmpfilename->str, cfile->filename->str)) {
-		VR_ERROR(vr, "Couldn't move temporary cache file '%s': '%s'", cfile->tmpfilename->str, g_strerror(errno));
-		unlink(cfile->tmpfilename->str);
-	}
-	cache_etag_file_free(cfile);
-}
-
 /**********************************************************************************/
 
-static void cache_etag_filter_free(liVRequest *vr, liFilter *f) {
-	cache_etag_file *cfile = (cache_etag_file*) f->param;
-	UNUSED(vr);
-	f->param = NULL;
-
-	cache_etag_file_free(cfile);
-}
-
 static liHandlerResult cache_etag_filter_hit(liVRequest *vr, liFilter *f) {
 	UNUSED(vr);
 
@@ -133,77 +65,6 @@ static liHandlerResult cache_etag_filter_hit(liVRequest *vr, liFilter *f) {
 	return LI_HANDLER_GO_ON;
 }
 
-static liHandlerResult cache_etag_filter_miss(liVRequest *vr, liFilter *f) {
-	cache_etag_file *cfile = (cache_etag_file*) f->param;
-	ssize_t res;
-	gchar *buf;
-	off_t buflen;
-	liChunkIter citer;
-	GError *err = NULL;
-
-	if (NULL == f->in) {
-		cache_etag_filter_free(vr, f);
-		/* didn't handle f->in->is_closed? abort forwarding */
-		if (!f->out->is_closed) li_stream_reset(&f->stream);
-		return LI_HANDLER_GO_ON;
-	}
-
-	if (NULL == cfile) goto forward;
-
-	if (f->in->length > 0) {
-		citer = li_chunkqueue_iter(f->in);
-		if (LI_HANDLER_GO_ON != li_chunkiter_read(citer, 0, 64*1024, &buf, &buflen, &err)) {
-			if (NULL != err) {
-				if (NULL != vr) VR_ERROR(vr, "Couldn't read data from chunkqueue: %s", err->message);
-				g_error_free(err);
-			} else {
-				if (NULL != vr) VR_ERROR(vr, "%s", "Couldn't read data from chunkqueue");
-			}
-			cache_etag_filter_free(vr, f);
-			goto forward;
-		}
-
-		res = write(cfile->fd, buf, buflen);
-		if (res < 0) {
-			switch (errno) {
-			case EINTR:
-			case EAGAIN:
-				return LI_HANDLER_COMEBACK;
-			default:
-				if (NULL != vr) VR_ERROR(vr, "Couldn't write to temporary cache file '%s': %s",
-					cfile->tmpfilename->str, g_strerror(errno));
-				cache_etag_filter_free(vr, f);
-				goto forward;
-			}
-		} else {
-			if (!f->out->is_closed) {
-				li_chunkqueue_steal_len(f->out, f->in, res);
-			} else {
-				li_chunkqueue_skip(f->in, res);
-			}
-		}
-	}
-
-	if (0 == f->in->length && f->in->is_closed) {
-		f->out->is_closed = TRUE;
-		f->param = NULL;
-		cache_etag_file_finish(vr, cfile);
-		return LI_HANDLER_GO_ON;
-	}
-
-	return LI_HANDLER_GO_ON;
-
-forward:
-	if (f->out->is_closed) {
-		li_chunkqueue_skip_all(f->in);
-		li_stream_disconnect(&f->stream);
-	} else {
-		li_chunkqueue_steal_all(f->out, f->in);
-		if (f->in->is_closed) f->out->is_closed = f->in->is_closed;
-	}
-	return LI_HANDLER_GO_ON;
-}
-
 static GString* createFileName(liVRequest *vr, GString *path, liHttpHeader *etagheader) {
 	GString *file = g_string_sized_new(255);
 	gchar* etag_base64 = g_base64_encode((guchar*) LI_HEADER_VALUE_LEN(etagheader));
@@ -292,13 +153,8 @@ static liHandlerResult cache_etag_handle(liVRequest *vr, gpointer param, gpointe
 		VR_DEBUG(vr, "cache miss for '%s'", vr->request.uri.path->str);
 	}
 
-	if (!cache_etag_file_start(vr, cfile)) {
-		cache_etag_file_free(cfile);
-		*context = NULL;
-		return LI_HANDLER_GO_ON; /* no caching */
-	}
-
-	li_vrequest_add_filter_out(vr, cache_etag_filter_miss, cache_etag_filter_free, NULL, cfile);
+	li_filter_cache_file(vr, cfile->filename->str, NULL, NULL);
+	cache_etag_file_free(cfile);
 	*context = NULL;
 
 	return LI_HANDLER_GO_ON;
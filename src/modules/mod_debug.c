@@ -36,7 +36,7 @@ struct mod_debug_data_t {
 	gint fd;
 	liConnectionState state;
 	GString *remote_addr_str, *local_addr_str;
-	gboolean is_ssl, keep_alive;
+	gboolean is_ssl, is_ktls, keep_alive;
 	GString *host, *path, *query;
 	liHttpMethod method;
 	goffset request_size;
@@ -50,6 +50,13 @@ struct mod_debug_data_t {
 };
 typedef struct mod_debug_data_t mod_debug_data_t;
 
+struct mod_debug_worker_data_t {
+	GArray *cons; /* mod_debug_data_t */
+	guint64 cond_cache_hits;
+	guint64 cond_cache_misses;
+};
+typedef struct mod_debug_worker_data_t mod_debug_worker_data_t;
+
 struct mod_debug_job_t {
 	liVRequest *vr;
 	gpointer *context;
@@ -80,12 +87,17 @@ typedef struct plugin_debug_data plugin_debug_data;
 
 /* the CollectFunc */
 static gpointer debug_collect_func(liWorker *wrk, gpointer fdata) {
+	mod_debug_worker_data_t *wd;
 	GArray *cons;
 	guint len;
 	mod_debug_job_t *job = fdata;
 
+	wd = g_slice_new(mod_debug_worker_data_t);
+	wd->cond_cache_hits = wrk->stats.cond_cache_hits;
+	wd->cond_cache_misses = wrk->stats.cond_cache_misses;
+
 	/* gather connection info */
-	cons = g_array_sized_new(FALSE, TRUE, sizeof(mod_debug_data_t), wrk->connections_active);
+	cons = wd->cons = g_array_sized_new(FALSE, TRUE, sizeof(mod_debug_data_t), wrk->connections_active);
 	g_array_set_size(cons, wrk->connections_active);
 
 	for (guint i = 0; i < wrk->connections_active; i++) {
@@ -97,6 +109,7 @@ static gpointer debug_collect_func(liWorker *wrk, gpointer fdata) {
 		cd->io_timeout_elem = c->io_timeout_elem;
 		cd->fd = -1;
 		cd->is_ssl = c->info.is_ssl;
+		cd->is_ktls = c->info.is_ktls;
 		cd->keep_alive = c->info.keep_alive;
 		cd->remote_addr_str = g_string_new_len(GSTR_LEN(c->info.remote_addr_str));
 		cd->local_addr_str = g_string_new_len(GSTR_LEN(c->info.local_addr_str));
@@ -123,6 +136,7 @@ static gpointer debug_collect_func(liWorker *wrk, gpointer fdata) {
 				g_string_append_printf(cd->detailed, "	remote_addr_str = \"%s\",\n", cd->remote_addr_str->str);
 				g_string_append_printf(cd->detailed, "	local_addr_str = \"%s\",\n", cd->local_addr_str->str);
 				g_string_append_printf(cd->detailed, "	is_ssl = \"%s\",\n", cd->is_ssl ? "true" : "false");
+				g_string_append_printf(cd->detailed, "	is_ktls = \"%s\",\n", cd->is_ktls ? "true" : "false");
 				g_string_append_printf(cd->detailed, "	keep_alive = \"%s\",\n", cd->keep_alive ? "true" : "false");
 				g_string_append_printf(cd->detailed, "	state = \"%s\",\n", li_connection_state_str(cd->state));
 				g_string_append_printf(cd->detailed, "	ts_started = %f,\n", cd->ts_started);
@@ -165,7 +179,7 @@ static gpointer debug_collect_func(liWorker *wrk, gpointer fdata) {
 		}
 	}
 
-	return cons;
+	return wd;
 }
 
 /* the CollectCallback */
@@ -181,7 +195,8 @@ static void debug_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result,
 		guint i, j;
 
 		for (i = 0; i < result->len; i++) {
-			GArray *cons = g_ptr_array_index(result, i);
+			mod_debug_worker_data_t *wd = g_ptr_array_index(result, i);
+			GArray *cons = wd->cons;
 			for (j = 0; j < cons->len; j++) {
 				mod_debug_data_t *cd = &g_array_index(cons, mod_debug_data_t, j);
 
@@ -195,6 +210,7 @@ static void debug_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result,
 			}
 
 			g_array_free(cons, TRUE);
+			g_slice_free(mod_debug_worker_data_t, wd);
 		}
 
 		if (job->detailed.remote_addr_str)
@@ -214,6 +230,27 @@ static void debug_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result,
 		"<style>a { color: blue; }</style>\n"
 		"</head>\n<body>\n"));
 
+	/* condition value cache */
+	{
+		guint i;
+		guint64 hits = 0, misses = 0;
+
+		g_string_append_len(html, CONST_STR_LEN("<table><tr><th>Worker</th><th>Condition cache hits</th><th>Misses</th><th>Hit rate</th></tr>\n"));
+		for (i = 0; i < result->len; i++) {
+			mod_debug_worker_data_t *wd = g_ptr_array_index(result, i);
+
+			g_string_append_printf(html, "<tr><td>%u</td><td style=\"text-align:right;\">%"G_GUINT64_FORMAT"</td><td style=\"text-align:right;\">%"G_GUINT64_FORMAT"</td><td style=\"text-align:right;\">%.1f%%</td></tr>\n",
+				i, wd->cond_cache_hits, wd->cond_cache_misses,
+				(wd->cond_cache_hits + wd->cond_cache_misses) > 0 ? 100.0 * wd->cond_cache_hits / (wd->cond_cache_hits + wd->cond_cache_misses) : 0.0
+			);
+			hits += wd->cond_cache_hits;
+			misses += wd->cond_cache_misses;
+		}
+		g_string_append_printf(html, "<tr><td>all</td><td style=\"text-align:right;\">%"G_GUINT64_FORMAT"</td><td style=\"text-align:right;\">%"G_GUINT64_FORMAT"</td><td style=\"text-align:right;\">%.1f%%</td></tr>\n</table>\n",
+			hits, misses, (hits + misses) > 0 ? 100.0 * hits / (hits + misses) : 0.0
+		);
+	}
+
 	/* list connections */
 	{
 		guint i, j;
@@ -227,7 +264,8 @@ static void debug_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result,
 		g_string_append_len(html, CONST_STR_LEN("<table><tr><th>Client</th><th>Duration</th><th></th></tr>\n"));
 
 		for (i = 0; i < result->len; i++) {
-			GArray *cons = g_ptr_array_index(result, i);
+			mod_debug_worker_data_t *wd = g_ptr_array_index(result, i);
+			GArray *cons = wd->cons;
 
 			for (j = 0; j < cons->len; j++) {
 				mod_debug_data_t *d = &g_array_index(cons, mod_debug_data_t, j);
@@ -252,6 +290,7 @@ static void debug_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result,
 			}
 
 			g_array_free(cons, TRUE);
+			g_slice_free(mod_debug_worker_data_t, wd);
 		}
 
 		g_string_append_len(html, CONST_STR_LEN("</table>\n"));
@@ -8,6 +8,10 @@
 
 #include <lighttpd/base.h>
 #include <lighttpd/plugin_core.h>
+#include <lighttpd/filter_cache_file.h>
+
+#include <sys/stat.h>
+#include <fcntl.h>
 
 LI_API gboolean mod_deflate_init(liModules *mods, liModule *mod);
 LI_API gboolean mod_deflate_free(liModules *mods, liModule *mod);
@@ -20,6 +24,8 @@ LI_API gboolean mod_deflate_free(liModules *mods, liModule *mod);
 #define ENCODING_NAME_COMPRESS   "compress"
 #define ENCODING_NAME_BZIP2      "bzip2"
 #define ENCODING_NAME_X_BZIP2    "x-bzip2"
+#define ENCODING_NAME_BROTLI     "br"
+#define ENCODING_NAME_ZSTD       "zstd"
 
 typedef enum {
 	ENCODING_IDENTITY,
@@ -28,7 +34,10 @@ typedef enum {
 	ENCODING_GZIP,
 	ENCODING_X_GZIP,
 	ENCODING_DEFLATE,
-	ENCODING_COMPRESS
+	ENCODING_COMPRESS,
+	ENCODING_BROTLI,
+	ENCODING_ZSTD,
+	ENCODING_COUNT
 } encodings;
 
 static const char* encoding_names[] = {
@@ -39,9 +48,24 @@ static const char* encoding_names[] = {
 	"x-gzip",
 	"deflate",
 	"compress",
+	"br",
+	"zstd",
 	NULL
 };
 
+/* histogram in the worker statistics for each encoding */
+static const liStatsCompressEncoding encoding_stats[] = {
+	LI_STATS_COMPRESS_ZLIB, /* identity, not used */
+	LI_STATS_COMPRESS_BZIP2,
+	LI_STATS_COMPRESS_BZIP2,
+	LI_STATS_COMPRESS_ZLIB,
+	LI_STATS_COMPRESS_ZLIB,
+	LI_STATS_COMPRESS_ZLIB,
+	LI_STATS_COMPRESS_ZLIB, /* compress, not supported */
+	LI_STATS_COMPRESS_BROTLI,
+	LI_STATS_COMPRESS_ZSTD
+};
+
 static const guint encoding_available_mask = 0
 #ifdef HAVE_BZIP
 	| (1 << ENCODING_BZIP2) | (1 << ENCODING_X_BZIP2)
@@ -49,13 +73,38 @@ static const guint encoding_available_mask = 0
 #ifdef HAVE_ZLIB
 	| (1 << ENCODING_GZIP) | (1 << ENCODING_X_GZIP) | (1 << ENCODING_DEFLATE)
 #endif
+#ifdef HAVE_BROTLI
+	| (1 << ENCODING_BROTLI)
+#endif
+#ifdef HAVE_ZSTD
+	| (1 << ENCODING_ZSTD)
+#endif
 ;
 
+/* server preference if the client accepts several encodings with the same q-value */
+static const encodings encoding_default_order[] = {
+	ENCODING_BROTLI,
+	ENCODING_ZSTD,
+	ENCODING_BZIP2,
+	ENCODING_X_BZIP2,
+	ENCODING_GZIP,
+	ENCODING_X_GZIP,
+	ENCODING_DEFLATE
+};
+
+typedef struct deflate_cache deflate_cache;
+typedef struct deflate_adaptive deflate_adaptive;
+
 typedef struct deflate_config deflate_config;
 struct deflate_config {
 	liPlugin *p;
 	guint allowed_encodings;
-	guint blocksize, output_buffer, compression_level;
+	guint order[ENCODING_COUNT], order_len; /* preference; only allowed encodings */
+	guint blocksize, output_buffer;
+	gint level[ENCODING_COUNT];       /* compression level per encoding */
+	guint window_bits[ENCODING_COUNT]; /* 0: library default */
+	deflate_cache *cache; /* NULL: no disk cache */
+	deflate_adaptive *adaptive; /* NULL: always use the configured levels */
 };
 
 /**********************************************************************************/
@@ -99,11 +148,11 @@ static void deflate_context_zlib_free(deflate_context_zlib *ctx) {
 	g_slice_free(deflate_context_zlib, ctx);
 }
 
-static deflate_context_zlib* deflate_context_zlib_create(liVRequest *vr, deflate_config *conf, gboolean is_gzip) {
+static deflate_context_zlib* deflate_context_zlib_create(liVRequest *vr, deflate_config *conf, gboolean is_gzip, gint compression_level) {
 	deflate_context_zlib *ctx = g_slice_new0(deflate_context_zlib);
 	z_stream *z = &ctx->z;
-	guint compression_level = conf->compression_level;
-	guint window_size = -MAX_WBITS; /* supress zlib-header */
+	encodings enc = is_gzip ? ENCODING_GZIP : ENCODING_DEFLATE;
+	gint window_size = -(0 != conf->window_bits[enc] ? (gint) conf->window_bits[enc] : MAX_WBITS); /* supress zlib-header */
 	guint mem_level = 8;
 
 	ctx->conf = *conf;
@@ -325,10 +374,9 @@ static void deflate_context_bzip2_free(deflate_context_bzip2 *ctx) {
 	g_slice_free(deflate_context_bzip2, ctx);
 }
 
-static deflate_context_bzip2* deflate_context_bzip2_create(liVRequest *vr, deflate_config *conf) {
+static deflate_context_bzip2* deflate_context_bzip2_create(liVRequest *vr, deflate_config *conf, gint compression_level) {
 	deflate_context_bzip2 *ctx = g_slice_new0(deflate_context_bzip2);
 	bz_stream *bz = &ctx->bz;
-	guint compression_level = conf->compression_level;
 
 	ctx->conf = *conf;
 
@@ -467,253 +515,1384 @@ static liHandlerResult deflate_filter_bzip2(liVRequest *vr, liFilter *f) {
 }
 #endif /* HAVE_BZIP */
 
-static liHandlerResult deflate_filter_null(liVRequest *vr, liFilter *f) {
-	UNUSED(vr);
-	if (NULL != f->in) {
-		li_chunkqueue_skip_all(f->in);
-		li_stream_disconnect(&f->stream);
-	}
-	return LI_HANDLER_GO_ON;
-}
-
 /**********************************************************************************/
 
-/* returns TRUE if handled with 304, FALSE otherwise */
-static gboolean cached_handle_etag(liVRequest *vr, gboolean debug, liHttpHeader *hh_etag, const char* enc_name) {
-	GString *s = vr->wrk->tmp_str;
+#ifdef HAVE_BROTLI
 
-	if (!hh_etag) return FALSE;
+# include <brotli/encode.h>
 
-	g_string_truncate(s, 0);
-	g_string_append_len(s, LI_HEADER_VALUE_LEN(hh_etag));
-	g_string_append_len(s, CONST_STR_LEN("-"));
-	g_string_append_len(s, enc_name, strlen(enc_name));
-	li_etag_mutate(s, s);
-	g_string_truncate(hh_etag->data, hh_etag->keylen + 2);
-	g_string_append_len(hh_etag->data, GSTR_LEN(s));
+typedef struct deflate_context_brotli deflate_context_brotli;
+struct deflate_context_brotli {
+	deflate_config conf;
 
-	if (200 == vr->response.http_status && li_http_response_handle_cachable(vr)) {
-		if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
-			VR_DEBUG(vr, "%s", "deflate: etag handling => 304 Not Modified");
-		}
-		vr->response.http_status = 304;
-		return TRUE;
-	}
-	return FALSE;
+	BrotliEncoderState *state;
+	GByteArray *buf;
+	size_t avail_out;
+	uint8_t *next_out;
+};
+
+static void deflate_context_brotli_free(deflate_context_brotli *ctx) {
+	if (!ctx) return;
+
+	BrotliEncoderDestroyInstance(ctx->state);
+
+	g_byte_array_free(ctx->buf, TRUE);
+
+	g_slice_free(deflate_context_brotli, ctx);
 }
 
-static guint header_to_endocing_mask(const gchar *s) {
-	guint encoding_mask = 0, i;
+static deflate_context_brotli* deflate_context_brotli_create(liVRequest *vr, deflate_config *conf, gint compression_level) {
+	deflate_context_brotli *ctx = g_slice_new0(deflate_context_brotli);
 
-	for (i = 1; encoding_names[i]; i++) {
-		const gchar *p = strstr(s, encoding_names[i]);
-		if (NULL != p && (p == s || p[-1] == ' ' || p[-1] == ',')) {
-			encoding_mask |= 1 << i;
-		}
+	ctx->conf = *conf;
+
+	if (NULL == (ctx->state = BrotliEncoderCreateInstance(NULL, NULL, NULL))) {
+		VR_ERROR(vr, "%s", "Couldn't create brotli encoder");
+		g_slice_free(deflate_context_brotli, ctx);
+		return NULL;
+	}
+
+	BrotliEncoderSetParameter(ctx->state, BROTLI_PARAM_QUALITY, compression_level);
+	if (0 != conf->window_bits[ENCODING_BROTLI]) {
+		BrotliEncoderSetParameter(ctx->state, BROTLI_PARAM_LGWIN, conf->window_bits[ENCODING_BROTLI]);
 	}
 
-	return encoding_mask;
+	ctx->buf = g_byte_array_new();
+	g_byte_array_set_size(ctx->buf, conf->output_buffer);
+
+	ctx->next_out = ctx->buf->data;
+	ctx->avail_out = ctx->buf->len;
+
+	return ctx;
 }
 
-static liHandlerResult deflate_handle(liVRequest *vr, gpointer param, gpointer *context) {
-	deflate_config *config = (deflate_config*) param;
-	GList *hh_encoding_entry, *hh_etag_entry;
-	liHttpHeader *hh_encoding, *hh_etag = NULL;
-	guint encoding_mask = 0, i;
-	gboolean debug = _OPTION(vr, config->p, 0).boolean;
-	gboolean is_head_request = (vr->request.http_method == LI_HTTP_METHOD_HEAD);
+static void deflate_filter_brotli_free(liVRequest *vr, liFilter *f) {
+	deflate_context_brotli *ctx = (deflate_context_brotli*) f->param;
+	UNUSED(vr);
 
-	UNUSED(context);
+	deflate_context_brotli_free(ctx);
+}
 
-	LI_VREQUEST_WAIT_FOR_RESPONSE_HEADERS(vr);
+static void deflate_brotli_flush_buf(deflate_context_brotli *ctx, liChunkQueue *out) {
+	if (0 < ctx->buf->len - ctx->avail_out) {
+		li_chunkqueue_append_mem(out, ctx->buf->data, ctx->buf->len - ctx->avail_out);
+		ctx->next_out = ctx->buf->data;
+		ctx->avail_out = ctx->buf->len;
+	}
+}
 
-	/* disable compression for some http status types. */
-	switch(vr->response.http_status) {
-	case 100:
-	case 101:
-	case 204:
-	case 205:
-	case 206:
-	case 304:
-		/* disable compression as we have no response entity */
+/* run op (FLUSH or FINISH) until the encoder has no more output */
+static gboolean deflate_brotli_drain(deflate_context_brotli *ctx, liChunkQueue *out, BrotliEncoderOperation op) {
+	do {
+		size_t avail_in = 0;
+		const uint8_t *next_in = NULL;
+
+		if (!BrotliEncoderCompressStream(ctx->state, op, &avail_in, &next_in, &ctx->avail_out, &ctx->next_out, NULL)) {
+			return FALSE;
+		}
+		if (0 == ctx->avail_out) deflate_brotli_flush_buf(ctx, out);
+	} while (BrotliEncoderHasMoreOutput(ctx->state) || (BROTLI_OPERATION_FINISH == op && !BrotliEncoderIsFinished(ctx->state)));
+
+	return TRUE;
+}
+
+static liHandlerResult deflate_filter_brotli(liVRequest *vr, liFilter *f) {
+	deflate_context_brotli *ctx = (deflate_context_brotli*) f->param;
+	const off_t blocksize = ctx->conf.blocksize;
+	const off_t max_compress = 4 * blocksize;
+	gboolean debug = (NULL != vr) && _OPTION(vr, ctx->conf.p, 0).boolean;
+	off_t l = 0;
+	liHandlerResult res;
+
+	if (NULL == f->in) {
+		f->out->is_closed = TRUE;
 		return LI_HANDLER_GO_ON;
-	default:
-		break;
 	}
 
-	/* response already encoded */
-	if (li_http_header_find_first(vr->response.headers, CONST_STR_LEN("content-encoding"))) {
-		if (debug) {
-			VR_DEBUG(vr, "%s", "deflate: Content-Encoding already set => not compressing");
-		}
+	if (f->in->is_closed && 0 == f->in->length && f->out->is_closed) {
+		/* nothing to do anymore */
 		return LI_HANDLER_GO_ON;
 	}
 
-	/* don't mess with content after transfer-encoding */
-	if (li_http_header_find_first(vr->response.headers, CONST_STR_LEN("transfer-encoding"))) {
+	if (f->out->is_closed) {
+		li_chunkqueue_skip_all(f->in);
+		li_stream_disconnect(&f->stream);
 		if (debug) {
-			VR_DEBUG(vr, "%s", "deflate: Transfer-Encoding set => not compressing");
+			VR_DEBUG(vr, "%s", "brotli out stream closed");
 		}
 		return LI_HANDLER_GO_ON;
 	}
 
-	/* announce that we have looked for accept-encoding */
-	li_http_header_append(vr->response.headers, CONST_STR_LEN("Vary"), CONST_STR_LEN("Accept-Encoding"));
+	while (l < max_compress) {
+		char *data;
+		off_t len;
+		liChunkIter ci;
+		GError *err = NULL;
+		size_t avail_in;
+		const uint8_t *next_in;
 
-	hh_encoding_entry = li_http_header_find_first(vr->request.headers, CONST_STR_LEN("accept-encoding"));
-	while (hh_encoding_entry) {
-		hh_encoding = (liHttpHeader*) hh_encoding_entry->data;
-		encoding_mask |= header_to_endocing_mask(LI_HEADER_VALUE(hh_encoding));
-		hh_encoding_entry = li_http_header_find_next(hh_encoding_entry, CONST_STR_LEN("accept-encoding"));
-	}
+		if (0 == f->in->length) break;
 
-	if (0 == encoding_mask)
-		return LI_HANDLER_GO_ON; /* no known encoding found */
+		ci = li_chunkqueue_iter(f->in);
 
-	encoding_mask &= encoding_available_mask & config->allowed_encodings;
-	if (0 == encoding_mask) {
-		if (debug) {
-			VR_DEBUG(vr, "%s", "no common encoding found => not compressing");
+		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(ci, 0, blocksize, &data, &len, &err))) {
+			if (NULL != err) {
+				if (NULL != vr) VR_ERROR(vr, "Couldn't read data from chunkqueue: %s", err->message);
+				g_error_free(err);
+			}
+			return res;
 		}
-		return LI_HANDLER_GO_ON; /* no common encoding found */
-	}
 
-	/* find best encoding (first in list) */
-	for (i = 1; 0 == (encoding_mask & (1 << i)) ; i++) ;
+		next_in = (const uint8_t*) data;
+		avail_in = len;
 
-	hh_etag_entry = li_http_header_find_first(vr->response.headers, CONST_STR_LEN("etag"));
-	if (hh_etag_entry) {
-		if (li_http_header_find_next(hh_etag_entry, CONST_STR_LEN("etag"))) {
-			if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
-				VR_DEBUG(vr, "%s", "duplicate etag header in response, will not deflate it");
+		do {
+			if (!BrotliEncoderCompressStream(ctx->state, BROTLI_OPERATION_PROCESS, &avail_in, &next_in, &ctx->avail_out, &ctx->next_out, NULL)) {
+				f->out->is_closed = TRUE;
+				if (NULL != vr) VR_ERROR(vr, "%s", "brotli compression error");
+				return LI_HANDLER_ERROR;
 			}
-			return LI_HANDLER_GO_ON;
-		}
-		hh_etag = (liHttpHeader*) hh_etag_entry->data;
-	}
 
-	if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
-		VR_DEBUG(vr, "deflate: compressing using %s encoding", encoding_names[i]);
+			if (0 == ctx->avail_out) deflate_brotli_flush_buf(ctx, f->out);
+		} while (avail_in > 0);
+
+		li_chunkqueue_skip(f->in, len);
+		l += len;
 	}
 
-	switch ((encodings) i) {
-	case ENCODING_IDENTITY:
-		return LI_HANDLER_GO_ON;
-	case ENCODING_BZIP2:
-	case ENCODING_X_BZIP2:
-#ifdef HAVE_BZIP
-		if (cached_handle_etag(vr, debug, hh_etag, encoding_names[i])) return LI_HANDLER_GO_ON;
-		if (!is_head_request) {
-			deflate_context_bzip2 *ctx;
-			ctx = deflate_context_bzip2_create(vr, config);
-			if (!ctx) return LI_HANDLER_GO_ON;
-			li_vrequest_add_filter_out(vr, deflate_filter_bzip2, deflate_filter_bzip2_free, NULL, ctx);
-		}
-		break;
-#endif
-		return LI_HANDLER_GO_ON;
-	case ENCODING_GZIP:
-	case ENCODING_X_GZIP:
-#ifdef HAVE_ZLIB
-		if (cached_handle_etag(vr, debug, hh_etag, encoding_names[i])) return LI_HANDLER_GO_ON;
-		if (!is_head_request) {
-			deflate_context_zlib *ctx;
-			ctx = deflate_context_zlib_create(vr, config, TRUE);
-			if (!ctx) return LI_HANDLER_GO_ON;
-			li_vrequest_add_filter_out(vr, deflate_filter_zlib, deflate_filter_zlib_free, NULL, ctx);
+	if (0 == f->in->length && f->in->is_closed) {
+		if (!deflate_brotli_drain(ctx, f->out, BROTLI_OPERATION_FINISH)) {
+			f->out->is_closed = TRUE;
+			if (NULL != vr) VR_ERROR(vr, "%s", "brotli compression error");
+			return LI_HANDLER_ERROR;
 		}
-		break;
-#endif
-		return LI_HANDLER_GO_ON;
-	case ENCODING_DEFLATE:
-#ifdef HAVE_ZLIB
-		if (cached_handle_etag(vr, debug, hh_etag, encoding_names[i])) return LI_HANDLER_GO_ON;
-		if (!is_head_request) {
-			deflate_context_zlib *ctx;
-			ctx = deflate_context_zlib_create(vr, config, FALSE);
-			if (!ctx) return LI_HANDLER_GO_ON;
-			li_vrequest_add_filter_out(vr, deflate_filter_zlib, deflate_filter_zlib_free, NULL, ctx);
+		deflate_brotli_flush_buf(ctx, f->out);
+
+		if (debug) {
+			VR_DEBUG(vr, "%s", "brotli finished");
 		}
-		break;
-#endif
-		return LI_HANDLER_GO_ON;
-	case ENCODING_COMPRESS:
-		return LI_HANDLER_GO_ON;
-	}
 
-	if (is_head_request) {
-		/* kill content so response.c doesn't send wrong content-length */
-		liFilter *f = li_vrequest_add_filter_out(vr, deflate_filter_null, NULL, NULL, NULL);
 		f->out->is_closed = TRUE;
 	}
 
-	li_http_header_insert(vr->response.headers, CONST_STR_LEN("Content-Encoding"), encoding_names[i], strlen(encoding_names[i]));
-	li_http_header_remove(vr->response.headers, CONST_STR_LEN("content-length"));
+	if (l > 0 && 0 == f->in->length && !f->in->is_closed) { /* flush encoder */
+		if (!deflate_brotli_drain(ctx, f->out, BROTLI_OPERATION_FLUSH)) {
+			if (NULL != vr) VR_ERROR(vr, "%s", "brotli compression error");
+			return LI_HANDLER_ERROR;
+		}
+	}
 
-	return LI_HANDLER_GO_ON;
+	/* flush output buffer if there is no more data pending */
+	if (0 == f->in->length) deflate_brotli_flush_buf(ctx, f->out);
+
+	return 0 == f->in->length ? LI_HANDLER_GO_ON : LI_HANDLER_COMEBACK;
 }
+#endif /* HAVE_BROTLI */
 
-static void deflate_free(liServer *srv, gpointer param) {
-	deflate_config *conf = (deflate_config*) param;
-	UNUSED(srv);
+/**********************************************************************************/
 
-	g_slice_free(deflate_config, conf);
+#ifdef HAVE_ZSTD
+
+# include <zstd.h>
+
+typedef struct deflate_context_zstd deflate_context_zstd;
+struct deflate_context_zstd {
+	deflate_config conf;
+
+	ZSTD_CCtx *cctx;
+	GByteArray *buf;
+	ZSTD_outBuffer out;
+};
+
+static void deflate_context_zstd_free(deflate_context_zstd *ctx) {
+	if (!ctx) return;
+
+	ZSTD_freeCCtx(ctx->cctx);
+
+	g_byte_array_free(ctx->buf, TRUE);
+
+	g_slice_free(deflate_context_zstd, ctx);
 }
 
-/* deflate option names */
-static const GString
-	don_encodings = { CONST_STR_LEN("encodings"), 0 },
-	don_blocksize = { CONST_STR_LEN("blocksize"), 0 },
-	don_outputbuffer = { CONST_STR_LEN("output-buffer"), 0 },
-	don_compression_level = { CONST_STR_LEN("compression-level"), 0 }
-;
+static deflate_context_zstd* deflate_context_zstd_create(liVRequest *vr, deflate_config *conf, gint compression_level) {
+	deflate_context_zstd *ctx = g_slice_new0(deflate_context_zstd);
+	size_t rc;
 
-static liAction* deflate_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
-	deflate_config *conf;
-	gboolean
-		have_encodings_parameter = FALSE,
-		have_blocksize_parameter = FALSE,
-		have_outputbuffer_parameter = FALSE,
-		have_compression_level_parameter = FALSE;
-	UNUSED(wrk); UNUSED(userdata);
+	ctx->conf = *conf;
 
-	val = li_value_get_single_argument(val);
+	if (NULL == (ctx->cctx = ZSTD_createCCtx())) {
+		VR_ERROR(vr, "%s", "Couldn't create zstd context");
+		g_slice_free(deflate_context_zstd, ctx);
+		return NULL;
+	}
 
-	if (NULL != val && NULL == (val = li_value_to_key_value_list(val))) {
-		ERROR(srv, "%s", "deflate expects a optional hash/key-value list as parameter");
+	rc = ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_compressionLevel, compression_level);
+	if (!ZSTD_isError(rc) && 0 != conf->window_bits[ENCODING_ZSTD]) {
+		rc = ZSTD_CCtx_setParameter(ctx->cctx, ZSTD_c_windowLog, conf->window_bits[ENCODING_ZSTD]);
+	}
+	if (ZSTD_isError(rc)) {
+		VR_ERROR(vr, "Couldn't configure zstd context: %s", ZSTD_getErrorName(rc));
+		ZSTD_freeCCtx(ctx->cctx);
+		g_slice_free(deflate_context_zstd, ctx);
 		return NULL;
 	}
 
-	conf = g_slice_new0(deflate_config);
-	conf->p = p;
-	conf->allowed_encodings = encoding_available_mask;
-	conf->blocksize = 16*1024;
-	conf->output_buffer = 4*1024;
-	conf->compression_level = 1;
+	ctx->buf = g_byte_array_new();
+	g_byte_array_set_size(ctx->buf, conf->output_buffer);
 
-	LI_VALUE_FOREACH(entry, val)
-		liValue *entryKey = li_value_list_at(entry, 0);
-		liValue *entryValue = li_value_list_at(entry, 1);
-		GString *entryKeyStr;
+	ctx->out.dst = ctx->buf->data;
+	ctx->out.size = ctx->buf->len;
+	ctx->out.pos = 0;
 
-		if (LI_VALUE_STRING != li_value_type(entryKey)) {
-			ERROR(srv, "%s", "deflate doesn't take default keys");
-			goto option_failed;
-		}
-		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
+	return ctx;
+}
 
-		if (g_string_equal(entryKeyStr, &don_encodings)) {
-			if (LI_VALUE_STRING != li_value_type(entryValue)) {
-				ERROR(srv, "deflate option '%s' expects string as parameter", entryKeyStr->str);
-				goto option_failed;
-			}
-			if (have_encodings_parameter) {
-				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
-				goto option_failed;
-			}
-			have_encodings_parameter = TRUE;
-			conf->allowed_encodings = header_to_endocing_mask(entryValue->data.string->str);
-		} else if (g_string_equal(entryKeyStr, &don_blocksize)) {
+static void deflate_filter_zstd_free(liVRequest *vr, liFilter *f) {
+	deflate_context_zstd *ctx = (deflate_context_zstd*) f->param;
+	UNUSED(vr);
+
+	deflate_context_zstd_free(ctx);
+}
+
+static void deflate_zstd_flush_buf(deflate_context_zstd *ctx, liChunkQueue *out) {
+	if (0 < ctx->out.pos) {
+		li_chunkqueue_append_mem(out, ctx->buf->data, ctx->out.pos);
+		ctx->out.pos = 0;
+	}
+}
+
+/* run mode (flush or end) until the frame (or block) is complete */
+static size_t deflate_zstd_drain(deflate_context_zstd *ctx, liChunkQueue *out, ZSTD_EndDirective mode) {
+	ZSTD_inBuffer in = { NULL, 0, 0 };
+	size_t remaining;
+
+	do {
+		remaining = ZSTD_compressStream2(ctx->cctx, &ctx->out, &in, mode);
+		if (ZSTD_isError(remaining)) return remaining;
+		if (ctx->out.pos == ctx->out.size) deflate_zstd_flush_buf(ctx, out);
+	} while (0 != remaining);
+
+	return 0;
+}
+
+static liHandlerResult deflate_filter_zstd(liVRequest *vr, liFilter *f) {
+	deflate_context_zstd *ctx = (deflate_context_zstd*) f->param;
+	const off_t blocksize = ctx->conf.blocksize;
+	const off_t max_compress = 4 * blocksize;
+	gboolean debug = (NULL != vr) && _OPTION(vr, ctx->conf.p, 0).boolean;
+	off_t l = 0;
+	liHandlerResult res;
+	size_t rc;
+
+	if (NULL == f->in) {
+		f->out->is_closed = TRUE;
+		return LI_HANDLER_GO_ON;
+	}
+
+	if (f->in->is_closed && 0 == f->in->length && f->out->is_closed) {
+		/* nothing to do anymore */
+		return LI_HANDLER_GO_ON;
+	}
+
+	if (f->out->is_closed) {
+		li_chunkqueue_skip_all(f->in);
+		li_stream_disconnect(&f->stream);
+		if (debug) {
+			VR_DEBUG(vr, "%s", "zstd out stream closed");
+		}
+		return LI_HANDLER_GO_ON;
+	}
+
+	while (l < max_compress) {
+		char *data;
+		off_t len;
+		liChunkIter ci;
+		GError *err = NULL;
+		ZSTD_inBuffer in;
+
+		if (0 == f->in->length) break;
+
+		ci = li_chunkqueue_iter(f->in);
+
+		if (LI_HANDLER_GO_ON != (res = li_chunkiter_read(ci, 0, blocksize, &data, &len, &err))) {
+			if (NULL != err) {
+				if (NULL != vr) VR_ERROR(vr, "Couldn't read data from chunkqueue: %s", err->message);
+				g_error_free(err);
+			}
+			return res;
+		}
+
+		in.src = data;
+		in.size = len;
+		in.pos = 0;
+
+		do {
+			rc = ZSTD_compressStream2(ctx->cctx, &ctx->out, &in, ZSTD_e_continue);
+			if (ZSTD_isError(rc)) {
+				f->out->is_closed = TRUE;
+				if (NULL != vr) VR_ERROR(vr, "zstd compression error: %s", ZSTD_getErrorName(rc));
+				return LI_HANDLER_ERROR;
+			}
+
+			if (ctx->out.pos == ctx->out.size) deflate_zstd_flush_buf(ctx, f->out);
+		} while (in.pos < in.size);
+
+		li_chunkqueue_skip(f->in, len);
+		l += len;
+	}
+
+	if (0 == f->in->length && f->in->is_closed) {
+		rc = deflate_zstd_drain(ctx, f->out, ZSTD_e_end);
+		if (ZSTD_isError(rc)) {
+			f->out->is_closed = TRUE;
+			if (NULL != vr) VR_ERROR(vr, "zstd compression error: %s", ZSTD_getErrorName(rc));
+			return LI_HANDLER_ERROR;
+		}
+		deflate_zstd_flush_buf(ctx, f->out);
+
+		if (debug) {
+			VR_DEBUG(vr, "%s", "zstd finished");
+		}
+
+		f->out->is_closed = TRUE;
+	}
+
+	if (l > 0 && 0 == f->in->length && !f->in->is_closed) { /* flush compressor */
+		rc = deflate_zstd_drain(ctx, f->out, ZSTD_e_flush);
+		if (ZSTD_isError(rc)) {
+			if (NULL != vr) VR_ERROR(vr, "zstd compression error: %s", ZSTD_getErrorName(rc));
+			return LI_HANDLER_ERROR;
+		}
+	}
+
+	/* flush output buffer if there is no more data pending */
+	if (0 == f->in->length) deflate_zstd_flush_buf(ctx, f->out);
+
+	return 0 == f->in->length ? LI_HANDLER_GO_ON : LI_HANDLER_COMEBACK;
+}
+#endif /* HAVE_ZSTD */
+
+static liHandlerResult deflate_filter_null(liVRequest *vr, liFilter *f) {
+	UNUSED(vr);
+	if (NULL != f->in) {
+		li_chunkqueue_skip_all(f->in);
+		li_stream_disconnect(&f->stream);
+	}
+	return LI_HANDLER_GO_ON;
+}
+
+/**********************************************************************************/
+/* disk cache for compressed static files
+ *
+ * key: physical path, etag, encoding and compression level; the file name is the sha1 of the key.
+ * a (per directory) in-memory index knows which files exist, their size and the last use;
+ * the first miss for a key compresses and writes the file (tempfile + rename), concurrent
+ * misses for the same key wait until it is finished.
+ */
+
+typedef struct deflate_plugin_data deflate_plugin_data;
+struct deflate_plugin_data {
+	GMutex *lock;
+	GHashTable *caches; /* (gchar*) path => (deflate_cache*), no reference */
+};
+
+struct deflate_cache {
+	gint refcount;
+	deflate_plugin_data *pd;
+	GString *path;
+	goffset max_size;   /* 0: unlimited */
+	li_tstamp max_age;  /* remove entries not used for max_age seconds; 0: unlimited */
+
+	GMutex *lock;
+	GHashTable *entries; /* (gchar*) name => (deflate_cache_entry*) */
+	GQueue lru;          /* complete entries, least recently used first */
+	goffset size;        /* size of all complete entries */
+};
+
+typedef struct deflate_cache_entry deflate_cache_entry;
+struct deflate_cache_entry {
+	gchar *name;
+	gboolean complete;   /* FALSE: someone is compressing */
+	goffset size;
+	li_tstamp used;
+	GList lru_link;
+	GPtrArray *waiters;  /* (deflate_cache_waiter*) waiting for the compression to finish */
+};
+
+typedef struct deflate_cache_waiter deflate_cache_waiter;
+struct deflate_cache_waiter {
+	gchar *name;
+	guint encoding;
+	gint level;
+	gboolean registered; /* in entry->waiters; protected by cache->lock */
+	liJobRef *vr_ref;
+};
+
+/* claimed cache entry; li_filter_cache_file() writes the file and releases the claim with deflate_cache_writer_done() */
+typedef struct deflate_cache_writer deflate_cache_writer;
+struct deflate_cache_writer {
+	deflate_cache *cache;
+	gchar *name;
+};
+
+typedef enum {
+	DEFLATE_CACHE_HIT,
+	DEFLATE_CACHE_MISS,
+	DEFLATE_CACHE_WAIT
+} deflate_cache_result;
+
+static GString* deflate_cache_filename(deflate_cache *cache, const gchar *name) {
+	GString *filename = g_string_sized_new(cache->path->len + 48);
+	g_string_append_len(filename, GSTR_LEN(cache->path));
+	g_string_append_len(filename, CONST_STR_LEN("/"));
+	g_string_append_len(filename, name, 2);
+	g_string_append_len(filename, CONST_STR_LEN("/"));
+	g_string_append(filename, name + 2);
+	return filename;
+}
+
+static void deflate_cache_entry_free(deflate_cache_entry *entry) {
+	LI_FORCE_ASSERT(NULL == entry->waiters || 0 == entry->waiters->len);
+	if (NULL != entry->waiters) g_ptr_array_free(entry->waiters, TRUE);
+	g_free(entry->name);
+	g_slice_free(deflate_cache_entry, entry);
+}
+
+/* cache->lock must be held */
+static void deflate_cache_wakeup(deflate_cache_entry *entry) {
+	guint i;
+
+	if (NULL == entry->waiters) return;
+
+	for (i = 0; i < entry->waiters->len; i++) {
+		deflate_cache_waiter *w = g_ptr_array_index(entry->waiters, i);
+		w->registered = FALSE;
+		li_job_async(w->vr_ref);
+	}
+	g_ptr_array_set_size(entry->waiters, 0);
+}
+
+/* cache->lock must be held; removes the file of a complete entry */
+static void deflate_cache_remove(deflate_cache *cache, deflate_cache_entry *entry) {
+	if (entry->complete) {
+		GString *filename = deflate_cache_filename(cache, entry->name);
+		unlink(filename->str);
+		g_string_free(filename, TRUE);
+
+		g_queue_unlink(&cache->lru, &entry->lru_link);
+		cache->size -= entry->size;
+	}
+
+	deflate_cache_wakeup(entry);
+	g_hash_table_remove(cache->entries, entry->name);
+}
+
+/* cache->lock must be held */
+static void deflate_cache_evict(deflate_cache *cache, li_tstamp now) {
+	GList *l;
+
+	while (NULL != (l = cache->lru.head)) {
+		deflate_cache_entry *entry = l->data;
+
+		if (cache->max_size > 0 && cache->size > cache->max_size) {
+			deflate_cache_remove(cache, entry);
+		} else if (cache->max_age > 0 && now - entry->used > cache->max_age) {
+			deflate_cache_remove(cache, entry);
+		} else {
+			break;
+		}
+	}
+}
+
+static deflate_cache_entry* deflate_cache_insert(deflate_cache *cache, const gchar *name, gboolean complete, goffset size, li_tstamp now) {
+	deflate_cache_entry *entry = g_slice_new0(deflate_cache_entry);
+	entry->name = g_strdup(name);
+	entry->complete = complete;
+	entry->size = size;
+	entry->used = now;
+	entry->lru_link.data = entry;
+	if (complete) {
+		g_queue_push_tail_link(&cache->lru, &entry->lru_link);
+		cache->size += size;
+	} else {
+		entry->waiters = g_ptr_array_new();
+	}
+	g_hash_table_insert(cache->entries, entry->name, entry);
+	return entry;
+}
+
+/* import files from a previous run; removes stale temporary files */
+static void deflate_cache_scan(deflate_cache *cache) {
+	GDir *dir, *subdir;
+	const gchar *dname, *fname;
+	GString *path = g_string_sized_new(cache->path->len + 48), *name = g_string_sized_new(48);
+	li_tstamp now = li_event_time();
+
+	if (NULL == (dir = g_dir_open(cache->path->str, 0, NULL))) goto out;
+
+	while (NULL != (dname = g_dir_read_name(dir))) {
+		gsize dirlen;
+
+		if (2 != strlen(dname)) continue;
+
+		g_string_printf(path, "%s/%s/", cache->path->str, dname);
+		dirlen = path->len;
+
+		if (NULL == (subdir = g_dir_open(path->str, 0, NULL))) continue;
+
+		while (NULL != (fname = g_dir_read_name(subdir))) {
+			struct stat st;
+
+			g_string_truncate(path, dirlen);
+			g_string_append(path, fname);
+
+			if (NULL != strchr(fname, '-')) {
+				/* tempfile of an unfinished compression */
+				unlink(path->str);
+				continue;
+			}
+
+			if (-1 == stat(path->str, &st) || !S_ISREG(st.st_mode)) continue;
+
+			g_string_printf(name, "%s%s", dname, fname);
+			if (NULL == g_hash_table_lookup(cache->entries, name->str)) {
+				deflate_cache_insert(cache, name->str, TRUE, st.st_size, now);
+			}
+		}
+
+		g_dir_close(subdir);
+	}
+
+	g_dir_close(dir);
+
+	deflate_cache_evict(cache, now);
+
+out:
+	g_string_free(path, TRUE);
+	g_string_free(name, TRUE);
+}
+
+static deflate_cache* deflate_cache_get(liServer *srv, deflate_plugin_data *pd, GString *path, goffset max_size, li_tstamp max_age) {
+	deflate_cache *cache;
+
+	g_mutex_lock(pd->lock);
+
+	if (NULL != (cache = g_hash_table_lookup(pd->caches, path->str))) {
+		if (cache->max_size != max_size || cache->max_age != max_age) {
+			g_mutex_unlock(pd->lock);
+			ERROR(srv, "deflate: cache '%s' already used with different limits", path->str);
+			return NULL;
+		}
+		g_atomic_int_inc(&cache->refcount);
+		g_mutex_unlock(pd->lock);
+		return cache;
+	}
+
+	cache = g_slice_new0(deflate_cache);
+	cache->refcount = 1;
+	cache->pd = pd;
+	cache->path = g_string_new_len(GSTR_LEN(path));
+	cache->max_size = max_size;
+	cache->max_age = max_age;
+	cache->lock = g_mutex_new();
+	cache->entries = g_hash_table_new_full(g_str_hash, g_str_equal, NULL, (GDestroyNotify) deflate_cache_entry_free);
+	g_queue_init(&cache->lru);
+
+	deflate_cache_scan(cache);
+
+	g_hash_table_insert(pd->caches, cache->path->str, cache);
+
+	g_mutex_unlock(pd->lock);
+
+	return cache;
+}
+
+static void deflate_cache_release(deflate_cache *cache) {
+	deflate_plugin_data *pd = cache->pd;
+
+	g_mutex_lock(pd->lock);
+	if (!g_atomic_int_dec_and_test(&cache->refcount)) {
+		g_mutex_unlock(pd->lock);
+		return;
+	}
+	g_hash_table_remove(pd->caches, cache->path->str);
+	g_mutex_unlock(pd->lock);
+
+	/* all requests are done, no compressing entries left */
+	g_hash_table_destroy(cache->entries);
+	g_mutex_free(cache->lock);
+	g_string_free(cache->path, TRUE);
+	g_slice_free(deflate_cache, cache);
+}
+
+static gchar* deflate_cache_key(liVRequest *vr, liHttpHeader *hh_etag, const gchar *enc_name, gint level, guint window_bits) {
+	GString *key = vr->wrk->tmp_str;
+
+	g_string_truncate(key, 0);
+	g_string_append_len(key, GSTR_LEN(vr->physical.path));
+	g_string_append_c(key, '\n');
+	g_string_append_len(key, LI_HEADER_VALUE_LEN(hh_etag));
+	g_string_append_c(key, '\n');
+	g_string_append(key, enc_name);
+	g_string_append_c(key, '\n');
+	li_string_append_int(key, level);
+	g_string_append_c(key, '/');
+	li_string_append_int(key, window_bits);
+
+	return g_compute_checksum_for_string(G_CHECKSUM_SHA1, key->str, key->len);
+}
+
+/* a HIT returns an open fd; a claimed MISS must be finished with deflate_cache_done() */
+static deflate_cache_result deflate_cache_lookup(deflate_cache *cache, deflate_cache_waiter *w, gboolean claim, li_tstamp now, int *fd, goffset *size) {
+	deflate_cache_entry *entry;
+	deflate_cache_result res;
+
+	g_mutex_lock(cache->lock);
+
+	entry = g_hash_table_lookup(cache->entries, w->name);
+
+	if (NULL != entry && entry->complete) {
+		GString *filename = deflate_cache_filename(cache, entry->name);
+		*fd = (cache->max_age > 0 && now - entry->used > cache->max_age) ? -1 : open(filename->str, O_RDONLY);
+		g_string_free(filename, TRUE);
+
+		if (-1 != *fd) {
+			entry->used = now;
+			g_queue_unlink(&cache->lru, &entry->lru_link);
+			g_queue_push_tail_link(&cache->lru, &entry->lru_link);
+			*size = entry->size;
+			g_mutex_unlock(cache->lock);
+			return DEFLATE_CACHE_HIT;
+		}
+
+		/* expired or removed from disk */
+		deflate_cache_remove(cache, entry);
+		entry = NULL;
+	}
+
+	if (NULL != entry) {
+		/* someone else is compressing */
+		if (claim) {
+			if (!w->registered) {
+				g_ptr_array_add(entry->waiters, w);
+				w->registered = TRUE;
+			}
+			res = DEFLATE_CACHE_WAIT;
+		} else {
+			res = DEFLATE_CACHE_MISS;
+		}
+	} else {
+		if (claim) deflate_cache_insert(cache, w->name, FALSE, 0, now);
+		res = DEFLATE_CACHE_MISS;
+	}
+
+	g_mutex_unlock(cache->lock);
+
+	return res;
+}
+
+/* finish a claimed miss: size < 0 means compression failed */
+static void deflate_cache_done(deflate_cache *cache, const gchar *name, goffset size, li_tstamp now) {
+	deflate_cache_entry *entry;
+
+	g_mutex_lock(cache->lock);
+
+	entry = g_hash_table_lookup(cache->entries, name);
+	if (NULL != entry && !entry->complete) {
+		deflate_cache_wakeup(entry);
+
+		if (size < 0) {
+			g_hash_table_remove(cache->entries, name);
+		} else {
+			entry->complete = TRUE;
+			entry->size = size;
+			entry->used = now;
+			g_queue_push_tail_link(&cache->lru, &entry->lru_link);
+			cache->size += size;
+			deflate_cache_evict(cache, now);
+		}
+	}
+
+	g_mutex_unlock(cache->lock);
+}
+
+static deflate_cache_waiter* deflate_cache_waiter_new(liVRequest *vr, gchar *name, guint encoding, gint level) {
+	deflate_cache_waiter *w = g_slice_new0(deflate_cache_waiter);
+	w->name = name;
+	w->encoding = encoding;
+	w->level = level;
+	w->vr_ref = li_vrequest_get_ref(vr);
+	return w;
+}
+
+static void deflate_cache_waiter_free(deflate_cache *cache, deflate_cache_waiter *w) {
+	if (NULL == w) return;
+
+	g_mutex_lock(cache->lock);
+	if (w->registered) {
+		deflate_cache_entry *entry = g_hash_table_lookup(cache->entries, w->name);
+		LI_FORCE_ASSERT(NULL != entry);
+		g_ptr_array_remove_fast(entry->waiters, w);
+		w->registered = FALSE;
+	}
+	g_mutex_unlock(cache->lock);
+
+	li_job_ref_release(w->vr_ref);
+	g_free(w->name);
+	g_slice_free(deflate_cache_waiter, w);
+}
+
+static void deflate_cache_writer_done(liVRequest *vr, goffset size, gpointer data) {
+	deflate_cache_writer *writer = (deflate_cache_writer*) data;
+
+	deflate_cache_done(writer->cache, writer->name, size, (NULL != vr) ? li_cur_ts(vr->wrk) : li_event_time());
+	g_free(writer->name);
+	g_slice_free(deflate_cache_writer, writer);
+}
+
+/* only complete static files (direct response with etag) are cached */
+static gboolean deflate_cache_usable(liVRequest *vr, liHttpHeader *hh_etag) {
+	return NULL != hh_etag
+		&& 200 == vr->response.http_status
+		&& 0 != vr->physical.path->len
+		&& NULL != vr->direct_out && vr->direct_out->is_closed
+		&& NULL == vr->filters_out_first;
+}
+
+/**********************************************************************************/
+
+/* returns TRUE if handled with 304, FALSE otherwise */
+static gboolean cached_handle_etag(liVRequest *vr, gboolean debug, liHttpHeader *hh_etag, const char* enc_name) {
+	GString *s = vr->wrk->tmp_str;
+
+	if (!hh_etag) return FALSE;
+
+	g_string_truncate(s, 0);
+	g_string_append_len(s, LI_HEADER_VALUE_LEN(hh_etag));
+	g_string_append_len(s, CONST_STR_LEN("-"));
+	g_string_append_len(s, enc_name, strlen(enc_name));
+	li_etag_mutate(s, s);
+	g_string_truncate(hh_etag->data, hh_etag->keylen + 2);
+	g_string_append_len(hh_etag->data, GSTR_LEN(s));
+	vr->response.headers->version++;
+
+	if (200 == vr->response.http_status && li_http_response_handle_cachable(vr)) {
+		if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+			VR_DEBUG(vr, "%s", "deflate: etag handling => 304 Not Modified");
+		}
+		vr->response.http_status = 304;
+		return TRUE;
+	}
+	return FALSE;
+}
+
+/* returns -1 for unknown encodings */
+static gint encoding_from_name(const gchar *name, gsize len) {
+	guint i;
+
+	for (i = 1; encoding_names[i]; i++) {
+		if (strlen(encoding_names[i]) == len && 0 == g_ascii_strncasecmp(name, encoding_names[i], len)) return i;
+	}
+
+	return -1;
+}
+
+/* "encodings" option: comma separated list; order is the server preference */
+static void parse_encodings_option(deflate_config *conf, const gchar *s) {
+	conf->allowed_encodings = 0;
+	conf->order_len = 0;
+
+	while ('\0' != *s) {
+		const gchar *name;
+		gint enc;
+
+		while (' ' == *s || '\t' == *s || ',' == *s) s++;
+		if ('\0' == *s) break;
+
+		name = s;
+		while ('\0' != *s && ',' != *s && ' ' != *s && '\t' != *s) s++;
+
+		if (-1 == (enc = encoding_from_name(name, s - name))) continue;
+		if (0 == (encoding_available_mask & (1 << enc))) continue;
+		if (0 != (conf->allowed_encodings & (1 << enc))) continue;
+
+		conf->allowed_encodings |= 1 << enc;
+		conf->order[conf->order_len++] = enc;
+	}
+}
+
+/**********************************************************************************/
+/* adaptive compression levels
+ *
+ * once per stats interval (a second) the event loop load of the worker (stats.loop_load) is compared
+ * with the thresholds: above "high" the levels are reduced by one more step (not below the minimum
+ * levels); if they already are at the minimum, large responses are not compressed at all until the
+ * load drops below "low" again. below "low" the levels go back up, one step per interval.
+ * between the thresholds nothing changes.
+ */
+
+typedef struct deflate_adaptive_worker deflate_adaptive_worker;
+struct deflate_adaptive_worker {
+	li_tstamp last_update; /* stats.last_update of the worker the state was calculated for */
+	guint step;            /* levels are reduced by this */
+	gboolean overloaded;   /* minimum levels reached and the load is still high */
+};
+
+struct deflate_adaptive {
+	gint refcount;
+	gdouble load_low, load_high;
+	gint min_level[ENCODING_COUNT];
+	guint max_step;
+	goffset max_size;      /* while overloaded don't compress responses larger than this; 0: no limit */
+
+	guint worker_count;
+	deflate_adaptive_worker *workers; /* one per worker, allocated in deflate_adaptive_prepare */
+};
+
+static void deflate_adaptive_release(deflate_adaptive *ad) {
+	if (!g_atomic_int_dec_and_test(&ad->refcount)) return;
+
+	if (NULL != ad->workers) {
+		g_slice_free1(sizeof(deflate_adaptive_worker) * ad->worker_count, ad->workers);
+	}
+	g_slice_free(deflate_adaptive, ad);
+}
+
+static void deflate_adaptive_prepare(liServer *srv, gpointer data, gboolean aborted) {
+	deflate_adaptive *ad = data;
+
+	if (!aborted) {
+		ad->worker_count = srv->worker_count;
+		ad->workers = g_slice_alloc0(sizeof(deflate_adaptive_worker) * ad->worker_count);
+	}
+	deflate_adaptive_release(ad);
+}
+
+static deflate_adaptive* deflate_adaptive_new(liServer *srv) {
+	deflate_adaptive *ad = g_slice_new0(deflate_adaptive);
+	ad->refcount = 2; /* one for deflate_adaptive_prepare() */
+	li_server_register_prepare_cb(srv, deflate_adaptive_prepare, ad);
+	return ad;
+}
+
+static deflate_adaptive_worker* deflate_adaptive_update(deflate_adaptive *ad, liWorker *wrk) {
+	deflate_adaptive_worker *aw;
+	li_tstamp last_update = wrk->stats.last_update;
+
+	if (NULL == ad->workers || wrk->ndx >= ad->worker_count) return NULL;
+	aw = &ad->workers[wrk->ndx];
+
+	if (aw->last_update != last_update) {
+		gdouble load = wrk->stats.loop_load;
+		/* go back up faster if there were no requests for some intervals */
+		guint intervals = (0 == aw->last_update) ? 1 : MAX(1, (guint) (last_update - aw->last_update));
+
+		aw->last_update = last_update;
+		if (load >= ad->load_high) {
+			if (aw->step < ad->max_step) {
+				aw->step++;
+			} else {
+				aw->overloaded = TRUE;
+			}
+		} else if (load <= ad->load_low) {
+			if (aw->overloaded) {
+				aw->overloaded = FALSE;
+				intervals--;
+			}
+			aw->step -= MIN(aw->step, intervals);
+		}
+	}
+
+	return aw;
+}
+
+/* response length from the closed direct response or the Content-Length header; -1 if unknown */
+static goffset deflate_response_length(liVRequest *vr) {
+	GList *l;
+
+	if (NULL != vr->direct_out && vr->direct_out->is_closed && NULL == vr->filters_out_first) {
+		return vr->direct_out->length;
+	}
+
+	if (NULL != (l = li_http_header_find_first(vr->response.headers, CONST_STR_LEN("content-length")))) {
+		liHttpHeader *hh = (liHttpHeader*) l->data;
+		gchar *end;
+		gint64 len = g_ascii_strtoll(LI_HEADER_VALUE(hh), &end, 10);
+		if (len >= 0 && end != LI_HEADER_VALUE(hh) && '\0' == *end) return len;
+	}
+
+	return -1;
+}
+
+/* level to use for enc; -1: don't compress (overloaded and response too large) */
+static gint deflate_select_level(liVRequest *vr, deflate_config *config, guint enc) {
+	deflate_adaptive *ad = config->adaptive;
+	deflate_adaptive_worker *aw;
+	goffset len;
+
+	if (NULL == ad || NULL == (aw = deflate_adaptive_update(ad, vr->wrk))) return config->level[enc];
+
+	if (aw->overloaded && 0 != ad->max_size && ((len = deflate_response_length(vr)) < 0 || len > ad->max_size)) {
+		return -1;
+	}
+
+	return MAX(ad->min_level[enc], config->level[enc] - (gint) aw->step);
+}
+
+/* returns FALSE if the encoding isn't available or the compressor couldn't be created */
+static gboolean deflate_add_compressor(liVRequest *vr, deflate_config *config, guint enc, gint level) {
+	switch ((encodings) enc) {
+	case ENCODING_BZIP2:
+	case ENCODING_X_BZIP2:
+#ifdef HAVE_BZIP
+		{
+			deflate_context_bzip2 *ctx;
+			ctx = deflate_context_bzip2_create(vr, config, level);
+			if (!ctx) return FALSE;
+			li_vrequest_add_filter_out(vr, deflate_filter_bzip2, deflate_filter_bzip2_free, NULL, ctx);
+		}
+		return TRUE;
+#endif
+		return FALSE;
+	case ENCODING_GZIP:
+	case ENCODING_X_GZIP:
+#ifdef HAVE_ZLIB
+		{
+			deflate_context_zlib *ctx;
+			ctx = deflate_context_zlib_create(vr, config, TRUE, level);
+			if (!ctx) return FALSE;
+			li_vrequest_add_filter_out(vr, deflate_filter_zlib, deflate_filter_zlib_free, NULL, ctx);
+		}
+		return TRUE;
+#endif
+		return FALSE;
+	case ENCODING_DEFLATE:
+#ifdef HAVE_ZLIB
+		{
+			deflate_context_zlib *ctx;
+			ctx = deflate_context_zlib_create(vr, config, FALSE, level);
+			if (!ctx) return FALSE;
+			li_vrequest_add_filter_out(vr, deflate_filter_zlib, deflate_filter_zlib_free, NULL, ctx);
+		}
+		return TRUE;
+#endif
+		return FALSE;
+	case ENCODING_BROTLI:
+#ifdef HAVE_BROTLI
+		{
+			deflate_context_brotli *ctx;
+			ctx = deflate_context_brotli_create(vr, config, level);
+			if (!ctx) return FALSE;
+			li_vrequest_add_filter_out(vr, deflate_filter_brotli, deflate_filter_brotli_free, NULL, ctx);
+		}
+		return TRUE;
+#endif
+		return FALSE;
+	case ENCODING_ZSTD:
+#ifdef HAVE_ZSTD
+		{
+			deflate_context_zstd *ctx;
+			ctx = deflate_context_zstd_create(vr, config, level);
+			if (!ctx) return FALSE;
+			li_vrequest_add_filter_out(vr, deflate_filter_zstd, deflate_filter_zstd_free, NULL, ctx);
+		}
+		return TRUE;
+#endif
+		return FALSE;
+	default:
+		return FALSE;
+	}
+}
+
+static void deflate_response_headers(liVRequest *vr, guint enc, gboolean is_head_request) {
+	if (is_head_request) {
+		/* kill content so response.c doesn't send wrong content-length */
+		liFilter *f = li_vrequest_add_filter_out(vr, deflate_filter_null, NULL, NULL, NULL);
+		f->out->is_closed = TRUE;
+	}
+
+	li_http_header_insert(vr->response.headers, CONST_STR_LEN("Content-Encoding"), encoding_names[enc], strlen(encoding_names[enc]));
+	li_http_header_remove(vr->response.headers, CONST_STR_LEN("content-length"));
+}
+
+/* *context is the deflate_cache_waiter; etag and vary headers are already done */
+static liHandlerResult deflate_handle_cache(liVRequest *vr, deflate_config *config, gboolean debug, gpointer *context) {
+	deflate_cache_waiter *w = (deflate_cache_waiter*) *context;
+	gboolean is_head_request = (vr->request.http_method == LI_HTTP_METHOD_HEAD);
+	guint enc = w->encoding;
+	deflate_cache_writer *writer = NULL;
+	liFilter *f;
+	gint level;
+	int fd = -1;
+	goffset size = 0;
+
+	debug = debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean;
+
+	switch (deflate_cache_lookup(config->cache, w, !is_head_request, li_cur_ts(vr->wrk), &fd, &size)) {
+	case DEFLATE_CACHE_WAIT:
+		if (debug) {
+			VR_DEBUG(vr, "deflate: waiting for compression of '%s' in other request", vr->physical.path->str);
+		}
+		return LI_HANDLER_WAIT_FOR_EVENT;
+	case DEFLATE_CACHE_HIT:
+		if (debug) {
+			VR_DEBUG(vr, "deflate: cache hit for '%s'", vr->physical.path->str);
+		}
+		deflate_cache_waiter_free(config->cache, w);
+		*context = NULL;
+
+		/* replace content with the cache file */
+		f = li_vrequest_add_filter_out(vr, deflate_filter_null, NULL, NULL, NULL);
+		if (NULL == f) {
+			close(fd);
+			return LI_HANDLER_GO_ON;
+		}
+		if (is_head_request) {
+			close(fd);
+		} else {
+			li_chunkqueue_append_file_fd(f->out, NULL, 0, size, fd);
+		}
+		f->out->is_closed = TRUE;
+
+		g_string_truncate(vr->wrk->tmp_str, 0);
+		li_string_append_int(vr->wrk->tmp_str, size);
+		li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Length"), GSTR_LEN(vr->wrk->tmp_str));
+		li_http_header_insert(vr->response.headers, CONST_STR_LEN("Content-Encoding"), encoding_names[enc], strlen(encoding_names[enc]));
+		return LI_HANDLER_GO_ON;
+	case DEFLATE_CACHE_MISS:
+		break;
+	}
+
+	if (debug && !is_head_request) {
+		VR_DEBUG(vr, "deflate: cache miss for '%s'", vr->physical.path->str);
+	}
+
+	level = w->level;
+	if (!is_head_request) {
+		writer = g_slice_new0(deflate_cache_writer);
+		writer->cache = config->cache;
+		writer->name = g_strdup(w->name);
+	}
+	deflate_cache_waiter_free(config->cache, w);
+	*context = NULL;
+
+	if (!is_head_request) {
+		GString *filename;
+
+		if (!deflate_add_compressor(vr, config, enc, level)) {
+			deflate_cache_writer_done(vr, -1, writer);
+			return LI_HANDLER_GO_ON;
+		}
+
+		filename = deflate_cache_filename(config->cache, writer->name);
+		li_filter_cache_file(vr, filename->str, deflate_cache_writer_done, writer);
+		g_string_free(filename, TRUE);
+	}
+
+	deflate_response_headers(vr, enc, is_head_request);
+
+	return LI_HANDLER_GO_ON;
+}
+
+static liHandlerResult deflate_handle(liVRequest *vr, gpointer param, gpointer *context) {
+	deflate_config *config = (deflate_config*) param;
+	GList *hh_etag_entry;
+	liHttpHeader *hh_etag = NULL;
+	gint q[ENCODING_COUNT], q_star, best_q = 0, level;
+	guint i, k;
+	gboolean debug = _OPTION(vr, config->p, 0).boolean;
+	gboolean is_head_request = (vr->request.http_method == LI_HTTP_METHOD_HEAD);
+
+	LI_VREQUEST_WAIT_FOR_RESPONSE_HEADERS(vr);
+
+	if (NULL != *context) {
+		/* woken up: compression in another request finished */
+		return deflate_handle_cache(vr, config, debug, context);
+	}
+
+	/* disable compression for some http status types. */
+	switch(vr->response.http_status) {
+	case 100:
+	case 101:
+	case 204:
+	case 205:
+	case 206:
+	case 304:
+		/* disable compression as we have no response entity */
+		return LI_HANDLER_GO_ON;
+	default:
+		break;
+	}
+
+	/* response already encoded */
+	if (li_http_header_find_first(vr->response.headers, CONST_STR_LEN("content-encoding"))) {
+		if (debug) {
+			VR_DEBUG(vr, "%s", "deflate: Content-Encoding already set => not compressing");
+		}
+		return LI_HANDLER_GO_ON;
+	}
+
+	/* don't mess with content after transfer-encoding */
+	if (li_http_header_find_first(vr->response.headers, CONST_STR_LEN("transfer-encoding"))) {
+		if (debug) {
+			VR_DEBUG(vr, "%s", "deflate: Transfer-Encoding set => not compressing");
+		}
+		return LI_HANDLER_GO_ON;
+	}
+
+	/* announce that we have looked for accept-encoding */
+	li_http_header_append(vr->response.headers, CONST_STR_LEN("Vary"), CONST_STR_LEN("Accept-Encoding"));
+
+	if (0 == li_http_header_count_id(vr->request.headers, LI_HTTP_HEADER_ACCEPT_ENCODING))
+		return LI_HANDLER_GO_ON; /* client doesn't accept encodings */
+
+	li_http_header_parse_qvalues(vr->request.headers, LI_HTTP_HEADER_ACCEPT_ENCODING, encoding_names, q, &q_star);
+
+	/* highest q-value wins, server preference on ties; "*" covers encodings not listed */
+	i = ENCODING_IDENTITY;
+	for (k = 0; k < config->order_len; k++) {
+		guint enc = config->order[k];
+		gint qv = (q[enc] >= 0) ? q[enc] : q_star;
+		if (qv > best_q) {
+			best_q = qv;
+			i = enc;
+		}
+	}
+
+	if (ENCODING_IDENTITY == i) {
+		if (debug) {
+			VR_DEBUG(vr, "%s", "no common encoding found => not compressing");
+		}
+		return LI_HANDLER_GO_ON; /* no common encoding found */
+	}
+
+	hh_etag_entry = li_http_header_find_first(vr->response.headers, CONST_STR_LEN("etag"));
+	if (hh_etag_entry) {
+		if (li_http_header_find_next(hh_etag_entry, CONST_STR_LEN("etag"))) {
+			if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+				VR_DEBUG(vr, "%s", "duplicate etag header in response, will not deflate it");
+			}
+			return LI_HANDLER_GO_ON;
+		}
+		hh_etag = (liHttpHeader*) hh_etag_entry->data;
+	}
+
+	switch ((encodings) i) {
+	case ENCODING_IDENTITY:
+	case ENCODING_COMPRESS:
+		return LI_HANDLER_GO_ON;
+	default:
+		break;
+	}
+
+	if (-1 == (level = deflate_select_level(vr, config, i))) {
+		if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+			VR_DEBUG(vr, "%s", "deflate: worker overloaded => not compressing large response");
+		}
+		vr->wrk->stats.compress_skipped++;
+		return LI_HANDLER_GO_ON;
+	}
+
+	if (debug || CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+		VR_DEBUG(vr, "deflate: compressing using %s encoding (level %i)", encoding_names[i], level);
+	}
+
+	if (cached_handle_etag(vr, debug, hh_etag, encoding_names[i])) return LI_HANDLER_GO_ON;
+
+	if (!is_head_request) {
+		vr->wrk->stats.compress_levels[encoding_stats[i]][CLAMP(level, 0, LI_STATS_COMPRESS_LEVELS - 1)]++;
+	}
+
+	if (NULL != config->cache && deflate_cache_usable(vr, hh_etag)) {
+		*context = deflate_cache_waiter_new(vr, deflate_cache_key(vr, hh_etag, encoding_names[i], level, config->window_bits[i]), i, level);
+		return deflate_handle_cache(vr, config, debug, context);
+	}
+
+	if (!is_head_request && !deflate_add_compressor(vr, config, i, level)) return LI_HANDLER_GO_ON;
+
+	deflate_response_headers(vr, i, is_head_request);
+
+	return LI_HANDLER_GO_ON;
+}
+
+static liHandlerResult deflate_handle_cleanup(liVRequest *vr, gpointer param, gpointer context) {
+	deflate_config *config = (deflate_config*) param;
+	UNUSED(vr);
+
+	deflate_cache_waiter_free(config->cache, context);
+
+	return LI_HANDLER_GO_ON;
+}
+
+static void deflate_free(liServer *srv, gpointer param) {
+	deflate_config *conf = (deflate_config*) param;
+	UNUSED(srv);
+
+	if (NULL != conf->cache) deflate_cache_release(conf->cache);
+	if (NULL != conf->adaptive) deflate_adaptive_release(conf->adaptive);
+	g_slice_free(deflate_config, conf);
+}
+
+/* valid compression levels and window sizes (0: no window option) per encoding */
+static void encoding_limits(encodings enc, gint *min_level, gint *max_level, guint *min_window, guint *max_window) {
+	*min_level = 1; *max_level = 9;
+	*min_window = *max_window = 0;
+
+	switch (enc) {
+	case ENCODING_GZIP:
+	case ENCODING_X_GZIP:
+	case ENCODING_DEFLATE:
+		*min_window = 9; *max_window = 15;
+		break;
+	case ENCODING_BROTLI:
+		*min_level = 0; *max_level = 11;
+		*min_window = 10; *max_window = 24;
+		break;
+	case ENCODING_ZSTD:
+		*max_level = 22;
+		/* clients only need to support windows up to 8MB */
+		*min_window = 10; *max_window = 23;
+		break;
+	default:
+		break;
+	}
+}
+
+/* [ "<encoding>" => <number>, ... ] for "compression-levels" and "window-bits"; values are stored in out[] */
+static gboolean parse_per_encoding_option(liServer *srv, GString *option, liValue *val, gint out[ENCODING_COUNT], gboolean window) {
+	if (NULL == (val = li_value_to_key_value_list(val))) {
+		ERROR(srv, "deflate option '%s' expects a hash/key-value list as parameter", option->str);
+		return FALSE;
+	}
+
+	LI_VALUE_FOREACH(entry, val)
+		liValue *encKey = li_value_list_at(entry, 0);
+		liValue *encValue = li_value_list_at(entry, 1);
+		gint enc, alias = -1, min_level, max_level;
+		guint min_window, max_window;
+		gint64 min, max;
+
+		if (LI_VALUE_STRING != li_value_type(encKey) || -1 == (enc = encoding_from_name(GSTR_LEN(encKey->data.string)))) {
+			ERROR(srv, "deflate option '%s' expects encoding names as keys", option->str);
+			return FALSE;
+		}
+
+		encoding_limits(enc, &min_level, &max_level, &min_window, &max_window);
+		if (window) {
+			min = min_window; max = max_window;
+		} else {
+			min = min_level; max = max_level;
+		}
+
+		if (0 == max) {
+			ERROR(srv, "deflate option '%s': not supported for encoding '%s'", option->str, encoding_names[enc]);
+			return FALSE;
+		}
+		if (LI_VALUE_NUMBER != li_value_type(encValue) || encValue->data.number < min || encValue->data.number > max) {
+			ERROR(srv, "deflate option '%s': encoding '%s' expects an integer between %i and %i", option->str, encoding_names[enc], (int) min, (int) max);
+			return FALSE;
+		}
+
+		switch (enc) {
+		case ENCODING_GZIP: alias = ENCODING_X_GZIP; break;
+		case ENCODING_X_GZIP: alias = ENCODING_GZIP; break;
+		case ENCODING_BZIP2: alias = ENCODING_X_BZIP2; break;
+		case ENCODING_X_BZIP2: alias = ENCODING_BZIP2; break;
+		default: break;
+		}
+
+		out[enc] = encValue->data.number;
+		if (-1 != alias) out[alias] = encValue->data.number;
+	LI_VALUE_END_FOREACH()
+
+	return TRUE;
+}
+
+/* deflate option names */
+static const GString
+	don_encodings = { CONST_STR_LEN("encodings"), 0 },
+	don_blocksize = { CONST_STR_LEN("blocksize"), 0 },
+	don_outputbuffer = { CONST_STR_LEN("output-buffer"), 0 },
+	don_compression_level = { CONST_STR_LEN("compression-level"), 0 },
+	don_compression_levels = { CONST_STR_LEN("compression-levels"), 0 },
+	don_window_bits = { CONST_STR_LEN("window-bits"), 0 },
+	don_cache = { CONST_STR_LEN("cache"), 0 },
+	don_cache_max_size = { CONST_STR_LEN("cache-max-size"), 0 },
+	don_cache_max_age = { CONST_STR_LEN("cache-max-age"), 0 },
+	don_adaptive = { CONST_STR_LEN("adaptive"), 0 },
+	don_min_compression_levels = { CONST_STR_LEN("min-compression-levels"), 0 },
+	don_adaptive_max_size = { CONST_STR_LEN("adaptive-max-size"), 0 }
+;
+
+static liAction* deflate_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
+	deflate_config *conf;
+	gboolean
+		have_encodings_parameter = FALSE,
+		have_blocksize_parameter = FALSE,
+		have_outputbuffer_parameter = FALSE,
+		have_compression_level_parameter = FALSE,
+		have_compression_levels_parameter = FALSE,
+		have_window_bits_parameter = FALSE,
+		have_cache_max_size_parameter = FALSE,
+		have_cache_max_age_parameter = FALSE,
+		have_adaptive_parameter = FALSE,
+		have_min_compression_levels_parameter = FALSE,
+		have_adaptive_max_size_parameter = FALSE;
+	gint compression_level = 1, levels[ENCODING_COUNT], window_bits[ENCODING_COUNT], min_levels[ENCODING_COUNT];
+	gint64 load_low = 50, load_high = 80;
+	goffset adaptive_max_size = 0;
+	guint i;
+	GString *cache_path = NULL;
+	goffset cache_max_size = 64*1024*1024;
+	li_tstamp cache_max_age = 0;
+	UNUSED(wrk); UNUSED(userdata);
+
+	val = li_value_get_single_argument(val);
+
+	if (NULL != val && NULL == (val = li_value_to_key_value_list(val))) {
+		ERROR(srv, "%s", "deflate expects a optional hash/key-value list as parameter");
+		return NULL;
+	}
+
+	conf = g_slice_new0(deflate_config);
+	conf->p = p;
+	conf->allowed_encodings = encoding_available_mask;
+	for (i = 0; i < G_N_ELEMENTS(encoding_default_order); i++) {
+		if (0 != (encoding_available_mask & (1 << encoding_default_order[i]))) {
+			conf->order[conf->order_len++] = encoding_default_order[i];
+		}
+	}
+	conf->blocksize = 16*1024;
+	conf->output_buffer = 4*1024;
+	for (i = 0; i < ENCODING_COUNT; i++) {
+		levels[i] = -1;
+		window_bits[i] = 0;
+		min_levels[i] = -1;
+	}
+
+	LI_VALUE_FOREACH(entry, val)
+		liValue *entryKey = li_value_list_at(entry, 0);
+		liValue *entryValue = li_value_list_at(entry, 1);
+		GString *entryKeyStr;
+
+		if (LI_VALUE_STRING != li_value_type(entryKey)) {
+			ERROR(srv, "%s", "deflate doesn't take default keys");
+			goto option_failed;
+		}
+		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
+
+		if (g_string_equal(entryKeyStr, &don_encodings)) {
+			if (LI_VALUE_STRING != li_value_type(entryValue)) {
+				ERROR(srv, "deflate option '%s' expects string as parameter", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (have_encodings_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_encodings_parameter = TRUE;
+			parse_encodings_option(conf, entryValue->data.string->str);
+		} else if (g_string_equal(entryKeyStr, &don_blocksize)) {
 			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number <= 0) {
 				ERROR(srv, "deflate option '%s' expects positive integer as parameter", entryKeyStr->str);
 				goto option_failed;
@@ -745,16 +1924,146 @@ static liAction* deflate_create(liServer *srv, liWorker *wrk, liPlugin* p, liVal
 				goto option_failed;
 			}
 			have_compression_level_parameter = TRUE;
-			conf->compression_level = entryValue->data.number;
+			compression_level = entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &don_compression_levels)) {
+			if (have_compression_levels_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_compression_levels_parameter = TRUE;
+			if (!parse_per_encoding_option(srv, entryKeyStr, entryValue, levels, FALSE)) goto option_failed;
+		} else if (g_string_equal(entryKeyStr, &don_window_bits)) {
+			if (have_window_bits_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_window_bits_parameter = TRUE;
+			if (!parse_per_encoding_option(srv, entryKeyStr, entryValue, window_bits, TRUE)) goto option_failed;
+		} else if (g_string_equal(entryKeyStr, &don_cache)) {
+			if (LI_VALUE_STRING != li_value_type(entryValue) || 0 == entryValue->data.string->len) {
+				ERROR(srv, "deflate option '%s' expects non-empty string as parameter", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (NULL != cache_path) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			cache_path = entryValue->data.string;
+		} else if (g_string_equal(entryKeyStr, &don_cache_max_size)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "deflate option '%s' expects non-negative integer as parameter", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (have_cache_max_size_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_cache_max_size_parameter = TRUE;
+			cache_max_size = entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &don_cache_max_age)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "deflate option '%s' expects non-negative integer as parameter", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (have_cache_max_age_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_cache_max_age_parameter = TRUE;
+			cache_max_age = entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &don_adaptive)) {
+			if (have_adaptive_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (LI_VALUE_BOOLEAN == li_value_type(entryValue)) {
+				have_adaptive_parameter = entryValue->data.boolean;
+			} else {
+				liValue *vLow = li_value_list_at(entryValue, 0), *vHigh = li_value_list_at(entryValue, 1);
+				if (!li_value_list_has_len(entryValue, 2)
+						|| LI_VALUE_NUMBER != li_value_type(vLow) || LI_VALUE_NUMBER != li_value_type(vHigh)
+						|| vLow->data.number < 0 || vLow->data.number > vHigh->data.number || vHigh->data.number > 100) {
+					ERROR(srv, "deflate option '%s' expects a boolean or a list of two percentages (low, high) as parameter", entryKeyStr->str);
+					goto option_failed;
+				}
+				have_adaptive_parameter = TRUE;
+				load_low = vLow->data.number;
+				load_high = vHigh->data.number;
+			}
+		} else if (g_string_equal(entryKeyStr, &don_min_compression_levels)) {
+			if (have_min_compression_levels_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_min_compression_levels_parameter = TRUE;
+			if (!parse_per_encoding_option(srv, entryKeyStr, entryValue, min_levels, FALSE)) goto option_failed;
+		} else if (g_string_equal(entryKeyStr, &don_adaptive_max_size)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "deflate option '%s' expects non-negative integer as parameter", entryKeyStr->str);
+				goto option_failed;
+			}
+			if (have_adaptive_max_size_parameter) {
+				ERROR(srv, "duplicate deflate option '%s'", entryKeyStr->str);
+				goto option_failed;
+			}
+			have_adaptive_max_size_parameter = TRUE;
+			adaptive_max_size = entryValue->data.number;
 		} else {
 			ERROR(srv, "unknown option for deflate '%s'", entryKeyStr->str);
 			goto option_failed;
 		}
 	LI_VALUE_END_FOREACH()
 
-	return li_action_new_function(deflate_handle, NULL, deflate_free, conf);
+	/* "compression-level" is the default for all encodings */
+	for (i = 0; i < ENCODING_COUNT; i++) {
+		conf->level[i] = (-1 != levels[i]) ? levels[i] : compression_level;
+		conf->window_bits[i] = window_bits[i];
+	}
+
+	if (have_adaptive_parameter) {
+		deflate_adaptive *ad;
+
+		/* check before registering the prepare callback */
+		for (i = 0; i < ENCODING_COUNT; i++) {
+			if (-1 != min_levels[i] && min_levels[i] > conf->level[i]) {
+				ERROR(srv, "deflate: minimum compression level for '%s' (%i) is higher than its compression level (%i)", encoding_names[i], min_levels[i], conf->level[i]);
+				goto option_failed;
+			}
+		}
+
+		ad = conf->adaptive = deflate_adaptive_new(srv);
+		ad->load_low = load_low / 100.0;
+		ad->load_high = load_high / 100.0;
+		ad->max_size = adaptive_max_size;
+		for (i = 0; i < ENCODING_COUNT; i++) {
+			gint min_level, max_level;
+			guint min_window, max_window;
+
+			encoding_limits(i, &min_level, &max_level, &min_window, &max_window);
+			ad->min_level[i] = (-1 != min_levels[i]) ? min_levels[i] : MIN(min_level, conf->level[i]);
+			ad->max_step = MAX(ad->max_step, (guint) (conf->level[i] - ad->min_level[i]));
+		}
+	} else if (have_min_compression_levels_parameter || have_adaptive_max_size_parameter) {
+		ERROR(srv, "%s", "deflate options 'min-compression-levels' and 'adaptive-max-size' need the 'adaptive' option");
+		goto option_failed;
+	}
+
+	if (NULL != cache_path) {
+		/* trailing slashes would break the file names */
+		GString *path = g_string_new_len(GSTR_LEN(cache_path));
+		while (path->len > 1 && '/' == path->str[path->len-1]) g_string_truncate(path, path->len-1);
+		conf->cache = deflate_cache_get(srv, p->data, path, cache_max_size, cache_max_age);
+		g_string_free(path, TRUE);
+		if (NULL == conf->cache) goto option_failed;
+	} else if (have_cache_max_size_parameter || have_cache_max_age_parameter) {
+		ERROR(srv, "%s", "deflate options 'cache-max-size' and 'cache-max-age' need the 'cache' option");
+		goto option_failed;
+	}
+
+	return li_action_new_function(deflate_handle, deflate_handle_cleanup, deflate_free, conf);
 
 option_failed:
+	if (NULL != conf->adaptive) deflate_adaptive_release(conf->adaptive);
 	g_slice_free(deflate_config, conf);
 	return NULL;
 }
@@ -775,12 +2084,28 @@ static const liPluginSetup setups[] = {
 };
 
 
+static void plugin_free(liServer *srv, liPlugin *p) {
+	deflate_plugin_data *pd = p->data;
+	UNUSED(srv);
+
+	g_hash_table_destroy(pd->caches);
+	g_mutex_free(pd->lock);
+	g_slice_free(deflate_plugin_data, pd);
+}
+
 static void plugin_init(liServer *srv, liPlugin *p, gpointer userdata) {
+	deflate_plugin_data *pd;
 	UNUSED(srv); UNUSED(userdata);
 
 	p->options = options;
 	p->actions = actions;
 	p->setups = setups;
+	p->free = plugin_free;
+
+	pd = g_slice_new0(deflate_plugin_data);
+	pd->lock = g_mutex_new();
+	pd->caches = g_hash_table_new(g_str_hash, g_str_equal);
+	p->data = pd;
 }
 
 gboolean mod_deflate_init(liModules *mods, liModule *mod) {
@@ -2,7 +2,6 @@
  * mod_fastcgi - connect to fastcgi backends for generating response content
  *
  * Todo:
- *     - reuse fastcgi connections (keepalive)
  *     - option for alternative doc-root?
  *
  * Author:
@@ -25,6 +24,11 @@ LI_API gboolean mod_fastcgi_free(liModules *mods, liModule *mod);
 
 typedef struct fastcgi_context fastcgi_context;
 
+/* fastcgi option names */
+static const GString
+	fon_multiplex = { CONST_STR_LEN("multiplex"), 0 }
+;
+
 struct fastcgi_context {
 	gint refcount;
 	liPlugin *plugin;
@@ -139,15 +143,55 @@ static void fastcgi_free(liServer *srv, gpointer param) {
 static liAction* fastcgi_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	liFastCGIBackendConfig config;
 	fastcgi_context *ctx;
+	liValue *options = NULL;
+	guint multiplex = 0;
+	liBackendHealthOptions health = { 0, 0, 0, NULL };
+	gboolean handled;
 	UNUSED(wrk); UNUSED(userdata);
 
 	val = li_value_get_single_argument(val);
 
+	if (li_value_list_has_len(val, 2)) {
+		options = li_value_list_at(val, 1);
+		val = li_value_list_at(val, 0);
+
+		if (NULL == (options = li_value_to_key_value_list(options))) {
+			ERROR(srv, "%s", "fastcgi expects a hash/key-value list as second parameter");
+			return NULL;
+		}
+	}
+
 	if (LI_VALUE_STRING != li_value_type(val)) {
 		ERROR(srv, "%s", "fastcgi expects a string as parameter");
 		return FALSE;
 	}
 
+	LI_VALUE_FOREACH(entry, options)
+		liValue *entryKey = li_value_list_at(entry, 0);
+		liValue *entryValue = li_value_list_at(entry, 1);
+		GString *entryKeyStr;
+
+		if (LI_VALUE_STRING != li_value_type(entryKey)) {
+			ERROR(srv, "%s", "fastcgi doesn't take default keys");
+			return NULL;
+		}
+		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
+
+		if (g_string_equal(entryKeyStr, &fon_multiplex)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0 || entryValue->data.number > G_MAXUINT16) {
+				ERROR(srv, "fastcgi option '%s' expects a number between 0 and 65535 as parameter", entryKeyStr->str);
+				return NULL;
+			}
+			multiplex = entryValue->data.number;
+		} else if (!li_backend_parse_health_option(srv, "fastcgi", entryKeyStr, entryValue, &health, &handled)) {
+			return NULL;
+		} else if (!handled || NULL != health.check_path) {
+			/* the active check sends FCGI_GET_VALUES, there is no path */
+			ERROR(srv, "unknown option for fastcgi '%s'", entryKeyStr->str);
+			return NULL;
+		}
+	LI_VALUE_END_FOREACH()
+
 	config.sock_addr = li_sockaddr_from_string(val->data.string, 0);
 	if (NULL == config.sock_addr.addr) {
 		ERROR(srv, "Invalid socket address '%s'", val->data.string->str);
@@ -164,6 +208,10 @@ static liAction* fastcgi_create(liServer *srv, liWorker *wrk, liPlugin* p, liVal
 	config.wait_timeout = 5;
 	config.idle_timeout = 5;
 	config.disable_time = 0;
+	config.multiplex = multiplex;
+	config.max_fails = health.max_fails;
+	config.check_interval = health.check_interval;
+	config.slow_start = health.slow_start;
 
 	ctx->pool = li_fastcgi_backend_pool_new(&config);
 	li_sockaddr_clear(&config.sock_addr);
@@ -19,6 +19,7 @@
 #include "gnutls_ocsp.h"
 #include "ssl_client_hello_parser.h"
 #include "ssl-session-db.h"
+#include "ssl-ticket-keys.h"
 
 #include <gnutls/gnutls.h>
 
@@ -71,6 +72,7 @@ struct mod_context {
 	gnutls_priority_t server_priority_beast;
 #ifdef HAVE_SESSION_TICKET
 	gnutls_datum_t ticket_key;
+	liSSLTicketKeys *ticket_keys; /* NULL: use ticket_key */
 #endif
 
 	liGnuTLSOCSP* ocsp;
@@ -240,6 +242,8 @@ static void mod_gnutls_context_release(mod_context *ctx) {
 			ctx->ticket_key.data = NULL;
 			ctx->ticket_key.size = 0;
 		}
+		li_ssl_ticket_keys_free(ctx->ticket_keys);
+		ctx->ticket_keys = NULL;
 #endif
 		li_ssl_session_db_free(ctx->session_db);
 		ctx->session_db = NULL;
@@ -372,6 +376,7 @@ static void handshake_cb(liGnuTLSFilter *f, gpointer data, liStream *plain_sourc
 	UNUSED(f);
 
 	if (NULL != con) {
+		li_server_socket_tls_stats_add(con->srv_sock, gnutls_session_is_resumed(conctx->session));
 		li_stream_connect(plain_source, con->con_sock.raw_in);
 		li_stream_connect(con->con_sock.raw_out, plain_drain);
 	} else {
@@ -585,7 +590,31 @@ static gboolean mod_gnutls_con_new(liConnection *con, int fd) {
 	}
 
 #ifdef HAVE_SESSION_TICKET
-	if (GNUTLS_E_SUCCESS > (r = gnutls_session_ticket_enable_server(session, &ctx->ticket_key))) {
+	if (NULL != ctx->ticket_keys) {
+		/* gnutls only knows a single master key (copied into the session): use the secrets of the current key */
+		liSSLTicketKey key;
+		unsigned char master_key[sizeof(key.hmac_secret) + sizeof(key.aes_key)];
+		gnutls_datum_t ticket_key = { master_key, sizeof(master_key) };
+		GError *err = NULL;
+
+		if (!li_ssl_ticket_keys_check(ctx->ticket_keys, &err)) {
+			ERROR(srv, "gnutls: couldn't reload ticket keys: %s", err->message);
+			g_error_free(err);
+		}
+
+		if (li_ssl_ticket_keys_current(ctx->ticket_keys, &key)) {
+			memcpy(master_key, key.hmac_secret, sizeof(key.hmac_secret));
+			memcpy(master_key + sizeof(key.hmac_secret), key.aes_key, sizeof(key.aes_key));
+			r = gnutls_session_ticket_enable_server(session, &ticket_key);
+			memset(master_key, 0, sizeof(master_key));
+			memset(&key, 0, sizeof(key));
+		} else {
+			r = gnutls_session_ticket_enable_server(session, &ctx->ticket_key);
+		}
+	} else {
+		r = gnutls_session_ticket_enable_server(session, &ctx->ticket_key);
+	}
+	if (GNUTLS_E_SUCCESS > r) {
 		ERROR(srv, "gnutls_session_ticket_enable_server (%s): %s",
 			gnutls_strerror_name(r), gnutls_strerror(r));
 		goto fail;
@@ -594,8 +623,16 @@ static gboolean mod_gnutls_con_new(liConnection *con, int fd) {
 
 #ifdef GNUTLS_ALPN_MAND
 	{
-		static const gnutls_datum_t proto_http1 = { (unsigned char*) CONST_STR_LEN("http/1.1") };
-		gnutls_alpn_set_protocols(session, &proto_http1, 1, 0);
+		static const gnutls_datum_t protos[] = {
+			{ (unsigned char*) CONST_STR_LEN("h2") },
+			{ (unsigned char*) CONST_STR_LEN("http/1.1") }
+		};
+		/* "h2" only with http2 enabled; the connection recognizes the HTTP/2 preface */
+		if (srv->http2) {
+			gnutls_alpn_set_protocols(session, protos, 2, GNUTLS_ALPN_SERVER_PRECEDENCE);
+		} else {
+			gnutls_alpn_set_protocols(session, &protos[1], 1, 0);
+		}
 	}
 #endif
 
@@ -755,13 +792,14 @@ static gboolean gnutls_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 	gboolean have_pemfile_parameter = FALSE;
 	gboolean have_protect_beast_parameter = FALSE;
 	gboolean have_session_db_size_parameter = FALSE;
-	const char *priority = NULL, *dh_params_file = NULL;
+	gboolean have_session_db_ttl_parameter = FALSE;
+	const char *priority = NULL, *dh_params_file = NULL, *ticket_key_file = NULL;
 #ifdef USE_SNI
 	const char *sni_backend = NULL;
 	liValue *sni_fallback_pemfile = NULL;
 #endif
 	gboolean protect_against_beast = FALSE;
-	gint64 session_db_size = 256;
+	gint64 session_db_size = 256, session_db_ttl = 3600;
 #if defined(HAVE_PIN)
 	liValue *pin = NULL;
 #endif
@@ -842,8 +880,8 @@ static gboolean gnutls_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 			have_protect_beast_parameter = TRUE;
 			protect_against_beast = entryValue->data.boolean;
 		} else if (g_str_equal(entryKeyStr->str, "session-db-size")) {
-			if (LI_VALUE_NUMBER != li_value_type(entryValue)) {
-				ERROR(srv, "%s", "gnutls session-db-size expects an integer as parameter");
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "%s", "gnutls session-db-size expects a non-negative integer as parameter");
 				return FALSE;
 			}
 			if (have_session_db_size_parameter) {
@@ -852,6 +890,27 @@ static gboolean gnutls_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 			}
 			have_session_db_size_parameter = TRUE;
 			session_db_size = entryValue->data.number;
+		} else if (g_str_equal(entryKeyStr->str, "session-db-ttl")) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "%s", "gnutls session-db-ttl expects a non-negative integer as parameter");
+				return FALSE;
+			}
+			if (have_session_db_ttl_parameter) {
+				ERROR(srv, "gnutls unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			have_session_db_ttl_parameter = TRUE;
+			session_db_ttl = entryValue->data.number;
+		} else if (g_str_equal(entryKeyStr->str, "ticket-key-file")) {
+			if (LI_VALUE_STRING != li_value_type(entryValue)) {
+				ERROR(srv, "%s", "gnutls ticket-key-file expects a string as parameter");
+				return FALSE;
+			}
+			if (NULL != ticket_key_file) {
+				ERROR(srv, "gnutls unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			ticket_key_file = entryValue->data.string->str;
 #ifdef USE_SNI
 		} else if (g_str_equal(entryKeyStr->str, "sni-backend")) {
 			if (LI_VALUE_STRING != li_value_type(entryValue)) {
@@ -952,7 +1011,20 @@ static gboolean gnutls_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 		}
 	LI_VALUE_END_FOREACH()
 
-	if (session_db_size > 0) ctx->session_db = li_ssl_session_db_new(session_db_size);
+	if (session_db_size > 0) ctx->session_db = li_ssl_session_db_new(session_db_size, session_db_ttl);
+
+	if (NULL != ticket_key_file) {
+#ifdef HAVE_SESSION_TICKET
+		GError *err = NULL;
+		if (NULL == (ctx->ticket_keys = li_ssl_ticket_keys_new(ticket_key_file, &err))) {
+			ERROR(srv, "gnutls: %s", err->message);
+			g_error_free(err);
+			goto error_free_ctx;
+		}
+#else
+		WARNING(srv, "%s", "gnutls: ticket-key-file ignored, session tickets not supported");
+#endif
+	}
 
 	if (NULL != dh_params_file) {
 		gchar *contents = NULL;
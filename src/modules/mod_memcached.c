@@ -23,13 +23,31 @@
 LI_API gboolean mod_memcached_init(liModules *mods, liModule *mod);
 LI_API gboolean mod_memcached_free(liModules *mods, liModule *mod);
 
+/* with more than one server the keys are distributed with a consistent hash ring (ketama):
+ * every server gets MC_RING_POINTS points, a key belongs to the first point after its hash.
+ * adding or removing a server only moves the keys of its own points.
+ */
+#define MC_RING_POINTS 160
+/* failover remembers the tried servers in a bitmask */
+#define MC_MAX_SERVERS 64
+#define MC_MAX_CONNECTIONS 16
+
+typedef struct {
+	guint32 point;
+	guint server;
+} mc_ring_point;
+
 typedef struct memcached_ctx memcached_ctx;
 struct memcached_ctx {
 	int refcount;
 	liServer *srv;
 
-	liMemcachedCon **worker_client_ctx;
-	liSocketAddress addr;
+	liMemcachedCon **worker_client_ctx; /* per worker, per server a pool of "connections" connections */
+	GArray *servers; /* (liSocketAddress) */
+	GArray *ring; /* (mc_ring_point) sorted by point; NULL with only one server */
+	guint connections;
+	liMemcachedProtocol protocol;
+	li_tstamp timeout;
 	liPattern *pattern;
 	guint flags;
 	li_tstamp ttl;
@@ -47,12 +65,26 @@ struct memcached_config {
 	GQueue prepare_ctx;
 };
 
+/* a request which fails over to the next server on the ring if the server breaks before it answers */
 typedef struct {
 	liMemcachedRequest *req;
+	memcached_ctx *ctx;
+	liWorker *wrk;
+	GString *key;
+	guint64 tried; /* servers already tried (bitmask) */
+} mc_failover_request;
+
+typedef struct {
+	mc_failover_request fr;
 	liBuffer *buffer;
 	liVRequest *vr;
 } memcache_request;
 
+typedef struct {
+	mc_failover_request fr;
+	liBuffer *data;
+} memcache_store_request;
+
 typedef struct {
 	memcached_ctx *ctx;
 	liBuffer *buf;
@@ -61,6 +93,9 @@ typedef struct {
 /* memcache option names */
 static const GString
 	mon_server = { CONST_STR_LEN("server"), 0 },
+	mon_connections = { CONST_STR_LEN("connections"), 0 },
+	mon_protocol = { CONST_STR_LEN("protocol"), 0 },
+	mon_timeout = { CONST_STR_LEN("timeout"), 0 },
 	mon_flags = { CONST_STR_LEN("flags"), 0 },
 	mon_ttl = { CONST_STR_LEN("ttl"), 0 },
 	mon_maxsize = { CONST_STR_LEN("maxsize"), 0 },
@@ -68,6 +103,11 @@ static const GString
 	mon_key = { CONST_STR_LEN("key"), 0 }
 ;
 
+/* number of connection slots in worker_client_ctx */
+static guint mc_ctx_pool_count(memcached_ctx *ctx, liServer *srv) {
+	return srv->worker_count * ctx->servers->len * ctx->connections;
+}
+
 static void mc_ctx_acquire(memcached_ctx* ctx) {
 	LI_FORCE_ASSERT(g_atomic_int_get(&ctx->refcount) > 0);
 	g_atomic_int_inc(&ctx->refcount);
@@ -87,13 +127,18 @@ static void mc_ctx_release(liServer *_srv, gpointer param) {
 	if (!g_atomic_int_dec_and_test(&ctx->refcount)) return;
 
 	if (ctx->worker_client_ctx) {
-		for (i = 0; i < srv->worker_count; i++) {
+		guint count = mc_ctx_pool_count(ctx, srv);
+		for (i = 0; i < count; i++) {
 			li_memcached_con_release(ctx->worker_client_ctx[i]);
 		}
-		g_slice_free1(sizeof(liMemcachedCon*) * srv->worker_count, ctx->worker_client_ctx);
+		g_slice_free1(sizeof(liMemcachedCon*) * count, ctx->worker_client_ctx);
 	}
 
-	li_sockaddr_clear(&ctx->addr);
+	for (i = 0; i < ctx->servers->len; i++) {
+		li_sockaddr_clear(&g_array_index(ctx->servers, liSocketAddress, i));
+	}
+	g_array_free(ctx->servers, TRUE);
+	if (NULL != ctx->ring) g_array_free(ctx->ring, TRUE);
 
 	li_pattern_free(ctx->pattern);
 
@@ -110,12 +155,97 @@ static void mc_ctx_release(liServer *_srv, gpointer param) {
 	g_slice_free(memcached_ctx, ctx);
 }
 
+static gboolean mc_ctx_add_server(liServer *srv, memcached_ctx *ctx, GString *str) {
+	liSocketAddress addr = li_sockaddr_from_string(str, 11211);
+
+	if (NULL == addr.addr) {
+		ERROR(srv, "invalid socket address: '%s'", str->str);
+		return FALSE;
+	}
+
+	g_array_append_val(ctx->servers, addr);
+	return TRUE;
+}
+
+static gint mc_ring_point_cmp(gconstpointer a, gconstpointer b) {
+	const mc_ring_point *pa = a, *pb = b;
+	return (pa->point < pb->point) ? -1 : (pa->point > pb->point);
+}
+
+/* the first 4 bytes of the md5 digest, like the other ketama implementations */
+static guint32 mc_ring_hash(const guint8 *digest) {
+	return ((guint32) digest[3] << 24) | ((guint32) digest[2] << 16) | ((guint32) digest[1] << 8) | digest[0];
+}
+
+static void mc_ctx_build_ring(memcached_ctx *ctx) {
+	GChecksum *md5 = g_checksum_new(G_CHECKSUM_MD5);
+	GString *name = g_string_sized_new(63);
+	guint8 digest[16];
+	gsize digest_len;
+	guint s, i, j;
+
+	ctx->ring = g_array_sized_new(FALSE, FALSE, sizeof(mc_ring_point), ctx->servers->len * MC_RING_POINTS);
+
+	for (s = 0; s < ctx->servers->len; s++) {
+		/* each digest of "<address>-<i>" gives 4 points */
+		for (i = 0; i < MC_RING_POINTS / 4; i++) {
+			li_sockaddr_to_string(g_array_index(ctx->servers, liSocketAddress, s), name, TRUE);
+			g_string_append_printf(name, "-%u", i);
+
+			g_checksum_reset(md5);
+			g_checksum_update(md5, (const guchar*) GSTR_LEN(name));
+			digest_len = sizeof(digest);
+			g_checksum_get_digest(md5, digest, &digest_len);
+
+			for (j = 0; j < 4; j++) {
+				mc_ring_point point;
+				point.point = mc_ring_hash(digest + 4*j);
+				point.server = s;
+				g_array_append_val(ctx->ring, point);
+			}
+		}
+	}
+
+	g_array_sort(ctx->ring, mc_ring_point_cmp);
+
+	g_string_free(name, TRUE);
+	g_checksum_free(md5);
+}
+
+/* index of the first ring point for the key */
+static guint mc_ctx_ring_find(memcached_ctx *ctx, GString *key) {
+	GChecksum *md5 = g_checksum_new(G_CHECKSUM_MD5);
+	guint8 digest[16];
+	gsize digest_len = sizeof(digest);
+	guint32 hash;
+	guint lo = 0, hi = ctx->ring->len;
+
+	g_checksum_update(md5, (const guchar*) GSTR_LEN(key));
+	g_checksum_get_digest(md5, digest, &digest_len);
+	hash = mc_ring_hash(digest);
+	g_checksum_free(md5);
+
+	while (lo < hi) {
+		guint mid = lo + (hi - lo) / 2;
+		if (g_array_index(ctx->ring, mc_ring_point, mid).point < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return (lo == ctx->ring->len) ? 0 : lo; /* wrap around */
+}
+
 static memcached_ctx* mc_ctx_parse(liServer *srv, liPlugin *p, liValue *config, const char *actname) {
 	memcached_ctx *ctx;
 	memcached_config *mconf = p->data;
 	GString def_server = li_const_gstring(CONST_STR_LEN("127.0.0.1:11211"));
 	gboolean
 		have_server_parameter = FALSE,
+		have_connections_parameter = FALSE,
+		have_protocol_parameter = FALSE,
+		have_timeout_parameter = FALSE,
 		have_flags_parameter = FALSE,
 		have_ttl_parameter = FALSE,
 		have_maxsize_parameter = FALSE,
@@ -127,7 +257,10 @@ static memcached_ctx* mc_ctx_parse(liServer *srv, liPlugin *p, liValue *config,
 	ctx->refcount = 1;
 	ctx->p = p;
 
-	ctx->addr = li_sockaddr_from_string(&def_server, 11211);
+	ctx->servers = g_array_new(FALSE, FALSE, sizeof(liSocketAddress));
+	ctx->connections = 1;
+	ctx->protocol = LI_MEMCACHED_PROTOCOL_TEXT;
+	ctx->timeout = 2;
 
 	ctx->pattern = li_pattern_new(srv, "%{req.path}");
 
@@ -148,21 +281,69 @@ static memcached_ctx* mc_ctx_parse(liServer *srv, liPlugin *p, liValue *config,
 		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
 
 		if (g_string_equal(entryKeyStr, &mon_server)) {
+			if (have_server_parameter) {
+				ERROR(srv, "duplicate %s option '%s'", actname, entryKeyStr->str);
+				goto option_failed;
+			}
+			have_server_parameter = TRUE;
+			if (LI_VALUE_STRING == li_value_type(entryValue)) {
+				if (!mc_ctx_add_server(srv, ctx, entryValue->data.string)) goto option_failed;
+			} else if (LI_VALUE_LIST == li_value_type(entryValue) && li_value_list_len(entryValue) > 0) {
+				LI_VALUE_FOREACH(server, entryValue)
+					if (LI_VALUE_STRING != li_value_type(server)) {
+						ERROR(srv, "%s option '%s' expects string or list of strings as parameter", actname, entryKeyStr->str);
+						goto option_failed;
+					}
+					if (!mc_ctx_add_server(srv, ctx, server->data.string)) goto option_failed;
+				LI_VALUE_END_FOREACH()
+				if (ctx->servers->len > MC_MAX_SERVERS) {
+					ERROR(srv, "%s option '%s': at most %u servers supported", actname, entryKeyStr->str, MC_MAX_SERVERS);
+					goto option_failed;
+				}
+			} else {
+				ERROR(srv, "%s option '%s' expects string or list of strings as parameter", actname, entryKeyStr->str);
+				goto option_failed;
+			}
+		} else if (g_string_equal(entryKeyStr, &mon_connections)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number <= 0 || entryValue->data.number > MC_MAX_CONNECTIONS) {
+				ERROR(srv, "%s option '%s' expects integer between 1 and %u as parameter", actname, entryKeyStr->str, MC_MAX_CONNECTIONS);
+				goto option_failed;
+			}
+			if (have_connections_parameter) {
+				ERROR(srv, "duplicate %s option '%s'", actname, entryKeyStr->str);
+				goto option_failed;
+			}
+			have_connections_parameter = TRUE;
+			ctx->connections = entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &mon_protocol)) {
 			if (LI_VALUE_STRING != li_value_type(entryValue)) {
 				ERROR(srv, "%s option '%s' expects string as parameter", actname, entryKeyStr->str);
 				goto option_failed;
 			}
-			if (have_server_parameter) {
+			if (have_protocol_parameter) {
 				ERROR(srv, "duplicate %s option '%s'", actname, entryKeyStr->str);
 				goto option_failed;
 			}
-			have_server_parameter = TRUE;
-			li_sockaddr_clear(&ctx->addr);
-			ctx->addr = li_sockaddr_from_string(entryValue->data.string, 11211);
-			if (NULL == ctx->addr.addr) {
-				ERROR(srv, "invalid socket address: '%s'", entryValue->data.string->str);
+			have_protocol_parameter = TRUE;
+			if (0 == strcmp(entryValue->data.string->str, "text")) {
+				ctx->protocol = LI_MEMCACHED_PROTOCOL_TEXT;
+			} else if (0 == strcmp(entryValue->data.string->str, "meta")) {
+				ctx->protocol = LI_MEMCACHED_PROTOCOL_META;
+			} else {
+				ERROR(srv, "%s option '%s': unknown protocol '%s' (expected \"text\" or \"meta\")", actname, entryKeyStr->str, entryValue->data.string->str);
 				goto option_failed;
 			}
+		} else if (g_string_equal(entryKeyStr, &mon_timeout)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "%s option '%s' expects non-negative integer as parameter", actname, entryKeyStr->str);
+				goto option_failed;
+			}
+			if (have_timeout_parameter) {
+				ERROR(srv, "duplicate %s option '%s'", actname, entryKeyStr->str);
+				goto option_failed;
+			}
+			have_timeout_parameter = TRUE;
+			ctx->timeout = entryValue->data.number;
 		} else if (g_string_equal(entryKeyStr, &mon_key)) {
 			if (LI_VALUE_STRING != li_value_type(entryValue)) {
 				ERROR(srv, "%s option '%s' expects string as parameter", actname, entryKeyStr->str);
@@ -233,8 +414,13 @@ static memcached_ctx* mc_ctx_parse(liServer *srv, liPlugin *p, liValue *config,
 		}
 	LI_VALUE_END_FOREACH()
 
+	if (0 == ctx->servers->len) {
+		if (!mc_ctx_add_server(srv, ctx, &def_server)) goto option_failed;
+	}
+	if (ctx->servers->len > 1) mc_ctx_build_ring(ctx);
+
 	if (LI_SERVER_INIT != g_atomic_int_get(&srv->state)) {
-		ctx->worker_client_ctx = g_slice_alloc0(sizeof(liMemcachedCon*) * srv->worker_count);
+		ctx->worker_client_ctx = g_slice_alloc0(sizeof(liMemcachedCon*) * mc_ctx_pool_count(ctx, srv));
 	} else {
 		ctx->mconf_link.data = ctx;
 		g_queue_push_tail_link(&mconf->prepare_ctx, &ctx->mconf_link);
@@ -248,28 +434,112 @@ option_failed:
 }
 
 static void mc_ctx_build_key(GString *dest, memcached_ctx *ctx, liVRequest *vr) {
-	GMatchInfo *match_info = NULL;
+	liRegexMatch *match = NULL;
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(dest, 0);
-	li_pattern_eval(vr, dest, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match_info);
+	li_pattern_eval(vr, dest, ctx->pattern, NULL, NULL, li_pattern_regex_cb, match);
 
 	li_memcached_mutate_key(dest);
 }
 
-static liMemcachedCon* mc_ctx_prepare(memcached_ctx *ctx, liWorker *wrk) {
-	liMemcachedCon *con = ctx->worker_client_ctx[wrk->ndx];
+/* get (set_data == NULL) or set on one server; requests are pipelined on the connection of the
+ * pool with the fewest pending requests, the others are tried if it can't take requests right now
+ */
+static liMemcachedRequest* mc_server_request(memcached_ctx *ctx, liWorker *wrk, guint server, GString *key, liBuffer *set_data, liMemcachedCB callback, gpointer cb_data, GError **err) {
+	liMemcachedCon **pool = ctx->worker_client_ctx + (wrk->ndx * ctx->servers->len + server) * ctx->connections;
+	liMemcachedRequest *req;
+	guint i, best = 0;
+
+	for (i = 0; i < ctx->connections; i++) {
+		if (NULL == pool[i]) {
+			pool[i] = li_memcached_con_new(&wrk->loop, g_array_index(ctx->servers, liSocketAddress, server));
+			li_memcached_con_set_protocol(pool[i], ctx->protocol);
+			li_memcached_con_set_timeout(pool[i], ctx->timeout);
+		}
+		if (li_memcached_con_pending(pool[i]) < li_memcached_con_pending(pool[best])) best = i;
+	}
+
+	for (i = 0; i < ctx->connections; i++) {
+		liMemcachedCon *con = pool[(best + i) % ctx->connections];
+
+		g_clear_error(err);
+		if (NULL != set_data) {
+			req = li_memcached_set(con, key, ctx->flags, ctx->ttl, set_data, callback, cb_data, err);
+		} else {
+			req = li_memcached_get(con, key, callback, cb_data, err);
+		}
+		if (NULL != req || (NULL != *err && LI_MEMCACHED_BAD_KEY == (*err)->code)) return req;
+	}
+
+	return NULL;
+}
+
+/* send the request to the server owning the key; if it is down (not connected, or disabled after
+ * an error) fail over to the next server on the ring. servers in *tried are skipped, the ones tried
+ * now are added.
+ */
+static liMemcachedRequest* mc_ctx_request(memcached_ctx *ctx, liWorker *wrk, GString *key, liBuffer *set_data, liMemcachedCB callback, gpointer cb_data, guint64 *tried, GError **err) {
+	liMemcachedRequest *req = NULL;
+	guint64 all = (ctx->servers->len >= 64) ? G_MAXUINT64 : (G_GUINT64_CONSTANT(1) << ctx->servers->len) - 1;
+	guint ndx = 0, server = 0;
+
+	if (NULL != ctx->ring) ndx = mc_ctx_ring_find(ctx, key);
+
+	while (all != (*tried & all)) {
+		if (NULL != ctx->ring) {
+			while (0 != (*tried & (G_GUINT64_CONSTANT(1) << (server = g_array_index(ctx->ring, mc_ring_point, ndx).server)))) {
+				ndx = (ndx + 1) % ctx->ring->len;
+			}
+		}
+		*tried |= G_GUINT64_CONSTANT(1) << server;
+
+		req = mc_server_request(ctx, wrk, server, key, set_data, callback, cb_data, err);
+		if (NULL != req || (NULL != *err && LI_MEMCACHED_BAD_KEY == (*err)->code)) break;
+	}
 
-	if (!con) {
-		con = li_memcached_con_new(&wrk->loop, ctx->addr);
-		ctx->worker_client_ctx[wrk->ndx] = con;
+	if (NULL == req && NULL == *err) {
+		g_set_error(err, LI_MEMCACHED_ERROR, LI_MEMCACHED_DISABLED, "No server left to try");
 	}
 
-	return con;
+	return req;
+}
+
+static void mc_failover_request_init(mc_failover_request *fr, memcached_ctx *ctx, liWorker *wrk, GString *key) {
+	mc_ctx_acquire(ctx);
+	fr->ctx = ctx;
+	fr->wrk = wrk;
+	fr->key = g_string_new_len(GSTR_LEN(key));
+	fr->tried = 0;
+}
+
+static void mc_failover_request_clear(mc_failover_request *fr) {
+	mc_ctx_release(NULL, fr->ctx);
+	fr->ctx = NULL;
+	g_string_free(fr->key, TRUE);
+	fr->key = NULL;
+}
+
+/* the connection broke (connect failed, timeout, I/O or protocol error) before the server answered:
+ * try the next server. returns FALSE if there is none left
+ */
+static gboolean mc_failover_retry(mc_failover_request *fr, liBuffer *set_data, liMemcachedCB callback, gpointer cb_data) {
+	GError *err = NULL;
+
+	fr->req = mc_ctx_request(fr->ctx, fr->wrk, fr->key, set_data, callback, cb_data, &fr->tried, &err);
+	if (NULL != err) g_error_free(err);
+
+	return NULL != fr->req;
+}
+
+static void memcache_request_free(memcache_request *req) {
+	mc_failover_request_clear(&req->fr);
+	li_buffer_release(req->buffer);
+	g_slice_free(memcache_request, req);
 }
 
 static void memcache_callback(liMemcachedRequest *request, liMemcachedResult result, liMemcachedItem *item, GError **err) {
@@ -277,10 +547,17 @@ static void memcache_callback(liMemcachedRequest *request, liMemcachedResult res
 	liVRequest *vr = req->vr;
 
 	/* request done */
-	req->req = NULL;
+	req->fr.req = NULL;
 
 	if (!vr) {
-		g_slice_free(memcache_request, req);
+		memcache_request_free(req);
+		return;
+	}
+
+	if (LI_MEMCACHED_RESULT_ERROR == result && mc_failover_retry(&req->fr, NULL, memcache_callback, req)) {
+		if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
+			VR_DEBUG(vr, "memcached.lookup: trying next server after error: %s", (err && *err) ? (*err)->message : "Unknown error");
+		}
 		return;
 	}
 
@@ -328,9 +605,10 @@ static liHandlerResult mc_handle_lookup(liVRequest *vr, gpointer param, gpointer
 		liBuffer *buf = req->buffer;
 		const GString *mime_str;
 
-		if (NULL != req->req) return LI_HANDLER_WAIT_FOR_EVENT; /* not done yet */
+		if (NULL != req->fr.req) return LI_HANDLER_WAIT_FOR_EVENT; /* not done yet */
 
-		g_slice_free(memcache_request, req);
+		req->buffer = NULL;
+		memcache_request_free(req);
 		*context = NULL;
 
 		if (NULL == buf) {
@@ -363,7 +641,6 @@ static liHandlerResult mc_handle_lookup(liVRequest *vr, gpointer param, gpointer
 		if (ctx->act_found) li_action_enter(vr, ctx->act_found);
 		return LI_HANDLER_GO_ON;
 	} else {
-		liMemcachedCon *con;
 		GError *err = NULL;
 
 		if (li_vrequest_is_handled(vr)) {
@@ -373,7 +650,6 @@ static liHandlerResult mc_handle_lookup(liVRequest *vr, gpointer param, gpointer
 			return LI_HANDLER_GO_ON;
 		}
 
-		con = mc_ctx_prepare(ctx, vr->wrk);
 		mc_ctx_build_key(vr->wrk->tmp_str, ctx, vr);
 
 		if (CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
@@ -381,9 +657,10 @@ static liHandlerResult mc_handle_lookup(liVRequest *vr, gpointer param, gpointer
 		}
 
 		req = g_slice_new0(memcache_request);
-		req->req = li_memcached_get(con, vr->wrk->tmp_str, memcache_callback, req, &err);
+		mc_failover_request_init(&req->fr, ctx, vr->wrk, vr->wrk->tmp_str);
+		req->fr.req = mc_ctx_request(ctx, vr->wrk, vr->wrk->tmp_str, NULL, memcache_callback, req, &req->fr.tried, &err);
 
-		if (NULL == req->req) {
+		if (NULL == req->fr.req) {
 			if (NULL != err) {
 				if (LI_MEMCACHED_DISABLED != err->code) {
 					VR_ERROR(vr, "memcached.lookup: get failed: %s", err->message);
@@ -392,7 +669,7 @@ static liHandlerResult mc_handle_lookup(liVRequest *vr, gpointer param, gpointer
 			} else {
 				VR_ERROR(vr, "memcached.lookup: get failed: %s", "Unkown error");
 			}
-			g_slice_free(memcache_request, req);
+			memcache_request_free(req);
 
 			/* miss */
 			if (ctx->act_miss) li_action_enter(vr, ctx->act_miss);
@@ -412,9 +689,8 @@ static liHandlerResult mc_lookup_handle_free(liVRequest *vr, gpointer param, gpo
 	UNUSED(vr);
 	UNUSED(param);
 
-	if (NULL == req->req) {
-		li_buffer_release(req->buffer);
-		g_slice_free(memcache_request, req);
+	if (NULL == req->fr.req) {
+		memcache_request_free(req);
 	} else {
 		req->vr = NULL;
 	}
@@ -422,6 +698,20 @@ static liHandlerResult mc_lookup_handle_free(liVRequest *vr, gpointer param, gpo
 	return LI_HANDLER_GO_ON;
 }
 
+static void memcache_store_callback(liMemcachedRequest *request, liMemcachedResult result, liMemcachedItem *item, GError **err) {
+	memcache_store_request *req = request->cb_data;
+	UNUSED(item);
+	UNUSED(err);
+
+	req->fr.req = NULL;
+
+	if (LI_MEMCACHED_RESULT_ERROR == result && mc_failover_retry(&req->fr, req->data, memcache_store_callback, req)) return;
+
+	mc_failover_request_clear(&req->fr);
+	li_buffer_release(req->data);
+	g_slice_free(memcache_store_request, req);
+}
+
 static void memcache_store_filter_free(liVRequest *vr, liFilter *f) {
 	memcache_filter *mf = (memcache_filter*) f->param;
 	UNUSED(vr);
@@ -497,26 +787,32 @@ static liHandlerResult memcache_store_filter(liVRequest *vr, liFilter *f) {
 	if (f->in->is_closed) {
 		/* finally: store response in memcached */
 
-		liMemcachedCon *con;
 		GError *err = NULL;
-		liMemcachedRequest *req;
+		memcache_store_request *req;
 		memcached_ctx *ctx = mf->ctx;
 
 		LI_FORCE_ASSERT(0 == f->in->length);
 
 		f->out->is_closed = TRUE;
 
-		con = mc_ctx_prepare(ctx, vr->wrk);
 		mc_ctx_build_key(vr->wrk->tmp_str, ctx, vr);
 
 		if (NULL != vr && CORE_OPTION(LI_CORE_OPTION_DEBUG_REQUEST_HANDLING).boolean) {
 			VR_DEBUG(vr, "memcached.store: storing response for key '%s'", vr->wrk->tmp_str->str);
 		}
 
-		req = li_memcached_set(con, vr->wrk->tmp_str, ctx->flags, ctx->ttl, mf->buf, NULL, NULL, &err);
+		req = g_slice_new0(memcache_store_request);
+		mc_failover_request_init(&req->fr, ctx, vr->wrk, vr->wrk->tmp_str);
+		req->data = mf->buf;
+		li_buffer_acquire(req->data);
+		req->fr.req = mc_ctx_request(ctx, vr->wrk, vr->wrk->tmp_str, mf->buf, memcache_store_callback, req, &req->fr.tried, &err);
 		memcache_store_filter_free(vr, f);
 
-		if (NULL == req) {
+		if (NULL == req->fr.req) {
+			mc_failover_request_clear(&req->fr);
+			li_buffer_release(req->data);
+			g_slice_free(memcache_store_request, req);
+
 			if (NULL != err) {
 				if (NULL != vr && LI_MEMCACHED_DISABLED != err->code) {
 					VR_ERROR(vr, "memcached.store: set failed: %s", err->message);
@@ -1140,7 +1436,7 @@ static void memcached_prepare(liServer *srv, liPlugin *p) {
 
 	while (NULL != (conf_link = g_queue_pop_head_link(&mconf->prepare_ctx))) {
 		ctx = conf_link->data;
-		ctx->worker_client_ctx = g_slice_alloc0(sizeof(liMemcachedCon*) * srv->worker_count);
+		ctx->worker_client_ctx = g_slice_alloc0(sizeof(liMemcachedCon*) * mc_ctx_pool_count(ctx, srv));
 		conf_link->data = NULL;
 	}
 }
@@ -10,10 +10,25 @@
 #include <lighttpd/plugin_core.h>
 
 #include "openssl_filter.h"
+#include "ssl-session-db.h"
+#include "ssl-ticket-keys.h"
 
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
+#include <openssl/evp.h>
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+# include <openssl/core_names.h>
+#else
+# include <openssl/hmac.h>
+#endif
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
+# define SESSION_ID_CONST
+#else
+# define SESSION_ID_CONST const
+#endif
 
 # ifndef OPENSSL_NO_DH
 #  include <openssl/dh.h>
@@ -47,7 +62,12 @@ struct openssl_connection_ctx {
 struct openssl_context {
 	gint refcount;
 
+	liServer *srv;
 	SSL_CTX *ssl_ctx;
+	gboolean ktls;
+
+	liSSLSessionDB *session_db; /* NULL: openssl internal session cache */
+	liSSLTicketKeys *ticket_keys; /* NULL: openssl generates the ticket keys */
 };
 
 enum {
@@ -72,6 +92,11 @@ static void mod_openssl_context_release(openssl_context *ctx) {
 			ctx->ssl_ctx = NULL;
 		}
 
+		li_ssl_session_db_free(ctx->session_db);
+		ctx->session_db = NULL;
+		li_ssl_ticket_keys_free(ctx->ticket_keys);
+		ctx->ticket_keys = NULL;
+
 		g_slice_free(openssl_context, ctx);
 	}
 }
@@ -93,6 +118,13 @@ static void tcp_io_cb(liIOStream *stream, liIOStreamEvent event) {
 
 	li_connection_simple_tcp(&conctx->con, stream, &conctx->simple_socket_data, event);
 
+	if (LI_IOSTREAM_WRITE == event && NULL != conctx->ssl_filter && -1 != li_event_io_fd(&stream->io_watcher)
+	    && NULL != stream->stream_out.out && 0 == stream->stream_out.out->length
+	    && !li_openssl_filter_ktls_flush(conctx->ssl_filter)) {
+		/* wait until the socket is writable again */
+		stream->can_write = FALSE;
+	}
+
 	if (NULL != conctx->con && conctx->con->out_has_all_data
 	    && (NULL == stream->stream_out.out || 0 == stream->stream_out.out->length)
 	    && li_streams_empty(conctx->con->con_sock.raw_out, NULL)) {
@@ -116,9 +148,10 @@ static void tcp_io_cb(liIOStream *stream, liIOStreamEvent event) {
 static void handshake_cb(liOpenSSLFilter *f, gpointer data, liStream *plain_source, liStream *plain_drain) {
 	openssl_connection_ctx *conctx = data;
 	liConnection *con = conctx->con;
-	UNUSED(f);
 
 	if (NULL != con) {
+		con->info.is_ktls = li_openssl_filter_ktls_send(f);
+		li_server_socket_tls_stats_add(con->srv_sock, SSL_session_reused(li_openssl_filter_ssl(f)));
 		li_stream_connect(plain_source, con->con_sock.raw_in);
 		li_stream_connect(con->con_sock.raw_out, plain_drain);
 	} else {
@@ -163,6 +196,7 @@ static void openssl_tcp_finished(liConnection *con, gboolean aborted) {
 	UNUSED(aborted);
 
 	con->info.is_ssl = FALSE;
+	con->info.is_ktls = FALSE;
 	con->con_sock.callbacks = NULL;
 
 	if (NULL != conctx) {
@@ -217,6 +251,8 @@ static gboolean openssl_con_new(liConnection *con, int fd) {
 		return FALSE;
 	}
 
+	if (ctx->ktls) li_openssl_filter_use_ktls(conctx->ssl_filter, fd);
+
 	conctx->con = con;
 	con->con_sock.data = conctx;
 	con->con_sock.callbacks = &openssl_tcp_cbs;
@@ -341,6 +377,129 @@ static liAction* openssl_setenv_create(liServer *srv, liWorker *wrk, liPlugin* p
 	return li_action_new_function(openssl_setenv, NULL, NULL, GUINT_TO_POINTER(params));
 }
 
+static int openssl_session_new_cb(SSL *ssl, SSL_SESSION *sess) {
+	openssl_context *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	const unsigned char *id;
+	unsigned int id_len;
+	unsigned char *data, *p;
+	int len;
+
+#if defined(TLS1_3_VERSION) && defined(SSL_OP_NO_TICKET)
+	/* TLS 1.3 resumes with the ticket alone (the "id" is random), entries would never be looked up */
+	if (TLS1_3_VERSION == SSL_version(ssl) && 0 == (SSL_get_options(ssl) & SSL_OP_NO_TICKET)) return 0;
+#endif
+
+	if (0 >= (len = i2d_SSL_SESSION(sess, NULL))) return 0;
+
+	id = SSL_SESSION_get_id(sess, &id_len);
+	p = data = g_malloc(len);
+	i2d_SSL_SESSION(sess, &p);
+	li_ssl_session_db_store(ctx->session_db, id, id_len, data, len);
+	g_free(data);
+
+	return 0; /* didn't keep a reference to sess */
+}
+
+static SSL_SESSION* openssl_session_get_cb(SSL *ssl, SESSION_ID_CONST unsigned char *id, int id_len, int *copy) {
+	openssl_context *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	liSSLSessionDBData *data;
+	SSL_SESSION *sess = NULL;
+
+	*copy = 0;
+
+	if (NULL != (data = li_ssl_session_db_lookup(ctx->session_db, id, id_len))) {
+		const unsigned char *p = data->data;
+		sess = d2i_SSL_SESSION(NULL, &p, data->size);
+		li_ssl_session_db_data_release(data);
+	}
+
+	return sess;
+}
+
+static void openssl_session_remove_cb(SSL_CTX *ssl_ctx, SSL_SESSION *sess) {
+	openssl_context *ctx = SSL_CTX_get_app_data(ssl_ctx);
+	const unsigned char *id;
+	unsigned int id_len;
+
+	id = SSL_SESSION_get_id(sess, &id_len);
+	li_ssl_session_db_remove(ctx->session_db, id, id_len);
+}
+
+/* returns 0 if there is no key (no new ticket / full handshake), 1 for the current key, 2 to renew the ticket
+ * with the current key and -1 on errors */
+static int openssl_ticket_key_setup(openssl_context *ctx, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cctx, liSSLTicketKey *key, int enc) {
+	int r;
+
+	if (enc) {
+		GError *err = NULL;
+
+		if (!li_ssl_ticket_keys_check(ctx->ticket_keys, &err)) {
+			ERROR(ctx->srv, "openssl: couldn't reload ticket keys: %s", err->message);
+			g_error_free(err);
+		}
+
+		if (!li_ssl_ticket_keys_current(ctx->ticket_keys, key)) return 0;
+		if (1 != RAND_bytes(iv, EVP_CIPHER_iv_length(EVP_aes_256_cbc()))) return -1;
+		memcpy(key_name, key->name, sizeof(key->name));
+		if (1 != EVP_EncryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv)) return -1;
+		return 1;
+	}
+
+	if (0 == (r = li_ssl_ticket_keys_find(ctx->ticket_keys, key_name, key))) return 0;
+	if (1 != EVP_DecryptInit_ex(cctx, EVP_aes_256_cbc(), NULL, key->aes_key, iv)) return -1;
+	return r;
+}
+
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+static int openssl_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cctx, EVP_MAC_CTX *hctx, int enc) {
+	openssl_context *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	liSSLTicketKey key;
+	int r;
+
+	if (0 < (r = openssl_ticket_key_setup(ctx, key_name, iv, cctx, &key, enc))) {
+		OSSL_PARAM params[3];
+		params[0] = OSSL_PARAM_construct_octet_string(OSSL_MAC_PARAM_KEY, key.hmac_secret, sizeof(key.hmac_secret));
+		params[1] = OSSL_PARAM_construct_utf8_string(OSSL_MAC_PARAM_DIGEST, (char*) "sha256", 0);
+		params[2] = OSSL_PARAM_construct_end();
+		if (1 != EVP_MAC_CTX_set_params(hctx, params)) r = -1;
+	}
+
+	OPENSSL_cleanse(&key, sizeof(key));
+	return r;
+}
+#else
+static int openssl_ticket_key_cb(SSL *ssl, unsigned char *key_name, unsigned char *iv, EVP_CIPHER_CTX *cctx, HMAC_CTX *hctx, int enc) {
+	openssl_context *ctx = SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl));
+	liSSLTicketKey key;
+	int r;
+
+	if (0 < (r = openssl_ticket_key_setup(ctx, key_name, iv, cctx, &key, enc))) {
+		if (1 != HMAC_Init_ex(hctx, key.hmac_secret, sizeof(key.hmac_secret), EVP_sha256(), NULL)) r = -1;
+	}
+
+	OPENSSL_cleanse(&key, sizeof(key));
+	return r;
+}
+#endif
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+/* offer "h2" only if http2 is enabled; clients without ALPN get HTTP/1.x */
+static int openssl_alpn_select_cb(SSL *ssl, const unsigned char **out, unsigned char *outlen, const unsigned char *in, unsigned int inlen, void *arg) {
+	static const unsigned char protos_h2[] = "\x02h2\x08http/1.1";
+	static const unsigned char protos_http1[] = "\x08http/1.1";
+	liServer *srv = arg;
+	UNUSED(ssl);
+
+	if (srv->http2) {
+		if (OPENSSL_NPN_NEGOTIATED == SSL_select_next_proto((unsigned char**) out, outlen, protos_h2, sizeof(protos_h2) - 1, in, inlen)) return SSL_TLSEXT_ERR_OK;
+	} else {
+		if (OPENSSL_NPN_NEGOTIATED == SSL_select_next_proto((unsigned char**) out, outlen, protos_http1, sizeof(protos_http1) - 1, in, inlen)) return SSL_TLSEXT_ERR_OK;
+	}
+
+	return SSL_TLSEXT_ERR_NOACK;
+}
+#endif
+
 static void openssl_setup_listen_cb(liServer *srv, int fd, gpointer data) {
 	openssl_context *ctx = data;
 	liServerSocket *srv_sock;
@@ -515,9 +674,13 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 		have_verify_parameter = FALSE,
 		have_verify_depth_parameter = FALSE,
 		have_verify_any_parameter = FALSE,
-		have_verify_require_parameter = FALSE;
+		have_verify_require_parameter = FALSE,
+		have_ktls_parameter = FALSE,
+		have_session_db_size_parameter = FALSE,
+		have_session_db_ttl_parameter = FALSE;
 	const char
-		*ciphers = NULL, *pemfile = NULL, *ca_file = NULL, *client_ca_file = NULL, *dh_params_file = NULL, *ecdh_curve = NULL;
+		*ciphers = NULL, *pemfile = NULL, *ca_file = NULL, *client_ca_file = NULL, *dh_params_file = NULL, *ecdh_curve = NULL,
+		*ticket_key_file = NULL;
 	long
 		options = SSL_OP_NO_SSLv2 | SSL_OP_NO_SSLv3 | SSL_OP_CIPHER_SERVER_PREFERENCE | SSL_OP_SINGLE_DH_USE
 #ifdef SSL_OP_NO_COMPRESSION
@@ -529,8 +692,11 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 		;
 	guint
 		verify_mode = 0, verify_depth = 1;
+	gint64
+		session_db_size = 0, session_db_ttl = 3600;
 	gboolean
-		verify_any = FALSE;
+		verify_any = FALSE,
+		ktls = FALSE;
 
 	UNUSED(p); UNUSED(userdata);
 
@@ -692,6 +858,52 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 				return FALSE;
 			}
 			client_ca_file = entryValue->data.string->str;
+		} else if (g_str_equal(entryKeyStr->str, "ktls")) {
+#ifndef USE_OPENSSL_KTLS
+			WARNING(srv, "%s", "the openssl library in use doesn't support kTLS => ktls has no effect");
+#endif
+			if (LI_VALUE_BOOLEAN != li_value_type(entryValue)) {
+				ERROR(srv, "%s", "openssl ktls expects a boolean as parameter");
+				return FALSE;
+			}
+			if (have_ktls_parameter) {
+				ERROR(srv, "openssl unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			have_ktls_parameter = TRUE;
+			ktls = entryValue->data.boolean;
+		} else if (g_str_equal(entryKeyStr->str, "session-db-size")) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "%s", "openssl session-db-size expects a non-negative number as parameter");
+				return FALSE;
+			}
+			if (have_session_db_size_parameter) {
+				ERROR(srv, "openssl unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			have_session_db_size_parameter = TRUE;
+			session_db_size = entryValue->data.number;
+		} else if (g_str_equal(entryKeyStr->str, "session-db-ttl")) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0) {
+				ERROR(srv, "%s", "openssl session-db-ttl expects a non-negative number as parameter");
+				return FALSE;
+			}
+			if (have_session_db_ttl_parameter) {
+				ERROR(srv, "openssl unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			have_session_db_ttl_parameter = TRUE;
+			session_db_ttl = entryValue->data.number;
+		} else if (g_str_equal(entryKeyStr->str, "ticket-key-file")) {
+			if (LI_VALUE_STRING != li_value_type(entryValue)) {
+				ERROR(srv, "%s", "openssl ticket-key-file expects a string as parameter");
+				return FALSE;
+			}
+			if (NULL != ticket_key_file) {
+				ERROR(srv, "openssl unexpected duplicate parameter %s", entryKeyStr->str);
+				return FALSE;
+			}
+			ticket_key_file = entryValue->data.string->str;
 		} else {
 			ERROR(srv, "invalid parameter for openssl: %s", entryKeyStr->str);
 			return FALSE;
@@ -710,6 +922,8 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 	}
 
 	ctx = mod_openssl_context_new();
+	ctx->srv = srv;
+	ctx->ktls = ktls;
 
 	if (NULL == (ctx->ssl_ctx = SSL_CTX_new(SSLv23_server_method()))) {
 		ERROR(srv, "SSL_CTX_new: %s", ERR_error_string(ERR_get_error(), NULL));
@@ -829,6 +1043,35 @@ static gboolean openssl_setup(liServer *srv, liPlugin* p, liValue *val, gpointer
 		SSL_CTX_set_client_CA_list(ctx->ssl_ctx, client_ca_list);
 	}
 
+	SSL_CTX_set_app_data(ctx->ssl_ctx, ctx);
+
+	if (session_db_size > 0) {
+		/* shared by all workers, but with less lock contention than the internal cache */
+		ctx->session_db = li_ssl_session_db_new(session_db_size, session_db_ttl);
+		SSL_CTX_set_session_cache_mode(ctx->ssl_ctx, SSL_SESS_CACHE_SERVER | SSL_SESS_CACHE_NO_INTERNAL);
+		SSL_CTX_sess_set_new_cb(ctx->ssl_ctx, openssl_session_new_cb);
+		SSL_CTX_sess_set_get_cb(ctx->ssl_ctx, openssl_session_get_cb);
+		SSL_CTX_sess_set_remove_cb(ctx->ssl_ctx, openssl_session_remove_cb);
+	}
+
+	if (NULL != ticket_key_file) {
+		GError *err = NULL;
+		if (NULL == (ctx->ticket_keys = li_ssl_ticket_keys_new(ticket_key_file, &err))) {
+			ERROR(srv, "openssl: %s", err->message);
+			g_error_free(err);
+			goto error_free_socket;
+		}
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+		SSL_CTX_set_tlsext_ticket_key_evp_cb(ctx->ssl_ctx, openssl_ticket_key_cb);
+#else
+		SSL_CTX_set_tlsext_ticket_key_cb(ctx->ssl_ctx, openssl_ticket_key_cb);
+#endif
+	}
+
+#if OPENSSL_VERSION_NUMBER >= 0x10002000L
+	SSL_CTX_set_alpn_select_cb(ctx->ssl_ctx, openssl_alpn_select_cb, srv);
+#endif
+
 	SSL_CTX_set_default_read_ahead(ctx->ssl_ctx, 1);
 	SSL_CTX_set_mode(ctx->ssl_ctx, SSL_CTX_get_mode(ctx->ssl_ctx) | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
 
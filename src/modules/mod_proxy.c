@@ -1,9 +1,6 @@
 /*
  * mod_proxy - connect to HTTP backends for generating response content
  *
- * TODO:
- *     - keep-alive connections
- *
  * Author:
  *     Copyright (c) 2013 Stefan Bühler
  */
@@ -21,24 +18,44 @@ LI_API gboolean mod_proxy_free(liModules *mods, liModule *mod);
 typedef struct proxy_connection proxy_connection;
 typedef struct proxy_context proxy_context;
 
+/* proxy option names */
+static const GString
+	pon_keepalive = { CONST_STR_LEN("keepalive"), 0 },
+	pon_max_requests = { CONST_STR_LEN("max-requests"), 0 },
+	pon_idle_timeout = { CONST_STR_LEN("idle-timeout"), 0 },
+	pon_splice = { CONST_STR_LEN("splice"), 0 }
+;
+
+/* don't create a pipe for small responses */
+#define PROXY_SPLICE_MIN (64*1024)
+
 struct proxy_context {
 	gint refcount;
 
 	liBackendPool *pool;
 
 	GString *socket_str;
+	gboolean keepalive;
+	gboolean splice;
 };
 
 
 struct proxy_connection {
 	proxy_context *ctx;
-	liBackendConnection *bcon;
+	liBackendConnection *bcon; /* NULL after the connection was returned to the pool */
 	gpointer simple_socket_data;
+
+	gboolean responded; /* backend sent data */
+	gboolean failed;    /* read/write error, or eof before the backend sent anything */
+	gboolean reported;  /* result was reported to the pool (li_backend_report) */
+
+	liChunkPipe *splice_pipe; /* response body is moved to the client with splice() */
+	gboolean splice_tried;
 };
 
 /**********************************************************************************/
 
-static void proxy_send_headers(liVRequest *vr, liChunkQueue *out) {
+static void proxy_send_headers(liVRequest *vr, liChunkQueue *out, gboolean keepalive) {
 	GString *head = g_string_sized_new(4095);
 	liHttpHeader *header;
 	GList *iter;
@@ -50,23 +67,26 @@ static void proxy_send_headers(liVRequest *vr, liChunkQueue *out) {
 
 	g_string_append_len(head, GSTR_LEN(vr->request.uri.raw_path));
 
-	switch (vr->request.http_version) {
-	case LI_HTTP_VERSION_1_1:
-		/* g_string_append_len(head, CONST_STR_LEN(" HTTP/1.1\r\n")); */
-		g_string_append_len(head, CONST_STR_LEN(" HTTP/1.0\r\n"));
-		break;
-	case LI_HTTP_VERSION_1_0:
-	default:
-		g_string_append_len(head, CONST_STR_LEN(" HTTP/1.0\r\n"));
-		break;
-	}
+	/* the backend connection is ours, independent of the client http version */
+	g_string_append_len(head, CONST_STR_LEN(" HTTP/1.1\r\n"));
 
 	li_http_header_tokenizer_start(&header_tokenizer, vr->request.headers, CONST_STR_LEN("Connection"));
 	while (li_http_header_tokenizer_next(&header_tokenizer, tmp_str)) {
 		if (0 == g_ascii_strcasecmp(tmp_str->str, "Upgrade")) {
 			g_string_append_len(head, CONST_STR_LEN("Connection: Upgrade\r\n"));
+			keepalive = TRUE; /* don't send "Connection: close" too */
 		}
 	}
+	if (!keepalive) {
+		g_string_append_len(head, CONST_STR_LEN("Connection: close\r\n"));
+	}
+
+	/* required for HTTP/1.1 */
+	if (NULL == li_http_header_lookup(vr->request.headers, CONST_STR_LEN("Host"))) {
+		g_string_append_len(head, CONST_STR_LEN("Host: "));
+		g_string_append_len(head, GSTR_LEN(vr->request.uri.authority));
+		g_string_append_len(head, CONST_STR_LEN("\r\n"));
+	}
 
 	if (LI_HTTP_METHOD_GET != vr->request.http_method && LI_HTTP_METHOD_HEAD != vr->request.http_method) {
 		g_string_append_printf(head, "Content-Length: %" LI_GOFFSET_MODIFIER "i\r\n", vr->request.content_length);
@@ -79,6 +99,7 @@ static void proxy_send_headers(liVRequest *vr, liChunkQueue *out) {
 		if (li_http_header_key_is(header, CONST_STR_LEN("TE"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("Connection"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("Proxy-Connection"))) continue;
+		if (li_http_header_key_is(header, CONST_STR_LEN("Keep-Alive"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("X-Forwarded-Proto"))) continue;
 		if (li_http_header_key_is(header, CONST_STR_LEN("X-Forwarded-For"))) continue;
 		g_string_append_len(head, GSTR_LEN(header->data));
@@ -106,19 +127,37 @@ static void proxy_send_headers(liVRequest *vr, liChunkQueue *out) {
 static void proxy_backend_free(liBackendPool *bpool) {
 	liBackendConfig *config = (liBackendConfig*) bpool->config;
 	li_sockaddr_clear(&config->sock_addr);
+	if (NULL != config->check_request) g_string_free(config->check_request, TRUE);
 	g_slice_free(liBackendConfig, config);
 }
 
+/* active health check: "HTTP/1.x 2xx" or "HTTP/1.x 3xx" */
+static liBackendCheckResult proxy_backend_check(liBackendPool *bpool, const GString *response, gboolean eof) {
+	const gchar *s = response->str;
+	gint status;
+	UNUSED(bpool);
+
+	if (response->len < 12) return eof ? LI_BACKEND_CHECK_FAILED : LI_BACKEND_CHECK_NEED_MORE;
+
+	if (0 != strncmp(s, "HTTP/1.", 7) || ' ' != s[8]) return LI_BACKEND_CHECK_FAILED;
+	if (!g_ascii_isdigit(s[9]) || !g_ascii_isdigit(s[10]) || !g_ascii_isdigit(s[11])) return LI_BACKEND_CHECK_FAILED;
+
+	status = (s[9] - '0') * 100 + (s[10] - '0') * 10 + (s[11] - '0');
+	return (status >= 200 && status < 400) ? LI_BACKEND_CHECK_OK : LI_BACKEND_CHECK_FAILED;
+}
+
 static liBackendCallbacks proxy_backend_cbs = {
 	/* backend_detach_thread */ NULL, 
 	/* backend_attach_thread */ NULL,
 	/* backend_new */ NULL,
 	/* backend_close */ NULL,
-	proxy_backend_free
+	proxy_backend_free,
+	proxy_backend_check
 };
 
 
-static proxy_context* proxy_context_new(liServer *srv, GString *dest_socket) {
+static proxy_context* proxy_context_new(liServer *srv, GString *dest_socket, gboolean keepalive, gint max_requests, gint idle_timeout,
+		const liBackendHealthOptions *health, gboolean splice) {
 	liSocketAddress saddr;
 	proxy_context* ctx;
 	liBackendConfig *config;
@@ -133,17 +172,31 @@ static proxy_context* proxy_context_new(liServer *srv, GString *dest_socket) {
 	config->callbacks = &proxy_backend_cbs;
 	config->sock_addr = saddr;
 	config->max_connections = 0;
-	config->idle_timeout = 5;
+	config->idle_timeout = keepalive ? idle_timeout : 5;
 	config->connect_timeout = 5;
 	config->wait_timeout = 5;
 	config->disable_time = 0;
-	config->max_requests = 1;
+	config->max_requests = keepalive ? max_requests : 1;
 	config->watch_for_close = TRUE;
+	config->max_fails = health->max_fails;
+	config->check_interval = health->check_interval;
+	config->slow_start = health->slow_start;
+
+	if (NULL != health->check_path) {
+		config->check_request = g_string_sized_new(127);
+		g_string_append_len(config->check_request, CONST_STR_LEN("GET "));
+		g_string_append_len(config->check_request, GSTR_LEN(health->check_path));
+		g_string_append_len(config->check_request, CONST_STR_LEN(" HTTP/1.1\r\nHost: "));
+		g_string_append_len(config->check_request, GSTR_LEN(dest_socket));
+		g_string_append_len(config->check_request, CONST_STR_LEN("\r\nConnection: close\r\n\r\n"));
+	}
 
 	ctx = g_slice_new0(proxy_context);
 	ctx->refcount = 1;
 	ctx->pool = li_backend_pool_new(config);
 	ctx->socket_str = g_string_new_len(GSTR_LEN(dest_socket));
+	ctx->keepalive = keepalive;
+	ctx->splice = splice;
 
 	return ctx;
 }
@@ -167,22 +220,51 @@ static void proxy_context_acquire(proxy_context *ctx) {
 static void proxy_io_cb(liIOStream *stream, liIOStreamEvent event) {
 	proxy_connection *con = stream->data;
 	liWorker *wrk = li_worker_from_iostream(stream);
+	int fd = li_event_io_fd(&stream->io_watcher);
+	goffset splice_max = 0;
+
+	if (LI_IOSTREAM_READ == event && con->ctx->splice && NULL != stream->stream_in.dest) {
+		/* stream_in.dest is the http response parser */
+		splice_max = li_stream_http_response_splice_max(stream->stream_in.dest);
+		if (NULL == con->splice_pipe && !con->splice_tried && splice_max >= PROXY_SPLICE_MIN) {
+			con->splice_tried = TRUE;
+			con->splice_pipe = li_chunkpipe_new();
+		}
+	}
 
-	li_stream_simple_socket_io_cb_with_context(stream, event, &con->simple_socket_data);
+	li_stream_simple_socket_io_cb_with_splice(stream, event, &con->simple_socket_data, con->splice_pipe, splice_max);
 
 	switch (event) {
 	case LI_IOSTREAM_DESTROY:
 		li_stream_simple_socket_close(stream, FALSE);
-		li_event_io_set_fd(&con->bcon->watcher, -1);
 
-		li_backend_put(wrk, con->ctx->pool, con->bcon, TRUE);
-		con->bcon = NULL;
+		if (NULL != con->bcon) {
+			li_event_io_set_fd(&con->bcon->watcher, -1);
+			li_backend_put(wrk, con->ctx->pool, con->bcon, TRUE);
+			con->bcon = NULL;
+		}
+
+		/* responses ending with the connection count as success; requests aborted by the
+		 * client before the backend answered don't count at all
+		 */
+		if (!con->reported && NULL != wrk && (con->failed || con->responded)) {
+			li_backend_report(wrk, con->ctx->pool, con->failed);
+		}
 
+		li_chunkpipe_release(con->splice_pipe);
 		proxy_context_release(con->ctx);
 		g_slice_free(proxy_connection, con);
 
 		stream->data = NULL;
 		return;
+	case LI_IOSTREAM_READ:
+		if (NULL != stream->stream_in.out && stream->stream_in.out->bytes_in > 0) con->responded = TRUE;
+		if (stream->in_closed && !con->responded) con->failed = TRUE;
+		/* fall through */
+	case LI_IOSTREAM_WRITE:
+		/* the socket got closed with an error */
+		if (-1 != fd && -1 == li_event_io_fd(&stream->io_watcher) && !con->reported) con->failed = TRUE;
+		break;
 	default:
 		break;
 	}
@@ -194,6 +276,43 @@ static void proxy_io_cb(liIOStream *stream, liIOStreamEvent event) {
 	}
 }
 
+/* complete request (including the body) was written, and we didn't shutdown(SHUT_WR) */
+static gboolean proxy_request_sent(liIOStream *iostream) {
+	liStream *out = &iostream->stream_out;
+
+	if (NULL == out->out || out->out->is_closed || out->out->length > 0) return FALSE;
+	return NULL != out->source && out->source->out->is_closed && 0 == out->source->out->length;
+}
+
+static void proxy_response_done(gpointer data, gint http_status, gboolean keepalive) {
+	liIOStream *iostream = data;
+	proxy_connection *con = iostream->data;
+
+	if (NULL != con && !con->reported) {
+		con->reported = TRUE;
+		li_backend_report(li_worker_from_iostream(iostream), con->ctx->pool, http_status >= 500);
+	}
+
+	if (keepalive && NULL != con && NULL != con->bcon && proxy_request_sent(iostream)) {
+		/* con is gone after li_iostream_reset */
+		liWorker *wrk = li_worker_from_iostream(iostream);
+		liBackendConnection *bcon = con->bcon;
+		proxy_context *ctx = con->ctx;
+
+		con->bcon = NULL;
+		proxy_context_acquire(ctx);
+
+		/* detach the socket from the iostream without closing it */
+		li_iostream_acquire(iostream);
+		li_iostream_reset(iostream);
+
+		li_backend_put(wrk, ctx->pool, bcon, FALSE);
+		proxy_context_release(ctx);
+	} else {
+		li_stream_simple_socket_close(iostream, TRUE);
+	}
+}
+
 static void proxy_connection_new(liVRequest *vr, liBackendConnection *bcon, proxy_context *ctx) {
 	proxy_connection* scon = g_slice_new0(proxy_connection);
 	liIOStream *iostream;
@@ -210,10 +329,10 @@ static void proxy_connection_new(liVRequest *vr, liBackendConnection *bcon, prox
 
 	li_stream_connect(outplug, &iostream->stream_out);
 
-	proxy_send_headers(vr, outplug->out);
+	proxy_send_headers(vr, outplug->out, ctx->keepalive);
 	li_stream_notify_later(outplug);
 
-	http_out = li_stream_http_response_handle(&iostream->stream_in, vr, TRUE, FALSE);
+	http_out = li_stream_http_response_handle_framed(&iostream->stream_in, vr, TRUE, FALSE, proxy_response_done, iostream);
 
 	li_vrequest_handle_indirect(vr, NULL);
 	li_vrequest_indirect_connect(vr, outplug, http_out);
@@ -279,16 +398,74 @@ static void proxy_free(liServer *srv, gpointer param) {
 
 static liAction* proxy_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	proxy_context *ctx;
+	liValue *config = NULL;
+	gboolean keepalive = FALSE, splice = TRUE;
+	gint max_requests = -1, idle_timeout = 5;
+	liBackendHealthOptions health = { 0, 0, 0, NULL };
+	gboolean handled;
 	UNUSED(wrk); UNUSED(userdata); UNUSED(p);
 
 	val = li_value_get_single_argument(val);
 
+	if (li_value_list_has_len(val, 2)) {
+		config = li_value_list_at(val, 1);
+		val = li_value_list_at(val, 0);
+
+		if (NULL == (config = li_value_to_key_value_list(config))) {
+			ERROR(srv, "%s", "proxy expects a hash/key-value list as second parameter");
+			return NULL;
+		}
+	}
+
 	if (LI_VALUE_STRING != li_value_type(val)) {
 		ERROR(srv, "%s", "proxy expects a string as parameter");
 		return FALSE;
 	}
 
-	ctx = proxy_context_new(srv, val->data.string);
+	LI_VALUE_FOREACH(entry, config)
+		liValue *entryKey = li_value_list_at(entry, 0);
+		liValue *entryValue = li_value_list_at(entry, 1);
+		GString *entryKeyStr;
+
+		if (LI_VALUE_STRING != li_value_type(entryKey)) {
+			ERROR(srv, "%s", "proxy doesn't take default keys");
+			return NULL;
+		}
+		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
+
+		if (g_string_equal(entryKeyStr, &pon_keepalive)) {
+			if (LI_VALUE_BOOLEAN != li_value_type(entryValue)) {
+				ERROR(srv, "proxy option '%s' expects boolean as parameter", entryKeyStr->str);
+				return NULL;
+			}
+			keepalive = entryValue->data.boolean;
+		} else if (g_string_equal(entryKeyStr, &pon_max_requests)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number < 0 || entryValue->data.number > G_MAXINT) {
+				ERROR(srv, "proxy option '%s' expects non-negative number as parameter", entryKeyStr->str);
+				return NULL;
+			}
+			max_requests = (0 == entryValue->data.number) ? -1 : entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &pon_idle_timeout)) {
+			if (LI_VALUE_NUMBER != li_value_type(entryValue) || entryValue->data.number <= 0 || entryValue->data.number > G_MAXINT) {
+				ERROR(srv, "proxy option '%s' expects positive number as parameter", entryKeyStr->str);
+				return NULL;
+			}
+			idle_timeout = entryValue->data.number;
+		} else if (g_string_equal(entryKeyStr, &pon_splice)) {
+			if (LI_VALUE_BOOLEAN != li_value_type(entryValue)) {
+				ERROR(srv, "proxy option '%s' expects boolean as parameter", entryKeyStr->str);
+				return NULL;
+			}
+			splice = entryValue->data.boolean;
+		} else if (!li_backend_parse_health_option(srv, "proxy", entryKeyStr, entryValue, &health, &handled)) {
+			return NULL;
+		} else if (!handled) {
+			ERROR(srv, "unknown option for proxy '%s'", entryKeyStr->str);
+			return NULL;
+		}
+	LI_VALUE_END_FOREACH()
+
+	ctx = proxy_context_new(srv, val->data.string, keepalive, max_requests, idle_timeout, &health, splice);
 	if (NULL == ctx) return NULL;
 
 	return li_action_new_function(proxy_handle, proxy_handle_abort, proxy_free, ctx);
@@ -21,7 +21,6 @@ LI_API gboolean mod_redirect_free(liModules *mods, liModule *mod);
 typedef struct redirect_rule redirect_rule;
 struct redirect_rule {
 	liPattern *pattern;
-	GRegex *regex;
 	enum {
 		REDIRECT_ABSOLUTE_URI,
 		REDIRECT_ABSOLUTE_PATH,
@@ -33,14 +32,15 @@ struct redirect_rule {
 typedef struct redirect_data redirect_data;
 struct redirect_data {
 	GArray *rules;
+	liRegexSet *regexes; /* regex for the n-th rule; NULL if the rule has no regex (always matches) */
 	liPlugin *p;
 };
 
-static gboolean redirect_rule_parse(liServer *srv, GString *regex, GString *str, redirect_rule *rule) {
+static gboolean redirect_rule_parse(liServer *srv, GString *regex, GString *str, redirect_rule *rule, liRegex **rule_regex) {
 	gchar *pattern_str = str->str;
 
 	rule->pattern = NULL;
-	rule->regex = NULL;
+	*rule_regex = NULL;
 	rule->type = REDIRECT_ABSOLUTE_URI;
 
 	if (pattern_str[0] == '/') {
@@ -59,11 +59,11 @@ static gboolean redirect_rule_parse(liServer *srv, GString *regex, GString *str,
 
 	if (NULL != regex) {
 		GError *err = NULL;
-		rule->regex = g_regex_new(regex->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, &err);
+		*rule_regex = li_regex_new(regex->str, &err);
 
-		if (NULL == rule->regex || NULL != err) {
+		if (NULL == *rule_regex) {
 			ERROR(srv, "redirect: error compiling regex \"%s\": %s", regex->str, NULL != err ? err->message : "unknown error");
-			g_error_free(err);
+			if (NULL != err) g_error_free(err);
 			goto error;
 		}
 	}
@@ -75,32 +75,16 @@ error:
 		li_pattern_free(rule->pattern);
 		rule->pattern = NULL;
 	}
-	if (NULL != rule->regex) {
-		g_regex_unref(rule->regex);
-		rule->regex = NULL;
-	}
 
 	return FALSE;
 }
 
-static gboolean redirect_internal(liVRequest *vr, GString *dest, redirect_rule *rule) {
-	gchar *path;
-	GMatchInfo *match_info = NULL;
-	GMatchInfo *prev_match_info = NULL;
-
-	path = vr->request.uri.path->str;
-
-	if (NULL != rule->regex && !g_regex_match(rule->regex, path, 0, &match_info)) {
-		if (match_info) {
-			g_match_info_free(match_info);
-		}
-
-		return FALSE;
-	}
+static void redirect_internal(liVRequest *vr, GString *dest, redirect_rule *rule, liRegexMatch *match) {
+	liRegexMatch *prev_match = NULL;
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		prev_match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		prev_match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(dest, 0);
@@ -139,44 +123,41 @@ static gboolean redirect_internal(liVRequest *vr, GString *dest, redirect_rule *
 		break;
 	}
 
-	li_pattern_eval(vr, dest, rule->pattern, li_pattern_regex_cb, match_info, li_pattern_regex_cb, prev_match_info);
-
-	if (match_info) {
-		g_match_info_free(match_info);
-	}
-
-	return TRUE;
+	li_pattern_eval(vr, dest, rule->pattern, li_pattern_regex_cb, match, li_pattern_regex_cb, prev_match);
 }
 
 static liHandlerResult redirect(liVRequest *vr, gpointer param, gpointer *context) {
 	guint i;
-	redirect_rule *rule;
 	redirect_data *rd = param;
 	gboolean debug = _OPTION(vr, rd->p, 0).boolean;
 	GString *dest = vr->wrk->tmp_str;
+	liRegexMatch *match;
+	GError *err = NULL;
 
 	UNUSED(context);
 
 	if (li_vrequest_is_handled(vr)) return LI_HANDLER_GO_ON;
 
-	for (i = 0; i < rd->rules->len; i++) {
-		rule = &g_array_index(rd->rules, redirect_rule, i);
+	/* all regexes in one pass, the first matching rule wins */
+	i = li_regex_set_match(rd->regexes, GSTR_LEN(vr->request.uri.path), &match, &err);
+	if (NULL != err) {
+		VR_ERROR(vr, "redirect: matching path \"%s\" failed: %s", vr->request.uri.path->str, err->message);
+		g_error_free(err);
+		return LI_HANDLER_ERROR;
+	}
+	if (G_MAXUINT == i) return LI_HANDLER_GO_ON;
 
-		if (redirect_internal(vr, dest, rule)) {
-			/* regex matched */
-			if (debug) {
-				VR_DEBUG(vr, "redirect: \"%s\"", dest->str);
-			}
+	redirect_internal(vr, dest, &g_array_index(rd->rules, redirect_rule, i), match);
+	li_regex_match_free(match);
 
-			if (!li_vrequest_handle_direct(vr)) return LI_HANDLER_ERROR;
+	if (debug) {
+		VR_DEBUG(vr, "redirect: \"%s\"", dest->str);
+	}
 
-			vr->response.http_status = 301;
-			li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Location"), GSTR_LEN(dest));
+	if (!li_vrequest_handle_direct(vr)) return LI_HANDLER_ERROR;
 
-			/* stop at first matching regex */
-			return LI_HANDLER_GO_ON;
-		}
-	}
+	vr->response.http_status = 301;
+	li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Location"), GSTR_LEN(dest));
 
 	return LI_HANDLER_GO_ON;
 }
@@ -191,12 +172,10 @@ static void redirect_free(liServer *srv, gpointer param) {
 		redirect_rule *rule = &g_array_index(rd->rules, redirect_rule, i);
 
 		li_pattern_free(rule->pattern);
-
-		if (NULL != rule->regex)
-			g_regex_unref(rule->regex);
 	}
 
 	g_array_free(rd->rules, TRUE);
+	li_regex_set_free(rd->regexes);
 	g_slice_free(redirect_data, rd);
 }
 
@@ -214,31 +193,37 @@ static liAction* redirect_create(liServer *srv, liWorker *wrk, liPlugin* p, liVa
 	rd = g_slice_new(redirect_data);
 	rd->p = p;
 	rd->rules = g_array_new(FALSE, FALSE, sizeof(redirect_rule));
+	rd->regexes = li_regex_set_new();
 
 	if (LI_VALUE_STRING == li_value_type(val)) {
 		redirect_rule rule;
+		liRegex *regex;
 
 		/* redirect "/foo/bar"; */
-		if (!redirect_rule_parse(srv, NULL, val->data.string, &rule)) {
+		if (!redirect_rule_parse(srv, NULL, val->data.string, &rule, &regex)) {
 			redirect_free(NULL, rd);
 			return NULL;
 		}
 
 		g_array_append_val(rd->rules, rule);
+		li_regex_set_add(rd->regexes, regex);
 	} else if (li_value_list_has_len(val, 2) && LI_VALUE_STRING == li_value_list_type_at(val, 0) && LI_VALUE_STRING == li_value_list_type_at(val, 1)) {
 		redirect_rule rule;
+		liRegex *regex;
 
 		/* only one rule */
-		if (!redirect_rule_parse(srv, li_value_list_at(val, 0)->data.string, li_value_list_at(val, 1)->data.string, &rule)) {
+		if (!redirect_rule_parse(srv, li_value_list_at(val, 0)->data.string, li_value_list_at(val, 1)->data.string, &rule, &regex)) {
 			redirect_free(NULL, rd);
 			return NULL;
 		}
 
 		g_array_append_val(rd->rules, rule);
+		li_regex_set_add(rd->regexes, regex);
 	} else {
 		/* probably multiple rules */
 		LI_VALUE_FOREACH(v, val)
 			redirect_rule rule;
+			liRegex *regex;
 
 			if (!li_value_list_has_len(v, 2)
 					|| LI_VALUE_STRING != li_value_list_type_at(v, 0) || LI_VALUE_STRING != li_value_list_type_at(v, 1)) {
@@ -247,15 +232,18 @@ static liAction* redirect_create(liServer *srv, liWorker *wrk, liPlugin* p, liVa
 				return NULL;
 			}
 
-			if (!redirect_rule_parse(srv, li_value_list_at(v, 0)->data.string, li_value_list_at(v, 1)->data.string, &rule)) {
+			if (!redirect_rule_parse(srv, li_value_list_at(v, 0)->data.string, li_value_list_at(v, 1)->data.string, &rule, &regex)) {
 				redirect_free(NULL, rd);
 				return NULL;
 			}
 
 			g_array_append_val(rd->rules, rule);
+			li_regex_set_add(rd->regexes, regex);
 		LI_VALUE_END_FOREACH()
 	}
 
+	li_regex_set_compile(rd->regexes);
+
 	return li_action_new_function(redirect, NULL, redirect_free, rd);
 }
 
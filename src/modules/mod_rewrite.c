@@ -19,20 +19,20 @@ LI_API gboolean mod_rewrite_free(liModules *mods, liModule *mod);
 typedef struct rewrite_rule rewrite_rule;
 struct rewrite_rule {
 	liPattern *path, *querystring;
-	GRegex *regex;
 };
 
 typedef struct rewrite_data rewrite_data;
 struct rewrite_data {
 	GArray *rules;
+	liRegexSet *regexes; /* regex for the n-th rule; NULL if the rule has no regex (always matches) */
 	liPlugin *p;
 };
 
-static gboolean rewrite_rule_parse(liServer *srv, GString *regex, GString *str, rewrite_rule *rule, gboolean raw) {
+static gboolean rewrite_rule_parse(liServer *srv, GString *regex, GString *str, rewrite_rule *rule, liRegex **rule_regex, gboolean raw) {
 	gchar *qs = NULL;
 
 	rule->path = rule->querystring = NULL;
-	rule->regex = NULL;
+	*rule_regex = NULL;
 
 	if (!raw) {
 		/* find "not-escaped" ? */
@@ -60,11 +60,11 @@ static gboolean rewrite_rule_parse(liServer *srv, GString *regex, GString *str,
 
 	if (NULL != regex) {
 		GError *err = NULL;
-		rule->regex = g_regex_new(regex->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, &err);
+		*rule_regex = li_regex_new(regex->str, &err);
 
-		if (NULL == rule->regex || NULL != err) {
+		if (NULL == *rule_regex) {
 			ERROR(srv, "rewrite: error compiling regex \"%s\": %s", regex->str, NULL != err ? err->message : "unknown error");
-			g_error_free(err);
+			if (NULL != err) g_error_free(err);
 			goto error;
 		}
 	}
@@ -84,10 +84,6 @@ error:
 		li_pattern_free(rule->path);
 		rule->path = NULL;
 	}
-	if (NULL != rule->regex) {
-		g_regex_unref(rule->regex);
-		rule->regex = NULL;
-	}
 
 	if (NULL != qs) {
 		*qs = '?';
@@ -96,63 +92,52 @@ error:
 	return FALSE;
 }
 
-static gboolean rewrite_internal(liVRequest *vr, GString *dest_path, GString *dest_query, rewrite_rule *rule, gchar *path) {
-	GMatchInfo *match_info = NULL;
-	GMatchInfo *prev_match_info = NULL;
-
-	if (NULL != rule->regex && !g_regex_match(rule->regex, path, 0, &match_info)) {
-		if (NULL != match_info) {
-			g_match_info_free(match_info);
-		}
-
-		return FALSE;
-	}
+static void rewrite_internal(liVRequest *vr, GString *dest_path, GString *dest_query, rewrite_rule *rule, liRegexMatch *match) {
+	liRegexMatch *prev_match = NULL;
 
 	if (vr->action_stack.regex_stack->len) {
 		GArray *rs = vr->action_stack.regex_stack;
-		prev_match_info = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match_info;
+		prev_match = g_array_index(rs, liActionRegexStackElement, rs->len - 1).match;
 	}
 
 	g_string_truncate(dest_path, 0);
 	if (NULL != dest_query) g_string_truncate(dest_query, 0);
 
-	li_pattern_eval(vr, dest_path, rule->path, li_pattern_regex_cb, match_info, li_pattern_regex_cb, prev_match_info);
+	li_pattern_eval(vr, dest_path, rule->path, li_pattern_regex_cb, match, li_pattern_regex_cb, prev_match);
 	if (NULL != rule->querystring) {
 		LI_FORCE_ASSERT(NULL != dest_query);
-		li_pattern_eval(vr, dest_query, rule->querystring, li_pattern_regex_cb, match_info, li_pattern_regex_cb, prev_match_info);
+		li_pattern_eval(vr, dest_query, rule->querystring, li_pattern_regex_cb, match, li_pattern_regex_cb, prev_match);
 	}
-
-	g_match_info_free(match_info);
-
-	return TRUE;
 }
 
 static liHandlerResult rewrite_raw(liVRequest *vr, gpointer param, gpointer *context) {
 	guint i;
-	rewrite_rule *rule;
 	rewrite_data *rd = param;
 	gboolean debug = _OPTION(vr, rd->p, 0).boolean;
 	gchar *path = vr->request.uri.raw_path->str;
+	GString *dest_path = vr->wrk->tmp_str;
+	liRegexMatch *match;
+	GError *err = NULL;
 	UNUSED(context);
 
-	for (i = 0; i < rd->rules->len; i++) {
-		GString *dest_path = vr->wrk->tmp_str;
-
-		rule = &g_array_index(rd->rules, rewrite_rule, i);
-
-		if (rewrite_internal(vr, dest_path, NULL, rule, path)) {
-			/* regex matched */
-			if (debug) {
-				VR_DEBUG(vr, "rewrite_raw: path \"%s\" => \"%s\"", path, dest_path->str);
-			}
+	/* all regexes in one pass, the first matching rule wins */
+	i = li_regex_set_match(rd->regexes, GSTR_LEN(vr->request.uri.raw_path), &match, &err);
+	if (NULL != err) {
+		VR_ERROR(vr, "rewrite_raw: matching path \"%s\" failed: %s", path, err->message);
+		g_error_free(err);
+		return LI_HANDLER_ERROR;
+	}
+	if (G_MAXUINT == i) return LI_HANDLER_GO_ON;
 
-			if (!li_parse_raw_path(&vr->request.uri, dest_path)) return LI_HANDLER_ERROR;
+	rewrite_internal(vr, dest_path, NULL, &g_array_index(rd->rules, rewrite_rule, i), match);
+	li_regex_match_free(match);
 
-			/* stop at first matching regex */
-			break;
-		}
+	if (debug) {
+		VR_DEBUG(vr, "rewrite_raw: path \"%s\" => \"%s\"", path, dest_path->str);
 	}
 
+	if (!li_parse_raw_path(&vr->request.uri, dest_path)) return LI_HANDLER_ERROR;
+
 	return LI_HANDLER_GO_ON;
 }
 
@@ -163,51 +148,57 @@ static liHandlerResult rewrite(liVRequest *vr, gpointer param, gpointer *context
 	rewrite_rule *rule;
 	rewrite_data *rd = param;
 	gboolean debug = _OPTION(vr, rd->p, 0).boolean;
-	GString *dest_query = g_string_sized_new(31);
+	GString *dest_query;
+	GString *dest_path = vr->wrk->tmp_str;
 	gchar *path = vr->request.uri.path->str;
+	liRegexMatch *match;
+	GError *err = NULL;
 	UNUSED(context);
 
-	for (i = 0; i < rd->rules->len; i++) {
-		GString *dest_path = vr->wrk->tmp_str;
-
-		rule = &g_array_index(rd->rules, rewrite_rule, i);
-
-		if (rewrite_internal(vr, dest_path, dest_query, rule, path)) {
-			/* regex matched */
-			if (debug) {
-				if (NULL != rule->querystring) {
-					VR_DEBUG(vr, "rewrite: path \"%s\" => \"%s\", query \"%s\" => \"%s\"",
-						path, dest_path->str,
-						vr->request.uri.query->str, dest_query->str
-					);
-				} else {
-					VR_DEBUG(vr, "rewrite: path \"%s\" => \"%s\"",
-						path, dest_path->str
-					);
-				}
-			}
-
-			/* change request query */
-			if (NULL != rule->querystring) {
-				g_string_truncate(vr->request.uri.query, 0);
-				g_string_append_len(vr->request.uri.query, GSTR_LEN(dest_query));
-			}
+	/* all regexes in one pass, the first matching rule wins */
+	i = li_regex_set_match(rd->regexes, GSTR_LEN(vr->request.uri.path), &match, &err);
+	if (NULL != err) {
+		VR_ERROR(vr, "rewrite: matching path \"%s\" failed: %s", path, err->message);
+		g_error_free(err);
+		return LI_HANDLER_ERROR;
+	}
+	if (G_MAXUINT == i) return LI_HANDLER_GO_ON;
+
+	rule = &g_array_index(rd->rules, rewrite_rule, i);
+	dest_query = g_string_sized_new(31);
+
+	rewrite_internal(vr, dest_path, dest_query, rule, match);
+	li_regex_match_free(match);
+
+	if (debug) {
+		if (NULL != rule->querystring) {
+			VR_DEBUG(vr, "rewrite: path \"%s\" => \"%s\", query \"%s\" => \"%s\"",
+				path, dest_path->str,
+				vr->request.uri.query->str, dest_query->str
+			);
+		} else {
+			VR_DEBUG(vr, "rewrite: path \"%s\" => \"%s\"",
+				path, dest_path->str
+			);
+		}
+	}
 
-			/* change request path */
-			g_string_truncate(vr->request.uri.path, 0);
-			g_string_append_len(vr->request.uri.path, GSTR_LEN(dest_path));
-			li_path_simplify(vr->request.uri.path);
+	/* change request query */
+	if (NULL != rule->querystring) {
+		g_string_truncate(vr->request.uri.query, 0);
+		g_string_append_len(vr->request.uri.query, GSTR_LEN(dest_query));
+	}
 
-			/* rebuild raw_path */
-			li_string_encode(vr->request.uri.path->str, vr->request.uri.raw_path, LI_ENCODING_URI);
-			if (vr->request.uri.query->len > 0) {
-				g_string_append_len(vr->request.uri.raw_path, CONST_STR_LEN("?"));
-				g_string_append_len(vr->request.uri.raw_path, GSTR_LEN(vr->request.uri.query));
-			}
+	/* change request path */
+	g_string_truncate(vr->request.uri.path, 0);
+	g_string_append_len(vr->request.uri.path, GSTR_LEN(dest_path));
+	li_path_simplify(vr->request.uri.path);
 
-			/* stop at first matching regex */
-			break;
-		}
+	/* rebuild raw_path */
+	li_string_encode(vr->request.uri.path->str, vr->request.uri.raw_path, LI_ENCODING_URI);
+	if (vr->request.uri.query->len > 0) {
+		g_string_append_len(vr->request.uri.raw_path, CONST_STR_LEN("?"));
+		g_string_append_len(vr->request.uri.raw_path, GSTR_LEN(vr->request.uri.query));
 	}
 
 	g_string_free(dest_query, TRUE);
@@ -225,13 +216,10 @@ static void rewrite_free(liServer *srv, gpointer param) {
 
 		li_pattern_free(rule->path);
 		li_pattern_free(rule->querystring);
-
-		if (rule->regex) {
-			g_regex_unref(rule->regex);
-		}
 	}
 
 	g_array_free(rd->rules, TRUE);
+	li_regex_set_free(rd->regexes);
 	g_slice_free(rewrite_data, rd);
 }
 
@@ -250,32 +238,38 @@ static liAction* rewrite_create(liServer *srv, liWorker *wrk, liPlugin* p, liVal
 	rd = g_slice_new(rewrite_data);
 	rd->p = p;
 	rd->rules = g_array_new(FALSE, FALSE, sizeof(rewrite_rule));
+	rd->regexes = li_regex_set_new();
 
 	if (LI_VALUE_STRING == li_value_type(val)) {
 		/* rewrite "/foo/bar"; */
-		rewrite_rule rule = { NULL, NULL, NULL };
+		rewrite_rule rule = { NULL, NULL };
+		liRegex *regex;
 
-		if (!rewrite_rule_parse(srv, NULL, val->data.string, &rule, raw)) {
+		if (!rewrite_rule_parse(srv, NULL, val->data.string, &rule, &regex, raw)) {
 			rewrite_free(NULL, rd);
 			ERROR(srv, "rewrite: error parsing rule \"%s\"", val->data.string->str);
 			return NULL;
 		}
 
 		g_array_append_val(rd->rules, rule);
+		li_regex_set_add(rd->regexes, regex);
 	} else if (li_value_list_has_len(val, 2) && LI_VALUE_STRING == li_value_list_type_at(val, 0) && LI_VALUE_STRING == li_value_list_type_at(val, 1)) {
 		/* only one rule */
-		rewrite_rule rule = { NULL, NULL, NULL };
+		rewrite_rule rule = { NULL, NULL };
+		liRegex *regex;
 
-		if (!rewrite_rule_parse(srv, li_value_list_at(val, 0)->data.string, li_value_list_at(val, 1)->data.string, &rule, raw)) {
+		if (!rewrite_rule_parse(srv, li_value_list_at(val, 0)->data.string, li_value_list_at(val, 1)->data.string, &rule, &regex, raw)) {
 			rewrite_free(NULL, rd);
 			return NULL;
 		}
 
 		g_array_append_val(rd->rules, rule);
+		li_regex_set_add(rd->regexes, regex);
 	} else {
 		/* probably multiple rules */
 		LI_VALUE_FOREACH(v, val)
-			rewrite_rule rule = { NULL, NULL, NULL };
+			rewrite_rule rule = { NULL, NULL };
+			liRegex *regex;
 
 			if (!li_value_list_has_len(v, 2)
 					|| LI_VALUE_STRING != li_value_list_type_at(v, 0) || LI_VALUE_STRING != li_value_list_type_at(v, 1)) {
@@ -284,15 +278,18 @@ static liAction* rewrite_create(liServer *srv, liWorker *wrk, liPlugin* p, liVal
 				return NULL;
 			}
 
-			if (!rewrite_rule_parse(srv, li_value_list_at(v, 0)->data.string, li_value_list_at(v, 1)->data.string, &rule, raw)) {
+			if (!rewrite_rule_parse(srv, li_value_list_at(v, 0)->data.string, li_value_list_at(v, 1)->data.string, &rule, &regex, raw)) {
 				rewrite_free(NULL, rd);
 				return NULL;
 			}
 
 			g_array_append_val(rd->rules, rule);
+			li_regex_set_add(rd->regexes, regex);
 		LI_VALUE_END_FOREACH()
 	}
 
+	li_regex_set_compile(rd->regexes);
+
 	return li_action_new_function(raw ? rewrite_raw : rewrite, NULL, rewrite_free, rd);
 }
 
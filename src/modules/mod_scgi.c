@@ -31,6 +31,9 @@ struct scgi_connection {
 	scgi_context *ctx;
 	liBackendConnection *bcon;
 	gpointer simple_socket_data;
+
+	gboolean responded; /* backend sent data */
+	gboolean failed;    /* read/write error, or eof before the backend sent anything */
 };
 
 /**********************************************************************************/
@@ -123,6 +126,9 @@ static void scgi_env_create(liVRequest *vr, liEnvironmentDup *envdup, GByteArray
 	scgi_env_add(buf, envdup, CONST_STR_LEN("REQUEST_METHOD"), GSTR_LEN(vr->request.http_method_str));
 	scgi_env_add(buf, envdup, CONST_STR_LEN("REDIRECT_STATUS"), CONST_STR_LEN("200")); /* if php is compiled with --force-redirect */
 	switch (vr->request.http_version) {
+	case LI_HTTP_VERSION_2:
+		scgi_env_add(buf, envdup, CONST_STR_LEN("SERVER_PROTOCOL"), CONST_STR_LEN("HTTP/2.0"));
+		break;
 	case LI_HTTP_VERSION_1_1:
 		scgi_env_add(buf, envdup, CONST_STR_LEN("SERVER_PROTOCOL"), CONST_STR_LEN("HTTP/1.1"));
 		break;
@@ -212,7 +218,7 @@ static liBackendCallbacks scgi_backend_cbs = {
 };
 
 
-static scgi_context* scgi_context_new(liServer *srv, GString *dest_socket) {
+static scgi_context* scgi_context_new(liServer *srv, GString *dest_socket, const liBackendHealthOptions *health) {
 	liSocketAddress saddr;
 	scgi_context* ctx;
 	liBackendConfig *config;
@@ -233,6 +239,9 @@ static scgi_context* scgi_context_new(liServer *srv, GString *dest_socket) {
 	config->disable_time = 0;
 	config->max_requests = 1;
 	config->watch_for_close = TRUE;
+	config->max_fails = health->max_fails;
+	config->check_interval = health->check_interval; /* connect only */
+	config->slow_start = health->slow_start;
 
 	ctx = g_slice_new0(scgi_context);
 	ctx->refcount = 1;
@@ -261,6 +270,7 @@ static void scgi_context_acquire(scgi_context *ctx) {
 static void scgi_io_cb(liIOStream *stream, liIOStreamEvent event) {
 	scgi_connection *con = stream->data;
 	liWorker *wrk = li_worker_from_iostream(stream);
+	int fd = li_event_io_fd(&stream->io_watcher);
 
 	li_stream_simple_socket_io_cb_with_context(stream, event, &con->simple_socket_data);
 
@@ -272,11 +282,22 @@ static void scgi_io_cb(liIOStream *stream, liIOStreamEvent event) {
 		li_backend_put(wrk, con->ctx->pool, con->bcon, TRUE);
 		con->bcon = NULL;
 
+		/* requests aborted by the client before the backend answered don't count at all */
+		if (NULL != wrk && (con->failed || con->responded)) li_backend_report(wrk, con->ctx->pool, con->failed);
+
 		scgi_context_release(con->ctx);
 		g_slice_free(scgi_connection, con);
 
 		stream->data = NULL;
 		return;
+	case LI_IOSTREAM_READ:
+		if (NULL != stream->stream_in.out && stream->stream_in.out->bytes_in > 0) con->responded = TRUE;
+		if (stream->in_closed && !con->responded) con->failed = TRUE;
+		/* fall through */
+	case LI_IOSTREAM_WRITE:
+		/* the socket got closed with an error */
+		if (-1 != fd && -1 == li_event_io_fd(&stream->io_watcher)) con->failed = TRUE;
+		break;
 	default:
 		break;
 	}
@@ -373,16 +394,49 @@ static void scgi_free(liServer *srv, gpointer param) {
 
 static liAction* scgi_create(liServer *srv, liWorker *wrk, liPlugin* p, liValue *val, gpointer userdata) {
 	scgi_context *ctx;
+	liValue *config = NULL;
+	liBackendHealthOptions health = { 0, 0, 0, NULL };
+	gboolean handled;
 	UNUSED(wrk); UNUSED(userdata); UNUSED(p);
 
 	val = li_value_get_single_argument(val);
 
+	if (li_value_list_has_len(val, 2)) {
+		config = li_value_list_at(val, 1);
+		val = li_value_list_at(val, 0);
+
+		if (NULL == (config = li_value_to_key_value_list(config))) {
+			ERROR(srv, "%s", "scgi expects a hash/key-value list as second parameter");
+			return NULL;
+		}
+	}
+
 	if (LI_VALUE_STRING != li_value_type(val)) {
 		ERROR(srv, "%s", "scgi expects a string as parameter");
 		return FALSE;
 	}
 
-	ctx = scgi_context_new(srv, val->data.string);
+	LI_VALUE_FOREACH(entry, config)
+		liValue *entryKey = li_value_list_at(entry, 0);
+		liValue *entryValue = li_value_list_at(entry, 1);
+		GString *entryKeyStr;
+
+		if (LI_VALUE_STRING != li_value_type(entryKey)) {
+			ERROR(srv, "%s", "scgi doesn't take default keys");
+			return NULL;
+		}
+		entryKeyStr = entryKey->data.string; /* keys are either NONE or STRING */
+
+		if (!li_backend_parse_health_option(srv, "scgi", entryKeyStr, entryValue, &health, &handled)) {
+			return NULL;
+		} else if (!handled || NULL != health.check_path) {
+			/* no http checks: the active check only connects */
+			ERROR(srv, "unknown option for scgi '%s'", entryKeyStr->str);
+			return NULL;
+		}
+	LI_VALUE_END_FOREACH()
+
+	ctx = scgi_context_new(srv, val->data.string, &health);
 	if (NULL == ctx) return NULL;
 
 	return li_action_new_function(scgi_handle, scgi_handle_abort, scgi_free, ctx);
@@ -8,6 +8,7 @@
  */
 
 #include <lighttpd/base.h>
+#include <lighttpd/backends.h>
 #include <lighttpd/collect.h>
 #include <lighttpd/encoding.h>
 
@@ -22,14 +23,28 @@
 LI_API gboolean mod_status_init(liModules *mods, liModule *mod);
 LI_API gboolean mod_status_free(liModules *mods, liModule *mod);
 
-static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_info, GPtrArray *result, guint uptime, liStatistics *totals, guint total_connections, guint *connection_count);
-static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *totals, guint total_connections, guint *connection_count);
+typedef struct mod_status_stat_cache_data mod_status_stat_cache_data;
+
+static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_info, GPtrArray *result, guint uptime, liStatistics *totals, mod_status_stat_cache_data *sc_totals, guint total_connections, guint *connection_count);
+static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *totals, mod_status_stat_cache_data *sc_totals, guint total_connections, guint *connection_count);
 static GString *status_info_auto(liVRequest *vr, guint uptime, liStatistics *totals, guint *connection_count);
 static liHandlerResult status_info_runtime(liVRequest *vr, liPlugin *p);
 static gint str_comp(gconstpointer a, gconstpointer b);
 
 /* auto format constants */
-static gchar liConnectionState_short[LI_CON_STATE_LAST+2] = "_cKqrhwu";
+static gchar liConnectionState_short[LI_CON_STATE_LAST+2] = "_cKqrhwu2";
+
+/* compression level histograms (liStatsCompressEncoding) */
+static const struct {
+	const gchar *name;
+	guint max_level;
+} mod_status_compress_encodings[LI_STATS_COMPRESS_ENCODINGS] = {
+	{ "gzip", 9 }, /* gzip and deflate */
+	{ "bzip2", 9 },
+	{ "br", 11 },
+	{ "zstd", 22 }
+};
+static const guint mod_status_compress_max_level = 22;
 
 /* html snippet constants */
 static const gchar html_header[] =
@@ -154,6 +169,7 @@ static const gchar html_connections_sum[] =
 	"				<th style=\"width: 100px;\">write response</th>\n"
 	"				<th style=\"width: 100px;\">keep-alive</th>\n"
 	"				<th style=\"width: 100px;\">upgraded</th>\n"
+	"				<th style=\"width: 100px;\">http2</th>\n"
 	"			</tr>\n"
 	"			<tr>\n"
 	"				<td>%u</td>\n"
@@ -163,6 +179,7 @@ static const gchar html_connections_sum[] =
 	"				<td>%u</td>\n"
 	"				<td>%u</td>\n"
 	"				<td>%u</td>\n"
+	"				<td>%u</td>\n"
 	"			</tr>\n"
 	"		</table>\n";
 static const gchar html_status_codes[] =
@@ -183,6 +200,28 @@ static const gchar html_status_codes[] =
 	"			</tr>\n"
 	"		</table>\n";
 
+static const gchar html_stat_cache[] =
+	"		<table cellspacing=\"0\">\n"
+	"			<tr>\n"
+	"				<th style=\"width: 100px;\">hits</th>\n"
+	"				<th style=\"width: 100px;\">misses</th>\n"
+	"				<th style=\"width: 100px;\">open file hits</th>\n"
+	"				<th style=\"width: 100px;\">open file misses</th>\n"
+	"				<th style=\"width: 100px;\">content hits</th>\n"
+	"				<th style=\"width: 100px;\">content misses</th>\n"
+	"				<th style=\"width: 100px;\">content size</th>\n"
+	"			</tr>\n"
+	"			<tr>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%" G_GUINT64_FORMAT "</td>\n"
+	"				<td>%s</td>\n"
+	"			</tr>\n"
+	"		</table>\n";
+
 static const gchar html_connections_th[] =
 	"		<table cellspacing=\"0\">\n"
 	"			<tr>\n"
@@ -201,7 +240,7 @@ static const gchar html_connections_th[] =
 static const gchar html_connections_row[] =
 	"			<tr>\n"
 	"				<td class=\"left\"><span>%s</span></td>\n"
-	"				<td><span>%s</span></td>\n"
+	"				<td><span>%s%s</span></td>\n"
 	"				<td><span>%s</span></td>\n"
 	"				<td class=\"left\"><span>%s%s%s</span></td>\n"
 	"				<td><span value=\"%"G_GUINT64_FORMAT"\">%s</span></td>\n"
@@ -340,7 +379,7 @@ struct mod_status_con_data {
 	guint worker_ndx;
 	liConnectionState state;
 	GString *remote_addr_str, *local_addr_str;
-	gboolean is_ssl, keep_alive;
+	gboolean is_ssl, is_ktls, keep_alive;
 	GString *host, *path, *query;
 	liHttpMethod method;
 	goffset request_size;
@@ -353,9 +392,16 @@ struct mod_status_con_data {
 	guint64 bytes_out_5s_diff;
 };
 
+struct mod_status_stat_cache_data {
+	guint64 hits, misses;
+	guint64 file_hits, file_misses;
+	guint64 content_hits, content_misses, content_size;
+};
+
 struct mod_status_wrk_data {
 	guint worker_ndx;
 	liStatistics stats;
+	mod_status_stat_cache_data stat_cache;
 	GArray *connections;
 	guint connection_count[LI_CON_STATE_LAST+1];
 };
@@ -376,6 +422,15 @@ static gpointer status_collect_func(liWorker *wrk, gpointer fdata) {
 
 	sd->stats = wrk->stats;
 	sd->worker_ndx = wrk->ndx;
+	if (NULL != wrk->stat_cache) {
+		sd->stat_cache.hits = wrk->stat_cache->hits;
+		sd->stat_cache.misses = wrk->stat_cache->misses;
+		sd->stat_cache.file_hits = wrk->stat_cache->file_hits;
+		sd->stat_cache.file_misses = wrk->stat_cache->file_misses;
+		sd->stat_cache.content_hits = wrk->stat_cache->content_hits;
+		sd->stat_cache.content_misses = wrk->stat_cache->content_misses;
+		sd->stat_cache.content_size = wrk->stat_cache->content_size;
+	}
 	/* gather connection info */
 	sd->connections = g_array_sized_new(FALSE, TRUE, sizeof(mod_status_con_data), wrk->connections_active);
 	g_array_set_size(sd->connections, wrk->connections_active);
@@ -383,6 +438,7 @@ static gpointer status_collect_func(liWorker *wrk, gpointer fdata) {
 		liConnection *c = g_array_index(wrk->connections, liConnection*, i);
 		mod_status_con_data *cd = &g_array_index(sd->connections, mod_status_con_data, i);
 		cd->is_ssl = c->info.is_ssl;
+		cd->is_ktls = c->info.is_ktls;
 		cd->keep_alive = c->info.keep_alive;
 		cd->remote_addr_str = g_string_new_len(GSTR_LEN(c->info.remote_addr_str));
 		cd->local_addr_str = g_string_new_len(GSTR_LEN(c->info.local_addr_str));
@@ -450,6 +506,7 @@ static void status_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result
 		guint uptime, len;
 		guint total_connections = 0;
 		guint connection_count[LI_CON_STATE_LAST+1] = {0};
+		mod_status_stat_cache_data sc_totals = { 0, 0, 0, 0, 0, 0, 0 };
 
 		liStatistics totals = {
 			G_GUINT64_CONSTANT(0), G_GUINT64_CONSTANT(0), G_GUINT64_CONSTANT(0), G_GUINT64_CONSTANT(0),
@@ -492,6 +549,30 @@ static void status_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result
 			totals.peak.requests += sd->stats.peak.requests;
 			totals.peak.active_cons += sd->stats.peak.active_cons;
 
+			for (j = 0; j < LI_WORKER_NEW_CON_BATCH_BUCKETS; ++j) {
+				totals.new_con_batches[j] += sd->stats.new_con_batches[j];
+			}
+			totals.new_con_batch_max = MAX(totals.new_con_batch_max, sd->stats.new_con_batch_max);
+			totals.new_con_ring_full += sd->stats.new_con_ring_full;
+
+			totals.loop_load += sd->stats.loop_load / result->len;
+			for (j = 0; j < LI_STATS_COMPRESS_ENCODINGS; ++j) {
+				guint k;
+				for (k = 0; k < LI_STATS_COMPRESS_LEVELS; ++k) {
+					totals.compress_levels[j][k] += sd->stats.compress_levels[j][k];
+				}
+			}
+			totals.compress_skipped += sd->stats.compress_skipped;
+			totals.write_syscalls += sd->stats.write_syscalls;
+
+			sc_totals.hits += sd->stat_cache.hits;
+			sc_totals.misses += sd->stat_cache.misses;
+			sc_totals.file_hits += sd->stat_cache.file_hits;
+			sc_totals.file_misses += sd->stat_cache.file_misses;
+			sc_totals.content_hits += sd->stat_cache.content_hits;
+			sc_totals.content_misses += sd->stat_cache.content_misses;
+			sc_totals.content_size += sd->stat_cache.content_size;
+
 			for (j = 0; j <= LI_CON_STATE_LAST; ++j) {
 				connection_count[j] += sd->connection_count[j];
 			}
@@ -499,13 +580,13 @@ static void status_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result
 
 		if (li_querystring_find(vr->request.uri.query, CONST_STR_LEN("format"), &val, &len) && strncmp(val, "plain", len) == 0) {
 			/* show plain text page */
-			html = status_info_plain(vr, uptime, &totals, total_connections, &connection_count[0]);
+			html = status_info_plain(vr, uptime, &totals, &sc_totals, total_connections, &connection_count[0]);
 		} else if (li_strncase_equal(vr->request.uri.query, CONST_STR_LEN("auto"))) {
 			/* show auto text page */
 			html = status_info_auto(vr, uptime, &totals, &connection_count[0]);
 		} else {
 			/* show full html page */
-			html = status_info_full(vr, p, short_info, result, uptime, &totals, total_connections, &connection_count[0]);
+			html = status_info_full(vr, p, short_info, result, uptime, &totals, &sc_totals, total_connections, &connection_count[0]);
 		}
 
 		LI_FORCE_ASSERT(li_vrequest_handle_direct(vr));
@@ -533,7 +614,7 @@ static void status_collect_cb(gpointer cbdata, gpointer fdata, GPtrArray *result
 	}
 }
 
-static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_info, GPtrArray *result, guint uptime, liStatistics *totals, guint total_connections, guint *connection_count) {
+static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_info, GPtrArray *result, guint uptime, liStatistics *totals, mod_status_stat_cache_data *sc_totals, guint total_connections, guint *connection_count) {
 	GString *html, *css, *count_req, *count_bin, *count_bout, *count_mem, *tmpstr;
 	gchar *val;
 	guint i, j, len;
@@ -719,7 +800,8 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 		connection_count[LI_CON_STATE_DEAD] + connection_count[LI_CON_STATE_CLOSE],
 		connection_count[LI_CON_STATE_REQUEST_START], connection_count[LI_CON_STATE_READ_REQUEST_HEADER],
 		connection_count[LI_CON_STATE_HANDLE_MAINVR], connection_count[LI_CON_STATE_WRITE],
-		connection_count[LI_CON_STATE_KEEP_ALIVE], connection_count[LI_CON_STATE_UPGRADED]
+		connection_count[LI_CON_STATE_KEEP_ALIVE], connection_count[LI_CON_STATE_UPGRADED],
+		connection_count[LI_CON_STATE_HTTP2]
 	);
 
 	/* response status codes */
@@ -728,6 +810,121 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 		mod_status_response_codes[2], mod_status_response_codes[3], mod_status_response_codes[4]
 	);
 
+	/* stat cache */
+	g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Stat cache</strong> (sum)</div>\n"));
+	li_counter_format(sc_totals->content_size, COUNTER_BYTES, tmpstr);
+	g_string_append_printf(html, html_stat_cache, sc_totals->hits, sc_totals->misses,
+		sc_totals->file_hits, sc_totals->file_misses,
+		sc_totals->content_hits, sc_totals->content_misses, tmpstr->str
+	);
+
+	/* event loop load */
+	g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Event loop load</strong></div>\n"));
+	g_string_append_len(html, CONST_STR_LEN("		<table cellspacing=\"0\">\n			<tr>\n"));
+	for (i = 0; i < result->len; i++) {
+		g_string_append_printf(html, "				<th style=\"width: 100px;\">Worker #%u</th>\n", i+1);
+	}
+	g_string_append_len(html, CONST_STR_LEN("				<th style=\"width: 100px;\">Average</th>\n			</tr>\n			<tr>\n"));
+	for (i = 0; i < result->len; i++) {
+		mod_status_wrk_data *sd = g_ptr_array_index(result, i);
+		g_string_append_printf(html, "				<td>%.0f%%</td>\n", sd->stats.loop_load * 100);
+	}
+	g_string_append_printf(html, "				<td>%.0f%%</td>\n			</tr>\n		</table>\n", totals->loop_load * 100);
+
+	/* write syscalls per request */
+	g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Write syscalls per request</strong></div>\n"));
+	g_string_append_len(html, CONST_STR_LEN("		<table cellspacing=\"0\">\n			<tr>\n"));
+	for (i = 0; i < result->len; i++) {
+		g_string_append_printf(html, "				<th style=\"width: 100px;\">Worker #%u</th>\n", i+1);
+	}
+	g_string_append_len(html, CONST_STR_LEN("				<th style=\"width: 100px;\">Total</th>\n			</tr>\n			<tr>\n"));
+	for (i = 0; i < result->len; i++) {
+		mod_status_wrk_data *sd = g_ptr_array_index(result, i);
+		g_string_append_printf(html, "				<td>%.2f</td>\n",
+			sd->stats.requests > 0 ? (gdouble) sd->stats.write_syscalls / sd->stats.requests : 0.0);
+	}
+	g_string_append_printf(html, "				<td>%.2f</td>\n			</tr>\n		</table>\n",
+		totals->requests > 0 ? (gdouble) totals->write_syscalls / totals->requests : 0.0);
+
+	/* compression levels */
+	g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Compression levels</strong> (sum)</div>\n"));
+	g_string_append_len(html, CONST_STR_LEN("		<table cellspacing=\"0\">\n			<tr>\n				<th style=\"width: 100px;\"></th>\n"));
+	for (i = 0; i <= mod_status_compress_max_level; i++) {
+		g_string_append_printf(html, "				<th style=\"width: 40px;\">%u</th>\n", i);
+	}
+	g_string_append_len(html, CONST_STR_LEN("			</tr>\n"));
+	for (j = 0; j < LI_STATS_COMPRESS_ENCODINGS; j++) {
+		g_string_append_printf(html, "			<tr>\n				<td>%s</td>\n", mod_status_compress_encodings[j].name);
+		for (i = 0; i <= mod_status_compress_max_level; i++) {
+			if (i > mod_status_compress_encodings[j].max_level) {
+				g_string_append_len(html, CONST_STR_LEN("				<td></td>\n"));
+			} else {
+				g_string_append_printf(html, "				<td>%" G_GUINT64_FORMAT "</td>\n", totals->compress_levels[j][i]);
+			}
+		}
+		g_string_append_len(html, CONST_STR_LEN("			</tr>\n"));
+	}
+	g_string_append_printf(html, "		</table>\n		<table cellspacing=\"0\">\n			<tr>\n				<th style=\"width: 100px;\">skipped (load)</th>\n			</tr>\n			<tr>\n				<td>%" G_GUINT64_FORMAT "</td>\n			</tr>\n		</table>\n", totals->compress_skipped);
+
+	/* backend pools (mod_proxy, mod_fastcgi) */
+	{
+		GArray *backends = li_backend_pools_stats(vr->wrk->srv);
+
+		if (backends->len > 0) {
+			g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>Backends</strong></div>\n"));
+			g_string_append_len(html, CONST_STR_LEN("		<table cellspacing=\"0\">\n			<tr>\n"
+				"				<th style=\"width: 200px;\">Backend</th>\n"
+				"				<th style=\"width: 100px;\">Active</th>\n"
+				"				<th style=\"width: 100px;\">Idle</th>\n"
+				"				<th style=\"width: 100px;\">Requests</th>\n"
+				"				<th style=\"width: 100px;\">Reused</th>\n"
+				"				<th style=\"width: 100px;\">Health</th>\n"
+				"				<th style=\"width: 100px;\">Failures</th>\n"
+				"				<th style=\"width: 100px;\">Ejected</th>\n"
+				"			</tr>\n"));
+			for (i = 0; i < backends->len; i++) {
+				liBackendPoolStats *ps = &g_array_index(backends, liBackendPoolStats, i);
+				g_string_append_len(html, CONST_STR_LEN("			<tr>\n				<td>"));
+				li_string_encode_append(ps->address->str, html, LI_ENCODING_HTML);
+				g_string_append_printf(html, "</td>\n				<td>%u</td>\n				<td>%u</td>\n"
+					"				<td>%" G_GUINT64_FORMAT "</td>\n				<td>%" G_GUINT64_FORMAT " (%.0f%%)</td>\n"
+					"				<td>%s</td>\n				<td>%u</td>\n				<td>%" G_GUINT64_FORMAT "</td>\n			</tr>\n",
+					ps->active, ps->idle, ps->requests, ps->reused,
+					ps->requests > 0 ? (ps->reused * 100.0) / ps->requests : 0.0,
+					li_backend_health_string(ps->health), ps->fails, ps->ejections);
+			}
+			g_string_append_len(html, CONST_STR_LEN("		</table>\n"));
+		}
+
+		li_backend_pools_stats_free(backends);
+	}
+
+	/* tls listeners: handshakes and session resumption (session cache or tickets) */
+	{
+		GArray *listeners = li_server_sockets_tls_stats(vr->wrk->srv);
+
+		if (listeners->len > 0) {
+			g_string_append_len(html, CONST_STR_LEN("<div class=\"title\"><strong>TLS listeners</strong></div>\n"));
+			g_string_append_len(html, CONST_STR_LEN("		<table cellspacing=\"0\">\n			<tr>\n"
+				"				<th style=\"width: 200px;\">Address</th>\n"
+				"				<th style=\"width: 100px;\">Handshakes</th>\n"
+				"				<th style=\"width: 100px;\">Resumed</th>\n"
+				"			</tr>\n"));
+			for (i = 0; i < listeners->len; i++) {
+				liServerSocketTLSStats *ls = &g_array_index(listeners, liServerSocketTLSStats, i);
+				g_string_append_len(html, CONST_STR_LEN("			<tr>\n				<td>"));
+				li_string_encode_append(ls->address->str, html, LI_ENCODING_HTML);
+				g_string_append_printf(html, "</td>\n				<td>%" G_GUINT64_FORMAT "</td>\n"
+					"				<td>%" G_GUINT64_FORMAT " (%.0f%%)</td>\n			</tr>\n",
+					ls->handshakes, ls->resumed,
+					ls->handshakes > 0 ? (ls->resumed * 100.0) / ls->handshakes : 0.0);
+			}
+			g_string_append_len(html, CONST_STR_LEN("		</table>\n"));
+		}
+
+		li_server_sockets_tls_stats_free(listeners);
+	}
+
 
 	/* list connections */
 	if (!short_info) {
@@ -762,7 +959,7 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 
 				g_string_append_printf(html, html_connections_row,
 					cd->remote_addr_str->str,
-					li_connection_state_str(cd->state),
+					li_connection_state_str(cd->state), cd->is_ktls ? " (kTLS)" : "",
 					cd->host->str,
 					cd->path->str,
 					cd->query->len ? "?":"",
@@ -807,8 +1004,9 @@ static GString *status_info_full(liVRequest *vr, liPlugin *p, gboolean short_inf
 	return html;
 }
 
-static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *totals, guint total_connections, guint *connection_count) {
+static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *totals, mod_status_stat_cache_data *sc_totals, guint total_connections, guint *connection_count) {
 	GString *html;
+	guint i, j;
 
 	html = g_string_sized_new(1024 - 1);
 
@@ -856,6 +1054,8 @@ static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *to
 	li_string_append_int(html, connection_count[LI_CON_STATE_KEEP_ALIVE]);
 	g_string_append_len(html, CONST_STR_LEN("\nconnection_state_upgraded: "));
 	li_string_append_int(html, connection_count[LI_CON_STATE_UPGRADED]);
+	g_string_append_len(html, CONST_STR_LEN("\nconnection_state_http2: "));
+	li_string_append_int(html, connection_count[LI_CON_STATE_HTTP2]);
 	/* status cpdes */
 	g_string_append_len(html, CONST_STR_LEN("\n\n# Status Codes (since start)\nstatus_1xx: "));
 	li_string_append_int(html, mod_status_response_codes[0]);
@@ -867,6 +1067,109 @@ static GString *status_info_plain(liVRequest *vr, guint uptime, liStatistics *to
 	li_string_append_int(html, mod_status_response_codes[3]);
 	g_string_append_len(html, CONST_STR_LEN("\nstatus_5xx: "));
 	li_string_append_int(html, mod_status_response_codes[4]);
+	/* hand-off of accepted connections to other workers: batches are counted per power of two */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Accept Hand-off (since start)"));
+	for (i = 0; i < LI_WORKER_NEW_CON_BATCH_BUCKETS; i++) {
+		g_string_append_len(html, CONST_STR_LEN("\naccept_batch_"));
+		li_string_append_int(html, 1 << i);
+		g_string_append_len(html, CONST_STR_LEN(": "));
+		li_string_append_int(html, totals->new_con_batches[i]);
+	}
+	g_string_append_len(html, CONST_STR_LEN("\naccept_batch_max: "));
+	li_string_append_int(html, totals->new_con_batch_max);
+	g_string_append_len(html, CONST_STR_LEN("\naccept_ring_full: "));
+	li_string_append_int(html, totals->new_con_ring_full);
+	/* stat cache */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Stat Cache (since start)\nstat_cache_hits: "));
+	li_string_append_int(html, sc_totals->hits);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_misses: "));
+	li_string_append_int(html, sc_totals->misses);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_file_hits: "));
+	li_string_append_int(html, sc_totals->file_hits);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_file_misses: "));
+	li_string_append_int(html, sc_totals->file_misses);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_content_hits: "));
+	li_string_append_int(html, sc_totals->content_hits);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_content_misses: "));
+	li_string_append_int(html, sc_totals->content_misses);
+	g_string_append_len(html, CONST_STR_LEN("\nstat_cache_content_size: "));
+	li_string_append_int(html, sc_totals->content_size);
+	/* event loop load in percent, average over all workers */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Worker Load\nloop_load: "));
+	li_string_append_int(html, (gint64) (totals->loop_load * 100 + 0.5));
+	/* syscalls needed to write to sockets (clients and backends) */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Network (since start)\nwrite_syscalls: "));
+	li_string_append_int(html, totals->write_syscalls);
+	g_string_append_printf(html, "\nwrite_syscalls_per_request: %.2f",
+		totals->requests > 0 ? (gdouble) totals->write_syscalls / totals->requests : 0.0);
+	/* compressed responses per encoding (library) and compression level */
+	g_string_append_len(html, CONST_STR_LEN("\n\n# Compression (since start)"));
+	for (j = 0; j < LI_STATS_COMPRESS_ENCODINGS; j++) {
+		for (i = 0; i <= mod_status_compress_encodings[j].max_level; i++) {
+			g_string_append_len(html, CONST_STR_LEN("\ncompress_level_"));
+			g_string_append(html, mod_status_compress_encodings[j].name);
+			g_string_append_c(html, '_');
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN(": "));
+			li_string_append_int(html, totals->compress_levels[j][i]);
+		}
+	}
+	g_string_append_len(html, CONST_STR_LEN("\ncompress_skipped: "));
+	li_string_append_int(html, totals->compress_skipped);
+	/* backend pools: connections handed out to requests, and how many of them were reused (keep-alive) */
+	{
+		GArray *backends = li_backend_pools_stats(vr->wrk->srv);
+
+		if (backends->len > 0) g_string_append_len(html, CONST_STR_LEN("\n\n# Backends (since start)"));
+		for (i = 0; i < backends->len; i++) {
+			liBackendPoolStats *ps = &g_array_index(backends, liBackendPoolStats, i);
+			g_string_append_len(html, CONST_STR_LEN("\nbackend_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_address: "));
+			g_string_append_len(html, GSTR_LEN(ps->address));
+			g_string_append_len(html, CONST_STR_LEN("\nbackend_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_requests: "));
+			li_string_append_int(html, ps->requests);
+			g_string_append_len(html, CONST_STR_LEN("\nbackend_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_reused: "));
+			li_string_append_int(html, ps->reused);
+			g_string_append_len(html, CONST_STR_LEN("\nbackend_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_health: "));
+			g_string_append(html, li_backend_health_string(ps->health));
+			g_string_append_len(html, CONST_STR_LEN("\nbackend_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_ejections: "));
+			li_string_append_int(html, ps->ejections);
+		}
+
+		li_backend_pools_stats_free(backends);
+	}
+	/* tls listeners: handshakes and how many of them resumed a session */
+	{
+		GArray *listeners = li_server_sockets_tls_stats(vr->wrk->srv);
+
+		if (listeners->len > 0) g_string_append_len(html, CONST_STR_LEN("\n\n# TLS listeners (since start)"));
+		for (i = 0; i < listeners->len; i++) {
+			liServerSocketTLSStats *ls = &g_array_index(listeners, liServerSocketTLSStats, i);
+			g_string_append_len(html, CONST_STR_LEN("\ntls_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_address: "));
+			g_string_append_len(html, GSTR_LEN(ls->address));
+			g_string_append_len(html, CONST_STR_LEN("\ntls_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_handshakes: "));
+			li_string_append_int(html, ls->handshakes);
+			g_string_append_len(html, CONST_STR_LEN("\ntls_"));
+			li_string_append_int(html, i);
+			g_string_append_len(html, CONST_STR_LEN("_resumed: "));
+			li_string_append_int(html, ls->resumed);
+		}
+
+		li_server_sockets_tls_stats_free(listeners);
+	}
 
 	li_http_header_overwrite(vr->response.headers, CONST_STR_LEN("Content-Type"), CONST_STR_LEN("text/plain"));
 
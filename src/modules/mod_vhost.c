@@ -22,16 +22,11 @@ struct vhost_map_data {
 	liValue *default_action;
 };
 
-typedef struct vhost_map_regex_entry vhost_map_regex_entry;
-struct vhost_map_regex_entry {
-	GRegex *regex;
-	liValue *action;
-};
-
 typedef struct vhost_map_regex_data vhost_map_regex_data;
 struct vhost_map_regex_data {
 	liPlugin *plugin;
-	GArray *list; /* array of vhost_map_regex_entry */
+	liRegexSet *regexes;
+	GPtrArray *actions; /* (liValue*) action for the n-th regex */
 	liValue *default_action;
 };
 
@@ -135,28 +130,24 @@ static liAction* vhost_map_create(liServer *srv, liWorker *wrk, liPlugin* p, liV
 static liHandlerResult vhost_map_regex(liVRequest *vr, gpointer param, gpointer *context) {
 	guint i;
 	vhost_map_regex_data *mrd = param;
-	GArray *list = mrd->list;
 	gboolean debug = _OPTION(vr, mrd->plugin, 0).boolean;
-	liValue *v = NULL;
-	vhost_map_regex_entry *entry = NULL;
+	GError *err = NULL;
 
 	UNUSED(context);
 
-	/* loop through all rules to find a match */
-	for (i = 0; i < list->len; i++) {
-		entry = &g_array_index(list, vhost_map_regex_entry, i);
-
-		if (!g_regex_match(entry->regex, vr->request.uri.host->str, 0, NULL))
-			continue;
-
-		v = entry->action;
-
-		break;
+	/* all rules in one pass, the first matching one wins */
+	i = li_regex_set_match(mrd->regexes, GSTR_LEN(vr->request.uri.host), NULL, &err);
+	if (NULL != err) {
+		VR_ERROR(vr, "vhost_map_regex: matching host %s failed: %s", vr->request.uri.host->str, err->message);
+		g_error_free(err);
+		return LI_HANDLER_ERROR;
 	}
 
-	if (NULL != v) {
+	if (G_MAXUINT != i) {
+		liValue *v = g_ptr_array_index(mrd->actions, i);
+
 		if (debug) {
-			VR_DEBUG(vr, "vhost_map_regex: host %s matches pattern \"%s\"", vr->request.uri.host->str, g_regex_get_pattern(entry->regex));
+			VR_DEBUG(vr, "vhost_map_regex: host %s matches pattern \"%s\"", vr->request.uri.host->str, li_regex_get_pattern(li_regex_set_get(mrd->regexes, i)));
 		}
 		li_action_enter(vr, v->data.val_action.action);
 	} else if (NULL != mrd->default_action) {
@@ -176,16 +167,13 @@ static liHandlerResult vhost_map_regex(liVRequest *vr, gpointer param, gpointer
 static void vhost_map_regex_free(liServer *srv, gpointer param) {
 	guint i;
 	vhost_map_regex_data *mrd = param;
-	GArray *list = mrd->list;
 	UNUSED(srv);
 
-	for (i = 0; i < list->len; i++) {
-		vhost_map_regex_entry *entry = &g_array_index(list, vhost_map_regex_entry, i);
-
-		g_regex_unref(entry->regex);
-		li_value_free(entry->action);
+	li_regex_set_free(mrd->regexes);
+	for (i = 0; i < mrd->actions->len; i++) {
+		li_value_free(g_ptr_array_index(mrd->actions, i));
 	}
-	g_array_free(list, TRUE);
+	g_ptr_array_free(mrd->actions, TRUE);
 
 	if (NULL != mrd->default_action) {
 		li_value_free(mrd->default_action);
@@ -207,7 +195,8 @@ static liAction* vhost_map_regex_create(liServer *srv, liWorker *wrk, liPlugin*
 
 	mrd = g_slice_new0(vhost_map_regex_data);
 	mrd->plugin = p;
-	mrd->list = g_array_new(FALSE, FALSE, sizeof(vhost_map_regex_entry));
+	mrd->regexes = li_regex_set_new();
+	mrd->actions = g_ptr_array_new();
 
 	LI_VALUE_FOREACH(entry, val)
 		liValue *entryKey = li_value_list_at(entry, 0);
@@ -216,7 +205,7 @@ static liAction* vhost_map_regex_create(liServer *srv, liWorker *wrk, liPlugin*
 
 		if (LI_VALUE_ACTION != li_value_type(entryValue)) {
 			ERROR(srv, "vhost.map_regex expects a hashtable/key-value list with action values as parameter, %s value given", li_value_type_string(entryValue));
-			vhost_map_free(srv, mrd);
+			vhost_map_regex_free(srv, mrd);
 			return NULL;
 		}
 
@@ -232,32 +221,33 @@ static liAction* vhost_map_regex_create(liServer *srv, liWorker *wrk, liPlugin*
 		if (NULL == entryKeyStr) {
 			if (NULL != mrd->default_action) {
 				ERROR(srv, "%s", "vhost.map_regex: already have a default action");
-				vhost_map_free(srv, mrd);
+				vhost_map_regex_free(srv, mrd);
 				return NULL;
 			}
 			mrd->default_action = li_value_extract(entryValue);
 		} else {
 			GError *err = NULL;
-			vhost_map_regex_entry map_entry;
+			liRegex *regex;
 
-			map_entry.regex = g_regex_new(entryKeyStr->str, G_REGEX_RAW | G_REGEX_OPTIMIZE, 0, &err);
-			g_string_free(entryKeyStr, TRUE);
+			regex = li_regex_new(entryKeyStr->str, &err);
 
-			if (NULL == map_entry.regex) {
+			if (NULL == regex) {
 				LI_FORCE_ASSERT(NULL != err);
 				vhost_map_regex_free(srv, mrd);
 				ERROR(srv, "vhost.map_regex: error compiling regex \"%s\": %s", entryKeyStr->str, err->message);
 				g_error_free(err);
+				g_string_free(entryKeyStr, TRUE);
 				return NULL;
 			}
-			LI_FORCE_ASSERT(NULL == err);
-
-			map_entry.action = li_value_extract(entryValue);
+			g_string_free(entryKeyStr, TRUE);
 
-			g_array_append_val(mrd->list, map_entry);
+			li_regex_set_add(mrd->regexes, regex);
+			g_ptr_array_add(mrd->actions, li_value_extract(entryValue));
 		}
 	LI_VALUE_END_FOREACH()
 
+	li_regex_set_compile(mrd->regexes);
+
 	return li_action_new_function(vhost_map_regex, NULL, vhost_map_regex_free, mrd);
 }
 
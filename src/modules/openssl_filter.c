@@ -1,10 +1,26 @@
-
 #include "openssl_filter.h"
 
 #include <openssl/bio.h>
 #include <openssl/err.h>
 #include <openssl/rand.h>
 
+#ifdef USE_OPENSSL_KTLS
+# include <linux/tls.h>
+# include <netinet/tcp.h>
+# ifndef SOL_TLS
+#  define SOL_TLS 282
+# endif
+# ifndef TCP_ULP
+#  define TCP_ULP 31
+# endif
+/* BIO controls OpenSSL 3.x uses to hand the record layer to a BIO (BIO_set_ktls(), BIO_set_ktls_ctrl_msg()
+ * and BIO_clear_ktls_ctrl_msg() in its internal bio.h); openssl_filter.h only enables kTLS for those releases
+ */
+# define LI_BIO_CTRL_SET_KTLS                   72
+# define LI_BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG  74
+# define LI_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG     75
+#endif
+
 
 struct liOpenSSLFilter {
 	int refcount;
@@ -28,10 +44,152 @@ struct liOpenSSLFilter {
 	unsigned int client_initiated_renegotiation:1;
 	unsigned int closing:1, aborted:1;
 	unsigned int write_wants_read:1;
+	unsigned int ktls_send:1; /* kernel encrypts outgoing records, crypt_source gets plain data */
+
+#ifdef USE_OPENSSL_KTLS
+	unsigned int ktls_rekey:1; /* sent a TLS 1.3 KeyUpdate, OpenSSL has to pass the new send key */
+	int ktls_fd; /* socket behind crypt_source.dest, -1: kTLS not wanted */
+	int ktls_ctrl_msg; /* record type for the next BIO write, 0: application data */
+	GQueue ktls_ops; /* f_ktls_op waiting for the data queued in front of them; plain data waits too */
+#endif
 };
 
 #define BIO_TYPE_LI_STREAM (127|BIO_TYPE_SOURCE_SINK)
 
+#ifdef USE_OPENSSL_KTLS
+/* socket operations which have to wait until the socket stream wrote the data queued before them */
+typedef struct f_ktls_op f_ktls_op;
+struct f_ktls_op {
+	int record_type; /* 0: set the send key */
+	GByteArray *data; /* record content, or the struct tls12_crypto_info_* for TLS_TX */
+};
+
+static void f_ktls_op_free(f_ktls_op *op) {
+	OPENSSL_cleanse(op->data->data, op->data->len);
+	g_byte_array_free(op->data, TRUE);
+	g_slice_free(f_ktls_op, op);
+}
+
+static void f_ktls_queue(liOpenSSLFilter *f, int record_type, const void *data, gsize len) {
+	f_ktls_op *op = g_slice_new(f_ktls_op);
+	op->record_type = record_type;
+	op->data = g_byte_array_sized_new(len);
+	g_byte_array_append(op->data, data, len);
+	g_queue_push_tail(&f->ktls_ops, op);
+
+	/* the socket stream calls li_openssl_filter_ktls_flush once it wrote the queued data */
+	li_stream_notify_later(&f->crypt_source);
+}
+
+/* whether everything written so far reached the socket */
+static gboolean f_ktls_socket_idle(liOpenSSLFilter *f) {
+	liStream *io_out = f->crypt_source.dest;
+
+	if (0 != f->ktls_ops.length) return FALSE;
+	if (NULL != f->crypt_source.out && 0 != f->crypt_source.out->length) return FALSE;
+	if (NULL != io_out && NULL != io_out->out && 0 != io_out->out->length) return FALSE;
+	return TRUE;
+}
+
+/* sends a record of the given type; the kernel encrypts it with the current send key */
+static ssize_t f_ktls_sendmsg(int fd, int record_type, const void *buf, gsize len) {
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cbuf[CMSG_SPACE(sizeof(unsigned char))];
+	ssize_t r;
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_TLS;
+	cmsg->cmsg_type = TLS_SET_RECORD_TYPE;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(unsigned char));
+	*((unsigned char*) CMSG_DATA(cmsg)) = record_type;
+	msg.msg_controllen = cmsg->cmsg_len;
+
+	iov.iov_base = (void*) buf;
+	iov.iov_len = len;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+
+	while (-1 == (r = sendmsg(fd, &msg, MSG_NOSIGNAL)) && EINTR == errno) { }
+	return r;
+}
+
+/* size of the struct tls12_crypto_info_* for the version and cipher; 0 if unknown */
+static socklen_t f_ktls_crypto_info_size(const struct tls_crypto_info *info) {
+	if (TLS_1_2_VERSION != info->version
+#ifdef TLS_1_3_VERSION
+	    && TLS_1_3_VERSION != info->version
+#endif
+	) return 0;
+
+	switch (info->cipher_type) {
+	case TLS_CIPHER_AES_GCM_128:
+		return sizeof(struct tls12_crypto_info_aes_gcm_128);
+#ifdef TLS_CIPHER_AES_GCM_256
+	case TLS_CIPHER_AES_GCM_256:
+		return sizeof(struct tls12_crypto_info_aes_gcm_256);
+#endif
+#ifdef TLS_CIPHER_AES_CCM_128
+	case TLS_CIPHER_AES_CCM_128:
+		return sizeof(struct tls12_crypto_info_aes_ccm_128);
+#endif
+#ifdef TLS_CIPHER_CHACHA20_POLY1305
+	case TLS_CIPHER_CHACHA20_POLY1305:
+		return sizeof(struct tls12_crypto_info_chacha20_poly1305);
+#endif
+	default:
+		return 0;
+	}
+}
+
+/* OpenSSL passes its ktls_crypto_info_t: on linux a union of the struct tls12_crypto_info_* it supports
+ * (followed by the length). they all start with struct tls_crypto_info, which tells which one it is.
+ * the key is set once the records encrypted by openssl so far (or with the previous key) are sent.
+ */
+static gboolean f_ktls_set_send_key(liOpenSSLFilter *f, const void *ptr) {
+	const struct tls_crypto_info *info = ptr;
+	socklen_t len = f_ktls_crypto_info_size(info);
+
+	if (0 == len) return FALSE;
+
+	if (!f->ktls_send) {
+		/* attaching the tls ULP doesn't change what is sent yet */
+		if (-1 == setsockopt(f->ktls_fd, SOL_TCP, TCP_ULP, "tls", sizeof("tls")) && EEXIST != errno) {
+			_DEBUG(f->srv, f->wrk, f->log_context, "kTLS not available: setsockopt(TCP_ULP) failed: %s", g_strerror(errno));
+			return FALSE;
+		}
+	}
+
+	f_ktls_queue(f, 0, info, len);
+	f->ktls_send = 1;
+	f->ktls_rekey = 0;
+
+	return TRUE;
+}
+
+/* records OpenSSL writes with kTLS: alerts, handshake messages (session tickets, KeyUpdate) */
+static int f_ktls_write_record(liOpenSSLFilter *f, int record_type, const char *buf, int len) {
+	ssize_t r = 0;
+
+	if (f_ktls_socket_idle(f)) {
+		if (-1 == (r = f_ktls_sendmsg(f->ktls_fd, record_type, buf, len))) {
+			if (EAGAIN != errno && EWOULDBLOCK != errno) return -1;
+			r = 0;
+		}
+	}
+
+	/* handshake messages can continue in the next record; alerts are too small to get split */
+	if (r < len) f_ktls_queue(f, record_type, buf + r, len - r);
+
+	errno = 0;
+	return len;
+}
+#endif
+
 #if OPENSSL_VERSION_NUMBER < 0x10100000L || defined(LIBRESSL_VERSION_NUMBER)
 
 static int stream_bio_write(BIO *bio, const char *buf, int len) {
@@ -147,6 +305,11 @@ static int stream_bio_write(BIO *bio, const char *buf, int len) {
 	cq = f->crypt_source.out;
 	if (cq->is_closed) return -1;
 
+#ifdef USE_OPENSSL_KTLS
+	if (0 != f->ktls_ctrl_msg) return f_ktls_write_record(f, f->ktls_ctrl_msg, buf, len);
+	if (0 != f->ktls_ops.length) return f_ktls_write_record(f, SSL3_RT_APPLICATION_DATA, buf, len);
+#endif
+
 	li_chunkqueue_append_mem(cq, buf, len);
 	li_stream_notify_later(&f->crypt_source);
 
@@ -199,6 +362,22 @@ static long stream_bio_ctrl(BIO *bio, int cmd, long num, void *ptr) {
 	case BIO_CTRL_PENDING:
 		if (NULL == f || NULL == f->crypt_drain.out) return 0;
 		return f->crypt_drain.out->length;
+#ifdef USE_OPENSSL_KTLS
+	case LI_BIO_CTRL_SET_KTLS:
+		/* only for sending: incoming records were already read (ahead) into crypt_drain */
+		if (NULL == f || 0 == num || -1 == f->ktls_fd || NULL == ptr) return 0;
+		return f_ktls_set_send_key(f, ptr) ? 1 : 0;
+	case BIO_CTRL_GET_KTLS_SEND:
+		return (NULL != f && f->ktls_send) ? 1 : 0;
+	case LI_BIO_CTRL_SET_KTLS_TX_SEND_CTRL_MSG:
+		if (NULL == f) return 0;
+		f->ktls_ctrl_msg = num;
+		return 1;
+	case LI_BIO_CTRL_CLEAR_KTLS_TX_CTRL_MSG:
+		if (NULL == f) return 0;
+		f->ktls_ctrl_msg = 0;
+		return 1;
+#endif
 	default:
 		return 0;
 	}
@@ -294,6 +473,12 @@ static void f_release(liOpenSSLFilter *f) {
 			li_buffer_release(f->raw_in_buffer);
 			f->raw_in_buffer = NULL;
 		}
+#ifdef USE_OPENSSL_KTLS
+		{
+			f_ktls_op *op;
+			while (NULL != (op = g_queue_pop_head(&f->ktls_ops))) f_ktls_op_free(op);
+		}
+#endif
 
 		g_slice_free(liOpenSSLFilter, f);
 	}
@@ -384,6 +569,40 @@ static void do_handle_error(liOpenSSLFilter *f, const char *sslfunc, int r, gboo
 
 }
 
+/* with kTLS the close_notify alert has to wait for the queued data; skip it if the socket isn't done yet */
+static void f_ktls_prepare_shutdown(liOpenSSLFilter *f) {
+#ifdef USE_OPENSSL_KTLS
+	if (f->ktls_send && !f_ktls_socket_idle(f)) SSL_set_quiet_shutdown(f->ssl, 1);
+#else
+	UNUSED(f);
+#endif
+}
+
+/* plain data waits for the records and key changes queued for the socket */
+static gboolean f_ktls_holding(liOpenSSLFilter *f) {
+#ifdef USE_OPENSSL_KTLS
+	return 0 != f->ktls_ops.length;
+#else
+	UNUSED(f);
+	return FALSE;
+#endif
+}
+
+/* after a TLS 1.3 KeyUpdate OpenSSL encrypts with a new key; if it didn't pass that key
+ * the kernel would continue with the old one */
+static gboolean f_ktls_check_rekey(liOpenSSLFilter *f) {
+#ifdef USE_OPENSSL_KTLS
+	if (f->ktls_rekey) {
+		_ERROR(f->srv, f->wrk, f->log_context, "%s", "kTLS: no new send key after TLS 1.3 KeyUpdate, closing connection");
+		f_abort_ssl(f);
+		return FALSE;
+	}
+#else
+	UNUSED(f);
+#endif
+	return TRUE;
+}
+
 static gboolean do_ssl_handshake(liOpenSSLFilter *f, gboolean writing) {
 	int r = SSL_do_handshake(f->ssl);
 	if (1 == r) {
@@ -455,11 +674,13 @@ static void do_ssl_read(liOpenSSLFilter *f) {
 			f_abort_ssl(f);
 			goto out;
 		}
+		if (!f_ktls_check_rekey(f)) goto out;
 		if (r < 0) {
 			do_handle_error(f, "SSL_read", r, FALSE);
 			goto out;
 		} else if (r == 0) {
 			/* clean shutdown? */
+			f_ktls_prepare_shutdown(f);
 			r = SSL_shutdown(f->ssl);
 			switch (r) {
 			case 0: /* don't care about bidirectional shutdown */
@@ -529,11 +750,25 @@ static void do_ssl_write(liOpenSSLFilter *f) {
 		goto out;
 	}
 
+	if (f->ktls_send && !f_ktls_holding(f)) {
+		/* the kernel encrypts the records: pass plain data through, files and pipes stay
+		 * what they are (sendfile/splice) */
+		while (cq->length > 0 && write_max > 0) {
+			liChunk *c = li_chunkqueue_first_chunk(cq);
+			if (FILE_CHUNK == c->type || PIPE_CHUNK == c->type) {
+				li_chunkqueue_steal_chunk(f->crypt_source.out, cq);
+			} else {
+				write_max -= li_chunkqueue_steal_len(f->crypt_source.out, cq, MIN(write_max, li_chunk_length(c)));
+			}
+		}
+		li_stream_notify_later(&f->crypt_source);
+	}
+
 	do {
 		GError *err = NULL;
 		liChunkIter ci;
 
-		if (0 == cq->length) break;
+		if (0 == cq->length || f->ktls_send) break;
 
 		ci = li_chunkqueue_iter(cq);
 		switch (li_chunkiter_read(ci, 0, blocksize, &block_data, &block_len, &err)) {
@@ -577,6 +812,7 @@ static void do_ssl_write(liOpenSSLFilter *f) {
 	} while (r == block_len && write_max > 0);
 
 	if (cq->is_closed && 0 == cq->length) {
+		f_ktls_prepare_shutdown(f);
 		r = SSL_shutdown(f->ssl);
 		switch (r) {
 		case 0: /* don't care about bidirectional shutdown */
@@ -592,7 +828,7 @@ static void do_ssl_write(liOpenSSLFilter *f) {
 			f_abort_ssl(f);
 			break;
 		}
-	} else if (0 < cq->length && 0 != li_chunkqueue_limit_available(f->crypt_source.out)) {
+	} else if (0 < cq->length && !f_ktls_holding(f) && 0 != li_chunkqueue_limit_available(f->crypt_source.out)) {
 		li_stream_again_later(&f->plain_drain);
 	}
 
@@ -733,6 +969,18 @@ static void stream_crypt_source_limit_notify_cb(gpointer context, gboolean locke
 	if (!locked && !f->closing) li_stream_again_later(&f->plain_drain);
 }
 
+#ifdef USE_OPENSSL_KTLS
+static void openssl_ktls_msg_callback(int write_p, int version, int content_type, const void *buf, size_t len, SSL *ssl, void *arg) {
+	UNUSED(version); UNUSED(arg);
+
+	/* records after a KeyUpdate we send use a new key, which OpenSSL should pass with BIO_set_ktls() */
+	if (write_p && SSL3_RT_HANDSHAKE == content_type && len > 0 && SSL3_MT_KEY_UPDATE == ((const unsigned char*) buf)[0]) {
+		liOpenSSLFilter *f = SSL_get_app_data(ssl);
+		if (NULL != f && f->ktls_send) f->ktls_rekey = 1;
+	}
+}
+#endif
+
 static void openssl_info_callback(const SSL *ssl, int where, int ret) {
 	UNUSED(ret);
 
@@ -775,6 +1023,13 @@ liOpenSSLFilter* li_openssl_filter_new(
 	f->client_initiated_renegotiation = 0;
 	f->closing = f->aborted = 0;
 	f->write_wants_read = 0;
+	f->ktls_send = 0;
+#ifdef USE_OPENSSL_KTLS
+	f->ktls_rekey = 0;
+	f->ktls_fd = -1;
+	f->ktls_ctrl_msg = 0;
+	g_queue_init(&f->ktls_ops);
+#endif
 
 	li_stream_init(&f->crypt_source, loop, stream_crypt_source_cb);
 	li_stream_init(&f->crypt_drain, loop, stream_crypt_drain_cb);
@@ -822,3 +1077,83 @@ void li_openssl_filter_free(liOpenSSLFilter *f) {
 SSL* li_openssl_filter_ssl(liOpenSSLFilter *f) {
 	return f->ssl;
 }
+
+gboolean li_openssl_filter_use_ktls(liOpenSSLFilter *f, int fd) {
+#ifdef USE_OPENSSL_KTLS
+	if (NULL == f->ssl || f->initial_handshaked_finished) return FALSE;
+	f->ktls_fd = fd;
+	SSL_set_options(f->ssl, SSL_OP_ENABLE_KTLS);
+	SSL_set_msg_callback(f->ssl, openssl_ktls_msg_callback);
+	return TRUE;
+#else
+	UNUSED(f); UNUSED(fd);
+	return FALSE;
+#endif
+}
+
+gboolean li_openssl_filter_ktls_send(liOpenSSLFilter *f) {
+	return f->ktls_send;
+}
+
+gboolean li_openssl_filter_ktls_flush(liOpenSSLFilter *f) {
+#ifdef USE_OPENSSL_KTLS
+	f_ktls_op *op;
+	gboolean res = TRUE;
+
+	if (0 == f->ktls_ops.length || NULL == f->ssl) return TRUE;
+	/* the socket stream didn't take everything yet */
+	if (NULL != f->crypt_source.out && 0 != f->crypt_source.out->length) return TRUE;
+
+	f_acquire(f);
+
+	while (NULL != (op = g_queue_peek_head(&f->ktls_ops))) {
+		if (0 == op->record_type) {
+			if (-1 == setsockopt(f->ktls_fd, SOL_TLS, TLS_TX, op->data->data, op->data->len)) {
+				/* openssl already passes plain data, there is no way back */
+				_ERROR(f->srv, f->wrk, f->log_context, "kTLS: setsockopt(TLS_TX) failed: %s, closing connection", g_strerror(errno));
+				f_abort_ssl(f);
+				goto out;
+			}
+		} else {
+			ssize_t r = f_ktls_sendmsg(f->ktls_fd, op->record_type, op->data->data, op->data->len);
+
+			if (-1 == r) {
+				switch (errno) {
+				case EAGAIN:
+#if EWOULDBLOCK != EAGAIN
+				case EWOULDBLOCK:
+#endif
+					res = FALSE;
+					goto out;
+				case ECONNRESET:
+				case EPIPE:
+					break;
+				default:
+					_ERROR(f->srv, f->wrk, f->log_context, "kTLS: sendmsg failed: %s", g_strerror(errno));
+					break;
+				}
+				f_abort_ssl(f);
+				goto out;
+			}
+			if ((gsize) r < op->data->len) {
+				g_byte_array_remove_range(op->data, 0, r);
+				res = FALSE;
+				goto out;
+			}
+		}
+
+		g_queue_pop_head(&f->ktls_ops);
+		f_ktls_op_free(op);
+	}
+
+	/* plain data can follow now */
+	li_stream_again_later(&f->plain_drain);
+
+out:
+	f_release(f);
+	return res;
+#else
+	UNUSED(f);
+	return TRUE;
+#endif
+}
@@ -5,6 +5,16 @@
 
 #include <openssl/ssl.h>
 
+/* kernel TLS needs OpenSSL 3.x (SSL_OP_ENABLE_KTLS) built with ktls support. OpenSSL hands the record layer
+ * to the BIO with controls that are internal to it; only the 3.x releases whose numbering is known (and
+ * checked against the public BIO_CTRL_GET_KTLS_SEND) are used.
+ */
+#if defined(LIGHTY_OS_LINUX) && defined(HAVE_LINUX_TLS_H) && defined(SSL_OP_ENABLE_KTLS) && !defined(OPENSSL_NO_KTLS) \
+	&& !defined(LIBRESSL_VERSION_NUMBER) && OPENSSL_VERSION_NUMBER >= 0x30000000L && OPENSSL_VERSION_NUMBER < 0x40000000L \
+	&& defined(BIO_get_ktls_send) && defined(BIO_CTRL_GET_KTLS_SEND) && 73 == BIO_CTRL_GET_KTLS_SEND
+# define USE_OPENSSL_KTLS
+#endif
+
 typedef struct liOpenSSLFilter liOpenSSLFilter;
 
 typedef void (*liOpenSSLFilterHandshakeCB)(liOpenSSLFilter *f, gpointer data, liStream *plain_source, liStream *plain_drain);
@@ -26,4 +36,18 @@ LI_API void li_openssl_filter_free(liOpenSSLFilter *f);
 
 LI_API SSL* li_openssl_filter_ssl(liOpenSSLFilter *f);
 
+/* call before the handshake; fd is the socket crypt_drain writes to.
+ * if the negotiated cipher is supported the kernel encrypts the outgoing records
+ * after the handshake and plain data is passed through unchanged (so files can use sendfile()).
+ * returns FALSE if kTLS isn't available in this build.
+ */
+LI_API gboolean li_openssl_filter_use_ktls(liOpenSSLFilter *f, int fd);
+/* whether outgoing records are encrypted by the kernel */
+LI_API gboolean li_openssl_filter_ktls_send(liOpenSSLFilter *f);
+/* call when the socket wrote everything from crypt_drain: records and key changes that had to wait for the
+ * data in front of them are passed to the kernel now. returns FALSE if the socket would block (wait for
+ * it to get writable and call it again).
+ */
+LI_API gboolean li_openssl_filter_ktls_flush(liOpenSSLFilter *f);
+
 #endif
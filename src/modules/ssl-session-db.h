@@ -3,9 +3,15 @@
 
 #include <lighttpd/base.h>
 
+/* the db is shared by all workers; entries are spread over shards with their own lock and LRU list
+ * so concurrent handshakes rarely wait for each other */
+#define LI_SSL_SESSION_DB_SHARDS 16
+
 typedef struct liSSLSessionDBKey liSSLSessionDBKey;
 struct liSSLSessionDBKey {
 	GList keys_link;
+	time_t expires; /* 0: doesn't expire */
+	guint hash;
 	size_t size;
 	unsigned char data[];
 };
@@ -17,12 +23,19 @@ struct liSSLSessionDBData {
 	unsigned char data[];
 };
 
-typedef struct liSSLSessionDB liSSLSessionDB;
-struct liSSLSessionDB {
-	size_t max_entries;
+typedef struct liSSLSessionDBShard liSSLSessionDBShard;
+struct liSSLSessionDBShard {
 	GQueue keys; /* move recently added/used entries to end */
 	GMutex *mutex;
-	GHashTable *db; /* liSSLSessionDBData -> liSSLSessionDBData */
+	GHashTable *db; /* liSSLSessionDBKey -> liSSLSessionDBData */
+};
+
+typedef struct liSSLSessionDB liSSLSessionDB;
+struct liSSLSessionDB {
+	size_t max_entries; /* in all shards together */
+	gint entries; /* atomic; sum of the shard lengths */
+	time_t ttl; /* seconds, 0: entries don't expire */
+	liSSLSessionDBShard shards[LI_SSL_SESSION_DB_SHARDS];
 };
 
 INLINE void li_ssl_session_db_data_release(liSSLSessionDBData *d) {
@@ -47,17 +60,16 @@ INLINE liSSLSessionDBData* li_ssl_session_db_data_new(const unsigned char *data,
 
 INLINE void li_ssl_session_db_key_free_cb(gpointer data) {
 	liSSLSessionDBKey *d = data;
-	liSSLSessionDB *sdb;
+	liSSLSessionDBShard *shard;
 	if (NULL == d) return;
-	sdb = d->keys_link.data;
-	if (NULL != sdb) g_queue_unlink(&sdb->keys, &d->keys_link);
+	shard = d->keys_link.data;
+	if (NULL != shard) g_queue_unlink(&shard->keys, &d->keys_link);
 	g_slice_free1(d->size + sizeof(liSSLSessionDBKey), d);
 }
 
 INLINE guint li_ssl_session_db_key_hash(gconstpointer data) {
 	const liSSLSessionDBKey *d = data;
-	const GString s = li_const_gstring((const gchar*)d->data, d->size);
-	return g_string_hash(&s);
+	return d->hash;
 }
 
 INLINE gboolean li_ssl_session_db_key_equal(gconstpointer a, gconstpointer b) {
@@ -68,69 +80,132 @@ INLINE gboolean li_ssl_session_db_key_equal(gconstpointer a, gconstpointer b) {
 
 INLINE liSSLSessionDBKey* li_ssl_session_db_key_new(const unsigned char *data, size_t size) {
 	liSSLSessionDBKey *d = g_slice_alloc0(size + sizeof(liSSLSessionDBKey));
+	const GString s = li_const_gstring((const gchar*)data, size);
+	d->hash = g_string_hash(&s);
 	d->size = size;
 	memcpy(d->data, data, size);
 	return d;
 }
 
+INLINE liSSLSessionDBShard* li_ssl_session_db_shard(liSSLSessionDB *sdb, const liSSLSessionDBKey *key) {
+	/* the low bits select the bucket in the hash table, use the high ones */
+	return &sdb->shards[(key->hash >> 24) % LI_SSL_SESSION_DB_SHARDS];
+}
 
-INLINE liSSLSessionDB* li_ssl_session_db_new(size_t max_entries) {
+/* ttl in seconds, 0: entries only get purged by LRU */
+INLINE liSSLSessionDB* li_ssl_session_db_new(size_t max_entries, time_t ttl) {
 	liSSLSessionDB *sdb = g_slice_new0(liSSLSessionDB);
+	guint i;
 	sdb->max_entries = max_entries;
-	sdb->mutex = g_mutex_new();
-	sdb->db = g_hash_table_new_full(li_ssl_session_db_key_hash, li_ssl_session_db_key_equal,
-		li_ssl_session_db_key_free_cb, li_ssl_session_db_data_free_cb);
+	sdb->entries = 0;
+	sdb->ttl = ttl;
+	for (i = 0; i < LI_SSL_SESSION_DB_SHARDS; i++) {
+		liSSLSessionDBShard *shard = &sdb->shards[i];
+		shard->mutex = g_mutex_new();
+		shard->db = g_hash_table_new_full(li_ssl_session_db_key_hash, li_ssl_session_db_key_equal,
+			li_ssl_session_db_key_free_cb, li_ssl_session_db_data_free_cb);
+	}
 	return sdb;
 }
 
 INLINE void li_ssl_session_db_free(liSSLSessionDB* sdb) {
+	guint i;
 	if (NULL == sdb) return;
-	g_mutex_free(sdb->mutex);
-	sdb->mutex = NULL;
-	g_hash_table_destroy(sdb->db);
-	sdb->db = NULL;
+	for (i = 0; i < LI_SSL_SESSION_DB_SHARDS; i++) {
+		liSSLSessionDBShard *shard = &sdb->shards[i];
+		g_mutex_free(shard->mutex);
+		shard->mutex = NULL;
+		g_hash_table_destroy(shard->db);
+		shard->db = NULL;
+	}
 	g_slice_free(liSSLSessionDB, sdb);
 }
 
+/* drops the least recently used entry of the shard, but keeps the last keep entries */
+INLINE gboolean li_ssl_session_db_shard_purge_lru(liSSLSessionDB *sdb, liSSLSessionDBShard *shard, guint keep) {
+	gboolean purged = FALSE;
+
+	g_mutex_lock(shard->mutex);
+		if (shard->keys.length > keep) {
+			liSSLSessionDBKey *purge_key = LI_CONTAINER_OF(shard->keys.head, liSSLSessionDBKey, keys_link);
+			g_hash_table_remove(shard->db, purge_key);
+			g_atomic_int_add(&sdb->entries, -1);
+			purged = TRUE;
+		}
+	g_mutex_unlock(shard->mutex);
+
+	return purged;
+}
+
 INLINE void li_ssl_session_db_store(liSSLSessionDB *sdb, const unsigned char *key, size_t keylen, const unsigned char *value, size_t valuelen) {
 	liSSLSessionDBData *dvalue = li_ssl_session_db_data_new(value, valuelen);
 	liSSLSessionDBKey *dkey = li_ssl_session_db_key_new(key, keylen);
-	g_mutex_lock(sdb->mutex);
-		dkey->keys_link.data = sdb;
-		g_queue_push_tail_link(&sdb->keys, &dkey->keys_link);
-		g_hash_table_replace(sdb->db, dkey, dvalue);
-		while (sdb->keys.length > sdb->max_entries) {
-			liSSLSessionDBKey *purge_key = LI_CONTAINER_OF(sdb->keys.head, liSSLSessionDBKey, keys_link);
-			g_hash_table_remove(sdb->db, purge_key);
+	liSSLSessionDBShard *shard = li_ssl_session_db_shard(sdb, dkey);
+	time_t now = time(NULL);
+	guint i, ndx = shard - sdb->shards, idle;
+
+	if (0 != sdb->ttl) dkey->expires = now + sdb->ttl;
+
+	g_mutex_lock(shard->mutex);
+		i = shard->keys.length;
+		dkey->keys_link.data = shard;
+		g_queue_push_tail_link(&shard->keys, &dkey->keys_link);
+		g_hash_table_replace(shard->db, dkey, dvalue);
+		/* least recently used entries are at the head; drop the expired ones there */
+		while (NULL != shard->keys.head) {
+			liSSLSessionDBKey *purge_key = LI_CONTAINER_OF(shard->keys.head, liSSLSessionDBKey, keys_link);
+			if (0 == purge_key->expires || purge_key->expires > now) break;
+			g_hash_table_remove(shard->db, purge_key);
+		}
+		g_atomic_int_add(&sdb->entries, (gint) shard->keys.length - (gint) i);
+	g_mutex_unlock(shard->mutex);
+
+	/* max_entries limits all shards together: drop the least recently used entries of this shard first
+	 * (but not the new one), then of the following shards. only one shard is locked at a time.
+	 */
+	for (i = 0, idle = 0; idle < LI_SSL_SESSION_DB_SHARDS && (size_t) g_atomic_int_get(&sdb->entries) > sdb->max_entries; ) {
+		liSSLSessionDBShard *purge_shard = &sdb->shards[(ndx + i) % LI_SSL_SESSION_DB_SHARDS];
+		if (li_ssl_session_db_shard_purge_lru(sdb, purge_shard, purge_shard == shard ? 1 : 0)) {
+			idle = 0;
+		} else {
+			idle++;
+			i++;
 		}
-	g_mutex_unlock(sdb->mutex);
+	}
 }
 
 INLINE liSSLSessionDBData* li_ssl_session_db_lookup(liSSLSessionDB *sdb, const unsigned char *key, size_t keylen) {
 	liSSLSessionDBData *dvalue = NULL;
 	liSSLSessionDBKey *dkey = li_ssl_session_db_key_new(key, keylen);
+	liSSLSessionDBShard *shard = li_ssl_session_db_shard(sdb, dkey);
 	gpointer orig_key, value;
 
-	g_mutex_lock(sdb->mutex);
-		if (g_hash_table_lookup_extended(sdb->db, dkey, &orig_key, &value)) {
+	g_mutex_lock(shard->mutex);
+		if (g_hash_table_lookup_extended(shard->db, dkey, &orig_key, &value)) {
 			liSSLSessionDBKey *k = orig_key;
-			g_queue_unlink(&sdb->keys, &k->keys_link);
-			g_queue_push_tail_link(&sdb->keys, &k->keys_link);
-
-			dvalue = value;
-			LI_FORCE_ASSERT(g_atomic_int_get(&dvalue->refcount) > 0);
-			g_atomic_int_inc(&dvalue->refcount);
+			if (0 != k->expires && k->expires <= time(NULL)) {
+				g_hash_table_remove(shard->db, k);
+				g_atomic_int_add(&sdb->entries, -1);
+			} else {
+				g_queue_unlink(&shard->keys, &k->keys_link);
+				g_queue_push_tail_link(&shard->keys, &k->keys_link);
+
+				dvalue = value;
+				LI_FORCE_ASSERT(g_atomic_int_get(&dvalue->refcount) > 0);
+				g_atomic_int_inc(&dvalue->refcount);
+			}
 		}
-	g_mutex_unlock(sdb->mutex);
+	g_mutex_unlock(shard->mutex);
 	li_ssl_session_db_key_free_cb(dkey);
 	return dvalue;
 }
 
 INLINE void li_ssl_session_db_remove(liSSLSessionDB *sdb, const unsigned char *key, size_t keylen) {
 	liSSLSessionDBKey *dkey = li_ssl_session_db_key_new(key, keylen);
-	g_mutex_lock(sdb->mutex);
-		g_hash_table_remove(sdb->db, dkey);
-	g_mutex_unlock(sdb->mutex);
+	liSSLSessionDBShard *shard = li_ssl_session_db_shard(sdb, dkey);
+	g_mutex_lock(shard->mutex);
+		if (g_hash_table_remove(shard->db, dkey)) g_atomic_int_add(&sdb->entries, -1);
+	g_mutex_unlock(shard->mutex);
 	li_ssl_session_db_key_free_cb(dkey);
 }
 
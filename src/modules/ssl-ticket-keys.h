@@ -0,0 +1,187 @@
+#ifndef _LIGHTTPD_SSL_TICKET_KEYS_H_
+#define _LIGHTTPD_SSL_TICKET_KEYS_H_
+
+#include <lighttpd/base.h>
+
+/* key ring for TLS session tickets, loaded from a file so several instances (and the next
+ * instance after a restart) accept each others tickets.
+ *
+ * the file contains one or more keys of 80 bytes each (same format as nginx's ssl_session_ticket_key):
+ * 16 bytes key name, 32 bytes HMAC secret, 32 bytes AES key.
+ * the first key encrypts new tickets, the others are only used to decrypt tickets (previous keys);
+ * rotate by writing a new file with a new first key. the file is checked for changes once a minute;
+ * a change of the mtime (with nanoseconds where available), inode or size counts.
+ */
+
+#define LI_SSL_TICKET_KEYS_CHECK_INTERVAL 60
+
+typedef struct liSSLTicketKey liSSLTicketKey;
+struct liSSLTicketKey {
+	unsigned char name[16];
+	unsigned char hmac_secret[32];
+	unsigned char aes_key[32];
+};
+
+/* identifies a version of the key file; a second-granularity mtime misses quick rotations */
+typedef struct liSSLTicketKeysFile liSSLTicketKeysFile;
+struct liSSLTicketKeysFile {
+	time_t mtime;
+	long mtime_nsec;
+	ino_t ino;
+	off_t size;
+};
+
+typedef struct liSSLTicketKeys liSSLTicketKeys;
+struct liSSLTicketKeys {
+	GMutex *mutex;
+	gchar *filename;
+	GArray *keys; /* (liSSLTicketKey), first one is the current key */
+	liSSLTicketKeysFile file;
+	time_t last_check;
+};
+
+INLINE void li_ssl_ticket_keys_file(liSSLTicketKeysFile *file, const struct stat *st) {
+	file->mtime = st->st_mtime;
+#if defined(LIGHTY_OS_LINUX)
+	file->mtime_nsec = st->st_mtim.tv_nsec;
+#elif defined(LIGHTY_OS_MACOSX)
+	file->mtime_nsec = st->st_mtimespec.tv_nsec;
+#else
+	file->mtime_nsec = 0;
+#endif
+	file->ino = st->st_ino;
+	file->size = st->st_size;
+}
+
+INLINE void li_ssl_ticket_keys_clear(GArray *keys) {
+	/* don't leave the secrets in free memory */
+	memset(keys->data, 0, keys->len * sizeof(liSSLTicketKey));
+	g_array_free(keys, TRUE);
+}
+
+/* (re)load the key file; keeps the old keys on errors */
+INLINE gboolean li_ssl_ticket_keys_load(liSSLTicketKeys *tk, GError **err) {
+	gchar *contents = NULL;
+	gsize length = 0, i;
+	struct stat st;
+	GArray *keys, *old_keys;
+
+	if (-1 == stat(tk->filename, &st)) {
+		g_set_error(err, G_FILE_ERROR, g_file_error_from_errno(errno), "couldn't stat ticket key file '%s': %s", tk->filename, g_strerror(errno));
+		return FALSE;
+	}
+
+	if (!g_file_get_contents(tk->filename, &contents, &length, err)) return FALSE;
+
+	if (0 == length || 0 != length % sizeof(liSSLTicketKey)) {
+		g_set_error(err, G_FILE_ERROR, G_FILE_ERROR_INVAL, "ticket key file '%s' must contain keys of %u bytes", tk->filename, (guint) sizeof(liSSLTicketKey));
+		memset(contents, 0, length);
+		g_free(contents);
+		return FALSE;
+	}
+
+	keys = g_array_sized_new(FALSE, FALSE, sizeof(liSSLTicketKey), length / sizeof(liSSLTicketKey));
+	for (i = 0; i < length; i += sizeof(liSSLTicketKey)) {
+		liSSLTicketKey key;
+		memcpy(key.name, contents + i, 16);
+		memcpy(key.hmac_secret, contents + i + 16, 32);
+		memcpy(key.aes_key, contents + i + 48, 32);
+		g_array_append_val(keys, key);
+	}
+	memset(contents, 0, length);
+	g_free(contents);
+
+	g_mutex_lock(tk->mutex);
+		old_keys = tk->keys;
+		tk->keys = keys;
+		li_ssl_ticket_keys_file(&tk->file, &st);
+	g_mutex_unlock(tk->mutex);
+
+	if (NULL != old_keys) li_ssl_ticket_keys_clear(old_keys);
+
+	return TRUE;
+}
+
+INLINE liSSLTicketKeys* li_ssl_ticket_keys_new(const gchar *filename, GError **err) {
+	liSSLTicketKeys *tk = g_slice_new0(liSSLTicketKeys);
+	tk->mutex = g_mutex_new();
+	tk->filename = g_strdup(filename);
+	tk->last_check = time(NULL);
+
+	if (!li_ssl_ticket_keys_load(tk, err)) {
+		g_mutex_free(tk->mutex);
+		g_free(tk->filename);
+		g_slice_free(liSSLTicketKeys, tk);
+		return NULL;
+	}
+
+	return tk;
+}
+
+INLINE void li_ssl_ticket_keys_free(liSSLTicketKeys *tk) {
+	if (NULL == tk) return;
+	g_mutex_free(tk->mutex);
+	g_free(tk->filename);
+	if (NULL != tk->keys) li_ssl_ticket_keys_clear(tk->keys);
+	g_slice_free(liSSLTicketKeys, tk);
+}
+
+/* reload the key file if it changed; only looks at the file every LI_SSL_TICKET_KEYS_CHECK_INTERVAL seconds.
+ * returns FALSE (and keeps the old keys) if the changed file couldn't be loaded
+ */
+INLINE gboolean li_ssl_ticket_keys_check(liSSLTicketKeys *tk, GError **err) {
+	time_t now = time(NULL);
+	liSSLTicketKeysFile file, cur;
+	struct stat st;
+
+	g_mutex_lock(tk->mutex);
+		if (now - tk->last_check < LI_SSL_TICKET_KEYS_CHECK_INTERVAL) {
+			g_mutex_unlock(tk->mutex);
+			return TRUE;
+		}
+		tk->last_check = now;
+		file = tk->file;
+	g_mutex_unlock(tk->mutex);
+
+	if (-1 == stat(tk->filename, &st)) return TRUE; /* keep using the old keys if the file is gone */
+
+	li_ssl_ticket_keys_file(&cur, &st);
+	if (cur.mtime == file.mtime && cur.mtime_nsec == file.mtime_nsec && cur.ino == file.ino && cur.size == file.size) return TRUE;
+
+	return li_ssl_ticket_keys_load(tk, err);
+}
+
+/* copy the key for new tickets */
+INLINE gboolean li_ssl_ticket_keys_current(liSSLTicketKeys *tk, liSSLTicketKey *key) {
+	gboolean found = FALSE;
+
+	g_mutex_lock(tk->mutex);
+		if (tk->keys->len > 0) {
+			*key = g_array_index(tk->keys, liSSLTicketKey, 0);
+			found = TRUE;
+		}
+	g_mutex_unlock(tk->mutex);
+
+	return found;
+}
+
+/* copy the key with the given name; returns 0 if not found, 1 for the current key and 2 for previous keys */
+INLINE int li_ssl_ticket_keys_find(liSSLTicketKeys *tk, const unsigned char *name, liSSLTicketKey *key) {
+	int result = 0;
+	guint i;
+
+	g_mutex_lock(tk->mutex);
+		for (i = 0; i < tk->keys->len; i++) {
+			const liSSLTicketKey *k = &g_array_index(tk->keys, liSSLTicketKey, i);
+			if (0 == memcmp(k->name, name, sizeof(k->name))) {
+				*key = *k;
+				result = (0 == i) ? 1 : 2;
+				break;
+			}
+		}
+	g_mutex_unlock(tk->mutex);
+
+	return result;
+}
+
+#endif
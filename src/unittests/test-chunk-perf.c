@@ -0,0 +1,120 @@
+
+#include <lighttpd/base.h>
+
+/* microbenchmarks for the chunkqueue patterns on the hot path; only run in perf mode:
+ *   test-chunk-perf -m perf
+ * compare the reported times between builds to see the effect of chunk/chunkqueue changes.
+ */
+
+#define ROUNDS 1000000
+
+static void report(const gchar *what, gdouble elapsed, guint ops) {
+	g_test_minimized_result(elapsed * 1e9 / ops, "%s: %.1f ns per operation", what, elapsed * 1e9 / ops);
+}
+
+/* li_network_read: append the new data in a buffer chunk, the next stream consumes it */
+static void perf_read_append_skip(void) {
+	liChunkQueue *cq = li_chunkqueue_new();
+	liBuffer *buf = li_buffer_new(4096);
+	guint i;
+
+	if (!g_test_perf()) goto out;
+
+	buf->used = 4096;
+	g_test_timer_start();
+	for (i = 0; i < ROUNDS; i++) {
+		li_buffer_acquire(buf);
+		li_chunkqueue_append_buffer2(cq, buf, (i % 8) * 512, 512);
+		if (7 == i % 8) li_chunkqueue_skip_all(cq);
+	}
+	report("append buffer / skip all", g_test_timer_elapsed(), ROUNDS);
+
+out:
+	li_chunkqueue_free(cq);
+	li_buffer_release(buf);
+}
+
+/* filters and stream plumbing: move everything to the next queue, the writer skips what was sent */
+static void perf_steal_all(void) {
+	liChunkQueue *in = li_chunkqueue_new(), *out = li_chunkqueue_new();
+	guint i;
+
+	if (!g_test_perf()) goto out;
+
+	g_test_timer_start();
+	for (i = 0; i < ROUNDS; i++) {
+		li_chunkqueue_append_mem(in, CONST_STR_LEN("0123456789abcdef"));
+		li_chunkqueue_append_mem(in, CONST_STR_LEN("0123456789abcdef"));
+		li_chunkqueue_steal_all(out, in);
+		li_chunkqueue_skip(out, 32);
+	}
+	report("append 2 / steal all / skip", g_test_timer_elapsed(), ROUNDS);
+
+out:
+	li_chunkqueue_free(in);
+	li_chunkqueue_free(out);
+}
+
+/* li_chunkqueue_steal_len: forwarding a limited number of bytes (request bodies, proxy); splits the first chunk
+ * and moves the rest */
+static void perf_steal_len(void) {
+	liChunkQueue *in = li_chunkqueue_new(), *out = li_chunkqueue_new();
+	liBuffer *buf = li_buffer_new(4096);
+	guint i;
+
+	if (!g_test_perf()) goto out;
+
+	buf->used = 4096;
+	g_test_timer_start();
+	for (i = 0; i < ROUNDS; i++) {
+		li_buffer_acquire(buf);
+		li_chunkqueue_append_buffer2(in, buf, 0, 1024);
+		li_chunkqueue_steal_len(out, in, 700);
+		li_chunkqueue_steal_len(out, in, 324);
+		li_chunkqueue_skip_all(out);
+	}
+	report("append buffer / steal len split + move / skip all", g_test_timer_elapsed(), ROUNDS);
+
+out:
+	li_chunkqueue_free(in);
+	li_chunkqueue_free(out);
+	li_buffer_release(buf);
+}
+
+/* walking the queue: parsers and extract_to */
+static void perf_iterate(void) {
+	liChunkQueue *cq = li_chunkqueue_new();
+	liChunkIter ci;
+	goffset total = 0;
+	guint i;
+
+	if (!g_test_perf()) goto out;
+
+	for (i = 0; i < 64; i++) {
+		li_chunkqueue_append_mem(cq, CONST_STR_LEN("0123456789abcdef"));
+	}
+
+	g_test_timer_start();
+	for (i = 0; i < ROUNDS / 64; i++) {
+		ci = li_chunkqueue_iter(cq);
+		do {
+			total += li_chunkiter_length(ci);
+		} while (li_chunkiter_next(&ci));
+	}
+	report("iterate chunk", g_test_timer_elapsed(), (ROUNDS / 64) * 64);
+	g_assert(total == (goffset) (ROUNDS / 64) * 64 * 16);
+
+out:
+	li_chunkqueue_free(cq);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/chunk-perf/read_append_skip", perf_read_append_skip);
+	g_test_add_func("/chunk-perf/steal_all", perf_steal_all);
+	g_test_add_func("/chunk-perf/steal_len", perf_steal_len);
+	g_test_add_func("/chunk-perf/iterate", perf_iterate);
+
+	return g_test_run();
+}
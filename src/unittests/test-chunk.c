@@ -50,10 +50,125 @@ static void test_filter_chunked_decode(void) {
 	li_chunkqueue_free(cq2);
 }
 
+static void cq_append_pipe(liChunkQueue *cq, liChunkPipe *cp, const gchar *s, size_t len) {
+	g_assert(li_chunkqueue_pipe_space(cq, cp) >= (goffset) len);
+	g_assert((ssize_t) len == write(cp->fd[1], s, len));
+	li_chunkqueue_append_pipe(cq, cp, len);
+}
+
+static void test_chunk_pipe(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+	liChunkPipe *cp = li_chunkpipe_new();
+
+	if (NULL == cp) {
+		/* no splice() support */
+		li_chunkqueue_free(cq);
+		li_chunkqueue_free(cq2);
+		return;
+	}
+
+	/* appending extends the last chunk */
+	cq_append_pipe(cq, cp, CONST_STR_LEN("0123456789"));
+	cq_append_pipe(cq, cp, CONST_STR_LEN("abcdefghij"));
+	g_assert(1 == cq->queue.length);
+	g_assert(20 == cq->length && 20 == cp->length);
+	g_assert(0 == cq->mem_usage);
+
+	/* pipe data belongs to a chunk in another queue now */
+	li_chunkqueue_steal_all(cq2, cq);
+	g_assert(0 == li_chunkqueue_pipe_space(cq, cp));
+
+	/* skipping throws the data away; splitting copies the first part */
+	g_assert(2 == li_chunkqueue_skip(cq2, 2));
+	g_assert(18 == cp->length);
+	g_assert(5 == li_chunkqueue_steal_len(cq, cq2, 5));
+	g_assert(13 == cp->length);
+	cq_assert_eq(cq, CONST_STR_LEN("23456"));
+	cq_assert_eq(cq2, CONST_STR_LEN("789abcdefghij"));
+
+	/* data was read from the pipe into memory */
+	g_assert(0 == cp->length);
+	g_assert(li_chunkqueue_pipe_space(cq, cp) > 0);
+
+	li_chunkqueue_skip_all(cq2);
+	cq_append_pipe(cq, cp, CONST_STR_LEN("next"));
+	g_assert(2 == cq->queue.length);
+	cq_assert_eq(cq, CONST_STR_LEN("23456next"));
+
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+	li_chunkpipe_release(cp);
+}
+
+static void test_chunk_pipe_lost(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+	liChunkPipe *cp = li_chunkpipe_new();
+	gchar buf[10];
+
+	if (NULL == cp) {
+		/* no splice() support */
+		li_chunkqueue_free(cq);
+		li_chunkqueue_free(cq2);
+		return;
+	}
+
+	cq_append_pipe(cq, cp, CONST_STR_LEN("0123456789"));
+
+	/* somebody else emptied the pipe: splitting the chunk fails instead of aborting */
+	g_assert(10 == read(cp->fd[0], buf, sizeof(buf)));
+	close(cp->fd[1]);
+	cp->fd[1] = -1;
+	g_assert(-1 == li_chunkqueue_steal_len(cq2, cq, 5));
+	g_assert(0 == cq2->length && 0 == cq2->queue.length);
+
+	/* the pipe isn't used for new data anymore */
+	g_assert(0 == li_chunkqueue_pipe_space(cq2, cp));
+
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+	li_chunkpipe_release(cp);
+}
+
+static void test_chunkqueue_steal(void) {
+	liChunkQueue *cq = li_chunkqueue_new(), *cq2 = li_chunkqueue_new();
+
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("0123"));
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("4567"));
+	li_chunkqueue_append_string(cq, g_string_new("89ab"));
+	g_assert(3 == cq->queue.length);
+
+	/* moves the first chunk, splits the second one */
+	g_assert(6 == li_chunkqueue_steal_len(cq2, cq, 6));
+	g_assert(2 == cq->queue.length && 2 == cq2->queue.length);
+	cq_assert_eq(cq2, CONST_STR_LEN("012345"));
+	cq_assert_eq(cq, CONST_STR_LEN("6789ab"));
+
+	g_assert(2 == li_chunkqueue_steal_chunk(cq2, cq));
+	g_assert(1 == cq->queue.length && 3 == cq2->queue.length);
+
+	/* appending to an emptied queue, then merging */
+	g_assert(4 == li_chunkqueue_skip_all(cq));
+	g_assert(0 == cq->queue.length && NULL == li_chunkqueue_first_chunk(cq));
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("cd"));
+	g_assert(2 == li_chunkqueue_steal_all(cq2, cq));
+	g_assert(0 == cq->queue.length && 4 == cq2->queue.length);
+	g_assert(10 == cq2->length && 0 == cq->length);
+	cq_assert_eq(cq2, CONST_STR_LEN("01234567cd"));
+
+	li_chunkqueue_append_mem(cq, CONST_STR_LEN("ef"));
+	cq_assert_eq(cq, CONST_STR_LEN("ef"));
+
+	li_chunkqueue_free(cq);
+	li_chunkqueue_free(cq2);
+}
+
 int main(int argc, char **argv) {
 	g_test_init(&argc, &argv, NULL);
 
 	g_test_add_func("/chunk/filter_chunked_decode", test_filter_chunked_decode);
+	g_test_add_func("/chunk/pipe", test_chunk_pipe);
+	g_test_add_func("/chunk/pipe_lost", test_chunk_pipe_lost);
+	g_test_add_func("/chunk/steal", test_chunkqueue_steal);
 
 	return g_test_run();
 }
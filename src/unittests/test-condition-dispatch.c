@@ -0,0 +1,201 @@
+
+#include <lighttpd/base.h>
+
+/* dispatch tables have to return the same index as checking the conditions one after another;
+ * the benchmark (only in perf mode: test-condition-dispatch -m perf) compares both for 10000 vhosts.
+ */
+
+#define PERF_VHOSTS 10000
+#define PERF_ROUNDS 200000
+
+static liCondition* new_cond(liConditionLValue *lvalue, liCompOperator op, const gchar *str) {
+	liCondition *cond;
+
+	li_condition_lvalue_acquire(lvalue);
+	cond = li_condition_new_string(NULL, op, lvalue, g_string_new(str));
+	g_assert(NULL != cond);
+	return cond;
+}
+
+/* what a chain of condition actions does */
+static guint linear_lookup(GPtrArray *conds, const gchar *value) {
+	guint i;
+
+	for (i = 0; i < conds->len; i++) {
+		liCondition *cond = g_ptr_array_index(conds, i);
+		gboolean match = FALSE;
+
+		switch (cond->op) {
+		case LI_CONFIG_COND_EQ:
+			match = g_str_equal(value, cond->rvalue.string->str);
+			break;
+		case LI_CONFIG_COND_PREFIX:
+			match = g_str_has_prefix(value, cond->rvalue.string->str);
+			break;
+		case LI_CONFIG_COND_SUFFIX:
+			match = g_str_has_suffix(value, cond->rvalue.string->str);
+			break;
+		default:
+			g_assert_not_reached();
+		}
+		if (match) return i;
+	}
+
+	return G_MAXUINT;
+}
+
+static void chain_add(liConditionDispatch *d, GPtrArray *conds, liConditionLValue *lvalue, liCompOperator op, const gchar *str) {
+	liCondition *cond = new_cond(lvalue, op, str);
+
+	g_assert(li_condition_dispatch_add(d, cond));
+	g_ptr_array_add(conds, cond);
+}
+
+static void chain_free(liConditionDispatch *d, GPtrArray *conds) {
+	guint i;
+
+	for (i = 0; i < conds->len; i++) li_condition_release(NULL, g_ptr_array_index(conds, i));
+	g_ptr_array_free(conds, TRUE);
+	li_condition_dispatch_free(NULL, d);
+}
+
+static void test_first_match(void) {
+	liConditionLValue *lvalue = li_condition_lvalue_new(LI_COMP_REQUEST_PATH, NULL);
+	liConditionDispatch *d = li_condition_dispatch_new(lvalue);
+	GPtrArray *conds = g_ptr_array_new();
+	static const gchar *values[] = {
+		"", "/", "/a", "/ab", "/abc", "/abcd", "/b", "/b/x.php", "/x.php", "/static/x.css", "/static/x.php",
+		"/static", "/static/", "/downloads/file.tar.gz", "/downloads/", "x", "/c.gz", ".gz", "/index.html", NULL
+	};
+	guint i;
+
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_EQ, "/index.html");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_PREFIX, "/static/");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_SUFFIX, ".php");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_PREFIX, "/ab");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_PREFIX, "/a");     /* shorter prefix after a longer one */
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_PREFIX, "/abc");   /* shadowed by "/ab" */
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_EQ, "/b");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_EQ, "/index.html"); /* shadowed by the first condition */
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_SUFFIX, ".tar.gz");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_SUFFIX, ".gz");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_EQ, "");
+	chain_add(d, conds, lvalue, LI_CONFIG_COND_PREFIX, "/");
+
+	g_assert_cmpuint(li_condition_dispatch_length(d), ==, conds->len);
+
+	for (i = 0; NULL != values[i]; i++) {
+		g_assert_cmpuint(li_condition_dispatch_lookup(d, values[i]), ==, linear_lookup(conds, values[i]));
+	}
+
+	g_assert_cmpuint(li_condition_dispatch_lookup(d, "/static/x.php"), ==, 1);
+	g_assert_cmpuint(li_condition_dispatch_lookup(d, "/abcd"), ==, 3);
+	g_assert_cmpuint(li_condition_dispatch_lookup(d, "x"), ==, G_MAXUINT);
+
+	chain_free(d, conds);
+	li_condition_lvalue_release(lvalue);
+}
+
+static void test_unsupported(void) {
+	liConditionLValue *host = li_condition_lvalue_new(LI_COMP_REQUEST_HOST, NULL);
+	liConditionLValue *path = li_condition_lvalue_new(LI_COMP_REQUEST_PATH, NULL);
+	liConditionLValue *header_a = li_condition_lvalue_new(LI_COMP_REQUEST_HEADER, g_string_new("X-Test"));
+	liConditionLValue *header_b = li_condition_lvalue_new(LI_COMP_REQUEST_HEADER, g_string_new("x-test"));
+	liConditionLValue *header_c = li_condition_lvalue_new(LI_COMP_REQUEST_HEADER, g_string_new("x-other"));
+	liConditionDispatch *d = li_condition_dispatch_new(host), *dh = li_condition_dispatch_new(header_a);
+	liCondition *cond;
+
+	cond = new_cond(path, LI_CONFIG_COND_EQ, "/");
+	g_assert(!li_condition_dispatch_add(d, cond));
+	li_condition_release(NULL, cond);
+
+	cond = new_cond(host, LI_CONFIG_COND_NE, "example.com");
+	g_assert(!li_condition_dispatch_supported(cond));
+	g_assert(!li_condition_dispatch_add(d, cond));
+	li_condition_release(NULL, cond);
+
+	cond = new_cond(host, LI_CONFIG_COND_PREFIX, "");
+	g_assert(!li_condition_dispatch_supported(cond));
+	li_condition_release(NULL, cond);
+
+	li_condition_lvalue_acquire(host);
+	cond = li_condition_new_int(NULL, LI_CONFIG_COND_EQ, host, 1);
+	g_assert(!li_condition_dispatch_supported(cond));
+	li_condition_release(NULL, cond);
+
+	/* header keys are lowercased: same lvalue */
+	cond = new_cond(header_b, LI_CONFIG_COND_EQ, "1");
+	g_assert(li_condition_dispatch_add(dh, cond));
+	li_condition_release(NULL, cond);
+	cond = new_cond(header_c, LI_CONFIG_COND_EQ, "1");
+	g_assert(!li_condition_dispatch_add(dh, cond));
+	li_condition_release(NULL, cond);
+
+	g_assert_cmpuint(li_condition_dispatch_length(d), ==, 0);
+	g_assert_cmpuint(li_condition_dispatch_length(dh), ==, 1);
+
+	li_condition_dispatch_free(NULL, d);
+	li_condition_dispatch_free(NULL, dh);
+	li_condition_lvalue_release(host);
+	li_condition_lvalue_release(path);
+	li_condition_lvalue_release(header_a);
+	li_condition_lvalue_release(header_b);
+	li_condition_lvalue_release(header_c);
+}
+
+static void perf_vhosts(void) {
+	liConditionLValue *lvalue;
+	liConditionDispatch *d;
+	GPtrArray *conds;
+	GString *host;
+	gdouble linear_time, dispatch_time;
+	guint i, sum_linear = 0, sum_dispatch = 0;
+
+	if (!g_test_perf()) return;
+
+	lvalue = li_condition_lvalue_new(LI_COMP_REQUEST_HOST, NULL);
+	d = li_condition_dispatch_new(lvalue);
+	conds = g_ptr_array_new();
+	host = g_string_sized_new(0);
+
+	for (i = 0; i < PERF_VHOSTS; i++) {
+		g_string_printf(host, "www.vhost%u.example.com", i);
+		chain_add(d, conds, lvalue, LI_CONFIG_COND_EQ, host->str);
+		if (0 == i % 100) {
+			g_string_printf(host, ".customer%u.example.net", i);
+			chain_add(d, conds, lvalue, LI_CONFIG_COND_SUFFIX, host->str);
+		}
+	}
+
+	g_test_timer_start();
+	for (i = 0; i < PERF_ROUNDS / 100; i++) {
+		g_string_printf(host, "www.vhost%u.example.com", (i * 7919) % (PERF_VHOSTS + PERF_VHOSTS / 10));
+		sum_linear += linear_lookup(conds, host->str);
+	}
+	linear_time = g_test_timer_elapsed() * 100;
+
+	g_test_timer_start();
+	for (i = 0; i < PERF_ROUNDS; i++) {
+		g_string_printf(host, "www.vhost%u.example.com", (i * 7919) % (PERF_VHOSTS + PERF_VHOSTS / 10));
+		sum_dispatch += li_condition_dispatch_lookup(d, host->str);
+	}
+	dispatch_time = g_test_timer_elapsed();
+
+	g_test_minimized_result(linear_time * 1e9 / PERF_ROUNDS, "%u vhosts, linear: %.1f ns per lookup", PERF_VHOSTS, linear_time * 1e9 / PERF_ROUNDS);
+	g_test_minimized_result(dispatch_time * 1e9 / PERF_ROUNDS, "%u vhosts, dispatch: %.1f ns per lookup", PERF_VHOSTS, dispatch_time * 1e9 / PERF_ROUNDS);
+	(void) sum_linear; (void) sum_dispatch;
+
+	g_string_free(host, TRUE);
+	chain_free(d, conds);
+	li_condition_lvalue_release(lvalue);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/condition-dispatch/first_match", test_first_match);
+	g_test_add_func("/condition-dispatch/unsupported", test_unsupported);
+	g_test_add_func("/condition-dispatch/perf_vhosts", perf_vhosts);
+
+	return g_test_run();
+}
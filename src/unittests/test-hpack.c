@@ -0,0 +1,192 @@
+
+#include <lighttpd/base.h>
+
+/* examples from RFC 7541 appendix C */
+
+static void hex_decode(GString *dest, const gchar *hex) {
+	g_string_truncate(dest, 0);
+	while (*hex) {
+		if (' ' == *hex) { hex++; continue; }
+		g_string_append_c(dest, (g_ascii_xdigit_value(hex[0]) << 4) | g_ascii_xdigit_value(hex[1]));
+		hex += 2;
+	}
+}
+
+static void collect_header(gpointer context, const gchar *name, gsize name_len, const gchar *value, gsize value_len) {
+	GString *headers = context;
+	g_string_append_len(headers, name, name_len);
+	g_string_append_len(headers, CONST_STR_LEN(": "));
+	g_string_append_len(headers, value, value_len);
+	g_string_append_c(headers, '\n');
+}
+
+static void check_decode(liHPackDecoder *dec, const gchar *hex, const gchar *expected, gsize table_size) {
+	GString *block = g_string_sized_new(0), *headers = g_string_sized_new(0);
+
+	hex_decode(block, hex);
+	g_assert(li_hpack_decode(dec, (const guint8*) block->str, block->len, collect_header, headers));
+	g_assert_cmpstr(headers->str, ==, expected);
+	g_assert_cmpuint(dec->table.size, ==, table_size);
+
+	g_string_free(block, TRUE);
+	g_string_free(headers, TRUE);
+}
+
+static void test_decode_requests(void) {
+	liHPackDecoder dec;
+
+	/* C.3: without huffman coding */
+	li_hpack_decoder_init(&dec, LI_HPACK_DEFAULT_TABLE_SIZE);
+	check_decode(&dec, "8286 8441 0f77 7777 2e65 7861 6d70 6c65 2e63 6f6d",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n", 57);
+	check_decode(&dec, "8286 84be 5808 6e6f 2d63 6163 6865",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n", 110);
+	check_decode(&dec, "8287 85bf 400a 6375 7374 6f6d 2d6b 6579 0c63 7573 746f 6d2d 7661 6c75 65",
+		":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n", 164);
+	li_hpack_decoder_clear(&dec);
+
+	/* C.4: with huffman coding */
+	li_hpack_decoder_init(&dec, LI_HPACK_DEFAULT_TABLE_SIZE);
+	check_decode(&dec, "8286 8441 8cf1 e3c2 e5f2 3a6b a0ab 90f4 ff",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\n", 57);
+	check_decode(&dec, "8286 84be 5886 a8eb 1064 9cbf",
+		":method: GET\n:scheme: http\n:path: /\n:authority: www.example.com\ncache-control: no-cache\n", 110);
+	check_decode(&dec, "8287 85bf 4088 25a8 49e9 5ba9 7d7f 8925 a849 e95b b8e8 b4bf",
+		":method: GET\n:scheme: https\n:path: /index.html\n:authority: www.example.com\ncustom-key: custom-value\n", 164);
+	li_hpack_decoder_clear(&dec);
+}
+
+static void test_decode_eviction(void) {
+	liHPackDecoder dec;
+
+	/* C.6: responses with huffman coding and a 256 bytes table */
+	li_hpack_decoder_init(&dec, 256);
+	check_decode(&dec, "4882 6402 5885 aec3 771a 4b61 96d0 7abe 9410 54d4 44a8 2005 9504 0b81 66e0 82a6 2d1b ff6e 919d 29ad 1718 63c7 8f0b 97c8 e9ae 82ae 43d3",
+		":status: 302\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222);
+	check_decode(&dec, "4883 640e ffc1 c0bf",
+		":status: 307\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:21 GMT\nlocation: https://www.example.com\n", 222);
+	check_decode(&dec, "88c1 6196 d07a be94 1054 d444 a820 0595 040b 8166 e084 a62d 1bff c05a 839b d9ab 77ad 94e7 821d d7f2 e6c7 b335 dfdf cd5b 3960 d5af 2708 7f36 72c1 ab27 0fb5 291f 9587 3160 65c0 03ed 4ee5 b106 3d50 07",
+		":status: 200\ncache-control: private\ndate: Mon, 21 Oct 2013 20:13:22 GMT\nlocation: https://www.example.com\ncontent-encoding: gzip\nset-cookie: foo=ASDJKHQKBZXOQWEOPIUAXQWEOIU; max-age=3600; version=1\n", 215);
+	li_hpack_decoder_clear(&dec);
+}
+
+static void test_decode_invalid(void) {
+	liHPackDecoder dec;
+	GString *block = g_string_sized_new(0), *headers = g_string_sized_new(0);
+	static const guint8 huffman_eos[] = { 0xff, 0xff, 0xff, 0xff };
+	static const guint8 huffman_padding[] = { 0x00 };
+
+	g_assert(!li_hpack_huffman_decode(headers, huffman_eos, sizeof(huffman_eos)));
+	g_assert(!li_hpack_huffman_decode(headers, huffman_padding, sizeof(huffman_padding)));
+
+	li_hpack_decoder_init(&dec, LI_HPACK_DEFAULT_TABLE_SIZE);
+	/* index 62 isn't in the (empty) dynamic table */
+	hex_decode(block, "be");
+	g_assert(!li_hpack_decode(&dec, (const guint8*) block->str, block->len, collect_header, headers));
+	li_hpack_decoder_clear(&dec);
+
+	li_hpack_decoder_init(&dec, LI_HPACK_DEFAULT_TABLE_SIZE);
+	/* table size update larger than our setting */
+	hex_decode(block, "3fe1 7f");
+	g_assert(!li_hpack_decode(&dec, (const guint8*) block->str, block->len, collect_header, headers));
+	li_hpack_decoder_clear(&dec);
+
+	g_string_free(block, TRUE);
+	g_string_free(headers, TRUE);
+}
+
+static void test_encode_roundtrip(void) {
+	liHPackEncoder enc;
+	liHPackDecoder dec;
+	GString *block = g_string_sized_new(0), *headers = g_string_sized_new(0), *expected = g_string_sized_new(0);
+	gsize first_len = 0;
+	guint i;
+
+	li_hpack_encoder_init(&enc);
+	li_hpack_decoder_init(&dec, LI_HPACK_DEFAULT_TABLE_SIZE);
+
+	for (i = 0; i < 3; i++) {
+		g_string_truncate(block, 0);
+		g_string_truncate(headers, 0);
+		li_hpack_encode_start(&enc, block);
+		li_hpack_encode(&enc, block, CONST_STR_LEN(":status"), CONST_STR_LEN("200"));
+		li_hpack_encode(&enc, block, CONST_STR_LEN("content-type"), CONST_STR_LEN("text/html; charset=utf-8"));
+		li_hpack_encode(&enc, block, CONST_STR_LEN("content-length"), CONST_STR_LEN("1234"));
+		li_hpack_encode(&enc, block, CONST_STR_LEN("server"), CONST_STR_LEN("lighttpd/2.0.0"));
+		li_hpack_encode(&enc, block, CONST_STR_LEN("x-binary"), CONST_STR_LEN("\001\377~"));
+
+		g_assert(li_hpack_decode(&dec, (const guint8*) block->str, block->len, collect_header, headers));
+		g_assert_cmpstr(headers->str, ==, ":status: 200\ncontent-type: text/html; charset=utf-8\ncontent-length: 1234\nserver: lighttpd/2.0.0\nx-binary: \001\377~\n");
+
+		/* repeated headers come from the dynamic table */
+		if (0 == i) first_len = block->len;
+		else if (1 == i) g_assert_cmpuint(block->len, <, first_len);
+
+		/* the next block has to announce the new size */
+		if (1 == i) li_hpack_encoder_set_max_size(&enc, 0);
+	}
+	g_assert_cmpuint(enc.table.size, ==, 0);
+	g_assert_cmpuint(dec.table.size, ==, 0);
+
+	/* eviction keeps both tables in sync */
+	li_hpack_encoder_set_max_size(&enc, LI_HPACK_DEFAULT_TABLE_SIZE);
+	for (i = 0; i < 500; i++) {
+		gchar name[32], value[32];
+		gint name_len = g_snprintf(name, sizeof(name), "x-h%u", i), value_len = g_snprintf(value, sizeof(value), "value-%u", i * 7);
+
+		g_string_truncate(block, 0);
+		g_string_truncate(headers, 0);
+		li_hpack_encode_start(&enc, block);
+		li_hpack_encode(&enc, block, name, name_len, value, value_len);
+		li_hpack_encode(&enc, block, CONST_STR_LEN("x-h3"), CONST_STR_LEN("value-21"));
+
+		g_assert(li_hpack_decode(&dec, (const guint8*) block->str, block->len, collect_header, headers));
+		g_string_printf(expected, "%s: %s\nx-h3: value-21\n", name, value);
+		g_assert_cmpstr(headers->str, ==, expected->str);
+	}
+	g_assert_cmpuint(enc.table.size, ==, dec.table.size);
+	g_assert_cmpuint(enc.table.count, ==, dec.table.count);
+
+	li_hpack_encoder_clear(&enc);
+	li_hpack_decoder_clear(&dec);
+	g_string_free(block, TRUE);
+	g_string_free(headers, TRUE);
+	g_string_free(expected, TRUE);
+}
+
+static void test_huffman(void) {
+	GString *encoded = g_string_sized_new(0), *decoded = g_string_sized_new(0), *expected = g_string_sized_new(0);
+	guint8 all[256];
+	guint i;
+
+	/* C.4.1 */
+	li_hpack_huffman_encode(encoded, (const guint8*) CONST_STR_LEN("www.example.com"));
+	hex_decode(expected, "f1e3 c2e5 f23a 6ba0 ab90 f4ff");
+	g_assert_cmpuint(encoded->len, ==, expected->len);
+	g_assert(0 == memcmp(encoded->str, expected->str, expected->len));
+	g_assert_cmpuint(li_hpack_huffman_length((const guint8*) CONST_STR_LEN("www.example.com")), ==, expected->len);
+
+	for (i = 0; i < 256; i++) all[i] = i;
+	g_string_truncate(encoded, 0);
+	li_hpack_huffman_encode(encoded, all, sizeof(all));
+	g_assert_cmpuint(encoded->len, ==, li_hpack_huffman_length(all, sizeof(all)));
+	g_assert(li_hpack_huffman_decode(decoded, (const guint8*) encoded->str, encoded->len));
+	g_assert_cmpuint(decoded->len, ==, sizeof(all));
+	g_assert(0 == memcmp(decoded->str, all, sizeof(all)));
+
+	g_string_free(encoded, TRUE);
+	g_string_free(decoded, TRUE);
+	g_string_free(expected, TRUE);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/hpack/decode_requests", test_decode_requests);
+	g_test_add_func("/hpack/decode_eviction", test_decode_eviction);
+	g_test_add_func("/hpack/decode_invalid", test_decode_invalid);
+	g_test_add_func("/hpack/encode_roundtrip", test_encode_roundtrip);
+	g_test_add_func("/hpack/huffman", test_huffman);
+
+	return g_test_run();
+}
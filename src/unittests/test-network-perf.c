@@ -0,0 +1,168 @@
+
+#include <lighttpd/base.h>
+
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+/* benchmark for the write backends of li_network_write ("network.backend"); only sends a few
+ * responses outside of perf mode, to check all backends deliver everything:
+ *   test-network-perf -m perf
+ * reports the throughput over a loopback TCP connection and the number of syscalls li_network_write
+ * needed per response for typical responses.
+ */
+
+#define ROUNDS 20000
+#define HEADER_SIZE 300
+#define WRITE_MAX (256*1024)
+
+#define perror(msg) g_error("(%s:%i) %s failed: %s", __FILE__, __LINE__, msg, g_strerror(errno))
+
+typedef struct {
+	const gchar *name;
+	goffset mem_length;  /* body in memory */
+	goffset file_length; /* body from a file */
+	guint rounds;
+} response_type;
+
+static const response_type responses[] = {
+	{ "small dynamic", 4*1024, 0, ROUNDS },
+	{ "small file", 0, 8*1024, ROUNDS },
+	{ "large file", 0, 1024*1024, ROUNDS / 100 },
+};
+
+static void tcp_pair(int *client, int *server) {
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	int lfd;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	if (-1 == (lfd = socket(AF_INET, SOCK_STREAM, 0))) perror("socket");
+	if (-1 == bind(lfd, (struct sockaddr*) &addr, sizeof(addr))) perror("bind");
+	if (-1 == listen(lfd, 1)) perror("listen");
+	if (-1 == getsockname(lfd, (struct sockaddr*) &addr, &addrlen)) perror("getsockname");
+
+	if (-1 == (*client = socket(AF_INET, SOCK_STREAM, 0))) perror("socket");
+	if (-1 == connect(*client, (struct sockaddr*) &addr, sizeof(addr))) perror("connect");
+	if (-1 == (*server = accept(lfd, NULL, NULL))) perror("accept");
+	close(lfd);
+
+	li_fd_init(*client);
+	li_fd_init(*server);
+}
+
+static liChunkFile* body_file(goffset length) {
+	GString *name = g_string_sized_new(0);
+	GError *err = NULL;
+	gchar *path, *block;
+	goffset left;
+	liChunkFile *cf;
+	int fd;
+
+	if (-1 == (fd = g_file_open_tmp("li-network-perf-XXXXXX", &path, &err))) {
+		g_error("g_file_open_tmp failed: %s", err->message);
+	}
+	g_string_assign(name, path);
+	g_free(path);
+
+	block = g_malloc0(64*1024);
+	for (left = length; left > 0; left -= 64*1024) {
+		if (-1 == write(fd, block, MIN(left, 64*1024))) perror("write");
+	}
+	g_free(block);
+
+	cf = li_chunkfile_new(name, fd, TRUE);
+	g_string_free(name, TRUE);
+	return cf;
+}
+
+/* returns number of bytes read */
+static goffset drain(int fd) {
+	static gchar buf[64*1024];
+	goffset total = 0;
+	ssize_t r;
+
+	while (0 < (r = li_net_read(fd, buf, sizeof(buf)))) total += r;
+	if (-1 == r && EAGAIN != errno && EWOULDBLOCK != errno) perror("read");
+
+	return total;
+}
+
+static void send_responses(liNetworkBackend backend, const gchar *backend_name, const response_type *resp) {
+	liChunkQueue *cq = li_chunkqueue_new();
+	liChunkFile *cf = NULL;
+	gchar *header = g_malloc0(HEADER_SIZE), *body = NULL;
+	guint64 syscalls = 0;
+	goffset sent = 0, received = 0;
+	guint rounds = g_test_perf() ? resp->rounds : 10, i;
+	gdouble elapsed;
+	int client, server;
+
+	tcp_pair(&client, &server);
+	if (resp->mem_length > 0) body = g_malloc0(resp->mem_length);
+	if (resp->file_length > 0) cf = body_file(resp->file_length);
+
+	g_test_timer_start();
+	for (i = 0; i < rounds; i++) {
+		li_chunkqueue_append_mem(cq, header, HEADER_SIZE);
+		if (NULL != body) li_chunkqueue_append_mem(cq, body, resp->mem_length);
+		if (NULL != cf) li_chunkqueue_append_chunkfile(cq, cf, 0, resp->file_length);
+		sent += cq->length;
+
+		while (cq->length > 0) {
+			GError *err = NULL;
+
+			switch (li_network_write(server, cq, WRITE_MAX, backend, &syscalls, &err)) {
+			case LI_NETWORK_STATUS_SUCCESS:
+				break;
+			case LI_NETWORK_STATUS_WAIT_FOR_EVENT:
+				received += drain(client);
+				break;
+			default:
+				g_error("li_network_write failed: %s", NULL != err ? err->message : "connection closed");
+			}
+		}
+	}
+	while (received < sent) received += drain(client);
+	elapsed = g_test_timer_elapsed();
+
+	g_assert_cmpint(received, ==, sent);
+	if (g_test_perf()) {
+		g_test_maximized_result(sent / elapsed / (1024*1024), "%s, %s: %.1f MiB/s, %.2f syscalls per response",
+			backend_name, resp->name, sent / elapsed / (1024*1024), (gdouble) syscalls / rounds);
+	}
+
+	close(client);
+	close(server);
+	li_chunkfile_release(cf);
+	g_free(body);
+	g_free(header);
+	li_chunkqueue_free(cq);
+}
+
+static void perf_backend(gconstpointer data) {
+	const gchar *backend_name = data;
+	liNetworkBackend backend;
+	guint i;
+
+	g_assert(li_network_backend_from_string(backend_name, &backend));
+
+	for (i = 0; i < G_N_ELEMENTS(responses); i++) {
+		send_responses(backend, backend_name, &responses[i]);
+	}
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_data_func("/network-perf/write", "write", perf_backend);
+	g_test_add_data_func("/network-perf/writev", "writev", perf_backend);
+#ifdef USE_SENDFILE
+	g_test_add_data_func("/network-perf/sendfile", "sendfile", perf_backend);
+#endif
+
+	return g_test_run();
+}
@@ -0,0 +1,271 @@
+
+#include <lighttpd/base.h>
+
+/* a regex set has to return the same index (and captures) as trying the regexes one after another;
+ * the benchmark (only in perf mode: test-regex -m perf) compares both for a long rewrite list.
+ */
+
+#define PERF_RULES 200
+#define PERF_ROUNDS 20000
+
+static liRegex* new_regex(const gchar *pattern) {
+	GError *err = NULL;
+	liRegex *regex = li_regex_new(pattern, &err);
+
+	g_assert_no_error(err);
+	g_assert(NULL != regex);
+	return regex;
+}
+
+static void check_group(liRegexMatch *match, guint n, const gchar *expected) {
+	gsize start, end;
+
+	if (NULL == expected) {
+		g_assert(!li_regex_match_fetch_pos(match, n, &start, &end));
+	} else {
+		gchar *s;
+
+		g_assert(li_regex_match_fetch_pos(match, n, &start, &end));
+		s = g_strndup(li_regex_match_get_subject(match) + start, end - start);
+		g_assert_cmpstr(s, ==, expected);
+		g_free(s);
+	}
+}
+
+/* what a list of rewrite rules does */
+static guint linear_lookup(liRegexSet *set, const gchar *subject, liRegexMatch **match) {
+	guint i;
+
+	for (i = 0; i < li_regex_set_get_length(set); i++) {
+		liRegex *regex = li_regex_set_get(set, i);
+
+		if (NULL == regex) {
+			*match = NULL;
+			return i;
+		}
+		if (NULL != (*match = li_regex_match(regex, subject, strlen(subject), NULL))) return i;
+	}
+
+	return G_MAXUINT;
+}
+
+static void check_set(liRegexSet *set, const gchar *subject) {
+	liRegexMatch *match, *expected;
+	guint ndx, expected_ndx, i;
+
+	expected_ndx = linear_lookup(set, subject, &expected);
+	ndx = li_regex_set_match(set, subject, strlen(subject), &match, NULL);
+
+	g_assert_cmpuint(ndx, ==, expected_ndx);
+	g_assert_cmpuint(li_regex_set_match(set, subject, strlen(subject), NULL, NULL), ==, expected_ndx);
+	g_assert((NULL == match) == (NULL == expected));
+
+	if (NULL != match) {
+		g_assert_cmpuint(li_regex_match_get_count(match), ==, li_regex_match_get_count(expected));
+
+		for (i = 0; i <= li_regex_match_get_count(match); i++) {
+			gsize start1 = 0, end1 = 0, start2 = 0, end2 = 0;
+			gboolean r1 = li_regex_match_fetch_pos(match, i, &start1, &end1);
+			gboolean r2 = li_regex_match_fetch_pos(expected, i, &start2, &end2);
+
+			g_assert(r1 == r2);
+			g_assert_cmpuint(start1, ==, start2);
+			g_assert_cmpuint(end1, ==, end2);
+		}
+	}
+
+	li_regex_match_free(match);
+	li_regex_match_free(expected);
+}
+
+static void test_match(void) {
+	liRegex *regex = new_regex("^/(\\w+)/(x)?(\\d+)\\.html$");
+	liRegexMatch *match;
+	const gchar *subject = "/news/2024.html";
+	GError *err = NULL;
+
+	g_assert_cmpuint(li_regex_get_capture_count(regex), ==, 3);
+	g_assert(li_regex_test(regex, subject, strlen(subject), NULL));
+	g_assert(!li_regex_test(regex, subject, strlen(subject) - 1, NULL));
+
+	match = li_regex_match(regex, subject, strlen(subject), NULL);
+	g_assert(NULL != match);
+	g_assert_cmpuint(li_regex_match_get_count(match), ==, 4);
+	check_group(match, 0, subject);
+	check_group(match, 1, "news");
+	check_group(match, 2, NULL);
+	check_group(match, 3, "2024");
+	check_group(match, 4, NULL);
+	li_regex_match_free(match);
+
+	g_assert(NULL == li_regex_match(regex, "/news/", 6, NULL));
+	li_regex_free(regex);
+
+	/* raw bytes, no utf-8 validation */
+	regex = new_regex("^\\xff(.)$");
+	g_assert(li_regex_test(regex, "\xff\xfe", 2, NULL));
+	li_regex_free(regex);
+
+	g_assert(NULL == li_regex_new("(unbalanced", &err));
+	g_assert(NULL != err);
+	g_error_free(err);
+}
+
+static void test_set_first_match(void) {
+	liRegexSet *set = li_regex_set_new();
+	static const gchar *patterns[] = {
+		"^/static/(.*)$",
+		"\\.(php|cgi)$",
+		"(?i)^/ADMIN(/.*)?$",
+		"bar",
+		"foo(bar)?",
+		"^/(a)(b)?(c)(d)(e)(f)(g)(h)(i)(j)(k)(l)$",
+		"^/old|\\.bak$",
+		"^/(x)|^/(y)",
+		"(?<=/)index",
+		"^/$",
+		NULL
+	};
+	static const gchar *subjects[] = {
+		"", "/", "/static/x.php", "/x.php", "/x.cgi", "/admin", "/Admin/users", "/administrator",
+		"/foobar", "/barfoo", "/foo", "/abcdefghijkl", "/abdefghijkl", "/x", "/y", "/index.html", "index",
+		"/x.bak", "/old/x",
+		NULL
+	};
+	guint i;
+
+	for (i = 0; NULL != patterns[i]; i++) {
+		li_regex_set_add(set, new_regex(patterns[i]));
+	}
+#ifdef HAVE_PCRE2
+	g_assert(li_regex_set_compile(set));
+#else
+	li_regex_set_compile(set);
+#endif
+
+	for (i = 0; NULL != subjects[i]; i++) {
+		check_set(set, subjects[i]);
+	}
+
+	/* "foo(bar)?" matches earlier in the subject, but "bar" comes first in the list */
+	g_assert_cmpuint(li_regex_set_match(set, "/foobar", 7, NULL, NULL), ==, 3);
+
+	li_regex_set_free(set);
+}
+
+static void test_set_special(void) {
+	liRegexSet *set;
+
+	/* backtracking verbs are not combined */
+	set = li_regex_set_new();
+	li_regex_set_add(set, new_regex("a(*COMMIT)b"));
+	li_regex_set_add(set, new_regex("ac"));
+	g_assert(!li_regex_set_compile(set));
+	check_set(set, "ac");
+	check_set(set, "xab");
+	li_regex_set_free(set);
+
+	/* NULL matches everything */
+	set = li_regex_set_new();
+	li_regex_set_add(set, new_regex("^/a"));
+	li_regex_set_add(set, new_regex("^/b(.*)"));
+	li_regex_set_add(set, NULL);
+	li_regex_set_add(set, new_regex("^/c"));
+	li_regex_set_compile(set);
+	check_set(set, "/a");
+	check_set(set, "/bcd");
+	check_set(set, "/c");
+	g_assert_cmpuint(li_regex_set_match(set, "/c", 2, NULL, NULL), ==, 2);
+	li_regex_set_free(set);
+
+	/* nothing to combine, still works */
+	set = li_regex_set_new();
+	g_assert(!li_regex_set_compile(set));
+	g_assert_cmpuint(li_regex_set_match(set, "/", 1, NULL, NULL), ==, G_MAXUINT);
+	li_regex_set_free(set);
+}
+
+static void test_match_error(void) {
+	liRegex *regex = new_regex("^(a+)+$");
+	liRegexSet *set;
+	/* catastrophic backtracking hits the match limit: an error, not just "no match" */
+	const gchar *subject = "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaab";
+	GError *err = NULL;
+
+	g_assert(!li_regex_test(regex, subject, strlen(subject), &err));
+	g_assert(NULL != err);
+	g_clear_error(&err);
+
+	g_assert(NULL == li_regex_match(regex, subject, strlen(subject), &err));
+	g_assert(NULL != err);
+	g_clear_error(&err);
+
+	g_assert(!li_regex_test(regex, CONST_STR_LEN("aaab"), &err));
+	g_assert_no_error(err);
+
+	set = li_regex_set_new();
+	li_regex_set_add(set, new_regex("^/never"));
+	li_regex_set_add(set, regex);
+	li_regex_set_compile(set);
+	g_assert_cmpuint(li_regex_set_match(set, subject, strlen(subject), NULL, &err), ==, G_MAXUINT);
+	g_assert(NULL != err);
+	g_clear_error(&err);
+	li_regex_set_free(set);
+}
+
+static void perf_rewrite_list(void) {
+	liRegexSet *set;
+	GString *str;
+	gdouble linear_time, set_time;
+	guint i, sum_linear = 0, sum_set = 0;
+
+	if (!g_test_perf()) return;
+
+	set = li_regex_set_new();
+	str = g_string_sized_new(0);
+
+	for (i = 0; i < PERF_RULES; i++) {
+		g_string_printf(str, "^/section%u/([^/]+)/(\\d+)$", i);
+		li_regex_set_add(set, new_regex(str->str));
+	}
+	li_regex_set_compile(set);
+
+	g_test_timer_start();
+	for (i = 0; i < PERF_ROUNDS; i++) {
+		liRegexMatch *match;
+
+		g_string_printf(str, "/section%u/article/%u", (i * 7919) % (PERF_RULES + PERF_RULES / 10), i);
+		sum_linear += linear_lookup(set, str->str, &match);
+		li_regex_match_free(match);
+	}
+	linear_time = g_test_timer_elapsed();
+
+	g_test_timer_start();
+	for (i = 0; i < PERF_ROUNDS; i++) {
+		liRegexMatch *match;
+
+		g_string_printf(str, "/section%u/article/%u", (i * 7919) % (PERF_RULES + PERF_RULES / 10), i);
+		sum_set += li_regex_set_match(set, str->str, str->len, &match, NULL);
+		li_regex_match_free(match);
+	}
+	set_time = g_test_timer_elapsed();
+
+	g_assert_cmpuint(sum_linear, ==, sum_set);
+	g_test_minimized_result(linear_time * 1e9 / PERF_ROUNDS, "%u rules, one after another: %.1f ns per lookup", PERF_RULES, linear_time * 1e9 / PERF_ROUNDS);
+	g_test_minimized_result(set_time * 1e9 / PERF_ROUNDS, "%u rules, regex set: %.1f ns per lookup", PERF_RULES, set_time * 1e9 / PERF_ROUNDS);
+
+	g_string_free(str, TRUE);
+	li_regex_set_free(set);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/regex/match", test_match);
+	g_test_add_func("/regex/set_first_match", test_set_first_match);
+	g_test_add_func("/regex/set_special", test_set_special);
+	g_test_add_func("/regex/match_error", test_match_error);
+	g_test_add_func("/regex/perf_rewrite_list", perf_rewrite_list);
+
+	return g_test_run();
+}
@@ -0,0 +1,255 @@
+
+#include <lighttpd/base.h>
+
+#include "../modules/ssl-session-db.h"
+#include "../modules/ssl-ticket-keys.h"
+
+static void session_key(guint i, gchar *buf, gsize len) {
+	g_snprintf(buf, len, "session-%u", i);
+}
+
+static liSSLSessionDBShard* session_shard(liSSLSessionDB *sdb, const gchar *key) {
+	liSSLSessionDBKey *dkey = li_ssl_session_db_key_new((const unsigned char*) key, strlen(key));
+	liSSLSessionDBShard *shard = li_ssl_session_db_shard(sdb, dkey);
+	li_ssl_session_db_key_free_cb(dkey);
+	return shard;
+}
+
+static gboolean session_lookup(liSSLSessionDB *sdb, const gchar *key, const gchar *value) {
+	liSSLSessionDBData *data = li_ssl_session_db_lookup(sdb, (const unsigned char*) key, strlen(key));
+	gboolean found;
+
+	if (NULL == data) return FALSE;
+	found = (data->size == strlen(value) && 0 == memcmp(data->data, value, data->size));
+	li_ssl_session_db_data_release(data);
+	g_assert(found);
+	return TRUE;
+}
+
+static void session_store(liSSLSessionDB *sdb, const gchar *key, const gchar *value) {
+	li_ssl_session_db_store(sdb, (const unsigned char*) key, strlen(key), (const unsigned char*) value, strlen(value));
+}
+
+static void test_session_db_store_lookup(void) {
+	liSSLSessionDB *sdb = li_ssl_session_db_new(1024, 0);
+	liSSLSessionDBData *data;
+
+	g_assert(!session_lookup(sdb, "a", "1"));
+	session_store(sdb, "a", "1");
+	session_store(sdb, "b", "2");
+	g_assert(session_lookup(sdb, "a", "1"));
+	g_assert(session_lookup(sdb, "b", "2"));
+
+	/* lookups keep a reference; replacing the entry doesn't free the data */
+	data = li_ssl_session_db_lookup(sdb, (const unsigned char*) CONST_STR_LEN("a"));
+	session_store(sdb, "a", "3");
+	g_assert(1 == data->size && '1' == data->data[0]);
+	li_ssl_session_db_data_release(data);
+	g_assert(session_lookup(sdb, "a", "3"));
+
+	li_ssl_session_db_remove(sdb, (const unsigned char*) CONST_STR_LEN("a"));
+	g_assert(!session_lookup(sdb, "a", "3"));
+	g_assert(session_lookup(sdb, "b", "2"));
+
+	li_ssl_session_db_free(sdb);
+}
+
+static void test_session_db_lru(void) {
+	liSSLSessionDB *sdb = li_ssl_session_db_new(1, 0);
+	gchar first[32], second[32], third[32], other[32];
+	liSSLSessionDBShard *shard;
+	guint i = 0;
+
+	/* find three keys in the same shard */
+	session_key(i++, first, sizeof(first));
+	shard = session_shard(sdb, first);
+	do { session_key(i++, second, sizeof(second)); } while (session_shard(sdb, second) != shard);
+	do { session_key(i++, third, sizeof(third)); } while (session_shard(sdb, third) != shard);
+	do { session_key(i++, other, sizeof(other)); } while (session_shard(sdb, other) == shard);
+
+	session_store(sdb, first, "1");
+	g_assert(session_lookup(sdb, first, "1"));
+	session_store(sdb, second, "2");
+	g_assert(!session_lookup(sdb, first, "1"));
+	g_assert(session_lookup(sdb, second, "2"));
+	g_assert(1 == shard->keys.length && 1 == g_hash_table_size(shard->db));
+
+	/* the limit covers all shards */
+	session_store(sdb, other, "4");
+	g_assert(!session_lookup(sdb, second, "2"));
+	g_assert(session_lookup(sdb, other, "4"));
+	g_assert(0 == shard->keys.length && 1 == sdb->entries);
+
+	li_ssl_session_db_free(sdb);
+
+	/* the least recently used entry gets dropped, lookups count as use */
+	sdb = li_ssl_session_db_new(2, 0);
+	shard = session_shard(sdb, first);
+	session_store(sdb, first, "1");
+	session_store(sdb, second, "2");
+	g_assert(session_lookup(sdb, first, "1"));
+	session_store(sdb, third, "3");
+	g_assert(session_lookup(sdb, first, "1"));
+	g_assert(!session_lookup(sdb, second, "2"));
+	g_assert(session_lookup(sdb, third, "3"));
+	g_assert(2 == shard->keys.length && 2 == sdb->entries);
+
+	li_ssl_session_db_free(sdb);
+}
+
+static void expire_all(liSSLSessionDB *sdb) {
+	guint i;
+	GList *l;
+
+	for (i = 0; i < LI_SSL_SESSION_DB_SHARDS; i++) {
+		for (l = sdb->shards[i].keys.head; NULL != l; l = l->next) {
+			liSSLSessionDBKey *key = LI_CONTAINER_OF(l, liSSLSessionDBKey, keys_link);
+			g_assert(0 != key->expires);
+			key->expires = time(NULL) - 1;
+		}
+	}
+}
+
+static void test_session_db_ttl(void) {
+	liSSLSessionDB *sdb = li_ssl_session_db_new(1024, 300);
+	gchar key[32];
+	guint i;
+
+	session_store(sdb, "a", "1");
+	g_assert(session_lookup(sdb, "a", "1"));
+
+	expire_all(sdb);
+	g_assert(!session_lookup(sdb, "a", "1"));
+
+	/* storing purges expired entries of the shard */
+	for (i = 0; i < 64; i++) {
+		session_key(i, key, sizeof(key));
+		session_store(sdb, key, "x");
+	}
+	expire_all(sdb);
+	for (i = 64; i < 128; i++) {
+		session_key(i, key, sizeof(key));
+		session_store(sdb, key, "y");
+	}
+	for (i = 0; i < LI_SSL_SESSION_DB_SHARDS; i++) {
+		g_assert(sdb->shards[i].keys.length == g_hash_table_size(sdb->shards[i].db));
+	}
+	for (i = 0; i < 64; i++) {
+		session_key(i, key, sizeof(key));
+		g_assert(!session_lookup(sdb, key, "x"));
+	}
+	for (i = 64; i < 128; i++) {
+		session_key(i, key, sizeof(key));
+		g_assert(session_lookup(sdb, key, "y"));
+	}
+
+	li_ssl_session_db_free(sdb);
+}
+
+static void ticket_key(liSSLTicketKey *key, gchar c) {
+	memset(key->name, c, sizeof(key->name));
+	memset(key->hmac_secret, c + 1, sizeof(key->hmac_secret));
+	memset(key->aes_key, c + 2, sizeof(key->aes_key));
+}
+
+static void write_ticket_keys(const gchar *filename, const gchar *names, gsize extra) {
+	GString *contents = g_string_sized_new(0);
+	GError *err = NULL;
+
+	for (; '\0' != *names; names++) {
+		liSSLTicketKey key;
+		ticket_key(&key, *names);
+		g_string_append_len(contents, (const gchar*) key.name, sizeof(key.name));
+		g_string_append_len(contents, (const gchar*) key.hmac_secret, sizeof(key.hmac_secret));
+		g_string_append_len(contents, (const gchar*) key.aes_key, sizeof(key.aes_key));
+	}
+	for (; extra > 0; extra--) g_string_append_c(contents, 'x');
+
+	if (!g_file_set_contents(filename, GSTR_LEN(contents), &err)) {
+		g_error("g_file_set_contents failed: %s", err->message);
+	}
+	g_string_free(contents, TRUE);
+}
+
+static void assert_ticket_key(liSSLTicketKeys *tk, gchar name, int expected) {
+	liSSLTicketKey key, wanted;
+
+	ticket_key(&wanted, name);
+	g_assert_cmpint(expected, ==, li_ssl_ticket_keys_find(tk, wanted.name, &key));
+	if (0 != expected) g_assert(0 == memcmp(&key, &wanted, sizeof(key)));
+}
+
+static void test_ticket_keys_rotation(void) {
+	GError *err = NULL;
+	gchar *filename;
+	liSSLTicketKeys *tk;
+	liSSLTicketKey key, wanted;
+	int fd;
+
+	if (-1 == (fd = g_file_open_tmp("li-ticket-keys-XXXXXX", &filename, &err))) {
+		g_error("g_file_open_tmp failed: %s", err->message);
+	}
+	close(fd);
+
+	/* empty file and incomplete keys are rejected */
+	g_assert(NULL == li_ssl_ticket_keys_new(filename, &err));
+	g_assert(NULL != err);
+	g_clear_error(&err);
+	write_ticket_keys(filename, "a", 1);
+	g_assert(NULL == li_ssl_ticket_keys_new(filename, &err));
+	g_clear_error(&err);
+
+	write_ticket_keys(filename, "ab", 0);
+	tk = li_ssl_ticket_keys_new(filename, &err);
+	g_assert(NULL != tk);
+
+	/* the first key encrypts new tickets, all keys decrypt */
+	ticket_key(&wanted, 'a');
+	g_assert(li_ssl_ticket_keys_current(tk, &key));
+	g_assert(0 == memcmp(&key, &wanted, sizeof(key)));
+	assert_ticket_key(tk, 'a', 1);
+	assert_ticket_key(tk, 'b', 2);
+	assert_ticket_key(tk, 'c', 0);
+
+	/* rotate: new current key, the old one still decrypts; the file is only checked after the interval */
+	write_ticket_keys(filename, "ca", 0);
+	g_assert(li_ssl_ticket_keys_check(tk, &err));
+	assert_ticket_key(tk, 'a', 1);
+
+	tk->last_check = 0;
+	g_assert(li_ssl_ticket_keys_check(tk, &err));
+	ticket_key(&wanted, 'c');
+	g_assert(li_ssl_ticket_keys_current(tk, &key));
+	g_assert(0 == memcmp(&key, &wanted, sizeof(key)));
+	assert_ticket_key(tk, 'c', 1);
+	assert_ticket_key(tk, 'a', 2);
+	assert_ticket_key(tk, 'b', 0);
+
+	/* a broken file keeps the old keys */
+	write_ticket_keys(filename, "d", 3);
+	tk->last_check = 0;
+	g_assert(!li_ssl_ticket_keys_check(tk, &err));
+	g_clear_error(&err);
+	assert_ticket_key(tk, 'c', 1);
+	assert_ticket_key(tk, 'd', 0);
+
+	/* so does a missing file */
+	unlink(filename);
+	tk->last_check = 0;
+	g_assert(li_ssl_ticket_keys_check(tk, &err));
+	assert_ticket_key(tk, 'c', 1);
+
+	li_ssl_ticket_keys_free(tk);
+	g_free(filename);
+}
+
+int main(int argc, char **argv) {
+	g_test_init(&argc, &argv, NULL);
+
+	g_test_add_func("/ssl/session_db/store_lookup", test_session_db_store_lookup);
+	g_test_add_func("/ssl/session_db/lru", test_session_db_lru);
+	g_test_add_func("/ssl/session_db/ttl", test_session_db_ttl);
+	g_test_add_func("/ssl/ticket_keys/rotation", test_ticket_keys_rotation);
+
+	return g_test_run();
+}
@@ -8,6 +8,16 @@ import zlib
 import bz2
 import os
 
+try:
+	import brotli
+except ImportError:
+	brotli = None
+
+try:
+	import zstandard
+except ImportError:
+	zstandard = None
+
 from base import *
 
 TEST_TXT="""Hi!
@@ -29,6 +39,7 @@ class CurlRequest(TestBase):
 	POST = None
 	REQUEST_HEADERS = []
 	ACCEPT_ENCODING = "deflate, gzip"
+	HTTP_VERSION = None # pycurl.CURL_HTTP_VERSION_* value
 
 	EXPECT_RESPONSE_BODY = None
 	EXPECT_RESPONSE_CODE = None
@@ -89,6 +100,7 @@ class CurlRequest(TestBase):
 		c.setopt(pycurl.WRITEFUNCTION, b.write)
 		c.setopt(pycurl.HEADERFUNCTION, self._recv_header)
 		if None != self.POST: c.setopt(pycurl.POSTFIELDS, self.POST)
+		if None != self.HTTP_VERSION: c.setopt(pycurl.HTTP_VERSION, self.HTTP_VERSION)
 
 		if None != self.AUTH:
 			c.setopt(pycurl.USERPWD, self.AUTH)
@@ -143,6 +155,10 @@ class CurlRequest(TestBase):
 			raise CurlRequestException("Unsupported content-encoding %s" % method)
 		elif 'x-bzip2' == method or 'bzip2' == method:
 			return bz2.decompress(data)
+		elif 'br' == method and None != brotli:
+			return brotli.decompress(data)
+		elif 'zstd' == method and None != zstandard:
+			return zstandard.ZstdDecompressor().decompressobj().decompress(data)
 		else:
 			raise CurlRequestException("Unsupported content-encoding %s" % method)
 
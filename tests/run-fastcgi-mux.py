@@ -0,0 +1,159 @@
+#!/usr/bin/env python
+# -*- coding: utf-8 -*-
+
+# FastCGI backend which multiplexes requests on a connection (FCGI_MPXS_CONNS).
+# the QUERY_STRING selects the response:
+#   conn:  number of the backend connection the request came in
+#   delay: same as conn, but answered 1 second later (other requests are handled meanwhile)
+#   big:   BIG_LINES lines "%07i\n"
+#   post:  length of the request body
+
+import socket
+import select
+import struct
+import time
+import traceback
+
+FCGI_BEGIN_REQUEST = 1
+FCGI_ABORT_REQUEST = 2
+FCGI_END_REQUEST = 3
+FCGI_PARAMS = 4
+FCGI_STDIN = 5
+FCGI_STDOUT = 6
+FCGI_GET_VALUES = 9
+FCGI_GET_VALUES_RESULT = 10
+
+FCGI_KEEP_CONN = 1
+
+MAX_REQS = 8
+BIG_LINES = 256*1024
+
+servsocket = socket.fromfd(0, socket.AF_UNIX, socket.SOCK_STREAM)
+
+def record(rtype, reqid, content):
+	res = ''
+	while True:
+		part, content = content[:0xffff], content[0xffff:]
+		padding = (8 - len(part) % 8) % 8
+		res += struct.pack('!BBHHBx', 1, rtype, reqid, len(part), padding) + part + '\0' * padding
+		if 0 == len(content): return res
+
+def decode_len(data, pos):
+	if ord(data[pos]) < 128: return (ord(data[pos]), pos + 1)
+	return (struct.unpack('!I', data[pos:pos+4])[0] & 0x7fffffff, pos + 4)
+
+def decode_pairs(data):
+	pairs = dict()
+	pos = 0
+	while pos < len(data):
+		klen, pos = decode_len(data, pos)
+		vlen, pos = decode_len(data, pos)
+		pairs[data[pos:pos+klen]] = data[pos+klen:pos+klen+vlen]
+		pos += klen + vlen
+	return pairs
+
+def encode_pair(key, value):
+	return chr(len(key)) + chr(len(value)) + key + value
+
+class Request(object):
+	def __init__(self, reqid, keepconn):
+		self.reqid = reqid
+		self.keepconn = keepconn
+		self.params = ''
+		self.body = ''
+
+class Connection(object):
+	def __init__(self, sock, num):
+		self.sock = sock
+		self.num = num
+		self.buf = ''
+		self.requests = dict()
+		self.close = False
+
+	def respond(self, req, body):
+		if not self.requests.has_key(req.reqid): return # aborted
+		del self.requests[req.reqid]
+		out = "Status: 200\r\nContent-Type: text/plain\r\n\r\n" + body
+		self.sock.sendall(record(FCGI_STDOUT, req.reqid, out) + record(FCGI_STDOUT, req.reqid, '')
+			+ record(FCGI_END_REQUEST, req.reqid, struct.pack('!IB3x', 0, 0)))
+		if not req.keepconn: self.close = True
+
+	def handle(self, req):
+		query = decode_pairs(req.params).get('QUERY_STRING', '')
+		if query == 'delay':
+			timers.append((time.time() + 1, self, req, str(self.num)))
+		elif query == 'big':
+			self.respond(req, ''.join(["%07i\n" % i for i in xrange(BIG_LINES)]))
+		elif query == 'post':
+			self.respond(req, str(len(req.body)))
+		else:
+			self.respond(req, str(self.num))
+
+	def parse(self):
+		while len(self.buf) >= 8:
+			version, rtype, reqid, clen, plen = struct.unpack('!BBHHBx', self.buf[:8])
+			if len(self.buf) < 8 + clen + plen: return
+			content = self.buf[8:8+clen]
+			self.buf = self.buf[8+clen+plen:]
+			if rtype == FCGI_GET_VALUES:
+				names = decode_pairs(content)
+				values = ''
+				if names.has_key('FCGI_MPXS_CONNS'): values += encode_pair('FCGI_MPXS_CONNS', '1')
+				if names.has_key('FCGI_MAX_REQS'): values += encode_pair('FCGI_MAX_REQS', str(MAX_REQS))
+				self.sock.sendall(record(FCGI_GET_VALUES_RESULT, 0, values))
+			elif rtype == FCGI_BEGIN_REQUEST:
+				role, flags = struct.unpack('!HB5x', content)
+				self.requests[reqid] = Request(reqid, 0 != (flags & FCGI_KEEP_CONN))
+			elif rtype == FCGI_ABORT_REQUEST:
+				if self.requests.has_key(reqid):
+					self.respond(self.requests[reqid], '')
+			elif not self.requests.has_key(reqid):
+				pass
+			elif rtype == FCGI_PARAMS:
+				self.requests[reqid].params += content
+			elif rtype == FCGI_STDIN:
+				if 0 == clen:
+					self.handle(self.requests[reqid])
+				else:
+					self.requests[reqid].body += content
+
+connections = dict()
+timers = []
+numcons = 0
+
+try:
+	while 1:
+		timeout = None
+		if len(timers) > 0: timeout = max(0, min([t[0] for t in timers]) - time.time())
+		readable = select.select([servsocket] + connections.keys(), [], [], timeout)[0]
+
+		now = time.time()
+		for t in [t for t in timers if t[0] <= now]:
+			timers.remove(t)
+			if not t[1].close and connections.has_key(t[1].sock): t[1].respond(t[2], t[3])
+
+		for sock in readable:
+			if sock == servsocket:
+				conn, addr = servsocket.accept()
+				numcons += 1
+				connections[conn] = Connection(conn, numcons)
+				continue
+			con = connections[sock]
+			try:
+				data = sock.recv(64*1024)
+				if 0 == len(data):
+					con.close = True
+				else:
+					con.buf += data
+					con.parse()
+			except KeyboardInterrupt:
+				raise
+			except Exception:
+				print traceback.format_exc()
+				con.close = True
+
+		for con in [con for con in connections.values() if con.close]:
+			del connections[con.sock]
+			con.sock.close()
+except KeyboardInterrupt:
+	pass
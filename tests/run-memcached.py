@@ -1,12 +1,21 @@
 #!/usr/bin/env python
 # -*- coding: utf-8 -*-
 
+# memcached stub speaking the text protocol and the meta commands mg / ms.
+# options:
+#   --meta-only: answer text protocol commands with ERROR
+#   --hang:      accept connections, but never answer
+
 import asyncore
 import socket
+import sys
 import time
 import random
 import traceback
 
+META_ONLY = '--meta-only' in sys.argv[1:]
+HANG = '--hang' in sys.argv[1:]
+
 class MemcacheEntry:
 	def __init__(self, flags, exptime, data, cas):
 		self.flags = flags
@@ -68,6 +77,10 @@ class MemcacheDB:
 		self.d[key] = MemcacheEntry(flags, exptime, data, self._next_cas())
 		return "STORED"
 
+	def meta_set(self, key, flags, exptime, data):
+		self.d[key] = MemcacheEntry(flags, exptime, data, self._next_cas())
+		return "HD"
+
 	def add(self, key, flags, exptime, data):
 		if None != self.get(key): return "NOT_STORED"
 		self.d[key] = MemcacheEntry(flags, exptime, data, self._next_cas())
@@ -197,6 +210,10 @@ class MemcachedHandler(asyncore.dispatcher_with_send):
 		if len(args) == 0: return _client_error("empty command")
 		cmd = args[0]
 		args = args[1:]
+		if cmd in ['mg', 'ms']:
+			return self._handle_meta(cmd, args)
+		if META_ONLY:
+			return self._error("text protocol disabled")
 		noreply = False
 		if args[-1] == "noreply":
 			args.pop()
@@ -236,6 +253,34 @@ class MemcachedHandler(asyncore.dispatcher_with_send):
 		else:
 			return self._error()
 
+	def _handle_meta(self, cmd, args):
+		if len(args) < 1: return self._client_error("missing key")
+		key = args[0]
+		if cmd == 'mg':
+			# mg <key> <flags>*: v returns the value, f the client flags
+			entry = self.db.get(key)
+			if entry == None:
+				self.send('EN\r\n')
+				return
+			rflags = ''
+			if 'f' in args[1:]: rflags += ' f%s' % (entry.flags)
+			if 'v' in args[1:]:
+				self.send('VA %i%s\r\n%s\r\n' % (len(entry.data), rflags, entry.data))
+			else:
+				self.send('HD%s\r\n' % (rflags))
+		else:
+			# ms <key> <datalen> <flags>*: F<client flags> T<ttl>
+			if len(args) < 2: return self._client_error("missing data length")
+			flags, exptime = '0', '0'
+			for flag in args[2:]:
+				if flag[0] == 'F': flags = flag[1:]
+				elif flag[0] == 'T': exptime = flag[1:]
+			self.want_binary = int(args[1])
+			if self.want_binary < 0: return self._client_error("negative bytes length")
+			self.args = [key, flags, exptime]
+			self.cmd = 'meta_set'
+			self.noreply = False
+
 	def _handle_data(self):
 		while len(self.data) > 0:
 			if self.want_binary != None:
@@ -259,6 +304,9 @@ class MemcachedHandler(asyncore.dispatcher_with_send):
 
 	def handle_read(self):
 		self.data += self.recv(8192)
+		if HANG:
+			self.data = ''
+			return
 		try:
 			self._handle_data()
 		except TypeError as e:
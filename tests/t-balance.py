@@ -0,0 +1,102 @@
+# -*- coding: utf-8 -*-
+
+from base import *
+from requests import *
+import pycurl
+import StringIO
+import time
+
+KEYS = [ "k%i" % i for i in xrange(16) ]
+
+def get(vhost, key, fail = False):
+	c = pycurl.Curl()
+	b = StringIO.StringIO()
+	headers = ["Host: " + vhost]
+	if fail: headers.append("X-Fail: 1")
+	c.setopt(pycurl.URL, "http://127.0.0.2:%i/?%s" % (Env.port, key))
+	c.setopt(pycurl.HTTPHEADER, headers)
+	c.setopt(pycurl.WRITEFUNCTION, b.write)
+	c.setopt(pycurl.NOSIGNAL, 1)
+	c.setopt(pycurl.TIMEOUT, 5)
+	try:
+		c.perform()
+		if 200 != c.getinfo(pycurl.RESPONSE_CODE):
+			raise CurlRequestException("Unexpected response code %i (wanted 200)" % (c.getinfo(pycurl.RESPONSE_CODE)))
+	finally:
+		c.close()
+	return b.getvalue()
+
+def mapping(vhost):
+	return dict([ (key, get(vhost, key)) for key in KEYS ])
+
+class TestHashStable(TestBase):
+	"""the same key always selects the same backend, and the keys are spread over the backends"""
+	no_docroot = True
+	config = """
+balance_ab;
+"""
+
+	def Run(self):
+		first = mapping(self.vhost)
+		for i in xrange(2):
+			if first != mapping(self.vhost):
+				raise CurlRequestException("keys moved between backends")
+		if set(first.values()) != set(["a", "b"]):
+			raise CurlRequestException("not all backends used: %s" % (first))
+		return True
+
+class TestHashRevive(TestBase):
+	"""a backend which failed gets its keys back after the wake up time"""
+	no_docroot = True
+	config = """
+balance_ab;
+"""
+
+	def Run(self):
+		before = mapping(self.vhost)
+		bkey = [ key for key in KEYS if before[key] == "b" ][0]
+		akeys = [ key for key in KEYS if before[key] == "a" ]
+
+		# backend b fails: fallback to a
+		if "a" != get(self.vhost, bkey, fail = True):
+			raise CurlRequestException("no fallback for failed backend")
+		# b is down now: its keys go to a, the keys of a don't move
+		if "a" != get(self.vhost, bkey):
+			raise CurlRequestException("backend used although it is down")
+		for key in akeys:
+			if "a" != get(self.vhost, key):
+				raise CurlRequestException("key '%s' of alive backend moved" % (key))
+
+		# dead backends get retried after a second
+		time.sleep(1.5)
+		if "b" != get(self.vhost, bkey):
+			raise CurlRequestException("backend not revived")
+		if before != mapping(self.vhost):
+			raise CurlRequestException("keys not back on their backends after revival")
+		return True
+
+class Test(GroupTest):
+	group = [
+		TestHashStable,
+		TestHashRevive,
+	]
+
+	def FeatureCheck(self):
+		# the backend "b" fails with an unreachable proxy backend if the request has "X-Fail: 1"
+		self.plain_config = """
+setup { module_load [ "mod_balance", "mod_proxy" ]; }
+
+balance_ab = {
+	balance.hash ( "%{req.query}", (
+		{ respond 200 => "a"; },
+		{
+			if req.header["X-Fail"] == "1" {
+				proxy "127.0.0.1:1";
+			} else {
+				respond 200 => "b";
+			}
+		}
+	));
+};
+"""
+		return True
@@ -3,6 +3,8 @@
 from base import *
 from requests import *
 
+import time
+
 class DeflateRequest(CurlRequest):
 	URL = "/test.txt"
 	EXPECT_RESPONSE_BODY = TEST_TXT
@@ -32,6 +34,104 @@ class TestBzip2(DeflateRequest):
 class TestXBzip2(DeflateRequest):
 	ACCEPT_ENCODING = 'x-bzip2'
 
+# brotli and zstd are optional (server and python modules)
+class OptionalDeflateRequest(CurlRequest):
+	URL = "/test.txt"
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+
+	def CheckResponse(self):
+		enc = self.resp_headers.get("content-encoding")
+		if None != enc and enc != self.ACCEPT_ENCODING:
+			raise CurlRequestException("Unexpected content-encoding '%s' (wanted '%s' or none)" % (enc, self.ACCEPT_ENCODING))
+		return super(OptionalDeflateRequest, self).CheckResponse()
+
+class TestBrotli(OptionalDeflateRequest):
+	ACCEPT_ENCODING = 'br'
+
+	def FeatureCheck(self):
+		if None == brotli:
+			return self.MissingFeature('python brotli')
+		return True
+
+class TestZstd(OptionalDeflateRequest):
+	ACCEPT_ENCODING = 'zstd'
+
+	def FeatureCheck(self):
+		if None == zstandard:
+			return self.MissingFeature('python zstandard')
+		return True
+
+class TestQValues(CurlRequest):
+	URL = "/test.txt"
+	ACCEPT_ENCODING = 'gzip;q=0.5, deflate;q=0.8'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "deflate")]
+
+class TestQZero(CurlRequest):
+	URL = "/test.txt"
+	ACCEPT_ENCODING = 'gzip;q=0, deflate;q=0.000'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", None)]
+
+class TestServerPreference(CurlRequest):
+	# same q-value: server order (gzip before deflate) wins
+	URL = "/test.txt"
+	ACCEPT_ENCODING = 'deflate, gzip'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip")]
+
+class TestAdaptive(CurlRequest):
+	# idle worker: adaptive compression uses the configured level
+	URL = "/test.txt?adaptive"
+	ACCEPT_ENCODING = 'gzip'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip")]
+
+class TestAdaptiveOverload(CurlRequest):
+	# thresholds of 0%: every stats interval counts as overloaded. the levels go down one step per
+	# interval (a second, per worker); once at the minimum, responses above 1 byte aren't compressed
+	URL = "/test.txt?overload"
+	ACCEPT_ENCODING = 'gzip'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", None)]
+
+	def Run(self):
+		for i in xrange(10):
+			time.sleep(1.1)
+			self.resp_header_list = []
+			self.resp_headers = { }
+			self.resp_first_line = None
+			self.resp_body = None
+			try:
+				return super(TestAdaptiveOverload, self).Run()
+			except CurlRequestException:
+				if i == 9: raise
+
+class TestAdaptiveSkipped(CurlRequest):
+	# the skipped response above shows up in the status counters
+	URL = "/?format=plain"
+	vhost = "deflate-status"
+	EXPECT_RESPONSE_CODE = 200
+	config = """
+setup { module_load "mod_status"; }
+status.info;
+"""
+
+	def CheckResponse(self):
+		for line in self.ResponseBody().splitlines():
+			if line.startswith("compress_skipped: "):
+				skipped = int(line.split(": ", 1)[1])
+				if skipped < 1:
+					raise CurlRequestException("Unexpected compress_skipped %i (wanted at least 1)" % (skipped))
+				return True
+		raise CurlRequestException("Missing compress_skipped in status")
+
 class TestDisableDeflate(CurlRequest):
 	URL = "/test.txt?nodeflate"
 	EXPECT_RESPONSE_BODY = TEST_TXT
@@ -41,11 +141,18 @@ class TestDisableDeflate(CurlRequest):
 
 
 class Test(GroupTest):
-	group = [TestGzip, TestXGzip, TestDeflate, TestBzip2, TestXBzip2, TestDisableDeflate]
+	group = [TestGzip, TestXGzip, TestDeflate, TestBzip2, TestXBzip2, TestBrotli, TestZstd, TestQValues, TestQZero, TestServerPreference, TestAdaptive, TestAdaptiveOverload, TestAdaptiveSkipped, TestDisableDeflate]
 
 	def Prepare(self):
 		# deflate is enabled global too; force it here anyway
 		self.config = """
 defaultaction;
-if req.query == "nodeflate" { req_header.remove "Accept-Encoding"; } static; do_deflate;
+if req.query == "nodeflate" { req_header.remove "Accept-Encoding"; } static;
+if req.query == "adaptive" {
+	deflate [ "compression-level" => 6, "adaptive" => [ 50, 80 ], "min-compression-levels" => [ "gzip" => 1 ], "adaptive-max-size" => 1mbyte ];
+} else if req.query == "overload" {
+	deflate [ "compression-level" => 1, "adaptive" => [ 0, 0 ], "adaptive-max-size" => 1 ];
+} else {
+	do_deflate;
+}
 """
@@ -0,0 +1,125 @@
+# -*- coding: utf-8 -*-
+
+from base import *
+from requests import *
+from service import FastCGI
+import pycurl
+import StringIO
+import time
+import os
+
+BIG_BODY = ''.join(["%07i\n" % i for i in xrange(256*1024)])
+POST_BODY = 'x' * (1024*1024)
+
+class FastCGIMux(FastCGI):
+	name = "fastcgi-mux"
+
+	def __init__(self):
+		super(FastCGIMux, self).__init__()
+		self.binary = [ os.path.join(Env.sourcedir, "tests", "run-fastcgi-mux.py") ]
+
+class TestSimple(CurlRequest):
+	URL = "/fcgi/?conn"
+	EXPECT_RESPONSE_CODE = 200
+
+	def CheckResponse(self):
+		int(self.resp.body)
+		return super(TestSimple, self).CheckResponse()
+
+class TestPost(CurlRequest):
+	URL = "/fcgi/?post"
+	POST = POST_BODY
+	EXPECT_RESPONSE_BODY = str(len(POST_BODY))
+	EXPECT_RESPONSE_CODE = 200
+
+class TestBig(CurlRequest):
+	URL = "/fcgi/?big"
+	EXPECT_RESPONSE_BODY = BIG_BODY
+	EXPECT_RESPONSE_CODE = 200
+
+class TestMuxPost(CurlRequest):
+	URL = "/fcgi-mux/?post"
+	POST = POST_BODY
+	EXPECT_RESPONSE_BODY = str(len(POST_BODY))
+	EXPECT_RESPONSE_CODE = 200
+
+class TestMuxBig(CurlRequest):
+	URL = "/fcgi-mux/?big"
+	EXPECT_RESPONSE_BODY = BIG_BODY
+	EXPECT_RESPONSE_CODE = 200
+
+class TestMuxShared(TestBase):
+	"""concurrent requests share backend connections"""
+	REQUESTS = 6
+
+	def Run(self):
+		m = pycurl.CurlMulti()
+		handles = []
+		try:
+			for i in xrange(self.REQUESTS):
+				c = pycurl.Curl()
+				b = StringIO.StringIO()
+				c.setopt(pycurl.URL, "http://127.0.0.2:%i/fcgi-mux/?delay" % (Env.port))
+				c.setopt(pycurl.HTTPHEADER, ["Host: " + self.vhost])
+				c.setopt(pycurl.WRITEFUNCTION, b.write)
+				c.setopt(pycurl.NOSIGNAL, 1)
+				c.setopt(pycurl.TIMEOUT, 5)
+				c.setopt(pycurl.FORBID_REUSE, 1)
+				m.add_handle(c)
+				handles.append((c, b))
+				# the first request on a connection finds out whether the backend can multiplex
+				start = time.time()
+				while time.time() - start < 0.1:
+					m.perform()
+					m.select(0.01)
+
+			while True:
+				ret, active = m.perform()
+				if 0 == active: break
+				m.select(0.1)
+
+			cons = set()
+			for (c, b) in handles:
+				if 200 != c.getinfo(pycurl.RESPONSE_CODE):
+					raise CurlRequestException("Unexpected response code %i (wanted 200)" % (c.getinfo(pycurl.RESPONSE_CODE)))
+				cons.add(b.getvalue())
+		finally:
+			for (c, b) in handles:
+				m.remove_handle(c)
+				c.close()
+			m.close()
+
+		if len(cons) >= self.REQUESTS:
+			raise CurlRequestException("%i concurrent requests used %i backend connections" % (self.REQUESTS, len(cons)))
+		return True
+
+class Test(GroupTest):
+	group = [
+		TestSimple,
+		TestPost,
+		TestBig,
+		TestMuxPost,
+		TestMuxBig,
+		TestMuxShared,
+	]
+
+	config = """
+run_fastcgi;
+"""
+
+	def FeatureCheck(self):
+		fcgi = FastCGIMux()
+		self.plain_config = """
+setup {{ module_load "mod_fastcgi"; }}
+
+run_fastcgi = {{
+	if req.path =^ "/fcgi-mux/" {{
+		fastcgi ("unix:{socket}", [ "multiplex" => 8 ]);
+	}} else {{
+		fastcgi "unix:{socket}";
+	}}
+}};
+""".format(socket = fcgi.sockfile)
+
+		self.tests.add_service(fcgi)
+		return True
@@ -0,0 +1,335 @@
+# -*- coding: utf-8 -*-
+
+from base import *
+from requests import *
+import pycurl
+import StringIO
+import socket
+import struct
+import time
+import hashlib
+
+def generate_body(seed, size):
+	i = 0
+	body = ''
+	while len(body) < size:
+		body += hashlib.sha1(seed + str(i)).digest()
+		i += 1
+	return body[:size]
+
+class Http2Request(CurlRequest):
+	def FeatureCheck(self):
+		if not hasattr(pycurl, 'CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE'):
+			return self.MissingFeature('pycurl http2')
+		return True
+
+	def CheckResponse(self):
+		if not self.resp_first_line.startswith("HTTP/2"):
+			raise CurlRequestException("Expected a HTTP/2 response, got '%s'" % (self.resp_first_line))
+		return True
+
+class TestPriorKnowledge(Http2Request):
+	URL = "/test.txt"
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Type", "text/plain; charset=utf-8")]
+
+	def Prepare(self):
+		self.HTTP_VERSION = pycurl.CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+
+class TestPriorKnowledgeStatus(Http2Request):
+	URL = "/test.txt"
+	EXPECT_RESPONSE_BODY = "hello"
+	EXPECT_RESPONSE_CODE = 403
+	config = """
+respond 403 => "hello";
+"""
+
+	def Prepare(self):
+		self.HTTP_VERSION = pycurl.CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+
+class TestPriorKnowledgePost(Http2Request):
+	URL = "/post"
+	POST = "a" * 100000
+	EXPECT_RESPONSE_BODY = "100000"
+	EXPECT_RESPONSE_CODE = 200
+	config = """
+respond "%{req.header[Content-Length]}";
+"""
+
+	def Prepare(self):
+		self.HTTP_VERSION = pycurl.CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE
+
+class TestUpgrade(Http2Request):
+	URL = "/test.txt?upgrade"
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Type", "text/plain; charset=utf-8")]
+
+	def Prepare(self):
+		self.HTTP_VERSION = pycurl.CURL_HTTP_VERSION_2_0
+
+	def _recv_header(self, header):
+		# skip the "101 Switching Protocols" response
+		if None == self.resp_first_line and header.startswith("HTTP/1.1 101"):
+			self.skip_101 = True
+			return
+		if getattr(self, 'skip_101', False):
+			if "" == header.rstrip():
+				self.skip_101 = False
+			return
+		super(TestUpgrade, self)._recv_header(header)
+
+class Http2Multi(TestBase):
+	"""runs requests concurrently with pycurl, multiplexed on as few connections as possible"""
+	FILES = 16
+	FILE_SIZE = 256*1024
+	POST_SIZE = 200*1024
+	config = """
+if req.path =^ "/post" {
+	respond "%{req.header[Content-Length]}";
+} else {
+	static;
+}
+"""
+
+	def FeatureCheck(self):
+		for feature in [ 'CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE', 'PIPEWAIT', 'PIPE_MULTIPLEX', 'M_MAX_HOST_CONNECTIONS', 'NUM_CONNECTS' ]:
+			if not hasattr(pycurl, feature):
+				return self.MissingFeature('pycurl http2 multiplexing')
+		return True
+
+	def Prepare(self):
+		self.bodies = [ generate_body("file%i" % i, self.FILE_SIZE) for i in xrange(self.FILES) ]
+		for i in xrange(self.FILES):
+			self.PrepareVHostFile("file%i" % i, self.bodies[i])
+
+	def multi(self, requests, connections):
+		"""requests: list of (path, post body or None, expected body); returns the order in which
+		the responses received data (list of request indices) and the number of connections used"""
+		m = pycurl.CurlMulti()
+		m.setopt(pycurl.M_PIPELINING, pycurl.PIPE_MULTIPLEX)
+		m.setopt(pycurl.M_MAX_HOST_CONNECTIONS, connections)
+		handles = []
+		order = []
+		try:
+			for (i, (path, post, expected)) in enumerate(requests):
+				c = pycurl.Curl()
+				b = StringIO.StringIO()
+				status = []
+				def write(data, i = i, b = b):
+					if 0 == len(order) or order[-1] != i: order.append(i)
+					b.write(data)
+				def header(line, status = status):
+					if 0 == len(status): status.append(line.strip())
+				c.setopt(pycurl.URL, "http://127.0.0.2:%i%s" % (Env.port, path))
+				c.setopt(pycurl.HTTPHEADER, ["Host: " + self.vhost])
+				c.setopt(pycurl.HTTP_VERSION, pycurl.CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE)
+				c.setopt(pycurl.PIPEWAIT, 1)
+				c.setopt(pycurl.WRITEFUNCTION, write)
+				c.setopt(pycurl.HEADERFUNCTION, header)
+				c.setopt(pycurl.NOSIGNAL, 1)
+				c.setopt(pycurl.TIMEOUT, 20)
+				if None != post: c.setopt(pycurl.POSTFIELDS, post)
+				m.add_handle(c)
+				handles.append((c, b, status, expected))
+
+			while True:
+				ret, active = m.perform()
+				if 0 == active: break
+				m.select(0.1)
+
+			used = 0
+			for (i, (c, b, status, expected)) in enumerate(handles):
+				if 0 == len(status) or not status[0].startswith("HTTP/2"):
+					raise CurlRequestException("request %i: expected a HTTP/2 response, got '%s'" % (i, status))
+				if 200 != c.getinfo(pycurl.RESPONSE_CODE):
+					raise CurlRequestException("request %i: unexpected response code %i (wanted 200)" % (i, c.getinfo(pycurl.RESPONSE_CODE)))
+				if expected != b.getvalue():
+					raise CurlRequestException("request %i: unexpected response body (%i bytes, wanted %i)" % (i, len(b.getvalue()), len(expected)))
+				used += c.getinfo(pycurl.NUM_CONNECTS)
+		finally:
+			for (c, b, status, expected) in handles:
+				m.remove_handle(c)
+				c.close()
+			m.close()
+
+		return (order, used)
+
+class TestMultiplexed(Http2Multi):
+	"""many concurrent streams on one connection: the responses are interleaved and bigger than the
+	flow control windows, as are the request bodies"""
+
+	def Run(self):
+		requests = []
+		for i in xrange(self.FILES):
+			requests.append(("/file%i" % i, None, self.bodies[i]))
+			requests.append(("/post%i" % i, "p" * self.POST_SIZE, str(self.POST_SIZE)))
+		(order, used) = self.multi(requests, 1)
+		if 1 != used:
+			raise CurlRequestException("%i concurrent requests used %i connections" % (len(requests), used))
+		if len(order) <= self.FILES:
+			raise CurlRequestException("responses weren't interleaved")
+		return True
+
+class TestLoad(Http2Multi):
+	"""lots of streams on a few connections"""
+	CONNECTIONS = 4
+	REQUESTS = 400
+
+	def Run(self):
+		requests = []
+		for i in xrange(self.REQUESTS):
+			if 0 == i % 10:
+				requests.append(("/post%i" % i, "p" * 1000, "1000"))
+			else:
+				requests.append(("/file%i" % (i % self.FILES), None, self.bodies[i % self.FILES]))
+		(order, used) = self.multi(requests, self.CONNECTIONS)
+		if used > self.CONNECTIONS:
+			raise CurlRequestException("%i requests used %i connections (allowed %i)" % (self.REQUESTS, used, self.CONNECTIONS))
+		return True
+
+H2_DATA = 0
+H2_HEADERS = 1
+H2_RST_STREAM = 3
+H2_SETTINGS = 4
+H2_GOAWAY = 7
+H2_WINDOW_UPDATE = 8
+H2_END_STREAM = 0x1
+H2_END_HEADERS = 0x4
+H2_ACK = 0x1
+H2_SETTINGS_INITIAL_WINDOW_SIZE = 4
+
+class TestFlowControl(TestBase):
+	"""raw HTTP/2 client with small windows: the server must not send more than the windows allow,
+	and must continue after WINDOW_UPDATE"""
+	FILES = 4
+	FILE_SIZE = 100000
+	STREAM_WINDOW = 4096
+	CONNECTION_WINDOW = 65535 # default, can only be changed by WINDOW_UPDATE
+	config = """
+static;
+"""
+
+	def Prepare(self):
+		self.bodies = [ generate_body("flow%i" % i, self.FILE_SIZE) for i in xrange(self.FILES) ]
+		for i in xrange(self.FILES):
+			self.PrepareVHostFile("flow%i" % i, self.bodies[i])
+
+	def frame(self, ftype, flags, stream_id, payload):
+		return struct.pack('!I', len(payload))[1:] + struct.pack('!BBI', ftype, flags, stream_id) + payload
+
+	def literal(self, name, value):
+		# literal header field without indexing, new name, no huffman coding
+		return '\0' + chr(len(name)) + name + chr(len(value)) + value
+
+	def read_frame(self):
+		while True:
+			if len(self.buf) >= 9:
+				length = struct.unpack('!I', '\0' + self.buf[:3])[0]
+				if len(self.buf) >= 9 + length:
+					(ftype, flags, stream_id) = struct.unpack('!BBI', self.buf[3:9])
+					payload = self.buf[9:9+length]
+					self.buf = self.buf[9+length:]
+					return (ftype, flags, stream_id & 0x7fffffff, payload)
+			data = self.sock.recv(65536)
+			if 0 == len(data):
+				raise CurlRequestException("connection closed by server")
+			self.buf += data
+
+	def receive(self, idle):
+		"""handles frames until all streams are finished or no DATA arrived for 'idle' seconds"""
+		self.sock.settimeout(idle)
+		while len(self.finished) < self.FILES:
+			try:
+				(ftype, flags, stream_id, payload) = self.read_frame()
+			except socket.timeout:
+				return
+			if H2_SETTINGS == ftype:
+				if 0 == flags & H2_ACK: self.sock.sendall(self.frame(H2_SETTINGS, H2_ACK, 0, ''))
+			elif H2_GOAWAY == ftype or H2_RST_STREAM == ftype:
+				raise CurlRequestException("stream %i: unexpected frame type %i" % (stream_id, ftype))
+			elif H2_HEADERS == ftype:
+				self.headers.add(stream_id)
+			elif H2_DATA == ftype:
+				if not stream_id in self.headers:
+					raise CurlRequestException("stream %i: DATA before HEADERS" % (stream_id))
+				self.bodies_received[stream_id] += payload
+				self.connection_received += len(payload)
+				if len(self.bodies_received[stream_id]) > self.stream_windows[stream_id]:
+					raise CurlRequestException("stream %i: received %i bytes, window was %i" % (stream_id, len(self.bodies_received[stream_id]), self.stream_windows[stream_id]))
+				if self.connection_received > self.connection_window:
+					raise CurlRequestException("received %i bytes, connection window was %i" % (self.connection_received, self.connection_window))
+				if 0 == len(self.order) or self.order[-1] != stream_id: self.order.append(stream_id)
+				if 0 != flags & H2_END_STREAM: self.finished.add(stream_id)
+
+	def Run(self):
+		streams = [ 2*i + 1 for i in xrange(self.FILES) ]
+		self.buf = ''
+		self.headers = set()
+		self.finished = set()
+		self.order = []
+		self.bodies_received = dict([ (s, '') for s in streams ])
+		self.stream_windows = dict([ (s, self.STREAM_WINDOW) for s in streams ])
+		self.connection_window = self.CONNECTION_WINDOW
+		self.connection_received = 0
+
+		self.sock = socket.create_connection(("127.0.0.2", Env.port), 5)
+		try:
+			out = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n"
+			out += self.frame(H2_SETTINGS, 0, 0, struct.pack('!HI', H2_SETTINGS_INITIAL_WINDOW_SIZE, self.STREAM_WINDOW))
+			for (i, s) in enumerate(streams):
+				block = self.literal(":method", "GET") + self.literal(":scheme", "http") + self.literal(":path", "/flow%i" % i) + self.literal(":authority", self.vhost)
+				out += self.frame(H2_HEADERS, H2_END_STREAM | H2_END_HEADERS, s, block)
+			self.sock.sendall(out)
+
+			# the stream windows block all streams
+			self.receive(0.5)
+			for s in streams:
+				if len(self.bodies_received[s]) != self.STREAM_WINDOW:
+					raise CurlRequestException("stream %i: received %i bytes, expected the full window %i" % (s, len(self.bodies_received[s]), self.STREAM_WINDOW))
+
+			# now the connection window blocks
+			out = ''
+			for s in streams:
+				out += self.frame(H2_WINDOW_UPDATE, 0, s, struct.pack('!I', self.FILE_SIZE))
+				self.stream_windows[s] += self.FILE_SIZE
+			self.sock.sendall(out)
+			self.receive(0.5)
+			if self.connection_received != self.CONNECTION_WINDOW:
+				raise CurlRequestException("received %i bytes, expected the full connection window %i" % (self.connection_received, self.CONNECTION_WINDOW))
+
+			# everything else; all streams have data and window, so they get interleaved
+			interleaved = len(self.order)
+			increment = self.FILES * self.FILE_SIZE
+			self.sock.sendall(self.frame(H2_WINDOW_UPDATE, 0, 0, struct.pack('!I', increment)))
+			self.connection_window += increment
+			self.receive(5)
+			if len(self.finished) < self.FILES:
+				raise CurlRequestException("only %i of %i streams finished" % (len(self.finished), self.FILES))
+			if len(self.order) - interleaved <= self.FILES:
+				raise CurlRequestException("responses weren't interleaved")
+		finally:
+			self.sock.close()
+
+		for (i, s) in enumerate(streams):
+			if self.bodies[i] != self.bodies_received[s]:
+				raise CurlRequestException("stream %i: unexpected body (%i bytes, wanted %i)" % (s, len(self.bodies_received[s]), len(self.bodies[i])))
+		return True
+
+class Test(GroupTest):
+	group = [
+		TestPriorKnowledge,
+		TestPriorKnowledgeStatus,
+		TestPriorKnowledgePost,
+		TestUpgrade,
+		TestMultiplexed,
+		TestLoad,
+		TestFlowControl,
+	]
+
+	def FeatureCheck(self):
+		self.plain_config = """
+setup { http2 true; }
+"""
+		return True
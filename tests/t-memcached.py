@@ -1,22 +1,28 @@
 # -*- coding: utf-8 -*-
 
-from base import GroupTest
-from requests import CurlRequest
+from base import GroupTest, TestBase
+from requests import CurlRequest, CurlRequestException
 from service import Service
 import socket
+import sys
 import os
 import base
 import time
+import hashlib
+import struct
+import pycurl
+import StringIO
 
 
 class Memcached(Service):
 	name = "memcached"
 	binary = [ None ]
 
-	def __init__(self):
+	def __init__(self, name = None, options = []):
+		if None != name: self.name = name
 		super(Memcached, self).__init__()
 		self.sockfile = os.path.join(base.Env.dir, "tmp", "sockets", self.name + ".sock")
-		self.binary = [ os.path.join(base.Env.sourcedir, "tests", "run-memcached.py") ]
+		self.binary = [ os.path.join(base.Env.sourcedir, "tests", "run-memcached.py") ] + options
 
 
 	def Prepare(self):
@@ -52,10 +58,117 @@ class TestLookup1(CurlRequest):
 		time.sleep(0.2)
 		return super(TestLookup1, self).Run()
 
+class TestMetaStore(CurlRequest):
+	URL = "/"
+	EXPECT_RESPONSE_BODY = "Hello Meta!"
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("X-Memcached-Hit", "false")]
+	config = """
+memcache_meta;
+"""
+
+class TestMetaLookup(CurlRequest):
+	URL = "/"
+	EXPECT_RESPONSE_BODY = "Hello Meta!"
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("X-Memcached-Hit", "true")]
+	config = """
+memcache_meta;
+"""
+
+	def Run(self):
+		time.sleep(0.2)
+		return super(TestMetaLookup, self).Run()
+
+# same distribution as mc_ctx_build_ring / mc_ctx_ring_find in mod_memcached
+def ketama_server(servers, key):
+	points = []
+	for (server, name) in enumerate(servers):
+		for i in xrange(40):
+			digest = hashlib.md5("%s-%i" % (name, i)).digest()
+			for j in xrange(4):
+				points.append((struct.unpack('<I', digest[4*j:4*j+4])[0], server))
+	points.sort()
+	h = struct.unpack('<I', hashlib.md5(key).digest()[:4])[0]
+	for (point, server) in points:
+		if point >= h: return server
+	return points[0][1]
+
+def get(vhost, path):
+	c = pycurl.Curl()
+	b = StringIO.StringIO()
+	headers = dict()
+	def header(line):
+		if ':' in line:
+			(key, value) = line.split(':', 1)
+			headers[key.strip().lower()] = value.strip()
+	c.setopt(pycurl.URL, "http://127.0.0.2:%i%s" % (base.Env.port, path))
+	c.setopt(pycurl.HTTPHEADER, ["Host: " + vhost])
+	c.setopt(pycurl.WRITEFUNCTION, b.write)
+	c.setopt(pycurl.HEADERFUNCTION, header)
+	c.setopt(pycurl.NOSIGNAL, 1)
+	c.setopt(pycurl.TIMEOUT, 5)
+	try:
+		c.perform()
+		return (c.getinfo(pycurl.RESPONSE_CODE), b.getvalue(), headers.get("x-memcached-hit"))
+	finally:
+		c.close()
+
+class TestRing(TestBase):
+	"""keys are stored on the server the ketama ring selects"""
+	KEYS = 16
+	config = """
+memcache_ring;
+"""
+
+	def Run(self):
+		servers = [ "unix:" + self.tests.memcached_ring[0].sockfile, "unix:" + self.tests.memcached_ring[1].sockfile ]
+		used = set()
+		for i in xrange(self.KEYS):
+			if (200, "ring", "false") != get(self.vhost, "/ring/%i" % i):
+				raise CurlRequestException("unexpected response for first request of key %i" % i)
+		time.sleep(0.2)
+		for i in xrange(self.KEYS):
+			key = "/ring/%i" % i
+			server = ketama_server(servers, key)
+			used.add(server)
+			if (200, "ring", None) != get(self.vhost, "/check-%i/?%s" % (server, key)):
+				raise CurlRequestException("key '%s' not stored on server %i" % (key, server))
+			if 404 != get(self.vhost, "/check-%i/?%s" % (1 - server, key))[0]:
+				raise CurlRequestException("key '%s' stored on server %i too" % (key, 1 - server))
+			if (200, "ring", "true") != get(self.vhost, key):
+				raise CurlRequestException("lookup of key '%s' failed" % (key))
+		if 2 != len(used):
+			raise CurlRequestException("keys not distributed over the servers")
+		return True
+
+class TestFailover(TestBase):
+	"""keys of a server which is down or doesn't answer are stored on the next server"""
+	config = """
+memcache_failover;
+"""
+
+	def Run(self):
+		for (n, down) in enumerate([ self.tests.memcached_hang.sockfile, self.tests.memcached_down ]):
+			servers = [ "unix:" + down, "unix:" + self.tests.memcached_ring[0].sockfile ]
+			keys = [ "/failover-%i/%i" % (n, i) for i in xrange(16) ]
+			key = [ key for key in keys if 0 == ketama_server(servers, key) ][0]
+			# the server of the key doesn't answer (fails after the "timeout") or can't be connected: miss
+			if (200, "failover", "false") != get(self.vhost, key):
+				raise CurlRequestException("unexpected response for first request of key '%s'" % key)
+			time.sleep(0.2)
+			if (200, "failover", "true") != get(self.vhost, key):
+				raise CurlRequestException("key '%s' wasn't stored on the next server" % key)
+		return True
+
 class Test(GroupTest):
 	group = [
 		TestStore1,
 		TestLookup1,
+		TestMetaStore,
+		TestMetaLookup,
+		TestRing,
+		TestFailover,
 	]
 
 	config = """
@@ -64,6 +177,12 @@ memcache;
 
 	def FeatureCheck(self):
 		memcached = Memcached()
+		meta = Memcached("memcached-meta", [ "--meta-only" ])
+		ring = [ Memcached("memcached-a"), Memcached("memcached-b") ]
+		hang = Memcached("memcached-hang", [ "--hang" ])
+		self.tests.memcached_ring = ring
+		self.tests.memcached_hang = hang
+		self.tests.memcached_down = os.path.join(base.Env.dir, "tmp", "sockets", "memcached-down.sock")
 		self.plain_config = """
 setup {{ module_load "mod_memcached"; }}
 
@@ -76,7 +195,55 @@ memcache = {{
 			memcached.store ( "server" => "unix:{socket}" );
 		}});
 }};
-""".format(socket = memcached.sockfile)
 
-		self.tests.add_service(memcached)
+memcache_meta = {{
+	memcached.lookup (( "server" => "unix:{meta}", "protocol" => "meta" ), {{
+			header.add "X-Memcached-Hit" => "true";
+		}}, {{
+			header.add "X-Memcached-Hit" => "false";
+			respond 200 => "Hello Meta!";
+			memcached.store ( "server" => "unix:{meta}", "protocol" => "meta" );
+		}});
+}};
+
+memcache_ring = {{
+	if req.path =^ "/check-0/" {{
+		memcached.lookup (( "server" => "unix:{a}", "key" => "%{{req.query}}" ), {{ }}, {{ respond 404; }});
+	}} else if req.path =^ "/check-1/" {{
+		memcached.lookup (( "server" => "unix:{b}", "key" => "%{{req.query}}" ), {{ }}, {{ respond 404; }});
+	}} else {{
+		memcached.lookup (( "server" => [ "unix:{a}", "unix:{b}" ] ), {{
+				header.add "X-Memcached-Hit" => "true";
+			}}, {{
+				header.add "X-Memcached-Hit" => "false";
+				respond 200 => "ring";
+				memcached.store ( "server" => [ "unix:{a}", "unix:{b}" ] );
+			}});
+	}}
+}};
+
+memcache_failover = {{
+	if req.path =^ "/failover-0/" {{
+		memcached.lookup (( "server" => [ "unix:{hang}", "unix:{a}" ], "timeout" => 1 ), {{
+				header.add "X-Memcached-Hit" => "true";
+			}}, {{
+				header.add "X-Memcached-Hit" => "false";
+				respond 200 => "failover";
+				memcached.store ( "server" => [ "unix:{hang}", "unix:{a}" ], "timeout" => 1 );
+			}});
+	}} else {{
+		memcached.lookup (( "server" => [ "unix:{down}", "unix:{a}" ] ), {{
+				header.add "X-Memcached-Hit" => "true";
+			}}, {{
+				header.add "X-Memcached-Hit" => "false";
+				respond 200 => "failover";
+				memcached.store ( "server" => [ "unix:{down}", "unix:{a}" ] );
+			}});
+	}}
+}};
+""".format(socket = memcached.sockfile, meta = meta.sockfile, a = ring[0].sockfile, b = ring[1].sockfile,
+			hang = hang.sockfile, down = self.tests.memcached_down)
+
+		for service in [ memcached, meta, hang ] + ring:
+			self.tests.add_service(service)
 		return True
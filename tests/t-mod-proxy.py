@@ -3,6 +3,10 @@
 from base import *
 from requests import *
 
+import pycurl
+import StringIO
+import time
+
 class TestSimple(CurlRequest):
 	URL = "/test.txt"
 	EXPECT_RESPONSE_CODE = 200
@@ -47,19 +51,135 @@ req_header.overwrite "Host" => "encodedurl.mod-proxy";
 self_proxy;
 """
 
+# backend answers with the client port of the connection the request came in on
+class ProvideRemotePort(TestBase):
+	runnable = False
+	vhost = "remoteport.mod-proxy"
+	no_docroot = True
+	config = """
+respond 200 => "%{req.remoteport}";
+"""
+
+# second request reuses the backend connection of the first one: the backend sees the same port twice
+class TestKeepAlive(TestBase):
+	no_docroot = True
+	config = """
+req_header.overwrite "Host" => "remoteport.mod-proxy";
+self_proxy;
+"""
+
+	def Run(self):
+		# both requests on one client connection: idle backend connections are kept per worker
+		c = pycurl.Curl()
+		c.setopt(pycurl.URL, "http://127.0.0.2:%i/" % (Env.port))
+		c.setopt(pycurl.HTTPHEADER, ["Host: " + self.vhost])
+		c.setopt(pycurl.NOSIGNAL, 1)
+		c.setopt(pycurl.TIMEOUT, 2)
+		ports = []
+		try:
+			for i in xrange(2):
+				b = StringIO.StringIO()
+				c.setopt(pycurl.WRITEFUNCTION, b.write)
+				c.perform()
+				if 200 != c.getinfo(pycurl.RESPONSE_CODE):
+					raise CurlRequestException("Unexpected response code %i (wanted 200)" % (c.getinfo(pycurl.RESPONSE_CODE)))
+				ports.append(b.getvalue())
+				# the backend connection goes back to the pool after the response was received
+				time.sleep(0.1)
+		finally:
+			c.close()
+
+		if ports[0] != ports[1]:
+			raise CurlRequestException("Backend connection not reused: requests came from ports %s and %s" % (ports[0], ports[1]))
+		return True
+
+class ProvideHealth(TestBase):
+	runnable = False
+	vhost = "health.mod-proxy"
+	no_docroot = True
+	config = """
+if req.query == "fail" {
+	respond 500 => "fail";
+} else {
+	respond 200 => "ok";
+}
+"""
+
+# a server error ejects the backend (max-fails 1); the active check brings it back
+class TestHealth(TestBase):
+	no_docroot = True
+	config = """
+req_header.overwrite "Host" => "health.mod-proxy";
+health_proxy;
+"""
+
+	def get(self, query):
+		c = pycurl.Curl()
+		c.setopt(pycurl.URL, "http://127.0.0.2:%i/?%s" % (Env.port, query))
+		c.setopt(pycurl.HTTPHEADER, ["Host: " + self.vhost])
+		c.setopt(pycurl.WRITEFUNCTION, StringIO.StringIO().write)
+		c.setopt(pycurl.NOSIGNAL, 1)
+		c.setopt(pycurl.TIMEOUT, 5)
+		try:
+			c.perform()
+			return c.getinfo(pycurl.RESPONSE_CODE)
+		finally:
+			c.close()
+
+	def expect(self, query, status):
+		result = self.get(query)
+		if status != result:
+			raise CurlRequestException("Unexpected response code %i for '%s' (wanted %i)" % (result, query, status))
+
+	def Run(self):
+		self.expect("ok", 200)
+		self.expect("fail", 500)
+		# ejected: requests fail without asking the backend
+		self.expect("ok", 503)
+
+		for i in xrange(50):
+			time.sleep(0.1)
+			if 200 == self.get("ok"): return True
+		raise CurlRequestException("Backend didn't recover")
+
+class TestNoKeepAlive(CurlRequest):
+	URL = "/test.txt"
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	config = """
+req_header.overwrite "Host" => "basic-gets";
+self_proxy_close;
+"""
+	no_docroot = True
+
 class Test(GroupTest):
 	group = [
 		TestSimple,
 		TestEncodedURL,
 		TestProxiedRewrittenEncodedURL,
 		TestProxiedRewrittenDecodedURL,
+		ProvideRemotePort,
+		TestKeepAlive,
+		ProvideHealth,
+		TestHealth,
+		TestNoKeepAlive,
 	]
 
 	def Prepare(self):
+		# served by the default vhost for the active checks of health_proxy
+		self.PrepareFile("www/default/proxy-health.txt", "ok\n")
 		self.plain_config = """
 setup {{ module_load "mod_proxy"; }}
 
 self_proxy = {{
-	proxy "127.0.0.2:{self_port}";
+	proxy ("127.0.0.2:{self_port}", [ "keepalive" => true ]);
+}};
+
+self_proxy_close = {{
+	proxy ("127.0.0.2:{self_port}", [ "keepalive" => false ]);
+}};
+
+health_proxy = {{
+	proxy ("127.0.0.2:{self_port}", [ "max-fails" => 1, "check-interval" => 1, "check-path" => "/proxy-health.txt" ]);
 }};
 """.format(self_port = Env.port)
@@ -0,0 +1,100 @@
+# -*- coding: utf-8 -*-
+
+from base import *
+from requests import *
+
+import struct
+import zlib
+
+def gzip_encode(data):
+	# fixed header without mtime, so CurlRequest._decode accepts it
+	c = zlib.compressobj(9, zlib.DEFLATED, -15)
+	body = c.compress(data) + c.flush()
+	return "\x1f\x8b\x08\x00\x00\x00\x00\x00\x00\x03" + body + struct.pack("<II", zlib.crc32(data) & 0xffffffff, len(data) & 0xffffffff)
+
+PRECOMPRESSED_TXT = "precompressed variant\n" * 10
+
+class TestPrecompressedGzip(CurlRequest):
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = 'gzip'
+	EXPECT_RESPONSE_BODY = PRECOMPRESSED_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip"), ("Vary", "Accept-Encoding")]
+
+class TestPrecompressedXGzip(CurlRequest):
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = 'x-gzip'
+	EXPECT_RESPONSE_BODY = PRECOMPRESSED_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip"), ("Vary", "Accept-Encoding")]
+
+class TestPrecompressedNoVariant(CurlRequest):
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = 'br'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", None)]
+
+class TestPrecompressedIdentity(CurlRequest):
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = None
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", None)]
+
+class TestPrecompressedStarZero(CurlRequest):
+	# "*" doesn't refuse the listed gzip
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = 'gzip;q=1.0, identity;q=0.5, *;q=0'
+	EXPECT_RESPONSE_BODY = PRECOMPRESSED_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip")]
+
+class TestPrecompressedGzipRefused(CurlRequest):
+	URL = "/pre/test.txt"
+	ACCEPT_ENCODING = 'gzip;q=0, *'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", None)]
+
+class TestPrecompressedQOrder(CurlRequest):
+	# br has the higher q-value, although gzip comes first in the config
+	URL = "/pre/both.txt"
+	ACCEPT_ENCODING = 'gzip;q=0.5, br;q=1'
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "br")]
+
+class TestPrecompressedQOrderGzip(CurlRequest):
+	URL = "/pre/both.txt"
+	ACCEPT_ENCODING = 'gzip;q=1, br;q=0.5'
+	EXPECT_RESPONSE_BODY = PRECOMPRESSED_TXT
+	EXPECT_RESPONSE_CODE = 200
+	EXPECT_RESPONSE_HEADERS = [("Content-Encoding", "gzip")]
+
+class TestPrecompressedMissing(CurlRequest):
+	# no .gz file: falls back to the original file (maybe compressed by mod_deflate)
+	URL = "/pre/other.txt"
+	ACCEPT_ENCODING = 'gzip'
+	EXPECT_RESPONSE_BODY = TEST_TXT
+	EXPECT_RESPONSE_CODE = 200
+
+class Test(GroupTest):
+	group = [
+		TestPrecompressedGzip, TestPrecompressedXGzip, TestPrecompressedNoVariant, TestPrecompressedIdentity,
+		TestPrecompressedStarZero, TestPrecompressedGzipRefused, TestPrecompressedQOrder, TestPrecompressedQOrderGzip,
+		TestPrecompressedMissing
+	]
+
+	def Prepare(self):
+		self.PrepareVHostFile("pre/test.txt", TEST_TXT)
+		self.PrepareVHostFile("pre/test.txt.gz", gzip_encode(PRECOMPRESSED_TXT))
+		self.PrepareVHostFile("pre/other.txt", TEST_TXT)
+		self.PrepareVHostFile("pre/both.txt", TEST_TXT)
+		self.PrepareVHostFile("pre/both.txt.gz", gzip_encode(PRECOMPRESSED_TXT))
+		# content doesn't matter, the body isn't decoded
+		self.PrepareVHostFile("pre/both.txt.br", "not really brotli")
+		self.config = """
+defaultaction;
+static.precompressed [ "gzip", "br" ];
+static;
+"""